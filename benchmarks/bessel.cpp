@@ -0,0 +1,73 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Bessel.h"
+#include "constants.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+using namespace optimet;
+
+//! The functions up to nMax at |z| = range / 10, half way between the real and imaginary axes
+template <BESSEL_TYPE TYPE> void bessel_workspace(benchmark::State &state) {
+  auto const nMax = state.range(0);
+  t_complex const z = std::polar(0.1 * state.range(1), 0.25 * consPi);
+  BesselWorkspace workspace;
+  for(auto _ : state)
+    benchmark::DoNotOptimize(bessel<TYPE>(z, nMax, workspace).data.data());
+  state.SetItemsProcessed(state.iterations() * (nMax + 1));
+}
+
+//! The same functions from the AMOS routines, the reference of the recurrences
+template <BESSEL_TYPE TYPE> void bessel_amos(benchmark::State &state) {
+  auto const nMax = state.range(0);
+  t_complex const z = std::polar(0.1 * state.range(1), 0.25 * consPi);
+  BesselWorkspace workspace;
+  std::vector<t_complex> functions(nMax + 2);
+  for(auto _ : state) {
+    details::amos<TYPE, false>(z, nMax + 2, functions.data(), workspace);
+    benchmark::DoNotOptimize(functions.data());
+  }
+  state.SetItemsProcessed(state.iterations() * (nMax + 1));
+}
+
+//! The functions of 1000 arguments of moduli up to range / 10 at once
+template <BESSEL_TYPE TYPE> void bessel_arguments(benchmark::State &state) {
+  auto const nMax = state.range(0);
+  std::vector<t_complex> z(1000);
+  for(std::size_t i = 0; i < z.size(); ++i)
+    z[i] = std::polar(0.1 * state.range(1) * (i + 1) / z.size(), 0.25 * consPi);
+  std::vector<t_complex> data((nMax + 1) * z.size()), ddata((nMax + 1) * z.size());
+  for(auto _ : state) {
+    bessel_batch<TYPE>(z.data(), z.size(), nMax, data.data(), ddata.data());
+    benchmark::DoNotOptimize(data.data());
+  }
+  state.SetItemsProcessed(state.iterations() * (nMax + 1) * z.size());
+}
+
+void orders_and_arguments(benchmark::internal::Benchmark *benchmark) {
+  for(int nMax : {5, 10, 20, 40})
+    for(int z : {1, 10, 100, 1000})
+      benchmark->Args({nMax, z});
+}
+}
+
+BENCHMARK_TEMPLATE(bessel_workspace, optimet::Bessel)->Apply(orders_and_arguments);
+BENCHMARK_TEMPLATE(bessel_workspace, optimet::Hankel1)->Apply(orders_and_arguments);
+BENCHMARK_TEMPLATE(bessel_amos, optimet::Bessel)->Apply(orders_and_arguments);
+BENCHMARK_TEMPLATE(bessel_amos, optimet::Hankel1)->Apply(orders_and_arguments);
+BENCHMARK_TEMPLATE(bessel_arguments, optimet::Bessel)->Apply(orders_and_arguments);
+BENCHMARK_TEMPLATE(bessel_arguments, optimet::Hankel1)->Apply(orders_and_arguments);
@@ -0,0 +1,87 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "AuxCoefficients.h"
+#include "Coupling.h"
+#include "TranslationAdditionCoefficients.h"
+#include "constants.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+using namespace optimet;
+
+//! The spherical functions of all the harmonics up to nMax at one point, k r = range / 10
+void aux_coefficients(benchmark::State &state) {
+  t_uint const nMax = state.range(0);
+  t_complex const waveK(2 * consPi / 500e-9, 0);
+  Spherical<t_real> const R(0.1 * state.range(1) / waveK.real(), 1.0, 2.0);
+  for(auto _ : state) {
+    AuxCoefficients const aux(R, waveK, false, nMax);
+    benchmark::DoNotOptimize(&aux.M(0));
+  }
+  state.SetItemsProcessed(state.iterations() * nMax * (nMax + 2));
+}
+
+//! All the translation-addition coefficients up to nMax, from a new table
+void translation_addition(benchmark::State &state) {
+  t_int const nMax = state.range(0);
+  t_complex const waveK(2 * consPi / 500e-9, 0);
+  Spherical<t_real> const R(0.1 * state.range(1) / waveK.real(), 1.0, 2.0);
+  for(auto _ : state) {
+    TranslationAdditionCoefficients ta(R, waveK, false, nMax);
+    t_complex sum = 0;
+    for(t_int n = 1; n <= nMax; ++n)
+      for(t_int m = -n; m <= n; ++m)
+        for(t_int l = 1; l <= nMax; ++l)
+          for(t_int k = -l; k <= l; ++k)
+            sum += ta(n, m, l, k);
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+//! The A and B coupling blocks between two scatterers
+void coupling(benchmark::State &state) {
+  t_uint const nMax = state.range(0);
+  t_complex const waveK(2 * consPi / 500e-9, 0);
+  Spherical<t_real> const R(0.1 * state.range(1) / waveK.real(), 1.0, 2.0);
+  for(auto _ : state) {
+    Coupling const coupling(R, waveK, nMax, false);
+    benchmark::DoNotOptimize(coupling.diagonal.data());
+  }
+}
+
+//! The same blocks through a rotation and a coaxial translation
+void rotation_coupling(benchmark::State &state) {
+  t_uint const nMax = state.range(0);
+  t_complex const waveK(2 * consPi / 500e-9, 0);
+  Spherical<t_real> const R(0.1 * state.range(1) / waveK.real(), 1.0, 2.0);
+  for(auto _ : state) {
+    RotationCoupling const coupling(R, waveK, nMax, false);
+    benchmark::DoNotOptimize(coupling.diagonal.data());
+  }
+}
+
+void orders_and_distances(benchmark::internal::Benchmark *benchmark) {
+  for(int nMax : {5, 10, 20})
+    for(int kr : {10, 100})
+      benchmark->Args({nMax, kr});
+}
+}
+
+BENCHMARK(aux_coefficients)->Apply(orders_and_distances)->Args({40, 1})->Args({40, 100});
+BENCHMARK(translation_addition)->Apply(orders_and_distances);
+BENCHMARK(coupling)->Apply(orders_and_distances);
+BENCHMARK(rotation_coupling)->Apply(orders_and_distances);
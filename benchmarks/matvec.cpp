@@ -0,0 +1,60 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "CouplingOperator.h"
+#include "Geometry.h"
+#include "constants.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+using namespace optimet;
+
+//! A cube of side^3 spheres of 50 nm, 150 nm apart
+Geometry cube(int side, int nMax) {
+  Geometry geometry;
+  for(int i = 0; i < side; ++i)
+    for(int j = 0; j < side; ++j)
+      for(int k = 0; k < side; ++k) {
+        Cartesian<t_real> const position(150e-9 * i, 150e-9 * j, 150e-9 * k);
+        geometry.pushObject(Scatterer(Spherical<t_real>::toSpherical(position), ElectroMagnetic(),
+                                      50e-9, nMax, nMax));
+      }
+  return geometry;
+}
+
+//! Products of the scattering matrix with a vector, without forming it
+void matvec(benchmark::State &state) {
+  int const nMax = state.range(0);
+  auto const geometry = cube(state.range(1), nMax);
+  t_uint const n = 2 * nMax * (nMax + 2), nobj = geometry.objects.size();
+  Matrix<t_complex> const T = Matrix<t_complex>::Random(n, nobj * n) * 1e-2;
+  CouplingOperator const S(T, geometry, 2 * consPi / 500e-9, nMax, false, state.range(2) != 0);
+  Vector<t_complex> const x = Vector<t_complex>::Random(nobj * n);
+  for(auto _ : state)
+    benchmark::DoNotOptimize((S * x).data());
+  state.SetItemsProcessed(state.iterations() * nobj * nobj);
+}
+
+//! The orders, the sides of the cube and whether the couplings are kept between the products
+void orders_and_cubes(benchmark::internal::Benchmark *benchmark) {
+  for(int nMax : {3, 5, 8})
+    for(int side : {2, 3, 4})
+      for(int cache : {0, 1})
+        benchmark->Args({nMax, side, cache});
+}
+}
+
+BENCHMARK(matvec)->Apply(orders_and_cubes)->Unit(benchmark::kMillisecond);
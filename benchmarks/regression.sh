@@ -0,0 +1,184 @@
+#!/bin/bash
+
+# Guards against performance and accuracy regressions of Optimet.
+#
+# "record" runs the micro-benchmarks and the given example decks and writes
+# the baseline, a text file meant to be kept under version control with the
+# sources. "check" runs them again and compares with the baseline, failing if
+#
+#   - a kernel, or a stage of a deck in <case>_Timings.json, takes more than
+#     the threshold longer than in the baseline, the shortest stages being too
+#     noisy to compare,
+#   - a cross section of a deck differs from the baseline by more than the
+#     relative tolerance,
+#   - an entry of the baseline is missing from the run.
+#
+#   ./regression.sh record -b baseline.txt ../examples/TwoParticlesSi.xml
+#   ./regression.sh check -b baseline.txt -t 0.2 ../examples/TwoParticlesSi.xml
+#
+# The baseline holds one entry per line, tab separated:
+#
+#   kernel  <benchmark>                        <median in ns>
+#   stage   <deck>/<region>                    <largest seconds of a process>
+#   cross   <deck>/<file>.dat:<line>:<column>  <cross section>
+#
+# Timings only compare on the machine they were recorded on, the cross sections
+# anywhere.
+
+usage() {
+  cat <<EOF
+Usage: $0 record|check [options] [deck.xml...]
+  -b baseline     baseline file, baseline.txt by default
+  -k benchmarks   micro-benchmarks, ../build/benchmarks/benchmarks by default, "" to skip them
+  -f filter       regex of the micro-benchmarks to run, all by default
+  -e executable   Optimet3D, ../build/Optimet3D by default
+  -l launcher     launches n processes as "\$launcher n", "mpirun -np" by default
+  -n processes    number of processes of the decks, 1 by default
+  -t threshold    largest slow down of a timing, 0.3 (30%) by default
+  -m minimum      shortest stage in seconds of the baseline to compare, 0.05 by default
+  -a tolerance    largest relative difference of a cross section, 1e-6 by default
+  -o directory    outputs of the runs, regression by default
+EOF
+  exit 1
+}
+
+[ $# -gt 0 ] || usage
+mode=$1
+shift
+[ "$mode" = record ] || [ "$mode" = check ] || usage
+
+here=$(cd "$(dirname "$0")" && pwd)
+baseline=baseline.txt
+benchmarks="$here/../build/benchmarks/benchmarks"
+filter=""
+executable="$here/../build/Optimet3D"
+launcher="mpirun -np"
+processes=1
+threshold=0.3
+minimum=0.05
+tolerance=1e-6
+output=regression
+while getopts "b:k:f:e:l:n:t:m:a:o:h" option; do
+  case $option in
+    b) baseline=$OPTARG ;;
+    k) benchmarks=$OPTARG ;;
+    f) filter=$OPTARG ;;
+    e) executable=$OPTARG ;;
+    l) launcher=$OPTARG ;;
+    n) processes=$OPTARG ;;
+    t) threshold=$OPTARG ;;
+    m) minimum=$OPTARG ;;
+    a) tolerance=$OPTARG ;;
+    o) output=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+mkdir -p "$output"
+output=$(cd "$output" && pwd)
+results="$output/results.txt"
+: > "$results"
+
+# The medians of the micro-benchmarks in ns, from their JSON output
+kernels() {
+  "$benchmarks" --benchmark_format=json --benchmark_repetitions=5 \
+    --benchmark_report_aggregates_only=true ${filter:+--benchmark_filter="$filter"} \
+    > "$output/kernels.json" 2> "$output/kernels.log" \
+    || { echo "The micro-benchmarks failed, see $output/kernels.log" >&2; return 1; }
+  awk -F '"' '
+    BEGIN { OFS = "\t"; scale["ns"] = 1; scale["us"] = 1e3; scale["ms"] = 1e6; scale["s"] = 1e9 }
+    $2 == "name" { name = $4 }
+    $2 == "real_time" { time = $3; gsub(/[: ,]/, "", time) }
+    $2 == "time_unit" && name ~ /_median$/ {
+      print "kernel", substr(name, 1, length(name) - 7), time * scale[$4]
+    }' "$output/kernels.json"
+}
+
+# The stages and cross sections of a deck
+deck() {
+  local deck=$1 name directory
+  name=$(basename "$deck" .xml)
+  directory="$output/$name"
+  mkdir -p "$directory"
+  cp "$deck" "$directory/case.xml"
+  [ -e "$(dirname "$deck")/meshlib" ] && ln -sfn "$(cd "$(dirname "$deck")" && pwd)/meshlib" "$directory/meshlib"
+  (cd "$directory" && $launcher "$processes" "$executable" case.xml > output.log 2>&1) \
+    || { echo "$name failed, see $directory/output.log" >&2; return 1; }
+  # the timings are on one line, the regions before the counters
+  sed 's/"counters".*//' "$directory/case_Timings.json" | grep -o '"[^"]*": {"calls[^}]*}' \
+    | sed 's/^"\([^"]*\)".*"max": \([^,}]*\).*/\1\t\2/' \
+    | awk -F '\t' -v deck="$name" 'BEGIN { OFS = "\t" } { print "stage", deck "/" $1, $2 }'
+  for file in "$directory"/case_*CS_*.dat; do
+    [ -e "$file" ] || continue
+    awk -v file="$name/${file#$directory/case_}" '
+      BEGIN { OFS = "\t" }
+      { for(i = 2; i <= NF; i++) print "cross", file ":" NR ":" i, $i }' "$file"
+  done
+}
+
+status=0
+if [ -n "$benchmarks" ]; then
+  kernels >> "$results" || status=1
+fi
+for each in "$@"; do
+  deck "$each" >> "$results" || status=1
+done
+
+if [ "$mode" = record ]; then
+  [ $status -eq 0 ] || { echo "Not recording an incomplete baseline" >&2; exit 1; }
+  cp "$results" "$baseline"
+  echo "Recorded $(wc -l < "$baseline") entries in $baseline"
+  exit 0
+fi
+
+[ -e "$baseline" ] || { echo "No baseline $baseline" >&2; exit 1; }
+# Only the kinds of entries and the decks which were run are compared
+awk -F '\t' -v threshold="$threshold" -v minimum="$minimum" -v tolerance="$tolerance" \
+    -v kernels="${benchmarks:+1}" -v filter="$filter" -v decks="$*" '
+  function decked(key,    name) {
+    name = key
+    sub(/[\/:].*/, "", name)
+    return name in ran
+  }
+  function relative(a, b) {
+    return (a == b) ? 0 : (a - b) / (b < 0 ? -b : b)
+  }
+  BEGIN {
+    n = split(decks, list, " ")
+    for(i = 1; i <= n; i++) {
+      name = list[i]
+      sub(/.*\//, "", name)
+      sub(/\.xml$/, "", name)
+      ran[name] = 1
+    }
+  }
+  FNR == NR { current[$1 FS $2] = $3; next }
+  $1 == "kernel" && (!kernels || $2 !~ filter) { next }
+  $1 != "kernel" && !decked($2) { next }
+  {
+    key = $1 FS $2
+    if(!(key in current)) {
+      printf "MISSING %s %s\n", $1, $2
+      failed++
+      next
+    }
+    compared++
+    change = relative(current[key], $3)
+    if($1 == "cross") {
+      if(change > tolerance || -change > tolerance) {
+        printf "WRONG   %s %s: %g instead of %g\n", $1, $2, current[key], $3
+        failed++
+      }
+    } else if($1 == "stage" && $3 < minimum)
+      next
+    else if(change > threshold) {
+      printf "SLOWER  %s %s: %g instead of %g, %+.0f%%\n", $1, $2, current[key], $3, 100 * change
+      failed++
+    } else if(-change > threshold)
+      printf "faster  %s %s: %g instead of %g, %+.0f%%\n", $1, $2, current[key], $3, 100 * change
+  }
+  END {
+    printf "%d entries compared, %d failed\n", compared, failed
+    exit failed > 0
+  }' "$results" "$baseline" || status=1
+exit $status
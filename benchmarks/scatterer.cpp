@@ -0,0 +1,54 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "MeshFile.h"
+#include "Scatterer.h"
+#include "constants.h"
+#include <benchmark/benchmark.h>
+
+#ifdef OPTIMET_MPI
+namespace {
+using namespace optimet;
+
+//! The rows of the Q matrix of a mesh of the library, integrated over all its triangles
+void q_local(benchmark::State &state) {
+  int const nMax = state.range(0);
+  int const pMax = nMax * (nMax + 2);
+  Scatterer object(Spherical<t_real>(0, 0, 0),
+                   ElectroMagnetic(t_complex(2.25, 0.1), 1, t_complex(2.25, 0.1), 1, 1, 1), 100e-9,
+                   nMax, nMax);
+  object.scatterer_type = "arbitrary.shape";
+  object.Mesh(MeshFile::load(state.range(1) == 0 ? "r50R30" : "r200R300", OPTIMET_MESHLIB));
+  ElectroMagnetic const bground;
+  auto const omega = 2 * consPi * consC / 500e-9;
+  Vector<t_complex> Q(4 * pMax * pMax);
+  for(auto _ : state) {
+    object.getQLocal(Q, omega, bground, 0, pMax, 0, object.getNOtriangles());
+    benchmark::DoNotOptimize(Q.data());
+  }
+  state.SetItemsProcessed(state.iterations() * object.getNOtriangles());
+}
+
+//! The orders and the meshes, 0 for r50R30 and 1 for r200R300
+void orders_and_meshes(benchmark::internal::Benchmark *benchmark) {
+  for(int nMax : {3, 5, 8})
+    for(int mesh : {0, 1})
+      benchmark->Args({nMax, mesh});
+}
+}
+
+BENCHMARK(q_local)->Apply(orders_and_meshes)->Unit(benchmark::kMillisecond);
+#endif
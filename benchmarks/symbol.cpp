@@ -0,0 +1,70 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Symbol.h"
+#include "Scatterer.h"
+#include "constants.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+using namespace optimet;
+
+//! All the 3j symbols (n1 n2 n3; m1 m2 -m1-m2) of n1, n2 up to nMax with m1 = 1, m2 = -1
+void wigner3j(benchmark::State &state) {
+  int const nMax = state.range(0);
+  for(auto _ : state) {
+    double sum = 0;
+    for(int n1 = 1; n1 <= nMax; ++n1)
+      for(int n2 = 1; n2 <= nMax; ++n2)
+        for(int n3 = std::abs(n1 - n2); n3 <= n1 + n2; ++n3)
+          sum += symbol::Wigner3j(n1, n2, n3, 1, -1, 0);
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+//! The same symbols, a recursion over n3 at a time
+void wigner3j_range(benchmark::State &state) {
+  int const nMax = state.range(0);
+  for(auto _ : state)
+    for(int n1 = 1; n1 <= nMax; ++n1)
+      for(int n2 = 1; n2 <= nMax; ++n2)
+        benchmark::DoNotOptimize(symbol::Wigner3jRange(n1, n2, 1, -1).data());
+}
+
+//! The coefficients of Xm1 and Xp1 of the SH sources at a point inside a sphere
+void cxm1p1(benchmark::State &state) {
+  int const nMax = state.range(0), nMaxS = state.range(1);
+  symbol::CouplingPattern const pattern(nMax, nMaxS);
+  std::vector<double> W_m1m1(pattern.size(), 0.1), W_00(pattern.size(), 0.2),
+      W_11(pattern.size(), 0.3);
+  Scatterer const object(Spherical<t_real>(0, 0, 0),
+                         ElectroMagnetic(t_complex(2.25, 0.1), 1, t_complex(2.25, 0.1), 1, 1, 1),
+                         50e-9, nMax, nMaxS);
+  Vector<t_complex> internal = Vector<t_complex>::Random(2 * nMax * (nMax + 2));
+  auto const omega = 2 * consPi * consC / 500e-9;
+  std::vector<t_complex> coefXmn(nMaxS * (nMaxS + 2)), coefXpl(nMaxS * (nMaxS + 2));
+  for(auto _ : state) {
+    symbol::CXm1p1(W_m1m1.data(), W_00.data(), W_11.data(), pattern, nMax, nMaxS, internal, 30e-9,
+                   0, omega, object, coefXmn.data(), coefXpl.data());
+    benchmark::DoNotOptimize(coefXmn.data());
+  }
+  state.SetItemsProcessed(state.iterations() * pattern.size());
+}
+}
+
+BENCHMARK(wigner3j)->Arg(5)->Arg(10)->Arg(20);
+BENCHMARK(wigner3j_range)->Arg(5)->Arg(10)->Arg(20);
+BENCHMARK(cxm1p1)->Args({5, 5})->Args({5, 10})->Args({10, 10})->Args({10, 15});
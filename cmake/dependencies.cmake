@@ -69,6 +69,91 @@ if(dompi AND NOT MPIEXEX_MAX_NUMPROCS)
   set(MPIEXEC_MAX_NUMPROCS 6)
 endif()
 
+# Threads within each rank
+set(OPTIMET_OPENMP FALSE)
+if(doopenmp)
+  find_package(OpenMP REQUIRED)
+  set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${OpenMP_C_FLAGS}")
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${OpenMP_CXX_FLAGS}")
+  set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} ${OpenMP_CXX_FLAGS}")
+  set(OPTIMET_OPENMP TRUE)
+endif()
+
+# Output written in the background by a thread of the roots
+find_package(Threads REQUIRED)
+
+# External profilers the timed regions are reported to
+set(OPTIMET_CALIPER FALSE)
+set(OPTIMET_SCOREP FALSE)
+set(OPTIMET_NVTX FALSE)
+set(OPTIMET_ITT FALSE)
+unset(PROFILER_INCLUDE_DIRS)
+unset(PROFILER_LIBRARIES)
+if(profiler STREQUAL "caliper")
+  find_package(caliper REQUIRED)
+  set(PROFILER_INCLUDE_DIRS ${caliper_INCLUDE_DIR})
+  set(PROFILER_LIBRARIES caliper)
+  set(OPTIMET_CALIPER TRUE)
+elseif(profiler STREQUAL "scorep")
+  # the user regions are enabled by compiling through the scorep wrappers with --user
+  set(OPTIMET_SCOREP TRUE)
+elseif(profiler STREQUAL "nvtx")
+  find_path(NVTX_INCLUDE_DIR nvToolsExt.h HINTS $ENV{CUDA_HOME}/include $ENV{CUDA_PATH}/include)
+  find_library(NVTX_LIBRARY nvToolsExt HINTS $ENV{CUDA_HOME}/lib64 $ENV{CUDA_PATH}/lib64)
+  if(NOT NVTX_INCLUDE_DIR OR NOT NVTX_LIBRARY)
+    message(FATAL_ERROR "Could not find NVTX, set CUDA_HOME")
+  endif()
+  set(PROFILER_INCLUDE_DIRS ${NVTX_INCLUDE_DIR})
+  set(PROFILER_LIBRARIES ${NVTX_LIBRARY} ${CMAKE_DL_LIBS})
+  set(OPTIMET_NVTX TRUE)
+elseif(profiler STREQUAL "itt")
+  find_path(ITT_INCLUDE_DIR ittnotify.h HINTS $ENV{VTUNE_PROFILER_DIR}/include $ENV{VTUNE_DIR}/include)
+  find_library(ITT_LIBRARY ittnotify HINTS $ENV{VTUNE_PROFILER_DIR}/lib64 $ENV{VTUNE_DIR}/lib64)
+  if(NOT ITT_INCLUDE_DIR OR NOT ITT_LIBRARY)
+    message(FATAL_ERROR "Could not find the ITT API, set VTUNE_PROFILER_DIR")
+  endif()
+  set(PROFILER_INCLUDE_DIRS ${ITT_INCLUDE_DIR})
+  set(PROFILER_LIBRARIES ${ITT_LIBRARY} ${CMAKE_DL_LIBS})
+  set(OPTIMET_ITT TRUE)
+elseif(NOT profiler STREQUAL "none")
+  message(FATAL_ERROR "Unknown profiler ${profiler}, expected none, caliper, scorep, nvtx or itt")
+endif()
+
+# Hardware counters of the timed regions
+set(OPTIMET_PAPI FALSE)
+if(dopapi)
+  find_path(PAPI_INCLUDE_DIR papi.h HINTS $ENV{PAPI_DIR}/include)
+  find_library(PAPI_LIBRARY papi HINTS $ENV{PAPI_DIR}/lib)
+  if(NOT PAPI_INCLUDE_DIR OR NOT PAPI_LIBRARY)
+    message(FATAL_ERROR "Could not find PAPI, set PAPI_DIR")
+  endif()
+  list(APPEND PROFILER_INCLUDE_DIRS ${PAPI_INCLUDE_DIR})
+  list(APPEND PROFILER_LIBRARIES ${PAPI_LIBRARY})
+  set(OPTIMET_PAPI TRUE)
+endif()
+
+# Dense factorizations on the GPUs
+set(OPTIMET_MAGMA FALSE)
+unset(MAGMA_INCLUDE_DIRS)
+unset(MAGMA_LIBRARIES)
+if(domagma)
+  find_path(MAGMA_INCLUDE_DIR magma_v2.h HINTS $ENV{MAGMA_DIR}/include)
+  find_library(MAGMA_LIBRARY magma HINTS $ENV{MAGMA_DIR}/lib)
+  find_path(CUDA_RUNTIME_INCLUDE_DIR cuda_runtime.h HINTS $ENV{CUDA_HOME}/include $ENV{CUDA_PATH}/include)
+  find_library(CUDART_LIBRARY cudart HINTS $ENV{CUDA_HOME}/lib64 $ENV{CUDA_PATH}/lib64)
+  find_library(CUBLAS_LIBRARY cublas HINTS $ENV{CUDA_HOME}/lib64 $ENV{CUDA_PATH}/lib64)
+  find_library(CUSPARSE_LIBRARY cusparse HINTS $ENV{CUDA_HOME}/lib64 $ENV{CUDA_PATH}/lib64)
+  if(NOT MAGMA_INCLUDE_DIR OR NOT MAGMA_LIBRARY)
+    message(FATAL_ERROR "Could not find MAGMA, set MAGMA_DIR")
+  endif()
+  if(NOT CUDA_RUNTIME_INCLUDE_DIR OR NOT CUDART_LIBRARY OR NOT CUBLAS_LIBRARY OR NOT CUSPARSE_LIBRARY)
+    message(FATAL_ERROR "Could not find CUDA, set CUDA_HOME")
+  endif()
+  set(MAGMA_INCLUDE_DIRS ${MAGMA_INCLUDE_DIR} ${CUDA_RUNTIME_INCLUDE_DIR})
+  set(MAGMA_LIBRARIES ${MAGMA_LIBRARY} ${CUSPARSE_LIBRARY} ${CUBLAS_LIBRARY} ${CUDART_LIBRARY})
+  set(OPTIMET_MAGMA TRUE)
+endif()
+
 # GMRes and other solvers
 find_package(Belos)
 set(OPTIMET_BELOS ${Belos_FOUND})
@@ -0,0 +1,245 @@
+#!/bin/bash
+
+# Synthetic decks of many particles, for benchmarks and scaling studies.
+#
+# Writes a deck of N identical particles, spheres or meshed spheroids, laid out
+# on a cubic lattice, packed at random in a cube, or packed at random in
+# clusters themselves packed at random. The same options and seed give the
+# same deck on every machine: the random numbers come from the generator of
+# Park and Miller rather than from awk's.
+#
+#   ./generate.sh -N 1000 -d random -f 0.05 -o random1000
+#   ./generate.sh -N 512 -d lattice -s 300 -g "50 100 12" -n 6 -o spheroids512
+#   ./generate.sh -N 2000 -d clustered -k 20 -m gold -o clusters2000
+#
+# A meshed spheroid of semi-axes a along x and y, c along z, with l rings of
+# vertices from pole to pole, is written to meshlib/coord_r<a>R<c>n<l>.txt and
+# the matching topol file, next to this script unless given -M.
+
+usage() {
+  cat <<EOF
+Usage: $0 [options] -N particles
+  -N particles    number of particles
+  -d layout       lattice, random or clustered, lattice by default
+  -s spacing      lattice: distance in nm between neighbours, 4 radii by default
+                  random and clustered: smallest gap in nm between surfaces, 10 by default
+  -f fraction     random and clustered: volume fraction of the particles, 0.1 by default
+  -k size         clustered: particles per cluster, 8 by default
+  -r radius       radius of the spheres in nm, 50 by default
+  -g "a c l"      meshed spheroids of semi-axes a and c in nm with l rings, spheres if not given
+  -M directory    where the meshes are written, meshlib next to this script by default
+  -n nmax         harmonic order, 4 by default
+  -m material     silicon, gold, or eps:<real>:<imag> for a constant permittivity, silicon by default
+  -w "i f s"      wavelengths in nm, initial, final and step, "600 600 10" by default
+  -S seed         seed of the random layouts, 1 by default
+  -o name         the deck is written to name.xml, synthetic by default
+EOF
+  exit 1
+}
+
+here=$(cd "$(dirname "$0")" && pwd)
+count=""
+layout=lattice
+spacing=""
+fraction=0.1
+cluster=8
+radius=50
+spheroid=""
+meshes="$here/meshlib"
+nmax=4
+material=silicon
+wavelengths="600 600 10"
+seed=1
+name=synthetic
+while getopts "N:d:s:f:k:r:g:M:n:m:w:S:o:h" option; do
+  case $option in
+    N) count=$OPTARG ;;
+    d) layout=$OPTARG ;;
+    s) spacing=$OPTARG ;;
+    f) fraction=$OPTARG ;;
+    k) cluster=$OPTARG ;;
+    r) radius=$OPTARG ;;
+    g) spheroid=$OPTARG ;;
+    M) meshes=$OPTARG ;;
+    n) nmax=$OPTARG ;;
+    m) material=$OPTARG ;;
+    w) wavelengths=$OPTARG ;;
+    S) seed=$OPTARG ;;
+    o) name=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+[ -n "$count" ] && [ "$count" -gt 0 ] 2>/dev/null || usage
+case $layout in
+  lattice | random | clustered) ;;
+  *) echo "Unknown layout $layout, expected lattice, random or clustered" >&2; exit 1 ;;
+esac
+case $material in
+  silicon) epsilon='<epsilon type="SiliconModel"/>' ;;
+  gold)
+    epsilon='<epsilon type="GoldModel">
+      <parameters a.real="1.0" a.imag="0.0" b.real="-1.0" b.imag="0.0" d.real="1.0" d.imag="0.0" />
+    </epsilon>' ;;
+  eps:*:*)
+    IFS=: read -r _ real imaginary <<< "$material"
+    epsilon="<epsilon type=\"relative\" value.real=\"$real\" value.imag=\"$imaginary\"/>
+    <epsilon_SH type=\"relative\" value.real=\"$real\" value.imag=\"$imaginary\"/>" ;;
+  *) echo "Unknown material $material, expected silicon, gold or eps:<real>:<imag>" >&2; exit 1 ;;
+esac
+
+# the meshed spheroid, its circumscribed radius being the larger semi-axis
+object='<object type="sphere">'
+if [ -n "$spheroid" ]; then
+  read -r a c rings <<< "$spheroid"
+  [ -n "$rings" ] && [ "$rings" -ge 2 ] 2>/dev/null || { echo "Expected -g \"a c rings\", rings >= 2" >&2; exit 1; }
+  dims="r${a}R${c}n${rings}"
+  mkdir -p "$meshes"
+  # the vertices from the north pole down, counterclockwise seen from outside, indices from 1
+  awk -v a="$a" -v c="$c" -v rings="$rings" -v coord="$meshes/coord_$dims.txt" \
+      -v topol="$meshes/topol_$dims.txt" 'BEGIN {
+    pi = atan2(0, -1)
+    around = 2 * rings
+    printf "%.9e\t%.9e\t%.9e\n", 0, 0, c * 1e-9 > coord
+    for(i = 1; i < rings; i++)
+      for(j = 0; j < around; j++) {
+        theta = pi * i / rings
+        phi = 2 * pi * j / around
+        printf "%.9e\t%.9e\t%.9e\n", a * sin(theta) * cos(phi) * 1e-9,
+          a * sin(theta) * sin(phi) * 1e-9, c * cos(theta) * 1e-9 > coord
+      }
+    south = 2 + (rings - 1) * around
+    printf "%.9e\t%.9e\t%.9e\n", 0, 0, -c * 1e-9 > coord
+    for(j = 0; j < around; j++) {
+      next_j = (j + 1) % around
+      printf "%d\t%d\t%d\n", 1, 2 + j, 2 + next_j > topol
+      for(i = 1; i < rings - 1; i++) {
+        upper = 2 + (i - 1) * around
+        lower = upper + around
+        printf "%d\t%d\t%d\n", upper + j, lower + j, lower + next_j > topol
+        printf "%d\t%d\t%d\n", upper + j, lower + next_j, upper + next_j > topol
+      }
+      last = 2 + (rings - 2) * around
+      printf "%d\t%d\t%d\n", last + j, south, last + next_j > topol
+    }
+  }'
+  radius=$(( a > c ? a : c ))
+  object="<object type=\"arbitrary.shape\" dims=\"$dims\">"
+fi
+spacing=${spacing:-$([ "$layout" = lattice ] && echo $((4 * radius)) || echo 10)}
+read -r initial final step <<< "$wavelengths"
+
+# the centres in nm, one line each
+centres=$(awk -v count="$count" -v layout="$layout" -v spacing="$spacing" -v fraction="$fraction" \
+    -v cluster="$cluster" -v radius="$radius" -v seed="$seed" '
+  # Park and Miller, exact in double precision
+  function uniform() {
+    state = (16807 * state) % 2147483647
+    return state / 2147483647
+  }
+  function cell(x) { return int(x / distance + 1e6) - 1e6 }
+  # whether a centre is at least distance away from all those placed, through a grid of cells
+  function free(x, y, z,    i, j, k, n, m, dx, dy, dz, members) {
+    for(i = cell(x) - 1; i <= cell(x) + 1; i++)
+      for(j = cell(y) - 1; j <= cell(y) + 1; j++)
+        for(k = cell(z) - 1; k <= cell(z) + 1; k++) {
+          n = split(grid[i, j, k], members, " ")
+          for(m = 1; m <= n; m++) {
+            dx = x - X[members[m]]; dy = y - Y[members[m]]; dz = z - Z[members[m]]
+            if(dx * dx + dy * dy + dz * dz < distance * distance)
+              return 0
+          }
+        }
+    return 1
+  }
+  function place(x, y, z) {
+    placed++
+    X[placed] = x; Y[placed] = y; Z[placed] = z
+    grid[cell(x), cell(y), cell(z)] = grid[cell(x), cell(y), cell(z)] " " placed
+  }
+  # n centres at random in a ball of radius R about (cx, cy, cz), or in a cube of side 2 R
+  function pack(n, cx, cy, cz, R, ball,    tries, x, y, z) {
+    for(tries = 0; n > 0; tries++) {
+      if(tries > 1000 * count) {
+        print "Could not pack the particles, lower the fraction" > "/dev/stderr"
+        exit 1
+      }
+      x = R * (2 * uniform() - 1); y = R * (2 * uniform() - 1); z = R * (2 * uniform() - 1)
+      if(ball && x * x + y * y + z * z > R * R)
+        continue
+      if(free(cx + x, cy + y, cz + z)) {
+        place(cx + x, cy + y, cz + z)
+        n--
+      }
+    }
+  }
+  BEGIN {
+    state = seed % 2147483646 + 1
+    pi = atan2(0, -1)
+    distance = 2 * radius + spacing
+    volume = 4 / 3 * pi * radius ^ 3
+    if(layout == "lattice") {
+      side = 1
+      while(side ^ 3 < count)
+        side++
+      for(n = 0; n < count; n++)
+        printf "%.3f %.3f %.3f\n", spacing * (n % side), spacing * (int(n / side) % side),
+          spacing * int(n / side / side)
+      exit
+    }
+    if(layout == "random")
+      pack(count, 0, 0, 0, (count * volume / fraction) ^ (1 / 3) / 2, 0)
+    else {
+      # the clusters are balls at the volume fraction, three times as dilute among themselves
+      clusters = int((count + cluster - 1) / cluster)
+      ball = (cluster * volume / fraction * 3 / (4 * pi)) ^ (1 / 3)
+      outer = (clusters * 4 / 3 * pi * (ball + spacing) ^ 3 * 3) ^ (1 / 3) / 2
+      for(c = 1; c <= clusters; c++) {
+        do {
+          cx[c] = outer * (2 * uniform() - 1)
+          cy[c] = outer * (2 * uniform() - 1)
+          cz[c] = outer * (2 * uniform() - 1)
+          apart = 1
+          for(d = 1; d < c && apart; d++)
+            if((cx[c] - cx[d]) ^ 2 + (cy[c] - cy[d]) ^ 2 + (cz[c] - cz[d]) ^ 2 < (2 * ball + spacing) ^ 2)
+              apart = 0
+        } while(!apart)
+      }
+      for(c = 1; c <= clusters; c++)
+        pack(c < clusters ? cluster : count - (clusters - 1) * cluster, cx[c], cy[c], cz[c],
+             ball - radius, 1)
+    }
+    for(n = 1; n <= placed; n++)
+      printf "%.3f %.3f %.3f\n", X[n], Y[n], Z[n]
+  }') || exit 1
+
+# the deck, the particles all alike but for their centres
+{
+  cat <<EOF
+<?xml version="1.0"?>
+<!-- $(basename "$0") -N $count -d $layout -s $spacing -f $fraction -k $cluster -r $radius -g "$spheroid" -n $nmax -m $material -S $seed -->
+<simulation>
+  <harmonics nmax="$nmax" />
+</simulation>
+<source type="planewave">
+  <wavelength value="$initial" />
+  <propagation theta="45.0" phi="90.0" />
+  <polarization Etheta.real="1.0" Etheta.imag="0.0" Ephi.real="0.0" Ephi.imag="0.0" />
+  <SHsources condition="yes" />
+</source>
+<geometry>
+EOF
+  object=$object epsilon=$epsilon radius=$radius awk '{
+    printf "  %s\n    <cartesian x=\"%s\" y=\"%s\" z=\"%s\" />\n", ENVIRON["object"], $1, $2, $3
+    printf "    <properties radius=\"%s\" />\n    %s\n", ENVIRON["radius"], ENVIRON["epsilon"]
+    print "    <mu type=\"relative\" value.real=\"1.0\" value.imag=\"0.0\" />\n  </object>"
+  }' <<< "$centres"
+  cat <<EOF
+</geometry>
+<output type="response">
+  <scan type="A+E">
+    <wavelength initial="$initial" final="$final" stepsize="$step" />
+  </scan>
+</output>
+EOF
+} > "$name.xml"
+echo "Wrote $count particles to $name.xml${dims:+ with the mesh $dims}"
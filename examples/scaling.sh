@@ -0,0 +1,157 @@
+#!/bin/bash
+
+# Strong and weak scaling of Optimet on the decks of this directory.
+#
+# Each deck is run at each number of processes, and at each harmonic order and
+# mesh if given, in a directory of its own. The timings of the stages, written
+# by Optimet to <case>_Timings.json, are kept next to the tables.
+#
+# Strong scaling keeps the deck as is. Weak scaling, with -w, repeats the
+# particles of the deck along x, the given number of copies per process, so
+# that the work of each process stays about the same. The decks must then give
+# the positions of their particles in cartesian coordinates.
+#
+#   ./scaling.sh -r "1 2 4 8" -n "4 8" OneParticleSi.xml ThreeParticlesSi.xml
+#   ./scaling.sh -r "1 2 4 8" -w 1 -s 2000 TwoParticlesSi.xml
+#
+# The tables list, for each number of processes, the wall time of the run, the
+# largest time of a process in the T-matrices, the solver update and the
+# solves, and the efficiency against the smallest number of processes.
+
+usage() {
+  cat <<EOF
+Usage: $0 [options] deck.xml...
+  -e executable   Optimet3D, ../build/Optimet3D by default
+  -l launcher     launches n processes as "\$launcher n", "mpirun -np" by default
+  -r ranks        numbers of processes, "1 2 4" by default
+  -n orders       harmonic orders, those of the decks by default
+  -m meshes       meshes of the arbitrary shaped particles, e.g. "r50R30 r200R300"
+  -w copies       weak scaling, with copies of the particles per process
+  -s spacing      distance in nm between the copies, 1000 by default
+  -o directory    outputs, scaling by default
+EOF
+  exit 1
+}
+
+here=$(cd "$(dirname "$0")" && pwd)
+executable="$here/../build/Optimet3D"
+launcher="mpirun -np"
+ranks="1 2 4"
+orders=""
+meshes=""
+copies=""
+spacing=1000
+output=scaling
+while getopts "e:l:r:n:m:w:s:o:h" option; do
+  case $option in
+    e) executable=$(cd "$(dirname "$OPTARG")" && pwd)/$(basename "$OPTARG") ;;
+    l) launcher=$OPTARG ;;
+    r) ranks=$OPTARG ;;
+    n) orders=$OPTARG ;;
+    m) meshes=$OPTARG ;;
+    w) copies=$OPTARG ;;
+    s) spacing=$OPTARG ;;
+    o) output=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[ $# -gt 0 ] || usage
+[ -x "$executable" ] || { echo "Cannot run $executable" >&2; exit 1; }
+mkdir -p "$output"
+output=$(cd "$output" && pwd)
+
+# Writes a deck with the given order and mesh, and its particles repeated
+# copies times along x, spacing nm apart. Empty values keep those of the deck.
+variant() {
+  awk -v nmax="$2" -v mesh="$3" -v copies="${4:-1}" -v spacing="$5" '
+    function shifted(block, offset,    lines, n, i, line, value) {
+      n = split(block, lines, "\n")
+      for(i = 1; i < n; i++) {
+        line = lines[i]
+        if(line ~ /<cartesian/ && match(line, /x="[^"]*"/)) {
+          value = substr(line, RSTART + 3, RLENGTH - 4) + offset
+          line = substr(line, 1, RSTART - 1) "x=\"" value "\"" substr(line, RSTART + RLENGTH)
+        }
+        print line
+      }
+    }
+    nmax != "" { sub(/nmax="[^"]*"/, "nmax=\"" nmax "\"") }
+    mesh != "" && /arbitrary.shape/ { sub(/dims="[^"]*"/, "dims=\"" mesh "\"") }
+    /<object/ { inside = 1; block = "" }
+    inside {
+      block = block $0 "\n"
+      if(/<\/object>/) {
+        inside = 0
+        for(c = 0; c < copies; c++)
+          shifted(block, c * spacing)
+      }
+      next
+    }
+    { print }' "$1"
+}
+
+# The largest time of a process in a region, from a timings file
+region() {
+  grep -o "\"$2\": {[^}]*}" "$1" 2>/dev/null | head -1 | sed 's/.*"max": \([^,}]*\).*/\1/'
+}
+
+# Runs a deck on n processes, printing its line of the table
+run() {
+  local deck=$1 n=$2 name=$3 directory
+  directory="$output/$name/$n"
+  mkdir -p "$directory"
+  cp "$deck" "$directory/case.xml"
+  ln -sfn "$here/meshlib" "$directory/meshlib"
+  for file in "$here"/*.dat "$here"/*.txt; do
+    [ -e "$file" ] && ln -sf "$file" "$directory/"
+  done
+  local start end
+  start=$(date +%s.%N)
+  (cd "$directory" && $launcher "$n" "$executable" case.xml > output.log 2>&1)
+  local status=$?
+  end=$(date +%s.%N)
+  local timings="$directory/case_Timings.json"
+  [ -e "$timings" ] && cp "$timings" "$output/$name.$n.json"
+  local wall
+  wall=$(awk -v start="$start" -v end="$end" 'BEGIN { print end - start }')
+  [ $status -eq 0 ] || echo "$name failed on $n processes, see $directory/output.log" >&2
+  printf "%s\t%s\t%s\t%s\t%s\n" "$n" "$wall" "$(region "$timings" T-matrices)" \
+    "$(region "$timings" "solver update")" "$(region "$timings" solve)"
+}
+
+# Adds the efficiency to the lines of a table, against its first line. The work
+# grows with the processes in weak scaling, not in strong scaling.
+efficiency() {
+  awk -v weak="$1" -F '\t' '
+    BEGIN { OFS = "\t"; print "ranks", "wall", "T-matrices", "update", "solve", "efficiency" }
+    NR == 1 { n1 = $1; t1 = $2 }
+    { print $0, (weak ? t1 / $2 : t1 * n1 / ($2 * $1)) }'
+}
+
+for deck in "$@"; do
+  base=$(basename "$deck" .xml)
+  # "-" keeps the order or mesh of the deck
+  for order in ${orders:--}; do
+    [ "$order" = - ] && order=""
+    for mesh in ${meshes:--}; do
+      [ "$mesh" = - ] && mesh=""
+      name=$base${order:+_n$order}${mesh:+_$mesh}
+      if [ -z "$copies" ]; then
+        variant "$deck" "$order" "$mesh" > "$output/$name.xml"
+        for n in $ranks; do
+          run "$output/$name.xml" "$n" "$name"
+        done | efficiency 0 > "$output/$name.strong.tsv"
+        echo "Strong scaling of $name"
+        cat "$output/$name.strong.tsv"
+      else
+        for n in $ranks; do
+          variant "$deck" "$order" "$mesh" $((copies * n)) "$spacing" > "$output/$name.$n.xml"
+          run "$output/$name.$n.xml" "$n" "$name.weak"
+        done | efficiency 1 > "$output/$name.weak.tsv"
+        echo "Weak scaling of $name"
+        cat "$output/$name.weak.tsv"
+      fi
+    done
+  done
+done
@@ -0,0 +1,136 @@
+# (C) University College London 2017
+# This file is part of Optimet, licensed under the terms of the GNU Public License
+#
+# Optimet is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# Optimet is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+"""Python interface of the Optimet engine, over the C interface of srcAr/EngineC.h.
+
+The coefficients of a solve are NumPy views of the memory of the engine, without a copy, and
+the fields are written directly into NumPy arrays. Lengths are in nm. The library is
+liboptimet.so next to this module, built with -Ddopython=on, or that of OPTIMET_LIBRARY.
+"""
+import atexit
+import ctypes
+import os
+import weakref
+
+import numpy
+
+_double_p = ctypes.POINTER(ctypes.c_double)
+_uint_p = ctypes.POINTER(ctypes.c_uint)
+
+_library = ctypes.CDLL(
+    os.environ.get("OPTIMET_LIBRARY",
+                   os.path.join(os.path.dirname(os.path.abspath(__file__)), "liboptimet.so")))
+_library.optimet_engine_create.restype = ctypes.c_void_p
+_library.optimet_engine_create.argtypes = [ctypes.c_char_p]
+_library.optimet_engine_destroy.argtypes = [ctypes.c_void_p]
+_library.optimet_engine_error.restype = ctypes.c_char_p
+_library.optimet_engine_error.argtypes = [ctypes.c_void_p]
+for _name in ("objects", "incidences", "coefficients"):
+    getattr(_library, "optimet_engine_" + _name).restype = ctypes.c_uint
+    getattr(_library, "optimet_engine_" + _name).argtypes = [ctypes.c_void_p]
+_library.optimet_engine_move.argtypes = [ctypes.c_void_p, ctypes.c_uint] + 3 * [ctypes.c_double]
+_library.optimet_engine_solve.argtypes = [ctypes.c_void_p, ctypes.c_double] + 3 * [_double_p]
+_library.optimet_engine_view.restype = _double_p
+_library.optimet_engine_view.argtypes = [ctypes.c_void_p, ctypes.c_int, _uint_p, _uint_p]
+_library.optimet_engine_fields.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_uint
+                                           ] + 5 * [_double_p]
+
+_library.optimet_initialize(0, None)
+# the engines still alive at exit are destroyed before MPI is finalized
+_engines = weakref.WeakSet()
+
+
+@atexit.register
+def _finalize():
+    for engine in list(_engines):
+        engine._destroy()
+    _library.optimet_finalize()
+
+
+#: The coefficients of a solve, as optimet_coefficients
+SCATTER, INTERNAL, SCATTER_SH, INTERNAL_SH = range(4)
+
+
+def _pointer(values):
+    return values.ctypes.data_as(_double_p) if values is not None else None
+
+
+class Engine(object):
+    """Solves a case file at one wavelength after the other, moving its objects in between.
+
+    All the calls are collective over the processes of MPI_COMM_WORLD.
+    """
+
+    def __init__(self, case_file):
+        self._engine = _library.optimet_engine_create(case_file.encode())
+        if not self._engine:
+            raise RuntimeError("Could not read " + case_file)
+        _engines.add(self)
+
+    def _destroy(self):
+        if getattr(self, "_engine", None):
+            _library.optimet_engine_destroy(self._engine)
+            self._engine = None
+
+    def __del__(self):
+        self._destroy()
+
+    def _check(self, status):
+        if status != 0:
+            raise RuntimeError(_library.optimet_engine_error(self._engine).decode())
+
+    @property
+    def objects(self):
+        return _library.optimet_engine_objects(self._engine)
+
+    @property
+    def incidences(self):
+        return _library.optimet_engine_incidences(self._engine)
+
+    def move(self, index, position):
+        """Moves an object to a cartesian position."""
+        self._check(_library.optimet_engine_move(self._engine, index, *map(float, position)))
+
+    def solve(self, wavelength):
+        """Solves at the wavelength, returning the extinction, scattering and SH scattering
+        cross sections of each incidence."""
+        sections = numpy.zeros((3, self.incidences))
+        self._check(
+            _library.optimet_engine_solve(self._engine, wavelength, *map(_pointer, sections)))
+        return sections[0], sections[1], sections[2]
+
+    def coefficients(self, which=SCATTER):
+        """The coefficients of the last solve, one column per incidence, as a read-only view of
+        the memory of the engine. The view is only valid until the next solve: copy it to keep
+        it longer."""
+        rows, columns = ctypes.c_uint(), ctypes.c_uint()
+        data = _library.optimet_engine_view(self._engine, which, ctypes.byref(rows),
+                                            ctypes.byref(columns))
+        if not data:
+            return numpy.zeros((0, 0), dtype=complex)
+        values = numpy.ctypeslib.as_array(data, shape=(columns.value, 2 * rows.value))
+        values = values.view(numpy.complex128).T
+        values.flags.writeable = False
+        return values
+
+    def fields(self, points, incidence=0):
+        """The E and H fields of the last solve at points, an array of their x, y and z, then
+        those of the SH. Each field has the x, y and z components of each point."""
+        points = numpy.ascontiguousarray(points, dtype=numpy.float64).reshape(-1, 3)
+        fields = numpy.empty((4, points.shape[0], 3), dtype=numpy.complex128)
+        self._check(
+            _library.optimet_engine_fields(self._engine, incidence, points.shape[0],
+                                           _pointer(points), *map(_pointer, fields)))
+        return fields[0], fields[1], fields[2], fields[3]
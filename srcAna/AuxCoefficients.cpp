@@ -20,9 +20,11 @@
 #include "Tools.h"
 #include "CompoundIterator.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 
 #include <boost/math/special_functions/factorials.hpp>
 
@@ -38,181 +40,6 @@ std::vector<t_real> AuxCoefficients::compute_dn(t_uint nMax) {
   return dn;
 }
 
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Pn(t_uint nMax, const std::vector<t_real> &Wigner) {
-  std::vector<SphericalP<t_complex>> Pn(nMax + 1);
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    Pn[i].rrr = Wigner[i];
-    Pn[i].the = 0.;
-    Pn[i].phi = 0.;
-  }
-
-  return Pn;
-}
-
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Cn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-                            const std::vector<t_real> &Wigner,
-                            const std::vector<t_real> &dWigner) {
-  std::vector<SphericalP<t_complex>> Cn(nMax + 1);
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    t_real A;
-    if (m == 0){
-      A = 0.0;}
-    else if (std::abs(R.the) < 1e-10 ||
-             (std::abs(R.the) - consPi + 1e-10) > 0.0){
-      A = m / std::cos(R.the) * dWigner[i];
-      }
-    else
-      {A = m / std::sin(R.the) * Wigner[i];
-      }
-      
-  
- 
-    Cn[i].rrr = t_complex(0.0, 0.0);
-    Cn[i].the = t_complex(0.0, A);
-    Cn[i].phi = t_complex(-dWigner[i], 0.0);
-    
-  }
-                       
-   
-  return Cn;
-}
-
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Bn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-                            const std::vector<t_real> &Wigner,
-                            const std::vector<t_real> &dWigner) {
-  std::vector<SphericalP<t_complex>> Bn(nMax + 1);
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    t_real A;
-    if (m == 0)
-      A = 0.0;
-    else if (std::abs(R.the) < 1e-10 ||
-             (std::abs(R.the) - consPi + 1e-10) > 0.0)
-      A = m / std::cos(R.the) * dWigner[i];
-    else
-      A = m / std::sin(R.the) * Wigner[i];
-
-    Bn[i].rrr = t_complex(0.0, 0.0);
-    Bn[i].the = t_complex(dWigner[i], 0.0);
-    Bn[i].phi = t_complex(0.0, A);
-  }
-
-  return Bn;
-}
-
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Mn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-                            t_complex waveK, const std::vector<t_real> &dn,
-                            const std::vector<SphericalP<t_complex>> &Cn,
-                            BESSEL_TYPE besselType) {
-  std::vector<SphericalP<t_complex>> Mn(nMax + 1);
-
-  std::vector<t_complex> data, ddata;
-  std::tie(data, ddata) = optimet::bessel(R.rrr * waveK, besselType, 0, nMax);
-
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    const t_complex c_temp = dm * dn[i] * exp_imphi;
-
-    Mn[i].rrr = c_temp * data[i] * Cn[i].rrr;
-    Mn[i].the = c_temp * data[i] * Cn[i].the;
-    Mn[i].phi = c_temp * data[i] * Cn[i].phi;
-  }
-
-  return Mn;
-}
-
-
-
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Xm1(t_uint nMax, t_int m, const 
-Spherical<t_real> &R, t_complex waveK, const std::vector<t_real> &dn,
- const std::vector<SphericalP<t_complex>> &Pn, BESSEL_TYPE besselType) {
-                            
-  std::vector<SphericalP<t_complex>> Xm1(nMax + 1);
-
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    const t_complex c_temp = dm * dn[i] * std::sqrt(i * (i + 1)) * exp_imphi;
-
-    Xm1[i].rrr = c_temp  * Pn[i].rrr;
-    Xm1[i].the = c_temp  * Pn[i].the;
-    Xm1[i].phi = c_temp  * Pn[i].phi;
-  }
-
-  return Xm1;
-}
-
-
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Xp1(t_uint nMax, t_int m, const 
-Spherical<t_real> &R, t_complex waveK, const std::vector<t_real> &dn,
-const std::vector<SphericalP<t_complex>> &Bn,
-BESSEL_TYPE besselType) {
-                            
-  std::vector<SphericalP<t_complex>> Xp1(nMax + 1);
-
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    const t_complex c_temp = dm * dn[i] * exp_imphi;
-
-    Xp1[i].rrr = c_temp  * Bn[i].rrr;
-    Xp1[i].the = c_temp  * Bn[i].the;
-    Xp1[i].phi = c_temp  * Bn[i].phi;
-  }
-
-  return Xp1;
-}
-
-
-
-std::vector<SphericalP<t_complex>> AuxCoefficients::compute_Nn(
-    t_uint nMax, t_int m, const Spherical<t_real> &R, t_complex waveK,
-    const std::vector<t_real> &dn, const std::vector<SphericalP<t_complex>> &Pn,
-    const std::vector<SphericalP<t_complex>> &Bn, BESSEL_TYPE besselType) {
-  std::vector<SphericalP<t_complex>> Nn(nMax + 1);
-
-  const t_complex Kr = waveK * R.rrr;
-
-  std::vector<t_complex> data, ddata;
-  std::tie(data, ddata) = optimet::bessel(R.rrr * waveK, besselType, 0, nMax);
-
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
-
-  Nn[0].rrr = t_complex(0.0, 0.0);
-  Nn[0].the = t_complex(0.0, 0.0);
-  Nn[0].phi = t_complex(0.0, 0.0);
-
-  for (t_uint i = 1; i <= nMax; ++i) {
-    Nn[i].rrr = (1.0 / Kr) * dm * dn[i] *
-                ((static_cast<t_real>(i * (i + 1)) * data[i] * Pn[i].rrr) +
-                 ((Kr * ddata[i] + data[i]) * Bn[i].rrr)) *
-                exp_imphi;
-    Nn[i].the = (1.0 / Kr) * dm * dn[i] *
-                ((static_cast<t_real>(i * (i + 1)) * data[i] * Pn[i].the) +
-                 ((Kr * ddata[i] + data[i]) * Bn[i].the)) *
-                exp_imphi;
-    Nn[i].phi = (1.0 / Kr) * dm * dn[i] *
-                ((static_cast<t_real>(i * (i + 1)) * data[i] * Pn[i].phi) +
-                 ((Kr * ddata[i] + data[i]) * Bn[i].phi)) *
-                exp_imphi;
-  }
-
-  return Nn;
-}
-
 std::tuple<std::vector<t_real>, std::vector<t_real>>
 AuxCoefficients::VIGdVIG(t_uint nMax, t_int m, const Spherical<t_real> &R) {
   assert(std::abs(m) <= nMax);
@@ -289,57 +116,219 @@ AuxCoefficients::VIGdVIG(t_uint nMax, t_int m, const Spherical<t_real> &R) {
   return std::make_tuple(Wigner, dWigner);
 }
 
-AuxCoefficients::AuxCoefficients(const Spherical<t_real> &R, t_complex waveK,
-                                 bool regular, t_uint nMax)
-    : _M(Tools::iteratorMax(nMax)), _Xp(Tools::iteratorMax(nMax)), 
-      _Xm(Tools::iteratorMax(nMax)), _N(Tools::iteratorMax(nMax)),
-      _B(Tools::iteratorMax(nMax)), _C(Tools::iteratorMax(nMax)),
-      _dn(compute_dn(nMax)) {
+namespace {
+//! Whether the polar angle is within 1e-10 of a pole
+bool at_pole(t_real the) {
+  return std::abs(the) < 1e-10 || (std::abs(the) - consPi + 1e-10) > 0.0;
+}
 
+//! \brief The Wigner functions and their derivatives of all the points, as VIGdVIG
+//! \details W and dW hold nMax + 1 rows of R.size() points, x and sine are work arrays.
+void VIGdVIG(t_uint nMax, t_int m, const std::vector<Spherical<t_real>> &R, t_real *W, t_real *dW,
+             t_real *x, t_real *sine) {
+  t_uint const N = R.size();
+  std::fill(W, W + (nMax + 1) * N, 0.0);
+  std::fill(dW, dW + (nMax + 1) * N, 0.0);
 
-  const BESSEL_TYPE besselType = (regular) ? Bessel : Hankel1;
+  const bool check_m_negative = (m < 0);
+  const t_uint n_min = static_cast<t_uint>(m = std::abs(m));
+  for(t_uint j = 0; j < N; ++j) {
+    t_real vig_the = (check_m_negative) ? consPi - R[j].the : R[j].the;
+    if(at_pole(R[j].the))
+      vig_the = vig_the + 1e-6; // prevents Nans in computation of Wigners functions
+    x[j] = std::cos(vig_the);
+    sine[j] = std::sin(vig_the);
+  }
 
-  for (CompoundIterator q(nMax, nMax); q < q.max(nMax); ++q) {
-
-    // Wigner d function test
-    std::vector<t_real> Wigner, dWigner;
-    std::tie(Wigner, dWigner) = VIGdVIG(nMax, q.second, R);
-
-    // call vector spherical functions
-
-    const std::vector<SphericalP<t_complex>> Pn = compute_Pn(nMax, Wigner);
-    const std::vector<SphericalP<t_complex>> Cn =
-        compute_Cn(nMax, q.second, R, Wigner, dWigner);
-                      
-    const std::vector<SphericalP<t_complex>> Bn =
-        compute_Bn(nMax, q.second, R, Wigner, dWigner);
-
-    // call vector spherical waves
-    const std::vector<SphericalP<t_complex>> Mn =
-        compute_Mn(nMax, q.second, R, waveK, _dn, Cn, besselType);
-    const std::vector<SphericalP<t_complex>> Nn =
-        compute_Nn(nMax, q.second, R, waveK, _dn, Pn, Bn, besselType);
-     const std::vector<SphericalP<t_complex>> Xm1 =
-        compute_Xm1(nMax, q.second, R, waveK, _dn, Pn, besselType); 
-     const std::vector<SphericalP<t_complex>> Xp1 =
-        compute_Xp1(nMax, q.second, R, waveK, _dn, Bn, besselType);     
-        
+  using boost::math::factorial;
+  const t_real c_min = std::pow(2.0, -m) *
+                       (std::sqrt(factorial<t_real>(2 * static_cast<unsigned int>(m))) /
+                        factorial<t_real>(static_cast<unsigned int>(m)));
+  for(t_uint j = 0; j < N; ++j)
+    W[n_min * N + j] = c_min * std::pow(1.0 - x[j], m / 2.0) * std::pow(1.0 + x[j], m / 2.0);
 
-    for (t_uint n = static_cast<t_uint>(std::abs(q.second)); n <= nMax; ++n) {
-      if (n != 0) {
-        CompoundIterator p(n, q.second);
+  t_uint s = n_min;
+  if(n_min == 0 && nMax > 0) {
+    for(t_uint j = 0; j < N; ++j)
+      W[N + j] = x[j] * W[j];
+    s = 1;
+  }
+  // Equations B.22 and B.26, the last W[nMax + 1] only being needed for dW[nMax]
+  std::vector<t_real> last(N);
+  for(; nMax > 0 && s <= nMax; ++s) {
+    const t_real a = std::sqrt(static_cast<t_real>(s * s - m * m));
+    const t_real b = std::sqrt(static_cast<t_real>((s + 1) * (s + 1) - m * m));
+    const t_real c_next = s * b;
+    const t_real c_prev = (s + 1) * std::sqrt(static_cast<t_real>(s * s * (s * s - m * m)));
+    t_real *const next = s < nMax ? W + (s + 1) * N : last.data();
+    const t_real *const Ws = W + s * N;
+    const t_real *const Wp = W + (s - 1) * N;
+    t_real *const dWs = dW + s * N;
+    for(t_uint j = 0; j < N; ++j) {
+      next[j] = ((2 * s + 1) * x[j] * Ws[j] - a * Wp[j]) / b;
+      dWs[j] = ((c_next * next[j]) / (2 * s + 1) - (c_prev * Wp[j]) / (s * (2 * s + 1))) / sine[j];
+    }
+  }
 
-        _B[static_cast<t_uint>(p)] = Tools::toProjection(R, Bn[n]);
-        _C[static_cast<t_uint>(p)] = Tools::toProjection(R, Cn[n]);
-        _M[static_cast<t_uint>(p)] = Tools::toProjection(R, Mn[n]);
-        _Xm[static_cast<t_uint>(p)] = Tools::toProjection(R, Xm1[n]);
-        _Xp[static_cast<t_uint>(p)] = Tools::toProjection(R, Xp1[n]);
-        _N[static_cast<t_uint>(p)] = Tools::toProjection(R, Nn[n]);
-        
-       
+  // IV - if (m<0) : apply symmetry property eq(B.7) to eqs(B.22-B.24)
+  if(check_m_negative)
+    for(t_uint i = 0; i <= nMax; ++i) {
+      const t_real c = 1.0 / std::pow(-1.0, i);
+      for(t_uint j = 0; j < N; ++j) {
+        W[i * N + j] *= c;
+        dW[i * N + j] *= -c;
+      }
+    }
+}
+
+//! Stores the projection of spherical components (r, theta, phi) at point j
+inline void project(t_real *out, t_uint N, t_uint j, t_real st, t_real ct, t_real sp, t_real cp,
+                    t_real rr, t_real ri, t_real tr, t_real ti, t_real pr, t_real pi) {
+  out[j] = st * cp * rr + ct * cp * tr - sp * pr;
+  out[N + j] = st * cp * ri + ct * cp * ti - sp * pi;
+  out[2 * N + j] = st * sp * rr + ct * sp * tr + cp * pr;
+  out[3 * N + j] = st * sp * ri + ct * sp * ti + cp * pi;
+  out[4 * N + j] = ct * rr - st * tr;
+  out[5 * N + j] = ct * ri - st * ti;
+}
+} // namespace
+
+AuxAngular::AuxAngular(const std::vector<Spherical<t_real>> &R, t_uint nMax)
+    : R_(R), nMax_(nMax), st_(R.size()), ct_(R.size()), sp_(R.size()), cp_(R.size()),
+      exp_(2 * (2 * nMax + 1) * R.size()), wigner_(3 * Tools::iteratorMax(nMax) * R.size()) {
+  t_uint const N = R.size();
+  for(t_uint j = 0; j < N; ++j) {
+    st_[j] = std::sin(R[j].the);
+    ct_[j] = std::cos(R[j].the);
+    sp_[j] = std::sin(R[j].phi);
+    cp_[j] = std::cos(R[j].phi);
+  }
+
+  std::vector<t_real> W((nMax + 1) * N), dW((nMax + 1) * N), x(N), sine(N);
+  for(t_int m = -static_cast<t_int>(nMax); m <= static_cast<t_int>(nMax); ++m) {
+    VIGdVIG(nMax, m, R, W.data(), dW.data(), x.data(), sine.data());
+
+    t_real *const er = &exp_[2 * (m + nMax) * N];
+    t_real *const ei = er + N;
+    for(t_uint j = 0; j < N; ++j) {
+      er[j] = std::cos(m * R[j].phi);
+      ei[j] = std::sin(m * R[j].phi);
+    }
+
+    for(t_uint n = std::max<t_uint>(std::abs(m), 1); n <= nMax; ++n) {
+      const t_uint i = CompoundIterator(n, m);
+      t_real *const Wi = &wigner_[3 * i * N];
+      t_real *const dWi = Wi + N;
+      t_real *const Ai = Wi + 2 * N;
+      for(t_uint j = 0; j < N; ++j) {
+        Wi[j] = W[n * N + j];
+        dWi[j] = dW[n * N + j];
+        Ai[j] = m == 0 ? 0.0 :
+                         at_pole(R[j].the) ? m / ct_[j] * dWi[j] : m / st_[j] * Wi[j];
       }
     }
   }
 }
 
+AuxCoefficientsBatch::AuxCoefficientsBatch(const std::vector<Spherical<t_real>> &R,
+                                           t_complex waveK, bool regular, t_uint nMax)
+    : AuxCoefficientsBatch(AuxAngular(R, nMax), 0, R.size(), waveK, regular, nMax) {}
+
+AuxCoefficientsBatch::AuxCoefficientsBatch(const AuxAngular &angular, t_uint first, t_uint last,
+                                           t_complex waveK, bool regular, t_uint nMax)
+    : points_(last - first), pMax_(Tools::iteratorMax(nMax)),
+      values_(6 * 3 * 2 * Tools::iteratorMax(nMax) * (last - first), 0.0) {
+  if(nMax > angular.nMax())
+    throw std::runtime_error("The angular functions do not reach the requested nMax");
+  t_uint const N = points_;
+  t_uint const stride = angular.points();
+  const std::vector<t_real> dn = AuxCoefficients::compute_dn(nMax);
+  const BESSEL_TYPE besselType = (regular) ? Bessel : Hankel1;
+
+  // by order and point: z_n(kr), (kr z_n'(kr) + z_n(kr)) / kr and z_n(kr) / kr
+  std::vector<t_real> zr((nMax + 1) * N), zi((nMax + 1) * N);
+  std::vector<t_real> dzr((nMax + 1) * N), dzi((nMax + 1) * N);
+  std::vector<t_real> fzr((nMax + 1) * N), fzi((nMax + 1) * N);
+  for(t_uint j = 0; j < N; ++j) {
+    const t_complex Kr = waveK * angular.R_[first + j].rrr;
+    auto const &bessels = optimet::bessel(Kr, besselType, 0, nMax, bessel_workspace());
+    for(t_uint n = 0; n <= nMax; ++n) {
+      const t_complex z = bessels.data[n];
+      const t_complex dz = (Kr * bessels.ddata[n] + z) / Kr;
+      const t_complex fz = z / Kr;
+      zr[n * N + j] = z.real();
+      zi[n * N + j] = z.imag();
+      dzr[n * N + j] = dz.real();
+      dzi[n * N + j] = dz.imag();
+      fzr[n * N + j] = fz.real();
+      fzi[n * N + j] = fz.imag();
+    }
+  }
+
+  const t_real *const st = &angular.st_[first], *const ct = &angular.ct_[first];
+  const t_real *const sp = &angular.sp_[first], *const cp = &angular.cp_[first];
+  for(t_int m = -static_cast<t_int>(nMax); m <= static_cast<t_int>(nMax); ++m) {
+    const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
+    const t_real *const er = &angular.exp_[2 * (m + angular.nMax()) * stride + first];
+    const t_real *const ei = er + stride;
+
+    for(t_uint n = std::max<t_uint>(std::abs(m), 1); n <= nMax; ++n) {
+      const t_uint i = CompoundIterator(n, m);
+      const t_real a = dm * dn[n];
+      const t_real nn = n * (n + 1);
+      const t_real sn = std::sqrt(nn);
+      const t_real *const Wn = &angular.wigner_[3 * i * stride + first];
+      const t_real *const dWn = Wn + stride;
+      const t_real *const An = Wn + 2 * stride;
+      const t_real *const znr = &zr[n * N], *const zni = &zi[n * N];
+      const t_real *const dznr = &dzr[n * N], *const dzni = &dzi[n * N];
+      const t_real *const fznr = &fzr[n * N], *const fzni = &fzi[n * N];
+      t_real *const outM = data(M_, 0, i), *const outN = data(N_, 0, i);
+      t_real *const outB = data(B_, 0, i), *const outC = data(C_, 0, i);
+      t_real *const outXp = data(Xp_, 0, i), *const outXm = data(Xm_, 0, i);
+
+      for(t_uint j = 0; j < N; ++j) {
+        const t_real A = An[j];
+        const t_real dWj = dWn[j];
+        // a exp(i m phi)
+        const t_real gr = a * er[j], gi = a * ei[j];
+        // Bn = (0, dW, i A) and Cn = (0, i A, -dW)
+        project(outB, N, j, st[j], ct[j], sp[j], cp[j], 0, 0, dWj, 0, 0, A);
+        project(outC, N, j, st[j], ct[j], sp[j], cp[j], 0, 0, 0, A, -dWj, 0);
+        // Mn = a exp(i m phi) z_n Cn
+        const t_real hr = gr * znr[j] - gi * zni[j], hi = gr * zni[j] + gi * znr[j];
+        project(outM, N, j, st[j], ct[j], sp[j], cp[j], 0, 0, -hi * A, hr * A, -hr * dWj,
+                -hi * dWj);
+        // Xm1 = a sqrt(n (n + 1)) exp(i m phi) Pn and Xp1 = a exp(i m phi) Bn
+        project(outXm, N, j, st[j], ct[j], sp[j], cp[j], sn * gr * Wn[j], sn * gi * Wn[j], 0, 0,
+                0, 0);
+        project(outXp, N, j, st[j], ct[j], sp[j], cp[j], 0, 0, gr * dWj, gi * dWj, -gi * A,
+                gr * A);
+        // Nn = a exp(i m phi) (n (n + 1) z_n / kr Pn + (kr z_n' + z_n) / kr Bn)
+        const t_real fr = gr * fznr[j] - gi * fzni[j], fi = gr * fzni[j] + gi * fznr[j];
+        const t_real kr = gr * dznr[j] - gi * dzni[j], ki = gr * dzni[j] + gi * dznr[j];
+        project(outN, N, j, st[j], ct[j], sp[j], cp[j], nn * fr * Wn[j], nn * fi * Wn[j],
+                kr * dWj, ki * dWj, -ki * A, kr * A);
+      }
+    }
+  }
+}
+
+AuxCoefficients::AuxCoefficients(const Spherical<t_real> &R, t_complex waveK,
+                                 bool regular, t_uint nMax)
+    : _M(Tools::iteratorMax(nMax)), _Xp(Tools::iteratorMax(nMax)), 
+      _Xm(Tools::iteratorMax(nMax)), _N(Tools::iteratorMax(nMax)),
+      _B(Tools::iteratorMax(nMax)), _C(Tools::iteratorMax(nMax)),
+      _dn(compute_dn(nMax)) {
+  const AuxCoefficientsBatch batch(std::vector<Spherical<t_real>>(1, R), waveK, regular, nMax);
+  for (t_uint i = 0; i < _M.size(); ++i) {
+    _B[i] = batch.B(i, 0);
+    _C[i] = batch.C(i, 0);
+    _M[i] = batch.M(i, 0);
+    _Xm[i] = batch.Xm(i, 0);
+    _Xp[i] = batch.Xp(i, 0);
+    _N[i] = batch.N(i, 0);
+  }
+}
+
 } // namespace optimet
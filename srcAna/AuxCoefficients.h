@@ -28,9 +28,117 @@
 
 namespace optimet {
 
+/**
+ * The AuxAngular class holds the angular parts of the spherical functions of
+ * many points: the Wigner functions and their derivatives, the exp(i m phi)
+ * factors and the projection of the spherical components. They depend on the
+ * directions of the points only, so they are shared by the functions of all
+ * the wave numbers, e.g. throughout a wavelength scan.
+ */
+class AuxAngular {
+public:
+  /**
+   * Initializing constructor for the AuxAngular class.
+   * @param R the Spherical vectors of the points.
+   * @param nMax the maximum value of the n iterator.
+   */
+  AuxAngular(const std::vector<Spherical<t_real>> &R, t_uint nMax);
+
+  //! Number of points
+  t_uint points() const { return R_.size(); }
+  //! Maximum value of the n iterator
+  t_uint nMax() const { return nMax_; }
+
+private:
+  friend class AuxCoefficientsBatch;
+
+  std::vector<Spherical<t_real>> R_; /**< The points. */
+  t_uint nMax_;                      /**< The maximum value of the n iterator. */
+  std::vector<t_real> st_, ct_, sp_, cp_; /**< Sine and cosine of theta and phi, by point. */
+  std::vector<t_real>
+      exp_; /**< Real then imaginary parts of exp(i m phi), by m from -nMax and point. */
+  std::vector<t_real> wigner_; /**< Wigner function, its derivative and the m / sin(theta) term
+                                    of Bn and Cn, by compound index and point. */
+};
+
+/**
+ * The AuxCoefficientsBatch class implements the spherical functions M, N, B,
+ * C, Xp and Xm of many points at once, for one wave number.
+ * The values are kept as structure of arrays: for each function, compound
+ * index and projection component, the real and the imaginary parts of all the
+ * points are contiguous. The angular recurrences and the radial factors then
+ * run over the points in the innermost loops, which the compiler vectorizes.
+ * The Bessel functions are computed once per point, the angular parts come
+ * from an AuxAngular.
+ */
+class AuxCoefficientsBatch {
+public:
+  //! The functions held by the batch
+  enum Function { M_ = 0, N_, B_, C_, Xp_, Xm_ };
+
+  /**
+   * Initializing constructor for the AuxCoefficientsBatch class.
+   * @param R the Spherical vectors of the points.
+   * @param waveK the wave number.
+   * @param regular the type of coefficients (regular or not).
+   * @param nMax the maximum value of the n iterator.
+   */
+  AuxCoefficientsBatch(const std::vector<Spherical<t_real>> &R, t_complex waveK, bool regular,
+                       t_uint nMax);
+
+  /**
+   * Initializing constructor from cached angular functions.
+   * @param angular the angular functions, up to at least nMax.
+   * @param first the first point of angular in the batch.
+   * @param last one past the last point of angular in the batch.
+   * @param waveK the wave number.
+   * @param regular the type of coefficients (regular or not).
+   * @param nMax the maximum value of the n iterator.
+   */
+  AuxCoefficientsBatch(const AuxAngular &angular, t_uint first, t_uint last, t_complex waveK,
+                       bool regular, t_uint nMax);
+
+  //! Number of points
+  t_uint points() const { return points_; }
+
+  //! The real parts of component c (0, 1 or 2) of function f at compound index i, for all points
+  const t_real *real(Function f, t_uint c, t_uint i) const {
+    return values_.data() + (((f * pMax_ + i) * 3 + c) * 2) * points_;
+  }
+  //! The imaginary parts of component c of function f at compound index i, for all points
+  const t_real *imag(Function f, t_uint c, t_uint i) const {
+    return real(f, c, i) + points_;
+  }
+  //! Function f at compound index i and point j
+  SphericalP<t_complex> operator()(Function f, t_uint i, t_uint j) const {
+    return SphericalP<t_complex>(t_complex(real(f, 0, i)[j], imag(f, 0, i)[j]),
+                                 t_complex(real(f, 1, i)[j], imag(f, 1, i)[j]),
+                                 t_complex(real(f, 2, i)[j], imag(f, 2, i)[j]));
+  }
+
+  SphericalP<t_complex> M(t_uint i, t_uint j) const { return (*this)(M_, i, j); }
+  SphericalP<t_complex> Xp(t_uint i, t_uint j) const { return (*this)(Xp_, i, j); }
+  SphericalP<t_complex> Xm(t_uint i, t_uint j) const { return (*this)(Xm_, i, j); }
+  SphericalP<t_complex> N(t_uint i, t_uint j) const { return (*this)(N_, i, j); }
+  SphericalP<t_complex> B(t_uint i, t_uint j) const { return (*this)(B_, i, j); }
+  SphericalP<t_complex> C(t_uint i, t_uint j) const { return (*this)(C_, i, j); }
+
+private:
+  t_uint points_; /**< The number of points. */
+  t_uint pMax_;   /**< The number of compound indices. */
+  std::vector<t_real>
+      values_; /**< The functions, by function, compound index, component, part and point. */
+
+  //! Writable real parts of component c of function f at compound index i, imaginary parts follow
+  t_real *data(Function f, t_uint c, t_uint i) {
+    return values_.data() + (((f * pMax_ + i) * 3 + c) * 2) * points_;
+  }
+};
+
 /**
  * The AuxCoefficients class implements the spherical functions M, N, B and C.
  * Also implements the dn symbol for incoming wave definition.
+ * The functions are computed by a batch of one point.
  */
 class AuxCoefficients {
 public:
@@ -72,92 +180,6 @@ public:
   const t_real &dn(t_uint i) const { return _dn[i]; }
 
 private:
-  /**
-   * Compute the Pn functions
-   * @param nMax the maximum value of the n iterator.
-   * @param Wigner the Wigner functions.
-   * @return Pn.
-   */
-  std::vector<SphericalP<t_complex>>
-  compute_Pn(t_uint nMax, const std::vector<t_real> &Wigner);
-
-  /**
-   * Compute the Cn functions
-   * @param nMax the maximum value of the n iterator.
-   * @param m_ the the value of the m iterator.
-   * @param R the Spherical vector.
-   * @param dn the d_n symbols.
-   * @param Wigner the Wigner functions.
-   * @param dWigner the derivatives of the Wigner functions.
-   * @param Cn the vector to store Cn in.
-   * @return 0 if succesful, 1 otherwise (deprecated).
-   */
-  std::vector<SphericalP<t_complex>>
-  compute_Cn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-             const std::vector<t_real> &Wigner,
-             const std::vector<t_real> &dWigner);
-                     
-
-  /**
-   * Compute the Bn functions
-   * @param nMax the maximum value of the n iterator.
-   * @param m_ the the value of the m iterator.
-   * @param R the Spherical vector.
-   * @param dn the d_n symbols.
-   * @param Wigner the Wigner functions.
-   * @param dWigner the derivatives of the Wigner functions.
-   * @param Bn the vector to store Bn in.
-   * @return 0 if succesful, 1 otherwise (deprecated).
-   */
-  std::vector<SphericalP<t_complex>>
-  compute_Bn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-             const std::vector<t_real> &Wigner,
-             const std::vector<t_real> &dWigner);
-
-  /**
-   * Compute the Mn functions.
-   * @param nMax the maximum value of the n iterator.
-   * @param R the Spherical vector.
-   * @param waveK the wave vector.
-   * @param Cnm the Cnm functions.
-   * @param Mn the Mn functions.
-   * @param BHreg the type of Bessel functions (regular or not).
-   * @return 0 if succesful, 1 otherwise (deprecated).
-   */
-  std::vector<SphericalP<t_complex>>
-  compute_Mn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-             std::complex<t_real> waveK, const std::vector<t_real> &dn,
-             const std::vector<SphericalP<t_complex>> &Cnm, BESSEL_TYPE BHreg);
-             
-        // compute the Xn functions       
-             
-    std::vector<SphericalP<t_complex>>
-   compute_Xm1 (t_uint nMax, t_int m, const Spherical<t_real> &R,
-             std::complex<t_real> waveK, const std::vector<t_real> &dn,
-             const std::vector<SphericalP<t_complex>> &Pn, BESSEL_TYPE BHreg);
-             
-   std::vector<SphericalP<t_complex>>
-   compute_Xp1 (t_uint nMax, t_int m, const Spherical<t_real> &R,
-             std::complex<t_real> waveK, const std::vector<t_real> &dn,
-             const std::vector<SphericalP<t_complex>> &Bn, BESSEL_TYPE BHreg); 
-
-  /**
-   * Compute the Nn functions.
-   * @param nMax the maximum value of the n iterator.
-   * @param R the Spherical vector.
-   * @param waveK the wave vector.
-   * @param Pn the Pn functions.
-   * @param Bn the Bn functions.
-   * @param Nn the Nn functions.
-   * @param BHreg the type of Bessel functions (regular or not).
-   * @return 0 if successful, 1 otherwise(deprecated).
-   */
-  std::vector<SphericalP<t_complex>>
-  compute_Nn(t_uint nMax, t_int m, const Spherical<t_real> &R, t_complex waveK,
-             const std::vector<t_real> &dn,
-             const std::vector<SphericalP<t_complex>> &Pn,
-             const std::vector<SphericalP<t_complex>> &Bn, BESSEL_TYPE BHreg);
-
   std::vector<SphericalP<t_complex>> _M, _N, _B,
       _C, _Xp, _Xm; /**< The M, N, B and C functions in compound iterator format. */
 
@@ -20,6 +20,8 @@
 #include "constants.h"
 #include <complex>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 #include <vector>
 
@@ -34,10 +36,25 @@ namespace optimet {
 
 enum BESSEL_TYPE { Bessel = 0, Hankel1 = 1, Hankel2 = 2 };
 
+//! \brief Buffers of the Bessel functions, reused from one call to the next
+//! \details Holds the output of AMOS and, when asked for, the functions themselves.
+struct BesselWorkspace {
+  //! Real and imaginary parts returned by AMOS
+  std::vector<double> cyr, cyi;
+  //! The functions, their derivatives and the terms of bessel3der
+  std::vector<std::complex<double>> data, ddata, dddata;
+};
+
+//! The workspace of the calling thread
+inline BesselWorkspace &bessel_workspace() {
+  static thread_local BesselWorkspace workspace;
+  return workspace;
+}
+
 /*!
  * The bessel function implements the Spherical Bessel and Hankel functions
  * and their derivatives, calculated from the zeroth order up to the maximum
- * order.
+ * order, into buffers given by the caller.
  *
  * \tparam BesselType   the type of function:
  *                        \c 0 - Bessel,
@@ -49,27 +66,31 @@ enum BESSEL_TYPE { Bessel = 0, Hankel1 = 1, Hankel2 = 2 };
  *
  * \param [in] z          the argument for the Bessel function
  * \param [in] max_order  the maximum order of functions to calculate
+ * \param [out] data      the max_order + 1 functions
+ * \param [out] ddata     the max_order + 1 derivatives, skipped if null
+ * \param [out] dddata    the max_order + 1 terms of bessel3der, skipped if null, needs ddata
+ * \param workspace       the buffers of AMOS
  *
- * \return a tuple containing the values of the spherical bessel and hankel
- *           functions in the first element, and their derivatives in the second
- *
- * \warning The zeroth order derivative (never used) is not accurate!
+ * \warning The zeroth order derivatives (never used) are not accurate!
  */
 template <BESSEL_TYPE BesselType, bool Scaling = false>
-std::tuple<std::vector<std::complex<double>>, std::vector<std::complex<double>>>
-bessel(const std::complex<double> &z, long int max_order) {
+void bessel(const std::complex<double> &z, long int max_order, std::complex<double> *data,
+            std::complex<double> *ddata, std::complex<double> *dddata = nullptr,
+            BesselWorkspace &workspace = bessel_workspace()) {
   // Calling FORTRAN functions from C/C++ expects the arguments to be pointers
   // to int/real which means they must be rvalues
   const double order = 0.5;
   const long int scaling = Scaling ? 2 : 1;
   const long int bessel_type = BesselType;
 
-  std::vector<std::complex<double>> data(max_order + 1);
-  std::vector<std::complex<double>> ddata(max_order + 1);
-
   if(std::abs(z) <= errEpsilon) {
-    for(int i = 0; i <= max_order; i++)
-      data[i] = ddata[i] = std::complex<double>(0.0, 0.0);
+    for(int i = 0; i <= max_order; i++) {
+      data[i] = std::complex<double>(0.0, 0.0);
+      if(ddata)
+        ddata[i] = std::complex<double>(0.0, 0.0);
+      if(dddata)
+        dddata[i] = std::complex<double>(0.0, 0.0);
+    }
     if(BesselType == Bessel)
       data[0] = std::complex<double>(1, 0);
   } else {
@@ -79,11 +100,16 @@ bessel(const std::complex<double> &z, long int max_order) {
     // Return vectors for real and imaginary parts
     // (+1 for zeroth order, +1 for derivative)
     const long int size = max_order + 2;
-    std::vector<double> cyr(size);
-    std::vector<double> cyi(size);
+    auto &cyr = workspace.cyr;
+    auto &cyi = workspace.cyi;
+    if(cyr.size() < static_cast<std::size_t>(size)) {
+      cyr.resize(size);
+      cyi.resize(size);
+    }
 
     long int zeroUnderflow, ierr;
 
+    {
     if(BesselType == Bessel)
       // Calculate the Bessel function of the first kind
       zbesj_(&zr, &zi, &order, &scaling, &size, cyr.data(), cyi.data(), &zeroUnderflow, &ierr);
@@ -91,6 +117,7 @@ bessel(const std::complex<double> &z, long int max_order) {
       // Calculate the Hankel function of the first or second kind
       zbesh_(&zr, &zi, &order, &scaling, &bessel_type, &size, cyr.data(), cyi.data(),
              &zeroUnderflow, &ierr);
+    }
 
     switch(ierr) {
     case 0:
@@ -121,131 +148,78 @@ bessel(const std::complex<double> &z, long int max_order) {
     for(int i = 0; i <= max_order; i++)
       data[i] = r * std::complex<double>(cyr[i], cyi[i]);
 
-    // Assemble the derivative functions
-    for(int i = 0; i < max_order; i++)
-      ddata[i] = consCm1 * data[i + 1] + ((double)i / z) * data[i];
+    if(ddata) {
+      // Assemble the derivative functions
+      for(int i = 0; i < max_order; i++)
+        ddata[i] = consCm1 * data[i + 1] + ((double)i / z) * data[i];
 
-    // The last derivative
-    ddata[max_order] = consCm1 * r * std::complex<double>(cyr[max_order + 1], cyi[max_order + 1]) +
-                       ((double)max_order / z) * data[max_order];
+      // The last derivative
+      ddata[max_order] =
+          consCm1 * r * std::complex<double>(cyr[max_order + 1], cyi[max_order + 1]) +
+          ((double)max_order / z) * data[max_order];
+    }
+
+    if(dddata) {
+      // Assemble the second derivative functions
+      dddata[0] = std::complex<double>(0.0, 0.0);
+      for(int i = 1; i <= max_order; i++)
+        dddata[i] = consCm1 * ((double)i / z) * ddata[i] +
+                    ((double)i / std::pow(z, 2.0)) * data[i] + ddata[i - 1];
+    }
   }
 
-   if ( (z.imag() == 0.0) && (BesselType == Bessel) ){   
-   // corrects the error if the imaginary part of the argument is exactly zero
-   for (int i = 0; i <= max_order; i++){
-   data[i]=data[i].real();
-   ddata[i]=ddata[i].real();
-   }
-  
+  if((z.imag() == 0.0) && (BesselType == Bessel)) {
+    // corrects the error if the imaginary part of the argument is exactly zero for Bessel func
+    for(int i = 0; i <= max_order; i++) {
+      data[i] = data[i].real();
+      if(ddata)
+        ddata[i] = ddata[i].real();
+      if(dddata)
+        dddata[i] = dddata[i].real();
+    }
   }
+}
 
-  return std::make_tuple(data, ddata);
+//! \brief Spherical Bessel and Hankel functions computed into the buffers of the workspace
+//! \details The returned workspace holds them in data, ddata and, if asked for, dddata.
+template <BESSEL_TYPE BesselType, bool Scaling = false>
+BesselWorkspace &bessel(const std::complex<double> &z, long int max_order,
+                        BesselWorkspace &workspace, bool second_derivative = false) {
+  workspace.data.resize(max_order + 1);
+  workspace.ddata.resize(max_order + 1);
+  if(second_derivative)
+    workspace.dddata.resize(max_order + 1);
+  bessel<BesselType, Scaling>(z, max_order, workspace.data.data(), workspace.ddata.data(),
+                              second_derivative ? workspace.dddata.data() : nullptr, workspace);
+  return workspace;
 }
 
+/*!
+ * Spherical Bessel and Hankel functions and their derivatives, in new vectors.
+ *
+ * \return a tuple containing the values of the spherical bessel and hankel
+ *           functions in the first element, and their derivatives in the second
+ */
+template <BESSEL_TYPE BesselType, bool Scaling = false>
+std::tuple<std::vector<std::complex<double>>, std::vector<std::complex<double>>>
+bessel(const std::complex<double> &z, long int max_order) {
+  std::vector<std::complex<double>> data(max_order + 1);
+  std::vector<std::complex<double>> ddata(max_order + 1);
+  bessel<BesselType, Scaling>(z, max_order, data.data(), ddata.data());
+  return std::make_tuple(std::move(data), std::move(ddata));
+}
+
+//! -i/z f_i' + i/z^2 f_i + f_{i-1}', from the spherical Bessel or Hankel functions f, in a new vector
 template <BESSEL_TYPE BesselType, bool Scaling = false>
 std::vector<std::complex<double>>
 bessel3der(const std::complex<double> &z, long int max_order) {
-
-  // Calling FORTRAN functions from C/C++ expects the arguments to be pointers
-  // to int/real which means they must be rvalues
-  const double order = 0.5;
-  const long int scaling = Scaling ? 2 : 1;
-  const long int bessel_type = BesselType;
-  
-  
-
   std::vector<std::complex<double>> data(max_order + 1);
   std::vector<std::complex<double>> ddata(max_order + 1);
   std::vector<std::complex<double>> dddata(max_order + 1);
-  
-  if(std::abs(z) <= errEpsilon) {
-    for(int i = 0; i <= max_order; i++){
-      data[i] = ddata[i] = std::complex<double>(0.0, 0.0);
-      dddata[i] = std::complex<double>(0.0, 0.0);
-      }
-    if(BesselType == Bessel)
-      
-      data[0] = std::complex<double>(1, 0);
-  } else {
-    const double zr = z.real();
-    const double zi = z.imag();
-
-    // Return vectors for real and imaginary parts
-    // (+1 for zeroth order, +1 for derivative)
-    const long int size = max_order + 2;
-    std::vector<double> cyr(size);
-    std::vector<double> cyi(size);
-
-     long int zeroUnderflow, ierr;
-     
-  
-    if(BesselType == Bessel)
-      // Calculate the Bessel function of the first kind
-      zbesj_(&zr, &zi, &order, &scaling, &size, cyr.data(), cyi.data(), &zeroUnderflow, &ierr);
-    else
-      // Calculate the Hankel function of the first or second kind
-      zbesh_(&zr, &zi, &order, &scaling, &bessel_type, &size, cyr.data(), cyi.data(),
-             &zeroUnderflow, &ierr);
-             
-    switch(ierr) {
-    case 0:
-      break;
-    case 1:
-      throw std::runtime_error("Incorrect input to Henkel/Bessel functions");
-      break;
-    case 2:
-      throw std::runtime_error("Overflow when computing to Henkel/Bessel functions");
-      break;
-    case 3:
-      throw std::runtime_error(
-          "Loss of significance: result is less than half of machine accuracy");
-      break;
-    case 4:
-      throw std::runtime_error("Complete loss of significance");
-      break;
-    case 5:
-      throw std::runtime_error("Algorithmic conditions not met");
-      break;
-    default:
-      throw std::runtime_error("Unknown error when computing Henkel/Bessel functions");
-      break;
-    }
-    
-     
-
-    // Assemble the direct functions
-    const std::complex<double> r = std::sqrt(consPi / (2.0 * z));
-    for(int i = 0; i <= max_order; i++)
-      data[i] = r * std::complex<double>(cyr[i], cyi[i]);
-
-    // Assemble the first derivative functions
-    for(int i = 0; i < max_order; i++)
-      ddata[i] = consCm1 * data[i + 1] + ((double)i / z) * data[i];
-
-    // The last derivative
-    ddata[max_order] = consCm1 * r * std::complex<double>(cyr[max_order + 1], cyi[max_order + 1]) +
-                       ((double)max_order / z) * data[max_order];
-                       
-   // Assemble the second derivative functions
-    for(int i = 1; i <= max_order; i++)
-      dddata[i] = consCm1 * ((double)i / z) * ddata[i] + ((double)i / std::pow(z , 2.0)) * data[i] + ddata[i - 1];
-                       
-                       
-  }
-
-  if ( (z.imag() == 0.0) && (BesselType == Bessel) ){
-   // corrects the error if the imaginary part of the argument is exactly zero
-   for (int i = 1; i <= max_order; i++){
-   dddata[i]=dddata[i].real();
-   }
-  
-  }
-
+  bessel<BesselType, Scaling>(z, max_order, data.data(), ddata.data(), dddata.data());
   return dddata;
 }
 
-
-
 inline std::tuple<std::vector<std::complex<double>>, std::vector<std::complex<double>>>
 bessel(const std::complex<double> &z, enum BESSEL_TYPE besselType, bool scale, long int nMax) {
   switch(besselType) {
@@ -258,6 +232,59 @@ bessel(const std::complex<double> &z, enum BESSEL_TYPE besselType, bool scale, l
   }
 }
 
+//! Spherical Bessel and Hankel functions of a type given at run time, into the workspace
+inline BesselWorkspace &bessel(const std::complex<double> &z, enum BESSEL_TYPE besselType,
+                               bool scale, long int nMax, BesselWorkspace &workspace) {
+  switch(besselType) {
+  case Bessel:
+    return scale ? bessel<Bessel, true>(z, nMax, workspace) :
+                   bessel<Bessel, false>(z, nMax, workspace);
+  case Hankel1:
+    return scale ? bessel<Hankel1, true>(z, nMax, workspace) :
+                   bessel<Hankel1, false>(z, nMax, workspace);
+  case Hankel2:
+    return scale ? bessel<Hankel2, true>(z, nMax, workspace) :
+                   bessel<Hankel2, false>(z, nMax, workspace);
+  }
+  return workspace;
+}
+
+//! An argument of bessel_batch for which the functions could not be computed
+struct BesselFailure {
+  std::size_t index;   /**< The index of the argument. */
+  std::string message; /**< The error, as for a single argument. */
+};
+
+/*!
+ * Spherical Bessel or Hankel functions and their derivatives of many arguments.
+ *
+ * Miller's backward recurrence for the Bessel functions, and the upward recurrence for the Hankel
+ * functions, run over chunks of arguments at once, the arguments in the innermost loops, and the
+ * chunks are shared by the OpenMP threads. Arguments for which the recurrences fail, e.g. zero or
+ * overflowing, are passed on to bessel one at a time.
+ *
+ * \param [in] z         the arguments
+ * \param [in] count     the number of arguments
+ * \param [in] max_order the maximum order of functions to calculate
+ * \param [out] data     the functions, data[n * count + i] of order n at z[i]
+ * \param [out] ddata    the derivatives, as data, skipped if null
+ * \return the arguments whose functions could not be computed, whose values are set to zero
+ */
+template <BESSEL_TYPE BesselType>
+std::vector<BesselFailure> bessel_batch(const std::complex<double> *z, std::size_t count,
+                                        long int max_order, std::complex<double> *data,
+                                        std::complex<double> *ddata);
+
+extern template std::vector<BesselFailure>
+bessel_batch<Bessel>(const std::complex<double> *, std::size_t, long int,
+                     std::complex<double> *, std::complex<double> *);
+extern template std::vector<BesselFailure>
+bessel_batch<Hankel1>(const std::complex<double> *, std::size_t, long int,
+                      std::complex<double> *, std::complex<double> *);
+extern template std::vector<BesselFailure>
+bessel_batch<Hankel2>(const std::complex<double> *, std::size_t, long int,
+                      std::complex<double> *, std::complex<double> *);
+
 } // namespace optimet
 
 #endif /* OPTIMET_BESSEL_H */
@@ -23,11 +23,12 @@
 
 #include <cmath>
 #include <tuple>
+#include <vector>
 
 namespace optimet {
 
 namespace {
-t_complex coefficients_A(t_int n, t_int m, t_int l, t_int k, TranslationAdditionCoefficients &ta) {
+template <class TA> t_complex coefficients_A(t_int n, t_int m, t_int l, t_int k, TA &ta) {
   if(std::abs(k) > l)
     return 0e0;
   auto const factor = 0.5 / std::sqrt(l * (l + 1) * n * (n + 1));
@@ -37,7 +38,7 @@ t_complex coefficients_A(t_int n, t_int m, t_int l, t_int k, TranslationAddition
   return factor * (c0 * ta(n, m, l, k) + c1 * ta(n, m + 1, l, k + 1) + c2 * ta(n, m - 1, l, k - 1));
 }
 
-t_complex coefficients_B(t_int n, t_int m, t_int l, t_int k, TranslationAdditionCoefficients &ta) {
+template <class TA> t_complex coefficients_B(t_int n, t_int m, t_int l, t_int k, TA &ta) {
   if(std::abs(k) > l)
     return 0e0;
   t_real const a0 = 2 * l + 1;
@@ -56,7 +57,7 @@ transfer_coefficients(Spherical<double> R, std::complex<double> waveK, bool regu
   Matrix<t_complex> diagonal = Matrix<t_complex>::Zero(N, N);
   Matrix<t_complex> offdiagonal = Matrix<t_complex>::Zero(N, N);
 
-  TranslationAdditionCoefficients ta(R, waveK, regular);
+  TranslationAdditionCoefficients ta(R, waveK, regular, n_max);
 
   // start at harmonic n = 1. (because n=0 spherical and hence symmetrically incompatible with
   // propagating wave)
@@ -75,6 +76,84 @@ transfer_coefficients(Spherical<double> R, std::complex<double> waveK, bool regu
   return std::make_tuple(diagonal, offdiagonal);
 }
 
+//! Wigner d^j_m,mu(beta) for j = max(|m|, |mu|), with c = cos(beta / 2) and s = sin(beta / 2)
+t_real wigner_edge(t_int m, t_int mu, t_real c, t_real s) {
+  // d^j_m,mu(beta) = d^j_mu,m(-beta)
+  if(std::abs(mu) > std::abs(m))
+    return wigner_edge(mu, m, c, -s);
+  t_int const j = std::abs(m);
+  t_int const k = m > 0 ? mu : -mu;
+  auto const binomial = std::exp(0.5 * (std::lgamma(2 * j + 1) - std::lgamma(j + k + 1) -
+                                        std::lgamma(j - k + 1)));
+  return m > 0 ? binomial * std::pow(c, j + k) * std::pow(-s, j - k) :
+                 binomial * std::pow(c, j + k) * std::pow(s, j - k);
+}
+
+//! \brief Wigner d^n(beta) matrices for n <= nMax, indexed by n - m and n - mu
+//! \details Upward recurrence over n for each (m, mu), starting from the edges of the matrices.
+std::vector<Matrix<t_real>> wigner_d(t_int nMax, t_real beta) {
+  std::vector<Matrix<t_real>> result;
+  for(t_int n(0); n <= nMax; ++n)
+    result.emplace_back(Matrix<t_real>::Zero(2 * n + 1, 2 * n + 1));
+  auto const c = std::cos(0.5 * beta);
+  auto const s = std::sin(0.5 * beta);
+  auto const cosb = std::cos(beta);
+  for(t_int m(-nMax); m <= nMax; ++m)
+    for(t_int mu(-nMax); mu <= nMax; ++mu) {
+      auto const j0 = std::max(std::abs(m), std::abs(mu));
+      t_real previous = 0, current = wigner_edge(m, mu, c, s);
+      result[j0](j0 - m, j0 - mu) = current;
+      for(t_int j(j0 + 1); j <= nMax; ++j) {
+        t_real const mm = m * m, mumu = mu * mu;
+        t_real const factor = j * (2 * j - 1) / std::sqrt((j * j - mm) * (j * j - mumu));
+        t_real next = cosb * current;
+        if(j > 1)
+          next -= m * mu * current / static_cast<t_real>(j * (j - 1)) +
+                  std::sqrt(((j - 1) * (j - 1) - mm) * ((j - 1) * (j - 1) - mumu)) /
+                      static_cast<t_real>((j - 1) * (2 * j - 1)) * previous;
+        previous = current;
+        current = factor * next;
+        result[j](j - m, j - mu) = current;
+      }
+    }
+  return result;
+}
+
+//! Coaxial coupling coefficients for each mu, indexed by n - max(1, |mu|) and l - max(1, |mu|)
+std::tuple<std::vector<Matrix<t_complex>>, std::vector<Matrix<t_complex>>>
+coaxial_coefficients(t_real distance, t_complex waveK, bool regular, t_int n_max) {
+  std::vector<Matrix<t_complex>> diagonal, offdiagonal;
+  CoaxialTranslationAdditionCoefficients const ta(distance, waveK, regular, n_max);
+  for(t_int mu(-n_max); mu <= n_max; ++mu) {
+    auto const first = std::max(1, std::abs(mu));
+    diagonal.emplace_back(n_max - first + 1, n_max - first + 1);
+    offdiagonal.emplace_back(n_max - first + 1, n_max - first + 1);
+    for(t_int n(first); n <= n_max; ++n)
+      for(t_int l(first); l <= n_max; ++l) {
+        diagonal.back()(n - first, l - first) = coefficients_A(n, mu, l, mu, ta);
+        offdiagonal.back()(n - first, l - first) = coefficients_B(n, mu, l, mu, ta);
+      }
+  }
+  return std::make_tuple(diagonal, offdiagonal);
+}
+
+//! Multiplies the rows of each harmonic n, m by exp(i sign m phi) and the rotation
+void rotate(Matrix<t_complex> &inout, std::vector<Matrix<t_real>> const &rotation, t_real phi,
+            t_int sign, bool forward) {
+  auto const N = inout.rows() / 2;
+  for(t_int n(1); n < static_cast<t_int>(rotation.size()); ++n) {
+    Vector<t_complex> phases(2 * n + 1);
+    for(t_int m(-n); m <= n; ++m)
+      phases(n - m) = std::exp(t_complex(0, sign * m * phi));
+    for(t_uint half(0); half < 2; ++half) {
+      auto block = inout.middleRows(half * N + n * n - 1, 2 * n + 1);
+      if(forward)
+        block = rotation[n].transpose() * (phases.asDiagonal() * block);
+      else
+        block = phases.asDiagonal() * (rotation[n] * block);
+    }
+  }
+}
 } // anonymous namespace
 
 Coupling::Coupling(Spherical<t_real> relR, t_complex waveK, t_uint nMax, bool regular) {
@@ -85,4 +164,48 @@ Coupling::Coupling(Spherical<t_real> relR, t_complex waveK, t_uint nMax, bool re
   } else
     std::tie(diagonal, offdiagonal) = transfer_coefficients(relR, waveK, not regular, nMax);
 }
+
+RotationCoupling::RotationCoupling(Spherical<t_real> relR, t_complex waveK, t_uint nMax,
+                                   bool regular)
+    : nMax(nMax), phi(relR.phi), rotation(wigner_d(nMax, relR.the)) {
+  t_int const n_max = nMax;
+  if(std::abs(relR.rrr) < errEpsilon) { // Check for NO translation case
+    for(t_int mu(-n_max); mu <= n_max; ++mu) {
+      auto const size = n_max - std::max(1, std::abs(mu)) + 1;
+      diagonal.emplace_back(Matrix<t_complex>::Identity(size, size));
+      offdiagonal.emplace_back(Matrix<t_complex>::Zero(size, size));
+    }
+  } else
+    std::tie(diagonal, offdiagonal) = coaxial_coefficients(relR.rrr, waveK, not regular, nMax);
+}
+
+Matrix<t_complex> RotationCoupling::apply(Matrix<t_complex> const &input, bool transpose) const {
+  t_int const n_max = nMax;
+  t_int const N = Tools::iteratorMax(n_max);
+  assert(input.rows() == 2 * N);
+  // A = exp(i m phi) d A_z d^T exp(-i k phi), A^T = exp(-i m phi) d A_z^T d^T exp(i k phi)
+  t_int const sign = transpose ? 1 : -1;
+  Matrix<t_complex> result = input;
+  rotate(result, rotation, phi, sign, true);
+  for(t_int mu(-n_max); mu <= n_max; ++mu) {
+    auto const first = std::max(1, std::abs(mu));
+    auto const &A = diagonal[mu + n_max];
+    auto const &B = offdiagonal[mu + n_max];
+    Matrix<t_complex> upper(A.rows(), input.cols()), lower(A.rows(), input.cols());
+    for(t_int n(first); n <= n_max; ++n) {
+      upper.row(n - first) = result.row(flatten_indices(n, mu));
+      lower.row(n - first) = result.row(N + flatten_indices(n, mu));
+    }
+    Matrix<t_complex> const up = transpose ? (A.transpose() * upper + B.transpose() * lower).eval() :
+                                             (A * upper + B * lower).eval();
+    Matrix<t_complex> const low = transpose ? (B.transpose() * upper + A.transpose() * lower).eval() :
+                                              (B * upper + A * lower).eval();
+    for(t_int n(first); n <= n_max; ++n) {
+      result.row(flatten_indices(n, mu)) = up.row(n - first);
+      result.row(N + flatten_indices(n, mu)) = low.row(n - first);
+    }
+  }
+  rotate(result, rotation, phi, -sign, false);
+  return result;
+}
 } // namespace optimet
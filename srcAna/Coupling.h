@@ -19,6 +19,7 @@
 
 #include "Tools.h"
 #include "Types.h"
+#include <vector>
 
 namespace optimet {
 /**
@@ -39,6 +40,38 @@ struct Coupling {
    */
   Coupling(Spherical<t_real> relR_, t_complex waveK_, t_uint nMax_, bool regular_ = true);
 };
+
+/**
+ * The RotationCoupling class implements the A and B coupling coefficients as
+ * a rotation onto the axis between two spheres, a coaxial translation, and the
+ * inverse rotation:
+ * A_nmlk(R) = exp(i(m - k)phi) sum_mu d^n_m,mu(theta) A_nl,mu(|R| z) d^l_k,mu(theta).
+ * The factors are computed and applied in O(nMax^3), rather than the
+ * O(nMax^4) of the full coefficients.
+ */
+struct RotationCoupling {
+  t_uint nMax;                         /**< The maximum value of the n iterator. */
+  t_real phi;                          /**< The azimuthal angle of the axis. */
+  std::vector<Matrix<t_real>> rotation; /**< Wigner d^n(theta), indexed by n - m and n - mu. */
+  /** Coaxial A_nl,mu coefficients, one block per mu, indexed by n - max(1, |mu|). */
+  std::vector<Matrix<t_complex>> diagonal;
+  /** Coaxial B_nl,mu coefficients, one block per mu, indexed by n - max(1, |mu|). */
+  std::vector<Matrix<t_complex>> offdiagonal;
+
+  /**
+   * Initialization constructor for the RotationCoupling class.
+   * @param relR_ the relative spherical vector between two spheres.
+   * @param waveK_ the complex wave number.
+   * @param regular_ the regular flag.
+   * @param nMax_ the maximum value of the n iterator.
+   */
+  RotationCoupling(Spherical<t_real> relR_, t_complex waveK_, t_uint nMax_, bool regular_ = true);
+
+  //! \brief Applies [A B; B A] to the columns of input
+  //! \details With transpose, applies its transpose [A^T B^T; B^T A^T] instead, i.e. the coupling
+  //! in the scattering matrix.
+  Matrix<t_complex> apply(Matrix<t_complex> const &input, bool transpose = false) const;
+};
 }
 
 #endif /* COUPLING_H_ */
@@ -16,7 +16,6 @@
 
 #include "Excitation.h"
 #include "Symbol.h"
-#include "Algebra.h"
 #include "Geometry.h"
 #include "AuxCoefficients.h"
 #include "CompoundIterator.h"
@@ -78,57 +77,29 @@ int Excitation::populate() {
 
 int Excitation::getIncLocal(Spherical<double> point_, std::complex<double> *Inc_local_,
                             int nMax_) const {
-  Spherical<double> Rrel = point_ - Spherical<double>(0.0, 0.0, 0.0);
-  optimet::Coupling const coupling(Rrel, waveK, nMax_, false);
-
-  CompoundIterator p, q;
-
-  int pMax = p.max(nMax_);
-  int qMax = q.max(nMax_);
-  
-
-  std::complex<double> *Inc_direct = new std::complex<double>[2 * pMax];
-  std::complex<double> **T_AB = new std::complex<double> *[2 * (p.max(nMax))];
-  for(p = 0; p < (int)(2 * p.max(nMax)); p++) {
-    T_AB[p] = new std::complex<double>[2 * p.max(nMax)];
-  }
-
-  for(p = 0; p < pMax; p++) {
-    Inc_direct[p] = dataIncAp[p]; //a_n coefficients in the expansion of the source
-    Inc_direct[p + pMax] = dataIncBp[p]; //b_n coefficients in the expansion of the source
-    
-  }
-  
-
-  for(p = 0; p < pMax; p++) {
-    for(q = 0; q < qMax; q++) {
-      T_AB[p][q] = coupling.diagonal(q, p);
-      T_AB[p + pMax][q + qMax] = coupling.diagonal(q, p);  // This is the transfer matrix for the incident wave
-      T_AB[p + pMax][q] = coupling.offdiagonal(q, p);
-      T_AB[p][q + qMax] = coupling.offdiagonal(q, p);
-      
-    }
-  }
-  
- 
-  
-  
-  Algebra::multiplyVectorMatrix(T_AB, 2 * pMax, 2 * pMax, Inc_direct, Inc_local_, consC1, consC0);
-  
-  
-
-  delete[] Inc_direct;
-
-  for(p = 0; p < 2 * pMax; p++) {
-    delete[] T_AB[p];
+  int const pMax = Tools::iteratorMax(nMax_);
+  Eigen::Map<Vector<t_complex>> local(Inc_local_, 2 * pMax);
+
+  // a plane wave only picks up its phase at the new origin
+  if(type == 0) {
+    Cartesian<double> direction = Tools::toCartesian(Spherical<double>(1.0, vKInc.the, vKInc.phi));
+    t_complex const phase = std::exp(consCi * waveK * (direction * Tools::toCartesian(point_)));
+    local.head(pMax) = phase * dataIncAp.head(pMax);
+    local.tail(pMax) = phase * dataIncBp.head(pMax);
+    return 0;
   }
 
-  delete[] T_AB;
+  // other sources are translated as regular expansions
+  Spherical<double> Rrel = point_ - Spherical<double>(0.0, 0.0, 0.0);
+  optimet::Coupling const coupling(Rrel, waveK, nMax_, false);
+  local.head(pMax) = coupling.diagonal.transpose() * dataIncAp.head(pMax) +
+                     coupling.offdiagonal.transpose() * dataIncBp.head(pMax);
+  local.tail(pMax) = coupling.offdiagonal.transpose() * dataIncAp.head(pMax) +
+                     coupling.diagonal.transpose() * dataIncBp.head(pMax);
 
   return 0;
 }
 
-
 void Excitation::updateWavelength(double lambda_) {
   Spherical<double> vKInc_local = vKInc;
   vKInc_local.rrr = 2 * constant::pi / lambda_;
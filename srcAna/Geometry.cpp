@@ -28,6 +28,7 @@
 
 #include <cmath>
 #include <iostream>
+#include <map>
 #include <numeric>
 #include <sstream>
 #include <stdexcept>
@@ -214,36 +215,42 @@ else if (objects[0].scatterer_type == "arbitrary.shape"){
   }
 }
   
+optimet::symbol::CouplingPattern const &Geometry::couplings(int nMax, int nMaxS) {
+  if(couplings_.nMax != nMax or couplings_.nMaxS != nMaxS)
+    couplings_ = optimet::symbol::CouplingPattern(nMax, nMaxS);
+  return couplings_;
+}
+
 #ifdef OPTIMET_MPI
 void Geometry::Coefficients(int nMax, int nMaxS, std::vector<double *> CLGcoeff, int gran1, int gran2){ 
+  auto const &pattern = couplings(nMax, nMaxS);
 
+   optimet::symbol::C_10m1coeff(CLGcoeff[0], pattern, gran1, gran2);
+   optimet::symbol::C_11m1coeff(CLGcoeff[1], pattern, gran1, gran2);
+   optimet::symbol::C_00m1coeff(CLGcoeff[2], pattern, gran1, gran2);
+   optimet::symbol::C_01m1coeff(CLGcoeff[3], pattern, gran1, gran2);
    
-   optimet::symbol::C_10m1coeff(CLGcoeff[0], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::C_11m1coeff(CLGcoeff[1], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::C_00m1coeff(CLGcoeff[2], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::C_01m1coeff(CLGcoeff[3], nMax, nMaxS, gran1, gran2);
-   
-   optimet::symbol::W_m1m1coeff(CLGcoeff[4], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_11coeff(CLGcoeff[5], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_00coeff(CLGcoeff[6], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_10coeff(CLGcoeff[7], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_01coeff(CLGcoeff[8], nMax, nMaxS, gran1, gran2);
+   optimet::symbol::W_m1m1coeff(CLGcoeff[4], pattern, gran1, gran2);
+   optimet::symbol::W_11coeff(CLGcoeff[5], pattern, gran1, gran2);
+   optimet::symbol::W_00coeff(CLGcoeff[6], pattern, gran1, gran2);
+   optimet::symbol::W_10coeff(CLGcoeff[7], pattern, gran1, gran2);
+   optimet::symbol::W_01coeff(CLGcoeff[8], pattern, gran1, gran2);
 }
 #endif
 
 void Geometry::Coefficients(int nMax, int nMaxS, std::vector<double *> CLGcoeff){ 
+  auto const &pattern = couplings(nMax, nMaxS);
 
+   optimet::symbol::C_10m1coeff(CLGcoeff[0], pattern, 0, pattern.size());
+   optimet::symbol::C_11m1coeff(CLGcoeff[1], pattern, 0, pattern.size());
+   optimet::symbol::C_00m1coeff(CLGcoeff[2], pattern, 0, pattern.size());
+   optimet::symbol::C_01m1coeff(CLGcoeff[3], pattern, 0, pattern.size());
    
-   optimet::symbol::C_10m1coeff(CLGcoeff[0], nMax, nMaxS);
-   optimet::symbol::C_11m1coeff(CLGcoeff[1], nMax, nMaxS);
-   optimet::symbol::C_00m1coeff(CLGcoeff[2], nMax, nMaxS);
-   optimet::symbol::C_01m1coeff(CLGcoeff[3], nMax, nMaxS);
-   
-   optimet::symbol::W_m1m1coeff(CLGcoeff[4], nMax, nMaxS);
-   optimet::symbol::W_11coeff(CLGcoeff[5], nMax, nMaxS);
-   optimet::symbol::W_00coeff(CLGcoeff[6], nMax, nMaxS);
-   optimet::symbol::W_10coeff(CLGcoeff[7], nMax, nMaxS);
-   optimet::symbol::W_01coeff(CLGcoeff[8], nMax, nMaxS);
+   optimet::symbol::W_m1m1coeff(CLGcoeff[4], pattern, 0, pattern.size());
+   optimet::symbol::W_11coeff(CLGcoeff[5], pattern, 0, pattern.size());
+   optimet::symbol::W_00coeff(CLGcoeff[6], pattern, 0, pattern.size());
+   optimet::symbol::W_10coeff(CLGcoeff[7], pattern, 0, pattern.size());
+   optimet::symbol::W_01coeff(CLGcoeff[8], pattern, 0, pattern.size());
 }
 
 
@@ -277,7 +284,7 @@ int Geometry::getIncLocalSH(std::vector<double *> CLGcoeff, int objectIndex_,
      
     
       Inc_local[p] =
-                optimet::symbol::vp_mn(p, C_00m1, C_01m1, nMax_,
+                optimet::symbol::vp_mn(p, C_00m1, C_01m1, couplings_, nMax_,
                                               internalCoef_FF_,
                                               objectIndex_,
                                               omega, objects[objectIndex_], bground);
@@ -285,7 +292,7 @@ int Geometry::getIncLocalSH(std::vector<double *> CLGcoeff, int objectIndex_,
                                               
                                               
                                             
-      Inc_local[p+pMax] = optimet::symbol::up_mn(p, C_10m1, C_11m1, nMax_,
+      Inc_local[p+pMax] = optimet::symbol::up_mn(p, C_10m1, C_11m1, couplings_, nMax_,
                                               internalCoef_FF_,
                                               objectIndex_,
                                               omega, objects[objectIndex_], bground);            
@@ -297,7 +304,7 @@ int Geometry::getIncLocalSH(std::vector<double *> CLGcoeff, int objectIndex_,
               
                                   
                   
-      Inc_local[p + 3*pMax] = optimet::symbol::upp_mn(p, W_m1m1, W_00, W_11, W_10, W_01, nMax_, 
+      Inc_local[p + 3*pMax] = optimet::symbol::upp_mn(p, W_m1m1, W_00, W_11, W_10, W_01, couplings_, nMax_, 
                   internalCoef_FF_,
                    objectIndex_,
                   omega, objects[objectIndex_]); 
@@ -344,13 +351,13 @@ int Geometry::getIncLocalSH_parallel(std::vector<double *> CLGcoeff, int gran1,
 
       p = q - objectIndex_ * qMax;
     
-       Inc_local[brojac] = optimet::symbol::vp_mn(p, C_00m1, C_01m1, nMax_,
+       Inc_local[brojac] = optimet::symbol::vp_mn(p, C_00m1, C_01m1, couplings_, nMax_,
                                               internalCoef_FF_,
                                               objectIndex_,
                                               omega, objects[objectIndex_], bground);                                        
                                               
                                            
-      Inc_local[brojac+size] = optimet::symbol::up_mn(p, C_10m1, C_11m1, nMax_,
+      Inc_local[brojac+size] = optimet::symbol::up_mn(p, C_10m1, C_11m1, couplings_, nMax_,
                                               internalCoef_FF_,
                                               objectIndex_,
                                               omega, objects[objectIndex_], bground);
@@ -362,7 +369,7 @@ int Geometry::getIncLocalSH_parallel(std::vector<double *> CLGcoeff, int gran1,
               
                                   
                   
-      Inc_local[brojac + 3*size] = optimet::symbol::upp_mn(p, W_m1m1, W_00, W_11, W_10, W_01, nMax_, 
+      Inc_local[brojac + 3*size] = optimet::symbol::upp_mn(p, W_m1m1, W_00, W_11, W_10, W_01, couplings_, nMax_, 
                   internalCoef_FF_,
                    objectIndex_,
                   omega, objects[objectIndex_]); 
@@ -413,7 +420,7 @@ optimet::Vector<optimet::t_complex> &internalCoef_FF_, optimet::Vector<optimet::
    
   dmnSH = internalCoef_SH_[pMax + objectIndex_ * 2 * pMax + p.compound];
     
-    coefABS[brojac] = optimet::symbol::ACSshcoeff(p, W_m1m1, W_00, W_11, nMax_, nMaxS_,
+    coefABS[brojac] = optimet::symbol::ACSshcoeff(p, W_m1m1, W_00, W_11, couplings_, nMax_, nMaxS_,
                   internalCoef_FF_, cmnSH, dmnSH,
                    objectIndex_,
                   omega, objects[objectIndex_]);
@@ -445,7 +452,7 @@ optimet::Vector<optimet::t_complex> &internalCoef_FF_, optimet::Vector<optimet::
   cmnSH = internalCoef_SH_[objectIndex_ * 2 * pMax + p.compound];
   dmnSH = internalCoef_SH_[pMax + objectIndex_ * 2 * pMax + p.compound];
 
-  coefABS[p] = optimet::symbol::ACSshcoeff(p, W_m1m1, W_00, W_11, nMax_, nMaxS_,
+  coefABS[p] = optimet::symbol::ACSshcoeff(p, W_m1m1, W_00, W_11, couplings_, nMax_, nMaxS_,
                   internalCoef_FF_, cmnSH, dmnSH,
                    objectIndex_,
                   omega, objects[objectIndex_]);
@@ -463,33 +470,12 @@ optimet::Vector<optimet::t_complex> &internalCoef_FF_, double r,
    double *W_11 = CLGcoeff[5];
    double *W_00 = CLGcoeff[6];                                
                  
-   CompoundIterator p;
-  
-   int pMax = p.max(nMaxS_);
    int nMax_ = this->nMax();   
 
   auto const omega = incWave_->omega();
 
- 
-    
-    for(p = 0; p < pMax; p++) {  
-         
-             
-    coefXmn[p] = optimet::symbol::CXm1(p, W_m1m1, W_00, W_11, nMax_,
-                  internalCoef_FF_, r,
-                   objectIndex_,
-                  omega, objects[objectIndex_]);
-                  
-                  
-                 
-    coefXpl[p] = optimet::symbol::CXp1(p, W_m1m1, W_00, W_11, nMax_,
-                  internalCoef_FF_, r,
-                   objectIndex_,
-                  omega, objects[objectIndex_]);              
-                  
-                   
-     
-    }
+  optimet::symbol::CXm1p1(W_m1m1, W_00, W_11, couplings_, nMax_, nMaxS_, internalCoef_FF_, r,
+                          objectIndex_, omega, objects[objectIndex_], coefXmn, coefXpl);
 
   return 0;
 }
@@ -500,5 +486,54 @@ void Geometry::update(std::shared_ptr<optimet::Excitation const> incWave_) {
   // Update the ElectroMagnetic properties of each object
   for(auto &object : objects)
     object.elmag.update(incWave_->lambda());
+
+  // the coefficients at a wavelength of the scan were computed by preload
+  auto const found = preloaded_.find(incWave_->omega());
+  if(found != preloaded_.end() and (preloaded_SH_ or not incWave_->SH_cond)) {
+    spheres_ = found->second;
+    return;
+  }
+  group_spheres();
+  for(optimet::t_uint kind(0); kind < spheres_.size(); ++kind)
+    spheres_[kind] = objects[first_spheres_[kind]].getCoefficients(incWave_->omega(), bground,
+                                                                   incWave_->SH_cond);
+}
+
+void Geometry::preload(std::vector<double> const &lambdas, bool SH) {
+  group_spheres();
+  preloaded_.clear();
+  preloaded_SH_ = SH;
+  if(lambdas.empty())
+    return;
+
+  std::vector<optimet::t_real> omegas(lambdas.size());
+  for(std::size_t w = 0; w < lambdas.size(); ++w)
+    omegas[w] = optimet::constant::c * (2 * optimet::constant::pi / lambdas[w]);
+  for(auto const omega : omegas)
+    preloaded_[omega].resize(first_spheres_.size());
+  // each distinct sphere at all the wavelengths at once, its material evaluated as update will
+  for(optimet::t_uint kind(0); kind < first_spheres_.size(); ++kind) {
+    auto const &object = objects[first_spheres_[kind]];
+    std::vector<ElectroMagnetic> materials(lambdas.size(), object.elmag);
+    for(std::size_t w = 0; w < lambdas.size(); ++w)
+      materials[w].update(lambdas[w]);
+    auto coefficients = object.getCoefficients(omegas, materials, bground, SH);
+    for(std::size_t w = 0; w < lambdas.size(); ++w)
+      preloaded_[omegas[w]][kind] = std::move(coefficients[w]);
+  }
 }
 
+void Geometry::group_spheres() {
+  // the first object of each kind stands for the others
+  first_spheres_.clear();
+  sphere_kinds_.resize(objects.size());
+  for(optimet::t_uint i(0); i < objects.size(); ++i) {
+    optimet::t_uint kind(0);
+    while(kind < first_spheres_.size() and not objects[first_spheres_[kind]].sameSphere(objects[i]))
+      ++kind;
+    if(kind == first_spheres_.size())
+      first_spheres_.push_back(i);
+    sphere_kinds_[i] = kind;
+  }
+  spheres_.resize(first_spheres_.size());
+}
@@ -19,7 +19,9 @@
 
 #include "Excitation.h"
 #include "Scatterer.h"
+#include "Symbol.h"
 #include "Types.h"
+#include <map>
 #include <memory>
 #include <numeric>
 #include <vector>
@@ -34,13 +36,18 @@
  */
 class Geometry {
 private:
-  //
+  optimet::symbol::CouplingPattern couplings_; // couplings of the Clebsch Gordan series
 public:
   std::vector<Scatterer> objects; /**< The list of scatterers. */
 
   ElectroMagnetic bground; /**< The properties of the background. */
   
   bool ACA_cond_; //condition for the existence of ACA compression
+  optimet::t_real ACA_tolerance_ = 1e-3; //relative tolerance of the ACA compression
+  bool ACA_recompress_ = false; //compressed blocks cut to their rank at that tolerance by QR and SVD
+  optimet::t_real krylov_tolerance_ = 1e-7; //relative residual sought by the iterative solver
+  optimet::t_uint krylov_restart_ = 250; //Krylov vectors of a cycle before a restart
+  optimet::t_uint krylov_cycles_ = 3; //cycles of the iterative solver
   /**
    * Default constructor for the Geometry class. Does not initialize.
    */
@@ -65,8 +72,15 @@ public:
   void pushObject(Scatterer const &object_);
   
   // conditions for ACA compression
-  void ACAcompression(bool ACA_cond){ACA_cond_ = ACA_cond;}
+  void ACAcompression(bool ACA_cond, optimet::t_real tolerance = 1e-3, bool recompress = false){ACA_cond_ = ACA_cond; ACA_tolerance_ = tolerance; ACA_recompress_ = recompress;}
   bool get_ACAcond()const{return ACA_cond_;}
+  optimet::t_real get_ACAtolerance()const{return ACA_tolerance_;}
+  bool get_ACArecompress()const{return ACA_recompress_;}
+  // iterations of the GMRES solver of the compressed matrices
+  void krylovSolver(optimet::t_real tolerance, optimet::t_uint restart, optimet::t_uint cycles){krylov_tolerance_ = tolerance; krylov_restart_ = restart; krylov_cycles_ = cycles;}
+  optimet::t_real get_krylovtolerance()const{return krylov_tolerance_;}
+  optimet::t_uint get_krylovrestart()const{return krylov_restart_;}
+  optimet::t_uint get_krylovcycles()const{return krylov_cycles_;}
 
   //! \brief Validate geometry
   //! \details Fails if no objects, or if two objects overlap.
@@ -81,6 +95,8 @@ public:
    * @return the index of the object in which this point is or -1 if outside.
    */
   int checkInner(Spherical<double> R_);
+  // Couplings of the Clebsch Gordan series allowed by the selection rules, one entry of the tables each
+  optimet::symbol::CouplingPattern const &couplings(int nMax, int nMaxS);
   // Clebsch Gordan series coeff
   #ifdef OPTIMET_MPI
   void Coefficients(int nMax, int nMaxS, std::vector<double *> CLGcoeff, int gran1, int gran2);
@@ -117,6 +133,20 @@ optimet::Vector<optimet::t_complex> &internalCoef_FF_, optimet::Vector<optimet::
    */
   void update(std::shared_ptr<optimet::Excitation const> incWave_);
 
+  /**
+   * Computes the coefficients of each distinct sphere at all the wavelengths of a scan, looked
+   * up by update rather than computed at each step.
+   * @param lambdas the wavelengths of the scan.
+   * @param SH whether the SH coefficients are needed too.
+   */
+  void preload(std::vector<double> const &lambdas, bool SH);
+
+  //! \brief Coefficients of an object at the wavelength of the last update
+  //! \details Identical spheres share a single evaluation.
+  SphereCoefficients const &sphere(optimet::t_uint object) const {
+    return spheres_[sphere_kinds_[object]];
+  }
+
   //! Size of the scattering vector
   optimet::t_uint scatterer_size() const;
 
@@ -147,6 +177,18 @@ optimet::Vector<optimet::t_complex> &internalCoef_FF_, optimet::Vector<optimet::
 protected:
   //! Validate last added sphere
   bool no_overlap(Scatterer const &object);
+  //! Groups the objects into distinct spheres
+  void group_spheres();
+  //! Coefficients of each distinct sphere
+  std::vector<SphereCoefficients> spheres_;
+  //! Distinct sphere of each object
+  std::vector<optimet::t_uint> sphere_kinds_;
+  //! First object of each distinct sphere
+  std::vector<optimet::t_uint> first_spheres_;
+  //! Coefficients of each distinct sphere at the frequencies of the scan
+  std::map<optimet::t_real, std::vector<SphereCoefficients>> preloaded_;
+  //! Whether preload computed the SH coefficients
+  bool preloaded_SH_ = false;
 };
 
 #endif /* GEOMETRY_H_ */
@@ -0,0 +1,92 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "MagmaSolver.h"
+#include <Eigen/Dense>
+#include <magma_v2.h>
+#include <stdexcept>
+
+namespace optimet {
+namespace solver {
+
+Magma::Magma(std::shared_ptr<Geometry> geometry, std::shared_ptr<Excitation const> incWave,
+             mpi::Communicator const &communicator)
+    : AbstractSolver(geometry, incWave, communicator) {
+  if(magma_init() != MAGMA_SUCCESS)
+    throw std::runtime_error("Could not initialize MAGMA");
+  update();
+}
+
+Magma::~Magma() { magma_finalize(); }
+
+void Magma::lu_factorization(Matrix<t_complex> &A, std::vector<t_int> &ipiv) {
+  magma_int_t const n = A.rows();
+  magma_int_t const ngpu = magma_num_gpus();
+  std::vector<magma_int_t> pivots(n);
+  magma_int_t info = 0;
+  // t_complex and magmaDoubleComplex share the layout of two doubles
+  auto const data = reinterpret_cast<magmaDoubleComplex *>(A.data());
+  if(ngpu > 1)
+    magma_zgetrf_m(ngpu, n, n, data, n, pivots.data(), &info);
+  else
+    magma_zgetrf(n, n, data, n, pivots.data(), &info);
+  if(info != 0)
+    throw std::runtime_error("Error encountered while factorizing the linear system");
+  ipiv.assign(pivots.begin(), pivots.end());
+}
+
+Vector<t_complex> Magma::lu_solve(Matrix<t_complex> const &LU, std::vector<t_int> const &ipiv,
+                                  Vector<t_complex> b) {
+  for(std::size_t i = 0; i < ipiv.size(); ++i)
+    if(ipiv[i] - 1 != static_cast<t_int>(i))
+      std::swap(b(i), b(ipiv[i] - 1));
+  LU.triangularView<Eigen::UnitLower>().solveInPlace(b);
+  LU.triangularView<Eigen::Upper>().solveInPlace(b);
+  return b;
+}
+
+void Magma::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_SH,
+                  Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const {
+  // FF case
+  X_sca_ = convertIndirect(lu_solve(luFF_, ipivFF_, Q));
+  X_int_ = solveInternal(X_sca_);
+
+  // SH case
+  if(incWave->SH_cond) {
+    Vector<t_complex> X_int_conj = X_int_.conjugate();
+    Vector<t_complex> const K = source_vectorSH(*geometry, incWave, X_int_conj, X_sca_, CGcoeff);
+    Vector<t_complex> K1ana =
+        source_vectorSH_K1ana(*geometry, incWave, X_int_conj, X_sca_, CGcoeff);
+
+    X_sca_SH = convertIndirect_SH_outer(lu_solve(luSH_, ipivSH_, K));
+    X_int_SH = solveInternal_SH(X_sca_SH, K1ana);
+  }
+}
+
+void Magma::update() {
+
+  Q = source_vector(*geometry, incWave);
+
+  luFF_ = preconditioned_scattering_matrix(*geometry, incWave);
+  lu_factorization(luFF_, ipivFF_);
+
+  if(incWave->SH_cond) {
+    luSH_ = preconditioned_scattering_matrixSH(*geometry, incWave);
+    lu_factorization(luSH_, ipivSH_);
+  }
+}
+}
+}
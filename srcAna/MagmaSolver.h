@@ -0,0 +1,61 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_MAGMA_SOLVER_H
+#define OPTIMET_MAGMA_SOLVER_H
+
+#include "Types.h"
+
+#ifdef OPTIMET_MAGMA
+#include "PreconditionedMatrix.h"
+#include "Solver.h"
+#include <vector>
+
+namespace optimet {
+namespace solver {
+
+//! \brief Use an actual matrix, and MAGMA's LU factorization on the GPUs
+//! \details The FF and SH matrices are factorized on every GPU of the node after each update,
+//! the solves reuse the factors on the host.
+class Magma : public AbstractSolver {
+public:
+  Magma(std::shared_ptr<Geometry> geometry, std::shared_ptr<Excitation const> incWave,
+        mpi::Communicator const &communicator = mpi::Communicator());
+  Magma(Run const &run) : Magma(run.geometry, run.excitation, run.communicator) {}
+  ~Magma();
+
+  void solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_SH,
+             Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const override;
+  void update() override;
+
+protected:
+  //! LU factors of the FF and SH scattering matrices, packed as by getrf
+  Matrix<t_complex> luFF_, luSH_;
+  //! Row interchanges of the FF and SH factorizations, one-based
+  std::vector<t_int> ipivFF_, ipivSH_;
+  //! Sources fundamental frequency
+  Vector<t_complex> Q;
+
+  //! Factorizes the matrix in place on the GPUs
+  static void lu_factorization(Matrix<t_complex> &A, std::vector<t_int> &ipiv);
+  //! Solves with the factors on the host
+  static Vector<t_complex> lu_solve(Matrix<t_complex> const &LU, std::vector<t_int> const &ipiv,
+                                    Vector<t_complex> b);
+};
+}
+}
+#endif
+#endif
@@ -32,14 +32,17 @@ void MatrixBelos::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_,Vec
     int nMaxS = geometry->nMaxS();
     int N = nMaxS * (nMaxS + 2);
     int nobj = geometry->objects.size();
-    double tol = 1e-6;
-    int maxit = 340;
-    int no_rest = 1;
+    double const tol = geometry->get_krylovtolerance();
+    int const maxit = geometry->get_krylovrestart();
+    int const no_rest = geometry->get_krylovcycles();
     Vector<t_complex> Q;
 
     if (geometry->ACA_cond_){
-    Q = source_vector(*geometry, incWave);
-    X_sca_ = Gmres_Zcomp(S_comp_FF, Q, tol, maxit, no_rest, *geometry);
+    // each process only computes the sources of its own scatterers
+    int gran1, gran2;
+    ACA_scatterers(geometry->objects.size(), communicator().rank(), communicator().size(), gran1, gran2);
+    Q = source_vector(geometry->objects.begin() + gran1, geometry->objects.begin() + gran2, incWave, *geometry);
+    X_sca_ = Gmres_Zcomp(S_comp_FF, Q, tol, maxit, no_rest, *geometry, guess_);
     PreconditionedMatrix::unprecondition(X_sca_, X_int_);
     }
   else{
@@ -80,7 +83,7 @@ void MatrixBelos::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_,Vec
   MPI_Barrier(MPI_COMM_WORLD);
 
   if (geometry->ACA_cond_){
-  X_sca_SH = Gmres_Zcomp(S_comp_SH, KmNOD, tol, maxit, no_rest, *geometry);
+  X_sca_SH = Gmres_Zcomp(S_comp_SH, KmNOD, tol, maxit, no_rest, *geometry, guess_SH_);
   PreconditionedMatrix::unprecondition_SH(X_sca_SH, X_int_SH, K1ana);
   }
   else{
@@ -15,6 +15,8 @@
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
 #include "Output.h"
+#include <fstream>
+#include <vector>
 
 Output::Output() { initDone = false; }
 
@@ -59,6 +61,139 @@ hid_t Output::getHandle(std::string code_) {
   return -1;
 }
 
+hid_t Output::open(std::string const &outputFileName_) {
+  std::ifstream existing(outputFileName_.c_str());
+  if (existing.good())
+    outputFile = H5Fopen(outputFileName_.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+  else
+    outputFile = H5Fcreate(outputFileName_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                           H5P_DEFAULT);
+  initDone = outputFile >= 0;
+  return outputFile;
+}
+
+bool Output::exists(std::string const &path_) {
+  if (!initDone)
+    return false;
+  // H5Lexists can only be trusted once the parent exists
+  std::string::size_type pos = 0;
+  do {
+    pos = path_.find('/', pos + 1);
+    if (H5Lexists(outputFile, path_.substr(0, pos).c_str(), H5P_DEFAULT) <= 0)
+      return false;
+  } while (pos != std::string::npos);
+  return true;
+}
+
+void Output::writeComplex(std::string const &path_,
+                          std::complex<double> const *data_, hsize_t rows_,
+                          hsize_t cols_) {
+  if (!initDone)
+    return;
+
+  hid_t auxGroupID;
+  if (exists(path_))
+    auxGroupID = H5Gopen(outputFile, path_.c_str(), H5P_DEFAULT);
+  else {
+    hid_t linkProps = H5Pcreate(H5P_LINK_CREATE);
+    H5Pset_create_intermediate_group(linkProps, 1);
+    auxGroupID = H5Gcreate(outputFile, path_.c_str(), linkProps, H5P_DEFAULT,
+                           H5P_DEFAULT);
+    H5Pclose(linkProps);
+  }
+
+  std::vector<double> part(rows_ * cols_);
+  hsize_t dims[2] = {rows_, cols_};
+  char const *names[2] = {"real", "imag"};
+
+  for (int k = 0; k < 2; k++) {
+    for (hsize_t i = 0; i < rows_ * cols_; i++)
+      part[i] = k == 0 ? data_[i].real() : data_[i].imag();
+
+    if (H5Lexists(auxGroupID, names[k], H5P_DEFAULT) > 0)
+      H5Ldelete(auxGroupID, names[k], H5P_DEFAULT);
+
+    hid_t auxDSpaceID = H5Screate_simple(2, dims, NULL);
+    hid_t auxDataID = H5Dcreate(auxGroupID, names[k], H5T_NATIVE_DOUBLE,
+                                auxDSpaceID, H5P_DEFAULT, H5P_DEFAULT,
+                                H5P_DEFAULT);
+    H5Dwrite(auxDataID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+             part.data());
+    H5Dclose(auxDataID);
+    H5Sclose(auxDSpaceID);
+  }
+  H5Gclose(auxGroupID);
+}
+
+bool Output::readComplex(std::string const &path_, std::complex<double> *data_,
+                         hsize_t rows_, hsize_t cols_) {
+  if (!exists(path_ + "/real") || !exists(path_ + "/imag"))
+    return false;
+
+  std::vector<double> real(rows_ * cols_), imag(rows_ * cols_);
+  double *parts[2] = {real.data(), imag.data()};
+  std::string const names[2] = {"/real", "/imag"};
+
+  for (int k = 0; k < 2; k++) {
+    hid_t auxDataID =
+        H5Dopen(outputFile, (path_ + names[k]).c_str(), H5P_DEFAULT);
+    hid_t auxDSpaceID = H5Dget_space(auxDataID);
+    hsize_t dims[2] = {0, 0};
+    bool const valid = H5Sget_simple_extent_ndims(auxDSpaceID) == 2 &&
+                       H5Sget_simple_extent_dims(auxDSpaceID, dims, NULL) == 2 &&
+                       dims[0] == rows_ && dims[1] == cols_;
+    if (valid)
+      H5Dread(auxDataID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+              parts[k]);
+    H5Sclose(auxDSpaceID);
+    H5Dclose(auxDataID);
+    if (!valid)
+      return false;
+  }
+
+  for (hsize_t i = 0; i < rows_ * cols_; i++)
+    data_[i] = std::complex<double>(real[i], imag[i]);
+  return true;
+}
+
+void Output::writeReal(std::string const &path_, double const *data_,
+                       hsize_t size_) {
+  if (!initDone)
+    return;
+
+  if (exists(path_))
+    H5Ldelete(outputFile, path_.c_str(), H5P_DEFAULT);
+
+  hid_t linkProps = H5Pcreate(H5P_LINK_CREATE);
+  H5Pset_create_intermediate_group(linkProps, 1);
+  hsize_t dims[1] = {size_};
+  hid_t auxDSpaceID = H5Screate_simple(1, dims, NULL);
+  hid_t auxDataID = H5Dcreate(outputFile, path_.c_str(), H5T_NATIVE_DOUBLE,
+                              auxDSpaceID, linkProps, H5P_DEFAULT,
+                              H5P_DEFAULT);
+  H5Dwrite(auxDataID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, data_);
+  H5Dclose(auxDataID);
+  H5Sclose(auxDSpaceID);
+  H5Pclose(linkProps);
+}
+
+bool Output::readReal(std::string const &path_, double *data_, hsize_t size_) {
+  if (!exists(path_))
+    return false;
+
+  hid_t auxDataID = H5Dopen(outputFile, path_.c_str(), H5P_DEFAULT);
+  hid_t auxDSpaceID = H5Dget_space(auxDataID);
+  hsize_t dims[1] = {0};
+  bool const valid = H5Sget_simple_extent_ndims(auxDSpaceID) == 1 &&
+                     H5Sget_simple_extent_dims(auxDSpaceID, dims, NULL) == 1 &&
+                     dims[0] == size_;
+  if (valid)
+    H5Dread(auxDataID, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, data_);
+  H5Sclose(auxDSpaceID);
+  H5Dclose(auxDataID);
+  return valid;
+}
+
 void Output::close() {
   if (initDone)
     H5Fclose(outputFile);
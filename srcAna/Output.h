@@ -17,6 +17,7 @@
 #ifndef OUTPUT_H_
 #define OUTPUT_H_
 
+#include <complex>
 #include <string>
 #include <hdf5.h>
 
@@ -79,6 +80,58 @@ public:
    */
   hid_t getHandle(std::string code_);
 
+  /**
+   * Opens an existing HDF5 file for reading and writing, or creates an empty
+   * one. Unlike init(), the file is not truncated and no base groups are made.
+   * @param outputFileName_ the name of the hdf5 file.
+   * @return the handle to the HDF5 file.
+   */
+  hid_t open(std::string const &outputFileName_);
+
+  /**
+   * Checks if a group or dataset exists.
+   * @param path_ the path of the object, e.g. "group/subgroup".
+   * @return true if every element of the path exists.
+   */
+  bool exists(std::string const &path_);
+
+  /**
+   * Writes a complex array as the datasets path_/real and path_/imag.
+   * Missing intermediate groups are created.
+   * @param path_ the group holding the two datasets.
+   * @param data_ the array, rows_ * cols_ values.
+   * @param rows_ the slowest varying dimension of the datasets.
+   * @param cols_ the fastest varying dimension of the datasets.
+   */
+  void writeComplex(std::string const &path_, std::complex<double> const *data_, hsize_t rows_,
+                    hsize_t cols_);
+
+  /**
+   * Reads a complex array written by writeComplex.
+   * @param path_ the group holding the two datasets.
+   * @param data_ the array to fill, rows_ * cols_ values.
+   * @return false if path_ does not exist or its datasets have other dimensions.
+   */
+  bool readComplex(std::string const &path_, std::complex<double> *data_, hsize_t rows_,
+                   hsize_t cols_);
+
+  /**
+   * Writes a real array as the dataset path_.
+   * Missing intermediate groups are created.
+   * @param path_ the dataset.
+   * @param data_ the array, size_ values.
+   * @param size_ the dimension of the dataset.
+   */
+  void writeReal(std::string const &path_, double const *data_, hsize_t size_);
+
+  /**
+   * Reads a real array written by writeReal.
+   * @param path_ the dataset.
+   * @param data_ the array to fill, size_ values.
+   * @return false if path_ does not exist or has another dimension.
+   */
+  bool readReal(std::string const &path_, double *data_, hsize_t size_);
+
   void close();
 };
 
@@ -18,10 +18,12 @@
 #include "PreconditionedMatrix.h"
 #include "Types.h"
 #include "scalapack/BroadcastToOutOfContext.h"
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <numeric>
+#include <set>
 #include <Eigen/Dense>
-#include <Eigen/Sparse>
 using namespace std::chrono;
 
 namespace optimet {
@@ -95,6 +97,56 @@ Vector<t_complex> gather_all_source_vector(scalapack::Matrix<t_complex> const &m
 
 
 #ifdef OPTIMET_MPI
+namespace {
+//! \brief Gathers the four parts of the SH source computed by each process onto all of them
+//! \details Each process holds its entries of the four parts, one part after the other. The
+//! datatypes put entry ii of part q straight into q * TMax + ii of the result, so the parts
+//! need no reordering afterwards. The gather is posted without waiting, completed by wait.
+class SHPartsGather {
+public:
+  SHPartsGather(Vector<t_complex> const &proc, int TMax, mpi::Communicator const &communicator)
+      : result_(4 * TMax), counts_(communicator.size()), displs_(communicator.size()) {
+    int const size = communicator.size();
+    for(int ranki = 0; ranki < size; ranki++) {
+      counts_[ranki] = TMax / size + (ranki < (TMax % size) ? 1 : 0);
+      displs_[ranki] = ranki * (TMax / size) + std::min(ranki, TMax % size);
+    }
+    int const numRow = counts_[communicator.rank()];
+    // an entry of the process is made of that entry in each of the four parts
+    int const sendDispls[] = {0, numRow, 2 * numRow, 3 * numRow};
+    // and goes to the same entry of the four parts of the result
+    int const recvDispls[] = {0, TMax, 2 * TMax, 3 * TMax};
+    MPI_Type_create_indexed_block(4, 1, sendDispls, MPI_DOUBLE_COMPLEX, &sendBlocks_);
+    MPI_Type_create_resized(sendBlocks_, 0, sizeof(t_complex), &sendEntry_);
+    MPI_Type_create_indexed_block(4, 1, recvDispls, MPI_DOUBLE_COMPLEX, &recvBlocks_);
+    MPI_Type_create_resized(recvBlocks_, 0, sizeof(t_complex), &recvEntry_);
+    MPI_Type_commit(&sendEntry_);
+    MPI_Type_commit(&recvEntry_);
+    MPI_Iallgatherv(proc.data(), numRow, sendEntry_, result_.data(), counts_.data(),
+                    displs_.data(), recvEntry_, *communicator, &request_);
+  }
+  SHPartsGather(SHPartsGather const &) = delete;
+  ~SHPartsGather() {
+    MPI_Type_free(&sendEntry_);
+    MPI_Type_free(&recvEntry_);
+    MPI_Type_free(&sendBlocks_);
+    MPI_Type_free(&recvBlocks_);
+  }
+
+  //! Completes the gather and returns the four parts, each TMax long
+  Vector<t_complex> const &wait() {
+    MPI_Wait(&request_, MPI_STATUS_IGNORE);
+    return result_;
+  }
+
+private:
+  Vector<t_complex> result_;
+  std::vector<int> counts_, displs_;
+  MPI_Request request_ = MPI_REQUEST_NULL;
+  MPI_Datatype sendBlocks_, sendEntry_, recvBlocks_, recvEntry_;
+};
+} // namespace
+
 Vector<t_complex> source_vectorSH_K1ana_parallel(Geometry &geometry,
                                            std::shared_ptr<Excitation const> incWave,
                                            Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_, std::vector<double *> CGcoeff) {
@@ -102,7 +154,7 @@ Vector<t_complex> source_vectorSH_K1ana_parallel(Geometry &geometry,
   if(nobj == 0)
      return Vector<t_complex>::Zero(0);
 
-  int gran, gran1, gran2, kk, objInd;
+  int gran1, gran2;
   mpi::Communicator communicator;
   int rank = communicator.rank();
   int size = communicator.size();
@@ -112,7 +164,7 @@ Vector<t_complex> source_vectorSH_K1ana_parallel(Geometry &geometry,
 
   int TMax = nobj * pMax;
   
-  Vector<t_complex> result, resultK, resultKK, result3, result1;
+  Vector<t_complex> resultK;
   Vector<t_complex> X_int_proc;
 
   int sizeFFint;
@@ -137,80 +189,25 @@ Vector<t_complex> source_vectorSH_K1ana_parallel(Geometry &geometry,
    // Analytical for spheres
    if (geometry.objects[0].scatterer_type == "sphere"){
 
-    int sizeVec = 4 * (gran2 - gran1);
-
-     result.resize(4*nobj*pMax);
-     resultKK.resize(4*nobj*pMax);
-     resultKK.setZero();
-
      resultK.resize(2*nobj*pMax);
-     resultK.setZero();
-
-    Vector<t_complex> resultProc(sizeVec);
-
-    Vector<int> sizesProc(size), disps(size);
-
-    MPI_Allgather (&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
-
-   for (int kk = 0; kk < size; kk++)
-   disps(kk) = (kk > 0) ? (disps(kk-1) + sizesProc(kk-1)) : 0;
-
-    resultProc = source_vectorSH_parallel(geometry, gran1, gran2, incWave, X_int_proc, CGcoeff);
-
-    MPI_Gatherv (&resultProc(0), sizeVec, MPI_DOUBLE_COMPLEX, &result(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-
-
-  if (rank == 0){
-
-  for (int ranki = 0; ranki < size; ranki++){
-  
-    if (ranki < (TMax % size)) {
-    gran1 = ranki * (TMax/size + 1);
-    gran2 = gran1 + TMax/size + 1;
-    } else {
-    gran1 = ranki * (TMax/size) + (TMax % size);
-    gran2 = gran1 + (TMax/size);
-    }
 
-      sizeVec = 4 * (gran2 - gran1);
+    Vector<t_complex> const resultProc = source_vectorSH_parallel(geometry, gran1, gran2, incWave, X_int_proc, CGcoeff);
 
-  int brojac (0);
-  for (int ii = gran1; ii < gran2; ii++){
+    SHPartsGather gather(resultProc, TMax, communicator);
 
-  objInd = ii / pMax;
+    // the coefficients of the spheres are laid out while the parts travel
+    for(int kk = 0; kk != nobj; kk++)
+      resultK.segment(kk * 2 * pMax, 2 * pMax) = geometry.sphere(kk).IauxSH2;
 
-  kk = ii - objInd * pMax;
-
-  gran = objInd * 4 * pMax + kk;
-
-  resultKK(gran) = result(disps(ranki) + brojac);
-  resultKK(gran + pMax) = result(disps(ranki) + (sizeVec/4) + brojac);
-  resultKK(gran + 2*pMax) = result(disps(ranki) + 2*(sizeVec/4) + brojac);
-  resultKK(gran + 3*pMax) = result(disps(ranki) + 3*(sizeVec/4) + brojac);
-
-  brojac++;
-
-  } // for ii
-
-  }  // for ranki
-
-
-  int i1 = 0;
-  int ii1 = 0;
+    auto const &resultKK = gather.wait();
 
    for(int kk = 0; kk != nobj; kk++)  {
 
-    resultK.segment(ii1, 2*pMax) =
-         (geometry.objects[kk].getIauxSH2(incWave->omega(), geometry.bground).array() * resultKK.segment(i1+2*pMax, 2*pMax).array());
-
-  i1 += 4 * pMax;
-  ii1 += 2 * pMax;
+    resultK.segment(kk * 2 * pMax, pMax).array() *= resultKK.segment(2 * TMax + kk * pMax, pMax).array();
+    resultK.segment(kk * 2 * pMax + pMax, pMax).array() *= resultKK.segment(3 * TMax + kk * pMax, pMax).array();
 
   }
   
-  } // if rank0
-  MPI_Bcast(&resultK(0), 2 * nobj *pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-  
   } // if sphere
 
 return resultK;
@@ -225,19 +222,17 @@ auto const nobj = geometry.objects.size();
   if(nobj == 0)
      return Vector<t_complex>::Zero(0);
   
-  int gran, gran1, gran2, kk, objInd;
+  int gran1, gran2;
   mpi::Communicator communicator;
   int rank = communicator.rank();
   int size = communicator.size();
   auto const nMaxS = geometry.objects.front().nMaxS;
-  auto const k_b_SH = 2.0 * incWave->omega() * std::sqrt(geometry.bground.epsilon * geometry.bground.mu);
 
   t_uint const pMax = nMaxS * (nMaxS + 2);
 
   int TMax = nobj * pMax;
 
-  Vector<t_complex> result, resultK, resultKK, result3, result1, resultK3, resultK1;
-  Matrix<t_complex> TmatrixSH (2*pMax, 2*pMax);
+  Vector<t_complex> resultK;
   Vector<t_complex> X_int_proc, X_sca_proc;
   
   int sizeFFint;
@@ -265,81 +260,23 @@ auto const nobj = geometry.objects.size();
    // Analytical for spheres
     if (geometry.objects[0].scatterer_type == "sphere"){
 
-    int sizeVec = 4 * (gran2 - gran1);
-
-     result.resize(4*nobj*pMax);
-     resultKK.resize(4*nobj*pMax);
-     resultKK.setZero();
-
      resultK.resize(2*nobj*pMax);
-     resultK.setZero();
-          
-    Vector<t_complex> resultProc(sizeVec);
-
-    Vector<int> sizesProc(size), disps(size);
-  
-    MPI_Allgather (&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
-  
-   for (int kk = 0; kk < size; kk++)
-   disps(kk) = (kk > 0) ? (disps(kk-1) + sizesProc(kk-1)) : 0;
-      
-    resultProc = source_vectorSH_parallel(geometry, gran1, gran2, incWave, X_int_proc, CGcoeff);
-
-    MPI_Gatherv (&resultProc(0), sizeVec, MPI_DOUBLE_COMPLEX, &result(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD); 
-
-
-  if (rank == 0){ 
-  
-  for (int ranki = 0; ranki < size; ranki++){
-
-     if (ranki < (TMax % size)) {
-    gran1 = ranki * (TMax/size + 1);
-    gran2 = gran1 + TMax/size + 1;
-    } else {
-    gran1 = ranki * (TMax/size) + (TMax % size);
-    gran2 = gran1 + (TMax/size);
-    }
-
-      sizeVec = 4 * (gran2 - gran1);
-
-  int brojac (0);
-  for (int ii = gran1; ii < gran2; ii++){
-
-  objInd = ii / pMax;
-
-  kk = ii - objInd * pMax; 
 
-  gran = objInd * 4 * pMax + kk;
+    Vector<t_complex> const resultProc = source_vectorSH_parallel(geometry, gran1, gran2, incWave, X_int_proc, CGcoeff);
 
-  resultKK(gran) = result(disps(ranki) + brojac);
-  resultKK(gran + pMax) = result(disps(ranki) + (sizeVec/4) + brojac);
-  resultKK(gran + 2*pMax) = result(disps(ranki) + 2*(sizeVec/4) + brojac);
-  resultKK(gran + 3*pMax) = result(disps(ranki) + 3*(sizeVec/4) + brojac);
+    SHPartsGather gather(resultProc, TMax, communicator);
 
-  brojac++; 
-  
-  } // for ii
-
-  }  // for ranki
- 
+    auto const &resultKK = gather.wait();
 
-  int i1 = 0;
-  int ii1 = 0;
- 
    for(int kk = 0; kk != nobj; kk++)  {
  
-    resultK.segment(ii1, 2*pMax) =
-         (geometry.objects[kk].getTLocalSH1_outer(incWave->omega(), geometry.bground).array() * resultKK.segment(i1, 2*pMax).array()) +
-
-        (geometry.objects[kk].getTLocalSH2_outer(incWave->omega(), geometry.bground).array() * resultKK.segment(2*pMax + i1, 2*pMax).array());
-       
-  i1 += 4 * pMax;
-  ii1 += 2 * pMax;
+    auto const &sphere = geometry.sphere(kk);
+    for(int q = 0; q < 2; q++)
+      resultK.segment(kk * 2 * pMax + q * pMax, pMax) =
+          sphere.SH1_outer.segment(q * pMax, pMax).cwiseProduct(resultKK.segment(q * TMax + kk * pMax, pMax)) +
+          sphere.SH2_outer.segment(q * pMax, pMax).cwiseProduct(resultKK.segment((q + 2) * TMax + kk * pMax, pMax));
 
   }
-   } // if rank0
-
-   MPI_Bcast(&resultK(0), 2 * nobj *pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
   } // if sphere
 
 return resultK;
@@ -352,13 +289,12 @@ preconditioned_scattering_matrix(std::vector<Scatterer>::const_iterator const &f
                                  std::vector<Scatterer>::const_iterator const &end_first,
                                  std::vector<Scatterer>::const_iterator const &second,
                                  std::vector<Scatterer>::const_iterator const &end_second,
-                                 ElectroMagnetic const &bground,
+                                 Geometry const &geometry,
                                  std::shared_ptr<Excitation const> incWave) {
   
                                                             
   auto const nMax = first->nMax;
   auto const n = nMax * (nMax + 2);
-  Matrix<t_complex> Tmatrix (2 * n , 2 * n); 
    
   if(first == end_first or second == end_second)
     return Matrix<t_complex>::Zero(2 * n * (end_first - first), 2 * n * (end_second - second));
@@ -368,7 +304,7 @@ preconditioned_scattering_matrix(std::vector<Scatterer>::const_iterator const &f
    size_t x(0);
    for(auto iteri(first); iteri != end_first; ++iteri, x += 2 * n) {
 
-     iteri->getTLocal(Tmatrix, incWave->omega(), bground);
+     auto const &T = geometry.sphere(iteri - geometry.objects.begin()).T;
 
      size_t y(0);
      for(auto iterj(second); iterj != end_second; ++iterj, y += 2 * n) {
@@ -387,7 +323,7 @@ preconditioned_scattering_matrix(std::vector<Scatterer>::const_iterator const &f
         result.block(x + n, y + n, n, n) = AB.diagonal.transpose();
         result.block(x, y + n, n, n) = AB.offdiagonal.transpose();
         result.block(x + n, y, n, n) = AB.offdiagonal.transpose();
-        result.block(x, y, 2 * n, 2 * n) = -(Tmatrix)*result.block(x, y, 2 * n, 2 * n);
+        result.block(x, y, 2 * n, 2 * n) = -(T.asDiagonal() * result.block(x, y, 2 * n, 2 * n));
         
   
     }
@@ -398,156 +334,127 @@ preconditioned_scattering_matrix(std::vector<Scatterer>::const_iterator const &f
   
   return result;
 }
+//! \brief Sets the block coupling first to second, -T [A^T B^T; B^T A^T], with T the diagonal of
+//! the T-matrix of first
+//! \details Blocks of well separated pairs are compressed by ACA from the rows and columns it
+//! pivots on, each applied through the rotation-coaxial factors, so the full block is never
+//! formed. The other blocks, and those ACA cannot compress, are kept dense.
+void ACA_coupling_block(Matrix_ACA &block, Vector<t_complex> const &T, Scatterer const &first,
+                        Scatterer const &second, t_complex waveK, t_uint nMax,
+                        Geometry const &geometry) {
+  auto const n = nMax * (nMax + 2);
+  block.dim = 2 * n;
+  auto const distance = Tools::findDistance(first.vR, second.vR);
+  if (distance >= 2.0*(first.radius + second.radius)){ //admissibility criterion for ACA
+
+    RotationCoupling const AB(first.vR - second.vR, waveK, nMax);
+    auto const unit = [n](int i) {
+      Matrix<t_complex> result = Matrix<t_complex>::Zero(2 * n, 1);
+      result(i) = 1.0;
+      return result;
+    };
+    // row i of the block is column i of [A B; B A], column j that of its transpose
+    auto const row = [&](int i) { return Vector<t_complex>(-T(i) * AB.apply(unit(i), false).col(0)); };
+    auto const col = [&](int j) {
+      return Vector<t_complex>(-T.cwiseProduct(AB.apply(unit(j), true).col(0)));
+    };
+    if(ACA_compression(block.U, block.V, 2 * n, row, col, geometry.get_ACAtolerance())) {
+      if(geometry.get_ACArecompress())
+        ACA_recompress(block.U, block.V, geometry.get_ACAtolerance());
+      return;
+    }
+  }
+
+  Coupling const AB(first.vR - second.vR, waveK, nMax);
+  Matrix<t_complex> CoupSubm (2*n, 2*n);
+  CoupSubm.block(0, 0, n, n) = AB.diagonal.transpose();
+  CoupSubm.block(n, n, n, n) = AB.diagonal.transpose();
+  CoupSubm.block(0, n, n, n) = AB.offdiagonal.transpose();
+  CoupSubm.block(n, 0, n, n) = AB.offdiagonal.transpose();
+  block.S_sub = - (T.asDiagonal() * CoupSubm);
+}
+
 #ifdef OPTIMET_MPI
+void ACA_scatterers(int nobj, int proc, int size, int &gran1, int &gran2){
+  if (proc < (nobj % size)) {
+    gran1 = proc * (nobj/size + 1);
+    gran2 = gran1 + nobj/size + 1;
+    } else {
+    gran1 = proc * (nobj/size) + (nobj % size);
+    gran2 = gran1 + (nobj/size);
+    }
+}
+
 void Scattering_matrix_ACA_FF_parallel(Geometry const &geometry, std::shared_ptr<Excitation const> incWave, std::vector<Matrix_ACA> &S_comp){
 
- 
   auto const nMax = geometry.objects[0].nMax;
   auto const n = nMax * (nMax + 2);
-  Matrix<t_complex> Tmatrix (2*n , 2*n), U, V;
-  Matrix<t_complex> CoupSubm (2*n, 2*n);
-  double distance, sizeMAT(0.0);
+  double sizeMAT(0.0);
   int nobj = geometry.objects.size();
-  
+
   mpi::Communicator communicator;
   int rank = communicator.rank();
   int size = communicator.size();
   int gran1, gran2, Ncp_proc;
   Vector<double> sizeMAT_vec(size);
-  
-  if (rank < (nobj % size)) {
-    gran1 = rank * (nobj/size + 1);
-    gran2 = gran1 + nobj/size + 1;
-    } else {
-    gran1 = rank * (nobj/size) + (nobj % size);
-    gran2 = gran1 + (nobj/size);
-    }
+
+  ACA_scatterers(nobj, rank, size, gran1, gran2);
 
    Ncp_proc = nobj*(gran2 - gran1);
    S_comp.resize(Ncp_proc);
-   
    int brojac(0);
-   
- 
-  for(int ii = gran1; ii < gran2; ++ii) {
-  
-     geometry.objects[ii].getTLocal(Tmatrix, incWave->omega(), geometry.bground);
 
-      for(int jj = 0; jj != nobj; ++jj) {
-       
-    
-      if(ii == jj) {
-        
-        S_comp[brojac].S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
-        S_comp[brojac].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[brojac].S_sub.size())*(16.0/1e6);
-        
-      } else {
-      
-        distance = Tools::findDistance(geometry.objects[ii].vR, geometry.objects[jj].vR);
-      
-        Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, incWave->waveK, nMax);
-        
-        CoupSubm.block(0, 0, n, n) = AB.diagonal.transpose();
-        CoupSubm.block(n, n, n, n) = AB.diagonal.transpose();
-        CoupSubm.block(0, n, n, n) = AB.offdiagonal.transpose();
-        CoupSubm.block(n, 0, n, n) = AB.offdiagonal.transpose();
-        CoupSubm = - Tmatrix * CoupSubm;
-        
+  for(int ii = gran1; ii < gran2; ++ii) {
 
-        if (distance >= 2.0*(geometry.objects[ii].radius + geometry.objects[jj].radius)){ //admissibility criterion for ACA
-        
-        ACA_compression(U , V, CoupSubm);
-        
-        S_comp[brojac].U = U;
-        S_comp[brojac].V = V;
-        S_comp[brojac].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[brojac].U.size())*(16.0/1e6) + (S_comp[brojac].V.size())*(16.0/1e6); 
-        }
-        
-        else{
-        S_comp[brojac].S_sub =  CoupSubm;
-        S_comp[brojac].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[brojac].S_sub.size())*(16.0/1e6);
-        } 
-        
+     auto const &T = geometry.sphere(ii).T;
 
-   }
+    for(int jj = 0; jj != nobj; ++jj) {
 
-  brojac++;
-  } 
+      auto &block = S_comp[brojac];
+      if(ii == jj) {
+        block.S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
+        block.dim = 2 * n;
+      } else
+        ACA_coupling_block(block, T, geometry.objects[ii], geometry.objects[jj], incWave->waveK, nMax, geometry);
+      sizeMAT = sizeMAT + (block.S_sub.size() + block.U.size() + block.V.size())*(16.0/1e6);
+      brojac++;
+    }
 
- }
+  }
 // sum all the partial sizes of matrices
 MPI_Gather(&sizeMAT, 1, MPI_DOUBLE, &sizeMAT_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
 if(rank==0)
 std::cout<<"The size of the FF scattering matrix in MB is"<< sizeMAT_vec.sum()<<std::endl;
- 
+
 }
 #endif
 void Scattering_matrix_ACA_FF(Geometry const &geometry, std::shared_ptr<Excitation const> incWave, std::vector<Matrix_ACA> &S_comp){
 
- 
   auto const nMax = geometry.objects[0].nMax;
   auto const n = nMax * (nMax + 2);
-  Matrix<t_complex> Tmatrix (2*n , 2*n), U, V;
-  Matrix<t_complex> CoupSubm (2*n, 2*n);
-  double distance, sizeMAT(0.0);
+  double sizeMAT(0.0);
   int nobj = geometry.objects.size();
   S_comp.resize(nobj*nobj);
-  
+
   for(int ii = 0; ii != nobj; ++ii) {
-      
-     geometry.objects[ii].getTLocal(Tmatrix, incWave->omega(), geometry.bground);
-     
-    
+
+     auto const &T = geometry.sphere(ii).T;
+
     for(int jj = 0; jj != nobj; ++jj) {
 
-    
+      auto &block = S_comp[nobj*ii + jj];
       if(ii == jj) {
-        S_comp[nobj*ii + jj].S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
-        S_comp[nobj*ii + jj].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[ii*nobj + jj].S_sub.size())*(16.0/1e6);
-        
-      } else {
-      
-        distance = Tools::findDistance(geometry.objects[ii].vR, geometry.objects[jj].vR);
-      
-        Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, incWave->waveK, nMax);
-        
-        CoupSubm.block(0, 0, n, n) = AB.diagonal.transpose();
-        CoupSubm.block(n, n, n, n) = AB.diagonal.transpose();
-        CoupSubm.block(0, n, n, n) = AB.offdiagonal.transpose();
-        CoupSubm.block(n, 0, n, n) = AB.offdiagonal.transpose();
-        CoupSubm = - (Tmatrix) * CoupSubm;
-        
+        block.S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
+        block.dim = 2 * n;
+      } else
+        ACA_coupling_block(block, T, geometry.objects[ii], geometry.objects[jj], incWave->waveK, nMax, geometry);
+      sizeMAT = sizeMAT + (block.S_sub.size() + block.U.size() + block.V.size())*(16.0/1e6);
+    }
 
-        if (distance >= 2.0*(geometry.objects[ii].radius + geometry.objects[jj].radius)){ //admissibility criterion for ACA
-        
-        ACA_compression(U , V, CoupSubm);
-        
-        S_comp[nobj*ii + jj].U = U;
-        S_comp[nobj*ii + jj].V = V;
-        S_comp[nobj*ii + jj].dim = 2 * n; 
-        sizeMAT = sizeMAT + (S_comp[ii*nobj + jj].U.size())*(16.0/1e6) + (S_comp[ii*nobj + jj].V.size())*(16.0/1e6);
-        }
-        
-        else{
-        S_comp[nobj*ii + jj].S_sub =  CoupSubm; 
-        S_comp[nobj*ii + jj].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[ii*nobj + jj].S_sub.size())*(16.0/1e6);
-        }
-        
+  }
 
-    }
-  
-      }
-  
-        }
-        
-  std::cout<<"The size of the FF matrix in MB is"  <<sizeMAT<< std::endl;      
-  
+  std::cout<<"The size of the FF matrix in MB is"  <<sizeMAT<< std::endl;
 }
 
 
@@ -557,13 +464,12 @@ preconditioned_scattering_matrixSH(std::vector<Scatterer>::const_iterator const
                                  std::vector<Scatterer>::const_iterator const &end_first,
                                  std::vector<Scatterer>::const_iterator const &second,
                                  std::vector<Scatterer>::const_iterator const &end_second,
-                                 ElectroMagnetic const &bground,
+                                 Geometry const &geometry,
                                  std::shared_ptr<Excitation const> incWave) {
                                  
                               
   auto const nMaxS = first->nMaxS;
   auto const n = nMaxS * (nMaxS + 2);
-  Matrix<t_complex> TmatrixSH (2*n , 2*n);
   Matrix<t_complex> resultSH;
 
   if (first->scatterer_type == "sphere"){
@@ -575,7 +481,7 @@ preconditioned_scattering_matrixSH(std::vector<Scatterer>::const_iterator const
         
     size_t x(0);
     for(auto iteri(first); iteri != end_first; ++iteri, x += 2 * n) {
-    iteri->getTLocalSH(TmatrixSH, incWave->omega(), bground);
+    auto const &TSH = geometry.sphere(iteri - geometry.objects.begin()).TSH;
 
     size_t y(0);
     for(auto iterj(second); iterj != end_second; ++iterj, y += 2 * n) {
@@ -595,7 +501,7 @@ preconditioned_scattering_matrixSH(std::vector<Scatterer>::const_iterator const
         resultSH.block(x + n, y + n, n, n) = AB.diagonal.transpose();
         resultSH.block(x, y + n, n, n) = AB.offdiagonal.transpose();
         resultSH.block(x + n, y, n, n) = AB.offdiagonal.transpose();
-        resultSH.block(x, y, 2 * n, 2 * n) = - (TmatrixSH)*resultSH.block(x, y, 2 * n, 2 * n);
+        resultSH.block(x, y, 2 * n, 2 * n) = -(TSH.asDiagonal() * resultSH.block(x, y, 2 * n, 2 * n));
       
      }
      
@@ -614,9 +520,7 @@ void Scattering_matrix_ACA_SH_parallel(Geometry const &geometry, std::shared_ptr
 
   auto const nMaxS = geometry.objects[0].nMaxS;
   auto const n = nMaxS * (nMaxS + 2);
-  Matrix<t_complex> TmatrixSH (2*n , 2*n), U, V;
-  Matrix<t_complex> CoupSubmSH (2*n, 2*n);
-  double distance, sizeMAT(0.0);
+  double sizeMAT(0.0);
   int nobj = geometry.objects.size();
 
   mpi::Communicator communicator;
@@ -625,74 +529,35 @@ void Scattering_matrix_ACA_SH_parallel(Geometry const &geometry, std::shared_ptr
   int gran1, gran2, Ncp_proc;
   Vector<double> sizeMAT_vec(size);
 
-  if (rank < (nobj % size)) {
-    gran1 = rank * (nobj/size + 1);
-    gran2 = gran1 + nobj/size + 1;
-    } else {
-    gran1 = rank * (nobj/size) + (nobj % size);
-    gran2 = gran1 + (nobj/size);
-    }
+  ACA_scatterers(nobj, rank, size, gran1, gran2);
 
    Ncp_proc = nobj*(gran2 - gran1);
    S_comp.resize(Ncp_proc);
    int brojac(0);
-  
- 
+
   for(int ii = gran1; ii < gran2; ++ii) {
-      
-     geometry.objects[ii].getTLocalSH(TmatrixSH, incWave->omega(), geometry.bground);
-     
-    
-    for(int jj = 0; jj != nobj; ++jj) {
 
-    
-      if(ii == jj) {
-        S_comp[brojac].S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
-        S_comp[brojac].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[brojac].S_sub.size())*(16.0/1e6);
-        
-      } else {
-      
-        distance = Tools::findDistance(geometry.objects[ii].vR, geometry.objects[jj].vR);
-      
-        Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 2.0 * incWave->waveK, nMaxS);
-        
-        CoupSubmSH.block(0, 0, n, n) = AB.diagonal.transpose();
-        CoupSubmSH.block(n, n, n, n) = AB.diagonal.transpose();
-        CoupSubmSH.block(0, n, n, n) = AB.offdiagonal.transpose();
-        CoupSubmSH.block(n, 0, n, n) = AB.offdiagonal.transpose();
-        CoupSubmSH = - (TmatrixSH) * CoupSubmSH;
-        
+     auto const &TSH = geometry.sphere(ii).TSH;
 
-        if (distance >= 2.0*(geometry.objects[ii].radius + geometry.objects[jj].radius)){ //admissibility criterion for ACA
+    for(int jj = 0; jj != nobj; ++jj) {
 
-        ACA_compression(U , V, CoupSubmSH);
-        
-        S_comp[brojac].U = U;
-        S_comp[brojac].V = V;
-        S_comp[brojac].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[brojac].U.size())*(16.0/1e6) + (S_comp[brojac].V.size())*(16.0/1e6);
-         
-        }
-        
-        else{
-        S_comp[brojac].S_sub =  CoupSubmSH;
-        S_comp[brojac].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[brojac].S_sub.size())*(16.0/1e6);   
-        } 
-        
+      auto &block = S_comp[brojac];
+      if(ii == jj) {
+        block.S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
+        block.dim = 2 * n;
+      } else
+        ACA_coupling_block(block, TSH, geometry.objects[ii], geometry.objects[jj], 2.0 * incWave->waveK, nMaxS, geometry);
+      sizeMAT = sizeMAT + (block.S_sub.size() + block.U.size() + block.V.size())*(16.0/1e6);
+      brojac++;
+    }
 
-   }
-  brojac++;
   }
-  
- }
-
+// sum all the partial sizes of matrices
 MPI_Gather(&sizeMAT, 1, MPI_DOUBLE, &sizeMAT_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
 if(rank==0)
-std::cout<<"The size of the SH scattering matrix in MB is"<<sizeMAT_vec.sum()<<std::endl;
-  
+std::cout<<"The size of the SH scattering matrix in MB is"<< sizeMAT_vec.sum()<<std::endl;
+
 }
 #endif
 
@@ -700,357 +565,477 @@ void Scattering_matrix_ACA_SH(Geometry const &geometry, std::shared_ptr<Excitati
 
   auto const nMaxS = geometry.objects[0].nMaxS;
   auto const n = nMaxS * (nMaxS + 2);
-  Matrix<t_complex> TmatrixSH (2*n , 2*n), U, V;
-  Matrix<t_complex> CoupSubmSH (2*n, 2*n);
-  double distance, sizeMAT(0.0);
+  double sizeMAT(0.0);
   int nobj = geometry.objects.size();
   S_comp.resize(nobj*nobj);
-  
- 
-  for(int ii = 0; ii != nobj; ++ii) {
-      
-     geometry.objects[ii].getTLocalSH(TmatrixSH, incWave->omega(), geometry.bground);
-     
-    
-    for(int jj = 0; jj != nobj; ++jj) {
 
-    
-      if(ii == jj) {
-        S_comp[nobj*ii + jj].S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
-        S_comp[nobj*ii + jj].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[ii*nobj + jj].S_sub.size())*(16.0/1e6);
-        
-      } else {
-      
-        distance = Tools::findDistance(geometry.objects[ii].vR, geometry.objects[jj].vR);
-      
-        Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 2.0 * incWave->waveK, nMaxS);
-        
-        CoupSubmSH.block(0, 0, n, n) = AB.diagonal.transpose();
-        CoupSubmSH.block(n, n, n, n) = AB.diagonal.transpose();
-        CoupSubmSH.block(0, n, n, n) = AB.offdiagonal.transpose();
-        CoupSubmSH.block(n, 0, n, n) = AB.offdiagonal.transpose();
-        CoupSubmSH = - (TmatrixSH) * CoupSubmSH;
-        
+  for(int ii = 0; ii != nobj; ++ii) {
 
-        if (distance >= 2.0*(geometry.objects[ii].radius + geometry.objects[jj].radius)){ //admissibility criterion for ACA
+     auto const &TSH = geometry.sphere(ii).TSH;
 
-        ACA_compression(U , V, CoupSubmSH);
-        
-        S_comp[nobj*ii + jj].U = U;
-        S_comp[nobj*ii + jj].V = V;
-        S_comp[nobj*ii + jj].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[ii*nobj + jj].U.size())*(16.0/1e6) + (S_comp[ii*nobj + jj].V.size())*(16.0/1e6);
-        }
-        
-        else{
-        S_comp[nobj*ii + jj].S_sub =  CoupSubmSH; 
-        S_comp[nobj*ii + jj].dim = 2 * n;
-        sizeMAT = sizeMAT + (S_comp[ii*nobj + jj].S_sub.size())*(16.0/1e6);
-        }
+    for(int jj = 0; jj != nobj; ++jj) {
 
+      auto &block = S_comp[nobj*ii + jj];
+      if(ii == jj) {
+        block.S_sub= Matrix<t_complex>::Identity(2 * n, 2 * n);
+        block.dim = 2 * n;
+      } else
+        ACA_coupling_block(block, TSH, geometry.objects[ii], geometry.objects[jj], 2.0 * incWave->waveK, nMaxS, geometry);
+      sizeMAT = sizeMAT + (block.S_sub.size() + block.U.size() + block.V.size())*(16.0/1e6);
     }
-  
-      }
-  
-        }
-        
- std::cout<<"The size of the SH matrix in MB is"  << sizeMAT<< std::endl;         
-}
 
+  }
 
+  std::cout<<"The size of the SH matrix in MB is"  <<sizeMAT<< std::endl;
+}
 
-void ACA_compression(Matrix<t_complex> &U, Matrix<t_complex> &V, Matrix<t_complex> &CoupMat){
 
- int kmax = CoupMat.cols(); // square coupling matrices
 
- U.resize(kmax , 1);
- V.resize(1 , kmax);
- Matrix<t_complex>  sum11(1 , kmax);
- Vector<int> I(1), J(1);
- Vector<t_complex> RowCol, Row, Col, Row1, Col1, Row2, Col2, sum22;
- Vector<double> NORMA(1);
- Matrix<t_complex> R = Matrix<t_complex>::Zero(kmax, kmax);
- double eps_ACA = 1e-3; // compression tolerance
- 
- for (int k = 0; k != kmax; ++k) {
- 
- if(k == 0){
- I(k) = 0;
- R.row(I(k)) = CoupMat.row(I(k));
- RowCol = R.row(I(k));
- J(k) = getMaxInd(RowCol, J, kmax);
- 
- V.row(k) = R.row(I(k)) / R(I(k) , J(k));
- Row = V.row(k);
- 
- R.col(J(k)) = CoupMat.col(J(k));
- U.col(k) = R.col(J(k));
- Col = U.col(k);
- 
- NORMA(k) = std::pow(Col.norm(), 2) * std::pow(Row.norm(), 2);
- 
- RowCol = R.col(J(0));
- I.conservativeResize(2);
- I(1) = getMaxInd(RowCol, I, kmax);
- 
- }
- else
- {
- 
- Matrix<t_complex> sum1 = Matrix<t_complex>::Zero(1, kmax);
- 
- for (int p = 0; p <= (k-1); ++p) {
- sum11 = U(I(k) , p) * V.row(p);
- 
- sum1 = sum1 + sum11;
+bool ACA_compression(Matrix<t_complex> &U, Matrix<t_complex> &V, int kmax,
+                     std::function<Vector<t_complex>(int)> const &row,
+                     std::function<Vector<t_complex>(int)> const &col, double eps_ACA){
+
+ // a compressed block should hold fewer entries than the dense one, which bounds its rank
+ int const maxRank = kmax / 2;
+ U.resize(kmax, maxRank);
+ V.resize(maxRank, kmax);
+ std::vector<bool> usedRows(kmax, false), usedCols(kmax, false);
+ int rank = 0;
+ double norm2 = 0.0;
+ int i = 0;
+
+ while (i >= 0) {
+ if (rank == maxRank)
+ return false;
+
+ usedRows[i] = true;
+ Vector<t_complex> Row = row(i);
+ Row -= V.topRows(rank).transpose() * U.row(i).head(rank).transpose();
+ int const j = getMaxInd(Row, usedCols);
+ if (j < 0) {
+ // this row is already approximated, try the next one
+ i = std::find(usedRows.begin(), usedRows.end(), false) - usedRows.begin();
+ if (i == kmax)
+ break;
+ continue;
  }
- 
- R.row(I(k)) = CoupMat.row(I(k)) - sum1;
- RowCol = R.row(I(k));
- J.conservativeResize(k+1);
- J(k) = getMaxInd(RowCol, J, kmax);
+ usedCols[j] = true;
+ Row /= Row(j);
+ Vector<t_complex> Col = col(j);
+ Col -= U.leftCols(rank) * V.col(j).head(rank);
+
+ // squared Frobenius norm of the approximation
+ double const uv = Col.squaredNorm() * Row.squaredNorm();
+ norm2 += 2.0 * std::real((U.leftCols(rank).adjoint() * Col)
+                          .cwiseProduct(V.topRows(rank).conjugate() * Row)
+                          .sum());
+ norm2 += uv;
+ U.col(rank) = Col;
+ V.row(rank) = Row.transpose();
+ ++rank;
+ if (std::sqrt(uv) <= eps_ACA * std::sqrt(norm2))
+ break;
 
- V.conservativeResize(k+1 , kmax);
- V.row(k) = R.row(I(k)) / R(I(k) , J(k));
- 
- Vector<t_complex> sum2 = Vector<t_complex>::Zero(kmax);
- for (int p = 0; p <= (k-1); ++p) {
- sum22 = V(p , J(k)) * U.col(p);
- sum2 = sum2 + sum22;
+ i = getMaxInd(Col, usedRows);
  }
- 
- R.col(J(k)) = CoupMat.col(J(k)) - sum2;
- 
- U.conservativeResize(kmax , k+1);
- U.col(k) = R.col(J(k));
- 
- double sum = 0.0;
- Col2 = U.col(k);
- Row2= V.row(k);
- for (int p = 0; p != (k-1); ++p) {
- Col1 = U.col(p);
- Row1= V.row(p);
-
- t_complex pom1(0.0, 0.0), pom2(0.0, 0.0);
- 
-  for (int tt = 0; tt != k; ++tt){
-  pom1 = pom1 + Col1(tt)*Col2(tt);
-  pom2 = pom2 + Row1(tt)*Row2(tt);
-  }
 
- sum = sum + abs(pom1) * abs(pom2);
- }
- 
- Row = V.row(k);
- Col = U.col(k);
- 
- NORMA.conservativeResize(k+1);
- NORMA(k) = NORMA(k-1) + std::pow(Col.norm(), 2) * std::pow(Row.norm(), 2) + 2.0 * sum;
- 
- if (eps_ACA * sqrt(NORMA(k)) >= Col.norm() * Row.norm())
- break;
- 
- RowCol = R.col(J(k));
- I.conservativeResize(k+2);
- I(k+1) = getMaxInd(RowCol, I, kmax);
- 
-  }
- 
+ U = Matrix<t_complex>(U.leftCols(rank));
+ V = Matrix<t_complex>(V.topRows(rank));
+ return true;
+}
+
+void ACA_recompress(Matrix<t_complex> &U, Matrix<t_complex> &V, double eps_ACA){
+
+ int const rank = U.cols();
+ if (rank <= 1)
+ return;
+ // U V = Qu Ru Rv^T Qv^T, with the SVD of the small Ru Rv^T
+ Eigen::HouseholderQR<Matrix<t_complex>> const qrU(U);
+ Eigen::HouseholderQR<Matrix<t_complex>> const qrV(V.transpose());
+ Matrix<t_complex> const Ru = qrU.matrixQR().topRows(rank).triangularView<Eigen::Upper>();
+ Matrix<t_complex> const Rv = qrV.matrixQR().topRows(rank).triangularView<Eigen::Upper>();
+ Eigen::JacobiSVD<Matrix<t_complex>> const svd(Ru * Rv.transpose(), Eigen::ComputeFullU | Eigen::ComputeFullV);
+ auto const &sigma = svd.singularValues();
+
+ // the smallest rank leaving out at most eps_ACA of the Frobenius norm
+ double const threshold = eps_ACA * eps_ACA * sigma.squaredNorm();
+ int cut = rank;
+ double tail = 0.0;
+ while (cut > 1 and tail + sigma(cut - 1) * sigma(cut - 1) <= threshold) {
+ --cut;
+ tail += sigma(cut) * sigma(cut);
  }
- 
+ if (cut == rank)
+ return;
+
+ Matrix<t_complex> const Qu = qrU.householderQ() * Matrix<t_complex>::Identity(U.rows(), rank);
+ Matrix<t_complex> const Qv = qrV.householderQ() * Matrix<t_complex>::Identity(V.cols(), rank);
+ U = Qu * (svd.matrixU().leftCols(cut) * sigma.head(cut).asDiagonal());
+ V = svd.matrixV().leftCols(cut).adjoint() * Qv.transpose();
 }
 
-int getMaxInd(Vector<t_complex> &RowCol, Vector<int> &K, int kmax){
+int getMaxInd(Vector<t_complex> const &RowCol, std::vector<bool> const &used){
 
 double max = 0.0;
-int imax, flag_same = 0;
+int imax = -1;
 
-for (int i = 0; i != kmax; ++i) {
+for (int i = 0; i != RowCol.size(); ++i) {
 
-for (int j = 0; j < (K.size()-1); ++j) {
-
- if(i==K(j))
- flag_same = 1;
- 
- }
- 
- if (flag_same==0){
- 
- if (abs (RowCol(i)) > max){
+ if (not used[i] and abs (RowCol(i)) > max){
    max = abs (RowCol(i));
    imax = i;
    }
- 
- } 
- flag_same = 0;
 }
 return imax;
 }
 
+namespace {
+//! \brief Orthogonalizes w against the first n columns of v, adding its components to h
+//! \details Classical Gram-Schmidt run twice, each pass being two matrix-vector products over
+//! the basis and a single reduction over the processes.
+void orthogonalize(Matrix<t_complex> const &v, int n, Vector<t_complex> &w,
+                   Eigen::Ref<Vector<t_complex>> h) {
+  for(int pass = 0; pass < 2; ++pass) {
+    Vector<t_complex> c = v.leftCols(n).adjoint() * w;
+#ifdef OPTIMET_MPI
+    MPI_Allreduce(MPI_IN_PLACE, c.data(), c.size(), MPI_DOUBLE_COMPLEX, MPI_SUM, MPI_COMM_WORLD);
+#endif
+    w -= v.leftCols(n) * c;
+    h += c;
+  }
+}
+
+//! Givens rotations of the previous columns, then a new one zeroing h(n + 1, n)
+void givens(Matrix<t_complex> &h, Vector<t_complex> &cs, Vector<t_complex> &sn,
+            Vector<t_complex> &g, int n) {
+  for(int t = 0; t < n; ++t) {
+    auto const temp = std::conj(cs(t)) * h(t, n) + std::conj(sn(t)) * h(t + 1, n);
+    h(t + 1, n) = -sn(t) * h(t, n) + cs(t) * h(t + 1, n);
+    h(t, n) = temp;
+  }
+  double const r = std::sqrt(std::norm(h(n, n)) + std::norm(h(n + 1, n)));
+  cs(n) = h(n, n) / r;
+  sn(n) = h(n + 1, n) / r;
+  h(n, n) = r;
+  h(n + 1, n) = 0;
+  g(n + 1) = -sn(n) * g(n);
+  g(n) = std::conj(cs(n)) * g(n);
+}
+}
+
 // gmres solver for ACA compressed matrices, compressed blocks are always square
-Vector<t_complex> Gmres_Zcomp(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex>const &Y, double tol, int maxit, int no_rest, Geometry const &geometry){
+Vector<t_complex> Gmres_Zcomp(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex>const &Y, double tol, int maxit, int no_rest, Geometry const &geometry,
+                              Vector<t_complex> const &x0){
 
-int N = Y.size(); // right hand side
-int n(0), brojac(0);
+int brojac(0);
 mpi::Communicator communicator;
 int rank = communicator.rank();
 
-Vector<t_complex> vn(N) , w(N) , vt(N), res(N), gipom, ym, x, gi;
-x = Vector<t_complex>::Zero(N);
-Vector<double> err(1);
-err(0) = 1;
-
-Eigen::SparseMatrix<t_complex, Eigen::ColMajor> v(N , maxit+1);
-Eigen::SparseVector<t_complex>  w_sps(N), res_sps(N);
-Matrix<t_complex> H = Matrix<t_complex>::Zero(maxit + 1 , maxit);
-Matrix<t_complex> Rigi, Ri, Ripom;
-
-double beta;
-double abs_y = Y.norm();
-
-for (int rest = 1;  rest <= no_rest; ++rest) {
-
-if(err(n)<=tol)
-break;
-
 #ifdef OPTIMET_MPI
-w = matvec_parallel(S_comp , x, geometry);
+// each process only holds the coefficients of its own scatterers
+auto const exchange = ACA_neighbourhood(S_comp, geometry);
+int const first = exchange.gran1 * exchange.dim;
+int const N = (exchange.gran2 - exchange.gran1) * exchange.dim;
+// the right hand side is either whole or already only the rows of this process
+Vector<t_complex> const b = Y.size() == N ? Y : Vector<t_complex>(Y.segment(first, N));
+bool const guess = x0.size() == static_cast<int>(geometry.objects.size()) * exchange.dim;
 #else
-w = matvec(S_comp , x, geometry);
+Vector<t_complex> const &b = Y;
+int const first = 0;
+int const N = b.size();
+bool const guess = x0.size() == Y.size();
 #endif
 
-res = Y - w;
-beta = res.norm();
-res_sps = res.sparseView();
-v.col(0) = res_sps / beta;
-
-n = 0; 
-while ((n < maxit) && (err(n) > tol)){
-
-vn= v.col(n);
+// norms over all the processes
+auto const norm = [](Vector<t_complex> const &a) {
+double result = a.squaredNorm();
+#ifdef OPTIMET_MPI
+MPI_Allreduce(MPI_IN_PLACE, &result, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+return std::sqrt(result);
+};
+auto const product = [&](Vector<t_complex> const &J) {
+#ifdef OPTIMET_MPI
+return matvec_parallel(S_comp , J, geometry, exchange); // matrix-vector product for compressed matrices
+#else
+Vector<t_complex> input = J;
+return matvec(S_comp , input, geometry);
+#endif
+};
 
+Vector<t_complex> x = guess ? Vector<t_complex>(x0.segment(first, N)) : Vector<t_complex>::Zero(N);
+double const abs_y = norm(b);
+if(abs_y == 0)
 #ifdef OPTIMET_MPI
-w = matvec_parallel(S_comp , vn, geometry);// matrix-vector product for compressed matrices
+return Vector<t_complex>::Zero(geometry.objects.size() * exchange.dim);
 #else
-w = matvec(S_comp , vn, geometry);
+return Vector<t_complex>::Zero(N);
 #endif
+double err = 1;
 
-for (int t = 0; t <= n; ++t) {
-vt = v.col(t);
-H(t , n) = vt.adjoint() * w;
-w = w - H(t , n) * vt;
-}
+// the basis of a cycle, allocated once for all of them
+Matrix<t_complex> v(N , maxit+1);
+Matrix<t_complex> H(maxit + 1 , maxit);
+Vector<t_complex> cs(maxit), sn(maxit), g(maxit + 1);
 
-H(n+1 , n) = w.norm();
-w_sps = w.sparseView();
-v.col(n+1) = w_sps / H(n+1,n);
- 
-Rigi.conservativeResize(n+2 , n+2);
+for (int rest = 1;  rest <= no_rest && err > tol; ++rest) {
 
-Rigi = det_approx (beta , n , H);
+Vector<t_complex> res = b - product(x);
+double beta = norm(res);
+// a guess further from the solution than zero is dropped
+if(rest == 1 and guess and beta > abs_y) {
+x = Vector<t_complex>::Zero(N);
+res = b;
+beta = abs_y;
+}
+err = beta / abs_y;
+if(err <= tol)
+break;
 
-Ri.conservativeResize(n+2 , n+1);
+H.setZero();
+g.setZero();
+v.col(0) = res / beta;
+g(0) = beta;
 
-Ri = Rigi.block(0 , 0 , n+2 , n+1);
+int n = 0;
+while ((n < maxit) && (err > tol)){
 
-gi.conservativeResize(n+2);
+Vector<t_complex> w = product(v.col(n));
+orthogonalize(v, n + 1, w, H.col(n).head(n + 1));
+H(n+1 , n) = norm(w);
+if(std::abs(H(n+1 , n)) > 0)
+v.col(n+1) = w / H(n+1,n);
 
-gi = Rigi.col(n+1);
+// Givens rotations bring the Hessenberg matrix to triangular form
+givens(H, cs, sn, g, n);
 
-err.conservativeResize(n+2);
-err(n+1) = abs(gi(n+1))/abs_y;
+err = std::abs(g(n+1)) / abs_y;
 n = n + 1;
 brojac++;
 }
 
-Ripom = Ri.block(0,0,n,n);
-gipom = gi.segment(0 , n);
-ym = Ripom.colPivHouseholderQr().solve(gipom);
-
-for (int j = 0; j != ym.size(); ++j) {
-vn =v.col(j);
-x = x + ym(j) * vn;
-}
+Vector<t_complex> const ym = H.topLeftCorner(n, n).triangularView<Eigen::Upper>().solve(g.head(n));
+x += v.leftCols(n) * ym;
 
 }// for restart
 
 if(rank==0){
 std::cout<<"GMRES converged at iteration"<<'\t'<<brojac<<std::endl;
-std::cout<<"The relative residual is"<<'\t'<<err(n)<<std::endl;
+std::cout<<"The relative residual is"<<'\t'<<err<<std::endl;
 }
 
-
+#ifdef OPTIMET_MPI
+// the solution is gathered only once, after convergence
+return communicator.all_gather(x);
+#else
 return x;
+#endif
 }
 
 #ifdef OPTIMET_MPI
-// matrix - vector product in parallel
-Vector<t_complex> matvec_parallel(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex> &J, Geometry const &geometry){
-// here we go through the matrix blocks and check if it is compressed or not
-auto const nobj = geometry.objects.size();
-int gran1, gran2, Ncp_proc, N;
-mpi::Communicator communicator;
-  int rank = communicator.rank();
-  int size = communicator.size();
- 
-   if(rank==0)
-   N = S_comp[0].dim;
-   
-  MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD); 
- 
-    if (rank < (nobj % size)) {
-    gran1 = rank * (nobj/size + 1);
-    gran2 = gran1 + nobj/size + 1;
-    } else {
-    gran1 = rank * (nobj/size) + (nobj % size);
-    gran2 = gran1 + (nobj/size);
-    }
-
-Ncp_proc = N*(gran2 - gran1);
-
-
-Vector<t_complex> Y_proc = Vector<t_complex>::Zero(Ncp_proc);; // process solution
-Vector<t_complex> Y_fin = Vector<t_complex>::Zero(nobj*N);; // final solution
-double distance;
-Matrix<t_complex> U , V;
-int brojac1(0), brojac2(0);
-
-for(int ii = gran1; ii < gran2; ii++)  {
+ACA_exchange ACA_neighbourhood(std::vector<Matrix_ACA>const &S_comp, Geometry const &geometry){
 
-  for(int jj = 0; jj != nobj; jj++)  {
-
-  distance = Tools::findDistance(geometry.objects[ii].vR, geometry.objects[jj].vR);
-
-   if (distance >= 2.0*(geometry.objects[ii].radius + geometry.objects[jj].radius)){ //admissibility criterion for ACA
-      
-        Y_proc.segment(brojac1*N , N) = Y_proc.segment(brojac1*N , N) + (S_comp[brojac2].U)*(S_comp[brojac2].V * J.segment(jj*N , N));
-        
-        }
-        
-    else{
-    Y_proc.segment(brojac1*N , N) = Y_proc.segment(brojac1*N , N) + S_comp[brojac2].S_sub * J.segment(jj*N , N);    
-     
-    }
-    brojac2++;
-    }
-    brojac1++;
-  } 
-
-// now gather all the partial solutions
+double eps_ACA = geometry.get_ACAtolerance(); // compression tolerance of the channels, as for the blocks
+int nobj = geometry.objects.size();
+mpi::Communicator communicator;
+int rank = communicator.rank();
+int size = communicator.size();
+
+// scatterers owned by a process, as in the assembly of the compressed matrices
+auto const range = [nobj, size](int proc, int &gran1, int &gran2) {
+  ACA_scatterers(nobj, proc, size, gran1, gran2);
+};
+
+ACA_exchange result;
+range(rank, result.gran1, result.gran2);
+result.dim = S_comp.size() > 0 ? S_comp[0].dim : 0;
+MPI_Allreduce(MPI_IN_PLACE, &result.dim, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+int const N = result.dim;
+int const nloc = result.gran2 - result.gran1;
+
+// every block couples two scatterers, so all the processes with scatterers are neighbours
+std::vector<std::set<t_uint>> graph(size);
+for (int p = 0; p < size; ++p)
+  for (int q = 0; q < size; ++q) {
+  int ip1, ip2, iq1, iq2;
+  range(p, ip1, ip2);
+  range(q, iq1, iq2);
+  if (p != q && ip2 > ip1 && iq2 > iq1)
+  graph[p].insert(q);
+  }
+result.graph = std::make_shared<mpi::GraphCommunicator>(communicator, graph);
+auto const neighbours = result.graph->neighborhood();
+
+// compresses the rows of the blocks of each column owned by a neighbour, weighted by the size of the block
+std::vector<int> ranks;
+std::vector<Matrix<t_complex>> bases;
+std::vector<int> rank_counts, basis_counts;
+for (auto const q : neighbours) {
+  int jj1, jj2;
+  range(q, jj1, jj2);
+  rank_counts.push_back(jj2 - jj1);
+  basis_counts.push_back(0);
+
+  for (int jj = jj1; jj < jj2; ++jj) {
+  bool raw = false;
+  int rows = 0;
+  for (int ii = result.gran1; ii < result.gran2; ++ii) {
+  auto const &block = S_comp[(ii - result.gran1) * nobj + jj];
+  raw = raw || block.S_sub.size() > 0;
+  rows += block.V.rows();
+  }
 
-   Vector<int> sizesProc(size), disps(size);
+  Matrix<t_complex> W(rows, N), expansion;
+  std::vector<Matrix<t_complex>> expansions;
+  if (!raw) {
+  rows = 0;
+  for (int ii = result.gran1; ii < result.gran2; ++ii) {
+  auto const &block = S_comp[(ii - result.gran1) * nobj + jj];
+  for (int t = 0; t < block.V.rows(); ++t)
+  W.row(rows + t) = block.U.col(t).norm() * block.V.row(t);
+  rows += block.V.rows();
+  }
+  Eigen::JacobiSVD<Matrix<t_complex>> svd(W, Eigen::ComputeThinU | Eigen::ComputeThinV);
+  auto const &sigma = svd.singularValues();
+  int k = 0;
+  while (k < sigma.size() && sigma(k) > eps_ACA * sigma(0))
+  ++k;
+  // the channel is only worth it with fewer entries than the coefficients themselves
+  raw = k >= N;
+  if (!raw) {
+  expansion = svd.matrixU().leftCols(k) * sigma.head(k).asDiagonal();
+  bases.push_back(svd.matrixV().leftCols(k).adjoint());
+  rows = 0;
+  for (int ii = result.gran1; ii < result.gran2; ++ii) {
+  auto const &block = S_comp[(ii - result.gran1) * nobj + jj];
+  Vector<t_complex> scale(block.U.cols());
+  for (int t = 0; t < block.U.cols(); ++t)
+  scale(t) = block.U.col(t).norm() > 0 ? 1e0 / block.U.col(t).norm() : 0e0;
+  expansions.push_back(block.U * scale.asDiagonal() * expansion.middleRows(rows, block.V.rows()));
+  rows += block.V.rows();
+  }
+  basis_counts.back() += k * N;
+  }
+  }
 
-    MPI_Allgather (&Ncp_proc, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
+  ranks.push_back(raw ? -1 : bases.back().rows());
+  result.receive_object.push_back(jj);
+  result.receive_expansion.push_back(expansions);
+  result.receive_counts.push_back(raw ? N : ranks.back());
+  }
+}
 
-   for (int kk = 0; kk < size; kk++)
-   disps(kk) = (kk > 0) ? (disps(kk-1) + sizesProc(kk-1)) : 0;
+// one group of receive counts per neighbour
+std::vector<int> receive_counts;
+{
+int c = 0;
+for (auto const q : neighbours) {
+  int jj1, jj2;
+  range(q, jj1, jj2);
+  receive_counts.push_back(0);
+  for (int jj = jj1; jj < jj2; ++jj)
+  receive_counts.back() += result.receive_counts[c++];
+}
+}
+result.receive_counts = receive_counts;
+
+// the owner of each column learns the rank of its channels, then their bases
+std::vector<int> own_counts(neighbours.size(), nloc);
+Vector<int> const ranks_out = Eigen::Map<Vector<int> const>(ranks.data(), ranks.size());
+Vector<int> ranks_in;
+mpi::wait(result.graph->ialltoall(ranks_out, ranks_in, rank_counts, own_counts));
+
+int total = 0;
+for (auto const &basis : bases)
+  total += basis.size();
+Vector<t_complex> bases_out(total);
+total = 0;
+for (auto const &basis : bases) {
+  Eigen::Map<Matrix<t_complex>>(bases_out.data() + total, basis.rows(), basis.cols()) = basis;
+  total += basis.size();
+}
+std::vector<int> own_basis_counts(neighbours.size(), 0);
+for (t_uint p = 0; p < neighbours.size(); ++p)
+  for (int jj = 0; jj < nloc; ++jj)
+  own_basis_counts[p] += std::max(ranks_in(p * nloc + jj), 0) * N;
+Vector<t_complex> bases_in;
+mpi::wait(result.graph->ialltoall(bases_out, bases_in, basis_counts, own_basis_counts));
+
+total = 0;
+for (t_uint p = 0; p < neighbours.size(); ++p) {
+  result.send_counts.push_back(0);
+  for (int jj = 0; jj < nloc; ++jj) {
+  int const k = ranks_in(p * nloc + jj);
+  result.send_raw.push_back(k < 0);
+  result.send_basis.push_back(k < 0 ? Matrix<t_complex>()
+                              : Matrix<t_complex>(Eigen::Map<Matrix<t_complex>>(bases_in.data() + total, k, N)));
+  result.send_counts.back() += k < 0 ? N : k;
+  total += std::max(k, 0) * N;
+  }
+}
 
-    MPI_Gatherv (&Y_proc(0), Ncp_proc, MPI_DOUBLE_COMPLEX, &Y_fin(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+return result;
+}
 
-    MPI_Bcast(&Y_fin(0), nobj*N, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+// matrix - vector product in parallel
+Vector<t_complex> matvec_parallel(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex> const &J, Geometry const &geometry, ACA_exchange const &exchange){
+auto const nobj = geometry.objects.size();
+int const N = exchange.dim;
+int const gran1 = exchange.gran1, gran2 = exchange.gran2;
+
+// coefficients of this process for each neighbour, projected on the channels when compressed
+int total = std::accumulate(exchange.send_counts.begin(), exchange.send_counts.end(), 0);
+Vector<t_complex> send(total), receive;
+total = 0;
+for (t_uint c = 0; c < exchange.send_raw.size(); ++c) {
+  auto const J_jj = J.segment((c % (gran2 - gran1)) * N, N);
+  if (exchange.send_raw[c]) {
+  send.segment(total, N) = J_jj;
+  total += N;
+  } else {
+  send.segment(total, exchange.send_basis[c].rows()) = exchange.send_basis[c] * J_jj;
+  total += exchange.send_basis[c].rows();
+  }
+}
+auto request = exchange.graph->ialltoall(send, receive, exchange.send_counts, exchange.receive_counts);
+
+// couplings between the scatterers of this process, while the channels are in flight
+Vector<t_complex> Y_proc = Vector<t_complex>::Zero(N*(gran2 - gran1)); // process solution
+for(int ii = gran1; ii < gran2; ii++)
+  for(int jj = gran1; jj < gran2; jj++){
+  auto const &block = S_comp[(ii - gran1)*nobj + jj];
+  if (block.S_sub.size() > 0)
+  Y_proc.segment((ii - gran1)*N , N) += block.S_sub * J.segment((jj - gran1)*N , N);
+  else
+  Y_proc.segment((ii - gran1)*N , N) += block.U * (block.V * J.segment((jj - gran1)*N , N));
+  }
+mpi::wait(std::move(request));
+
+// couplings with the scatterers of the other processes
+total = 0;
+for (t_uint c = 0; c < exchange.receive_object.size(); ++c) {
+  int const jj = exchange.receive_object[c];
+  auto const &expansions = exchange.receive_expansion[c];
+  if (expansions.size() == 0) {
+  auto const J_jj = receive.segment(total, N);
+  for(int ii = gran1; ii < gran2; ii++){
+  auto const &block = S_comp[(ii - gran1)*nobj + jj];
+  if (block.S_sub.size() > 0)
+  Y_proc.segment((ii - gran1)*N , N) += block.S_sub * J_jj;
+  else
+  Y_proc.segment((ii - gran1)*N , N) += block.U * (block.V * J_jj);
+  }
+  total += N;
+  }
+  else {
+  auto const k = expansions[0].cols();
+  for(int ii = gran1; ii < gran2; ii++)
+  Y_proc.segment((ii - gran1)*N , N) += expansions[ii - gran1] * receive.segment(total, k);
+  total += k;
+  }
+}
 
-return Y_fin;
+return Y_proc;
 }
 #endif
 
@@ -1059,24 +1044,16 @@ Vector<t_complex> matvec (std::vector<Matrix_ACA>const &S_comp, Vector<t_complex
 auto const nobj = geometry.objects.size();
 int N = S_comp[0].dim;
 Vector<t_complex> Y = Vector<t_complex>::Zero(nobj*N); // solution vector 
-double distance;
-Matrix<t_complex> U , V;
 
 for(int ii = 0; ii != nobj; ii++)  {
 
   for(int jj = 0; jj != nobj; jj++)  {
 
-  distance = Tools::findDistance(geometry.objects[ii].vR, geometry.objects[jj].vR);
-
-   if (distance >= 2.0*(geometry.objects[ii].radius + geometry.objects[jj].radius)){ //ACA admissibility
-      
-        Y.segment(ii*N , N) = Y.segment(ii*N , N) + (S_comp[ii*nobj + jj].U)*(S_comp[ii*nobj + jj].V * J.segment(jj*N , N));
-
-        }
-        
-    else{
-    Y.segment(ii*N , N) = Y.segment(ii*N , N) + S_comp[ii*nobj + jj].S_sub * J.segment(jj*N , N);           
-    }
+   auto const &block = S_comp[ii*nobj + jj];
+   if (block.S_sub.size() > 0)
+    Y.segment(ii*N , N) += block.S_sub * J.segment(jj*N , N);
+   else // compressed by ACA
+    Y.segment(ii*N , N) += block.U * (block.V * J.segment(jj*N , N));
     }
    
 }
@@ -1084,72 +1061,6 @@ for(int ii = 0; ii != nobj; ii++)  {
 return Y;
 }
 
-Matrix<t_complex> det_approx (double beta, int n, Matrix<t_complex> &H){
-
-Matrix<t_complex> Rigi, Ri, W, POM(2,2);
-
-Rigi.conservativeResize(n+2 , n+2);
-Ri.conservativeResize(n+2 , n+1);
-
-
-Vector<t_complex> gi = Vector<t_complex>::Zero(n+2);
-t_complex hi1, hi2, temp, c, s;
-
-Ri = H.block(0,0, n+2,n+1);
-gi(0) = beta;
-
-for (int i = 0; i <= n; ++i) {
-
-hi1 = Ri(i,i);
-hi2 = Ri(i+1,i);
-
-if (abs(hi2)>abs(hi1)){
-      temp = hi1/hi2; 
-      s = 1.0 / sqrt(1.0 + std::pow(abs(temp),2)); 
-      c = -temp*s;
-      }
-      
- else{
-     temp = hi2/hi1; 
-      c = 1.0 / sqrt(1.0 + std::pow(abs(temp),2)); 
-      s = -temp*c;
- } 
-
- POM(0,0) = std::conj(c);
- POM(0,1) = std::conj(-s);
- POM(1,0) = s;
- POM(1,1) = c;
- W = Matrix<t_complex>::Identity(n+2 , n+2);
- W.block(i,i, 2, 2)  = POM;
- 
- Ri = W*Ri;
- gi = W*gi; 
-}
-
-Rigi.block(0,0, n+2,n+1) = Ri;
-Rigi.col(n+1) = gi; 
- 
-return Rigi;
-}
-
-
-
-Matrix<t_complex> preconditioned_scattering_matrix(std::vector<Scatterer> const &objects,
-                                                   ElectroMagnetic const &bground,
-                                                   std::shared_ptr<Excitation const> incWave) {
-                                                                                                  
-  return preconditioned_scattering_matrix(objects.begin(), objects.end(), objects.begin(),
-                                          objects.end(), bground, incWave);
-}
-
- Matrix<t_complex> preconditioned_scattering_matrixSH(std::vector<Scatterer> const &objects,
-                                                   ElectroMagnetic const &bground,
-                                                   std::shared_ptr<Excitation const> incWave) {
-                                                                                                    
-  return preconditioned_scattering_matrixSH(objects.begin(), objects.end(), objects.begin(),
-                                          objects.end(), bground, incWave);
-}
-
 
 
 Matrix<t_complex> preconditioned_scattering_matrix(Geometry const &geometry,
@@ -1163,7 +1074,9 @@ Matrix<t_complex> preconditioned_scattering_matrix(Geometry const &geometry,
   for(auto const &scatterer : geometry.objects)
     if(scatterer.nMax != nMax)
       throw std::runtime_error("All objects must have same number of harmonics");
-  return preconditioned_scattering_matrix(geometry.objects, geometry.bground, incWave);
+  return preconditioned_scattering_matrix(geometry.objects.begin(), geometry.objects.end(),
+                                          geometry.objects.begin(), geometry.objects.end(), geometry,
+                                          incWave);
   
 }
 
@@ -1179,7 +1092,9 @@ Matrix<t_complex> preconditioned_scattering_matrixSH(Geometry const &geometry,
     for(auto const &scatterer : geometry.objects)
      if(scatterer.nMaxS != nMaxS)
      throw std::runtime_error("All objects must have same number of SH harmonics"); 
-     return preconditioned_scattering_matrixSH(geometry.objects, geometry.bground, incWave);
+     return preconditioned_scattering_matrixSH(geometry.objects.begin(), geometry.objects.end(),
+                                               geometry.objects.begin(), geometry.objects.end(),
+                                               geometry, incWave);
                       
                       }
 
@@ -1216,7 +1131,7 @@ Matrix<t_complex> preconditioned_scattering_matrix(Geometry const &geometry,
     linear_matrix.local().leftCols(nloc * 2 * n) = preconditioned_scattering_matrix(
         geometry.objects.begin(), geometry.objects.end(),
         geometry.objects.begin() + nloc * linear_context.col(),
-        geometry.objects.begin() + nloc * (1 + linear_context.col()), geometry.bground, incWave);
+        geometry.objects.begin() + nloc * (1 + linear_context.col()), geometry, incWave);
 
   }
 
@@ -1229,7 +1144,7 @@ Matrix<t_complex> preconditioned_scattering_matrix(Geometry const &geometry,
           geometry.objects.begin(), geometry.objects.end(),
           geometry.objects.begin() + nloc * linear_context.cols() + remainder_context.col(),
           geometry.objects.begin() + nloc * linear_context.cols() + remainder_context.col() + 1,
-          geometry.bground, incWave);
+          geometry, incWave);
     
     scalapack::Matrix<t_complex> transfered(linear_context, {nobj * n * 2, remainder * n * 2},
                                             {nobj * n * 2, nloc * n * 2});
@@ -1277,7 +1192,7 @@ Matrix<t_complex> preconditioned_scattering_matrix_SH(Geometry const &geometry,
     linear_matrix.local().leftCols(nloc * 2 * n) = preconditioned_scattering_matrixSH(
         geometry.objects.begin(), geometry.objects.end(),
         geometry.objects.begin() + nloc * linear_context.col(),
-        geometry.objects.begin() + nloc * (1 + linear_context.col()), geometry.bground, incWave);
+        geometry.objects.begin() + nloc * (1 + linear_context.col()), geometry, incWave);
   }
 
   if(remainder > 0 and linear_context.is_valid()) {
@@ -1289,7 +1204,7 @@ Matrix<t_complex> preconditioned_scattering_matrix_SH(Geometry const &geometry,
           geometry.objects.begin(), geometry.objects.end(),
           geometry.objects.begin() + nloc * linear_context.cols() + remainder_context.col(),
           geometry.objects.begin() + nloc * linear_context.cols() + remainder_context.col() + 1,
-          geometry.bground, incWave);
+          geometry, incWave);
 
     scalapack::Matrix<t_complex> transfered(linear_context, {nobj * n * 2, remainder * n * 2},
                                             {nobj * n * 2, nloc * n * 2});
@@ -1331,14 +1246,13 @@ Vector<t_complex> source_vector(std::vector<Scatterer>::const_iterator first,
     return Vector<t_complex>::Zero(0);
   auto const nMax = first->nMax;
   auto const flatMax = nMax * (nMax + 2);
-  Matrix<t_complex> TmatrixFF (2 * flatMax , 2 * flatMax);
   Vector<t_complex> result(2 * flatMax * (last - first));
 
   for(size_t i(0); first != last; ++first, i += 2 * flatMax){
 
     incWave->getIncLocal(first->vR, result.data() + i, nMax);
-    first->getTLocal(TmatrixFF, incWave->omega(), geometry.bground);   
-    result.segment(i , 2 * flatMax) = TmatrixFF * result.segment(i , 2 * flatMax);
+    result.segment(i , 2 * flatMax).array() *=
+        geometry.sphere(first - geometry.objects.begin()).T.array();
 
     }
   return result;
@@ -1358,7 +1272,6 @@ Vector<t_complex> source_vectorSH(Geometry &geometry, std::vector<Scatterer>::co
   int objectIndex_=0;
   auto const k_b_SH = 2 * incWave->omega() * std::sqrt(geometry.bground.epsilon * geometry.bground.mu);
   Vector<t_complex> result, result1, result3, resultAna;
-  Matrix<t_complex> TmatrixSH (2*flatMax, 2*flatMax);
   
   if (first->scatterer_type == "sphere"){
 
@@ -1379,8 +1292,8 @@ Vector<t_complex> source_vectorSH(Geometry &geometry, std::vector<Scatterer>::co
    for(int kk = 0; kk != nobj; kk++)  {
  
     result.segment(ii, 2*flatMax) =
-        (geometry.objects[kk].getTLocalSH1_outer(incWave->omega(), geometry.bground).array() * resultAna.segment(i, 2*flatMax).array()) +
-        (geometry.objects[kk].getTLocalSH2_outer(incWave->omega(), geometry.bground).array() * resultAna.segment(i + 2*flatMax, 2*flatMax).array());
+        (geometry.sphere(kk).SH1_outer.array() * resultAna.segment(i, 2*flatMax).array()) +
+        (geometry.sphere(kk).SH2_outer.array() * resultAna.segment(i + 2*flatMax, 2*flatMax).array());
        
   i += 4 * flatMax;
   ii += 2 * flatMax;
@@ -1423,7 +1336,7 @@ Vector<t_complex> &internalCoef_FF_, Vector<t_complex> &scatteredCoef_FF_, std::
  
     result.segment(ii, 2 *flatMax) =
     
-    geometry.objects[kk].getIauxSH2(incWave->omega(), geometry.bground).array() * resultAna.segment(i + 2*flatMax, 2 * flatMax).array();
+    geometry.sphere(kk).IauxSH2.array() * resultAna.segment(i + 2*flatMax, 2 * flatMax).array();
   
   i += 4 * flatMax;
   ii += 2 * flatMax;
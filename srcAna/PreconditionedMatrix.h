@@ -22,6 +22,12 @@
 #include "Geometry.h"
 #include "Types.h"
 #include "scalapack/Context.h"
+#ifdef OPTIMET_MPI
+#include "mpi/GraphCommunicator.h"
+#endif
+#include <functional>
+#include <memory>
+#include <vector>
 #include "scalapack/Matrix.h"
 
 namespace optimet {
@@ -33,6 +39,23 @@ Matrix<t_complex> S_sub;
 int dim;
 };
 
+#ifdef OPTIMET_MPI
+// channels of the distributed matrix-vector product for compressed matrices
+// each process owns the coefficients of the scatterers gran1 to gran2 and trades with every other
+// process either the coefficients of a scatterer or their projection onto the rows of all the
+// compressed blocks of that process in the corresponding column
+struct ACA_exchange{
+int gran1, gran2; // scatterers of this process
+int dim; // size of the block of one scatterer
+std::shared_ptr<mpi::GraphCommunicator> graph; // processes owning scatterers
+std::vector<int> send_counts, receive_counts; // entries traded with each neighbour per product
+std::vector<bool> send_raw; // whether a scatterer of this process is sent uncompressed, by neighbour
+std::vector<Matrix<t_complex>> send_basis; // otherwise, the projection applied before sending
+std::vector<int> receive_object; // the scatterer of each received channel
+std::vector<std::vector<Matrix<t_complex>>> receive_expansion; // blocks of the compressed channels, by scatterer of this process
+};
+#endif
+
 //! Computes source vector at FF
 Vector<t_complex>
 source_vector(Geometry const &geometry, std::shared_ptr<Excitation const> incWave);
@@ -81,6 +104,9 @@ Matrix<t_complex> preconditioned_scattering_matrix(Geometry const &geometry,
 
 // Computes the scattering matrix at FF with ACA compression in parallel
 #ifdef OPTIMET_MPI
+// the scatterers gran1 to gran2 owned by process proc out of size in the compressed matrices
+void ACA_scatterers(int nobj, int proc, int size, int &gran1, int &gran2);
+
 void Scattering_matrix_ACA_FF_parallel(Geometry const &geometry,
                                                    std::shared_ptr<Excitation const> incWave, std::vector<Matrix_ACA>& S_comp);
 
@@ -96,24 +122,34 @@ void Scattering_matrix_ACA_FF(Geometry const &geometry,
 void Scattering_matrix_ACA_SH(Geometry const &geometry,
                          std::shared_ptr<Excitation const> incWave, std::vector<Matrix_ACA>& S_comp);
 
-// ACA algorithm, adaptive cross approximation
-void ACA_compression(Matrix<t_complex> &U, Matrix<t_complex> &V, Matrix<t_complex> &CoupMat);
+// ACA algorithm, adaptive cross approximation of a square block of size kmax into U V, to eps_ACA
+// only the rows and columns it pivots on are asked for, false if the block does not compress
+bool ACA_compression(Matrix<t_complex> &U, Matrix<t_complex> &V, int kmax,
+                     std::function<Vector<t_complex>(int)> const &row,
+                     std::function<Vector<t_complex>(int)> const &col, double eps_ACA = 1e-3);
+
+// cuts U V to its rank at eps_ACA by QR and SVD of the factors
+void ACA_recompress(Matrix<t_complex> &U, Matrix<t_complex> &V, double eps_ACA);
 
-//search for the index of the largest absolute element in row/column for ACA algorithm
-int getMaxInd(Vector<t_complex> &RowCol, Vector<int> &K, int kmax);
+//search for the index of the largest absolute element in row/column not used yet, -1 if none
+int getMaxInd(Vector<t_complex> const &RowCol, std::vector<bool> const &used);
 
-//the gmres solver for ACA compressed matrices with restarts                                                   
-Vector<t_complex> Gmres_Zcomp(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex>const &Y, double tol, int maxit, int no_rest, Geometry const &geometry);  
+//the gmres solver for ACA compressed matrices with restarts, starting from x0 if given
+//in parallel, Y may hold only the rows of the scatterers of this process, the solution is whole
+Vector<t_complex> Gmres_Zcomp(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex>const &Y, double tol, int maxit, int no_rest, Geometry const &geometry,
+                              Vector<t_complex> const &x0 = Vector<t_complex>());  
 
 // matrix-vector product for compressed matrices in parallel
 #ifdef OPTIMET_MPI
-Vector<t_complex> matvec_parallel(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex> &J, Geometry const &geometry);
+// sets up the channels between the processes, once per system
+ACA_exchange ACA_neighbourhood(std::vector<Matrix_ACA>const &S_comp, Geometry const &geometry);
+// J and the result only hold the coefficients of the scatterers of this process
+Vector<t_complex> matvec_parallel(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex> const &J, Geometry const &geometry, ACA_exchange const &exchange);
 #endif
 
 // matrix-vector product for compressed matrices in serial
 Vector<t_complex> matvec(std::vector<Matrix_ACA>const &S_comp, Vector<t_complex> &J, Geometry const &geometry);
 
-Matrix<t_complex> det_approx (double beta, int n, Matrix<t_complex> &H);
                                                                                                   
 //! Computes preconditioned scattering matrix in serial for SH frequency 
 Matrix<t_complex> preconditioned_scattering_matrixSH(Geometry const &geometry,
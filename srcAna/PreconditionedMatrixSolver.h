@@ -47,15 +47,15 @@ public:
               Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const override {
   
     // parameters for ACA-gmres solver
-    double tol = 1e-6;
-    int maxit = 240;
-    int no_rest = 2;
+    double const tol = geometry->get_krylovtolerance();
+    int const maxit = geometry->get_krylovrestart();
+    int const no_rest = geometry->get_krylovcycles();
     
     // FF case
     if (geometry->ACA_cond_)
-    X_sca_ = Gmres_Zcomp(S_comp_FF, Q, tol, maxit, no_rest, *geometry);
+    X_sca_ = Gmres_Zcomp(S_comp_FF, Q, tol, maxit, no_rest, *geometry, guess_);
     else
-    X_sca_ = S.colPivHouseholderQr().solve(Q);
+    X_sca_ = qrFF_.solve(Q);
     
     unprecondition(X_sca_, X_int_);
     
@@ -70,9 +70,9 @@ public:
     K1ana = source_vectorSH_K1ana(*geometry, incWave, X_int_conj, X_sca_, CGcoeff);
     
     if (geometry->ACA_cond_)
-    X_sca_SH = Gmres_Zcomp(S_comp_SH, K, tol, maxit, no_rest, *geometry);
+    X_sca_SH = Gmres_Zcomp(S_comp_SH, K, tol, maxit, no_rest, *geometry, guess_SH_);
     else
-    X_sca_SH = V.colPivHouseholderQr().solve(K);
+    X_sca_SH = qrSH_.solve(K);
         
     unprecondition_SH(X_sca_SH, X_int_SH, K1ana);
     }
@@ -85,15 +85,20 @@ public:
 
     if (geometry->ACA_cond_)
     Scattering_matrix_ACA_FF(*geometry, incWave, S_comp_FF);
-    else
+    else {
     S = preconditioned_scattering_matrix(*geometry, incWave);
+    // factorized once, every solve until the next update reuses it
+    qrFF_.compute(S);
+    }
 
     if(incWave->SH_cond){
 
     if (geometry->ACA_cond_)
     Scattering_matrix_ACA_SH(*geometry, incWave, S_comp_SH);
-    else
+    else {
     V = preconditioned_scattering_matrixSH(*geometry, incWave);
+    qrSH_.compute(V);
+    }
 
  }
 
@@ -107,6 +112,8 @@ protected:
   Vector<t_complex> Q;
   // SH scattering matrix
   Matrix<t_complex> V;
+  //! QR factors of the FF and SH scattering matrices
+  Eigen::ColPivHouseholderQR<Matrix<t_complex>> qrFF_, qrSH_;
 
   std::vector<Matrix_ACA> S_comp_FF;
   std::vector<Matrix_ACA> S_comp_SH;
@@ -939,8 +939,31 @@ std::tuple<bool, t_int> read_fmm_input(pugi::xml_node const &node) {
 Run simulation_input(pugi::xml_document const &inputFile) {
   Run result;
   result.geometry = read_geometry(inputFile);
+  // accuracy of the ACA compression of the scattering matrices
+  auto const aca = inputFile.child("simulation").child("ACA");
+  result.geometry->ACAcompression(result.geometry->get_ACAcond(),
+                                  aca.attribute("tolerance").as_double(1e-3),
+                                  !std::strcmp(aca.attribute("recompress").value(), "yes"));
+  if(not(result.geometry->get_ACAtolerance() > 0))
+    throw std::runtime_error("The ACA tolerance should be positive");
+  // GMRES runs this many cycles of this many vectors, down to this relative residual
+  auto const krylov = inputFile.child("simulation").child("krylov");
+  result.geometry->krylovSolver(krylov.attribute("tolerance").as_double(1e-7),
+                                krylov.attribute("restart").as_uint(250),
+                                krylov.attribute("cycles").as_uint(3));
+  if(not(result.geometry->get_krylovtolerance() > 0) or result.geometry->get_krylovrestart() == 0 or
+     result.geometry->get_krylovcycles() == 0)
+    throw std::runtime_error("The Krylov tolerance, restart and cycles should be positive");
   result.nMax = result.geometry->nMax();
   result.nMaxS = result.geometry->nMaxS();
+  // iterative solves of a scan start from the previous wavelengths
+  result.extrapolate_guess =
+      !std::strcmp(inputFile.child("simulation").child("guess").attribute("extrapolate").value(), "yes");
+  // Clebsch Gordan tables of the SH sources held once per node
+  result.shared_tables =
+      !std::strcmp(inputFile.child("simulation").child("coefficients").attribute("shared").value(), "yes");
+  // CLG tables are read from and added to this library, if any
+  result.CLG_library = inputFile.child("simulation").child("coefficients").attribute("library").value();
   ElectroMagnetic bground =  result.geometry->bground;
   // Read Excitation
   result.excitation = read_excitation(inputFile, result.nMax, bground);
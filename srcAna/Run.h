@@ -77,6 +77,12 @@ public:
   bool do_fmm;
   //! Number of subdiagonals when setting up fmm local vs non-local mpi distribution
   t_int fmm_subdiagonals;
+  //! Whether the initial guesses along a wavelength scan are extrapolated from the last two steps
+  bool extrapolate_guess = false;
+  //! Whether the CLG tables are held once per node, in shared memory, rather than by each process
+  bool shared_tables = false;
+  //! HDF5 file caching the CLG tables between runs, none if empty
+  std::string CLG_library;
 
   /**
    * Default constructor for the Case class.
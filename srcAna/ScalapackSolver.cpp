@@ -55,23 +55,28 @@ void Scalapack::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vect
                       Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const {
     
     // parameters for ACA-gmres solver
-    double tol = 1e-7;
-    int maxit = 250;
-    int no_rest = 3;
+    double const tol = geometry->get_krylovtolerance();
+    int const maxit = geometry->get_krylovrestart();
+    int const no_rest = geometry->get_krylovcycles();
     // FF part
     Vector<t_complex> Q;
     
     if (geometry->ACA_cond_){
-    Q = source_vector(*geometry, incWave);
-    X_sca_ = Gmres_Zcomp(S_comp_FF, Q, tol, maxit, no_rest, *geometry);
+    // each process only computes the sources of its own scatterers
+    int gran1, gran2;
+    ACA_scatterers(geometry->objects.size(), communicator().rank(), communicator().size(), gran1, gran2);
+    Q = source_vector(geometry->objects.begin() + gran1, geometry->objects.begin() + gran2, incWave, *geometry);
+    X_sca_ = Gmres_Zcomp(S_comp_FF, Q, tol, maxit, no_rest, *geometry, guess_);
     PreconditionedMatrix::unprecondition(X_sca_, X_int_);
     }
     else {
     if(context().is_valid()) {
     auto input = parallel_input();
-    // Now the actual work
-    auto const gls_result =
-        scalapack::general_linear_system(std::get<0>(input), std::get<1>(input));
+    // Now the actual work, the factorization is kept until the next update
+    if(not luFF_)
+      luFF_ = std::make_shared<scalapack::LUFactors<t_complex>>(
+          scalapack::lu_factorization(std::get<0>(input)));
+    auto const gls_result = scalapack::lu_solve(*luFF_, std::get<1>(input));
     
     if(std::get<1>(gls_result) != 0)
       throw std::runtime_error("Error encountered while solving the linear system");
@@ -97,7 +102,7 @@ void Scalapack::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vect
   MPI_Barrier(MPI_COMM_WORLD);
 
   if (geometry->ACA_cond_){
-  X_sca_SH = Gmres_Zcomp(S_comp_SH, KmNOD, tol, maxit, no_rest, *geometry);
+  X_sca_SH = Gmres_Zcomp(S_comp_SH, KmNOD, tol, maxit, no_rest, *geometry, guess_SH_);
   PreconditionedMatrix::unprecondition_SH(X_sca_SH, X_int_SH, K1ana);
   }
   else{   
@@ -108,9 +113,11 @@ void Scalapack::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vect
  
     K = distributed_source_vector_SH(*geometry, KmNOD, context(), block_size());
      auto input_SH = parallel_input_SH(K, Dims);
-    // Now the actual work
-    auto const gls_result_SH =
-        scalapack::general_linear_system(std::get<0>(input_SH), std::get<1>(input_SH));
+    // Now the actual work, the factorization is kept until the next update
+    if(not luSH_)
+      luSH_ = std::make_shared<scalapack::LUFactors<t_complex>>(
+          scalapack::lu_factorization(std::get<0>(input_SH)));
+    auto const gls_result_SH = scalapack::lu_solve(*luSH_, std::get<1>(input_SH));
 
     if(std::get<1>(gls_result_SH) != 0)
       throw std::runtime_error("Error encountered while solving the linear system");
@@ -131,6 +138,10 @@ if(context().size() != communicator().size()) {
 
 void Scalapack::update() {
 
+  // the factorizations belong to the previous wavelength or geometry
+  luFF_.reset();
+  luSH_.reset();
+
   Q = distributed_source_vector(source_vector(*geometry, incWave), context(), block_size());
   MPI_Barrier(MPI_COMM_WORLD);  
   
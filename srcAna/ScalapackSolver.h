@@ -24,6 +24,8 @@
 #include "PreconditionedMatrixSolver.h"
 #include "Solver.h"
 #include "scalapack/Context.h"
+#include "scalapack/LinearSystemSolver.h"
+#include <memory>
 
 namespace optimet {
 namespace solver {
@@ -56,6 +58,9 @@ protected:
   scalapack::Context context_;
   //! Block-sizes for scalapack
   scalapack::Sizes block_size_;
+  //! \brief LU factors of the FF and SH scattering matrices
+  //! \details Computed by the first solve after an update, reused by the next ones.
+  mutable std::shared_ptr<scalapack::LUFactors<t_complex>> luFF_, luSH_;
 
   //! Creates scalapack matrix wrappers
   std::tuple<scalapack::Matrix<t_complex>, scalapack::Matrix<t_complex>> parallel_input() const;
@@ -36,382 +36,185 @@ topol = top;
 
 }
 
-void Scatterer::getTLocal(optimet::Matrix<optimet::t_complex>& Tmatrix,
- optimet::t_real omega_, ElectroMagnetic const &bground) const {
-  using namespace optimet;
- 
-  auto const N = HarmonicsIterator::max_flat(nMax) - 1;
-  
-  if (this->scatterer_type == "sphere"){
- 
-  // Fundamental frequency coefficients 
-  auto const k_s = omega_ * std::sqrt(elmag.epsilon * elmag.mu);
-  auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu);
-  
-  auto const rho = k_s / k_b;
-  auto const r_0 = k_b * radius;
-  auto const mu_sob = elmag.mu / bground.mu;
-
-  auto const Jn = bessel<Bessel>(r_0, nMax);
-  auto const Jrho = bessel<Bessel>(rho * r_0, nMax);
-  auto const Hn = bessel<Hankel1>(r_0, nMax);
-  auto const Hnrho = bessel<Hankel1>(rho * r_0, nMax);
-   
-  std::complex<double> zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
-  std::complex<double> zeta_j2 = std::sqrt(elmag.mu / elmag.epsilon); 
-  std::complex<double> zeta_boj2 = zeta_b2 / zeta_j2;  
-
-  auto const N = HarmonicsIterator::max_flat(nMax) - 1; 
-  
-  Vector<t_complex> result = Vector<t_complex>::Zero(2 * N);
-  std::vector<std::complex<double>> data, ddata;
-  
-  for(t_uint n(1), current(0); n <= nMax; current += 2 * n + 1, ++n) {
-    
-    // fundamental frequency functions
-    auto const psi = r_0 * std::get<0>(Jn)[n];
-    
-    auto const dpsi = r_0 * std::get<1>(Jn)[n] + std::get<0>(Jn)[n];
-    
-    auto const ksi = r_0 * std::get<0>(Hn)[n];
-    auto const dksi = r_0 * std::get<1>(Hn)[n] + std::get<0>(Hn)[n];
-
-    auto const psirho = r_0 * rho * std::get<0>(Jrho)[n];
-    auto const dpsirho = r_0 * rho * std::get<1>(Jrho)[n] + std::get<0>(Jrho)[n];
-
-    // TE Part  b_n coefficients fundamental frequency
-    auto const TE = (psi / ksi) * (mu_sob * dpsi / psi - rho * dpsirho / psirho) /
-                    (rho * dpsirho / psirho - mu_sob * dksi / ksi);
-                    
-    result.segment(current, 2 * n + 1).fill(TE);
-    
-    // TM part  a_n coefficients fundamental frequency
-    auto const TM = (psi / ksi) * (mu_sob * dpsirho / psirho - rho * dpsi / psi) /
-                    (rho * dksi / ksi - mu_sob * dpsirho / psirho);  
-                                       
-    result.segment(current + N, 2 * n + 1).fill(TM);
-    
-}
-  	
-  Tmatrix = result.asDiagonal();
-  }
-     
-}
-                  
-void Scatterer::getTLocalSH(optimet::Matrix<optimet::t_complex>& Tmatrix, optimet::t_real omega_, ElectroMagnetic const &bground) const {
-  using namespace optimet;
-  
-  auto const N = HarmonicsIterator::max_flat(nMaxS) - 1;
- 
-  if (this->scatterer_type == "sphere"){
-  
-  auto const k_s = 2.0 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH);
-  auto const k_b = 2.0 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-  auto const rho = k_s / k_b;
-  auto const r_0 = k_b * radius;
-  
-  auto const mu_sob = elmag.mu_SH / bground.mu;
-
-  auto const Jn = bessel<Bessel>(r_0, nMaxS);
-  auto const Jrho = bessel<Bessel>(rho * r_0, nMaxS);
-  auto const Hn = bessel<Hankel1>(r_0, nMaxS);
-  auto const Hnrho = bessel<Hankel1>(rho * r_0, nMaxS);
-   
-
-  std::complex<double> zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
-  std::complex<double> zeta_j2 = std::sqrt(elmag.mu_SH / elmag.epsilon_SH); 
-  std::complex<double> zeta_boj2 = zeta_b2 / zeta_j2;   
-  
-  Vector<t_complex> result = Vector<t_complex>::Zero(2 * N);
- 
-  std::vector<std::complex<double>> data, ddata;
-  
-  for(t_uint n(1), current(0); n <= nMaxS; current += 2 * n + 1, ++n) {
-    
-    
-    auto const psi = r_0 * std::get<0>(Jn)[n];
-    auto const dpsi = r_0 * std::get<1>(Jn)[n] + std::get<0>(Jn)[n];
-    
-    auto const ksi = r_0 * std::get<0>(Hn)[n];
-    auto const dksi = r_0 * std::get<1>(Hn)[n] + std::get<0>(Hn)[n];
-    
-    auto const psirho = r_0 * rho * std::get<0>(Jrho)[n];
-    auto const dpsirho = r_0 * rho * std::get<1>(Jrho)[n] + std::get<0>(Jrho)[n];
-    
-
-    // TE Part  b_n coefficients fundamental frequency
-    auto const TE = ((psi / ksi) * (mu_sob * dpsi / psi - rho * dpsirho / psirho) /
-                    (rho * dpsirho / psirho - mu_sob * dksi / ksi));
-                                  
-    result.segment(current, 2 * n + 1).fill(TE);
-
-    // TM part  a_n coefficients fundamental frequency
-    auto const TM = ((psi / ksi) * (mu_sob * dpsirho / psirho - rho * dpsi / psi) /
-                    (rho * dksi / ksi - mu_sob * dpsirho / psirho));  
-                                                             
-    result.segment(current + N, 2 * n + 1).fill(TM);
-
-  }
-  	
-  Tmatrix = result.asDiagonal();
-  
-  	
+namespace {
+using namespace optimet;
+
+//! \brief Spherical Bessel and Hankel functions of a sphere at many frequencies
+//! \details Those of the background, at r_0 = k_b R, and of the sphere, at rho r_0. The order n at
+//! frequency w is at [n * count + w], as bessel_batch lays them out.
+struct SphereBessel {
+  std::size_t count;
+  std::vector<t_complex> J, dJ, Jrho, dJrho, H, dH;
+
+  SphereBessel(std::vector<t_complex> const &r_0, std::vector<t_complex> const &rho_r_0,
+               t_uint nMax)
+      : count(r_0.size()), J((nMax + 1) * count), dJ(J.size()), Jrho(J.size()), dJrho(J.size()),
+        H(J.size()), dH(J.size()) {
+    for(auto const &failures :
+        {bessel_batch<Bessel>(r_0.data(), count, nMax, J.data(), dJ.data()),
+         bessel_batch<Bessel>(rho_r_0.data(), count, nMax, Jrho.data(), dJrho.data()),
+         bessel_batch<Hankel1>(r_0.data(), count, nMax, H.data(), dH.data())})
+      if(not failures.empty())
+        throw std::runtime_error(failures.front().message);
   }
-  
+};
+
+//! Riccati-Bessel functions of order n at frequency w
+struct Riccati {
+  t_complex psi, dpsi, ksi, dksi, psirho, dpsirho;
+
+  Riccati(SphereBessel const &b, std::size_t w, t_uint n, t_complex r_0, t_complex rho) {
+    auto const i = n * b.count + w;
+    psi = r_0 * b.J[i];
+    dpsi = r_0 * b.dJ[i] + b.J[i];
+    ksi = r_0 * b.H[i];
+    dksi = r_0 * b.dH[i] + b.H[i];
+    psirho = r_0 * rho * b.Jrho[i];
+    dpsirho = r_0 * rho * b.dJrho[i] + b.Jrho[i];
   }
+};
+
+//! TE (b_n) and TM (a_n) Mie coefficients
+std::pair<t_complex, t_complex> mie(Riccati const &f, t_complex rho, t_complex mu_sob) {
+  auto const TE = (f.psi / f.ksi) * (mu_sob * f.dpsi / f.psi - rho * f.dpsirho / f.psirho) /
+                  (rho * f.dpsirho / f.psirho - mu_sob * f.dksi / f.ksi);
+  auto const TM = (f.psi / f.ksi) * (mu_sob * f.dpsirho / f.psirho - rho * f.dpsi / f.psi) /
+                  (rho * f.dksi / f.ksi - mu_sob * f.dpsirho / f.psirho);
+  return {TE, TM};
+}
+} // namespace
 
-optimet::Vector<optimet::t_complex>
-Scatterer::getTLocalSH1_outer(optimet::t_real omega_, ElectroMagnetic const &bground) const {
-  using namespace optimet;
-  
-    // SH frequency coefficients 
-  auto const k_s_SH = 2 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH);
-  auto const k_b_SH = 2 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-    
-  auto const rho_SH = k_s_SH / k_b_SH;
-  auto const r_0_SH = k_b_SH * radius;
-  
- 
-  auto const Jn_SH = bessel<Bessel>(r_0_SH, nMaxS);
-  auto const Jrho_SH = bessel<Bessel>(rho_SH * r_0_SH, nMaxS);
-  auto const Hn_SH = bessel<Hankel1>(r_0_SH, nMaxS);
-  auto const Hnrho_SH = bessel<Hankel1>(rho_SH * r_0_SH, nMaxS);
-  
-  std::complex<double> x_b2 = k_b_SH * radius;
-  std::complex<double> zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
-  std::complex<double> zeta_j2 = std::sqrt(elmag.mu_SH / elmag.epsilon_SH); 
-  std::complex<double> zeta_boj2 = zeta_b2 / zeta_j2;  
-
-  auto const N = HarmonicsIterator::max_flat(nMaxS) - 1;
-  
-  Vector<t_complex> resultSH1 = Vector<t_complex>::Zero(2 * N);
- 
-  for(t_uint n(1), current(0); n <= nMaxS; current += 2 * n + 1, ++n) {
-      
-      // SH frequency functions
-    auto const psi_SH = r_0_SH * std::get<0>(Jn_SH)[n];
-    auto const dpsi_SH = r_0_SH * std::get<1>(Jn_SH)[n] + std::get<0>(Jn_SH)[n];
-
-    auto const ksi_SH = r_0_SH * std::get<0>(Hn_SH)[n];
-    auto const dksi_SH = r_0_SH * std::get<1>(Hn_SH)[n] + std::get<0>(Hn_SH)[n];
-
-    auto const psirho_SH = r_0_SH * rho_SH * std::get<0>(Jrho_SH)[n];
-    auto const dpsirho_SH = r_0_SH * rho_SH * std::get<1>(Jrho_SH)[n] + std::get<0>(Jrho_SH)[n];
-    
-     
-    // TE1 Part  b_n' coefficients SH frequency                
-    auto const TE_SH1 = - x_b2 * psirho_SH / (zeta_boj2 * ksi_SH * dpsirho_SH - psirho_SH * dksi_SH); 
-    
-    resultSH1.segment(current, 2 * n + 1).fill(TE_SH1);
-             
-    // TM1 Part  a_n' coefficients SH frequency   
-    auto const TM_SH1 = - x_b2 * dpsirho_SH / (zeta_boj2 * psirho_SH * dksi_SH - ksi_SH * dpsirho_SH);
-    
-    resultSH1.segment(current + N, 2 * n + 1).fill(TM_SH1);
-    
-  }
-  
-  return resultSH1;
+SphereCoefficients
+Scatterer::getCoefficients(optimet::t_real omega_, ElectroMagnetic const &bground, bool SH) const {
+  return getCoefficients(std::vector<optimet::t_real>{omega_}, std::vector<ElectroMagnetic>{elmag},
+                         bground, SH)
+      .front();
 }
 
- 
-optimet::Vector<optimet::t_complex>
-Scatterer::getTLocalSH2_outer(optimet::t_real omega_, ElectroMagnetic const &bground) const {
+std::vector<SphereCoefficients>
+Scatterer::getCoefficients(std::vector<optimet::t_real> const &omegas,
+                           std::vector<ElectroMagnetic> const &elmags,
+                           ElectroMagnetic const &bground, bool SH) const {
   using namespace optimet;
-  
-  
-    // SH frequency coefficients 
-  auto const k_s_SH = 2 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH); 
-  auto const k_b_SH = 2 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-
-  auto const rho_SH = k_s_SH / k_b_SH;
-  auto const r_0_SH = k_b_SH * radius;
- 
-  auto const Jn_SH = bessel<Bessel>(r_0_SH, nMaxS);
-  auto const Jrho_SH = bessel<Bessel>(rho_SH * r_0_SH, nMaxS);
-  auto const Hn_SH = bessel<Hankel1>(r_0_SH, nMaxS);
-  auto const Hnrho_SH = bessel<Hankel1>(rho_SH * r_0_SH, nMaxS);
-  
-  std::complex<double> x_b2 = k_b_SH * radius;
-  std::complex<double> zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
-  std::complex<double> zeta_j2 = std::sqrt(elmag.mu_SH / elmag.epsilon_SH);
-  std::complex<double> zeta_boj2 = zeta_b2 / zeta_j2;  
-
-  auto const N = HarmonicsIterator::max_flat(nMaxS) - 1;
- 
-  Vector<t_complex> resultSH2 = Vector<t_complex>::Zero(2 * N);
- 
-  for(t_uint n(1), current(0); n <= nMaxS; current += 2 * n + 1, ++n) {
-    
-    
-      // SH frequency functions
-    auto const psi_SH = r_0_SH * std::get<0>(Jn_SH)[n];
-    auto const dpsi_SH = r_0_SH * std::get<1>(Jn_SH)[n] + std::get<0>(Jn_SH)[n];
 
-    auto const ksi_SH = r_0_SH * std::get<0>(Hn_SH)[n];
-    auto const dksi_SH = r_0_SH * std::get<1>(Hn_SH)[n] + std::get<0>(Hn_SH)[n];
-
-    auto const psirho_SH = r_0_SH * rho_SH * std::get<0>(Jrho_SH)[n];
-    auto const dpsirho_SH = r_0_SH * rho_SH * std::get<1>(Jrho_SH)[n] + std::get<0>(Jrho_SH)[n];
-    
-     
-    // TE2 Part  b_n'' coefficients SH frequency 
-    auto const TE_SH2 = zeta_boj2 * x_b2 * dpsirho_SH / (zeta_boj2 * ksi_SH * dpsirho_SH - psirho_SH * dksi_SH);
-              
-    resultSH2.segment(current, 2 * n + 1).fill(TE_SH2);
-    
-  
-    // TM2 Part  a_n'' coefficients SH frequency  
-    auto const TM_SH2 =   zeta_boj2 * x_b2 * psirho_SH / (zeta_boj2 * psirho_SH * dksi_SH - ksi_SH * dpsirho_SH);
-                
-    resultSH2.segment(current + N, 2 * n + 1).fill(TM_SH2);
-    
+  auto const W = omegas.size();
+  bool const sphere = scatterer_type == "sphere";
+  std::vector<SphereCoefficients> result(W);
+  std::vector<t_complex> rho(W), r_0(W), rho_r_0(W);
+
+  // Fundamental frequency coefficients
+  auto const N = nMax * (nMax + 2);
+  for(std::size_t w = 0; w < W; ++w) {
+    auto const k_s = omegas[w] * std::sqrt(elmags[w].epsilon * elmags[w].mu);
+    auto const k_b = omegas[w] * std::sqrt(bground.epsilon * bground.mu);
+    rho[w] = k_s / k_b;
+    r_0[w] = k_b * radius;
+    rho_r_0[w] = rho[w] * r_0[w];
   }
-  return resultSH2;
-}
-         
-
-optimet::Vector<optimet::t_complex>
-Scatterer::getIaux(optimet::t_real omega_, ElectroMagnetic const &bground) const {
-
-  auto const k_s = omega_ * std::sqrt(elmag.epsilon * elmag.mu);
-  auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu);
-  auto const rho = k_s / k_b;
-  auto const r_0 = k_b * radius;
-  auto const mu_j = elmag.mu;
-  auto const mu_0 = bground.mu;
-  
-  std::complex<double> zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
-  std::complex<double> zeta_j2 = std::sqrt(elmag.mu / elmag.epsilon); 
-  std::complex<double> zeta_boj2 = zeta_b2 / zeta_j2;  
-
-  auto Jdata = optimet::bessel<optimet::Bessel>(r_0, nMax);
-  auto const Jrho = optimet::bessel<optimet::Bessel>(rho * r_0, nMax);
-
-  optimet::Vector<optimet::t_complex> result(2 * nMax * (nMax + 2));
-  auto TE = result.head(nMax * (nMax + 2));
-  auto TM = result.tail(nMax * (nMax + 2));
-  
-  for(auto n = 1, i = 0; n <= nMax; ++n) {
-    // obtain Riccati-Bessel functions
-    auto const psi = r_0 * std::get<0>(Jdata)[n];
-    auto const dpsi = r_0 * std::get<1>(Jdata)[n] + std::get<0>(Jdata)[n];
-    auto const psirho = r_0 * rho * std::get<0>(Jrho)[n];
-    auto const dpsirho = r_0 * rho * std::get<1>(Jrho)[n] + std::get<0>(Jrho)[n];
-
-    for(auto m = -n; m <= n; ++m, ++i) {
-    
-    
-      TE(i) = (mu_j * rho) / (mu_0 * rho * dpsirho * psi - mu_j * psirho * dpsi) *
-              std::complex<double>(0., 1.);
-                  
-              
-      TM(i) = (mu_j * rho) / (mu_j * psi * dpsirho - mu_0 * rho * psirho * dpsi) *
-              std::complex<double>(0., 1.);
-               
-            
-              
+  SphereBessel const FF(r_0, rho_r_0, nMax);
+
+  for(std::size_t w = 0; w < W; ++w) {
+    auto const mu_j = elmags[w].mu;
+    auto const mu_0 = bground.mu;
+    auto &T = result[w].T;
+    auto &Iaux = result[w].Iaux;
+    T = Vector<t_complex>::Zero(2 * N);
+    Iaux.resize(2 * N);
+
+    for(t_uint n(1), current(0); n <= nMax; current += 2 * n + 1, ++n) {
+      Riccati const f(FF, w, n, r_0[w], rho[w]);
+
+      // TE part b_n and TM part a_n
+      if(sphere) {
+        auto const TETM = mie(f, rho[w], mu_j / mu_0);
+        T.segment(current, 2 * n + 1).fill(TETM.first);
+        T.segment(current + N, 2 * n + 1).fill(TETM.second);
+      }
+
+      // internal coefficients
+      Iaux.segment(current, 2 * n + 1)
+          .fill((mu_j * rho[w]) / (mu_0 * rho[w] * f.dpsirho * f.psi - mu_j * f.psirho * f.dpsi) *
+                t_complex(0., 1.));
+      Iaux.segment(current + N, 2 * n + 1)
+          .fill((mu_j * rho[w]) / (mu_j * f.psi * f.dpsirho - mu_0 * rho[w] * f.psirho * f.dpsi) *
+                t_complex(0., 1.));
     }
   }
-  return result;
-}
-
 
-optimet::Vector<optimet::t_complex>
-Scatterer::getIauxSH1(optimet::t_real omega_, ElectroMagnetic const &bground) const {
-
-  auto const k_s_SH = 2.0 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH);
-  auto const k_b_SH = 2.0 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-  auto const rho_SH = k_s_SH / k_b_SH;
-  auto const r_0_SH = k_b_SH * radius;
-  auto const mu_0 = bground.mu;
-  
-  std::complex<double> x_b2 = k_b_SH * radius;
-  std::complex<double> x_i2 = k_s_SH * radius;
-  std::complex<double> zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
-  std::complex<double> zeta_j2 = std::sqrt(elmag.mu_SH / elmag.epsilon_SH);
-  std::complex<double> zeta_boj2 = zeta_b2 / zeta_j2;  
-
-  auto Jdata_SH = optimet::bessel<optimet::Bessel>(r_0_SH, nMaxS);
-  auto const Jrho_SH = optimet::bessel<optimet::Bessel>(rho_SH * r_0_SH, nMaxS);
-  auto const Hn_SH = optimet::bessel<optimet::Hankel1>(r_0_SH, nMaxS);
-
-  optimet::Vector<optimet::t_complex> result(2 * nMaxS * (nMaxS + 2));
-  auto TE = result.head( nMaxS * (nMaxS + 2));
-  auto TM = result.tail( nMaxS * (nMaxS + 2));
-  
-  for(auto n = 1, i = 0; n <= nMaxS; ++n) {
-    // obtain Riccati-Bessel functions
-    auto const psi_SH = r_0_SH * std::get<0>(Jdata_SH)[n];
-    auto const dpsi_SH = r_0_SH * std::get<1>(Jdata_SH)[n] + std::get<0>(Jdata_SH)[n];
-    auto const psirho_SH = r_0_SH * rho_SH * std::get<0>(Jrho_SH)[n];
-    auto const dpsirho_SH = r_0_SH * rho_SH * std::get<1>(Jrho_SH)[n] + std::get<0>(Jrho_SH)[n];
-    auto const ksi_SH = r_0_SH * std::get<0>(Hn_SH)[n];
-    auto const dksi_SH = r_0_SH * std::get<1>(Hn_SH)[n] + std::get<0>(Hn_SH)[n];
-
-    for(auto m = -n; m <= n; ++m, ++i) {
-    
-      TE(i) = (- x_i2 * ksi_SH) / (x_b2 * psirho_SH) ; // result related to the bmn'
-             
-      TM(i) = (- x_i2 * dksi_SH) / (x_b2 * dpsirho_SH); // result related to the amn'       
-                     
-    }
+  if(not SH)
+    return result;
+
+  // SH frequency coefficients
+  auto const NS = nMaxS * (nMaxS + 2);
+  for(std::size_t w = 0; w < W; ++w) {
+    auto const k_s_SH = 2.0 * omegas[w] * std::sqrt(elmags[w].epsilon_SH * elmags[w].mu_SH);
+    auto const k_b_SH = 2.0 * omegas[w] * std::sqrt(bground.epsilon * bground.mu);
+    rho[w] = k_s_SH / k_b_SH;
+    r_0[w] = k_b_SH * radius;
+    rho_r_0[w] = rho[w] * r_0[w];
   }
-  
-  
-  return result;
-}
-
-
-optimet::Vector<optimet::t_complex>
-Scatterer::getIauxSH2(optimet::t_real omega_, ElectroMagnetic const &bground) const {
-
-  auto const k_s_SH = 2.0 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH);
-  auto const k_b_SH = 2.0 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-  auto const rho_SH = k_s_SH / k_b_SH;
-  auto const r_0_SH = k_b_SH * radius;
-  auto const mu_0 = bground.mu;
-  
-  std::complex<double> bnpp, anpp;
-  std::complex<double> x_b2 = k_b_SH * radius;
-  std::complex<double> x_i2 = k_s_SH * radius;
-  std::complex<double> zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
-  std::complex<double> zeta_j2 = std::sqrt(elmag.mu_SH / elmag.epsilon_SH);
-  std::complex<double> zeta_boj2 = zeta_b2 / zeta_j2;  
-
-  auto Jdata_SH = optimet::bessel<optimet::Bessel>(r_0_SH, nMaxS);
-  auto const Jrho_SH = optimet::bessel<optimet::Bessel>(rho_SH * r_0_SH, nMaxS);
-  auto const Hn_SH = optimet::bessel<optimet::Hankel1>(r_0_SH, nMaxS);
-
-  optimet::Vector<optimet::t_complex> result(2 * nMaxS * (nMaxS + 2));
-  auto TE = result.head( nMaxS * (nMaxS + 2));
-  auto TM = result.tail( nMaxS * (nMaxS + 2));
-  
-  for(auto n = 1, i = 0; n <= nMaxS; ++n) {
-    // obtain Riccati-Bessel functions
-    auto const psi_SH = r_0_SH * std::get<0>(Jdata_SH)[n];
-    auto const dpsi_SH = r_0_SH * std::get<1>(Jdata_SH)[n] + std::get<0>(Jdata_SH)[n];
-    auto const psirho_SH = r_0_SH * rho_SH * std::get<0>(Jrho_SH)[n];
-    auto const dpsirho_SH = r_0_SH * rho_SH * std::get<1>(Jrho_SH)[n] + std::get<0>(Jrho_SH)[n];
-    auto const ksi_SH = r_0_SH * std::get<0>(Hn_SH)[n];
-    auto const dksi_SH = r_0_SH * std::get<1>(Hn_SH)[n] + std::get<0>(Hn_SH)[n];
-
-    for(auto m = -n; m <= n; ++m, ++i) {
-
-      bnpp =   (zeta_boj2 * x_b2 * dpsirho_SH) / (zeta_boj2 * ksi_SH * dpsirho_SH - psirho_SH * dksi_SH);
-      
-      anpp =    (zeta_boj2 * x_b2 * psirho_SH) / (zeta_boj2 * psirho_SH * dksi_SH - ksi_SH * dpsirho_SH);       
-     
-      TE(i) =  bnpp * ((- x_i2 * ksi_SH) / (x_b2 * psirho_SH) + (x_i2 * dksi_SH) / (zeta_boj2 * x_b2 * dpsirho_SH)) ;  //related to bmn and cmn 
-      
-      TM(i) = anpp * ((- x_i2 * dksi_SH) / (x_b2 * dpsirho_SH) + (x_i2 * ksi_SH) / (zeta_boj2 * x_b2 * psirho_SH));  //related to amn and dmn
-                     
+  SphereBessel const SHB(r_0, rho_r_0, nMaxS);
+
+  for(std::size_t w = 0; w < W; ++w) {
+    auto const x_b2 = r_0[w];
+    auto const x_i2 = rho_r_0[w];
+    auto const mu_sob = elmags[w].mu_SH / bground.mu;
+    t_complex const zeta_b2 = std::sqrt(bground.mu / bground.epsilon);
+    t_complex const zeta_j2 = std::sqrt(elmags[w].mu_SH / elmags[w].epsilon_SH);
+    t_complex const zeta_boj2 = zeta_b2 / zeta_j2;
+    auto &coefficients = result[w];
+    coefficients.TSH = Vector<t_complex>::Zero(2 * NS);
+    for(auto *vector : {&coefficients.SH1_outer, &coefficients.SH2_outer, &coefficients.IauxSH1,
+                        &coefficients.IauxSH2})
+      vector->resize(2 * NS);
+
+    for(t_uint n(1), current(0); n <= nMaxS; current += 2 * n + 1, ++n) {
+      Riccati const f(SHB, w, n, r_0[w], rho[w]);
+      auto const TE = [&](Vector<t_complex> &vector, t_complex value) {
+        vector.segment(current, 2 * n + 1).fill(value);
+      };
+      auto const TM = [&](Vector<t_complex> &vector, t_complex value) {
+        vector.segment(current + NS, 2 * n + 1).fill(value);
+      };
+
+      if(sphere) {
+        auto const TETM = mie(f, rho[w], mu_sob);
+        TE(coefficients.TSH, TETM.first);
+        TM(coefficients.TSH, TETM.second);
+      }
+
+      // b_n' and a_n' SH coefficients
+      TE(coefficients.SH1_outer,
+         -x_b2 * f.psirho / (zeta_boj2 * f.ksi * f.dpsirho - f.psirho * f.dksi));
+      TM(coefficients.SH1_outer,
+         -x_b2 * f.dpsirho / (zeta_boj2 * f.psirho * f.dksi - f.ksi * f.dpsirho));
+
+      // b_n'' and a_n'' SH coefficients
+      auto const bnpp =
+          zeta_boj2 * x_b2 * f.dpsirho / (zeta_boj2 * f.ksi * f.dpsirho - f.psirho * f.dksi);
+      auto const anpp =
+          zeta_boj2 * x_b2 * f.psirho / (zeta_boj2 * f.psirho * f.dksi - f.ksi * f.dpsirho);
+      TE(coefficients.SH2_outer, bnpp);
+      TM(coefficients.SH2_outer, anpp);
+
+      // internal coefficients, related to bmn' and amn'
+      TE(coefficients.IauxSH1, (-x_i2 * f.ksi) / (x_b2 * f.psirho));
+      TM(coefficients.IauxSH1, (-x_i2 * f.dksi) / (x_b2 * f.dpsirho));
+
+      // related to bmn and cmn, amn and dmn
+      TE(coefficients.IauxSH2, bnpp * ((-x_i2 * f.ksi) / (x_b2 * f.psirho) +
+                                       (x_i2 * f.dksi) / (zeta_boj2 * x_b2 * f.dpsirho)));
+      TM(coefficients.IauxSH2, anpp * ((-x_i2 * f.dksi) / (x_b2 * f.dpsirho) +
+                                       (x_i2 * f.ksi) / (zeta_boj2 * x_b2 * f.psirho)));
     }
   }
   return result;
 }
 
-
-
-
-
+bool Scatterer::sameSphere(Scatterer const &other) const {
+  // the models of the materials are evaluated the same way at each wavelength
+  return scatterer_type == other.scatterer_type and radius == other.radius and nMax == other.nMax and
+         nMaxS == other.nMaxS and elmag.modelType == other.elmag.modelType and
+         elmag.epsilon == other.elmag.epsilon and elmag.mu == other.elmag.mu and
+         elmag.epsilon_SH == other.elmag.epsilon_SH and elmag.mu_SH == other.elmag.mu_SH;
+}
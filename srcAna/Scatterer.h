@@ -26,6 +26,17 @@
 #include <cstring>
 
 
+//! T-matrix diagonals and auxiliary coefficients of a sphere at one wavelength
+struct SphereCoefficients {
+  optimet::Vector<optimet::t_complex> T;         /**< Diagonal of the FF T-matrix */
+  optimet::Vector<optimet::t_complex> TSH;       /**< Diagonal of the SH T-matrix */
+  optimet::Vector<optimet::t_complex> SH1_outer; /**< SH scattered coefficients from the SH sources */
+  optimet::Vector<optimet::t_complex> SH2_outer;
+  optimet::Vector<optimet::t_complex> Iaux;      /**< FF internal coefficients */
+  optimet::Vector<optimet::t_complex> IauxSH1;   /**< SH internal coefficients */
+  optimet::Vector<optimet::t_complex> IauxSH2;
+};
+
 /**
  * The Scatterer class is the highest level element of a geometry.
  * This is the only class used to create the geometry. The radius property
@@ -100,26 +111,18 @@ public:
   int nMaxS;              /**< Maximum value of the nth iterator SH */  
   std::string scatterer_type; // type of scatterer, spherical or non-spherical
 
-  // FF Tmatrix for spherical objects
-  void getTLocal(optimet::Matrix<optimet::t_complex>& Tmatrix, optimet::t_real omega_, ElectroMagnetic const &bground) const;
-  
-  // SH Tmatrix for spherical objects
-  void getTLocalSH(optimet::Matrix<optimet::t_complex>& Tmatrix, optimet::t_real omega_, ElectroMagnetic const &bground) const;
- 
-  optimet::Vector<optimet::t_complex> getTLocalSH1_outer(optimet::t_real omega_, ElectroMagnetic const &bground) const;
-  
-  optimet::Vector<optimet::t_complex> getTLocalSH2_outer(optimet::t_real omega_, ElectroMagnetic const &bground) const;
-  
-  //! Coefficients for fields inside a sphere FF
-  optimet::Vector<optimet::t_complex>
-  getIaux(optimet::t_real omega_, ElectroMagnetic const &bground) const;
-  
-  //! Coefficients for fields inside a sphere SH
-  optimet::Vector<optimet::t_complex>
-  getIauxSH1(optimet::t_real omega_, ElectroMagnetic const &bground) const;
-  
-  optimet::Vector<optimet::t_complex>
-  getIauxSH2(optimet::t_real omega_, ElectroMagnetic const &bground) const;
+  //! \brief T-matrix diagonals and auxiliary coefficients at omega_, the SH ones only if SH
+  //! \details The T-matrices of other kinds of scatterers are zero.
+  SphereCoefficients getCoefficients(optimet::t_real omega_, ElectroMagnetic const &bground, bool SH) const;
+
+  //! \brief The same at each of the frequencies omegas, with the material evaluated there
+  //! \details The Bessel and Hankel functions of all the frequencies are computed at once.
+  std::vector<SphereCoefficients>
+  getCoefficients(std::vector<optimet::t_real> const &omegas, std::vector<ElectroMagnetic> const &elmags,
+                  ElectroMagnetic const &bground, bool SH) const;
+
+  //! Whether the two spheres have the same coefficients at every wavelength
+  bool sameSphere(Scatterer const &other) const;
     
 };
 
@@ -22,6 +22,7 @@
 #include "Result.h"
 #include "Run.h"
 #include "Solver.h"
+#include <algorithm>
 #include <string>
 #include <chrono>
 #include <cstdlib>
@@ -76,7 +77,7 @@ void Simulation::field_simulation_parallel(Run &run, std::shared_ptr<solver::Abs
   int nMaxS = run.geometry->nMaxS();
   int flatMax = nMax * (nMax + 2);
   int flatMaxS = nMaxS * (nMaxS + 2);
-  int sizeCF = flatMaxS * flatMax * flatMax;
+  int sizeCF = run.geometry->couplings(nMax, nMaxS).size();
   
   int gran1CG, gran2CG;
   int rank_pc = communicator().rank();
@@ -98,18 +99,29 @@ void Simulation::field_simulation_parallel(Run &run, std::shared_ptr<solver::Abs
   std::vector<double> C_10m1_par(sizeCF_par), C_11m1_par(sizeCF_par), C_00m1_par(sizeCF_par), C_01m1_par(sizeCF_par);
   std::vector<double> W_m1m1_par(sizeCF_par), W_11_par(sizeCF_par), W_00_par(sizeCF_par), W_10_par(sizeCF_par), W_01_par(sizeCF_par);
 
-  std::vector<double> C_10m1(sizeCF), C_11m1(sizeCF), C_00m1(sizeCF), C_01m1(sizeCF);
-  std::vector<double> W_m1m1(sizeCF), W_11(sizeCF), W_00(sizeCF), W_10(sizeCF), W_01(sizeCF);
+  // the complete tables, on each process or once per node in shared memory
+  int const sizeCF_full = run.shared_tables ? 0 : sizeCF;
+  std::vector<double> C_10m1(sizeCF_full), C_11m1(sizeCF_full), C_00m1(sizeCF_full), C_01m1(sizeCF_full);
+  std::vector<double> W_m1m1(sizeCF_full), W_11(sizeCF_full), W_00(sizeCF_full), W_10(sizeCF_full), W_01(sizeCF_full);
 
   std::vector<double *> CLGcoeff_par = {&C_10m1_par[0], &C_11m1_par[0], &C_00m1_par[0], &C_01m1_par[0],
                                        &W_m1m1_par[0], &W_11_par[0], &W_00_par[0], &W_10_par[0], &W_01_par[0]};
 
-  std::vector<double *> CLGcoeff = {&C_10m1[0], &C_11m1[0], &C_00m1[0], &C_01m1[0],
-                                       &W_m1m1[0], &W_11[0], &W_00[0], &W_10[0], &W_01[0]};
+  std::vector<double *> CLGcoeff = {C_10m1.data(), C_11m1.data(), C_00m1.data(), C_01m1.data(),
+                                       W_m1m1.data(), W_11.data(), W_00.data(), W_10.data(), W_01.data()};
 
-  run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
+  if(run.shared_tables)
+    CLGcoeff = shared_tables(sizeCF);
 
-  All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
+  if(not load_tables(run, CLGcoeff, sizeCF)) {
+    run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
+
+    if(run.shared_tables)
+      All2all_shared(CLGcoeff, CLGcoeff_par, gran1CG, sizeCF_par);
+    else
+      All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
+    save_tables(run, CLGcoeff, sizeCF);
+  }
 
   solver->solve(result.scatter_coef, result.internal_coef, result.scatter_coef_SH, result.internal_coef_SH, CLGcoeff);
 
@@ -324,7 +336,7 @@ void Simulation::field_simulation(Run &run, std::shared_ptr<solver::AbstractSolv
   int nMaxS = run.geometry->nMaxS();
   int flatMax = nMax * (nMax + 2);
   int flatMaxS = nMaxS * (nMaxS + 2);
-  int sizeCF = flatMaxS * flatMax * flatMax;
+  int sizeCF = run.geometry->couplings(nMax, nMaxS).size();
   
   std::vector<double> C_10m1(sizeCF), C_11m1(sizeCF), C_00m1(sizeCF), C_01m1(sizeCF);
   std::vector<double> W_m1m1(sizeCF), W_11(sizeCF), W_00(sizeCF), W_10(sizeCF), W_01(sizeCF);
@@ -388,6 +400,95 @@ void Simulation::All2all (std::vector<double *> CLGcoeff, std::vector<double *>
 
 
 }
+
+std::vector<double *> Simulation::shared_tables(int sizeCF) {
+  auto const node = communicator().split_shared();
+  CLGshared_.clear();
+  std::vector<double *> CLGcoeff;
+  for(int i = 0; i < 9; i++) {
+    CLGshared_.emplace_back(sizeCF, node);
+    CLGcoeff.push_back(CLGshared_.back().data());
+  }
+  return CLGcoeff;
+}
+
+void Simulation::All2all_shared(std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par,
+                                int gran1, int sizeVec) {
+  auto const &node = CLGshared_.front().node();
+  auto const sizeCF = CLGshared_.front().size();
+  // the roots of the nodes exchange the tables between nodes
+  auto const roots = communicator().split(node.is_root() ? 0 : 1);
+
+  // each coefficient is computed by one process only and is zero elsewhere, so the sum over the
+  // nodes fills the tables exactly
+  if(node.is_root())
+    for(int i = 0; i < 9; i++)
+      std::fill(CLGcoeff[i], CLGcoeff[i] + sizeCF, 0e0);
+  CLGshared_.front().synchronize();
+  for(int i = 0; i < 9; i++)
+    std::copy(CLGcoeff_par[i], CLGcoeff_par[i] + sizeVec, CLGcoeff[i] + gran1);
+  CLGshared_.front().synchronize();
+  if(node.is_root() and roots.size() > 1)
+    for(int i = 0; i < 9; i++)
+      MPI_Allreduce(MPI_IN_PLACE, CLGcoeff[i], sizeCF, MPI_DOUBLE, MPI_SUM, *roots);
+  CLGshared_.front().synchronize();
+}
+
+namespace {
+//! Names of the CLG tables in the library
+char const *const CLGnames[9] = {"C_10m1", "C_11m1", "C_00m1", "C_01m1", "W_m1m1",
+                                 "W_11",   "W_00",   "W_10",   "W_01"};
+//! Group of the CLG tables of nMax and nMaxS in the library
+std::string CLGkey(Run const &run) {
+  return "CLG/nMax" + std::to_string(run.geometry->nMax()) + "_nMaxS" +
+         std::to_string(run.geometry->nMaxS());
+}
+}
+
+bool Simulation::load_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF) {
+  if(run.CLG_library.empty())
+    return false;
+  int found = 0;
+  if(communicator().rank() == 0) {
+    std::ifstream existing(run.CLG_library.c_str());
+    if(existing.good()) {
+      Output file;
+      if(file.open(run.CLG_library) >= 0) {
+        found = 1;
+        for(int i = 0; i < 9 and found; i++)
+          found = file.readReal(CLGkey(run) + "/" + CLGnames[i], CLGcoeff[i], sizeCF);
+        file.close();
+      }
+    }
+  }
+  MPI_Bcast(&found, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if(not found)
+    return false;
+
+  // in shared memory only the roots of the nodes receive the tables
+  bool const shared = not CLGshared_.empty();
+  auto const root = shared ? CLGshared_.front().node().is_root() : true;
+  auto const readers = communicator().split(root ? 0 : 1);
+  if(root)
+    for(int i = 0; i < 9; i++)
+      MPI_Bcast(CLGcoeff[i], sizeCF, MPI_DOUBLE, 0, *readers);
+  if(shared)
+    CLGshared_.front().synchronize();
+  return true;
+}
+
+void Simulation::save_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF) {
+  if(run.CLG_library.empty() or communicator().rank() != 0)
+    return;
+  Output file;
+  if(file.open(run.CLG_library) < 0) {
+    std::cerr << "Could not open CLG library " << run.CLG_library << std::endl;
+    return;
+  }
+  for(int i = 0; i < 9; i++)
+    file.writeReal(CLGkey(run) + "/" + CLGnames[i], CLGcoeff[i], sizeCF);
+  file.close();
+}
 #endif
 
 #ifdef OPTIMET_MPI
@@ -398,7 +499,7 @@ void Simulation::scan_wavelengths_parallel(Run &run, std::shared_ptr<solver::Abs
   int nMaxS = run.geometry->nMaxS();
   int flatMax = nMax * (nMax + 2);
   int flatMaxS = nMaxS * (nMaxS + 2);
-  int sizeCF = flatMaxS * flatMax * flatMax;
+  int sizeCF = run.geometry->couplings(nMax, nMaxS).size();
   int gran1, gran2, gran1AC, gran2AC, gran1CG, gran2CG;
   int rank = communicator().rank();
   int size = communicator().size();
@@ -417,19 +518,29 @@ void Simulation::scan_wavelengths_parallel(Run &run, std::shared_ptr<solver::Abs
   std::vector<double> C_10m1_par(sizeCF_par), C_11m1_par(sizeCF_par), C_00m1_par(sizeCF_par), C_01m1_par(sizeCF_par);
   std::vector<double> W_m1m1_par(sizeCF_par), W_11_par(sizeCF_par), W_00_par(sizeCF_par), W_10_par(sizeCF_par), W_01_par(sizeCF_par);
 
-  std::vector<double> C_10m1(sizeCF), C_11m1(sizeCF), C_00m1(sizeCF), C_01m1(sizeCF);
-  std::vector<double> W_m1m1(sizeCF), W_11(sizeCF), W_00(sizeCF), W_10(sizeCF), W_01(sizeCF);
+  // the complete tables, on each process or once per node in shared memory
+  int const sizeCF_full = run.shared_tables ? 0 : sizeCF;
+  std::vector<double> C_10m1(sizeCF_full), C_11m1(sizeCF_full), C_00m1(sizeCF_full), C_01m1(sizeCF_full);
+  std::vector<double> W_m1m1(sizeCF_full), W_11(sizeCF_full), W_00(sizeCF_full), W_10(sizeCF_full), W_01(sizeCF_full);
   
   std::vector<double *> CLGcoeff_par = {&C_10m1_par[0], &C_11m1_par[0], &C_00m1_par[0], &C_01m1_par[0],
                                        &W_m1m1_par[0], &W_11_par[0], &W_00_par[0], &W_10_par[0], &W_01_par[0]};
 
-  std::vector<double *> CLGcoeff = {&C_10m1[0], &C_11m1[0], &C_00m1[0], &C_01m1[0],
-                                       &W_m1m1[0], &W_11[0], &W_00[0], &W_10[0], &W_01[0]}; 
+  std::vector<double *> CLGcoeff = {C_10m1.data(), C_11m1.data(), C_00m1.data(), C_01m1.data(),
+                                       W_m1m1.data(), W_11.data(), W_00.data(), W_10.data(), W_01.data()}; 
 
-  run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
+  if(run.shared_tables)
+    CLGcoeff = shared_tables(sizeCF);
 
-      
-  All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
+  if(not load_tables(run, CLGcoeff, sizeCF)) {
+    run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
+
+    if(run.shared_tables)
+      All2all_shared(CLGcoeff, CLGcoeff_par, gran1CG, sizeCF_par);
+    else
+      All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
+    save_tables(run, CLGcoeff, sizeCF);
+  }
  
   if(communicator().rank() == communicator().root_id()) {
   
@@ -457,6 +568,15 @@ void Simulation::scan_wavelengths_parallel(Run &run, std::shared_ptr<solver::Abs
   int TMax = NO * flatMaxS;
   
   lams = (lamf - lami) / (steps - 1); 
+
+  // the coefficients of the spheres at all the wavelengths up front
+  std::vector<double> lambdas(steps);
+  for(int i = 0; i < steps; i++)
+    lambdas[i] = lami + i * lams;
+  run.geometry->preload(lambdas, run.excitation->SH_cond);
+
+  // solutions at the last two wavelengths, from which the iterative solvers start
+  Vector<t_complex> last, before_last, last_SH, before_last_SH;
   
    for(int i = 0; i < steps; i++) {
     
@@ -467,6 +587,12 @@ void Simulation::scan_wavelengths_parallel(Run &run, std::shared_ptr<solver::Abs
 
     solver->update(run); // building of the system matrices   
 
+    // the steps are even, so that the linear extrapolation is 2 x_{i-1} - x_{i-2}
+    if(run.extrapolate_guess and i > 1)
+      solver->initial_guess(2.0 * last - before_last, 2.0 * last_SH - before_last_SH);
+    else
+      solver->initial_guess(last, last_SH);
+
     Vector<double> absCS_SH_vec(size), scaCS_SH_vec(size), scaCS_FF_vec(size), extCS_FF_vec(size);
 
     if(communicator().rank() == communicator().root_id()) {
@@ -478,6 +604,10 @@ void Simulation::scan_wavelengths_parallel(Run &run, std::shared_ptr<solver::Abs
   Result result(run.geometry, run.excitation);
    
   solver->solve(result.scatter_coef, result.internal_coef, result.scatter_coef_SH, result.internal_coef_SH, CLGcoeff);
+  before_last.swap(last);
+  before_last_SH.swap(last_SH);
+  last = result.scatter_coef;
+  last_SH = result.scatter_coef_SH;
  
       if (size <= NO) {  // if the number of processes is less or eq numb of particles
 
@@ -608,7 +738,7 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
   int nMaxS = run.geometry->nMaxS();
   int flatMax = nMax * (nMax + 2);
   int flatMaxS = nMaxS * (nMaxS + 2);
-  int sizeCF = flatMaxS * flatMax * flatMax;
+  int sizeCF = run.geometry->couplings(nMax, nMaxS).size();
   
   std::vector<double> C_10m1(sizeCF), C_11m1(sizeCF), C_00m1(sizeCF), C_01m1(sizeCF);
   std::vector<double> W_m1m1(sizeCF), W_11(sizeCF), W_00(sizeCF), W_10(sizeCF), W_01(sizeCF);
@@ -640,6 +770,15 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
 
   lams = (lamf - lami) / (steps - 1);
 
+  // the coefficients of the spheres at all the wavelengths up front
+  std::vector<double> lambdas(steps);
+  for(int i = 0; i < steps; i++)
+    lambdas[i] = lami + i * lams;
+  run.geometry->preload(lambdas, run.excitation->SH_cond);
+
+  // solutions at the last two wavelengths, from which the iterative solvers start
+  Vector<t_complex> last, before_last, last_SH, before_last_SH;
+
   for(int i = 0; i < steps; i++) {
     lam = lami + i * lams;
 
@@ -649,10 +788,20 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
     run.geometry->update(run.excitation);
     
     solver->update(run);
+
+    // the steps are even, so that the linear extrapolation is 2 x_{i-1} - x_{i-2}
+    if(run.extrapolate_guess and i > 1)
+      solver->initial_guess(2.0 * last - before_last, 2.0 * last_SH - before_last_SH);
+    else
+      solver->initial_guess(last, last_SH);
     
     Result result(run.geometry, run.excitation);
     
     solver->solve(result.scatter_coef, result.internal_coef, result.scatter_coef_SH, result.internal_coef_SH, CLGcoeff);
+    before_last.swap(last);
+    before_last_SH.swap(last_SH);
+    last = result.scatter_coef;
+    last_SH = result.scatter_coef_SH;
   
     if(communicator().rank() == communicator().root_id()) {
     
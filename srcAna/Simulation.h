@@ -18,6 +18,7 @@
 #define SIMULATION_H_
 
 #include "mpi/Communicator.h"
+#include "mpi/SharedArray.h"
 #include <memory>
 #include <string>
 #include <vector>
@@ -71,6 +72,16 @@ protected:
   void scan_wavelengths_parallel(Run &run, std::shared_ptr<solver::AbstractSolver> solver);
   void field_simulation_parallel(Run &run, std::shared_ptr<solver::AbstractSolver> solver);
   void All2all(std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par, int sizeVec);
+  //! \brief Allocates the CLG tables once per node, in MPI-3 shared memory windows
+  //! \details The windows are kept until the next call.
+  std::vector<double *> shared_tables(int sizeCF);
+  //! Gathers the slices of the CLG tables into the shared windows of each node
+  void All2all_shared(std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par, int gran1,
+                      int sizeVec);
+  //! Reads the CLG tables from the library of the run, false if it does not hold them
+  bool load_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF);
+  //! Adds the CLG tables to the library of the run, if any
+  void save_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF);
   #endif
   void scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolver> solver);
   void field_simulation(Run &run, std::shared_ptr<solver::AbstractSolver> solver);
@@ -79,6 +90,10 @@ protected:
 private:
   std::string caseFile; /**< Name of the case without extensions. */
   mpi::Communicator communicator_;
+  #ifdef OPTIMET_MPI
+  //! The CLG tables shared by the processes of a node, if any
+  std::vector<mpi::SharedArray> CLGshared_;
+  #endif
 };
 }
 #endif /* SIMULATION_H_ */
@@ -16,6 +16,7 @@
 
 #include "Solver.h"
 #include "ElectroMagnetic.h"
+#include "MagmaSolver.h"
 #include "MatrixBelosSolver.h"
 #include "PreconditionedMatrixSolver.h"
 #include "ScalapackSolver.h"
@@ -31,6 +32,11 @@ std::shared_ptr<AbstractSolver> factory(Run const &run) {
 
 #ifndef OPTIMET_MPI
 
+#ifdef OPTIMET_MAGMA
+  // the dense systems go to the GPUs, the compressed ones to the host GMRES
+  if(not run.geometry->ACA_cond_)
+    return std::make_shared<Magma>(run);
+#endif
   return std::make_shared<PreconditionedMatrix>(run);
 #elif defined(OPTIMET_SCALAPACK) && !defined(OPTIMET_BELOS)
   
@@ -54,19 +60,17 @@ std::shared_ptr<AbstractSolver> factory(Run const &run) {
 }
 } // namespace solver
 
-Vector<t_complex> convertInternal(Vector<t_complex> const &scattered, t_real const &omega,
-                                  ElectroMagnetic const &bground,
-                                  std::vector<Scatterer> const &objects) {
+Vector<t_complex> convertInternal(Vector<t_complex> const &scattered, Geometry const &geometry) {
+  auto const &objects = geometry.objects;
   Vector<t_complex> result(scattered.size());
   size_t i = 0;
   auto const N = 2 * objects[0].nMax * (objects[0].nMax + 2);
-  Matrix<t_complex> Intrmatrix(N, N);
 
-  for(auto const &object : objects) {
+  for(t_uint j = 0; j < objects.size(); ++j) {
   
-   if (object.scatterer_type == "sphere"){
+   if (objects[j].scatterer_type == "sphere"){
     result.segment(i, N).array() =
-        scattered.segment(i, N).array() * object.getIaux(omega, bground).array();
+        scattered.segment(i, N).array() * geometry.sphere(j).Iaux.array();
     }
 
     i += N;
@@ -92,20 +96,18 @@ Vector<t_complex> convertIndirect_SH_outer(Vector<t_complex> const &scattered, t
 }
 
 
-Vector<t_complex> convertInternal_SH(Vector<t_complex> const &scattered, Vector<t_complex> const &K_1ana, t_real const &omega,
-                                  ElectroMagnetic const &bground,
-                                  std::vector<Scatterer> const &objects) {
+Vector<t_complex> convertInternal_SH(Vector<t_complex> const &scattered, Vector<t_complex> const &K_1ana,
+                                     Geometry const &geometry) {
+  auto const &objects = geometry.objects;
   Vector<t_complex> result(scattered.size());
   auto const N = 2 * objects[0].nMaxS * (objects[0].nMaxS + 2);
-  Matrix<t_complex> Intrmatrix(N, N);
   size_t i = 0; 
- auto const k_b_SH = 2 * omega * std::sqrt(bground.epsilon * bground.mu);
 
   if (objects[0].scatterer_type == "sphere"){
-  for(auto const &object : objects) {
+  for(t_uint j = 0; j < objects.size(); ++j) {
     
     result.segment(i, N).array() =
-        scattered.segment(i, N).array() * object.getIauxSH1(omega, bground).array();
+        scattered.segment(i, N).array() * geometry.sphere(j).IauxSH1.array();
         
     result.segment(i, N) = result.segment(i, N)  - K_1ana.segment(i, N);  
   
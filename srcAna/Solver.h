@@ -43,8 +43,7 @@ Vector<t_complex> convertIndirect(Vector<t_complex> const &scattered, t_real con
                                   
                                   
 //! Computes internal field coefficients, spheres FF
-Vector<t_complex> convertInternal(Vector<t_complex> const &scattered, t_real const &omega,
-                                  ElectroMagnetic const &bground, std::vector<Scatterer> const &);
+Vector<t_complex> convertInternal(Vector<t_complex> const &scattered, Geometry const &geometry);
   
   
   //! Computes scattering field coefficients, spheres SH
@@ -52,9 +51,8 @@ Vector<t_complex> convertIndirect_SH_outer(Vector<t_complex> const &scattered, t
                                   ElectroMagnetic const &bground, std::vector<Scatterer> const &); 
                                   
 //  Computes internal field coefficients, spheres SH                                
-Vector<t_complex> convertInternal_SH(Vector<t_complex> const &scattered, Vector<t_complex> const &K_1ana, t_real const &omega,
-                                  ElectroMagnetic const &bground,
-                                  std::vector<Scatterer> const &);                                  
+Vector<t_complex> convertInternal_SH(Vector<t_complex> const &scattered, Vector<t_complex> const &K_1ana,
+                                     Geometry const &geometry);                                  
                                                                     
 namespace solver {
 
@@ -102,6 +100,17 @@ public:
  
   virtual void update() = 0;
 
+  /**
+   * Initial guesses of the iterative solvers for the next solves.
+   * Typically the solution at a neighbouring wavelength. The direct solvers ignore them.
+   * @param X_sca_ the scattered coefficients, empty to start from zero.
+   * @param X_sca_SH the scattered SH coefficients, likewise.
+   */
+  void initial_guess(Vector<t_complex> const &X_sca_, Vector<t_complex> const &X_sca_SH) {
+    guess_ = X_sca_;
+    guess_SH_ = X_sca_SH;
+  }
+
   //! Converts back to the scattered result from the indirect calculation
   Vector<t_complex> convertIndirect(Vector<t_complex> const &scattered) const {
     return optimet::convertIndirect(scattered, incWave->omega(), geometry->bground,
@@ -111,8 +120,7 @@ public:
 
   //! Solves for the internal coefficients at fundamental frequency
   Vector<t_complex> solveInternal(Vector<t_complex> const &scattered) const {
-    return optimet::convertInternal(scattered, incWave->omega(), geometry->bground,
-                                    geometry->objects);
+    return optimet::convertInternal(scattered, *geometry);
   }
   
   
@@ -124,8 +132,7 @@ public:
   
   //! Solves for the internal coefficients SH frequency
   Vector<t_complex> solveInternal_SH(Vector<t_complex> const &scattered, Vector<t_complex> const &K_1ana) const {
-    return optimet::convertInternal_SH(scattered, K_1ana, incWave->omega(), geometry->bground,
-                                    geometry->objects);
+    return optimet::convertInternal_SH(scattered, K_1ana, *geometry);
   }
 
   //! Number of spherical harmonics in expansion
@@ -141,6 +148,8 @@ protected:
   std::shared_ptr<Excitation const> incWave; /**< Pointer to the incoming excitation. */
   mpi::Communicator communicator_;
   t_uint nMax;
+  Vector<t_complex> guess_;                     /**< Initial guess of the scattered coefficients. */
+  Vector<t_complex> guess_SH_;                  /**< Initial guess of the scattered SH coefficients. */
 };
 
 //! A factory function for solvers
@@ -17,6 +17,7 @@
 #include "TranslationAdditionCoefficients.h"
 #include "Bessel.h"
 #include "constants.h"
+#include <algorithm>
 #include <cmath>
 #include <complex>
 
@@ -78,19 +79,47 @@ t_complex CachedRecurrence::operator()(t_int n, t_int m, t_int l, t_int k) {
   // separately using the symmetry
   // relationship.
   assert(m >= 0);
+  if(axial and k != m)
+    return 0e0;
+
+  if(n > nmax or l > 2 * nmax - n)
+    tabulate(std::max(std::max(n, l), nmax + 1));
+  return table[index(n, m, l, k)];
+}
 
-  // Check cache first
-  t_indices const indices{{n, m, l, k}};
-  auto const i_found = cache.find(indices);
-  if(i_found != cache.end())
-    return i_found->second;
+t_complex CachedRecurrence::value(t_int n, t_int m, t_int l, t_int k) const {
+  if(not is_valid(n, m, l, k) or (axial and k != m))
+    return 0e0;
+  assert(n <= nmax and l <= 2 * nmax - n);
+  return table[index(n, m, l, k)];
+}
 
-  auto const result = recurrence(n, m, l, k);
-  cache[indices] = result;
-  return result;
+void CachedRecurrence::tabulate(t_int nMax) {
+  nmax = nMax;
+  table.assign(static_cast<std::size_t>(nmax + 1) * (nmax + 1) * (2 * nmax + 1) *
+                   (axial ? 1 : 4 * nmax + 1),
+               0e0);
+  radial.resize(2 * nmax + 1);
+  if(regular)
+    optimet::bessel<Bessel>(direction.rrr * waveK, 2 * nmax, radial.data(), nullptr);
+  else
+    optimet::bessel<Hankel1>(direction.rrr * waveK, 2 * nmax, radial.data(), nullptr);
+
+  // each n only depends on n - 1 and n - 2, for l up to one more
+  for(t_int n(0); n <= nmax; ++n)
+    for(t_int m(0); m <= n; ++m)
+      for(t_int l(0); l <= 2 * nmax - n; ++l) {
+        if(axial) {
+          if(m <= l)
+            table[index(n, m, l, m)] = recurrence(n, m, l, m);
+          continue;
+        }
+        for(t_int k(-l); k <= l; ++k)
+          table[index(n, m, l, k)] = recurrence(n, m, l, k);
+      }
 }
 
-t_complex CachedRecurrence::recurrence(t_int n, t_int m, t_int l, t_int k) {
+t_complex CachedRecurrence::recurrence(t_int n, t_int m, t_int l, t_int k) const {
   if(n == 0 and m == 0)
     return initial(l, k);
   else if(n == m)
@@ -99,27 +128,25 @@ t_complex CachedRecurrence::recurrence(t_int n, t_int m, t_int l, t_int k) {
     return offdiagonal_recurrence(n, m, l, k);
 }
 
-t_complex CachedRecurrence::initial(t_int l, t_int k) {
+t_complex CachedRecurrence::initial(t_int l, t_int k) const {
   assert(l >= 0);
-  auto const wave = direction.rrr * waveK;
-  auto const bessel = regular ? optimet::bessel<Bessel> : optimet::bessel<Hankel1>;
-  auto const hb = std::get<0>(bessel(wave, l)).back();
+  auto const hb = radial[l];
   if(l == 0 and k == 0)
     return hb;
   auto const factor = std::sqrt(4e0 * constant::pi) * ((l + k) % 2 == 0 ? 1 : -1);
   return factor * Ynm(direction, l, -k) * hb;
 }
 
-t_complex CachedRecurrence::diagonal_recurrence(t_int n, t_int l, t_int k) {
-  return (operator()(n - 1, n - 1, l - 1, k - 1) * b_plus(l - 1, k - 1) +
-          operator()(n - 1, n - 1, l + 1, k - 1) * b_minus(l + 1, k - 1)) /
+t_complex CachedRecurrence::diagonal_recurrence(t_int n, t_int l, t_int k) const {
+  return (value(n - 1, n - 1, l - 1, k - 1) * b_plus(l - 1, k - 1) +
+          value(n - 1, n - 1, l + 1, k - 1) * b_minus(l + 1, k - 1)) /
          b_plus(n - 1, n - 1);
 }
 
-t_complex CachedRecurrence::offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k) {
-  return (-operator()(n - 2, m, l, k) * a_minus(n - 1, m) +
-          operator()(n - 1, m, l - 1, k) * a_plus(l - 1, k) +
-          operator()(n - 1, m, l + 1, k) * a_minus(l + 1, k)) /
+t_complex CachedRecurrence::offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k) const {
+  return (-value(n - 2, m, l, k) * a_minus(n - 1, m) +
+          value(n - 1, m, l - 1, k) * a_plus(l - 1, k) +
+          value(n - 1, m, l + 1, k) * a_minus(l + 1, k)) /
          a_plus(n - 1, m);
 }
 
@@ -134,4 +161,69 @@ t_complex TranslationAdditionCoefficients::operator()(t_int n, t_int m, t_int l,
   return sign % 2 == 0 ? result : -result;
 }
 
+CoaxialTranslationAdditionCoefficients::CoaxialTranslationAdditionCoefficients(t_real distance,
+                                                                               t_complex waveK,
+                                                                               bool regular,
+                                                                               t_int nMax)
+    : nmax(nMax), table((nMax + 1) * (nMax + 1) * (nMax + 1), 0e0) {
+  std::vector<t_complex> radial(2 * nmax + 1);
+  if(regular)
+    optimet::bessel<Bessel>(distance * waveK, 2 * nmax, radial.data(), nullptr);
+  else
+    optimet::bessel<Hankel1>(distance * waveK, 2 * nmax, radial.data(), nullptr);
+
+  // weights of the radial functions of orders 0 to 2 nmax, for n - 2, n - 1 and n
+  t_int const L = 2 * nmax + 1;
+  auto const position = [nMax, L](t_int n, t_int m, t_int l) -> std::size_t {
+    return ((static_cast<std::size_t>(n % 3) * (nMax + 1) + m) * L + l) * L;
+  };
+  std::vector<t_real> weights(3 * (nmax + 1) * L * L, 0e0);
+  auto const weight = [&](t_int n, t_int m, t_int l) -> t_real const * {
+    return is_valid(n, m, l, m) and l <= 2 * nmax - n ? &weights[position(n, m, l)] : nullptr;
+  };
+  for(t_int n(0); n <= nmax; ++n)
+    for(t_int m(0); m <= n; ++m)
+      for(t_int l(0); l < L; ++l) {
+        auto *const result = &weights[position(n, m, l)];
+        std::fill(result, result + L, 0e0);
+        if(l > 2 * nmax - n or l < m)
+          continue;
+        auto const add = [result, L](t_real const *w, t_real factor) {
+          if(w != nullptr and factor != 0)
+            for(t_int p(0); p < L; ++p)
+              result[p] += factor * w[p];
+        };
+        if(n == 0)
+          // sqrt(4 pi) (-1)^l Y_l0(0, 0)
+          result[l] = (l % 2 == 0 ? 1 : -1) * std::sqrt(2e0 * l + 1e0);
+        else if(n == m) {
+          add(weight(n - 1, n - 1, l - 1), b_plus(l - 1, m - 1) / b_plus(n - 1, n - 1));
+          add(weight(n - 1, n - 1, l + 1), b_minus(l + 1, m - 1) / b_plus(n - 1, n - 1));
+        } else {
+          add(weight(n - 2, m, l), -a_minus(n - 1, m) / a_plus(n - 1, m));
+          add(weight(n - 1, m, l - 1), a_plus(l - 1, m) / a_plus(n - 1, m));
+          add(weight(n - 1, m, l + 1), a_minus(l + 1, m) / a_plus(n - 1, m));
+        }
+        // only orders |n - l| <= p <= n + l contribute, round-off errors elsewhere would dominate
+        // the small regular coefficients
+        std::fill(result, result + std::abs(n - l), 0e0);
+        std::fill(result + std::min(n + l + 1, L), result + L, 0e0);
+        if(l <= nmax) {
+          t_complex value = 0;
+          for(t_int p(0); p < L; ++p)
+            value += result[p] * radial[p];
+          table[(n * (nmax + 1) + m) * (nmax + 1) + l] = value;
+        }
+      }
+}
+
+t_complex CoaxialTranslationAdditionCoefficients::operator()(t_int n, t_int m, t_int l,
+                                                             t_int k) const {
+  if(not is_valid(n, m, l, k) or k != m)
+    return 0e0;
+  assert(n <= nmax and l <= nmax);
+  // coefficients for -m are those for m along z
+  return table[(n * (nmax + 1) + std::abs(m)) * (nmax + 1) + l];
+}
+
 } // end of optimet namespace
@@ -18,9 +18,10 @@
 
 #include "Types.h"
 #include <array>
-#include <map>
+#include <vector>
 
 #include "Spherical.h"
+#include "constants.h"
 
 namespace optimet {
 //! Equation 1 of Appendix A in Stout (2002)
@@ -30,14 +31,20 @@ namespace details {
 
 //! \brief Computes translation addition coefficients for m > 0
 //! \details Equations come from Stout (2002), appendix C. Negative m coefficients should be
-//! obtained using the symmetry relationship. This class caches previously computed coefficients.
+//! obtained using the symmetry relationship. The coefficients are tabulated for n <= nMax, in the
+//! order of the recurrence. The table grows if larger indices are requested. When R lies on the z
+//! axis, only the k = m coefficients are non-zero, and only those are tabulated.
 class CachedRecurrence {
 public:
   //! Indices tuple
   typedef std::array<t_int, 4> t_indices;
 
-  CachedRecurrence(Spherical<t_real> R, t_complex waveK, bool regular = true)
-      : direction(R), waveK(waveK), regular(regular) {}
+  CachedRecurrence(Spherical<t_real> R, t_complex waveK, bool regular = true, t_int nMax = 0)
+      : direction(R), waveK(waveK), regular(regular),
+        axial(R.the == 0e0 or R.the == constant::pi), nmax(-1) {
+    if(nMax > 0)
+      tabulate(nMax);
+  }
 
   //! \brief Returns translation addition coefficients
   //! \details n and m correspond to the same variables in Stout (2004), l and k correspond to ν and
@@ -53,14 +60,30 @@ protected:
   t_complex const waveK;
   //! Whether this is for regular or irregular coeffs
   bool const regular;
-  //! Caches known coefficients
-  std::map<t_indices, t_complex> cache;
+  //! Whether the direction is along z
+  bool const axial;
+  //! Largest n in the table, l goes up to 2 nmax - n
+  t_int nmax;
+  //! Coefficients for 0 <= m <= n <= nmax
+  std::vector<t_complex> table;
+  //! Bessel or Hankel functions of order 0 to 2 nmax
+  std::vector<t_complex> radial;
+
+  //! Position of (n, m, l, k) in the table
+  std::size_t index(t_int n, t_int m, t_int l, t_int k) const {
+    auto const nml = (static_cast<std::size_t>(n) * (nmax + 1) + m) * (2 * nmax + 1) + l;
+    return axial ? nml : nml * (4 * nmax + 1) + k + 2 * nmax;
+  }
+  //! Tabulated coefficient, zero outside the domain of validity
+  t_complex value(t_int n, t_int m, t_int l, t_int k) const;
+  //! Fills the table up to n = nMax, without recursion
+  void tabulate(t_int nMax);
 
   //! Switches between recurrence relationships
-  t_complex recurrence(t_int n, t_int m, t_int l, t_int k);
-  t_complex initial(t_int l, t_int k);
-  t_complex diagonal_recurrence(t_int n, t_int l, t_int k);
-  t_complex offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k);
+  t_complex recurrence(t_int n, t_int m, t_int l, t_int k) const;
+  t_complex initial(t_int l, t_int k) const;
+  t_complex diagonal_recurrence(t_int n, t_int l, t_int k) const;
+  t_complex offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k) const;
 };
 
 } // end of details namespace
@@ -69,9 +92,11 @@ protected:
 //! \details The coefficients are obtained for given wave. It is not possible to change it once set.
 class TranslationAdditionCoefficients {
 public:
-  TranslationAdditionCoefficients(Spherical<t_real> R, t_complex waveK, bool regular = true)
-      : positive(R, waveK, regular),
-        negative(R, regular ? std::conj(waveK) : -std::conj(waveK), regular) {}
+  //! \param nMax: largest n and l expected, so that the coefficients are tabulated only once
+  TranslationAdditionCoefficients(Spherical<t_real> R, t_complex waveK, bool regular = true,
+                                  t_int nMax = 0)
+      : positive(R, waveK, regular, nMax),
+        negative(R, regular ? std::conj(waveK) : -std::conj(waveK), regular, nMax) {}
 
   //! \brief Computes the coefficients as per Stout (2002)
   //! \details n, m, l, k correspond to n, m, ν, μ in Stout (2002), respectively.
@@ -83,6 +108,29 @@ protected:
   //! Recurrence for negative m
   details::CachedRecurrence negative;
 };
+
+//! \brief Translation-addition coefficients for a translation along z
+//! \details Only the k = m coefficients are non-zero. The recurrence of Stout (2002) is applied to
+//! the weights of each Bessel or Hankel function in the coefficients, which are purely geometric.
+//! The coefficients are then summed from accurate radial functions. Unlike a recurrence over the
+//! coefficients themselves, this remains accurate for large orders at short distances, at a cost of
+//! O(nMax^4) rather than O(nMax^3).
+class CoaxialTranslationAdditionCoefficients {
+public:
+  //! \param nMax: largest n and l of the table
+  CoaxialTranslationAdditionCoefficients(t_real distance, t_complex waveK, bool regular,
+                                         t_int nMax);
+
+  //! \brief Coefficients as per Stout (2002), for n, l <= nMax
+  //! \details n, m, l, k correspond to n, m, ν, μ in Stout (2002), respectively.
+  t_complex operator()(t_int n, t_int m, t_int l, t_int k) const;
+
+protected:
+  //! Largest n and l in the table
+  t_int nmax;
+  //! Coefficients for 0 <= m <= n <= nmax and l <= nmax
+  std::vector<t_complex> table;
+};
 }
 
 #endif
@@ -56,6 +56,13 @@ Communicator Communicator::split(t_int color, t_uint rank) const {
   return comm;
 }
 
+Communicator Communicator::split_shared() const {
+  MPI_Comm comm;
+  MPI_Comm_split_type(**this, MPI_COMM_TYPE_SHARED, static_cast<t_int>(rank()), MPI_INFO_NULL,
+                      &comm);
+  return comm;
+}
+
 Communicator Communicator::duplicate() const {
   MPI_Comm comm;
   MPI_Comm_dup(**this, &comm);
@@ -66,6 +66,9 @@ public:
   Communicator split(t_int color) const { return split(color, rank()); }
   //! Split current communicator
   Communicator split(t_int color, t_uint rank) const;
+  //! \brief Splits into the processes that can share memory, one communicator per node
+  //! \details Ranks are kept in the same order.
+  Communicator split_shared() const;
 
   //! True if object is root
   bool is_root() const { return rank() == root_id(); }
@@ -0,0 +1,62 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "mpi/SharedArray.h"
+#include "mpi/Collectives.h"
+#include "mpi/Session.h"
+#include <exception>
+#include <mpi.h>
+
+namespace optimet {
+namespace mpi {
+
+SharedArray::SharedArray(t_uint size, Communicator const &node) : impl(nullptr), node_(node) {
+  if(not initialized())
+    throw std::runtime_error("Mpi was not initialized");
+
+  // only the root allocates, the others point to its memory
+  MPI_Aint const bytes = node.is_root() ? size * sizeof(double) : 0;
+  double *data = nullptr;
+  MPI_Win window;
+  if(MPI_Win_allocate_shared(bytes, sizeof(double), MPI_INFO_NULL, *node, &data, &window) !=
+     MPI_SUCCESS)
+    throw std::runtime_error("Could not allocate the shared memory window");
+
+  MPI_Aint root_bytes;
+  int unit;
+  MPI_Win_shared_query(window, node.root_id(), &root_bytes, &unit, &data);
+  // passive target epoch for the whole life of the window, synchronized with MPI_Win_sync
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+
+  impl = std::shared_ptr<Impl>(new Impl{window, data, size}, &delete_window);
+}
+
+void SharedArray::synchronize() const {
+  MPI_Win_sync(impl->window);
+  node_.barrier();
+  MPI_Win_sync(impl->window);
+}
+
+void SharedArray::delete_window(Impl *const impl) {
+  if(initialized() and not finalized()) {
+    MPI_Win_unlock_all(impl->window);
+    MPI_Win_free(&impl->window);
+  }
+  delete impl;
+}
+
+} /* optimet::mpi */
+} /* optimet */
@@ -47,7 +47,12 @@ void OPTIMET_FC_GLOBAL_(blacs_pcoord, BLACS_PCOORD)(int *context, int *pnum, int
       *ptrmynewblock, int ib, int jb, int *mb, int globcontext);                              \
   void OPTIMET_FC_GLOBAL(p ## letter ## gesv, P ## LETTER ## GESV)(int *n, int *nrhs,         \
       TYPE *a, int *ia, int *ja, int *desca, int *ipiv, TYPE *b, int *ib, int *jb,            \
-      int *descb, int *info);
+      int *descb, int *info);                                                                 \
+  void OPTIMET_FC_GLOBAL(p ## letter ## getrf, P ## LETTER ## GETRF)(int *m, int *n,          \
+      TYPE *a, int *ia, int *ja, int *desca, int *ipiv, int *info);                           \
+  void OPTIMET_FC_GLOBAL(p ## letter ## getrs, P ## LETTER ## GETRS)(char const *trans,       \
+      int *n, int *nrhs, TYPE const *a, int *ia, int *ja, int *desca, int const *ipiv,        \
+      TYPE *b, int *ib, int *jb, int *descb, int *info);
 
 OPTIMET_MACRO(i, I, int);
 OPTIMET_MACRO(s, S, float);
@@ -29,6 +29,7 @@
 #endif
 
 #include <tuple>
+#include <vector>
 
 namespace optimet {
 namespace scalapack {
@@ -42,6 +43,22 @@ template <class SCALAR>
 std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
 general_linear_system(Matrix<SCALAR> const &A, Matrix<SCALAR> const &b);
 
+//! LU factors of a matrix, reusable for any number of right-hand sides
+template <class SCALAR> struct LUFactors {
+  //! Factors L and U, as overwritten by pXgetrf
+  typename Matrix<SCALAR>::ConcreteMatrix LU;
+  //! Pivots of the rows
+  std::vector<int> pivots;
+  //! Info flag of pXgetrf
+  int info;
+};
+//! Factorizes a square matrix
+template <class SCALAR> LUFactors<SCALAR> lu_factorization(Matrix<SCALAR> const &A);
+//! Solves a system of linear equations from the LU factors of its matrix
+template <class SCALAR>
+std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
+lu_solve(LUFactors<SCALAR> const &factors, Matrix<SCALAR> const &b);
+
 #ifdef OPTIMET_BELOS
 //! Solve a system of linear equations using Belos
 template <class SCALARA, class SCALARB>
@@ -64,6 +64,22 @@ OPTIMET_MACRO(c, C, std::complex<float>);
 OPTIMET_MACRO(z, Z, std::complex<double>);
 #undef OPTIMET_MACRO
 
+#define OPTIMET_MACRO(letter, LETTER, TYPE)                                                        \
+  inline void getrf(int *m, int *n, TYPE *a, int *ia, int *ja, int *desca, int *ipiv, int *info) { \
+    OPTIMET_FC_GLOBAL(p##letter##getrf, P##LETTER##GETRF)(m, n, a, ia, ja, desca, ipiv, info);     \
+  }                                                                                                \
+  inline void getrs(char const *trans, int *n, int *nrhs, TYPE const *a, int *ia, int *ja,         \
+                    int *desca, int const *ipiv, TYPE *b, int *ib, int *jb, int *descb,            \
+                    int *info) {                                                                   \
+    OPTIMET_FC_GLOBAL(p##letter##getrs, P##LETTER##GETRS)                                          \
+    (trans, n, nrhs, a, ia, ja, desca, ipiv, b, ib, jb, descb, info);                              \
+  }
+OPTIMET_MACRO(s, S, float);
+OPTIMET_MACRO(d, D, double);
+OPTIMET_MACRO(c, C, std::complex<float>);
+OPTIMET_MACRO(z, Z, std::complex<double>);
+#undef OPTIMET_MACRO
+
 template <class SCALARA, class SCALARB>
 void sane_input(Matrix<SCALARA> const &A, Matrix<SCALARB> const &b) {
   if(A.rows() != A.cols())
@@ -90,6 +106,43 @@ template <class SCALAR> int general_linear_system_inplace(Matrix<SCALAR> &A, Mat
   return info;
 }
 
+template <class SCALAR> LUFactors<SCALAR> lu_factorization(Matrix<SCALAR> const &A) {
+  typedef typename Matrix<SCALAR>::ConcreteMatrix ConcreteMatrix;
+  if(A.rows() != A.cols())
+    throw std::runtime_error("Matrix should be square");
+  LUFactors<SCALAR> result{ConcreteMatrix(A.local(), A.context(), A.sizes(), A.blocks()),
+                           std::vector<int>(), 0};
+  if(not A.context().is_valid())
+    return result;
+  if(A.blocks().rows != A.blocks().cols)
+    throw std::runtime_error("Blocs must be square");
+  int m = A.rows(), n = A.cols(), one = 1;
+  result.pivots.resize(A.local().rows() + A.blocks().rows);
+  getrf(&m, &n, result.LU.local().data(), &one, &one, const_cast<int *>(result.LU.blacs().data()),
+        result.pivots.data(), &result.info);
+  return result;
+}
+
+template <class SCALAR>
+std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
+lu_solve(LUFactors<SCALAR> const &factors, Matrix<SCALAR> const &b) {
+  typedef typename Matrix<SCALAR>::ConcreteMatrix ConcreteMatrix;
+  auto const &A = factors.LU;
+  if(not(A.context().is_valid() and b.context().is_valid()))
+    return std::tuple<ConcreteMatrix, int>{ConcreteMatrix(b.context(), b.sizes(), b.blocks()), 0};
+  sane_input(A, b);
+  if(factors.info != 0)
+    return std::tuple<ConcreteMatrix, int>{ConcreteMatrix(b.context(), b.sizes(), b.blocks()),
+                                           factors.info};
+  ConcreteMatrix result(b.local(), b.context(), b.sizes(), b.blocks());
+  int n = A.rows(), nrhs = b.cols(), one = 1, info;
+  char const trans = 'N';
+  getrs(&trans, &n, &nrhs, A.local().data(), &one, &one, const_cast<int *>(A.blacs().data()),
+        factors.pivots.data(), result.local().data(), &one, &one,
+        const_cast<int *>(result.blacs().data()), &info);
+  return std::tuple<ConcreteMatrix, int>{std::move(result), std::move(info)};
+}
+
 #ifdef OPTIMET_BELOS
 template <class SCALARA, class SCALARB>
 std::tuple<typename Matrix<SCALARA>::ConcreteMatrix, int>
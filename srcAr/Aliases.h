@@ -29,6 +29,15 @@
 /** @brief Cartesian Regular grid. */
 #define O3DCartesianRegular 911
 
+/** @brief Regular grid on a plane of any orientation. */
+#define O3DPlane 912
+
+/** @brief Evenly spaced points along a segment. */
+#define O3DLine 913
+
+/** @brief Points listed in a binary file. */
+#define O3DPointList 914
+
 /** @brief Spiral structure. */
 #define O3DGeometrySpiral 311
 
@@ -0,0 +1,75 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace optimet {
+namespace {
+//! The bytes rounded up to the alignment, so that the next allocation is aligned too
+std::size_t aligned(std::size_t bytes) {
+  return (bytes + Arena::alignment - 1) / Arena::alignment * Arena::alignment;
+}
+} // namespace
+
+std::size_t Arena::capacity() const {
+  std::size_t result = 0;
+  for(auto const &block : blocks_)
+    result += block.size;
+  return result;
+}
+
+void Arena::grow(std::size_t bytes) {
+  // doubling, so that a batch only adds a few blocks before they are merged
+  Block block;
+  auto const next = blocks_.empty() ? std::size_t(1) << 16 : 2 * blocks_.back().size;
+  block.size = aligned(std::max(bytes, next));
+  block.data.reset(new char[block.size + alignment]);
+  auto const address = reinterpret_cast<std::uintptr_t>(block.data.get());
+  block.first = block.data.get() + (alignment - address % alignment) % alignment;
+  block.used = 0;
+  blocks_.push_back(std::move(block));
+}
+
+void *Arena::allocate_bytes(std::size_t bytes) {
+  bytes = aligned(std::max<std::size_t>(bytes, 1));
+  if(blocks_.empty() or blocks_.back().size - blocks_.back().used < bytes)
+    grow(bytes);
+  auto &block = blocks_.back();
+  void *const result = block.first + block.used;
+  block.used += bytes;
+  ++live_;
+  return result;
+}
+
+void Arena::deallocate_bytes(void *p, std::size_t bytes) {
+  if(p == nullptr)
+    return;
+  bytes = aligned(std::max<std::size_t>(bytes, 1));
+  auto &block = blocks_.back();
+  // the last allocation is given back at once, the others with the whole batch
+  if(static_cast<char *>(p) + bytes == block.first + block.used)
+    block.used -= bytes;
+  if(--live_ > 0)
+    return;
+  if(blocks_.size() > 1) {
+    auto const size = capacity();
+    blocks_.clear();
+    grow(size);
+  }
+  blocks_.back().used = 0;
+}
+} // namespace optimet
@@ -0,0 +1,109 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_ARENA_H
+#define OPTIMET_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The Arena class hands out the memory of the temporaries of a thread by
+ * bumping an offset into blocks it keeps. Freeing the last allocation moves
+ * the offset back, and the arena starts over once all of its allocations are
+ * freed, i.e. at the end of each batch of points. The blocks are merged into
+ * one as large as the largest batch, so that the kernels stop calling malloc
+ * once the first batches are done.
+ */
+class Arena {
+public:
+  //! Alignment of all the allocations, that of the widest vector registers
+  static constexpr std::size_t alignment = 64;
+
+  Arena() = default;
+  Arena(Arena const &) = delete;
+  Arena &operator=(Arena const &) = delete;
+
+  //! Memory for n values of type T, left uninitialized
+  template <class T> T *allocate(std::size_t n) {
+    return static_cast<T *>(allocate_bytes(n * sizeof(T)));
+  }
+  //! Frees memory from allocate
+  template <class T> void deallocate(T *p, std::size_t n) { deallocate_bytes(p, n * sizeof(T)); }
+
+  //! Bytes held in the blocks
+  std::size_t capacity() const;
+  //! Number of allocations not freed yet
+  std::size_t live() const { return live_; }
+
+private:
+  struct Block {
+    std::unique_ptr<char[]> data; /**< The memory, with room for the alignment. */
+    char *first;                  /**< First aligned byte. */
+    std::size_t size;             /**< Aligned bytes. */
+    std::size_t used;             /**< Bytes handed out, from first. */
+  };
+  //! The blocks, allocations bumping the offset of the last one
+  std::vector<Block> blocks_;
+  std::size_t live_ = 0;
+
+  void *allocate_bytes(std::size_t bytes);
+  void deallocate_bytes(void *p, std::size_t bytes);
+  //! Adds a block of at least bytes
+  void grow(std::size_t bytes);
+};
+
+//! The arena of the calling thread
+inline Arena &thread_arena() {
+  static thread_local Arena arena;
+  return arena;
+}
+
+//! \brief Standard allocator over the arena of the thread creating the container
+//! \details The containers must be freed on the thread which created them, as any OpenMP local.
+template <class T> class ArenaAllocator {
+public:
+  typedef T value_type;
+
+  ArenaAllocator() : arena_(&thread_arena()) {}
+  template <class U> ArenaAllocator(ArenaAllocator<U> const &other) : arena_(other.arena()) {}
+
+  T *allocate(std::size_t n) { return arena_->allocate<T>(n); }
+  void deallocate(T *p, std::size_t n) { arena_->deallocate(p, n); }
+  //! Copies take the memory of the thread copying
+  ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+  Arena *arena() const { return arena_; }
+
+private:
+  Arena *arena_;
+};
+
+template <class T, class U>
+bool operator==(ArenaAllocator<T> const &a, ArenaAllocator<U> const &b) {
+  return a.arena() == b.arena();
+}
+template <class T, class U>
+bool operator!=(ArenaAllocator<T> const &a, ArenaAllocator<U> const &b) {
+  return not(a == b);
+}
+
+//! Vector whose memory comes from the arena of the thread
+template <class T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+} // namespace optimet
+#endif
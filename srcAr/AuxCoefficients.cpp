@@ -18,11 +18,15 @@
 
 #include "constants.h"
 #include "Tools.h"
+#include "RadialTable.h"
 #include "CompoundIterator.h"
+#include "TranslationAdditionCoefficients.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 
 #include <boost/math/special_functions/factorials.hpp>
 
@@ -38,307 +42,353 @@ std::vector<t_real> AuxCoefficients::compute_dn(t_uint nMax) {
   return dn;
 }
 
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Pn(t_uint nMax, const std::vector<t_real> &Wigner) {
-  std::vector<SphericalP<t_complex>> Pn(nMax + 1);
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    Pn[i].rrr = Wigner[i];
-    Pn[i].the = 0.;
-    Pn[i].phi = 0.;
-  }
+std::tuple<std::vector<t_real>, std::vector<t_real>>
+AuxCoefficients::VIGdVIG(t_uint nMax, t_int m, const Spherical<t_real> &R) {
+  assert(std::abs(m) <= nMax);
 
-  return Pn;
-}
+  std::vector<t_real> Wigner(nMax + 1, 0.0), dWigner(nMax + 1, 0.0);
 
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Cn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-                            const std::vector<t_real> &Wigner,
-                            const std::vector<t_real> &dWigner) {
-  std::vector<SphericalP<t_complex>> Cn(nMax + 1);
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    t_real A;
-    if (m == 0){
-      A = 0.0;}
-    else if (std::abs(R.the) < 1e-10 ||
-             (std::abs(R.the) - consPi + 1e-10) > 0.0){
-      A = m / std::cos(R.the) * dWigner[i];
-      }
-    else
-      {A = m / std::sin(R.the) * Wigner[i];
-      }
-      
-  
- 
-    Cn[i].rrr = t_complex(0.0, 0.0);
-    Cn[i].the = t_complex(0.0, A);
-    Cn[i].phi = t_complex(-dWigner[i], 0.0);
-    
-  }
-                       
-   
-  return Cn;
-}
+  // I and II - determine n_min and obtain vig_d_n_min
+  const bool check_m_negative = (m < 0);
+  // vector spherical function index : n_min=max(|l|,|m|), where l == 0
+  const t_uint n_min = static_cast<t_uint>(m = std::abs(m));
+  // wigner function argument : [0<=the<=PI]
+  t_real vig_the = (check_m_negative) ? consPi - R.the : R.the;
+  if((std::abs(R.the) < 1e-10) || (std::abs(R.the) - consPi + 1e-10 > 0.0)){vig_the = vig_the < consPi / 2 ? vig_the + 1e-6 : vig_the - 1e-6;} //prevents Nans in computation of Wigners functions, staying within [0, PI]
+  // wigner function auxiliary variable   : x=cos(the)
+  const t_real vig_x = std::cos(vig_the); // calculate in radians
+  const t_real vig_sine = std::sin(vig_the);
+
+  // d_0m^n = (-1)^m sqrt(4 pi / (2n + 1)) times the normalized Legendre functions, the last one
+  // only being needed for the derivative of n = nMax
+  std::vector<t_real> legendres(nMax + 2 - n_min);
+  legendre(vig_x, vig_sine, m, nMax + 1, legendres.data());
+  const auto wigner = [&](t_uint n) {
+    return n < n_min ? 0.0 :
+                       (m % 2 == 0 ? 1.0 : -1.0) * std::sqrt(4 * consPi / (2 * n + 1)) *
+                           legendres[n - n_min];
+  };
+  for(t_uint n = n_min; n <= nMax; ++n)
+    Wigner[n] = wigner(n);
+
+  // Equation B.26
+  for(t_uint s = std::max<t_uint>(n_min, 1); s <= nMax; ++s)
+    dWigner[s] = ((s * std::sqrt(static_cast<t_real>((s + 1) * (s + 1) - m * m)) * wigner(s + 1)) /
+                      (2 * s + 1) -
+                  ((s + 1) * std::sqrt(static_cast<t_real>(s * s * (s * s - m * m))) *
+                   wigner(s - 1)) /
+                      (s * (2 * s + 1))) /
+                 vig_sine;
 
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Bn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-                            const std::vector<t_real> &Wigner,
-                            const std::vector<t_real> &dWigner) {
-  std::vector<SphericalP<t_complex>> Bn(nMax + 1);
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    t_real A;
-    if (m == 0)
-      A = 0.0;
-    else if (std::abs(R.the) < 1e-10 ||
-             (std::abs(R.the) - consPi + 1e-10) > 0.0)
-      A = m / std::cos(R.the) * dWigner[i];
-    else
-      A = m / std::sin(R.the) * Wigner[i];
-
-    Bn[i].rrr = t_complex(0.0, 0.0);
-    Bn[i].the = t_complex(dWigner[i], 0.0);
-    Bn[i].phi = t_complex(0.0, A);
+  // IV - if (m<0) : apply symmetry property eq(B.7) to eqs(B.22-B.24)
+  if (check_m_negative) {
+    for (t_uint i = 0; i <= nMax; ++i) {
+      const t_real c = 1.0 / std::pow(-1.0, i);
+      Wigner[i] *= c;   // obtain final VIG_d
+      dWigner[i] *= -c; // obtain final VIG_d
+    }
   }
 
-  return Bn;
+  return std::make_tuple(Wigner, dWigner);
 }
 
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Mn(t_uint nMax, t_int m, const Spherical<t_real> &R,
-                            t_complex waveK, const std::vector<t_real> &dn,
-                            const std::vector<SphericalP<t_complex>> &Cn,
-                            BESSEL_TYPE besselType) {
-  std::vector<SphericalP<t_complex>> Mn(nMax + 1);
+namespace {
+//! Whether the direction of sine st of the polar angle is within 1e-10 of a pole
+bool at_pole(t_real st) { return st < 1e-10; }
 
-  std::vector<t_complex> data, ddata;
-  std::tie(data, ddata) = optimet::bessel(R.rrr * waveK, besselType, 0, nMax);
+//! \brief The Wigner functions and their derivatives of all the points, as VIGdVIG
+//! \details W and dW hold nMax + 1 rows of N points, from the cosines ct and sines st of their
+//! polar angles, x and sine are work arrays.
+void VIGdVIG(t_uint nMax, t_int m, t_uint N, const t_real *ct, const t_real *st, t_real *W,
+             t_real *dW, t_real *x, t_real *sine) {
+  std::fill(W, W + (nMax + 1) * N, 0.0);
+  std::fill(dW, dW + (nMax + 1) * N, 0.0);
 
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
+  const bool check_m_negative = (m < 0);
+  const t_uint n_min = static_cast<t_uint>(m = std::abs(m));
+  // the functions of pi - theta for m < 0, and 1e-6 away from the poles, which prevents Nans in
+  // the computation of Wigners functions while staying within [0, PI] so that the sine keeps its
+  // sign
+  const t_real sign = check_m_negative ? -1.0 : 1.0;
+  const t_real x_pole = std::cos(1e-6), sine_pole = std::sin(1e-6);
+  for(t_uint j = 0; j < N; ++j) {
+    x[j] = sign * (at_pole(st[j]) ? std::copysign(x_pole, ct[j]) : ct[j]);
+    sine[j] = at_pole(st[j]) ? sine_pole : st[j];
+  }
 
-  for (t_uint i = 0; i <= nMax; ++i) {
-    const t_complex c_temp = dm * dn[i] * exp_imphi;
+  using boost::math::factorial;
+  const t_real c_min = std::pow(2.0, -m) *
+                       (std::sqrt(factorial<t_real>(2 * static_cast<unsigned int>(m))) /
+                        factorial<t_real>(static_cast<unsigned int>(m)));
+  // sin^m rather than (1 - x^2)^(m / 2), which loses digits near the poles
+  for(t_uint j = 0; j < N; ++j)
+    W[n_min * N + j] = c_min * std::pow(sine[j], m);
 
-    Mn[i].rrr = c_temp * data[i] * Cn[i].rrr;
-    Mn[i].the = c_temp * data[i] * Cn[i].the;
-    Mn[i].phi = c_temp * data[i] * Cn[i].phi;
+  t_uint s = n_min;
+  if(n_min == 0 && nMax > 0) {
+    for(t_uint j = 0; j < N; ++j)
+      W[N + j] = x[j] * W[j];
+    s = 1;
+  }
+  // Equations B.22 and B.26, the last W[nMax + 1] only being needed for dW[nMax]
+  ArenaVector<t_real> last(N);
+  for(; nMax > 0 && s <= nMax; ++s) {
+    const t_real a = std::sqrt(static_cast<t_real>(s * s - m * m));
+    const t_real b = std::sqrt(static_cast<t_real>((s + 1) * (s + 1) - m * m));
+    const t_real c_next = s * b;
+    const t_real c_prev = (s + 1) * std::sqrt(static_cast<t_real>(s * s * (s * s - m * m)));
+    t_real *const next = s < nMax ? W + (s + 1) * N : last.data();
+    const t_real *const Ws = W + s * N;
+    const t_real *const Wp = W + (s - 1) * N;
+    t_real *const dWs = dW + s * N;
+    for(t_uint j = 0; j < N; ++j) {
+      next[j] = ((2 * s + 1) * x[j] * Ws[j] - a * Wp[j]) / b;
+      dWs[j] = ((c_next * next[j]) / (2 * s + 1) - (c_prev * Wp[j]) / (s * (2 * s + 1))) / sine[j];
+    }
   }
 
-  return Mn;
+  // IV - if (m<0) : apply symmetry property eq(B.7) to eqs(B.22-B.24)
+  if(check_m_negative)
+    for(t_uint i = 0; i <= nMax; ++i) {
+      const t_real c = 1.0 / std::pow(-1.0, i);
+      for(t_uint j = 0; j < N; ++j) {
+        W[i * N + j] *= c;
+        dW[i * N + j] *= -c;
+      }
+    }
 }
 
-
-
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Xm1(t_uint nMax, t_int m, const 
-Spherical<t_real> &R, t_complex waveK, const std::vector<t_real> &dn,
- const std::vector<SphericalP<t_complex>> &Pn, BESSEL_TYPE besselType) {
-                            
-  std::vector<SphericalP<t_complex>> Xm1(nMax + 1);
-
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    const t_complex c_temp = dm * dn[i] * std::sqrt(i * (i + 1)) * exp_imphi;
-
-    Xm1[i].rrr = c_temp  * Pn[i].rrr;
-    Xm1[i].the = c_temp  * Pn[i].the;
-    Xm1[i].phi = c_temp  * Pn[i].phi;
+//! Stores the projection of spherical components (r, theta, phi) at point j
+template <class REAL>
+inline void project(REAL *out, t_uint N, t_uint j, REAL st, REAL ct, REAL sp, REAL cp, REAL rr,
+                    REAL ri, REAL tr, REAL ti, REAL pr, REAL pi) {
+  out[j] = st * cp * rr + ct * cp * tr - sp * pr;
+  out[N + j] = st * cp * ri + ct * cp * ti - sp * pi;
+  out[2 * N + j] = st * sp * rr + ct * sp * tr + cp * pr;
+  out[3 * N + j] = st * sp * ri + ct * sp * ti + cp * pi;
+  out[4 * N + j] = ct * rr - st * tr;
+  out[5 * N + j] = ct * ri - st * ti;
+}
+} // namespace
+
+AuxAngular::AuxAngular(const std::vector<Spherical<t_real>> &R, t_uint nMax)
+    : r_(R.size()), nMax_(nMax), st_(R.size()), ct_(R.size()), sp_(R.size()), cp_(R.size()) {
+  for(t_uint j = 0; j < R.size(); ++j) {
+    r_[j] = R[j].rrr;
+    st_[j] = std::sin(R[j].the);
+    ct_[j] = std::cos(R[j].the);
+    sp_[j] = std::sin(R[j].phi);
+    cp_[j] = std::cos(R[j].phi);
   }
-
-  return Xm1;
+  tabulate();
 }
 
-
-std::vector<SphericalP<t_complex>>
-AuxCoefficients::compute_Xp1(t_uint nMax, t_int m, const 
-Spherical<t_real> &R, t_complex waveK, const std::vector<t_real> &dn,
-const std::vector<SphericalP<t_complex>> &Bn,
-BESSEL_TYPE besselType) {
-                            
-  std::vector<SphericalP<t_complex>> Xp1(nMax + 1);
-
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
-
-  for (t_uint i = 0; i <= nMax; ++i) {
-    const t_complex c_temp = dm * dn[i] * exp_imphi;
-
-    Xp1[i].rrr = c_temp  * Bn[i].rrr;
-    Xp1[i].the = c_temp  * Bn[i].the;
-    Xp1[i].phi = c_temp  * Bn[i].phi;
+AuxAngular::AuxAngular(const std::vector<Cartesian<t_real>> &X, const Cartesian<t_real> &center,
+                       t_uint nMax)
+    : r_(X.size()), nMax_(nMax), st_(X.size()), ct_(X.size()), sp_(X.size()), cp_(X.size()) {
+  // the directions of the offsets to the center without their angles, the origin and the
+  // points of the axis having theta = phi = 0 as in Tools::toSpherical
+  for(t_uint j = 0; j < X.size(); ++j) {
+    t_real const x = X[j].x - center.x, y = X[j].y - center.y, z = X[j].z - center.z;
+    t_real const rho = std::sqrt(x * x + y * y);
+    r_[j] = std::sqrt(rho * rho + z * z);
+    st_[j] = r_[j] > 0 ? rho / r_[j] : 0.0;
+    ct_[j] = r_[j] > 0 ? z / r_[j] : 1.0;
+    sp_[j] = rho > 0 ? y / rho : 0.0;
+    cp_[j] = rho > 0 ? x / rho : 1.0;
   }
-
-  return Xp1;
+  tabulate();
 }
 
-
-
-std::vector<SphericalP<t_complex>> AuxCoefficients::compute_Nn(
-    t_uint nMax, t_int m, const Spherical<t_real> &R, t_complex waveK,
-    const std::vector<t_real> &dn, const std::vector<SphericalP<t_complex>> &Pn,
-    const std::vector<SphericalP<t_complex>> &Bn, BESSEL_TYPE besselType) {
-  std::vector<SphericalP<t_complex>> Nn(nMax + 1);
-
-  const t_complex Kr = waveK * R.rrr;
-
-  std::vector<t_complex> data, ddata;
-  std::tie(data, ddata) = optimet::bessel(R.rrr * waveK, besselType, 0, nMax);
-
-  const t_real dm = std::pow(-1.0, m); // Legendre to Wigner function
-  const t_complex exp_imphi(std::cos(m * R.phi), std::sin(m * R.phi));
-
-  Nn[0].rrr = t_complex(0.0, 0.0);
-  Nn[0].the = t_complex(0.0, 0.0);
-  Nn[0].phi = t_complex(0.0, 0.0);
-
-  for (t_uint i = 1; i <= nMax; ++i) {
-    Nn[i].rrr = (1.0 / Kr) * dm * dn[i] *
-                ((static_cast<t_real>(i * (i + 1)) * data[i] * Pn[i].rrr) +
-                 ((Kr * ddata[i] + data[i]) * Bn[i].rrr)) *
-                exp_imphi;
-    Nn[i].the = (1.0 / Kr) * dm * dn[i] *
-                ((static_cast<t_real>(i * (i + 1)) * data[i] * Pn[i].the) +
-                 ((Kr * ddata[i] + data[i]) * Bn[i].the)) *
-                exp_imphi;
-    Nn[i].phi = (1.0 / Kr) * dm * dn[i] *
-                ((static_cast<t_real>(i * (i + 1)) * data[i] * Pn[i].phi) +
-                 ((Kr * ddata[i] + data[i]) * Bn[i].phi)) *
-                exp_imphi;
+void AuxAngular::tabulate() {
+  t_uint const N = r_.size();
+  exp_.resize(2 * (2 * nMax_ + 1) * N);
+  wigner_.resize(3 * Tools::iteratorMax(nMax_) * N);
+
+  // exp(i m phi) by products of exp(i phi) upwards from m = 0, and their conjugates for m < 0
+  t_real *const e0 = &exp_[2 * nMax_ * N];
+  std::fill(e0, e0 + N, 1.0);
+  std::fill(e0 + N, e0 + 2 * N, 0.0);
+  for(t_uint m = 1; m <= nMax_; ++m) {
+    t_real const *const pr = &exp_[2 * (m - 1 + nMax_) * N];
+    t_real const *const pi = pr + N;
+    t_real *const er = &exp_[2 * (m + nMax_) * N];
+    t_real *const ei = er + N;
+    t_real *const cr = &exp_[2 * (nMax_ - m) * N];
+    t_real *const ci = cr + N;
+    for(t_uint j = 0; j < N; ++j) {
+      er[j] = pr[j] * cp_[j] - pi[j] * sp_[j];
+      ei[j] = pr[j] * sp_[j] + pi[j] * cp_[j];
+      cr[j] = er[j];
+      ci[j] = -ei[j];
+    }
   }
 
-  return Nn;
+  ArenaVector<t_real> W((nMax_ + 1) * N), dW((nMax_ + 1) * N), x(N), sine(N);
+  for(t_int m = -static_cast<t_int>(nMax_); m <= static_cast<t_int>(nMax_); ++m) {
+    VIGdVIG(nMax_, m, N, ct_.data(), st_.data(), W.data(), dW.data(), x.data(), sine.data());
+
+    for(t_uint n = std::max<t_uint>(std::abs(m), 1); n <= nMax_; ++n) {
+      const t_uint i = CompoundIterator(n, m);
+      t_real *const Wi = &wigner_[3 * i * N];
+      t_real *const dWi = Wi + N;
+      t_real *const Ai = Wi + 2 * N;
+      for(t_uint j = 0; j < N; ++j) {
+        Wi[j] = W[n * N + j];
+        dWi[j] = dW[n * N + j];
+        Ai[j] = m == 0 ? 0.0 : at_pole(st_[j]) ? m / ct_[j] * dWi[j] : m / st_[j] * Wi[j];
+      }
+    }
+  }
 }
 
-std::tuple<std::vector<t_real>, std::vector<t_real>>
-AuxCoefficients::VIGdVIG(t_uint nMax, t_int m, const Spherical<t_real> &R) {
-  assert(std::abs(m) <= nMax);
-
-  std::vector<t_real> Wigner(nMax + 1, 0.0), dWigner(nMax + 1, 0.0);
-
-  // I and II - determine n_min and obtain vig_d_n_min
-  const bool check_m_negative = (m < 0);
-  // vector spherical function index : n_min=max(|l|,|m|), where l == 0
-  const t_uint n_min = static_cast<t_uint>(m = std::abs(m));
-  // wigner function argument : [0<=the<=PI]
-  t_real vig_the = (check_m_negative) ? consPi - R.the : R.the;
-  if((std::abs(R.the) < 1e-10) || (std::abs(R.the) - consPi + 1e-10 > 0.0)){vig_the = vig_the + 1e-6;} //prevents Nans in computation of Wigners functions
-  // wigner function auxiliary variable   : x=cos(the)
-  const t_real vig_x = std::cos(vig_the); // calculate in radians
-
-  // obtain the readily availble VIG_d[n_min] value
-  using boost::math::factorial;
-  Wigner[n_min] =
-      std::pow(2.0, -m) *
-      (std::sqrt(factorial<t_real>(2 * static_cast<unsigned int>(m))) /
-       factorial<t_real>(static_cast<unsigned int>(m))) *
-      std::pow(1.0 - vig_x, m / 2.0) *
-      std::pow(1.0 + vig_x, m / 2.0); // by definition
-
-  // obtain all other values in VIG_d[i] from recursive relationship
-  //   - Based on 'n_min' value and 'n' value; total recursive steps == n -
-  //   n_min
-  t_uint s = n_min;
-  if (n_min == 0 && nMax > 0) {
-    // When n_min == 0 recursion depends on current value only - including
-    // previous value results in out-of-bounds read, which shouldn't matter as
-    // it gets multiplied by zero, but if the out-of-bounds read happens to be
-    // NaN then it will propagate (n_min == |m| == s)
-    Wigner[1] = vig_x * Wigner[0];
-    s = 1;
-  }
-  for (; s < nMax; ++s) {
-    // Equation B.22
-    Wigner[s + 1] = ((2 * s + 1) * vig_x * Wigner[s] -
-                     std::sqrt(s * s - m * m) * Wigner[s - 1]) /
-                    std::sqrt((s + 1) * (s + 1) - m * m);
-    // Equation B.26
-    dWigner[s] =
-        (((s * std::sqrt((s + 1) * (s + 1) - m * m) * Wigner[s + 1]) /
-          (2 * s + 1)) -
-         (((s + 1) * std::sqrt(s * s * (s * s - m * m)) * Wigner[s - 1]) /
-          (s * (2 * s + 1)))) /
-        std::sin(vig_the);
-
-        
+template <class REAL>
+BasicAuxCoefficientsBatch<REAL>::BasicAuxCoefficientsBatch(const std::vector<Spherical<t_real>> &R,
+                                                           t_complex waveK, bool regular,
+                                                           t_uint nMax)
+    : BasicAuxCoefficientsBatch(AuxAngular(R, nMax), 0, R.size(), waveK, regular, nMax) {}
+
+template <class REAL>
+BasicAuxCoefficientsBatch<REAL>::BasicAuxCoefficientsBatch(const AuxAngular &angular,
+                                                           t_uint first, t_uint last,
+                                                           t_complex waveK, bool regular,
+                                                           t_uint nMax,
+                                                           const RadialTable *radial)
+    : points_(last - first), pMax_(Tools::iteratorMax(nMax)),
+      values_(6 * 3 * 2 * Tools::iteratorMax(nMax) * (last - first), 0.0) {
+  if(nMax > angular.nMax())
+    throw std::runtime_error("The angular functions do not reach the requested nMax");
+  t_uint const N = points_;
+  t_uint const stride = angular.points();
+  // the temporaries of the points come from the arena of the thread, as the values
+  ArenaVector<t_real> dn(nMax + 1, -1000);
+  for(t_uint n = 1; n <= nMax; ++n)
+    dn[n] = std::sqrt((2.0 * n + 1.0) / (4.0 * consPi * (n * (n + 1))));
+
+  // by order and point: z_n(kr), (kr z_n'(kr) + z_n(kr)) / kr and z_n(kr) / kr, computed in
+  // double precision and rounded to that of the batch
+  ArenaVector<REAL> zr((nMax + 1) * N), zi((nMax + 1) * N);
+  ArenaVector<REAL> dzr((nMax + 1) * N), dzi((nMax + 1) * N);
+  ArenaVector<REAL> fzr((nMax + 1) * N), fzi((nMax + 1) * N);
+  ArenaVector<t_complex> Kr(N), bessels((nMax + 1) * N), dbessels((nMax + 1) * N);
+  for(t_uint j = 0; j < N; ++j)
+    Kr[j] = waveK * angular.r_[first + j];
+  auto const batch = [regular, nMax](t_complex const *z, t_uint count, t_complex *f,
+                                     t_complex *df) {
+    return regular ? bessel_batch<Bessel>(z, count, nMax, f, df) :
+                     bessel_batch<Hankel1>(z, count, nMax, f, df);
+  };
+  std::vector<BesselFailure> failures;
+  if(not radial)
+    failures = batch(Kr.data(), N, bessels.data(), dbessels.data());
+  else {
+    if(radial->type() != (regular ? Bessel : Hankel1) or radial->waveK() != waveK)
+      throw std::runtime_error("The radial table is not that of the functions of the batch");
+    // the distances the table covers are interpolated, the others computed
+    ArenaVector<t_real> r(N);
+    for(t_uint j = 0; j < N; ++j)
+      r[j] = angular.r_[first + j];
+    auto const misses = (*radial)(r.data(), N, nMax, bessels.data(), dbessels.data());
+    t_uint const M = misses.size();
+    if(M > 0) {
+      ArenaVector<t_complex> z(M), f((nMax + 1) * M), df((nMax + 1) * M);
+      for(t_uint j = 0; j < M; ++j)
+        z[j] = Kr[misses[j]];
+      failures = batch(z.data(), M, f.data(), df.data());
+      for(auto &failure : failures)
+        failure.index = misses[failure.index];
+      for(t_uint n = 0; n <= nMax; ++n)
+        for(t_uint j = 0; j < M; ++j) {
+          bessels[n * N + misses[j]] = f[n * M + j];
+          dbessels[n * N + misses[j]] = df[n * M + j];
+        }
+    }
   }
-  if (nMax > 0) {
-    // Calculate the final term in the dWigner recursion
-    const double Wn_max = ((2 * nMax + 1) * vig_x * Wigner[nMax] -
-                           std::sqrt(nMax * nMax - m * m) * Wigner[nMax - 1]) /
-                          std::sqrt((nMax + 1) * (nMax + 1) - m * m);
-    dWigner[nMax] =
-        (((nMax * std::sqrt((nMax + 1) * (nMax + 1) - m * m) * Wn_max) / (2 * nMax + 1)) -
-         (((nMax + 1) * std::sqrt(nMax * nMax * (nMax * nMax - m * m)) * Wigner[nMax - 1]) /
-          (nMax * (2 * nMax + 1)))) /
-        std::sin(vig_the);
+  if(not failures.empty())
+    throw std::runtime_error(failures.front().message + " at " +
+                             std::to_string(failures.size()) + " points, the first being point " +
+                             std::to_string(first + failures.front().index));
+  for(t_uint j = 0; j < N; ++j) {
+    for(t_uint n = 0; n <= nMax; ++n) {
+      const t_complex z = bessels[n * N + j];
+      const t_complex dz = (Kr[j] * dbessels[n * N + j] + z) / Kr[j];
+      const t_complex fz = z / Kr[j];
+      zr[n * N + j] = z.real();
+      zi[n * N + j] = z.imag();
+      dzr[n * N + j] = dz.real();
+      dzi[n * N + j] = dz.imag();
+      fzr[n * N + j] = fz.real();
+      fzi[n * N + j] = fz.imag();
+    }
   }
 
-  // IV - if (m<0) : apply symmetry property eq(B.7) to eqs(B.22-B.24)
-  if (check_m_negative) {
-    for (t_uint i = 0; i <= nMax; ++i) {
-      const t_real c = 1.0 / std::pow(-1.0, i);
-      Wigner[i] *= c;   // obtain final VIG_d
-      dWigner[i] *= -c; // obtain final VIG_d
+  const t_real *const st = &angular.st_[first], *const ct = &angular.ct_[first];
+  const t_real *const sp = &angular.sp_[first], *const cp = &angular.cp_[first];
+  for(t_int m = -static_cast<t_int>(nMax); m <= static_cast<t_int>(nMax); ++m) {
+    const REAL dm = std::pow(-1.0, m); // Legendre to Wigner function
+    const t_real *const er = &angular.exp_[2 * (m + angular.nMax()) * stride + first];
+    const t_real *const ei = er + stride;
+
+    for(t_uint n = std::max<t_uint>(std::abs(m), 1); n <= nMax; ++n) {
+      const t_uint i = CompoundIterator(n, m);
+      const REAL a = dm * dn[n];
+      const REAL nn = n * (n + 1);
+      const REAL sn = std::sqrt(nn);
+      const t_real *const Wn = &angular.wigner_[3 * i * stride + first];
+      const t_real *const dWn = Wn + stride;
+      const t_real *const An = Wn + 2 * stride;
+      const REAL *const znr = &zr[n * N], *const zni = &zi[n * N];
+      const REAL *const dznr = &dzr[n * N], *const dzni = &dzi[n * N];
+      const REAL *const fznr = &fzr[n * N], *const fzni = &fzi[n * N];
+      REAL *const outM = data(M_, 0, i), *const outN = data(N_, 0, i);
+      REAL *const outB = data(B_, 0, i), *const outC = data(C_, 0, i);
+      REAL *const outXp = data(Xp_, 0, i), *const outXm = data(Xm_, 0, i);
+
+      for(t_uint j = 0; j < N; ++j) {
+        // the angular parts at the precision of the batch
+        const REAL A = An[j], dWj = dWn[j], W = Wn[j];
+        const REAL stj = st[j], ctj = ct[j], spj = sp[j], cpj = cp[j];
+        // a exp(i m phi)
+        const REAL gr = a * static_cast<REAL>(er[j]), gi = a * static_cast<REAL>(ei[j]);
+        // Bn = (0, dW, i A) and Cn = (0, i A, -dW)
+        project<REAL>(outB, N, j, stj, ctj, spj, cpj, 0, 0, dWj, 0, 0, A);
+        project<REAL>(outC, N, j, stj, ctj, spj, cpj, 0, 0, 0, A, -dWj, 0);
+        // Mn = a exp(i m phi) z_n Cn
+        const REAL hr = gr * znr[j] - gi * zni[j], hi = gr * zni[j] + gi * znr[j];
+        project<REAL>(outM, N, j, stj, ctj, spj, cpj, 0, 0, -hi * A, hr * A, -hr * dWj,
+                      -hi * dWj);
+        // Xm1 = a sqrt(n (n + 1)) exp(i m phi) Pn and Xp1 = a exp(i m phi) Bn
+        project<REAL>(outXm, N, j, stj, ctj, spj, cpj, sn * gr * W, sn * gi * W, 0, 0,
+                      0, 0);
+        project<REAL>(outXp, N, j, stj, ctj, spj, cpj, 0, 0, gr * dWj, gi * dWj, -gi * A,
+                      gr * A);
+        // Nn = a exp(i m phi) (n (n + 1) z_n / kr Pn + (kr z_n' + z_n) / kr Bn)
+        const REAL fr = gr * fznr[j] - gi * fzni[j], fi = gr * fzni[j] + gi * fznr[j];
+        const REAL kr = gr * dznr[j] - gi * dzni[j], ki = gr * dzni[j] + gi * dznr[j];
+        project<REAL>(outN, N, j, stj, ctj, spj, cpj, nn * fr * W, nn * fi * W,
+                      kr * dWj, ki * dWj, -ki * A, kr * A);
+      }
     }
   }
-
-  return std::make_tuple(Wigner, dWigner);
 }
 
+template class BasicAuxCoefficientsBatch<t_real>;
+template class BasicAuxCoefficientsBatch<float>;
+
 AuxCoefficients::AuxCoefficients(const Spherical<t_real> &R, t_complex waveK,
                                  bool regular, t_uint nMax)
     : _M(Tools::iteratorMax(nMax)), _Xp(Tools::iteratorMax(nMax)), 
       _Xm(Tools::iteratorMax(nMax)), _N(Tools::iteratorMax(nMax)),
       _B(Tools::iteratorMax(nMax)), _C(Tools::iteratorMax(nMax)),
       _dn(compute_dn(nMax)) {
-
-
-  const BESSEL_TYPE besselType = (regular) ? Bessel : Hankel1;
-
-  for (CompoundIterator q(nMax, nMax); q < q.max(nMax); ++q) {
-
-    // Wigner d function test
-    std::vector<t_real> Wigner, dWigner;
-    std::tie(Wigner, dWigner) = VIGdVIG(nMax, q.second, R);
-
-    // call vector spherical functions
-
-    const std::vector<SphericalP<t_complex>> Pn = compute_Pn(nMax, Wigner);
-    const std::vector<SphericalP<t_complex>> Cn =
-        compute_Cn(nMax, q.second, R, Wigner, dWigner);
-                      
-    const std::vector<SphericalP<t_complex>> Bn =
-        compute_Bn(nMax, q.second, R, Wigner, dWigner);
-
-    // call vector spherical waves
-    const std::vector<SphericalP<t_complex>> Mn =
-        compute_Mn(nMax, q.second, R, waveK, _dn, Cn, besselType);
-    const std::vector<SphericalP<t_complex>> Nn =
-        compute_Nn(nMax, q.second, R, waveK, _dn, Pn, Bn, besselType);
-     const std::vector<SphericalP<t_complex>> Xm1 =
-        compute_Xm1(nMax, q.second, R, waveK, _dn, Pn, besselType); 
-     const std::vector<SphericalP<t_complex>> Xp1 =
-        compute_Xp1(nMax, q.second, R, waveK, _dn, Bn, besselType);     
-        
-
-    for (t_uint n = static_cast<t_uint>(std::abs(q.second)); n <= nMax; ++n) {
-      if (n != 0) {
-        CompoundIterator p(n, q.second);
-
-        _B[static_cast<t_uint>(p)] = Tools::toProjection(R, Bn[n]);
-        _C[static_cast<t_uint>(p)] = Tools::toProjection(R, Cn[n]);
-        _M[static_cast<t_uint>(p)] = Tools::toProjection(R, Mn[n]);
-        _Xm[static_cast<t_uint>(p)] = Tools::toProjection(R, Xm1[n]);
-        _Xp[static_cast<t_uint>(p)] = Tools::toProjection(R, Xp1[n]);
-        _N[static_cast<t_uint>(p)] = Tools::toProjection(R, Nn[n]);
-        
-       
-      }
-    }
+  const AuxCoefficientsBatch batch(std::vector<Spherical<t_real>>(1, R), waveK, regular, nMax);
+  for (t_uint i = 0; i < _M.size(); ++i) {
+    _B[i] = batch.B(i, 0);
+    _C[i] = batch.C(i, 0);
+    _M[i] = batch.M(i, 0);
+    _Xm[i] = batch.Xm(i, 0);
+    _Xp[i] = batch.Xp(i, 0);
+    _N[i] = batch.N(i, 0);
   }
 }
 
@@ -0,0 +1,102 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "AxialSymmetry.h"
+#include "Tools.h"
+#include <cmath>
+
+namespace optimet {
+bool AxialSymmetry::detect(Geometry const &geometry, t_uint nMax) {
+  if(not geometry.get_periodic().empty())
+    return false;
+  t_real extent = 0;
+  for(auto const &object : geometry.objects)
+    extent = std::max(extent, object.vR.rrr + object.radius);
+  for(auto const &object : geometry.objects) {
+    auto const R = Tools::toCartesian(object.vR);
+    if(std::sqrt(R.x * R.x + R.y * R.y) > 1e-9 * extent)
+      return false;
+    // the orders m and m' of the T-matrix of a shape invariant under k rotations differ by
+    // multiples of k, and are equal for a body of revolution
+    if(object.kind() == Scatterer::sphere)
+      continue;
+    if(object.kind() != Scatterer::arbitrary_shape or
+       (object.getContour() == 0 and static_cast<t_uint>(object.getNOrotations()) <= 2 * nMax) or
+       std::abs(std::sin(object.orientation[1])) > 1e-9)
+      return false;
+  }
+  return true;
+}
+
+std::vector<t_uint> AxialSymmetry::indices(t_int m) const {
+  t_uint const pMax = nMax_ * (nMax_ + 2);
+  std::vector<t_uint> result;
+  for(t_uint n = std::max<t_int>(std::abs(m), 1); n <= nMax_; ++n)
+    result.push_back(n * (n + 1) + m - 1);
+  auto const half = result.size();
+  for(t_uint i = 0; i < half; ++i)
+    result.push_back(result[i] + pMax);
+  return result;
+}
+
+Matrix<t_complex> AxialSymmetry::solve(Matrix<t_complex> const &Y, PairBlock const &block) {
+  t_uint const n = 2 * nMax_ * (nMax_ + 2);
+  // the orders whose sources are not negligible
+  t_real const threshold = 1e-12 * Y.norm();
+  std::vector<t_int> orders;
+  for(t_int m = -static_cast<t_int>(nMax_); m <= static_cast<t_int>(nMax_); ++m) {
+    t_real norm = 0;
+    for(t_uint ii = 0; ii < nobj_; ++ii)
+      for(auto const row : indices(m))
+        norm += Y.row(ii * n + row).squaredNorm();
+    if(std::sqrt(norm) > threshold)
+      orders.push_back(m);
+  }
+
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(Y.rows(), Y.cols());
+  for(t_uint k = communicator_.rank(); k < orders.size(); k += communicator_.size()) {
+    auto const m = orders[k];
+    auto const rows = indices(m);
+    t_uint const c = rows.size();
+    auto factors = factors_.find(m);
+    if(factors == factors_.end()) {
+      // the coefficients of order m of all the scatterers, one after the other
+      Matrix<t_complex> S(nobj_ * c, nobj_ * c);
+      for(t_uint ii = 0; ii < nobj_; ++ii)
+        for(t_uint jj = 0; jj < nobj_; ++jj) {
+          Matrix<t_complex> const B = block(ii, jj);
+          for(t_uint a = 0; a < c; ++a)
+            for(t_uint b = 0; b < c; ++b)
+              S(ii * c + a, jj * c + b) = B(rows[a], rows[b]);
+        }
+      factors = factors_.emplace(m, S.partialPivLu()).first;
+    }
+    Matrix<t_complex> Ym(nobj_ * c, Y.cols());
+    for(t_uint ii = 0; ii < nobj_; ++ii)
+      for(t_uint a = 0; a < c; ++a)
+        Ym.row(ii * c + a) = Y.row(ii * n + rows[a]);
+    Matrix<t_complex> const Xm = factors->second.solve(Ym);
+    for(t_uint ii = 0; ii < nobj_; ++ii)
+      for(t_uint a = 0; a < c; ++a)
+        result.row(ii * n + rows[a]) = Xm.row(ii * c + a);
+  }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *communicator_);
+#endif
+  return result;
+}
+}
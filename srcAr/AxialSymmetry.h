@@ -0,0 +1,77 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_AXIAL_SYMMETRY_H
+#define OPTIMET_AXIAL_SYMMETRY_H
+
+#include "Geometry.h"
+#include "Types.h"
+#include "mpi/Communicator.h"
+#include <Eigen/LU>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The AxialSymmetry class solves the scattering matrix of particles on the z axis, each invariant
+ * under the rotations about it, e.g. a chain of spheres or of spheroids standing along z. The
+ * couplings along the axis and the T-matrices then keep the azimuthal order m: the system splits
+ * into one matrix per m, holding only the coefficients of that order of all the particles. Only the
+ * orders with sources are assembled and factorised, shared out between the processes, e.g. m = 1
+ * and m = -1 for a plane wave along z.
+ */
+class AxialSymmetry {
+public:
+  //! Block of the scattering matrix coupling object ii to object jj
+  typedef std::function<Matrix<t_complex>(t_uint ii, t_uint jj)> PairBlock;
+
+  /**
+   * Constructor.
+   * @param nobj the number of scatterers.
+   * @param nMax the harmonics of the blocks.
+   * @param communicator the processes sharing the orders out.
+   */
+  AxialSymmetry(t_uint nobj, t_uint nMax,
+                mpi::Communicator const &communicator = mpi::Communicator())
+      : nobj_(nobj), nMax_(nMax), communicator_(communicator) {}
+
+  //! \brief Whether the objects lie on the z axis and keep the orders m up to nMax
+  //! \details Spheres, bodies of revolution and meshes invariant under more than 2 nMax rotations,
+  //! their axis standing along z. Never for a periodic array.
+  static bool detect(Geometry const &geometry, t_uint nMax);
+
+  //! \brief Solves S X = Y for the columns of Y
+  //! \details The orders with sources are factorised on first use from the blocks, and kept for
+  //! the next solves. Collective, the result being known on all the processes.
+  Matrix<t_complex> solve(Matrix<t_complex> const &Y, PairBlock const &block);
+
+protected:
+  //! The number of scatterers
+  t_uint nobj_;
+  //! The maximum value of the n iterator
+  t_uint nMax_;
+  //! The communicator sharing the orders
+  mpi::Communicator communicator_;
+  //! The factorised matrices of the orders of this process
+  std::map<t_int, Eigen::PartialPivLU<Matrix<t_complex>>> factors_;
+
+  //! The rows of order m of one scatterer, M then N
+  std::vector<t_uint> indices(t_int m) const;
+};
+}
+#endif
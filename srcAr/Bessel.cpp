@@ -0,0 +1,283 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Bessel.h"
+#include "Types.h"
+#include <algorithm>
+#include <exception>
+
+namespace optimet {
+namespace {
+//! Number of arguments whose recurrences run together
+constexpr std::size_t chunk = 64;
+
+//! \brief The buffers of a chunk of arguments, reused from one chunk to the next
+//! \details The functions are kept by order and argument, real and imaginary parts apart.
+struct BesselChunk {
+  std::size_t size;                         /**< The number of arguments. */
+  std::vector<t_real> zr, zi, ir, ii;       /**< The arguments and their inverses. */
+  std::vector<t_real> fr, fi;               /**< The functions. */
+  std::vector<t_real> jr, ji;               /**< The Bessel functions of the Hankel functions. */
+  std::vector<t_real> ar, ai, cr, ci;       /**< Two consecutive orders of the recurrences. */
+  std::vector<char> scalar;                 /**< The arguments left to bessel. */
+};
+
+//! \brief j_0 to j_n of the arguments of a chunk by Miller's backward recurrence
+//! \details As details::spherical_bessel, starting from the largest order any argument needs.
+//! The arguments whose functions overflow are left to bessel.
+void miller(BesselChunk &c, long int n, t_real *jr, t_real *ji) {
+  auto const P = c.size;
+  double top = n;
+  for(std::size_t p = 0; p < P; ++p)
+    if(not c.scalar[p])
+      top = std::max(top, std::abs(t_complex(c.zr[p], c.zi[p])));
+  long int const start = static_cast<long int>(top + 16 + 8 * std::cbrt(top));
+  double const big = 1e150, big2 = big * big;
+  std::fill(c.ar.begin(), c.ar.begin() + P, 0e0);
+  std::fill(c.ai.begin(), c.ai.begin() + P, 0e0);
+  std::fill(c.cr.begin(), c.cr.begin() + P, 1e0);
+  std::fill(c.ci.begin(), c.ci.begin() + P, 0e0);
+  t_real *const ar = c.ar.data(), *const ai = c.ai.data();
+  t_real *const cr = c.cr.data(), *const ci = c.ci.data();
+  t_real const *const ir = c.ir.data(), *const ii = c.ii.data();
+  for(long int k = start; k > 0; --k) {
+    t_real const t = 2 * k + 1;
+    bool large = false;
+    for(std::size_t p = 0; p < P; ++p) {
+      t_real const br = t * (ir[p] * cr[p] - ii[p] * ci[p]) - ar[p];
+      t_real const bi = t * (ir[p] * ci[p] + ii[p] * cr[p]) - ai[p];
+      ar[p] = cr[p];
+      ai[p] = ci[p];
+      cr[p] = br;
+      ci[p] = bi;
+      large |= br * br + bi * bi > big2;
+    }
+    if(k <= n + 1)
+      for(std::size_t p = 0; p < P; ++p) {
+        jr[(k - 1) * P + p] = cr[p];
+        ji[(k - 1) * P + p] = ci[p];
+      }
+    if(large)
+      for(std::size_t p = 0; p < P; ++p) {
+        if(not(cr[p] * cr[p] + ci[p] * ci[p] > big2))
+          continue;
+        ar[p] /= big;
+        ai[p] /= big;
+        cr[p] /= big;
+        ci[p] /= big;
+        if(k <= n + 1)
+          for(long int i = k - 1; i <= n; ++i) {
+            jr[i * P + p] /= big;
+            ji[i * P + p] /= big;
+          }
+      }
+  }
+
+  // normalised by j_0 or j_1, whichever is larger
+  for(std::size_t p = 0; p < P; ++p) {
+    if(c.scalar[p])
+      continue;
+    t_complex const z(c.zr[p], c.zi[p]);
+    t_complex const s = std::sin(z), co = std::cos(z);
+    t_complex const j0 = s / z, j1 = (s / z - co) / z;
+    t_complex const norm = std::abs(j0) >= std::abs(j1) ? j0 / t_complex(jr[p], ji[p]) :
+                                                          j1 / t_complex(jr[P + p], ji[P + p]);
+    if(not(std::isfinite(std::abs(norm)) and std::isfinite(std::abs(j0)) and
+           std::isfinite(std::abs(j1)))) {
+      c.scalar[p] = true;
+      continue;
+    }
+    for(long int i = 0; i <= n; ++i) {
+      t_complex const j = norm * t_complex(jr[i * P + p], ji[i * P + p]);
+      jr[i * P + p] = j.real();
+      ji[i * P + p] = j.imag();
+    }
+  }
+}
+
+//! \brief h_0 to h_n of the arguments of a chunk
+//! \details As details::spherical_hankel: the upward recurrence of the kind stable on the side
+//! of the real axis of each argument, fixed up with the Bessel functions where needed.
+template <BESSEL_TYPE BesselType> void hankel(BesselChunk &c, long int n) {
+  auto const P = c.size;
+  t_real const sigma = BesselType == Hankel1 ? 1 : -1;
+  t_real *const fr = c.fr.data(), *const fi = c.fi.data();
+  bool bessel = false;
+  for(std::size_t p = 0; p < P; ++p) {
+    t_complex const z(c.zr[p], c.zi[p]), inverse(c.ir[p], c.ii[p]);
+    t_real const sign = c.zi[p] >= 0 ? 1 : -1;
+    bessel |= c.zi[p] == 0 or sign != sigma;
+    t_complex const e = std::exp(t_complex(0, sign) * z);
+    t_complex const h0 = t_complex(0, -sign) * e * inverse;
+    t_complex const h1 = -e * (z + t_complex(0, sign)) * inverse * inverse;
+    fr[p] = h0.real();
+    fi[p] = h0.imag();
+    fr[P + p] = h1.real();
+    fi[P + p] = h1.imag();
+  }
+  t_real const *const ir = c.ir.data(), *const ii = c.ii.data();
+  for(long int k = 1; k < n; ++k) {
+    t_real const t = 2 * k + 1;
+    t_real const *const pr = fr + (k - 1) * P, *const pi = fi + (k - 1) * P;
+    t_real const *const hr = fr + k * P, *const hi = fi + k * P;
+    t_real *const nr = fr + (k + 1) * P, *const ni = fi + (k + 1) * P;
+    for(std::size_t p = 0; p < P; ++p) {
+      nr[p] = t * (ir[p] * hr[p] - ii[p] * hi[p]) - pr[p];
+      ni[p] = t * (ir[p] * hi[p] + ii[p] * hr[p]) - pi[p];
+    }
+  }
+
+  if(bessel) {
+    miller(c, n, c.jr.data(), c.ji.data());
+    t_real const *const jr = c.jr.data(), *const ji = c.ji.data();
+    for(std::size_t p = 0; p < P; ++p) {
+      if(c.scalar[p])
+        continue;
+      t_real const sign = c.zi[p] >= 0 ? 1 : -1;
+      if(c.zi[p] == 0) {
+        // the imaginary parts are the spherical Neumann functions
+        for(long int k = 0; k <= n; ++k) {
+          fr[k * P + p] = jr[k * P + p];
+          fi[k * P + p] *= sigma;
+        }
+      } else if(sign != sigma)
+        for(long int k = 0; k <= n; ++k) {
+          fr[k * P + p] = 2 * jr[k * P + p] - fr[k * P + p];
+          fi[k * P + p] = 2 * ji[k * P + p] - fi[k * P + p];
+        }
+    }
+  }
+  for(std::size_t p = 0; p < P; ++p)
+    if(not(std::isfinite(fr[n * P + p]) and std::isfinite(fi[n * P + p]) and
+           std::isfinite(fr[p]) and std::isfinite(fi[p])))
+      c.scalar[p] = true;
+}
+
+//! The functions of the arguments first to first + size of the batch
+template <BESSEL_TYPE BesselType>
+void bessel_chunk(BesselChunk &c, const t_complex *z, std::size_t count, std::size_t first,
+                  long int max_order, t_complex *data, t_complex *ddata,
+                  std::vector<BesselFailure> &failures) {
+  auto const P = c.size;
+  // one order more for the derivatives
+  long int const n = max_order + 1;
+  for(std::size_t p = 0; p < P; ++p) {
+    t_complex const inverse = 1.0 / z[first + p];
+    c.zr[p] = z[first + p].real();
+    c.zi[p] = z[first + p].imag();
+    c.ir[p] = inverse.real();
+    c.ii[p] = inverse.imag();
+    c.scalar[p] = std::abs(z[first + p]) <= errEpsilon;
+  }
+  if(BesselType == Bessel)
+    miller(c, n, c.fr.data(), c.fi.data());
+  else
+    hankel<BesselType>(c, n);
+
+  t_real const *const fr = c.fr.data(), *const fi = c.fi.data();
+  for(long int k = 0; k <= max_order; ++k)
+    for(std::size_t p = 0; p < P; ++p) {
+      auto const i = k * count + first + p;
+      t_complex const f(fr[k * P + p], fi[k * P + p]);
+      data[i] = f;
+      if(ddata)
+        ddata[i] = static_cast<t_real>(k) * t_complex(c.ir[p], c.ii[p]) * f -
+                   t_complex(fr[(k + 1) * P + p], fi[(k + 1) * P + p]);
+      if(BesselType == Bessel and c.zi[p] == 0) {
+        data[i] = data[i].real();
+        if(ddata)
+          ddata[i] = ddata[i].real();
+      }
+    }
+
+  std::vector<t_complex> f(max_order + 1), df(max_order + 1);
+  for(std::size_t p = 0; p < P; ++p) {
+    if(not c.scalar[p])
+      continue;
+    try {
+      bessel<BesselType>(z[first + p], max_order, f.data(), df.data());
+    } catch(std::runtime_error const &e) {
+      failures.push_back({first + p, e.what()});
+      std::fill(f.begin(), f.end(), 0e0);
+      std::fill(df.begin(), df.end(), 0e0);
+    }
+    for(long int k = 0; k <= max_order; ++k) {
+      data[k * count + first + p] = f[k];
+      if(ddata)
+        ddata[k * count + first + p] = df[k];
+    }
+  }
+}
+} // namespace
+
+template <BESSEL_TYPE BesselType>
+std::vector<BesselFailure> bessel_batch(const std::complex<double> *z, std::size_t count,
+                                        long int max_order, std::complex<double> *data,
+                                        std::complex<double> *ddata) {
+  t_int const chunks = (count + chunk - 1) / chunk;
+  std::vector<BesselFailure> failures;
+  std::exception_ptr error = nullptr;
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel if(chunks > 1)
+#endif
+  {
+    // the buffers of each thread are kept from one batch to the next
+    static thread_local BesselChunk c;
+    for(auto *buffer : {&c.zr, &c.zi, &c.ir, &c.ii, &c.ar, &c.ai, &c.cr, &c.ci})
+      buffer->resize(chunk);
+    for(auto *buffer : {&c.fr, &c.fi, &c.jr, &c.ji})
+      if(buffer->size() < (max_order + 2) * chunk)
+        buffer->resize((max_order + 2) * chunk);
+    c.scalar.resize(chunk);
+    std::vector<BesselFailure> local;
+#ifdef OPTIMET_OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(t_int i = 0; i < chunks; ++i) {
+      try {
+        std::size_t const first = i * chunk;
+        c.size = std::min(chunk, count - first);
+        bessel_chunk<BesselType>(c, z, count, first, max_order, data, ddata, local);
+      } catch(...) {
+        // exceptions must not escape the parallel region
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_bessel_batch)
+#endif
+        error = std::current_exception();
+      }
+    }
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_bessel_batch)
+#endif
+    failures.insert(failures.end(), local.begin(), local.end());
+  }
+  if(error)
+    std::rethrow_exception(error);
+  std::sort(failures.begin(), failures.end(),
+            [](BesselFailure const &a, BesselFailure const &b) { return a.index < b.index; });
+  return failures;
+}
+
+template std::vector<BesselFailure>
+bessel_batch<Bessel>(const std::complex<double> *, std::size_t, long int,
+                     std::complex<double> *, std::complex<double> *);
+template std::vector<BesselFailure>
+bessel_batch<Hankel1>(const std::complex<double> *, std::size_t, long int,
+                      std::complex<double> *, std::complex<double> *);
+template std::vector<BesselFailure>
+bessel_batch<Hankel2>(const std::complex<double> *, std::size_t, long int,
+                      std::complex<double> *, std::complex<double> *);
+} // namespace optimet
@@ -18,8 +18,12 @@
 #define OPTIMET_BESSEL_H
 
 #include "constants.h"
+#include <algorithm>
+#include <cmath>
 #include <complex>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 #include <vector>
 
@@ -34,10 +38,206 @@ namespace optimet {
 
 enum BESSEL_TYPE { Bessel = 0, Hankel1 = 1, Hankel2 = 2 };
 
+//! \brief Buffers of the Bessel functions, reused from one call to the next
+//! \details Holds the output of AMOS and, when asked for, the functions themselves.
+struct BesselWorkspace {
+  //! Real and imaginary parts returned by AMOS
+  std::vector<double> cyr, cyi;
+  //! The functions up to one order above the maximum, from which the derivatives follow
+  std::vector<std::complex<double>> orders;
+  //! The functions, their derivatives and the terms of bessel3der
+  std::vector<std::complex<double>> data, ddata, dddata;
+};
+
+//! The workspace of the calling thread
+inline BesselWorkspace &bessel_workspace() {
+  static thread_local BesselWorkspace workspace;
+  return workspace;
+}
+
+namespace details {
+//! \brief Spherical Bessel functions j_0(z) to j_n(z), for a real or complex argument
+//! \details For real arguments, orders below |z| follow from the upward recurrence, which is
+//! stable there. Otherwise Miller's backward recurrence starts well above n and |z| and is
+//! normalised by j_0 or j_1, whichever is larger.
+//! \return false if the functions overflow, e.g. for large imaginary parts
+template <class T> bool spherical_bessel(T const &z, long int n, std::complex<double> *f) {
+  T const s = std::sin(z), c = std::cos(z);
+  T const j0 = s / z, j1 = (s / z - c) / z;
+  if(not(std::isfinite(std::abs(j0)) and std::isfinite(std::abs(j1))))
+    return false;
+  f[0] = j0;
+  if(n == 0)
+    return true;
+  f[1] = j1;
+  T const inverse = 1.0 / z;
+  auto const r = std::abs(z);
+  if(std::imag(z) == 0 and r > n) {
+    T previous = j0, current = j1;
+    for(long int k = 1; k < n; ++k) {
+      T const next = static_cast<double>(2 * k + 1) * inverse * current - previous;
+      previous = current;
+      current = next;
+      f[k + 1] = next;
+    }
+    return true;
+  }
+
+  // the ratios j_k / j_(k + 1) converge quickly above max(n, |z|)
+  double const top = std::max(static_cast<double>(n), r);
+  long int const start = static_cast<long int>(top + 16 + 8 * std::cbrt(top));
+  double const big = 1e150;
+  T above(0), current(1);
+  for(long int k = start; k > 0; --k) {
+    T const below = static_cast<double>(2 * k + 1) * inverse * current - above;
+    above = current;
+    current = below;
+    if(k <= n + 1)
+      f[k - 1] = current;
+    if(std::abs(current) > big) {
+      above /= big;
+      current /= big;
+      if(k <= n + 1)
+        for(long int i = k - 1; i <= n; ++i)
+          f[i] /= big;
+    }
+  }
+  std::complex<double> const norm = std::abs(j0) >= std::abs(j1) ? std::complex<double>(j0) / f[0] :
+                                                                    std::complex<double>(j1) / f[1];
+  for(long int i = 0; i <= n; ++i)
+    f[i] *= norm;
+  return std::isfinite(std::abs(norm));
+}
+
+//! \brief Spherical Hankel functions h_0(z) to h_n(z) of the first or second kind
+//! \details For real arguments, the spherical Neumann functions follow from the upward
+//! recurrence and the Bessel functions from spherical_bessel. Otherwise the upward recurrence is
+//! stable for the smaller of the two kinds, the first above the real axis, and the other kind is
+//! 2 j_n - h_n.
+//! \return false if the functions overflow, e.g. for large orders at small arguments
+template <BESSEL_TYPE BesselType>
+bool spherical_hankel(std::complex<double> const &z, long int n, std::complex<double> *f) {
+  double const sign = BesselType == Hankel1 ? 1 : -1;
+  if(z.imag() == 0) {
+    double const x = z.real();
+    if(not spherical_bessel(x, n, f))
+      return false;
+    double const inverse = 1 / x;
+    double previous = -std::cos(x) * inverse, current = (previous - std::sin(x)) * inverse;
+    f[0] += std::complex<double>(0, sign * previous);
+    if(n > 0)
+      f[1] += std::complex<double>(0, sign * current);
+    for(long int k = 1; k < n; ++k) {
+      double const next = (2 * k + 1) * inverse * current - previous;
+      previous = current;
+      current = next;
+      f[k + 1] += std::complex<double>(0, sign * next);
+    }
+  } else if((z.imag() > 0) != (BesselType == Hankel1)) {
+    if(not spherical_bessel(z, n, f))
+      return false;
+    std::vector<std::complex<double>> other(n + 1);
+    if(not spherical_hankel<BesselType == Hankel1 ? Hankel2 : Hankel1>(z, n, other.data()))
+      return false;
+    for(long int k = 0; k <= n; ++k)
+      f[k] = 2.0 * f[k] - other[k];
+  } else {
+    std::complex<double> const e = std::exp(std::complex<double>(0, sign) * z);
+    std::complex<double> const inverse = 1.0 / z;
+    std::complex<double> previous = std::complex<double>(0, -sign) * e * inverse;
+    std::complex<double> current = -e * (z + std::complex<double>(0, sign)) * inverse * inverse;
+    f[0] = previous;
+    if(n > 0)
+      f[1] = current;
+    for(long int k = 1; k < n; ++k) {
+      std::complex<double> const next = static_cast<double>(2 * k + 1) * inverse * current - previous;
+      previous = current;
+      current = next;
+      f[k + 1] = next;
+    }
+  }
+  return std::isfinite(std::abs(f[n])) and std::isfinite(std::abs(f[0]));
+}
+
+//! The error reported by AMOS, null if none
+inline char const *amos_error(long int ierr) {
+  switch(ierr) {
+  case 0:
+    return nullptr;
+  case 1:
+    return "Incorrect input to Henkel/Bessel functions";
+  case 2:
+    return "Overflow when computing to Henkel/Bessel functions";
+  case 3:
+    return "Loss of significance: result is less than half of machine accuracy";
+  case 4:
+    return "Complete loss of significance";
+  case 5:
+    return "Algorithmic conditions not met";
+  default:
+    return "Unknown error when computing Henkel/Bessel functions";
+  }
+}
+
+//! \brief Spherical Bessel or Hankel functions of orders 0 to size - 1 from the AMOS routines
+//! \details Throws if AMOS reports an error.
+template <BESSEL_TYPE BesselType, bool Scaling>
+void amos(const std::complex<double> &z, long int size, std::complex<double> *f,
+          BesselWorkspace &workspace) {
+  // Calling FORTRAN functions from C/C++ expects the arguments to be pointers
+  // to int/real which means they must be rvalues
+  const double order = 0.5;
+  const long int scaling = Scaling ? 2 : 1;
+  const long int bessel_type = BesselType;
+  const double zr = z.real();
+  const double zi = z.imag();
+
+  // Return vectors for real and imaginary parts
+  auto &cyr = workspace.cyr;
+  auto &cyi = workspace.cyi;
+  if(cyr.size() < static_cast<std::size_t>(size)) {
+    cyr.resize(size);
+    cyi.resize(size);
+  }
+
+  long int zeroUnderflow, ierr;
+
+  // The f2c translation of AMOS keeps its work variables in statics
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_amos)
+#endif
+  {
+  if(BesselType == Bessel)
+    // Calculate the Bessel function of the first kind
+    zbesj_(&zr, &zi, &order, &scaling, &size, cyr.data(), cyi.data(), &zeroUnderflow, &ierr);
+  else
+    // Calculate the Hankel function of the first or second kind
+    zbesh_(&zr, &zi, &order, &scaling, &bessel_type, &size, cyr.data(), cyi.data(),
+           &zeroUnderflow, &ierr);
+  }
+
+  if(ierr != 0)
+    throw std::runtime_error(amos_error(ierr));
+
+  const std::complex<double> r = std::sqrt(consPi / (2.0 * z));
+  for(int i = 0; i < size; i++)
+    f[i] = r * std::complex<double>(cyr[i], cyi[i]);
+}
+
+//! \brief Spherical Bessel or Hankel functions of orders 0 to n computed natively
+//! \return false if they could not be, in which case AMOS should be used
+template <BESSEL_TYPE BesselType>
+bool spherical(std::complex<double> const &z, long int n, std::complex<double> *f) {
+  if(BesselType != Bessel)
+    return spherical_hankel<BesselType>(z, n, f);
+  return z.imag() == 0 ? spherical_bessel(z.real(), n, f) : spherical_bessel(z, n, f);
+}
+} // namespace details
+
 /*!
  * The bessel function implements the Spherical Bessel and Hankel functions
  * and their derivatives, calculated from the zeroth order up to the maximum
- * order.
+ * order, into buffers given by the caller.
  *
  * \tparam BesselType   the type of function:
  *                        \c 0 - Bessel,
@@ -49,203 +249,110 @@ enum BESSEL_TYPE { Bessel = 0, Hankel1 = 1, Hankel2 = 2 };
  *
  * \param [in] z          the argument for the Bessel function
  * \param [in] max_order  the maximum order of functions to calculate
+ * \param [out] data      the max_order + 1 functions
+ * \param [out] ddata     the max_order + 1 derivatives, skipped if null
+ * \param [out] dddata    the max_order + 1 terms of bessel3der, skipped if null, needs ddata
+ * \param workspace       the buffers of AMOS
  *
- * \return a tuple containing the values of the spherical bessel and hankel
- *           functions in the first element, and their derivatives in the second
+ * The unscaled functions come from the recurrences of details::spherical, the scaled ones
+ * and those which overflow there from the AMOS routines, which also serve as their reference.
  *
- * \warning The zeroth order derivative (never used) is not accurate!
+ * \warning The zeroth order derivatives (never used) are not accurate!
  */
 template <BESSEL_TYPE BesselType, bool Scaling = false>
-std::tuple<std::vector<std::complex<double>>, std::vector<std::complex<double>>>
-bessel(const std::complex<double> &z, long int max_order) {
-  // Calling FORTRAN functions from C/C++ expects the arguments to be pointers
-  // to int/real which means they must be rvalues
-  const double order = 0.5;
-  const long int scaling = Scaling ? 2 : 1;
-  const long int bessel_type = BesselType;
-
-  std::vector<std::complex<double>> data(max_order + 1);
-  std::vector<std::complex<double>> ddata(max_order + 1);
-
+void bessel(const std::complex<double> &z, long int max_order, std::complex<double> *data,
+            std::complex<double> *ddata, std::complex<double> *dddata = nullptr,
+            BesselWorkspace &workspace = bessel_workspace()) {
   if(std::abs(z) <= errEpsilon) {
-    for(int i = 0; i <= max_order; i++)
-      data[i] = ddata[i] = std::complex<double>(0.0, 0.0);
+    for(int i = 0; i <= max_order; i++) {
+      data[i] = std::complex<double>(0.0, 0.0);
+      if(ddata)
+        ddata[i] = std::complex<double>(0.0, 0.0);
+      if(dddata)
+        dddata[i] = std::complex<double>(0.0, 0.0);
+    }
     if(BesselType == Bessel)
       data[0] = std::complex<double>(1, 0);
   } else {
-    const double zr = z.real();
-    const double zi = z.imag();
-
-    // Return vectors for real and imaginary parts
-    // (+1 for zeroth order, +1 for derivative)
+    // The functions, +1 for zeroth order, +1 for derivative
     const long int size = max_order + 2;
-    std::vector<double> cyr(size);
-    std::vector<double> cyi(size);
-
-    long int zeroUnderflow, ierr;
-
-    if(BesselType == Bessel)
-      // Calculate the Bessel function of the first kind
-      zbesj_(&zr, &zi, &order, &scaling, &size, cyr.data(), cyi.data(), &zeroUnderflow, &ierr);
-    else
-      // Calculate the Hankel function of the first or second kind
-      zbesh_(&zr, &zi, &order, &scaling, &bessel_type, &size, cyr.data(), cyi.data(),
-             &zeroUnderflow, &ierr);
-
-    switch(ierr) {
-    case 0:
-      break;
-    case 1:
-      throw std::runtime_error("Incorrect input to Henkel/Bessel functions");
-      break;
-    case 2:
-      throw std::runtime_error("Overflow when computing to Henkel/Bessel functions");
-      break;
-    case 3:
-      throw std::runtime_error(
-          "Loss of significance: result is less than half of machine accuracy");
-      break;
-    case 4:
-      throw std::runtime_error("Complete loss of significance");
-      break;
-    case 5:
-      throw std::runtime_error("Algorithmic conditions not met");
-      break;
-    default:
-      throw std::runtime_error("Unknown error when computing Henkel/Bessel functions");
-      break;
-    }
+    auto &orders = workspace.orders;
+    if(orders.size() < static_cast<std::size_t>(size))
+      orders.resize(size);
+    if(Scaling or not details::spherical<BesselType>(z, max_order + 1, orders.data()))
+      details::amos<BesselType, Scaling>(z, size, orders.data(), workspace);
 
     // Assemble the direct functions
-    const std::complex<double> r = std::sqrt(consPi / (2.0 * z));
     for(int i = 0; i <= max_order; i++)
-      data[i] = r * std::complex<double>(cyr[i], cyi[i]);
+      data[i] = orders[i];
 
-    // Assemble the derivative functions
-    for(int i = 0; i < max_order; i++)
-      ddata[i] = consCm1 * data[i + 1] + ((double)i / z) * data[i];
+    if(ddata) {
+      // Assemble the derivative functions
+      for(int i = 0; i <= max_order; i++)
+        ddata[i] = consCm1 * orders[i + 1] + ((double)i / z) * data[i];
+    }
 
-    // The last derivative
-    ddata[max_order] = consCm1 * r * std::complex<double>(cyr[max_order + 1], cyi[max_order + 1]) +
-                       ((double)max_order / z) * data[max_order];
+    if(dddata) {
+      // Assemble the second derivative functions
+      dddata[0] = std::complex<double>(0.0, 0.0);
+      for(int i = 1; i <= max_order; i++)
+        dddata[i] = consCm1 * ((double)i / z) * ddata[i] +
+                    ((double)i / std::pow(z, 2.0)) * data[i] + ddata[i - 1];
+    }
   }
 
-   if ( (z.imag() == 0.0) && (BesselType == Bessel) ){   
-   // corrects the error if the imaginary part of the argument is exactly zero fro Bessel func
-   for (int i = 0; i <= max_order; i++){
-   data[i]=data[i].real();
-   ddata[i]=ddata[i].real();
-   }
-  
+  if((z.imag() == 0.0) && (BesselType == Bessel)) {
+    // corrects the error if the imaginary part of the argument is exactly zero for Bessel func
+    for(int i = 0; i <= max_order; i++) {
+      data[i] = data[i].real();
+      if(ddata)
+        ddata[i] = ddata[i].real();
+      if(dddata)
+        dddata[i] = dddata[i].real();
+    }
   }
+}
 
-  return std::make_tuple(data, ddata);
+//! \brief Spherical Bessel and Hankel functions computed into the buffers of the workspace
+//! \details The returned workspace holds them in data, ddata and, if asked for, dddata.
+template <BESSEL_TYPE BesselType, bool Scaling = false>
+BesselWorkspace &bessel(const std::complex<double> &z, long int max_order,
+                        BesselWorkspace &workspace, bool second_derivative = false) {
+  workspace.data.resize(max_order + 1);
+  workspace.ddata.resize(max_order + 1);
+  if(second_derivative)
+    workspace.dddata.resize(max_order + 1);
+  bessel<BesselType, Scaling>(z, max_order, workspace.data.data(), workspace.ddata.data(),
+                              second_derivative ? workspace.dddata.data() : nullptr, workspace);
+  return workspace;
 }
 
+/*!
+ * Spherical Bessel and Hankel functions and their derivatives, in new vectors.
+ *
+ * \return a tuple containing the values of the spherical bessel and hankel
+ *           functions in the first element, and their derivatives in the second
+ */
+template <BESSEL_TYPE BesselType, bool Scaling = false>
+std::tuple<std::vector<std::complex<double>>, std::vector<std::complex<double>>>
+bessel(const std::complex<double> &z, long int max_order) {
+  std::vector<std::complex<double>> data(max_order + 1);
+  std::vector<std::complex<double>> ddata(max_order + 1);
+  bessel<BesselType, Scaling>(z, max_order, data.data(), ddata.data());
+  return std::make_tuple(std::move(data), std::move(ddata));
+}
+
+//! -i/z f_i' + i/z^2 f_i + f_{i-1}', from the spherical Bessel or Hankel functions f, in a new vector
 template <BESSEL_TYPE BesselType, bool Scaling = false>
 std::vector<std::complex<double>>
 bessel3der(const std::complex<double> &z, long int max_order) {
-
-  // Calling FORTRAN functions from C/C++ expects the arguments to be pointers
-  // to int/real which means they must be rvalues
-  const double order = 0.5;
-  const long int scaling = Scaling ? 2 : 1;
-  const long int bessel_type = BesselType;
-  
-  
-
   std::vector<std::complex<double>> data(max_order + 1);
   std::vector<std::complex<double>> ddata(max_order + 1);
   std::vector<std::complex<double>> dddata(max_order + 1);
-  
-  if(std::abs(z) <= errEpsilon) {
-    for(int i = 0; i <= max_order; i++){
-      data[i] = ddata[i] = std::complex<double>(0.0, 0.0);
-      dddata[i] = std::complex<double>(0.0, 0.0);
-      }
-    if(BesselType == Bessel)
-      
-      data[0] = std::complex<double>(1, 0);
-  } else {
-    const double zr = z.real();
-    const double zi = z.imag();
-
-    // Return vectors for real and imaginary parts
-    // (+1 for zeroth order, +1 for derivative)
-    const long int size = max_order + 2;
-    std::vector<double> cyr(size);
-    std::vector<double> cyi(size);
-
-     long int zeroUnderflow, ierr;
-     
-  
-    if(BesselType == Bessel)
-      // Calculate the Bessel function of the first kind
-      zbesj_(&zr, &zi, &order, &scaling, &size, cyr.data(), cyi.data(), &zeroUnderflow, &ierr);
-    else
-      // Calculate the Hankel function of the first or second kind
-      zbesh_(&zr, &zi, &order, &scaling, &bessel_type, &size, cyr.data(), cyi.data(),
-             &zeroUnderflow, &ierr);
-             
-    switch(ierr) {
-    case 0:
-      break;
-    case 1:
-      throw std::runtime_error("Incorrect input to Henkel/Bessel functions");
-      break;
-    case 2:
-      throw std::runtime_error("Overflow when computing to Henkel/Bessel functions");
-      break;
-    case 3:
-      throw std::runtime_error(
-          "Loss of significance: result is less than half of machine accuracy");
-      break;
-    case 4:
-      throw std::runtime_error("Complete loss of significance");
-      break;
-    case 5:
-      throw std::runtime_error("Algorithmic conditions not met");
-      break;
-    default:
-      throw std::runtime_error("Unknown error when computing Henkel/Bessel functions");
-      break;
-    }
-    
-     
-
-    // Assemble the direct functions
-    const std::complex<double> r = std::sqrt(consPi / (2.0 * z));
-    for(int i = 0; i <= max_order; i++)
-      data[i] = r * std::complex<double>(cyr[i], cyi[i]);
-
-    // Assemble the first derivative functions
-    for(int i = 0; i < max_order; i++)
-      ddata[i] = consCm1 * data[i + 1] + ((double)i / z) * data[i];
-
-    // The last derivative
-    ddata[max_order] = consCm1 * r * std::complex<double>(cyr[max_order + 1], cyi[max_order + 1]) +
-                       ((double)max_order / z) * data[max_order];
-                       
-   // Assemble the second derivative functions
-    for(int i = 1; i <= max_order; i++)
-      dddata[i] = consCm1 * ((double)i / z) * ddata[i] + ((double)i / std::pow(z , 2.0)) * data[i] + ddata[i - 1];
-                       
-                       
-  }
-
-  if ( (z.imag() == 0.0) && (BesselType == Bessel) ){
-   // corrects the error if the imaginary part of the argument is exactly zero for Bessel func
-   for (int i = 1; i <= max_order; i++){
-   dddata[i]=dddata[i].real();
-   }
-  
-  }
-
+  bessel<BesselType, Scaling>(z, max_order, data.data(), ddata.data(), dddata.data());
   return dddata;
 }
 
-
-
 inline std::tuple<std::vector<std::complex<double>>, std::vector<std::complex<double>>>
 bessel(const std::complex<double> &z, enum BESSEL_TYPE besselType, bool scale, long int nMax) {
   switch(besselType) {
@@ -258,6 +365,58 @@ bessel(const std::complex<double> &z, enum BESSEL_TYPE besselType, bool scale, l
   }
 }
 
+//! Spherical Bessel and Hankel functions of a type given at run time, into the workspace
+inline BesselWorkspace &bessel(const std::complex<double> &z, enum BESSEL_TYPE besselType,
+                               bool scale, long int nMax, BesselWorkspace &workspace) {
+  switch(besselType) {
+  case Bessel:
+    return scale ? bessel<Bessel, true>(z, nMax, workspace) :
+                   bessel<Bessel, false>(z, nMax, workspace);
+  case Hankel1:
+    return scale ? bessel<Hankel1, true>(z, nMax, workspace) :
+                   bessel<Hankel1, false>(z, nMax, workspace);
+  case Hankel2:
+    return scale ? bessel<Hankel2, true>(z, nMax, workspace) :
+                   bessel<Hankel2, false>(z, nMax, workspace);
+  }
+  return workspace;
+}
+
+//! An argument of bessel_batch for which the functions could not be computed
+struct BesselFailure {
+  std::size_t index;   /**< The index of the argument. */
+  std::string message; /**< The error, as for a single argument. */
+};
+
+/*!
+ * Spherical Bessel or Hankel functions and their derivatives of many arguments.
+ *
+ * The recurrences of details::spherical run over chunks of arguments at once, the arguments
+ * in the innermost loops, and the chunks are shared by the OpenMP threads. Arguments for which
+ * the recurrences fail, e.g. zero or overflowing, are passed on to bessel one at a time.
+ *
+ * \param [in] z         the arguments
+ * \param [in] count     the number of arguments
+ * \param [in] max_order the maximum order of functions to calculate
+ * \param [out] data     the functions, data[n * count + i] of order n at z[i]
+ * \param [out] ddata    the derivatives, as data, skipped if null
+ * \return the arguments whose functions could not be computed, whose values are set to zero
+ */
+template <BESSEL_TYPE BesselType>
+std::vector<BesselFailure> bessel_batch(const std::complex<double> *z, std::size_t count,
+                                        long int max_order, std::complex<double> *data,
+                                        std::complex<double> *ddata);
+
+extern template std::vector<BesselFailure>
+bessel_batch<Bessel>(const std::complex<double> *, std::size_t, long int,
+                     std::complex<double> *, std::complex<double> *);
+extern template std::vector<BesselFailure>
+bessel_batch<Hankel1>(const std::complex<double> *, std::size_t, long int,
+                      std::complex<double> *, std::complex<double> *);
+extern template std::vector<BesselFailure>
+bessel_batch<Hankel2>(const std::complex<double> *, std::size_t, long int,
+                      std::complex<double> *, std::complex<double> *);
+
 } // namespace optimet
 
 #endif /* OPTIMET_BESSEL_H */
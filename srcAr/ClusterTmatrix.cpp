@@ -0,0 +1,124 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "ClusterTmatrix.h"
+#ifdef OPTIMET_MPI
+#include "Coupling.h"
+#include "Excitation.h"
+#include "Geometry.h"
+#include "PreconditionedMatrix.h"
+#include "Profile.h"
+#include "Tools.h"
+#include <Eigen/LU>
+#include <algorithm>
+#include <cmath>
+#include <mpi.h>
+#include <stdexcept>
+
+namespace optimet {
+namespace {
+//! \brief The translation by R up to order, between the VSWFs up to nMax and those up to order
+//! \details Regular to regular with rows, outgoing to outgoing with columns up to nMax only.
+Matrix<t_complex> translation(Spherical<t_real> const &R, t_complex waveK, t_uint nMax,
+                              t_uint order, bool rows) {
+  Coupling const AB(R, waveK, order, false);
+  t_uint const P = order * (order + 2), p = nMax * (nMax + 2);
+  Matrix<t_complex> full(2 * P, 2 * P);
+  full << AB.diagonal.transpose(), AB.offdiagonal.transpose(), AB.offdiagonal.transpose(),
+      AB.diagonal.transpose();
+  // the harmonics up to nMax come first in each half
+  if(rows) {
+    Matrix<t_complex> result(2 * p, 2 * P);
+    result << full.topRows(p), full.middleRows(P, p);
+    return result;
+  }
+  Matrix<t_complex> result(2 * P, 2 * p);
+  result << full.leftCols(p), full.middleCols(P, p);
+  return result;
+}
+} // namespace
+
+t_uint cluster_order(Geometry const &geometry, t_complex waveK) {
+  t_real extent = 0;
+  for(auto const &object : geometry.objects)
+    extent = std::max(extent, object.vR.rrr);
+  return std::ceil(geometry.objects.front().nMax + std::abs(waveK) * extent);
+}
+
+Matrix<t_complex> cluster_tmatrix(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                                  Matrix<t_complex> const &TmatrixFF, t_uint order,
+                                  mpi::Communicator const &communicator) {
+  if(not geometry.get_periodic().empty())
+    throw std::runtime_error("A periodic lattice has no cluster T-matrix");
+  auto const &objects = geometry.objects;
+  t_int const nobj = objects.size();
+  auto const nMax = objects.front().nMax;
+  for(auto const &object : objects)
+    if(object.nMax != nMax)
+      throw std::runtime_error("All objects must have same number of harmonics");
+  order = std::max<t_uint>(order, nMax);
+  Profile::Region const timer("cluster T-matrix");
+  t_int const n = 2 * nMax * (nMax + 2), N = 2 * order * (order + 2);
+  t_complex const waveK = incWave->waveK;
+
+  Eigen::PartialPivLU<Matrix<t_complex>> const lu(
+      ScatteringMatrixFF_parr(TmatrixFF, geometry, incWave, communicator));
+  // the regular VSWFs about the origin at each object, and the outgoing ones back to the origin
+  Matrix<t_complex> sources(n * nobj, N);
+  std::vector<Matrix<t_complex>> outgoing;
+  for(t_int j = 0; j < nobj; ++j) {
+    auto const R = Tools::toCartesian(objects[j].vR);
+    sources.middleRows(j * n, n) = translation(objects[j].vR, waveK, nMax, order, true);
+    outgoing.push_back(translation(Tools::toSpherical(Cartesian<t_real>(-R.x, -R.y, -R.z)), waveK,
+                                   nMax, order, false));
+  }
+
+  // blocks of columns dealt out to the processes in turn, then summed
+  t_int const width = std::max(1, std::min(N, 64));
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(N, N);
+  for(t_int c = communicator.rank() * width; c < N; c += communicator.size() * width) {
+    auto const w = std::min(width, N - c);
+    Matrix<t_complex> const indirect = lu.solve(sources.middleCols(c, w));
+    for(t_int j = 0; j < nobj; ++j)
+      result.middleCols(c, w).noalias() +=
+          outgoing[j] * (TmatrixFF.block(0, j * n, n, n) * indirect.middleRows(j * n, n));
+  }
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), 2 * result.size(), MPI_DOUBLE, MPI_SUM,
+                *communicator);
+  return result;
+}
+
+OrientationAverage orientation_average(Matrix<t_complex> const &Tcluster,
+                                       std::shared_ptr<Excitation const> incWave) {
+  if(incWave->type != 0)
+    throw std::runtime_error("The analytic orientation average needs a plane wave");
+  // The coefficients of a plane wave average to intensity times the identity over its
+  // directions and polarizations, intensity being the same for every harmonic.
+  auto const nMax = incWave->nMax;
+  t_int const p = nMax * (nMax + 2);
+  Vector<t_complex> coefficients(2 * p);
+  incWave->getIncLocal(Spherical<t_real>(0, 0, 0), coefficients.data(), nMax);
+  auto const intensity = coefficients.squaredNorm() / (2 * p);
+  auto const k2 = std::real(incWave->waveK) * std::real(incWave->waveK);
+  OrientationAverage result;
+  result.extinction = -intensity / k2 * std::real(Tcluster.trace());
+  result.scattering = intensity / k2 * Tcluster.squaredNorm();
+  result.absorption = result.extinction - result.scattering;
+  return result;
+}
+} // namespace optimet
+#endif
@@ -0,0 +1,64 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef OPTIMET_CLUSTER_TMATRIX_H
+#define OPTIMET_CLUSTER_TMATRIX_H
+
+#include "Types.h"
+#include "mpi/Communicator.h"
+#include <memory>
+
+#ifdef OPTIMET_MPI
+class Geometry;
+namespace optimet {
+class Excitation;
+
+/**
+ * Computes the T-matrix of a cluster about the origin, on the VSWFs up to the given order.
+ * Each of its columns holds the scattered coefficients of all the objects, translated to the
+ * origin, for one incident regular VSWF: the columns are solved a block at a time with one
+ * factorization of the scattering matrix, the blocks shared out between the processes.
+ * Collective over communicator.
+ * @param geometry the objects, all with the same number of harmonics.
+ * @param incWave the excitation, for its wavenumber.
+ * @param TmatrixFF the T-matrices of the objects side by side, as the first half of the columns
+ * of getTRgQmatrix_FF_parr.
+ * @param order the largest n of the VSWFs about the origin, at least that of the objects.
+ */
+Matrix<t_complex> cluster_tmatrix(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                                  Matrix<t_complex> const &TmatrixFF, t_uint order,
+                                  mpi::Communicator const &communicator = mpi::Communicator());
+
+//! Smallest order of the VSWFs about the origin holding the fields of all the objects
+t_uint cluster_order(Geometry const &geometry, t_complex waveK);
+
+//! Cross sections averaged over all the orientations of a cluster and the polarizations
+struct OrientationAverage {
+  t_real extinction, scattering, absorption;
+};
+
+/**
+ * Cross sections averaged over the orientations of the cluster, in the invariants of its
+ * T-matrix: the trace for the extinction and the Frobenius norm for the scattering.
+ * @param Tcluster the T-matrix of the cluster, from cluster_tmatrix.
+ * @param incWave a plane wave, for its wavenumber and intensity.
+ */
+OrientationAverage orientation_average(Matrix<t_complex> const &Tcluster,
+                                       std::shared_ptr<Excitation const> incWave);
+} // namespace optimet
+#endif
+#endif
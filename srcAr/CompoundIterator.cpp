@@ -18,6 +18,17 @@
 
 #include <cmath>
 
+namespace optimet {
+std::vector<HarmonicIndex> harmonic_indices(t_int nMax) {
+  std::vector<HarmonicIndex> result;
+  result.reserve(max_flat_index(nMax));
+  for(t_int n = 1; n <= nMax; ++n)
+    for(t_int m = n; m >= -n; --m)
+      result.push_back({n, m});
+  return result;
+}
+}
+
 CompoundIterator::CompoundIterator() {
   first = 0;
   second = 0;
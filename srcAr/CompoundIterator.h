@@ -18,6 +18,7 @@
 #define COMPOUNDITERATOR_H_
 
 #include "Types.h"
+#include <vector>
 
 namespace optimet {
 //! Harmonic index n, m but flat
@@ -29,6 +30,17 @@ inline constexpr t_int flatten_indices(t_int first, t_int second) {
 inline constexpr t_int max_flat_index(t_int first) {
   return first * (first + 2);
 }
+
+//! Harmonic indices n, m of a flat index
+struct HarmonicIndex {
+  t_int first;
+  t_int second;
+};
+
+//! \brief Harmonic indices of the flat indices 0 to max_flat_index(nMax) - 1, in order
+//! \details For the loops which decode flat indices, e.g. those of the coupling patterns: a
+//! lookup rather than the square root CompoundIterator takes at each assignment.
+std::vector<HarmonicIndex> harmonic_indices(t_int nMax);
 }
 
 /**
@@ -22,12 +22,15 @@
 #include "TranslationAdditionCoefficients.h"
 
 #include <cmath>
+#include <stdexcept>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 namespace optimet {
 
 namespace {
-t_complex coefficients_A(t_int n, t_int m, t_int l, t_int k, TranslationAdditionCoefficients &ta) {
+template <class TA> t_complex coefficients_A(t_int n, t_int m, t_int l, t_int k, TA &ta) {
   if(std::abs(k) > l)
     return 0e0;
   auto const factor = 0.5 / std::sqrt(l * (l + 1) * n * (n + 1));
@@ -37,7 +40,7 @@ t_complex coefficients_A(t_int n, t_int m, t_int l, t_int k, TranslationAddition
   return factor * (c0 * ta(n, m, l, k) + c1 * ta(n, m + 1, l, k + 1) + c2 * ta(n, m - 1, l, k - 1));
 }
 
-t_complex coefficients_B(t_int n, t_int m, t_int l, t_int k, TranslationAdditionCoefficients &ta) {
+template <class TA> t_complex coefficients_B(t_int n, t_int m, t_int l, t_int k, TA &ta) {
   if(std::abs(k) > l)
     return 0e0;
   t_real const a0 = 2 * l + 1;
@@ -51,13 +54,11 @@ t_complex coefficients_B(t_int n, t_int m, t_int l, t_int k, TranslationAddition
 }
 
 std::tuple<Matrix<t_complex>, Matrix<t_complex>>
-transfer_coefficients(Spherical<double> R, std::complex<double> waveK, bool regular, int n_max) {
+transfer_coefficients(TranslationAdditionCoefficients &ta, int n_max) {
   auto const N = Tools::iteratorMax(n_max);
   Matrix<t_complex> diagonal = Matrix<t_complex>::Zero(N, N);
   Matrix<t_complex> offdiagonal = Matrix<t_complex>::Zero(N, N);
 
-  TranslationAdditionCoefficients ta(R, waveK, regular);
-
   // start at harmonic n = 1. (because n=0 spherical and hence symmetrically incompatible with
   // propagating wave?)
   for(t_int n(1); n <= n_max; ++n)
@@ -75,14 +76,293 @@ transfer_coefficients(Spherical<double> R, std::complex<double> waveK, bool regu
   return std::make_tuple(diagonal, offdiagonal);
 }
 
+//! Wigner d^j_m,mu(beta) for j = max(|m|, |mu|), with c = cos(beta / 2) and s = sin(beta / 2)
+t_real wigner_edge(t_int m, t_int mu, t_real c, t_real s) {
+  // d^j_m,mu(beta) = d^j_mu,m(-beta)
+  if(std::abs(mu) > std::abs(m))
+    return wigner_edge(mu, m, c, -s);
+  t_int const j = std::abs(m);
+  t_int const k = m > 0 ? mu : -mu;
+  auto const binomial = std::exp(0.5 * (std::lgamma(2 * j + 1) - std::lgamma(j + k + 1) -
+                                        std::lgamma(j - k + 1)));
+  return m > 0 ? binomial * std::pow(c, j + k) * std::pow(-s, j - k) :
+                 binomial * std::pow(c, j + k) * std::pow(s, j - k);
+}
+
+//! Coaxial coupling coefficients for each mu, indexed by n - max(1, |mu|) and l - max(1, |mu|)
+std::tuple<std::vector<Matrix<t_complex>>, std::vector<Matrix<t_complex>>>
+coaxial_coefficients(t_real distance, t_complex waveK, bool regular, t_int n_max) {
+  std::vector<Matrix<t_complex>> diagonal, offdiagonal;
+  CoaxialTranslationAdditionCoefficients const ta(distance, waveK, regular, n_max);
+  for(t_int mu(-n_max); mu <= n_max; ++mu) {
+    auto const first = std::max(1, std::abs(mu));
+    diagonal.emplace_back(n_max - first + 1, n_max - first + 1);
+    offdiagonal.emplace_back(n_max - first + 1, n_max - first + 1);
+    for(t_int n(first); n <= n_max; ++n)
+      for(t_int l(first); l <= n_max; ++l) {
+        diagonal.back()(n - first, l - first) = coefficients_A(n, mu, l, mu, ta);
+        offdiagonal.back()(n - first, l - first) = coefficients_B(n, mu, l, mu, ta);
+      }
+  }
+  return std::make_tuple(diagonal, offdiagonal);
+}
+
+//! Multiplies the rows of each harmonic n, m by exp(i sign m phi) and the rotation
+void rotate(Matrix<t_complex> &inout, std::vector<Matrix<t_real>> const &rotation, t_real phi,
+            t_int sign, bool forward) {
+  auto const N = inout.rows() / 2;
+  for(t_int n(1); n < static_cast<t_int>(rotation.size()); ++n) {
+    Vector<t_complex> phases(2 * n + 1);
+    for(t_int m(-n); m <= n; ++m)
+      phases(n - m) = std::exp(t_complex(0, sign * m * phi));
+    for(t_uint half(0); half < 2; ++half) {
+      auto block = inout.middleRows(half * N + n * n - 1, 2 * n + 1);
+      if(forward)
+        block = rotation[n].transpose() * (phases.asDiagonal() * block);
+      else
+        block = phases.asDiagonal() * (rotation[n] * block);
+    }
+  }
+}
+
+//! \brief RotationCoupling::apply with the number of harmonics fixed at compile time
+//! \details The columns are coupled one at a time, with every temporary sized by NMAX on the
+//! stack, so that the loops over the harmonics have constant bounds.
+template <t_int NMAX>
+Matrix<t_complex>
+apply_fixed(RotationCoupling const &coupling, Matrix<t_complex> const &input, bool transpose) {
+  constexpr t_int N = NMAX * (NMAX + 2);
+  typedef Eigen::Matrix<t_complex, Eigen::Dynamic, 1, Eigen::ColMajor, 2 * NMAX + 1, 1> Harmonics;
+  typedef Eigen::Matrix<t_complex, Eigen::Dynamic, 1, Eigen::ColMajor, NMAX, 1> Coaxial;
+  assert(input.rows() == 2 * N);
+
+  t_int const sign = transpose ? 1 : -1;
+  Eigen::Matrix<t_complex, 2 * NMAX + 1, 1> phases;
+  for(t_int m(-NMAX); m <= NMAX; ++m)
+    phases(NMAX - m) = std::exp(t_complex(0, sign * m * coupling.phi));
+
+  Matrix<t_complex> result(2 * N, input.cols());
+  Eigen::Matrix<t_complex, 2 * N, 1> x;
+  for(t_int col(0); col < input.cols(); ++col) {
+    x = input.col(col);
+    for(t_int n(1); n <= NMAX; ++n)
+      for(t_int half(0); half < 2; ++half) {
+        auto block = x.segment(half * N + n * n - 1, 2 * n + 1);
+        Harmonics const phased = phases.segment(NMAX - n, 2 * n + 1).cwiseProduct(block);
+        auto const &d = coupling.rotation[n];
+        for(t_int i(0); i < 2 * n + 1; ++i) {
+          t_real re = 0, im = 0;
+          for(t_int j(0); j < 2 * n + 1; ++j) {
+            re += d(j, i) * phased(j).real();
+            im += d(j, i) * phased(j).imag();
+          }
+          block(i) = t_complex(re, im);
+        }
+      }
+    for(t_int mu(-NMAX); mu <= NMAX; ++mu) {
+      auto const first = std::max(1, std::abs(mu));
+      auto const &A = coupling.diagonal[mu + NMAX];
+      auto const &B = coupling.offdiagonal[mu + NMAX];
+      t_int const size = NMAX - first + 1;
+      Coaxial upper(size), lower(size);
+      for(t_int n(first); n <= NMAX; ++n) {
+        upper(n - first) = x(flatten_indices(n, mu));
+        lower(n - first) = x(N + flatten_indices(n, mu));
+      }
+      for(t_int i(0); i < size; ++i) {
+        t_complex up = 0, low = 0;
+        for(t_int j(0); j < size; ++j) {
+          t_complex const a = transpose ? A(j, i) : A(i, j);
+          t_complex const b = transpose ? B(j, i) : B(i, j);
+          up += a * upper(j) + b * lower(j);
+          low += b * upper(j) + a * lower(j);
+        }
+        x(flatten_indices(i + first, mu)) = up;
+        x(N + flatten_indices(i + first, mu)) = low;
+      }
+    }
+    for(t_int n(1); n <= NMAX; ++n)
+      for(t_int half(0); half < 2; ++half) {
+        auto block = x.segment(half * N + n * n - 1, 2 * n + 1);
+        auto const &d = coupling.rotation[n];
+        Harmonics rotated = Harmonics::Zero(2 * n + 1);
+        for(t_int j(0); j < 2 * n + 1; ++j)
+          for(t_int i(0); i < 2 * n + 1; ++i)
+            rotated(i) += d(i, j) * block(j);
+        block = phases.segment(NMAX - n, 2 * n + 1).conjugate().cwiseProduct(rotated);
+      }
+    result.col(col) = x;
+  }
+  return result;
+}
 } // anonymous namespace
 
+std::vector<Matrix<t_real>> wigner_d(t_int nMax, t_real beta) {
+  std::vector<Matrix<t_real>> result;
+  for(t_int n(0); n <= nMax; ++n)
+    result.emplace_back(Matrix<t_real>::Zero(2 * n + 1, 2 * n + 1));
+  auto const c = std::cos(0.5 * beta);
+  auto const s = std::sin(0.5 * beta);
+  auto const cosb = std::cos(beta);
+  for(t_int m(-nMax); m <= nMax; ++m)
+    for(t_int mu(-nMax); mu <= nMax; ++mu) {
+      auto const j0 = std::max(std::abs(m), std::abs(mu));
+      t_real previous = 0, current = wigner_edge(m, mu, c, s);
+      result[j0](j0 - m, j0 - mu) = current;
+      for(t_int j(j0 + 1); j <= nMax; ++j) {
+        t_real const mm = m * m, mumu = mu * mu;
+        t_real const factor = j * (2 * j - 1) / std::sqrt((j * j - mm) * (j * j - mumu));
+        t_real next = cosb * current;
+        if(j > 1)
+          next -= m * mu * current / static_cast<t_real>(j * (j - 1)) +
+                  std::sqrt(((j - 1) * (j - 1) - mm) * ((j - 1) * (j - 1) - mumu)) /
+                      static_cast<t_real>((j - 1) * (2 * j - 1)) * previous;
+        previous = current;
+        current = factor * next;
+        result[j](j - m, j - mu) = current;
+      }
+    }
+  return result;
+}
+
+Coupling const &OriginCouplings::operator()(Spherical<t_real> const &R, t_complex waveK,
+                                            t_uint nMax) {
+  Key const key(R.rrr, R.the, R.phi, waveK.real(), waveK.imag(), nMax);
+  std::map<Key, Coupling>::const_iterator found;
+  bool known;
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_origin_couplings)
+#endif
+  {
+    found = couplings_.find(key);
+    known = found != couplings_.end();
+  }
+  if(known)
+    return found->second;
+
+  // computed outside of the lock, the references to the other couplings staying valid
+  Coupling coupling(R, waveK, nMax, false);
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_origin_couplings)
+#endif
+  found = couplings_.emplace(key, std::move(coupling)).first;
+  return found->second;
+}
+
+void OriginCouplings::clear() {
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_origin_couplings)
+#endif
+  couplings_.clear();
+}
+
+Matrix<t_complex> rotate_tmatrix(Matrix<t_complex> const &M, t_uint nMax, t_real alpha,
+                                 t_real beta, t_real gamma, bool internal) {
+  auto const pMax = nMax * (nMax + 2);
+  if(static_cast<t_uint>(M.rows()) != 2 * pMax or static_cast<t_uint>(M.cols()) != 2 * pMax)
+    throw std::runtime_error("The matrix to rotate does not match the number of harmonics");
+  auto const d = wigner_d(nMax, beta);
+  // D^n_m,mu = exp(i m alpha) d^n_m,mu(beta) exp(i mu gamma), the same for both halves
+  std::vector<Matrix<t_complex>> D(nMax + 1), right(nMax + 1);
+  for(t_uint n(1); n <= nMax; ++n) {
+    t_int const size = 2 * n + 1;
+    // the coefficients are stored with m increasing, the d matrices with n - m increasing
+    D[n] = d[n].reverse().cast<t_complex>();
+    for(t_int i(0); i < size; ++i) {
+      t_int const m = i - static_cast<t_int>(n);
+      D[n].row(i) *= std::exp(t_complex(0, m * alpha));
+      D[n].col(i) *= std::exp(t_complex(0, m * gamma));
+    }
+    // the internal coefficients carry an extra (-1)^m
+    right[n] = D[n];
+    if(internal)
+      for(t_int i(0); i < size; ++i)
+        for(t_int j(0); j < size; ++j)
+          if((i + j) % 2 == 1)
+            right[n](i, j) = -right[n](i, j);
+  }
+  // D M, block of rows by block of rows, then (D M) D^H, block of columns by block of columns
+  Matrix<t_complex> left(2 * pMax, 2 * pMax), result(2 * pMax, 2 * pMax);
+  for(t_uint half(0); half < 2; ++half)
+    for(t_uint n(1); n <= nMax; ++n)
+      left.middleRows(half * pMax + n * n - 1, 2 * n + 1).noalias() =
+          D[n] * M.middleRows(half * pMax + n * n - 1, 2 * n + 1);
+  for(t_uint half(0); half < 2; ++half)
+    for(t_uint n(1); n <= nMax; ++n)
+      result.middleCols(half * pMax + n * n - 1, 2 * n + 1).noalias() =
+          left.middleCols(half * pMax + n * n - 1, 2 * n + 1) * right[n].adjoint();
+  return result;
+}
+
 Coupling::Coupling(Spherical<t_real> relR, t_complex waveK, t_uint nMax, bool regular) {
   auto const n = Tools::iteratorMax(nMax);
   if(std::abs(relR.rrr) < errEpsilon) { // Check for NO translation case
     offdiagonal = Matrix<t_complex>::Zero(n, n);
     diagonal = Matrix<t_complex>::Identity(n, n);
+  } else {
+    TranslationAdditionCoefficients ta(relR, waveK, not regular, nMax);
+    std::tie(diagonal, offdiagonal) = transfer_coefficients(ta, nMax);
+  }
+}
+
+Coupling::Coupling(TranslationAdditionCoefficients ta, t_uint nMax) {
+  std::tie(diagonal, offdiagonal) = transfer_coefficients(ta, nMax);
+}
+
+RotationCoupling::RotationCoupling(Spherical<t_real> relR, t_complex waveK, t_uint nMax,
+                                   bool regular)
+    : nMax(nMax), phi(relR.phi), rotation(wigner_d(nMax, relR.the)) {
+  t_int const n_max = nMax;
+  if(std::abs(relR.rrr) < errEpsilon) { // Check for NO translation case
+    for(t_int mu(-n_max); mu <= n_max; ++mu) {
+      auto const size = n_max - std::max(1, std::abs(mu)) + 1;
+      diagonal.emplace_back(Matrix<t_complex>::Identity(size, size));
+      offdiagonal.emplace_back(Matrix<t_complex>::Zero(size, size));
+    }
   } else
-    std::tie(diagonal, offdiagonal) = transfer_coefficients(relR, waveK, not regular, nMax);
+    std::tie(diagonal, offdiagonal) = coaxial_coefficients(relR.rrr, waveK, not regular, nMax);
+}
+
+Matrix<t_complex> RotationCoupling::apply(Matrix<t_complex> const &input, bool transpose) const {
+  // the nMax of most runs have their own kernels, the others take the generic path below
+  switch(nMax) {
+  case 4:
+    return apply_fixed<4>(*this, input, transpose);
+  case 6:
+    return apply_fixed<6>(*this, input, transpose);
+  case 8:
+    return apply_fixed<8>(*this, input, transpose);
+  case 10:
+    return apply_fixed<10>(*this, input, transpose);
+  default:
+    break;
+  }
+  t_int const n_max = nMax;
+  t_int const N = Tools::iteratorMax(n_max);
+  assert(input.rows() == 2 * N);
+  // A = exp(i m phi) d A_z d^T exp(-i k phi), A^T = exp(-i m phi) d A_z^T d^T exp(i k phi)
+  t_int const sign = transpose ? 1 : -1;
+  Matrix<t_complex> result = input;
+  rotate(result, rotation, phi, sign, true);
+  for(t_int mu(-n_max); mu <= n_max; ++mu) {
+    auto const first = std::max(1, std::abs(mu));
+    auto const &A = diagonal[mu + n_max];
+    auto const &B = offdiagonal[mu + n_max];
+    Matrix<t_complex> upper(A.rows(), input.cols()), lower(A.rows(), input.cols());
+    for(t_int n(first); n <= n_max; ++n) {
+      upper.row(n - first) = result.row(flatten_indices(n, mu));
+      lower.row(n - first) = result.row(N + flatten_indices(n, mu));
+    }
+    Matrix<t_complex> const up = transpose ? (A.transpose() * upper + B.transpose() * lower).eval() :
+                                             (A * upper + B * lower).eval();
+    Matrix<t_complex> const low = transpose ? (B.transpose() * upper + A.transpose() * lower).eval() :
+                                              (B * upper + A * lower).eval();
+    for(t_int n(first); n <= n_max; ++n) {
+      result.row(flatten_indices(n, mu)) = up.row(n - first);
+      result.row(N + flatten_indices(n, mu)) = low.row(n - first);
+    }
+  }
+  rotate(result, rotation, phi, -sign, false);
+  return result;
 }
 } // namespace optimet
@@ -18,7 +18,11 @@
 #define COUPLING_H_
 
 #include "Tools.h"
+#include "TranslationAdditionCoefficients.h"
 #include "Types.h"
+#include <map>
+#include <tuple>
+#include <vector>
 
 namespace optimet {
 /**
@@ -38,7 +42,88 @@ struct Coupling {
    * @param nMax_ the maximum value of the n iterator.
    */
   Coupling(Spherical<t_real> relR_, t_complex waveK_, t_uint nMax_, bool regular_ = true);
+
+  /**
+   * Coupling coefficients from translation addition coefficients, e.g. those summed over the
+   * images of a lattice.
+   * @param ta_ the translation addition coefficients, tabulated up to nMax_.
+   * @param nMax_ the maximum value of the n iterator.
+   */
+  Coupling(TranslationAdditionCoefficients ta_, t_uint nMax_);
 };
+
+/**
+ * The OriginCouplings class keeps the couplings from the origin to the scatterers, with the
+ * Bessel functions, as used by the source vectors and the cross sections. Each is computed on
+ * first use and looked up by the later stages at the same position, wave number and order.
+ * It can be looked up from the threads of an OpenMP loop.
+ */
+class OriginCouplings {
+public:
+  //! The coupling Coupling(R, waveK, nMax, false) from the origin to R
+  Coupling const &operator()(Spherical<t_real> const &R, t_complex waveK, t_uint nMax);
+  //! Forgets all the couplings
+  void clear();
+  //! Number of couplings kept
+  std::size_t size() const { return couplings_.size(); }
+
+protected:
+  typedef std::tuple<t_real, t_real, t_real, t_real, t_real, t_uint> Key;
+  std::map<Key, Coupling> couplings_;
+};
+
+/**
+ * The RotationCoupling class implements the A and B coupling coefficients as
+ * a rotation onto the axis between two spheres, a coaxial translation, and the
+ * inverse rotation:
+ * A_nmlk(R) = exp(i(m - k)phi) sum_mu d^n_m,mu(theta) A_nl,mu(|R| z) d^l_k,mu(theta).
+ * The factors are computed and applied in O(nMax^3), rather than the
+ * O(nMax^4) of the full coefficients.
+ */
+struct RotationCoupling {
+  t_uint nMax;                         /**< The maximum value of the n iterator. */
+  t_real phi;                          /**< The azimuthal angle of the axis. */
+  std::vector<Matrix<t_real>> rotation; /**< Wigner d^n(theta), indexed by n - m and n - mu. */
+  /** Coaxial A_nl,mu coefficients, one block per mu, indexed by n - max(1, |mu|). */
+  std::vector<Matrix<t_complex>> diagonal;
+  /** Coaxial B_nl,mu coefficients, one block per mu, indexed by n - max(1, |mu|). */
+  std::vector<Matrix<t_complex>> offdiagonal;
+
+  /**
+   * Initialization constructor for the RotationCoupling class.
+   * @param relR_ the relative spherical vector between two spheres.
+   * @param waveK_ the complex wave number.
+   * @param regular_ the regular flag.
+   * @param nMax_ the maximum value of the n iterator.
+   */
+  RotationCoupling(Spherical<t_real> relR_, t_complex waveK_, t_uint nMax_, bool regular_ = true);
+
+  //! \brief Applies [A B; B A] to the columns of input
+  //! \details With transpose, applies its transpose [A^T B^T; B^T A^T] instead, i.e. the coupling
+  //! in the scattering matrix.
+  Matrix<t_complex> apply(Matrix<t_complex> const &input, bool transpose = false) const;
+};
+
+//! \brief Wigner d^n(beta) matrices for n <= nMax, indexed by n - m and n - mu
+//! \details Upward recurrence over n for each (m, mu), starting from the edges of the matrices.
+std::vector<Matrix<t_real>> wigner_d(t_int nMax, t_real beta);
+
+/**
+ * Rotates a T-matrix, or any matrix acting on the coefficients of the fields
+ * about the center of a particle, from the frame of the particle to the
+ * laboratory frame: D M D^H, where D^n_m,mu = exp(i m alpha) d^n_m,mu(beta)
+ * exp(i mu gamma) is block diagonal in n. The columns of the RgQ matrix act on
+ * the internal coefficients, which carry an extra (-1)^m: they are turned by
+ * (-1)^(m - mu) D^n_m,mu instead. Costs O(pMax^2 nMax).
+ * @param M the matrix in the frame of the particle, 2 pMax by 2 pMax.
+ * @param nMax the maximum value of the n iterator.
+ * @param alpha, beta, gamma the z-y-z Euler angles of the particle: it is turned by
+ * Rz(alpha) Ry(beta) Rz(gamma).
+ * @param internal true if the columns act on the internal coefficients.
+ * @return the matrix in the laboratory frame.
+ */
+Matrix<t_complex> rotate_tmatrix(Matrix<t_complex> const &M, t_uint nMax, t_real alpha,
+                                 t_real beta, t_real gamma, bool internal = false);
 }
 
 #endif /* COUPLING_H_ */
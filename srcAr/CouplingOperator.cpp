@@ -0,0 +1,228 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "CouplingOperator.h"
+#include "Bessel.h"
+#include "HMatrix.h"
+#include "Profile.h"
+#include "mpi/Communicator.h"
+#include <algorithm>
+#include <numeric>
+
+namespace optimet {
+
+CouplingCache::Couplings CouplingCache::take(t_complex waveK, t_uint nMax) {
+  // the wave numbers of the two harmonics are worked out from different wavelengths
+  for(auto i = sets_.begin(); i != sets_.end(); ++i)
+    if(i->nMax == nMax and std::abs(i->waveK - waveK) <= 1e-12 * std::abs(waveK)) {
+      auto const result = i->couplings;
+      sets_.erase(i);
+      return result;
+    }
+  return nullptr;
+}
+
+void CouplingCache::keep(t_complex waveK, t_uint nMax, Couplings const &couplings) {
+  sets_.push_back({waveK, nMax, couplings});
+}
+
+CouplingOperator::CouplingOperator(Matrix<t_complex> const &T, Geometry const &geometry,
+                                   t_complex waveK, t_uint nMax, bool SH, bool cache,
+                                   CouplingCache *couplings, bool keep)
+    : n_(2 * nMax * (nMax + 2)), nobj_(geometry.objects.size()), nMax_(nMax), waveK_(waveK),
+      SH_(SH), T_(T, n_) {
+  for(auto const &object : geometry.objects)
+    positions_.push_back(object.vR);
+
+  // the pairs are dealt to the processes in turn
+  mpi::Communicator communicator;
+  int const rank = communicator.rank();
+  int const size = communicator.size();
+  std::size_t p = 0;
+  for(t_uint ii = 0; ii < nobj_; ++ii)
+    for(t_uint jj = 0; jj < nobj_; ++jj) {
+      if(ii == jj)
+        continue;
+      if(p++ % size != static_cast<std::size_t>(rank))
+        continue;
+      pairs_.push_back({{ii, jj}});
+      orders_.push_back(SH ? nMax : std::min<t_uint>(nMax, geometry.coupling_order(ii, jj)));
+    }
+  if(geometry.get_couplingtolerance() > 0)
+    sparsify(T, geometry.get_couplingtolerance());
+  if(not cache)
+    return;
+
+  if(couplings)
+    couplings_ = couplings->take(waveK_, nMax_);
+  if(couplings_ and couplings_->size() == pairs_.size())
+    Profile::count("reused couplings", pairs_.size());
+  else {
+    auto computed = std::make_shared<std::vector<RotationCoupling>>();
+    for(std::size_t p = 0; p < pairs_.size(); ++p)
+      computed->push_back(coupling(p));
+    couplings_ = computed;
+  }
+  if(couplings and keep)
+    couplings->keep(waveK_, nMax_, couplings_);
+}
+
+RotationCoupling CouplingOperator::coupling(std::size_t p) const {
+  return RotationCoupling(positions_[pairs_[p][0]] - positions_[pairs_[p][1]], waveK_, orders_[p]);
+}
+
+Matrix<t_complex> CouplingOperator::apply(std::size_t p, Matrix<t_complex> const &input) const {
+  auto const apply = [this, p](Matrix<t_complex> const &x) -> Matrix<t_complex> {
+    return couplings_ ? (*couplings_)[p].apply(x, true) : coupling(p).apply(x, true);
+  };
+  if(orders_[p] == nMax_)
+    return apply(input);
+  // the leading M and N functions only
+  t_uint const n = n_ / 2, q = orders_[p] * (orders_[p] + 2);
+  Matrix<t_complex> leading(2 * q, input.cols());
+  leading << input.topRows(q), input.middleRows(n, q);
+  Matrix<t_complex> const output = apply(leading);
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(n_, input.cols());
+  result.topRows(q) = output.topRows(q);
+  result.middleRows(n, q) = output.bottomRows(q);
+  return result;
+}
+
+void CouplingOperator::sparsify(Matrix<t_complex> const &T, t_real tolerance) {
+  // the norms of the harmonics of each order of the T-matrices: the columns weigh the coupled
+  // coefficients, the rows those the FF couplings act on
+  t_uint const n = n_ / 2;
+  Matrix<t_real> columns(nMax_ + 1, nobj_), rows = Matrix<t_real>::Ones(nMax_ + 1, nobj_);
+  for(t_uint ii = 0; ii < nobj_; ++ii)
+    for(t_uint l = 1; l <= nMax_; ++l) {
+      auto const block = T.middleCols(ii * n_, n_);
+      columns(l, ii) = std::sqrt(block.middleCols(l * l - 1, 2 * l + 1).squaredNorm() +
+                                 block.middleCols(n + l * l - 1, 2 * l + 1).squaredNorm());
+      if(not SH_)
+        rows(l, ii) = std::sqrt(block.middleRows(l * l - 1, 2 * l + 1).squaredNorm() +
+                                block.middleRows(n + l * l - 1, 2 * l + 1).squaredNorm());
+    }
+
+  // the pairs of a row are spread over the processes, each neglects its share of the tolerance
+  t_real const budget = tolerance * tolerance / mpi::Communicator().size();
+  std::vector<std::array<t_uint, 2>> pairs;
+  std::vector<t_uint> orders;
+  std::vector<t_complex> hankel(2 * nMax_ + 1);
+  std::size_t dropped = 0, truncated = 0;
+  for(std::size_t first = 0, last = 0; first < pairs_.size(); first = last) {
+    while(last < pairs_.size() and pairs_[last][0] == pairs_[first][0])
+      ++last;
+    // the squared norms neglected by each pair of the row cut to q harmonics, all of them at q = 0
+    std::vector<std::vector<t_real>> tails;
+    for(std::size_t p = first; p < last; ++p) {
+      auto const ii = pairs_[p][0];
+      auto const jj = pairs_[p][1];
+      auto const order = orders_[p];
+      bessel<Hankel1>(waveK_ * (positions_[ii] - positions_[jj]).rrr, 2 * order, hankel.data(),
+                      nullptr);
+      std::vector<t_real> tail(order + 1, 0);
+      for(t_uint nn = 1; nn <= order; ++nn)
+        for(t_uint l = 1; l <= order; ++l) {
+          t_real h = 0;
+          for(t_uint j = std::max(nn, l) - std::min(nn, l); j <= nn + l; ++j)
+            h = std::max(h, std::abs(hankel[j]));
+          t_real const bound = columns(nn, ii) * std::sqrt((2.0 * nn + 1) * (2.0 * l + 1)) * h *
+                               rows(l, jj);
+          for(t_uint q = 0; q < std::max(nn, l); ++q)
+            tail[q] += bound * bound;
+        }
+      tails.push_back(tail);
+    }
+    // the weakest pairs are cut first
+    std::vector<std::size_t> weakest(last - first);
+    std::iota(weakest.begin(), weakest.end(), 0);
+    std::sort(weakest.begin(), weakest.end(),
+              [&tails](std::size_t a, std::size_t b) { return tails[a][0] < tails[b][0]; });
+    std::vector<t_uint> cut(last - first);
+    t_real neglected = 0;
+    for(auto const k : weakest) {
+      while(neglected + tails[k][cut[k]] > budget)
+        ++cut[k];
+      neglected += tails[k][cut[k]];
+    }
+    for(std::size_t k = 0; k < cut.size(); ++k) {
+      if(cut[k] == 0) {
+        ++dropped;
+        continue;
+      }
+      if(cut[k] < orders_[first + k])
+        ++truncated;
+      pairs.push_back(pairs_[first + k]);
+      orders.push_back(cut[k]);
+    }
+  }
+  pairs_ = pairs;
+  orders_ = orders;
+  Profile::count("dropped couplings", dropped);
+  Profile::count("truncated couplings", truncated);
+}
+
+Vector<t_complex> CouplingOperator::operator*(Vector<t_complex> const &x) const {
+  return (*this * Matrix<t_complex>(x)).col(0);
+}
+
+Matrix<t_complex> CouplingOperator::operator*(Matrix<t_complex> const &X) const {
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(rows(), X.cols());
+  // the first harmonic couples T_j x_j, computed once for each jj
+  std::vector<Matrix<t_complex>> inputs(nobj_);
+  for(std::size_t p = 0; p < pairs_.size(); ++p) {
+    auto const ii = pairs_[p][0];
+    auto const jj = pairs_[p][1];
+    if(not SH_ and inputs[jj].size() == 0)
+      inputs[jj] = T_.left(jj, X.middleRows(jj * n_, n_));
+    Matrix<t_complex> const input = SH_ ? Matrix<t_complex>(X.middleRows(jj * n_, n_)) : inputs[jj];
+    Matrix<t_complex> const output = apply(p, input);
+    if(SH_)
+      result.middleRows(ii * n_, n_) += output;
+    else
+      result.middleRows(ii * n_, n_) -= output;
+  }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *mpi::Communicator());
+#endif
+  if(SH_)
+    for(t_uint ii = 0; ii < nobj_; ++ii)
+      result.middleRows(ii * n_, n_) = T_.left(ii, result.middleRows(ii * n_, n_));
+  return result + X;
+}
+
+t_real CouplingOperator::memory() const {
+  t_real result = T_.memory();
+  if(couplings_)
+    for(auto const &AB : *couplings_) {
+      for(auto const &d : AB.rotation)
+        result += d.size() * (8.0 / 1e6);
+      for(std::size_t mu = 0; mu < AB.diagonal.size(); ++mu)
+        result += (AB.diagonal[mu].size() + AB.offdiagonal[mu].size()) * (16.0 / 1e6);
+    }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &result, 1, MPI_DOUBLE, MPI_SUM, *mpi::Communicator());
+#endif
+  return result;
+}
+
+Vector<t_complex> Gmres_Zcomp(CouplingOperator const &S, Vector<t_complex> const &Y, double tol,
+                              int maxit, int no_rest, Vector<t_complex> const &x0) {
+  return Gmres([&S](Vector<t_complex> const &x) -> Vector<t_complex> { return S * x; }, S.rows(), Y,
+               tol, maxit, no_rest, x0);
+}
+}
@@ -0,0 +1,133 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_COUPLING_OPERATOR_H
+#define OPTIMET_COUPLING_OPERATOR_H
+
+#include "Coupling.h"
+#include "Geometry.h"
+#include "TmatrixBlocks.h"
+#include "Types.h"
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The CouplingCache class keeps the factorised couplings of the pairs of a process from one
+ * operator to the next one at the same wave number. The SH operator at a wavelength and the FF
+ * operator at half of it couple at the same wave number, when the background does not disperse.
+ */
+class CouplingCache {
+public:
+  //! The couplings of the pairs of a process, in the order of the pairs
+  typedef std::shared_ptr<std::vector<RotationCoupling> const> Couplings;
+
+  //! The couplings at this wave number and order, removed from the cache, or null
+  Couplings take(t_complex waveK, t_uint nMax);
+  //! Keeps the couplings at this wave number and order
+  void keep(t_complex waveK, t_uint nMax, Couplings const &couplings);
+  //! Drops all the couplings, e.g. when the scatterers move
+  void clear() { sets_.clear(); }
+
+protected:
+  struct Set {
+    t_complex waveK;
+    t_uint nMax;
+    Couplings couplings;
+  };
+  std::vector<Set> sets_;
+};
+
+/**
+ * The CouplingOperator class applies the scattering matrix without forming it.
+ * The product with a vector goes through the T-matrices and the rotation-coaxial
+ * factorisation of the couplings of each pair of scatterers. The pairs are
+ * shared between the MPI processes. Only the T-matrices and, if cached, the
+ * factorised couplings are stored, rather than the (nobj 2 pMax)^2 entries of
+ * the dense matrix. With a coupling tolerance in the geometry, the weakest pairs
+ * are dropped and the others cut to fewer harmonics, within that bound on the
+ * scattered coefficients.
+ */
+class CouplingOperator {
+public:
+  /**
+   * Initialization constructor for the CouplingOperator class.
+   * @param T the T-matrices of the scatterers side by side, 2 pMax by nobj 2 pMax.
+   * @param geometry the geometry of the simulation.
+   * @param waveK the wave number of the couplings.
+   * @param nMax the maximum value of the n iterator.
+   * @param SH whether the blocks are T_i C_ij, as for the second harmonic, or -C_ij T_j.
+   * @param cache whether the couplings are stored or computed at each product.
+   * @param couplings couplings kept by an earlier operator, taken from it if at this wave number.
+   * @param keep whether the couplings are left in the cache for a later operator.
+   */
+  CouplingOperator(Matrix<t_complex> const &T, Geometry const &geometry, t_complex waveK,
+                   t_uint nMax, bool SH, bool cache = true, CouplingCache *couplings = nullptr,
+                   bool keep = false);
+
+  //! Product of the scattering matrix with a vector, the result is known on all processes
+  Vector<t_complex> operator*(Vector<t_complex> const &x) const;
+  //! Product with the columns of a matrix at once, each coupling being applied once for all of them
+  Matrix<t_complex> operator*(Matrix<t_complex> const &X) const;
+
+  //! Number of rows of the matrix
+  t_uint rows() const { return n_ * nobj_; }
+  //! Memory held by all the processes, in MB
+  t_real memory() const;
+
+protected:
+  //! The size of the block of one scatterer
+  t_uint n_;
+  //! The number of scatterers
+  t_uint nobj_;
+  //! The maximum value of the n iterator
+  t_uint nMax_;
+  //! The wave number of the couplings
+  t_complex waveK_;
+  //! Whether this is the second harmonic operator
+  bool SH_;
+  //! The T-matrices of the scatterers
+  TmatrixBlocks T_;
+  //! The positions of the scatterers
+  std::vector<Spherical<t_real>> positions_;
+  //! The pairs (ii, jj) of scatterers this process applies
+  std::vector<std::array<t_uint, 2>> pairs_;
+  //! \brief The harmonics of the coupling of each pair, below nMax if both are truncated
+  //! \details The other rows and columns of the block are left uncoupled.
+  std::vector<t_uint> orders_;
+  //! The couplings of the pairs, if cached
+  CouplingCache::Couplings couplings_;
+
+  //! The coupling of the pair p, from scatterer jj to scatterer ii
+  RotationCoupling coupling(std::size_t p) const;
+  //! Applies the coupling of the pair p to the columns of the input
+  Matrix<t_complex> apply(std::size_t p, Matrix<t_complex> const &input) const;
+  //! \brief Drops or truncates the pairs whose couplings change the scattered coefficients least
+  //! \details The block of orders n and l of a coupling at distance d is of the order of
+  //! sqrt((2n + 1)(2l + 1)) max |h_j(k d)| over |n - l| <= j <= n + l, weighted by the norms of
+  //! the T-matrices on either side. The pairs of each row are taken from the weakest one, each cut
+  //! to the fewest harmonics, none at all, that keeps the root sum square of the neglected blocks
+  //! of the row within tolerance.
+  void sparsify(Matrix<t_complex> const &T, t_real tolerance);
+};
+
+//! Solves S x = Y with restarted GMRES, S applied through the coupling operator
+Vector<t_complex> Gmres_Zcomp(CouplingOperator const &S, Vector<t_complex> const &Y, double tol,
+                              int maxit, int no_rest, Vector<t_complex> const &x0 = Vector<t_complex>());
+}
+#endif
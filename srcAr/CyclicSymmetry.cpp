@@ -0,0 +1,181 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "CyclicSymmetry.h"
+#include "Tools.h"
+#include "constants.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace optimet {
+namespace {
+//! Whether two angles are the same, modulo 2 pi
+bool same_angle(t_real a, t_real b) { return std::abs(std::remainder(a - b, 2 * consPi)) <= 1e-9; }
+
+//! \brief Whether b has the T-matrix of a turned by angle about the z axis
+//! \details Spheres are unchanged by any rotation, and a shape turned by the angle in the
+//! laboratory frame adds it to its first Euler angle, or to the sum of the first and last one
+//! when the second is zero. A shape invariant under its own rotations about z is unchanged.
+bool turned_copy(Scatterer const &a, Scatterer const &b, t_real angle, t_uint order) {
+  if(not a.sameTmatrix(b) or a.truncation() != b.truncation())
+    return false;
+  if(a.kind() == Scatterer::sphere)
+    return true;
+  auto const &x = a.orientation, &y = b.orientation;
+  if(x[1] == 0 and y[1] == 0) {
+    if(same_angle(y[0] + y[2], x[0] + x[2] + angle))
+      return true;
+    return same_angle(y[0] + y[2], x[0] + x[2]) and a.getNOrotations() % order == 0;
+  }
+  return same_angle(y[0], x[0] + angle) and same_angle(y[1], x[1]) and same_angle(y[2], x[2]);
+}
+
+//! \brief The orbits of the objects under the rotations by 2 pi / order about z, in turn
+//! \details Empty if an object has no turned copy, or lies on the axis.
+std::vector<std::vector<t_uint>> find_orbits(Geometry const &geometry, t_uint order) {
+  auto const &objects = geometry.objects;
+  auto const nobj = objects.size();
+  if(order < 2 or nobj % order != 0)
+    return {};
+  t_real extent = 0;
+  std::vector<Cartesian<t_real>> positions;
+  for(auto const &object : objects) {
+    positions.push_back(Tools::toCartesian(object.vR));
+    extent = std::max(extent, object.vR.rrr + object.radius);
+  }
+  t_real const angle = 2 * consPi / order, tolerance = 1e-9 * extent;
+  t_real const c = std::cos(angle), s = std::sin(angle);
+  // the image of each object under a single rotation
+  std::vector<t_uint> image(nobj);
+  for(t_uint i = 0; i < nobj; ++i) {
+    auto const &R = positions[i];
+    Cartesian<t_real> const turned(c * R.x - s * R.y, s * R.x + c * R.y, R.z);
+    t_uint j = 0;
+    while(j < nobj and
+          (std::sqrt((positions[j] - turned) * (positions[j] - turned)) > tolerance or
+           not turned_copy(objects[i], objects[j], angle, order)))
+      ++j;
+    if(j == nobj or j == i)
+      return {};
+    image[i] = j;
+  }
+  // off the axis, each object comes back after order rotations and no fewer
+  std::vector<std::vector<t_uint>> result;
+  std::vector<bool> seen(nobj, false);
+  for(t_uint i = 0; i < nobj; ++i) {
+    if(seen[i])
+      continue;
+    std::vector<t_uint> orbit;
+    for(t_uint j = i; not seen[j]; j = image[j]) {
+      seen[j] = true;
+      orbit.push_back(j);
+    }
+    if(orbit.size() != order or image[orbit.back()] != i)
+      return {};
+    result.push_back(orbit);
+  }
+  return result;
+}
+
+//! The factors exp(i m angle) the coefficients pick up when the fields turn by angle about z
+Vector<t_complex> rotation(t_uint nMax, t_real angle) {
+  t_uint const pMax = nMax * (nMax + 2);
+  Vector<t_complex> result(2 * pMax);
+  for(t_uint n = 1; n <= nMax; ++n)
+    for(t_int m = -static_cast<t_int>(n); m <= static_cast<t_int>(n); ++m)
+      result(n * (n + 1) + m - 1) = result(n * (n + 1) + m - 1 + pMax) = std::polar(1.0, m * angle);
+  return result;
+}
+} // namespace
+
+CyclicSymmetry::CyclicSymmetry(Geometry const &geometry, t_uint order)
+    : order_(order), orbits_(find_orbits(geometry, order)) {
+  if(orbits_.empty())
+    throw std::runtime_error("The objects are not invariant under the rotations by 2 pi / " +
+                             std::to_string(order) + " about the z axis, with none on the axis");
+}
+
+t_uint CyclicSymmetry::detect(Geometry const &geometry) {
+  for(t_uint order = geometry.objects.size(); order >= 2; --order)
+    if(not find_orbits(geometry, order).empty())
+      return order;
+  return 1;
+}
+
+void CyclicSymmetry::factorise(t_uint nMax, PairBlock const &block,
+                               mpi::Communicator const &communicator) {
+  nMax_ = nMax;
+  n_ = 2 * nMax * (nMax + 2);
+  communicator_ = communicator;
+  t_uint const M = orbits_.size(), N = order_, m = M * n_;
+  // the blocks from the first object of each orbit to the k-th of each orbit, turned back by k
+  // rotations, in the k-th block of columns, shared out between the processes
+  Matrix<t_complex> blocks = Matrix<t_complex>::Zero(m, N * m);
+  for(t_uint b = communicator.rank(); b < M * M * N; b += communicator.size()) {
+    auto const o = b % M, other = (b / M) % M, k = b / (M * M);
+    blocks.block(o * n_, k * m + other * n_, n_, n_) =
+        block(orbits_[o][0], orbits_[other][k]) * rotation(nMax, 2 * consPi * k / N).asDiagonal();
+  }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, blocks.data(), blocks.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *communicator);
+#endif
+  // the matrix of representation q is the sum of the blocks k times exp(2 i pi q k / N)
+  representations_.clear();
+  for(t_uint q = communicator.rank(); q < N; q += communicator.size()) {
+    Matrix<t_complex> S = Matrix<t_complex>::Zero(m, m);
+    for(t_uint k = 0; k < N; ++k)
+      S += std::polar(1.0, 2 * consPi * ((q * k) % N) / N) * blocks.middleCols(k * m, m);
+    representations_.emplace_back(q, S.partialPivLu());
+  }
+}
+
+Matrix<t_complex> CyclicSymmetry::turn(Matrix<t_complex> const &X, bool back) const {
+  Matrix<t_complex> result(X.rows(), X.cols());
+  for(auto const &orbit : orbits_)
+    for(t_uint j = 0; j < order_; ++j)
+      result.middleRows(orbit[j] * n_, n_) =
+          rotation(nMax_, (back ? -2 : 2) * consPi * j / order_).asDiagonal() *
+          X.middleRows(orbit[j] * n_, n_);
+  return result;
+}
+
+Matrix<t_complex> CyclicSymmetry::solve(Matrix<t_complex> const &Y) const {
+  t_uint const M = orbits_.size(), N = order_, m = M * n_;
+  // the coefficients turned back to the first object of their orbit
+  Matrix<t_complex> const Z = turn(Y, true);
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(Y.rows(), Y.cols());
+  for(auto const &representation : representations_) {
+    auto const q = representation.first;
+    Matrix<t_complex> Zq = Matrix<t_complex>::Zero(m, Y.cols());
+    for(t_uint o = 0; o < M; ++o)
+      for(t_uint j = 0; j < N; ++j)
+        Zq.middleRows(o * n_, n_) +=
+            std::polar(1.0, -2 * consPi * ((q * j) % N) / N) * Z.middleRows(orbits_[o][j] * n_, n_);
+    Matrix<t_complex> const Xq = representation.second.solve(Zq);
+    for(t_uint o = 0; o < M; ++o)
+      for(t_uint j = 0; j < N; ++j)
+        result.middleRows(orbits_[o][j] * n_, n_) +=
+            std::polar(1.0 / N, 2 * consPi * ((q * j) % N) / N) * Xq.middleRows(o * n_, n_);
+  }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *communicator_);
+#endif
+  return turn(result, false);
+}
+}
@@ -0,0 +1,92 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_CYCLIC_SYMMETRY_H
+#define OPTIMET_CYCLIC_SYMMETRY_H
+
+#include "Geometry.h"
+#include "Types.h"
+#include "mpi/Communicator.h"
+#include <Eigen/LU>
+#include <functional>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The CyclicSymmetry class solves the scattering matrix of an arrangement invariant under the
+ * rotations by 2 pi / order about the z axis, e.g. a ring or a regular polygon of particles.
+ * Each rotation takes the objects of an orbit to the next one, and turns the coefficients of
+ * azimuthal order m by exp(i m alpha): in the coefficients turned back to the first object of
+ * their orbit, the scattering matrix is block circulant over the rotations. A discrete Fourier
+ * transform over them splits it into one matrix per irreducible representation, each as large
+ * as the orbits are many. The order matrices are assembled from the blocks of the first object
+ * of each orbit and factorised in turn by the processes, for order^2 times fewer operations than
+ * the whole matrix. The excitation need not be symmetric.
+ */
+class CyclicSymmetry {
+public:
+  //! Block of the scattering matrix coupling object ii to object jj
+  typedef std::function<Matrix<t_complex>(t_uint ii, t_uint jj)> PairBlock;
+
+  /**
+   * Finds the orbits of the objects under the rotations.
+   * @param geometry the geometry of the simulation.
+   * @param order the number of rotations, 2 pi / order each.
+   * @throw std::runtime_error if the arrangement is not invariant under them, or an object
+   * lies on the axis.
+   */
+  CyclicSymmetry(Geometry const &geometry, t_uint order);
+
+  //! Largest order the arrangement is invariant under, without an object on the axis, 1 if none
+  static t_uint detect(Geometry const &geometry);
+
+  /**
+   * Assembles and factorises the matrices of the irreducible representations, each process those
+   * of its own. Collective over communicator.
+   * @param nMax the harmonics of the blocks.
+   * @param block function returning the block coupling two scatterers.
+   */
+  void factorise(t_uint nMax, PairBlock const &block,
+                 mpi::Communicator const &communicator = mpi::Communicator());
+
+  //! \brief Solves S X = Y for the columns of Y
+  //! \details Collective over the communicator of the factorisation, the result being known
+  //! on all its processes.
+  Matrix<t_complex> solve(Matrix<t_complex> const &Y) const;
+
+  //! The number of rotations
+  t_uint order() const { return order_; }
+
+protected:
+  //! The number of rotations
+  t_uint order_;
+  //! The size of the block of one scatterer
+  t_uint n_ = 0;
+  //! The maximum value of the n iterator
+  t_uint nMax_ = 0;
+  //! \brief The objects of each orbit, the first one turned by j rotations being the j-th
+  std::vector<std::vector<t_uint>> orbits_;
+  //! The communicator sharing the representations
+  mpi::Communicator communicator_;
+  //! The representations q of this process, with the factorisations of their matrices
+  std::vector<std::pair<t_uint, Eigen::PartialPivLU<Matrix<t_complex>>>> representations_;
+
+  //! \brief Turns the coefficients of the j-th object of each orbit by j rotations, or back
+  Matrix<t_complex> turn(Matrix<t_complex> const &X, bool back) const;
+};
+}
+#endif
@@ -15,7 +15,56 @@
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
 #include "ElectroMagnetic.h"
+#include "MaterialTable.h"
 #include "constants.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+//! Schinke data for silicon, tabulated every 0.01um from 0.25um to 1.45um
+struct SchinkeTable {
+  double first = 0.25, step = 0.01;
+  std::vector<double> refInd = {1.6370, 1.7370, 2.0300, 2.8400,4.1850,5.0490,5.0910,5.0850,5.1350,5.2450,5.4230,5.9140,6.8200,6.5870,6.0250,
+5.6230,5.3410,5.1100,4.9320,4.7900,4.6730,4.5720,4.4850,4.4120,4.3490,4.2890,4.2350,
+4.1870,4.1450,4.1030,4.0730,4.0380,4.0060,3.9770,3.9540,3.9310,3.9080,3.8880,3.8690,
+3.8510,3.8350,3.8170,3.8050,3.7910,3.7760,3.7650,3.7530,3.7410,3.7300,3.7190,3.7120,
+3.7010,3.6930,3.6840,3.6770,3.6690,3.6620,3.6550,3.6460,3.6410,3.6360,3.6280,3.6220,
+3.6170,3.6130,3.6100,3.6040,3.5980,3.5970,3.5900,3.5840,3.5840,3.5780,3.5820,3.5790,
+3.5750,3.5720,3.5680,3.5650,3.5620,3.5590,3.5560,3.5530,3.5490,3.5470,3.5450,3.5420,
+3.5400,3.5370,3.5340,3.5330,3.5300,3.5270,3.5260,3.5240,3.5220,3.5200,3.5180,3.5170,
+3.5150,3.5130,3.5120,3.5090,3.5090,3.5060,3.5050,3.5030,3.5020,3.5010,3.5000,3.4990,
+3.4970,3.4960,3.4960,3.4960,3.4930,3.4920,3.4920,3.4900,3.4880,3.4870
+};
+  std::vector<double> Extcoeff = {3.5889,3.9932,4.5958,5.1961,5.3124,4.2900,3.6239,3.2824,3.0935,2.9573,
+  2.9078,2.9135,2.1403,0.9840,0.5031,0.3263,0.2413,0.1769,0.1377,0.1120,0.0954,0.0791,
+  0.0702,0.0598,0.0538,0.0485,0.0438,0.0395,0.0348,0.0299,0.0280,0.0266,0.0237,0.0219,
+  0.0201,0.0185,0.0173,0.0168,0.0163,0.0147,0.0144,0.0136,0.0128,0.0120,0.0113,0.0106,
+  0.0100,0.0093,0.0087,0.0082,0.0076,0.0071,0.0066,0.0061,0.0057,0.0053,0.0049,0.0045,
+  0.0041,0.0038,0.0035,0.0032,0.0029,0.0026,0.0023,0.0021,0.0019,0.0017,0.0015,0.0013,
+  0.0011,9.8243e-04,8.4060e-04,7.1334e-04,5.9638e-04,4.9020e-04,3.9616e-04,3.1437e-04,
+  2.4048e-04,1.7959e-04,1.3043e-04,9.2450e-05,6.7820e-05,5.2168e-05,3.9770e-05,3.0217e-05,
+  2.2913e-05,1.7068e-05,1.2382e-05,8.6210e-06,5.6876e-06,3.4275e-06,1.7653e-06,5.5561e-07,
+  2.3153e-07,1.3904e-07,8.0863e-08,4.7940e-08,2.7132e-08,1.4318e-08,5.8798e-09,2.3352e-09,
+  1.2714e-09,7.5284e-10,4.4799e-10,2.7228e-10,1.5856e-10,8.7196e-11,4.2039e-11,1.8128e-11,
+  1.0428e-11,6.2911e-12,3.9030e-12,2.6367e-12,1.7377e-12,1.0428e-12,6.0422e-13,4.2895e-13,
+  2.0381e-13,1.3785e-13,1.0901e-13
+  };
+};
+
+//! \brief Complex refractive index of silicon, linearly interpolated in the Schinke table
+//! \details The table is uniform, so that the bin is found directly.
+std::complex<double> schinke_index(double lambdaum) {
+  static SchinkeTable const table;
+  auto const position = (lambdaum - table.first) / table.step;
+  auto const last = static_cast<int>(table.refInd.size()) - 1;
+  if(position < -1e-9 or position > last + 1e-9)
+    throw std::runtime_error("The silicon model is tabulated from 0.25um to 1.45um");
+  auto const i = std::max(0, std::min(static_cast<int>(position), last - 1));
+  auto const t = position - i;
+  return std::complex<double>((1 - t) * table.refInd[i] + t * table.refInd[i + 1],
+                              (1 - t) * table.Extcoeff[i] + t * table.Extcoeff[i + 1]);
+}
+}
 
 ElectroMagnetic::ElectroMagnetic() {
   init_r(std::complex<double>(1.0, 0.0), std::complex<double>(1.0, 0.0), std::complex<double>(1.0, 0.0), std::complex<double>(1.0, 0.0), std::complex<double>(1.0, 0.0), std::complex<double>(1.0, 0.0));
@@ -143,93 +192,17 @@ void ElectroMagnetic::populateHydrodynamicModel() {
 
 
 void ElectroMagnetic::initSiliconModel_r(std::complex<double> mu_r_) {
-  
-  refInd = {1.6370, 1.7370, 2.0300, 2.8400,4.1850,5.0490,5.0910,5.0850,5.1350,5.2450,5.4230,5.9140,6.8200,6.5870,6.0250,
-5.6230,5.3410,5.1100,4.9320,4.7900,4.6730,4.5720,4.4850,4.4120,4.3490,4.2890,4.2350,
-4.1870,4.1450,4.1030,4.0730,4.0380,4.0060,3.9770,3.9540,3.9310,3.9080,3.8880,3.8690,
-3.8510,3.8350,3.8170,3.8050,3.7910,3.7760,3.7650,3.7530,3.7410,3.7300,3.7190,3.7120,
-3.7010,3.6930,3.6840,3.6770,3.6690,3.6620,3.6550,3.6460,3.6410,3.6360,3.6280,3.6220,
-3.6170,3.6130,3.6100,3.6040,3.5980,3.5970,3.5900,3.5840,3.5840,3.5780,3.5820,3.5790,
-3.5750,3.5720,3.5680,3.5650,3.5620,3.5590,3.5560,3.5530,3.5490,3.5470,3.5450,3.5420,
-3.5400,3.5370,3.5340,3.5330,3.5300,3.5270,3.5260,3.5240,3.5220,3.5200,3.5180,3.5170,
-3.5150,3.5130,3.5120,3.5090,3.5090,3.5060,3.5050,3.5030,3.5020,3.5010,3.5000,3.4990,
-3.4970,3.4960,3.4960,3.4960,3.4930,3.4920,3.4920,3.4900,3.4880,3.4870
-};
-  
-  Extcoeff = {3.5889,3.9932,4.5958,5.1961,5.3124,4.2900,3.6239,3.2824,3.0935,2.9573,
-  2.9078,2.9135,2.1403,0.9840,0.5031,0.3263,0.2413,0.1769,0.1377,0.1120,0.0954,0.0791,
-  0.0702,0.0598,0.0538,0.0485,0.0438,0.0395,0.0348,0.0299,0.0280,0.0266,0.0237,0.0219,
-  0.0201,0.0185,0.0173,0.0168,0.0163,0.0147,0.0144,0.0136,0.0128,0.0120,0.0113,0.0106,
-  0.0100,0.0093,0.0087,0.0082,0.0076,0.0071,0.0066,0.0061,0.0057,0.0053,0.0049,0.0045,
-  0.0041,0.0038,0.0035,0.0032,0.0029,0.0026,0.0023,0.0021,0.0019,0.0017,0.0015,0.0013,
-  0.0011,9.8243e-04,8.4060e-04,7.1334e-04,5.9638e-04,4.9020e-04,3.9616e-04,3.1437e-04,
-  2.4048e-04,1.7959e-04,1.3043e-04,9.2450e-05,6.7820e-05,5.2168e-05,3.9770e-05,3.0217e-05,
-  2.2913e-05,1.7068e-05,1.2382e-05,8.6210e-06,5.6876e-06,3.4275e-06,1.7653e-06,5.5561e-07,
-  2.3153e-07,1.3904e-07,8.0863e-08,4.7940e-08,2.7132e-08,1.4318e-08,5.8798e-09,2.3352e-09,
-  1.2714e-09,7.5284e-10,4.4799e-10,2.7228e-10,1.5856e-10,8.7196e-11,4.2039e-11,1.8128e-11,
-  1.0428e-11,6.2911e-12,3.9030e-12,2.6367e-12,1.7377e-12,1.0428e-12,6.0422e-13,4.2895e-13,
-  2.0381e-13,1.3785e-13,1.0901e-13
-  };
-
   mu_r = mu_r_;
 
   modelType = 4;
 }
 
 void ElectroMagnetic::populateSiliconModel() {
+  // the SH wavelength is half the FF one
+  auto const nFF = schinke_index(lambda * 1e6), nSH = schinke_index(lambda * 1e6 / 2.0);
 
-double nFF, nSH, kFF, kSH, lambdaumFF, lambdaumSH, lambdastep1, lambdastep2;
-
-double epsrFF_real, epsrFF_imag, epsrSH_real, epsrSH_imag;
-
-int brojac;
-
-lambdaumFF = lambda * 1e6;
-lambdaumSH = lambdaumFF / 2.0 ;
-
- for(brojac = 0; brojac < Extcoeff.size(); brojac++) {
-     
-     lambdastep1 = 0.25 + brojac * 0.01;   
-     lambdastep2 = 0.25 + (brojac+1) * 0.01; 
-          if ((lambdaumFF>=lambdastep1)&&(lambdaumFF<=lambdastep2))
-                break;                 
-     }
-     
-       nFF = refInd[brojac] + 
-                        ((refInd[brojac+1] - refInd[brojac])/(lambdastep2 - lambdastep1)) * 
-                         (lambdaumFF-lambdastep1);
-                         
-       kFF = Extcoeff[brojac] + 
-                        ((Extcoeff[brojac+1] - Extcoeff[brojac])/(lambdastep2 - lambdastep1)) * 
-                         (lambdaumFF-lambdastep1);       
-                         
-                         
-  for(brojac = 0; brojac < Extcoeff.size(); brojac++) {
-     
-     lambdastep1 = 0.25 + brojac * 0.01;   
-     lambdastep2 = 0.25 + (brojac+1) * 0.01; 
-          if ((lambdaumSH>=lambdastep1)&&(lambdaumSH<=lambdastep2))
-                break;                 
-     }
-     
-       nSH = refInd[brojac] + 
-                        ((refInd[brojac+1] - refInd[brojac])/(lambdastep2 - lambdastep1)) * 
-                         (lambdaumSH-lambdastep1);
-                         
-       kSH = Extcoeff[brojac] + 
-                        ((Extcoeff[brojac+1] - Extcoeff[brojac])/(lambdastep2 - lambdastep1)) * 
-                         (lambdaumSH-lambdastep1);                               
-                                                      
-
-  epsrFF_real = std::pow (nFF, 2) - std::pow (kFF, 2);
-  epsrFF_imag = 2.0 * nFF * kFF;
-  
-  epsrSH_real = std::pow (nSH, 2) - std::pow (kSH, 2);
-  epsrSH_imag = 2.0 * nSH * kSH; 
-  
-  epsilon_r =  epsrFF_real + std::complex<double>(0.0, 1.0)*epsrFF_imag;
-                    
-  epsilon_r_SH =  epsrSH_real + std::complex<double>(0.0, 1.0)*epsrSH_imag;
+  epsilon_r = nFF * nFF;
+  epsilon_r_SH = nSH * nSH;
 
   epsilon_SH = epsilon_r_SH * consEpsilon0;
   
@@ -240,6 +213,57 @@ lambdaumSH = lambdaumFF / 2.0 ;
   gamma = 1.3e-19; 
 }
 
+void ElectroMagnetic::initTabulatedModel_r(std::shared_ptr<optimet::MaterialTable const> table_,
+                                           std::complex<double> mu_r_,
+                                           std::complex<double> ksippp_,
+                                           std::complex<double> ksiparppar_,
+                                           std::complex<double> gamma_) {
+  table = table_;
+  preloaded.reset();
+  mu_r = mu_r_;
+  ksippp = ksippp_;
+  ksiparppar = ksiparppar_;
+  gamma = gamma_;
+
+  modelType = 5;
+}
+
+void ElectroMagnetic::populateTabulatedModel() {
+  auto const found = preloaded ? preloaded->find(lambda) : preloaded_type::const_iterator();
+  if(preloaded and found != preloaded->end())
+    std::tie(epsilon_r, epsilon_r_SH) = found->second;
+  else {
+    epsilon_r = (*table)(lambda);
+    epsilon_r_SH = (*table)(lambda / 2.0);
+  }
+
+  epsilon_SH = epsilon_r_SH * consEpsilon0;
+
+  epsilon = epsilon_r * consEpsilon0;
+}
+
+void ElectroMagnetic::preload(std::vector<double> const &lambdas) {
+  if(modelType != 5)
+    return;
+  Eigen::Map<optimet::Vector<double> const> const FF(lambdas.data(), lambdas.size());
+  optimet::Vector<std::complex<double>> const epsFF = (*table)(FF), epsSH = (*table)(FF / 2.0);
+  auto result = std::make_shared<preloaded_type>();
+  for(std::size_t i = 0; i < lambdas.size(); ++i)
+    result->emplace(lambdas[i], std::make_pair(epsFF(i), epsSH(i)));
+  preloaded = result;
+}
+
+bool ElectroMagnetic::same_model(ElectroMagnetic const &other) const {
+  if(modelType != other.modelType or mu_r != other.mu_r)
+    return false;
+  if(modelType == 3)
+    return a_SH == other.a_SH and b_SH == other.b_SH and d_SH == other.d_SH;
+  if(modelType == 5)
+    return table == other.table and ksippp == other.ksippp and
+           ksiparppar == other.ksiparppar and gamma == other.gamma;
+  return modelType == 4;
+}
+
 
 void ElectroMagnetic::update(double lambda_) {
   lambda = lambda_;
@@ -257,4 +281,8 @@ void ElectroMagnetic::update(double lambda_) {
   {
     populateSiliconModel();
   }  
+  if (modelType == 5) // Tabulated model
+  {
+    populateTabulatedModel();
+  }
 }
@@ -18,8 +18,15 @@
 #define ELECTROMAGNETIC_H_
 
 #include <complex>
+#include <map>
+#include <memory>
+#include <utility>
 #include <vector>
 
+namespace optimet {
+class MaterialTable;
+}
+
 /**
  * @brief The ElectroMagnetic class implements EM properties for scatterers.
  * The ElectroMagnetic class can be used to create a collection of related
@@ -52,14 +59,16 @@ public:
    */
   virtual ~ElectroMagnetic();
   // Model variables
-  int modelType; /**< Mode being used. Currently supports 0-fixed, 3-Hydrodynamic_Gold_Johnson, 4-Silicon_Schinke */
+  int modelType; /**< Mode being used. Currently supports 0-fixed, 3-Hydrodynamic_Gold_Johnson, 4-Silicon_Schinke, 5-Tabulated */
   
   double lambda;
- 
-
-// Schinke data for lambda range 0.5 - 1.45um
 
-   std::vector<double> refInd, Extcoeff;
+  //! Tabulated relative permittivity, for the tabulated model
+  std::shared_ptr<optimet::MaterialTable const> table;
+  //! Relative permittivities at the FF and SH wavelengths, by wavelength
+  typedef std::map<double, std::pair<std::complex<double>, std::complex<double>>> preloaded_type;
+  //! Permittivities preloaded for the wavelengths of a scan, for the tabulated model
+  std::shared_ptr<preloaded_type const> preloaded;
 
   // Fundamental Frequency variables
   std::complex<double> epsilon;   /**< The absolute electric permittivity. */
@@ -105,10 +114,36 @@ public:
 
   void initSiliconModel_r(std::complex<double> mu_r_);
   
+  /**
+   * Initialization function for a relative permittivity tabulated against the wavelength.
+   * @param table_ the tabulated permittivity, shared with the other objects of the material.
+   * @param mu_r_ the complex relative value for permeability.
+   * other parameters are the constant surface and bulk tensor values for the second harmonic
+   */
+  void initTabulatedModel_r(std::shared_ptr<optimet::MaterialTable const> table_,
+                            std::complex<double> mu_r_, std::complex<double> ksippp,
+                            std::complex<double> ksiparppar, std::complex<double> gamma);
+
   void populateHydrodynamicModel();
 
   void populateSiliconModel();
 
+  void populateTabulatedModel();
+
+  /**
+   * Evaluates a tabulated permittivity at once for all the wavelengths of a scan, at which
+   * update then only looks it up.
+   * @param lambdas the wavelengths of the scan.
+   */
+  void preload(std::vector<double> const &lambdas);
+
+  /**
+   * Whether both objects follow the same dispersive model with the same parameters, so that
+   * one evaluation at each wavelength serves both.
+   * @param other the properties to compare with.
+   */
+  bool same_model(ElectroMagnetic const &other) const;
+
   /**
    * Updates the ElectroMagnetic object to a new wavelength.
    * @param lambda_ the new wavelength.
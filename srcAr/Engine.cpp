@@ -0,0 +1,169 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Engine.h"
+#ifdef OPTIMET_MPI
+#include "Profile.h"
+#include "Result.h"
+#include "Run.h"
+#include "Solver.h"
+#include "Tools.h"
+#include <mpi.h>
+#include <stdexcept>
+
+namespace optimet {
+
+std::vector<double *> Engine::tables(Run const &run) {
+  // no tables, the W numbers being computed where they are used
+  auto const nMax = run.geometry->nMax(), nMaxS = run.geometry->nMaxS();
+  if(run.onthefly_tables) {
+    run.geometry->couplings(nMax, nMaxS);
+    return std::vector<double *>(9, nullptr);
+  }
+  if(tables_.empty() or nMax != nMax_ or nMaxS != nMaxS_) {
+    Profile::Region const timer("CLG coefficients");
+    int const sizeCF = run.geometry->couplings(nMax, nMaxS).size();
+    int const size = communicator_.size(), rank = communicator_.rank();
+    // each process computes a contiguous slice, then all of them gather the tables
+    std::vector<int> counts(size), displs(size + 1, 0);
+    for(int r = 0; r < size; ++r) {
+      counts[r] = sizeCF / size + (r < sizeCF % size ? 1 : 0);
+      displs[r + 1] = displs[r] + counts[r];
+    }
+    std::vector<std::vector<double>> slices(9, std::vector<double>(counts[rank]));
+    std::vector<double *> CLGcoeff_par;
+    for(auto &slice : slices)
+      CLGcoeff_par.push_back(slice.data());
+    run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, displs[rank], displs[rank + 1]);
+    tables_.assign(9, std::vector<double>(sizeCF));
+    for(int i = 0; i < 9; i++)
+      MPI_Allgatherv(slices[i].data(), counts[rank], MPI_DOUBLE, tables_[i].data(), counts.data(),
+                     displs.data(), MPI_DOUBLE, *communicator_);
+    nMax_ = nMax;
+    nMaxS_ = nMaxS;
+  }
+  std::vector<double *> result;
+  for(auto &table : tables_)
+    result.push_back(table.data());
+  return result;
+}
+
+Engine::Response Engine::solve(Run &run, t_real wavelength) {
+  run.communicator = communicator_;
+  run.excitation->updateWavelength(wavelength);
+  run.geometry->update(run.excitation);
+  if(not solver_ or run.geometry != geometry_ or run.excitation != excitation_) {
+    solver_ = solver::factory(run);
+    geometry_ = run.geometry;
+    excitation_ = run.excitation;
+  }
+  else {
+    Profile::Region const timer("solver update");
+    solver_->update(run);
+  }
+
+  Response result;
+  auto const CLGcoeff = run.excitation->SH_cond ? tables(run) : std::vector<double *>(9, nullptr);
+  auto const nInc = run.excitation->nIncidences();
+  if(nInc == 1) {
+    Vector<t_complex> scatter_coef, internal_coef, scatter_coef_SH, internal_coef_SH;
+    solver_->solve(scatter_coef, internal_coef, scatter_coef_SH, internal_coef_SH, CLGcoeff);
+    result.scatter_coef = scatter_coef;
+    result.internal_coef = internal_coef;
+    result.scatter_coef_SH = scatter_coef_SH;
+    result.internal_coef_SH = internal_coef_SH;
+  }
+  else
+    solver_->solve_incidences(result.scatter_coef, result.internal_coef, result.scatter_coef_SH,
+                              result.internal_coef_SH, CLGcoeff);
+
+  // each process adds up the cross sections of a contiguous share of the scatterers
+  int const nobj = run.geometry->objects.size();
+  int const size = communicator_.size(), rank = communicator_.rank();
+  int const gran1 = rank * (nobj / size) + std::min(rank, nobj % size);
+  int const gran2 = gran1 + nobj / size + (rank < nobj % size ? 1 : 0);
+  result.extinction = Vector<t_real>::Zero(nInc);
+  result.scattering = Vector<t_real>::Zero(nInc);
+  result.scattering_SH = Vector<t_real>::Zero(nInc);
+  for(t_uint inc = 0; inc < nInc; ++inc) {
+    Result response(run.geometry, nInc == 1 ? run.excitation : run.excitation->incidence(inc));
+    response.couplings = solver_->origin_couplings();
+    response.scatter_coef = result.scatter_coef.col(inc);
+    response.internal_coef = result.internal_coef.col(inc);
+    if(solver_->sources().cols() == static_cast<t_int>(nInc))
+      response.incident_coef = solver_->sources().col(inc);
+    result.extinction(inc) = response.getExtinctionCrossSection(gran1, gran2);
+    result.scattering(inc) = response.getScatteringCrossSection(gran1, gran2);
+    if(run.excitation->SH_cond) {
+      response.scatter_coef_SH = result.scatter_coef_SH.col(inc);
+      response.internal_coef_SH = result.internal_coef_SH.col(inc);
+      result.scattering_SH(inc) = response.getScatteringCrossSection_SH(gran1, gran2);
+    }
+  }
+  for(auto cs : {&result.extinction, &result.scattering, &result.scattering_SH})
+    MPI_Allreduce(MPI_IN_PLACE, cs->data(), nInc, MPI_DOUBLE, MPI_SUM, *communicator_);
+  result.absorption = result.extinction - result.scattering;
+  return result;
+}
+
+CrossSectionGradient Engine::gradient(Run &run, t_real wavelength) {
+  run.communicator = communicator_;
+  run.excitation->updateWavelength(wavelength);
+  run.geometry->update(run.excitation);
+  if(wavelength != wavelength_)
+    Tmatrices_.clear();
+  wavelength_ = wavelength;
+  auto const TRgQ =
+      getTRgQmatrix_FF_parr(*run.geometry, run.excitation, &Tmatrices_, communicator_);
+  return cross_section_gradient(*run.geometry, run.excitation, TRgQ.leftCols(TRgQ.cols() / 2),
+                                communicator_);
+}
+
+Engine::Fields Engine::fields(Run &run, Response const &response, t_uint incidence,
+                              std::vector<Cartesian<t_real>> const &points) {
+  auto const nInc = run.excitation->nIncidences();
+  if(incidence >= nInc or static_cast<t_int>(incidence) >= response.scatter_coef.cols())
+    throw std::out_of_range("No such incidence in the solution");
+  Result result(run.geometry, nInc == 1 ? run.excitation : run.excitation->incidence(incidence));
+  result.scatter_coef = response.scatter_coef.col(incidence);
+  result.internal_coef = response.internal_coef.col(incidence);
+  if(run.excitation->SH_cond) {
+    result.scatter_coef_SH = response.scatter_coef_SH.col(incidence);
+    result.internal_coef_SH = response.internal_coef_SH.col(incidence);
+  }
+  std::vector<double> Rr, Rthe, Rphi;
+  for(auto const &point : points) {
+    auto const R = Tools::toSpherical(point);
+    Rr.push_back(R.rrr);
+    Rthe.push_back(R.the);
+    Rphi.push_back(R.phi);
+  }
+  auto const CLGcoeff = run.excitation->SH_cond ? tables(run) : std::vector<double *>(9, nullptr);
+  Fields fields;
+  result.getFields(Rr, Rthe, Rphi, false, CLGcoeff, fields.E_FF, fields.H_FF, fields.E_SH,
+                   fields.H_SH);
+  return fields;
+}
+
+void Engine::clear() {
+  Tmatrices_.clear();
+  solver_.reset();
+  geometry_.reset();
+  excitation_.reset();
+  tables_.clear();
+}
+} // namespace optimet
+#endif
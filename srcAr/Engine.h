@@ -0,0 +1,114 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_ENGINE_H
+#define OPTIMET_ENGINE_H
+
+#include "Cartesian.h"
+#include "Gradient.h"
+#include "PreconditionedMatrix.h"
+#include "SphericalP.h"
+#include "Types.h"
+#include "mpi/Communicator.h"
+#include <memory>
+#include <vector>
+
+#ifdef OPTIMET_MPI
+class Geometry;
+namespace optimet {
+class Excitation;
+class Run;
+namespace solver {
+class AbstractSolver;
+}
+
+/**
+ * The Engine class solves runs one after the other within a program, without
+ * case files. The solver, with the T-matrices of the particles it has met, and
+ * the CLG tables are kept from one call to the next, so that runs moving the
+ * particles or changing the wavelength only compute what changed. The results
+ * are returned in memory, nothing is written.
+ */
+class Engine {
+public:
+  //! The solution of a run at one wavelength, one column or entry per incidence
+  struct Response {
+    Matrix<t_complex> scatter_coef, internal_coef, scatter_coef_SH, internal_coef_SH;
+    Vector<t_real> extinction, scattering, absorption, scattering_SH;
+  };
+  //! The cartesian components of the fields at points, one entry per point
+  struct Fields {
+    std::vector<SphericalP<t_complex>> E_FF, H_FF, E_SH, H_SH;
+  };
+
+  //! The processes solving the runs together
+  Engine(mpi::Communicator const &comm = mpi::Communicator()) : communicator_(comm) {}
+
+  /**
+   * Solves a run at a wavelength, collective over the communicator of the engine.
+   * The run may be modified between calls, e.g. moving its objects. A run with
+   * another geometry or excitation gets a new solver.
+   * @param run the run, read once with simulation_input or built in memory.
+   * @param wavelength the wavelength of the fundamental frequency, in m.
+   * @return the coefficients and cross sections, on all the processes.
+   */
+  Response solve(Run &run, t_real wavelength);
+
+  /**
+   * Cross sections at the fundamental frequency and their derivatives with respect to the
+   * centres of the objects, from a direct factorization and its adjoint solve. The T-matrices
+   * are kept from one call to the next at the same wavelength.
+   * @param run the run, with all its objects of the same number of harmonics.
+   * @param wavelength the wavelength of the fundamental frequency, in m.
+   */
+  CrossSectionGradient gradient(Run &run, t_real wavelength);
+
+  /**
+   * The fields at points of an incidence of a solution, collective over the communicator of the
+   * engine. The run must be at the wavelength of the solution, that of the last call to solve().
+   * @param run the run of the solution.
+   * @param response the solution.
+   * @param incidence the incidence, a column of the coefficients.
+   * @param points the points, in cartesian coordinates in m.
+   * @return the fields, those of the SH zero without SH sources.
+   */
+  Fields fields(Run &run, Response const &response, t_uint incidence,
+                std::vector<Cartesian<t_real>> const &points);
+
+  //! Forgets the solver and the tables, e.g. to free their memory
+  void clear();
+
+  mpi::Communicator const &communicator() const { return communicator_; }
+
+private:
+  mpi::Communicator communicator_;
+  //! The solver and the geometry and excitation it was built for
+  std::shared_ptr<solver::AbstractSolver> solver_;
+  std::shared_ptr<Geometry> geometry_;
+  std::shared_ptr<Excitation> excitation_;
+  //! The CLG tables of the SH sources, for nMax_ and nMaxS_
+  std::vector<std::vector<double>> tables_;
+  t_uint nMax_ = 0, nMaxS_ = 0;
+  //! The T-matrices of the gradients, at wavelength_
+  TmatrixCache Tmatrices_;
+  t_real wavelength_ = 0;
+
+  //! The CLG tables of the run, computed on first use
+  std::vector<double *> tables(Run const &run);
+};
+} // namespace optimet
+#endif
+#endif
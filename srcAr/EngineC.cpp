@@ -0,0 +1,176 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "EngineC.h"
+#ifdef OPTIMET_MPI
+#include "Engine.h"
+#include "Reader.h"
+#include "Run.h"
+#include "Tools.h"
+#include "constants.h"
+#include "mpi/Session.h"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct optimet_engine {
+  optimet::Engine engine;
+  optimet::Run run;
+  optimet::Engine::Response response;
+  std::string error;
+};
+
+namespace {
+//! Runs a call, keeping the message of its exception if it throws
+template <class CALL> int guarded(optimet_engine const *engine, CALL const &call) {
+  auto &error = const_cast<optimet_engine *>(engine)->error;
+  try {
+    call();
+    error.clear();
+    return 0;
+  } catch(std::exception const &e) {
+    error = e.what();
+  }
+  return 1;
+}
+} // namespace
+
+void optimet_initialize(int argc, char const **argv) {
+  if(not optimet::mpi::initialized())
+    optimet::mpi::init(argc, argv);
+}
+
+void optimet_finalize(void) { optimet::mpi::finalize(); }
+
+optimet_engine *optimet_engine_create(char const *case_file) {
+  try {
+    std::unique_ptr<optimet_engine> result(new optimet_engine);
+    result->run = optimet::simulation_input(case_file, result->engine.communicator());
+    return result.release();
+  } catch(std::exception const &) {
+  }
+  return nullptr;
+}
+
+void optimet_engine_destroy(optimet_engine *engine) { delete engine; }
+
+char const *optimet_engine_error(optimet_engine const *engine) { return engine->error.c_str(); }
+
+unsigned optimet_engine_objects(optimet_engine const *engine) {
+  return engine->run.geometry->objects.size();
+}
+
+unsigned optimet_engine_incidences(optimet_engine const *engine) {
+  return engine->run.excitation->nIncidences();
+}
+
+unsigned optimet_engine_coefficients(optimet_engine const *engine) {
+  auto const nMax = engine->run.geometry->nMax();
+  return 2 * nMax * (nMax + 2) * engine->run.geometry->objects.size();
+}
+
+int optimet_engine_move(optimet_engine *engine, unsigned object, double x, double y, double z) {
+  return guarded(engine, [&]() {
+    auto &objects = engine->run.geometry->objects;
+    if(object >= objects.size())
+      throw std::out_of_range("No such object");
+    objects[object].vR = Tools::toSpherical(
+        Cartesian<double>(x * consFrnmTom, y * consFrnmTom, z * consFrnmTom));
+  });
+}
+
+int optimet_engine_solve(optimet_engine *engine, double wavelength, double *extinction,
+                         double *scattering, double *scattering_SH) {
+  return guarded(engine, [&]() {
+    engine->response = engine->engine.solve(engine->run, wavelength * consFrnmTom);
+    auto const &response = engine->response;
+    auto const n = response.extinction.size();
+    if(extinction)
+      std::copy(response.extinction.data(), response.extinction.data() + n, extinction);
+    if(scattering)
+      std::copy(response.scattering.data(), response.scattering.data() + n, scattering);
+    if(scattering_SH)
+      std::copy(response.scattering_SH.data(), response.scattering_SH.data() + n, scattering_SH);
+  });
+}
+
+int optimet_engine_gradient(optimet_engine *engine, double wavelength, double *extinction,
+                            double *scattering, double *d_extinction, double *d_scattering) {
+  return guarded(engine, [&]() {
+    auto const gradient = engine->engine.gradient(engine->run, wavelength * consFrnmTom);
+    auto const copy = [](optimet::Matrix<double> const &values, double scale, double *out) {
+      if(out)
+        for(optimet::Matrix<double>::Index i = 0; i < values.size(); ++i)
+          out[i] = scale * values.data()[i];
+    };
+    copy(gradient.extinction, 1, extinction);
+    copy(gradient.scattering, 1, scattering);
+    copy(gradient.d_extinction, consFrnmTom, d_extinction);
+    copy(gradient.d_scattering, consFrnmTom, d_scattering);
+  });
+}
+
+int optimet_engine_scatter_coef(optimet_engine const *engine, double *coefficients) {
+  return guarded(engine, [&]() {
+    auto const &coef = engine->response.scatter_coef;
+    if(coef.size() == 0)
+      throw std::runtime_error("Nothing was solved");
+    auto const values = reinterpret_cast<double const *>(coef.data());
+    std::copy(values, values + 2 * coef.size(), coefficients);
+  });
+}
+
+double const *optimet_engine_view(optimet_engine const *engine, optimet_coefficients which,
+                                  unsigned *rows, unsigned *columns) {
+  auto const &response = engine->response;
+  optimet::Matrix<optimet::t_complex> const *const all[] = {
+      &response.scatter_coef, &response.internal_coef, &response.scatter_coef_SH,
+      &response.internal_coef_SH};
+  auto const &coef = *all[which];
+  *rows = coef.size() > 0 ? coef.rows() : 0;
+  *columns = coef.size() > 0 ? coef.cols() : 0;
+  return coef.size() > 0 ? reinterpret_cast<double const *>(coef.data()) : nullptr;
+}
+
+int optimet_engine_fields(optimet_engine *engine, unsigned incidence, unsigned points,
+                          double const *xyz, double *E, double *H, double *E_SH, double *H_SH) {
+  return guarded(engine, [&]() {
+    if(engine->response.scatter_coef.size() == 0)
+      throw std::runtime_error("Nothing was solved");
+    std::vector<Cartesian<double>> X;
+    for(unsigned i = 0; i < points; ++i)
+      X.emplace_back(xyz[3 * i] * consFrnmTom, xyz[3 * i + 1] * consFrnmTom,
+                     xyz[3 * i + 2] * consFrnmTom);
+    auto const fields = engine->engine.fields(engine->run, engine->response, incidence, X);
+    auto const copy = [points](std::vector<SphericalP<std::complex<double>>> const &values,
+                               double *out) {
+      if(out)
+        for(unsigned i = 0; i < points; ++i)
+          for(auto const &c : {values[i].rrr, values[i].the, values[i].phi}) {
+            *out++ = c.real();
+            *out++ = c.imag();
+          }
+    };
+    copy(fields.E_FF, E);
+    copy(fields.H_FF, H);
+    copy(fields.E_SH, E_SH);
+    copy(fields.H_SH, H_SH);
+  });
+}
+#endif
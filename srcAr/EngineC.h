@@ -0,0 +1,82 @@
+/* (C) University College London 2017
+ * This file is part of Optimet, licensed under the terms of the GNU Public License
+ *
+ * Optimet is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Optimet is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPTIMET_ENGINE_C_H
+#define OPTIMET_ENGINE_C_H
+
+/* C interface of optimet::Engine, for programs solving many runs in a row. Lengths are in nm.
+ * All the calls are collective over the processes of MPI_COMM_WORLD. The functions returning
+ * an int return 0 on success, and otherwise leave a message for optimet_engine_error. */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct optimet_engine optimet_engine;
+
+/* Initializes MPI, unless the program did, and finalizes it */
+void optimet_initialize(int argc, char const **argv);
+void optimet_finalize(void);
+
+/* Reads a case file once, NULL if it cannot be read */
+optimet_engine *optimet_engine_create(char const *case_file);
+void optimet_engine_destroy(optimet_engine *engine);
+/* The last error, empty if none */
+char const *optimet_engine_error(optimet_engine const *engine);
+
+/* Numbers of objects, of incidences and of scattering coefficients of an incidence */
+unsigned optimet_engine_objects(optimet_engine const *engine);
+unsigned optimet_engine_incidences(optimet_engine const *engine);
+unsigned optimet_engine_coefficients(optimet_engine const *engine);
+
+/* Moves an object to the given cartesian position */
+int optimet_engine_move(optimet_engine *engine, unsigned object, double x, double y, double z);
+/* Solves at the wavelength, writing the cross sections of each incidence to the arrays, which
+ * may be NULL. The second harmonic ones are zero without second harmonic sources. */
+int optimet_engine_solve(optimet_engine *engine, double wavelength, double *extinction,
+                         double *scattering, double *scattering_SH);
+/* Cross sections at the fundamental frequency of each incidence, and their derivatives with
+ * respect to the positions of the objects in m^2 per nm: x, y and z of each object in turn,
+ * incidence after incidence, 3 * objects * incidences values. Any of the arrays may be NULL. */
+int optimet_engine_gradient(optimet_engine *engine, double wavelength, double *extinction,
+                            double *scattering, double *d_extinction, double *d_scattering);
+/* The scattering coefficients of the last solve, real and imaginary parts interleaved, incidence
+ * after incidence */
+int optimet_engine_scatter_coef(optimet_engine const *engine, double *coefficients);
+
+/* The coefficients of a solve */
+typedef enum {
+  optimet_scatter_coef,
+  optimet_internal_coef,
+  optimet_scatter_coef_SH,
+  optimet_internal_coef_SH
+} optimet_coefficients;
+/* The coefficients of the last solve in place, without a copy, as optimet_engine_scatter_coef:
+ * rows coefficients of each of columns incidences. NULL, with no rows or columns, if there are
+ * none. The values stay valid until the next solve or the destruction of the engine. */
+double const *optimet_engine_view(optimet_engine const *engine, optimet_coefficients which,
+                                  unsigned *rows, unsigned *columns);
+/* The fields of an incidence of the last solve at points given by their cartesian coordinates
+ * in nm, x, y and z of each point in turn. Each array, which may be NULL, receives the x, y and
+ * z components of each point, real and imaginary parts interleaved: 6 * points values. The SH
+ * fields are zero without second harmonic sources. */
+int optimet_engine_fields(optimet_engine *engine, unsigned incidence, unsigned points,
+                          double const *xyz, double *E, double *H, double *E_SH, double *H_SH);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
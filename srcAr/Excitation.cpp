@@ -17,7 +17,6 @@
 #include "Excitation.h"
 
 #include "Symbol.h"
-#include "Algebra.h"
 #include "Geometry.h"
 #include "AuxCoefficients.h"
 #include "CompoundIterator.h"
@@ -28,6 +27,7 @@
 
 #include <cmath>
 #include <iostream>
+#include <stdexcept>
 
 
 namespace optimet {
@@ -51,28 +51,22 @@ void Excitation::update(unsigned long type_, SphericalP<std::complex<double>> Ei
 int Excitation::populate() {
   optimet::AuxCoefficients coef(Spherical<double>(0.0, vKInc.the, vKInc.phi), waveK, 1, nMax);
 
-  CompoundIterator p; 
-   
-  for(p = 0; p < p.max(nMax); p++) {
-    SphericalP<std::complex<double>> C_local = coef.C(static_cast<long>(p));
-    SphericalP<std::complex<double>> B_local = coef.B(static_cast<long>(p));
-
-    SphericalP<std::complex<double>> conjAux(std::conj(C_local.rrr), std::conj(C_local.the),
-                                             std::conj(C_local.phi)); 
-    dataIncAp[p] = 4 * constant::pi * std::pow(-1.0, p.second) * std::pow(consCi, p.first) *
-                   coef.dn(p.first) * (conjAux * Einc) *
-                   std::exp(consCmi * (double)p.second * vKInc.phi);
-
-
-    conjAux =
-        SphericalP<std::complex<double>>(std::conj(B_local.rrr), std::conj(B_local.the),
-                                         std::conj(B_local.phi)); 
-    dataIncBp[p] = 4 * constant::pi * std::pow(-1.0, p.second) * std::pow(consCi, p.first - 1) *
-                   coef.dn(p.first) * (conjAux * Einc) *
-                   std::exp(consCmi * (double)p.second * vKInc.phi);
-                   
-                  
-  }
+  for(int n = 1; n <= static_cast<int>(nMax); ++n)
+    for(int m = n; m >= -n; --m) {
+      auto const p = optimet::flatten_indices(n, m);
+      SphericalP<std::complex<double>> C_local = coef.C(p);
+      SphericalP<std::complex<double>> B_local = coef.B(p);
+
+      SphericalP<std::complex<double>> conjAux(std::conj(C_local.rrr), std::conj(C_local.the),
+                                               std::conj(C_local.phi));
+      dataIncAp[p] = 4 * constant::pi * std::pow(-1.0, m) * std::pow(consCi, n) * coef.dn(n) *
+                     (conjAux * Einc) * std::exp(consCmi * (double)m * vKInc.phi);
+
+      conjAux = SphericalP<std::complex<double>>(std::conj(B_local.rrr), std::conj(B_local.the),
+                                                 std::conj(B_local.phi));
+      dataIncBp[p] = 4 * constant::pi * std::pow(-1.0, m) * std::pow(consCi, n - 1) *
+                     coef.dn(n) * (conjAux * Einc) * std::exp(consCmi * (double)m * vKInc.phi);
+    }
 
   return 0;
 }
@@ -80,58 +74,43 @@ int Excitation::populate() {
 
 
 int Excitation::getIncLocal(Spherical<double> point_, std::complex<double> *Inc_local_,
-                            int nMax_) const {
-  Spherical<double> Rrel = point_ - Spherical<double>(0.0, 0.0, 0.0);
-  optimet::Coupling const coupling(Rrel, waveK, nMax_, false);
-
-  CompoundIterator p, q;
-
-  int pMax = p.max(nMax_);
-  int qMax = q.max(nMax_);
-  
-
-  std::complex<double> *Inc_direct = new std::complex<double>[2 * pMax];
-  std::complex<double> **T_AB = new std::complex<double> *[2 * (p.max(nMax))];
-  for(p = 0; p < (int)(2 * p.max(nMax)); p++) {
-    T_AB[p] = new std::complex<double>[2 * p.max(nMax)];
-  }
-
-  for(p = 0; p < pMax; p++) {
-    Inc_direct[p] = dataIncAp[p]; //a_n coefficients in the expansion of the source
-    Inc_direct[p + pMax] = dataIncBp[p]; //b_n coefficients in the expansion of the source
-    
-  }
-  
-
-  for(p = 0; p < pMax; p++) {
-    for(q = 0; q < qMax; q++) {
-      T_AB[p][q] = coupling.diagonal(q, p);
-      T_AB[p + pMax][q + qMax] = coupling.diagonal(q, p);  // This is the transfer matrix
-      T_AB[p + pMax][q] = coupling.offdiagonal(q, p);
-      T_AB[p][q + qMax] = coupling.offdiagonal(q, p);
-      
-    }
-  }
-  
- 
-  
-  
-  Algebra::multiplyVectorMatrix(T_AB, 2 * pMax, 2 * pMax, Inc_direct, Inc_local_, consC1, consC0);
-  
-  
-
-  delete[] Inc_direct;
-
-  for(p = 0; p < 2 * pMax; p++) {
-    delete[] T_AB[p];
+                            int nMax_, OriginCouplings *couplings) const {
+  int const pMax = Tools::iteratorMax(nMax_);
+  Eigen::Map<Vector<t_complex>> local(Inc_local_, 2 * pMax);
+
+  // a plane wave only picks up its phase at the new origin
+  if(type == 0) {
+    Cartesian<double> direction = Tools::toCartesian(Spherical<double>(1.0, vKInc.the, vKInc.phi));
+    t_complex const phase = std::exp(consCi * waveK * (direction * Tools::toCartesian(point_)));
+    local.head(pMax) = phase * dataIncAp.head(pMax);
+    local.tail(pMax) = phase * dataIncBp.head(pMax);
+    return 0;
   }
 
-  delete[] T_AB;
+  // other sources are translated as regular expansions
+  Spherical<double> Rrel = point_ - Spherical<double>(0.0, 0.0, 0.0);
+  OriginCouplings local_couplings;
+  auto const &coupling = (couplings ? *couplings : local_couplings)(Rrel, waveK, nMax_);
+  local.head(pMax) = coupling.diagonal.transpose() * dataIncAp.head(pMax) +
+                     coupling.offdiagonal.transpose() * dataIncBp.head(pMax);
+  local.tail(pMax) = coupling.offdiagonal.transpose() * dataIncAp.head(pMax) +
+                     coupling.diagonal.transpose() * dataIncBp.head(pMax);
 
   return 0;
 }
 
-
+std::shared_ptr<Excitation> Excitation::incidence(t_uint i) const {
+  auto result = std::make_shared<Excitation>(*this);
+  if(incidences.size() == 0)
+    return result;
+  if(i >= incidences.size())
+    throw std::out_of_range("No such incidence");
+
+  result->incidences.clear();
+  result->update(type, incidences[i].Einc,
+                 Spherical<double>(vKInc.rrr, incidences[i].vKInc.the, incidences[i].vKInc.phi), nMax);
+  return result;
+}
 
 void Excitation::updateWavelength(double lambda_) {
   Spherical<double> vKInc_local = vKInc;
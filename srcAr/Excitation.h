@@ -22,9 +22,12 @@
 #include "constants.h"
 #include <complex>
 #include <memory>
+#include <vector>
 
 
 namespace optimet {
+class OriginCouplings;
+
 /**
  * The Excitation class implements the incoming wave coefficients.
  * Possible Excitation types are:
@@ -46,6 +49,16 @@ public:
   Vector<t_complex> dataIncBp; /**< The incoming wave b_n^m coefficients. */
 
   std::complex<double> waveK, bgcoef; /**< The incoming wave wavenumber. */
+
+  //! An incoming direction and polarization sharing the wavelength of the excitation
+  struct Incidence {
+    Spherical<double> vKInc;                 /**< Only the angles are used. */
+    SphericalP<std::complex<double>> Einc;   /**< The incoming wave values. */
+    t_real weight;                           /**< The weight in the orientation average. */
+  };
+  //! \brief The incidences solved together, the first one being vKInc and Einc
+  //! \details Empty for a single incidence.
+  std::vector<Incidence> incidences;
   
   
   /**
@@ -86,12 +99,23 @@ public:
    * @param point_ the new origin of the coordinate system.
    * @param Inc_local_ the incoming local matrix.
    * @param nMax_ the maximum value of the n iterator.
+   * @param couplings the couplings from the origin already computed, if any, else null.
    * @return 0 if successful, 1 otherwise.
    */
   int getIncLocal(Spherical<double> point_, std::complex<double> *Inc_local_,
-                  int nMax_) const;
+                  int nMax_, OriginCouplings *couplings = nullptr) const;
                   
                                           
+  //! Number of incidences solved with the same scattering matrix
+  t_uint nIncidences() const { return incidences.size() > 0 ? incidences.size() : 1; }
+  //! Weight of an incidence in the orientation average
+  t_real weight(t_uint i) const { return incidences.size() > 0 ? incidences[i].weight : 1e0; }
+  /**
+   * Returns the excitation of a single incidence, populated at the current wavelength.
+   * @param i the index of the incidence, 0 being vKInc and Einc.
+   */
+  std::shared_ptr<Excitation> incidence(t_uint i) const;
+
   /**
    * Updates the wavelength of the current excitation object to a new value.
    * @param lambda_ the new value of the wavelength.
@@ -0,0 +1,374 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "FMM.h"
+#include "HMatrix.h"
+#include "Tools.h"
+#include "mpi/Communicator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace optimet {
+
+namespace {
+//! Interleaves the bits of the integer coordinates of a leaf
+std::uint64_t morton(std::array<t_int, 3> const &index, t_uint depth) {
+  std::uint64_t result = 0;
+  for(t_uint bit = 0; bit < depth; ++bit)
+    for(t_uint d = 0; d < 3; ++d)
+      result |= static_cast<std::uint64_t>((index[d] >> bit) & 1) << (3 * bit + d);
+  return result;
+}
+
+//! Octant of a box within its parent
+t_uint octant(std::array<t_int, 3> const &index) {
+  return (index[0] & 1) | ((index[1] & 1) << 1) | ((index[2] & 1) << 2);
+}
+
+//! True if two boxes of the same level touch
+bool touch(std::array<t_int, 3> const &a, std::array<t_int, 3> const &b) {
+  for(t_uint d = 0; d < 3; ++d)
+    if(std::abs(a[d] - b[d]) > 1)
+      return false;
+  return true;
+}
+
+//! \brief Order of the expansions of a box
+//! \details Semi-empirical rule of the Helmholtz FMM, never below the order of the scatterers.
+t_uint expansion_order(t_complex waveK, t_real diameter, t_real digits, t_uint nMax) {
+  auto const kd = std::abs(waveK) * diameter;
+  auto const order = kd + 1.8 * std::pow(digits, 2e0 / 3e0) * std::cbrt(std::max(kd, 1e0));
+  return std::max<t_uint>(nMax, static_cast<t_uint>(std::ceil(order)));
+}
+
+//! Coefficients of an expansion of order from brought to order to, truncated or padded with zeros
+Vector<t_complex> resize(Vector<t_complex> const &input, t_uint from, t_uint to) {
+  t_uint const N = from * (from + 2);
+  t_uint const M = to * (to + 2);
+  Vector<t_complex> result = Vector<t_complex>::Zero(2 * M);
+  auto const common = std::min(N, M);
+  result.head(common) = input.head(common);
+  result.segment(M, common) = input.segment(N, common);
+  return result;
+}
+
+//! \brief Multiplies the coefficients of order n by (-1)^n, and by -(-1)^n for the second half
+//! \details Regular translations by -R are those by R with this applied before and after.
+Vector<t_complex> parity(Vector<t_complex> const &input, t_uint order) {
+  t_uint const N = order * (order + 2);
+  Vector<t_complex> result = input;
+  for(t_uint n = 1; n <= order; n += 2) {
+    result.segment(n * n - 1, 2 * n + 1) *= -1;
+    result.segment(N + n * n - 1, 2 * n + 1) *= -1;
+  }
+  result.tail(N) *= -1;
+  return result;
+}
+
+//! Translates an expansion of order from to an expansion of order to
+Vector<t_complex> translate(RotationCoupling const &AB, Vector<t_complex> const &input, t_uint from,
+                            t_uint to) {
+  Matrix<t_complex> const output = AB.apply(resize(input, from, AB.nMax), true);
+  return resize(output.col(0), AB.nMax, to);
+}
+
+//! Memory of the factors of a coupling, in MB
+t_real coupling_memory(RotationCoupling const &AB) {
+  t_real result = 0;
+  for(auto const &d : AB.rotation)
+    result += d.size() * (8.0 / 1e6);
+  for(std::size_t mu = 0; mu < AB.diagonal.size(); ++mu)
+    result += (AB.diagonal[mu].size() + AB.offdiagonal[mu].size()) * (16.0 / 1e6);
+  return result;
+}
+} // anonymous namespace
+
+FMMOperator::FMMOperator(Matrix<t_complex> const &T, Geometry const &geometry, t_complex waveK,
+                         t_uint nMax, bool SH, t_uint leaf, t_real digits)
+    : n_(2 * nMax * (nMax + 2)), nobj_(geometry.objects.size()), nMax_(nMax), SH_(SH), T_(T, n_),
+      leaves_({{0, 0}}) {
+  if(nobj_ == 0)
+    return;
+
+  // cube bounding the centers of the scatterers
+  std::vector<Cartesian<t_real>> positions;
+  std::array<t_real, 3> lower, upper;
+  lower.fill(std::numeric_limits<t_real>::max());
+  upper.fill(-std::numeric_limits<t_real>::max());
+  for(auto const &object : geometry.objects) {
+    positions.push_back(Tools::toCartesian(object.vR));
+    std::array<t_real, 3> const R{{positions.back().x, positions.back().y, positions.back().z}};
+    for(t_uint d = 0; d < 3; ++d) {
+      lower[d] = std::min(lower[d], R[d]);
+      upper[d] = std::max(upper[d], R[d]);
+    }
+  }
+  t_real width = 0;
+  for(t_uint d = 0; d < 3; ++d)
+    width = std::max(width, upper[d] - lower[d]);
+  width = width > 0 ? width * (1 + 1e-8) : 1e0;
+
+  // levels 0 and 1 have no well separated boxes
+  t_uint const depth = std::min<t_uint>(
+      10, std::max<t_uint>(2, std::ceil(std::log(nobj_ / static_cast<t_real>(std::max<t_uint>(
+                                                              leaf, 1))) /
+                                        std::log(8e0))));
+  boxes_.resize(depth + 1);
+  // no expansions are needed above level 2
+  orders_.assign(depth + 1, 0);
+  for(t_uint level = 2; level <= depth; ++level)
+    orders_[level] = expansion_order(waveK, std::sqrt(3e0) * width / (1u << level), digits, nMax);
+
+  // leaves in Morton order, then their parents level by level
+  t_real const leafWidth = width / (1u << depth);
+  std::vector<std::pair<std::uint64_t, t_uint>> keys;
+  std::vector<std::array<t_int, 3>> indices(nobj_);
+  for(t_uint i = 0; i < nobj_; ++i) {
+    std::array<t_real, 3> const R{{positions[i].x, positions[i].y, positions[i].z}};
+    for(t_uint d = 0; d < 3; ++d)
+      indices[i][d] = std::min<t_int>((1 << depth) - 1, (R[d] - lower[d]) / leafWidth);
+    keys.emplace_back(morton(indices[i], depth), i);
+  }
+  std::sort(keys.begin(), keys.end());
+  for(std::size_t i = 0; i < keys.size(); ++i) {
+    if(i == 0 or keys[i].first != keys[i - 1].first)
+      boxes_[depth].push_back(Box{indices[keys[i].second], Cartesian<t_real>(), -1, {}, {}});
+    boxes_[depth].back().objects.push_back(keys[i].second);
+  }
+  for(t_uint level = depth; level > 0; --level)
+    for(auto &box : boxes_[level]) {
+      std::array<t_int, 3> const index{{box.index[0] >> 1, box.index[1] >> 1, box.index[2] >> 1}};
+      if(boxes_[level - 1].empty() or boxes_[level - 1].back().index != index)
+        boxes_[level - 1].push_back(Box{index, Cartesian<t_real>(), -1, {}, {}});
+      box.parent = boxes_[level - 1].size() - 1;
+    }
+  std::vector<std::map<std::array<t_int, 3>, t_uint>> lookup(depth + 1);
+  for(t_uint level = 0; level <= depth; ++level)
+    for(t_uint b = 0; b < boxes_[level].size(); ++b) {
+      auto &box = boxes_[level][b];
+      t_real const w = width / (1u << level);
+      box.center = Cartesian<t_real>(lower[0] + (box.index[0] + 0.5) * w,
+                                     lower[1] + (box.index[1] + 0.5) * w,
+                                     lower[2] + (box.index[2] + 0.5) * w);
+      lookup[level][box.index] = b;
+    }
+
+  // interaction lists: children of the neighbours of the parent which do not touch the box
+  for(t_uint level = 2; level <= depth; ++level)
+    for(auto &box : boxes_[level]) {
+      auto const &parent = boxes_[level - 1][box.parent].index;
+      for(t_int dx = -1; dx <= 1; ++dx)
+        for(t_int dy = -1; dy <= 1; ++dy)
+          for(t_int dz = -1; dz <= 1; ++dz)
+            for(t_uint child = 0; child < 8; ++child) {
+              std::array<t_int, 3> const index{{2 * (parent[0] + dx) + static_cast<t_int>(child & 1),
+                                                2 * (parent[1] + dy) + static_cast<t_int>((child >> 1) & 1),
+                                                2 * (parent[2] + dz) + static_cast<t_int>((child >> 2) & 1)}};
+              auto const found = lookup[level].find(index);
+              if(found != lookup[level].end() and not touch(index, box.index))
+                box.far.push_back(found->second);
+            }
+    }
+
+  // contiguous leaves for each process, with the boxes above them
+  mpi::Communicator communicator;
+  t_uint const rank = communicator.rank();
+  t_uint const size = communicator.size();
+  t_uint const nleaves = boxes_[depth].size();
+  leaves_ = {{rank * nleaves / size, (rank + 1) * nleaves / size}};
+  needed_.resize(depth + 1);
+  for(t_uint b = leaves_[0]; b < leaves_[1]; ++b)
+    needed_[depth].push_back(b);
+  for(t_uint level = depth; level > 2; --level)
+    for(auto const b : needed_[level]) {
+      auto const parent = boxes_[level][b].parent;
+      if(needed_[level - 1].empty() or needed_[level - 1].back() != static_cast<t_uint>(parent))
+        needed_[level - 1].push_back(parent);
+    }
+
+  // translations between the levels and within each level only depend on relative positions
+  upward_.resize(depth + 1);
+  downward_.resize(depth + 1);
+  transfer_.resize(depth + 1);
+  for(t_uint level = 3; level <= depth; ++level) {
+    t_real const w = width / (1u << level);
+    auto const order = std::max(orders_[level - 1], orders_[level]);
+    for(t_uint child = 0; child < 8; ++child) {
+      Cartesian<t_real> const offset((child & 1 ? 0.5 : -0.5) * w, ((child >> 1) & 1 ? 0.5 : -0.5) * w,
+                                     ((child >> 2) & 1 ? 0.5 : -0.5) * w);
+      upward_[level].emplace_back(
+          Tools::toSpherical(Cartesian<t_real>(-offset.x, -offset.y, -offset.z)), waveK, order, false);
+      downward_[level].emplace_back(Tools::toSpherical(offset), waveK, order, false);
+    }
+  }
+  for(t_uint level = 2; level <= depth; ++level) {
+    t_real const w = width / (1u << level);
+    for(auto const b : needed_[level])
+      for(auto const source : boxes_[level][b].far) {
+        auto const &target = boxes_[level][b].index;
+        auto const &origin = boxes_[level][source].index;
+        std::array<t_int, 3> const offset{
+            {target[0] - origin[0], target[1] - origin[1], target[2] - origin[2]}};
+        if(transfer_[level].count(offset) == 0)
+          transfer_[level].emplace(
+              offset, RotationCoupling(Tools::toSpherical(Cartesian<t_real>(
+                                           offset[0] * w, offset[1] * w, offset[2] * w)),
+                                       waveK, orders_[level]));
+      }
+  }
+
+  // gathering, scattering and direct couplings of the leaves of this process
+  for(t_uint b = leaves_[0]; b < leaves_[1]; ++b) {
+    auto const &box = boxes_[depth][b];
+    for(auto const i : box.objects) {
+      auto const &R = positions[i];
+      auto const &c = box.center;
+      gather_.emplace_back(Tools::toSpherical(Cartesian<t_real>(c.x - R.x, c.y - R.y, c.z - R.z)),
+                           waveK, orders_[depth], false);
+    }
+    for(t_int dx = -1; dx <= 1; ++dx)
+      for(t_int dy = -1; dy <= 1; ++dy)
+        for(t_int dz = -1; dz <= 1; ++dz) {
+          auto const found =
+              lookup[depth].find({{box.index[0] + dx, box.index[1] + dy, box.index[2] + dz}});
+          if(found == lookup[depth].end())
+            continue;
+          for(auto const i : box.objects)
+            for(auto const j : boxes_[depth][found->second].objects)
+              if(i != j) {
+                near_.push_back({{i, j}});
+                nearCouplings_.emplace_back(geometry.objects[i].vR - geometry.objects[j].vR,
+                                            waveK, nMax);
+              }
+        }
+  }
+}
+
+Vector<t_complex> FMMOperator::couple(Vector<t_complex> const &x) const {
+  auto const depth = boxes_.size() - 1;
+  Vector<t_complex> result = Vector<t_complex>::Zero(rows());
+
+  // outgoing expansions of the leaves, then up the tree on every process
+  std::vector<std::vector<Vector<t_complex>>> outgoing(depth + 1);
+  for(t_uint level = 0; level <= depth; ++level)
+    outgoing[level].assign(boxes_[level].size(), Vector<t_complex>::Zero(2 * orders_[level] *
+                                                                         (orders_[level] + 2)));
+  std::size_t o = 0;
+  for(t_uint b = leaves_[0]; b < leaves_[1]; ++b)
+    for(auto const j : boxes_[depth][b].objects)
+      outgoing[depth][b] += translate(gather_[o++], x.segment(j * n_, n_), nMax_, orders_[depth]);
+#ifdef OPTIMET_MPI
+  t_uint const leafSize = 2 * orders_[depth] * (orders_[depth] + 2);
+  Vector<t_complex> leaves(leafSize * boxes_[depth].size());
+  for(t_uint b = 0; b < boxes_[depth].size(); ++b)
+    leaves.segment(b * leafSize, leafSize) = outgoing[depth][b];
+  MPI_Allreduce(MPI_IN_PLACE, leaves.data(), leaves.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *mpi::Communicator());
+  for(t_uint b = 0; b < boxes_[depth].size(); ++b)
+    outgoing[depth][b] = leaves.segment(b * leafSize, leafSize);
+#endif
+  for(t_uint level = depth; level > 2; --level)
+    for(t_uint b = 0; b < boxes_[level].size(); ++b) {
+      auto const &box = boxes_[level][b];
+      outgoing[level - 1][box.parent] += translate(upward_[level][octant(box.index)],
+                                                   outgoing[level][b], orders_[level],
+                                                   orders_[level - 1]);
+    }
+
+  // regular expansions of the boxes needed by this process, down the tree
+  std::vector<std::vector<Vector<t_complex>>> regular(depth + 1);
+  for(t_uint level = 2; level <= depth; ++level) {
+    regular[level].resize(boxes_[level].size());
+    for(auto const b : needed_[level]) {
+      auto const &box = boxes_[level][b];
+      Vector<t_complex> local = Vector<t_complex>::Zero(2 * orders_[level] * (orders_[level] + 2));
+      if(level > 2)
+        local = translate(downward_[level][octant(box.index)], regular[level - 1][box.parent],
+                          orders_[level - 1], orders_[level]);
+      for(auto const source : box.far) {
+        auto const &origin = boxes_[level][source].index;
+        std::array<t_int, 3> const offset{{box.index[0] - origin[0], box.index[1] - origin[1],
+                                           box.index[2] - origin[2]}};
+        local += translate(transfer_[level].at(offset), outgoing[level][source], orders_[level],
+                           orders_[level]);
+      }
+      regular[level][b] = local;
+    }
+  }
+
+  // evaluation at the scatterers, and direct couplings of the neighbours
+  o = 0;
+  for(t_uint b = leaves_[0]; b < leaves_[1]; ++b)
+    for(auto const i : boxes_[depth][b].objects)
+      result.segment(i * n_, n_) += parity(
+          translate(gather_[o++], parity(regular[depth][b], orders_[depth]), orders_[depth], nMax_),
+          nMax_);
+  for(std::size_t p = 0; p < near_.size(); ++p) {
+    Matrix<t_complex> const input = x.segment(near_[p][1] * n_, n_);
+    result.segment(near_[p][0] * n_, n_) += nearCouplings_[p].apply(input, true).col(0);
+  }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *mpi::Communicator());
+#endif
+  return result;
+}
+
+Vector<t_complex> FMMOperator::operator*(Vector<t_complex> const &x) const {
+  if(nobj_ == 0)
+    return x;
+  if(SH_) {
+    // T_i sum_j C_ij x_j
+    Vector<t_complex> result = couple(x);
+    for(t_uint ii = 0; ii < nobj_; ++ii)
+      result.segment(ii * n_, n_) = T_.left(ii, result.segment(ii * n_, n_));
+    return x + result;
+  }
+  // -sum_j C_ij T_j x_j
+  Vector<t_complex> input(rows());
+  for(t_uint jj = 0; jj < nobj_; ++jj)
+    input.segment(jj * n_, n_) = T_.left(jj, x.segment(jj * n_, n_));
+  return x - couple(input);
+}
+
+t_real FMMOperator::memory() const {
+  t_real result = T_.memory();
+  for(auto const &level : upward_)
+    for(auto const &AB : level)
+      result += coupling_memory(AB);
+  for(auto const &level : downward_)
+    for(auto const &AB : level)
+      result += coupling_memory(AB);
+  for(auto const &level : transfer_)
+    for(auto const &AB : level)
+      result += coupling_memory(AB.second);
+  for(auto const *couplings : {&gather_, &nearCouplings_})
+    for(auto const &AB : *couplings)
+      result += coupling_memory(AB);
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &result, 1, MPI_DOUBLE, MPI_SUM, *mpi::Communicator());
+#endif
+  return result;
+}
+
+Vector<t_complex> Gmres_Zcomp(FMMOperator const &S, Vector<t_complex> const &Y, double tol,
+                              int maxit, int no_rest, Vector<t_complex> const &x0) {
+  return Gmres([&S](Vector<t_complex> const &x) -> Vector<t_complex> { return S * x; }, S.rows(), Y,
+               tol, maxit, no_rest, x0);
+}
+}
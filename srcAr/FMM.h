@@ -0,0 +1,119 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_FMM_H
+#define OPTIMET_FMM_H
+
+#include "Cartesian.h"
+#include "Coupling.h"
+#include "Geometry.h"
+#include "TmatrixBlocks.h"
+#include "Types.h"
+#include <array>
+#include <map>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The FMMOperator class applies the scattering matrix with a multilevel fast
+ * multipole method. The scatterers are sorted into an octree. The scattered
+ * fields of each leaf are gathered into outgoing expansions about its center,
+ * passed up the tree, translated into regular expansions between well
+ * separated boxes of the same level, passed down the tree and finally
+ * evaluated at the scatterers. Only the scatterers in neighbouring leaves are
+ * coupled directly. All translations go through RotationCoupling.
+ * The leaves are shared between the MPI processes, in Morton order.
+ */
+class FMMOperator {
+public:
+  //! Box of the octree
+  struct Box {
+    std::array<t_int, 3> index;   /**< The integer coordinates of the box within its level. */
+    Cartesian<t_real> center;     /**< The center of the box. */
+    int parent;                   /**< The parent box in the level above, -1 at the top. */
+    std::vector<t_uint> objects;  /**< The scatterers in the box, for leaves. */
+    std::vector<t_uint> far;      /**< The interaction list, boxes of the same level. */
+  };
+
+  /**
+   * Initialization constructor for the FMMOperator class.
+   * @param T the T-matrices of the scatterers side by side, 2 pMax by nobj 2 pMax.
+   * @param geometry the geometry of the simulation.
+   * @param waveK the wave number of the couplings.
+   * @param nMax the maximum value of the n iterator.
+   * @param SH whether the blocks are T_i C_ij, as for the second harmonic, or -C_ij T_j.
+   * @param leaf the average number of scatterers in a leaf.
+   * @param digits the number of accurate digits sought from the expansions.
+   */
+  FMMOperator(Matrix<t_complex> const &T, Geometry const &geometry, t_complex waveK, t_uint nMax,
+              bool SH, t_uint leaf = 8, t_real digits = 6);
+
+  //! Product of the scattering matrix with a vector, the result is known on all processes
+  Vector<t_complex> operator*(Vector<t_complex> const &x) const;
+
+  //! Number of rows of the matrix
+  t_uint rows() const { return n_ * nobj_; }
+  //! Memory held by all the processes, in MB
+  t_real memory() const;
+  //! Number of levels of the octree
+  t_uint levels() const { return boxes_.size(); }
+  //! Order of the expansions of a level
+  t_uint order(t_uint level) const { return orders_[level]; }
+
+protected:
+  //! The size of the block of one scatterer
+  t_uint n_;
+  //! The number of scatterers
+  t_uint nobj_;
+  //! The maximum value of the n iterator of the scatterers
+  t_uint nMax_;
+  //! Whether this is the second harmonic operator
+  bool SH_;
+  //! The T-matrices of the scatterers
+  TmatrixBlocks T_;
+  //! The boxes of each level, the leaves being the last level
+  std::vector<std::vector<Box>> boxes_;
+  //! The order of the expansions of each level
+  std::vector<t_uint> orders_;
+  //! The first and one past the last leaf of this process
+  std::array<t_uint, 2> leaves_;
+  //! The boxes of each level whose regular expansion is needed by this process
+  std::vector<std::vector<t_uint>> needed_;
+
+  //! Outgoing translations from each octant of a box to its parent, by level of the child
+  std::vector<std::vector<RotationCoupling>> upward_;
+  //! Regular translations from a box to each of its octants, by level of the child
+  std::vector<std::vector<RotationCoupling>> downward_;
+  //! Outgoing to regular translations between boxes of the same level, by offset
+  std::vector<std::map<std::array<t_int, 3>, RotationCoupling>> transfer_;
+  //! \brief Translations from the scatterers of the leaves of this process to the center of the leaf
+  //! \details Up to a parity, they also translate from the center back to the scatterers.
+  std::vector<RotationCoupling> gather_;
+  //! Pairs of scatterers of neighbouring leaves coupled directly by this process
+  std::vector<std::array<t_uint, 2>> near_;
+  //! Direct couplings of the pairs
+  std::vector<RotationCoupling> nearCouplings_;
+
+  //! The sum over j != i of C_ij x_j, using the far and near fields
+  Vector<t_complex> couple(Vector<t_complex> const &x) const;
+};
+
+//! Solves S x = Y with restarted GMRES, S applied through the fast multipole method
+Vector<t_complex> Gmres_Zcomp(FMMOperator const &S, Vector<t_complex> const &Y, double tol,
+                              int maxit, int no_rest, Vector<t_complex> const &x0 = Vector<t_complex>());
+}
+#endif
@@ -0,0 +1,118 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "FarField.h"
+
+#include "AuxCoefficients.h"
+#include "CompoundIterator.h"
+#include "Tools.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace optimet {
+
+FarField::FarField(std::vector<t_real> const &the, std::vector<t_real> const &phi, t_uint nMax)
+    : nMax_(nMax), pMax_(Tools::iteratorMax(nMax)), st_(the.size()), ct_(the.size()),
+      sp_(the.size()), cp_(the.size()), basis_(2 * Tools::iteratorMax(nMax) * 3 * 2 * the.size()) {
+  if(the.size() != phi.size())
+    throw std::runtime_error("The polar and azimuthal angles of the directions do not match");
+  t_uint const N = the.size();
+  std::vector<Spherical<t_real>> R(N);
+  for(t_uint j = 0; j < N; ++j)
+    R[j] = Spherical<t_real>(1.0, the[j], phi[j]);
+  AuxAngular const angular(R, nMax);
+  st_ = angular.st_;
+  ct_ = angular.ct_;
+  sp_ = angular.sp_;
+  cp_ = angular.cp_;
+
+  std::vector<t_real> const dn = AuxCoefficients::compute_dn(nMax);
+  for(t_int m = -static_cast<t_int>(nMax); m <= static_cast<t_int>(nMax); ++m) {
+    t_real const dm = std::pow(-1.0, m); // Legendre to Wigner function
+    t_real const *const er = &angular.exp_[2 * (m + nMax) * N];
+    t_real const *const ei = er + N;
+    for(t_uint n = std::max<t_uint>(std::abs(m), 1); n <= nMax; ++n) {
+      t_uint const i = CompoundIterator(n, m);
+      t_real const a = dm * dn[n];
+      t_real const *const dWn = &angular.wigner_[(3 * i + 1) * N];
+      t_real const *const An = dWn + N;
+      t_real *const B = &basis_[(i * 3 * 2) * N];
+      t_real *const C = &basis_[((pMax_ + i) * 3 * 2) * N];
+      for(t_uint j = 0; j < N; ++j) {
+        // a exp(i m phi) times Bn = (0, dW, i A) and Cn = (0, i A, -dW)
+        t_real const gr = a * er[j], gi = a * ei[j];
+        t_real const btr = gr * dWn[j], bti = gi * dWn[j];
+        t_real const bpr = -gi * An[j], bpi = gr * An[j];
+        t_real const ctr = bpr, cti = bpi, cpr = -btr, cpi = -bti;
+        t_real const st = st_[j], ct = ct_[j], sp = sp_[j], cp = cp_[j];
+        B[j] = ct * cp * btr - sp * bpr;
+        B[N + j] = ct * cp * bti - sp * bpi;
+        B[2 * N + j] = ct * sp * btr + cp * bpr;
+        B[3 * N + j] = ct * sp * bti + cp * bpi;
+        B[4 * N + j] = -st * btr;
+        B[5 * N + j] = -st * bti;
+        C[j] = ct * cp * ctr - sp * cpr;
+        C[N + j] = ct * cp * cti - sp * cpi;
+        C[2 * N + j] = ct * sp * ctr + cp * cpr;
+        C[3 * N + j] = ct * sp * cti + cp * cpi;
+        C[4 * N + j] = -st * ctr;
+        C[5 * N + j] = -st * cti;
+      }
+    }
+  }
+}
+
+void FarField::add(t_complex waveK, Spherical<t_real> const &origin, t_complex const *m,
+                   t_complex const *n, t_uint nMax, t_complex factor,
+                   std::vector<SphericalP<t_complex>> &pattern) const {
+  if(nMax > nMax_)
+    throw std::runtime_error("The far field directions do not reach the requested nMax");
+  t_uint const N = directions();
+  t_uint const pMax = Tools::iteratorMax(nMax);
+  t_complex const minus_i(0, -1);
+
+  std::vector<t_real> values(6 * N, 0.0);
+  for(t_uint p = 0; p < pMax; ++p) {
+    // (-i)^(n+1) m_p and (-i)^n n_p, from the asymptotic forms of the Hankel functions
+    t_complex const phase = std::pow(minus_i, static_cast<t_int>(CompoundIterator(p).first));
+    t_complex const alpha = phase * minus_i * m[p], beta = phase * n[p];
+    for(t_uint c = 0; c < 3; ++c) {
+      t_real const *const Br = basis(0, c, p), *const Bi = Br + N;
+      t_real const *const Cr = basis(1, c, p), *const Ci = Cr + N;
+      t_real *const re = &values[2 * c * N], *const im = re + N;
+      for(t_uint j = 0; j < N; ++j) {
+        re[j] += Cr[j] * alpha.real() - Ci[j] * alpha.imag() + Br[j] * beta.real() -
+                 Bi[j] * beta.imag();
+        im[j] += Cr[j] * alpha.imag() + Ci[j] * alpha.real() + Br[j] * beta.imag() +
+                 Bi[j] * beta.real();
+      }
+    }
+  }
+
+  // exp(i k |r - r0|) ~ exp(i k r) exp(-i k u.r0) along the direction u
+  pattern.resize(N, SphericalP<t_complex>(0.0, 0.0, 0.0));
+  auto const r0 = Tools::toCartesian(origin);
+  for(t_uint j = 0; j < N; ++j) {
+    t_real const u = st_[j] * cp_[j] * r0.x + st_[j] * sp_[j] * r0.y + ct_[j] * r0.z;
+    t_complex const shift = factor * std::exp(t_complex(0, -1) * waveK * u);
+    pattern[j] = pattern[j] + SphericalP<t_complex>(t_complex(values[j], values[N + j]) * shift,
+                                                    t_complex(values[2 * N + j], values[3 * N + j]) * shift,
+                                                    t_complex(values[4 * N + j], values[5 * N + j]) * shift);
+  }
+}
+
+} // namespace optimet
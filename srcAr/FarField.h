@@ -0,0 +1,86 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef FAR_FIELD_H_
+#define FAR_FIELD_H_
+
+#include "Spherical.h"
+#include "SphericalP.h"
+#include "Types.h"
+
+#include <complex>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The FarField class implements the radiation patterns of multipole
+ * expansions on a set of directions.
+ * At large distances r, the radiative functions reduce to
+ *    M_p ~ (-i)^(n+1) exp(i k r) / (k r) a exp(i m phi) C_n,
+ *    N_p ~ (-i)^n exp(i k r) / (k r) a exp(i m phi) B_n,
+ * so that the pattern F of a field E ~ exp(i k r) / (k r) F only depends on
+ * the angular functions of the directions. These are computed once, up to
+ * nMax, and shared by the fundamental and SH frequencies, by all the
+ * scatterers and by all the wavelengths of a scan. A pattern then costs
+ * O(directions pMax) per scatterer and no Bessel function.
+ */
+class FarField {
+public:
+  /**
+   * Initializing constructor for the FarField class.
+   * @param the the polar angles of the directions.
+   * @param phi the azimuthal angles of the directions.
+   * @param nMax the maximum value of the n iterator.
+   */
+  FarField(std::vector<t_real> const &the, std::vector<t_real> const &phi, t_uint nMax);
+
+  //! Number of directions
+  t_uint directions() const { return st_.size(); }
+  //! Maximum value of the n iterator
+  t_uint nMax() const { return nMax_; }
+
+  /**
+   * Adds the pattern of an expansion sum_p M_p m_p + N_p n_p about a point.
+   * The pattern is referred to the origin of the coordinates, in Cartesian
+   * components, and multiplied by factor.
+   * @param waveK the wave number of the radiative functions.
+   * @param origin the center of the expansion.
+   * @param m the coefficients of the M functions.
+   * @param n the coefficients of the N functions.
+   * @param nMax the maximum value of the n iterator of the expansion.
+   * @param factor the factor of the pattern.
+   * @param pattern the pattern, one value per direction.
+   */
+  void add(t_complex waveK, Spherical<t_real> const &origin, t_complex const *m,
+           t_complex const *n, t_uint nMax, t_complex factor,
+           std::vector<SphericalP<t_complex>> &pattern) const;
+
+private:
+  t_uint nMax_;                           /**< The maximum value of the n iterator. */
+  t_uint pMax_;                           /**< The number of compound indices. */
+  std::vector<t_real> st_, ct_, sp_, cp_; /**< Sine and cosine of theta and phi, by direction. */
+  //! a exp(i m phi) B_n then a exp(i m phi) C_n, by compound index, component, part and direction
+  std::vector<t_real> basis_;
+
+  t_real const *basis(t_uint f, t_uint c, t_uint i) const {
+    return basis_.data() + (((f * pMax_ + i) * 3 + c) * 2) * directions();
+  }
+};
+
+} // namespace optimet
+
+#endif /*FAR_FIELD_H_*/
@@ -14,10 +14,9 @@
 // You should have received a copy of the GNU General Public License
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 #include "AuxCoefficients.h"
+#include "AuxCoefficients.h"
 #include "Coupling.h"
 #include "Geometry.h"
-#include "Trian.h"
-#include "Algebra.h"
 #include "Bessel.h"
 #include "CompoundIterator.h"
 #include "HarmonicsIterator.h"
@@ -26,40 +25,115 @@
 #include "Types.h"
 #include "constants.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <numeric>
 #include <sstream>
 #include <stdexcept>
+#include <string>
 #include <vector>
 #include <chrono>
 using namespace std::chrono;
 
+namespace {
+//! \brief Calls f with the key of each cell of size h overlapped by the bounding box of a sphere
+//! \details Keys wrap around beyond 2^21 cells along an axis, which only adds candidates.
+template <class F> void for_cells(Scatterer const &object, optimet::t_real h, F const &f) {
+  auto const center = Tools::toCartesian(object.vR);
+  optimet::t_real const c[3] = {center.x, center.y, center.z};
+  std::int64_t lo[3], hi[3];
+  for(int a = 0; a < 3; ++a) {
+    lo[a] = std::floor((c[a] - object.radius) / h);
+    hi[a] = std::floor((c[a] + object.radius) / h);
+  }
+  std::uint64_t const mask = (1u << 21) - 1;
+  for(auto i = lo[0]; i <= hi[0]; ++i)
+    for(auto j = lo[1]; j <= hi[1]; ++j)
+      for(auto k = lo[2]; k <= hi[2]; ++k)
+        f(((static_cast<std::uint64_t>(i) & mask) << 42) |
+          ((static_cast<std::uint64_t>(j) & mask) << 21) | (static_cast<std::uint64_t>(k) & mask));
+}
+
+//! Same criterion as ever: the circumscribed spheres touch or intersect
+bool overlaps(Scatterer const &a, Scatterer const &b) {
+  return Tools::findDistance(a.vR, b.vR) <= a.radius + b.radius;
+}
+}
+
 Geometry::~Geometry() {}
 Geometry::Geometry() {}
 
+void Geometry::bin(optimet::t_uint j) {
+  if(objects[j].radius > 0.5 * cell_ or not(cell_ > 0)) {
+    cell_ = objects[j].radius > 0 ? 2 * std::max(objects[j].radius, cell_) : 1;
+    cells_.clear();
+    binned_ = 0;
+  }
+  for(; binned_ <= j; ++binned_)
+    for_cells(objects[binned_], cell_,
+              [this](std::uint64_t key) { cells_[key].push_back(binned_); });
+}
+
+int Geometry::overlap(Scatterer const &object) const {
+  // two spheres which touch share a point, and so a cell; larger objects are rare enough to scan
+  if(object.radius <= 0.5 * cell_) {
+    int result = -1;
+    for_cells(object, cell_, [&](std::uint64_t key) {
+      auto const found = cells_.find(key);
+      if(found != cells_.end())
+        for(auto const j : found->second)
+          if(result < 0 and overlaps(objects[j], object))
+            result = j;
+    });
+    if(result >= 0)
+      return result;
+  } else
+    for(optimet::t_uint j = 0; j < binned_; ++j)
+      if(overlaps(objects[j], object))
+        return j;
+  for(optimet::t_uint j = binned_; j < objects.size(); ++j)
+    if(overlaps(objects[j], object))
+      return j;
+  return -1;
+}
+
 void Geometry::pushObject(Scatterer const &object_) {
-  for(auto const &obj : objects)
-    if(Tools::findDistance(obj.vR, object_.vR) <= (object_.radius + obj.radius)) {
-      std::ostringstream sstr;
-      sstr << "The particle at (" << Tools::toCartesian(object_.vR).x << ", "
-           << Tools::toCartesian(object_.vR).y << ", " << Tools::toCartesian(object_.vR).z << ") "
-           << "overlaps with the one at (" << Tools::toCartesian(obj.vR).x << ", "
-           << Tools::toCartesian(obj.vR).y << ", " << Tools::toCartesian(obj.vR).z << "), "
-           << "with circumscribed radii " << object_.radius << " and " << obj.radius;
-      throw std::runtime_error(sstr.str());
-    }
+  auto const other = overlap(object_);
+  if(other >= 0) {
+    auto const &obj = objects[other];
+    std::ostringstream sstr;
+    sstr << "The particle at (" << Tools::toCartesian(object_.vR).x << ", "
+         << Tools::toCartesian(object_.vR).y << ", " << Tools::toCartesian(object_.vR).z << ") "
+         << "overlaps with the one at (" << Tools::toCartesian(obj.vR).x << ", "
+         << Tools::toCartesian(obj.vR).y << ", " << Tools::toCartesian(obj.vR).z << "), "
+         << "with circumscribed radii " << object_.radius << " and " << obj.radius;
+    throw std::runtime_error(sstr.str());
+  }
+  if(not objects.empty())
+    bin(objects.size() - 1);
   objects.emplace_back(object_);
+  locator_.reset();
 }
 
 bool Geometry::is_valid() const {
   using namespace optimet;
   if(objects.size() == 0)
     return false;
+  // pairs of overlapping objects share one of the cells, at least as large as the objects
+  t_real cell = 0;
+  for(auto const &object : objects)
+    cell = std::max(cell, 2 * object.radius);
+  if(not(cell > 0))
+    cell = 1;
+  std::unordered_map<std::uint64_t, std::vector<t_uint>> cells;
   for(t_uint i(0); i < objects.size(); ++i)
-    for(t_uint j(0); j < objects.size(); ++j)
-      if(Tools::findDistance(objects[i].vR, objects[j].vR) <= objects[i].radius + objects[j].radius)
-        return false;
+    for_cells(objects[i], cell, [&cells, i](std::uint64_t key) { cells[key].push_back(i); });
+  for(auto const &bin : cells)
+    for(t_uint i(0); i < bin.second.size(); ++i)
+      for(t_uint j(i + 1); j < bin.second.size(); ++j)
+        if(overlaps(objects[bin.second[i]], objects[bin.second[j]]))
+          return false;
   return true;
 }
 
@@ -73,102 +147,48 @@ optimet::t_uint Geometry::scatterer_size() const {
 }
 
 bool Geometry::no_overlap(Scatterer const &object_) {
-  if(objects.size() < 1)
-    return true;
-
-  for(auto const &obj : objects)
-    if(Tools::findDistance(obj.vR, object_.vR) <= (object_.radius + obj.radius))
-      return false;
-
-  return true;
+  return overlap(object_) < 0;
 }
 
 
 int Geometry::checkInner(Spherical<double> R_) {
-  Spherical<double> Rrel;
-  Cartesian <double> Rcar, centCar;
-  std::vector<double> RtoCp(3);
-  double DOT;
-
-  if (objects[0].scatterer_type == "sphere"){
-  for(size_t j = 0; j < objects.size(); j++) {
-    // Translate to object j
-    Rrel = Tools::toPoint(R_, objects[j].vR);
-
-    // Check if R_.rrr is inside radius of object j
-    if(Rrel.rrr <= objects[j].radius)
-      return j;
-  }
+  if(not locator_)
+    locator_ = std::make_shared<optimet::PointLocator const>(objects);
+  return locator_->locate(R_);
+}
 
-  return -1;
+std::vector<int> Geometry::checkInner(std::vector<Spherical<double>> const &R) {
+  if(not locator_)
+    locator_ = std::make_shared<optimet::PointLocator const>(objects);
+  return locator_->locate(R);
 }
 
-else if (objects[0].scatterer_type == "arbitrary.shape"){
-  Rcar = Tools::toCartesian(R_);
-  
-  for(size_t j = 0; j < objects.size(); j++) {
-  
-  int clearPass(1);
-  centCar = Tools::toCartesian(objects[j].vR);
-  unsigned int Nt = (objects[j].getTopolsize()) / 3;
-  
-  for (int ele1 = 0; ele1 < Nt; ++ele1){
-	        
-	        const int* n1 = objects[j].getNOvertex(ele1);
-	
-		const double* p1 = objects[j].getCoord(n1[0]);
-
-		const double* p2 = objects[j].getCoord(n1[1]);
-	
-		const double* p3 = objects[j].getCoord(n1[2]);
-                
-                Trian trian(p1, p2, p3); 
-               
-		std::vector<double> nvec = trian.getnorm();
-		std::vector<double> cp = trian.getcp();
-
-		
-		cp[0] = cp[0] + centCar.x;
-		cp[1] = cp[1] + centCar.y;
-		cp[2] = cp[2] + centCar.z;
-		
-		RtoCp[0] = Rcar.x - cp[0];
-		RtoCp[1] = Rcar.y - cp[1];
-		RtoCp[2] = Rcar.z - cp[2];
-		
-       DOT = Tools::dot(&nvec[0], &RtoCp[0]);
-         
-         if ( DOT >= 0 ){  // the point is outside the particle
-         clearPass = 0;
-	 break;	
-	 }
-	 
-	 
-    }
-      	
-      if (clearPass)
-      return j;		
-  }
-  
-  return -1;
-  
-  }
+optimet::t_uint Geometry::nearSurfaces(Cartesian<double> const &R, double reach) {
+  if(not locator_)
+    locator_ = std::make_shared<optimet::PointLocator const>(objects);
+  return locator_->surfaces(R, reach);
+}
+
+optimet::symbol::CouplingPattern const &Geometry::couplings(int nMax, int nMaxS) {
+  if(couplings_.nMax != nMax or couplings_.nMaxS != nMaxS)
+    couplings_ = optimet::symbol::CouplingPattern(nMax, nMaxS);
+  return couplings_;
 }
 
 #ifdef OPTIMET_MPI
 void Geometry::Coefficients(int nMax, int nMaxS, std::vector<double *> CLGcoeff, int gran1, int gran2){ 
+  auto const &pattern = couplings(nMax, nMaxS);
 
+   optimet::symbol::C_10m1coeff(CLGcoeff[0], pattern, gran1, gran2);
+   optimet::symbol::C_11m1coeff(CLGcoeff[1], pattern, gran1, gran2);
+   optimet::symbol::C_00m1coeff(CLGcoeff[2], pattern, gran1, gran2);
+   optimet::symbol::C_01m1coeff(CLGcoeff[3], pattern, gran1, gran2);
    
-   optimet::symbol::C_10m1coeff(CLGcoeff[0], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::C_11m1coeff(CLGcoeff[1], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::C_00m1coeff(CLGcoeff[2], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::C_01m1coeff(CLGcoeff[3], nMax, nMaxS, gran1, gran2);
-   
-   optimet::symbol::W_m1m1coeff(CLGcoeff[4], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_11coeff(CLGcoeff[5], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_00coeff(CLGcoeff[6], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_10coeff(CLGcoeff[7], nMax, nMaxS, gran1, gran2);
-   optimet::symbol::W_01coeff(CLGcoeff[8], nMax, nMaxS, gran1, gran2);
+   optimet::symbol::W_m1m1coeff(CLGcoeff[4], pattern, gran1, gran2);
+   optimet::symbol::W_11coeff(CLGcoeff[5], pattern, gran1, gran2);
+   optimet::symbol::W_00coeff(CLGcoeff[6], pattern, gran1, gran2);
+   optimet::symbol::W_10coeff(CLGcoeff[7], pattern, gran1, gran2);
+   optimet::symbol::W_01coeff(CLGcoeff[8], pattern, gran1, gran2);
 }
 #endif
 
@@ -180,326 +200,280 @@ optimet::Vector<optimet::t_complex> &internalCoef_FF_, double r,
    double *W_11 = CLGcoeff[5];
    double *W_00 = CLGcoeff[6];                                
                  
-   CompoundIterator p;
-  
-   int pMax = p.max(nMaxS_);
    int nMax_ = this->nMax();   
 
   auto const omega = incWave_->omega();
 
- 
-    
-    for(p = 0; p < pMax; p++) {  
-         
-             
-    coefXmn[p] = optimet::symbol::CXm1(p, W_m1m1, W_00, W_11, nMax_,
-                  internalCoef_FF_, r,
-                   objectIndex_,
-                  omega, objects[objectIndex_]);
-                  
-                  
-                 
-    coefXpl[p] = optimet::symbol::CXp1(p, W_m1m1, W_00, W_11, nMax_,
-                  internalCoef_FF_, r,
-                   objectIndex_,
-                  omega, objects[objectIndex_]);              
-                  
-                   
-     
-    }
+  optimet::symbol::CXm1p1(W_m1m1, W_00, W_11, couplings_, nMax_, nMaxS_, internalCoef_FF_, r,
+                          objectIndex_, omega, objects[objectIndex_], coefXmn, coefXpl);
 
   return 0;
 }
 
 #ifdef OPTIMET_MPI
-void Geometry::getEXCvecSH_ARB3_parall(optimet::Vector<optimet::t_complex>& EXvec, std::shared_ptr<optimet::Excitation const> excitation, optimet::Vector<optimet::t_complex> &externalCoef_FF_, optimet::Vector<optimet::t_complex> &internalCoef_FF_, int gran1, int gran2, int objIndex){
+namespace {
+//! \brief The inner VSWFs at the quadrature points of a meshed object
+//! \details Row 3 q + c holds component c at point q, the columns the M then the N functions, so
+//! that the product with the FF internal coefficients of the object is its field at the points.
+optimet::Matrix<optimet::t_complex>
+sh_inner_functions(Scatterer const &object, optimet::t_complex k_s, int nMax, int nMaxS) {
   using namespace optimet;
-  
-  int nMax = this->nMax();
-  int nMaxS = this->nMaxS();
-  auto const N = nMaxS * (nMaxS + 2);
-  
-          CompoundIterator mu1, mup, pp;
-         
-          optimet::t_real omega_ = excitation->omega();
-          Cartesian<double> intpoinCar; // integration point in Cartesian system
-          Spherical<double> intpoinSph; // integration point in spherical system
-          
-          SphericalP<std::complex<double>> Eint_FF;
-          
-          int muMax =mu1.max(nMaxS);
-          int ppMax = pp.max(nMax);
-          int brojac(0);
-          int size = gran2 - gran1;
-          
-          std::complex<double>* Etan = new std::complex<double>[3];
-          std::complex<double>* Tan = new std::complex<double>[3];
-          std::complex<double>* resCR = new std::complex<double>[3];
-          std::complex<double> Enorm, resDOT1, resDOT2, EE;
-          
-         const std::complex<double> k_0_SH = 2 * (omega_) * std::sqrt(consEpsilon0 * consMu0); 
-         auto const k_s_SH = 2 * omega_ * std::sqrt(objects[objIndex].elmag.epsilon_SH * objects[objIndex].elmag.mu_SH); 
-         auto const k_b_SH = 2 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-         auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu);
-         auto const k_s = omega_ * std::sqrt(objects[objIndex].elmag.epsilon * objects[objIndex].elmag.mu);
-        
-         const std::complex<double> ksiparppar = objects[objIndex].elmag.ksiparppar; // SH surf tensor coefficient
-         const std::complex<double> ksippp = objects[objIndex].elmag.ksippp; // SH surf tensor coefficient
-         const std::complex<double> gamma = objects[objIndex].elmag.gamma; // SH bulk tensor coefficient
-
-         auto const Cf = (k_b_SH * consEpsilon0 * gamma)/objects[objIndex].elmag.epsilon_SH;
-  
-        unsigned int Nt = (objects[objIndex].getTopolsize()) / 3;  //number of triangles
-         
-        std::vector<std::vector<double>> Points = Tools::getPoints4();
-
-        std::vector<double> Weights = Tools::getWeights4();
-        
-	for (mu1 = gran1; mu1 < gran2 ; mu1++){
-	
-	std::complex<double> I11s(0.0,0.0), I21s(0.0,0.0), I31s(0.0,0.0), I12s(0.0,0.0), I22s(0.0,0.0), I32s(0.0,0.0);
-        	
-	int nn = mu1.first;
-	int mm =  mu1.second;
-	mup = nn * (nn + 1) + mm - 1;
-	
-       	
-	for (int ele1 = 0; ele1 < Nt; ++ele1){
-	        
-	        const int* n1 = objects[objIndex].getNOvertex(ele1);
-	
-		const double* p1 = objects[objIndex].getCoord(n1[0]);
-
-		const double* p2 = objects[objIndex].getCoord(n1[1]);
-	
-		const double* p3 = objects[objIndex].getCoord(n1[2]);
-                
-                Trian trian(p1, p2, p3); 
-                
-		double det = trian.getDeter();
-		std::vector<double> nvec = trian.getnorm();
-		
-	// surface integration	
-	for (int ni = 0; ni != Weights.size(); ++ni) {
-      
-      Eint_FF = SphericalP<std::complex<double>>(std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-	
-	double N1 = Points[ni][0];
-	double N2 = Points[ni][1];
-        double N0 = 1.0 - N1 - N2;
-
-	double wi = Weights[ni];
-         
-	intpoinCar.x = (p1[0])*N1 + (p2[0])*N2 + (p3[0])*N0;
-	intpoinCar.y = (p1[1])*N1 + (p2[1])*N2 + (p3[1])*N0;
-	intpoinCar.z = (p1[2])*N1 + (p2[2])*N2 + (p3[2])*N0;
-
-	intpoinSph = Tools::toSpherical(intpoinCar); 
-	
-	// Internal field
-
-      optimet::AuxCoefficients aCoefInt(intpoinSph, k_s, 1, nMax); //internal FF field
-      
-      
-      for(pp = 0; pp < ppMax; pp++) {
-
-        Eint_FF = Eint_FF + (aCoefInt.M(static_cast<long>(pp)) * internalCoef_FF_[objIndex*2*ppMax + pp] +
-                       aCoefInt.N(static_cast<long>(pp)) * internalCoef_FF_[objIndex*2*ppMax + ppMax + pp]);
-                                                                  
-      }
-      //tangential component -nxnxEext
-      Tools::crossTanTr(Etan, resCR, &nvec[0], Eint_FF);
-      
-      // inner component of normal field at FF
-      Enorm = Tools::dot (&nvec[0], Eint_FF);
-                        
-       Tools::crossTan(Tan, resCR, &nvec[0], &Etan[0]);
-                                 
-       optimet::AuxCoefficients aCoefext3(intpoinSph, k_b_SH, 0, nMaxS); //radiative VSWFs (3)
-                                                    
-       resDOT1 = Tools::dot (&Tan[0], aCoefext3.M(static_cast<long>(mup)));
-       resDOT2 = Tools::dot (&Tan[0], aCoefext3.N(static_cast<long>(mup))); 
-
-       I11s = I11s + wi * det * 2.0 * Enorm * ksiparppar * k_0_SH * k_0_SH * resDOT1;
-      I12s = I12s + wi * det * 2.0 * Enorm * ksiparppar * k_0_SH * k_0_SH * resDOT2;
-      
-      resDOT1 = Tools::dot (&nvec[0], aCoefext3.M(static_cast<long>(mup)));
-      resDOT2 = Tools::dot (&nvec[0], aCoefext3.N(static_cast<long>(mup)));
-      
-      I21s = I21s - wi * det * k_b_SH * k_b_SH *  ksippp * Enorm*Enorm * resDOT1;
-      I22s = I22s - wi * det * k_b_SH * k_b_SH *  ksippp * Enorm*Enorm * resDOT2 ;
-                                                                             
-      
-      // calculation of the particular solution on the surface 
-     
-     EE = Etan[0] * Etan[0] + Etan[1] * Etan[1] + Etan[2] * Etan[2] + Enorm*Enorm;
-     
-     resDOT1 = Tools::dot (&nvec[0], aCoefext3.M(static_cast<long>(mup)));
-     resDOT2 = Tools::dot (&nvec[0], aCoefext3.N(static_cast<long>(mup)));
-
-     I31s = I31s - ( wi * det * k_b_SH * Cf) * EE * resDOT1;
-     I32s = I32s - ( wi * det * k_b_SH * Cf) * EE * resDOT2; 
-  
-  }// surface integration over the triangle is OVER
-  
-  } // all the triangles surface integration
- 
-
-  EXvec (brojac) = I11s + I21s + I31s;
-  EXvec (brojac + size) = I12s + I22s + I32s;
-  brojac++;
-  } // outer for loop
- 
+  int const ppMax = nMax * (nMax + 2);
+  int const Nt = object.getNOtriangles();   // number of triangles
+  int const Nq = object.getNOpoints() / Nt; // points per triangle
+  auto const angular = object.getPointAngular(std::max(nMax, nMaxS));
+  Matrix<t_complex> result(3 * Nt * Nq, 2 * ppMax);
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for(int ele1 = 0; ele1 < Nt; ++ele1) {
+    AuxCoefficientsBatch const aCoefInt(*angular, ele1 * Nq, (ele1 + 1) * Nq, k_s, 1, nMax);
+    for(int pp = 0; pp < ppMax; ++pp)
+      for(int c = 0; c < 3; ++c)
+        for(int q = 0; q < Nq; ++q) {
+          auto const row = 3 * (ele1 * Nq + q) + c;
+          result(row, pp) = t_complex(aCoefInt.real(AuxCoefficientsBatch::M_, c, pp)[q],
+                                      aCoefInt.imag(AuxCoefficientsBatch::M_, c, pp)[q]);
+          result(row, pp + ppMax) = t_complex(aCoefInt.real(AuxCoefficientsBatch::N_, c, pp)[q],
+                                              aCoefInt.imag(AuxCoefficientsBatch::N_, c, pp)[q]);
+        }
   }
+  return result;
+}
 
-  void Geometry::getEXCvecSH_ARB1_parall(optimet::Vector<optimet::t_complex>& EXvec, std::shared_ptr<optimet::Excitation const> excitation, optimet::Vector<optimet::t_complex> &externalCoef_FF_, optimet::Vector<optimet::t_complex> &internalCoef_FF_, int gran1, int gran2, int objIndex){
+//! \brief The outer VSWFs of rows gran1 to gran2 at the quadrature points of a meshed object
+//! \details The radiative M functions of the rows, their N functions, then the regular M and N
+//! functions, column 4 q + c holding component c at point q and column 4 q + 3 the normal
+//! projection. The radiative functions give the outgoing sources, the regular ones the incoming
+//! sources. The functions are taken at (n, -m).
+optimet::Matrix<optimet::t_complex>
+sh_outer_functions(Scatterer const &object, optimet::t_complex k_b_SH, int nMax, int nMaxS,
+                   int gran1, int gran2) {
   using namespace optimet;
-  
-  int nMax = this->nMax();
-  int nMaxS = this->nMaxS();
-  auto const N = nMaxS * (nMaxS + 2);
-  
-          CompoundIterator mu1, mup, pp;
-         
-          optimet::t_real omega_ = excitation->omega();
-          Cartesian<double> intpoinCar; // integration point in Cartesian system
-          Spherical<double> intpoinSph; // integration point in spherical system
-          
-          SphericalP<std::complex<double>> Eint_FF;
-          
-          int muMax =mu1.max(nMaxS);
-          int ppMax = pp.max(nMax);
-          int brojac(0);
-          int size = gran2 - gran1;
-          
-          std::complex<double>* Etan = new std::complex<double>[3];
-          std::complex<double>* Tan = new std::complex<double>[3];
-          std::complex<double>* resCR = new std::complex<double>[3];
-          std::complex<double> Enorm, resDOT1, resDOT2, EE;
-          
-         const std::complex<double> k_0_SH = 2 * (omega_) * std::sqrt(consEpsilon0 * consMu0); 
-         auto const k_s_SH = 2 * omega_ * std::sqrt(objects[objIndex].elmag.epsilon_SH * objects[objIndex].elmag.mu_SH); 
-         auto const k_b_SH = 2 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-         auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu);
-         auto const k_s = omega_ * std::sqrt(objects[objIndex].elmag.epsilon * objects[objIndex].elmag.mu);
- 
-         const std::complex<double> ksiparppar = objects[objIndex].elmag.ksiparppar; // SH surface tensor coefficient
-         const std::complex<double> ksippp = objects[objIndex].elmag.ksippp; // SH surface tensor coefficient
-         const std::complex<double> gamma = objects[objIndex].elmag.gamma; // SH surface tensor coefficient
-
-         auto const Cf = (k_b_SH * consEpsilon0 * gamma)/objects[objIndex].elmag.epsilon_SH;
-
-  
-        unsigned int Nt = (objects[objIndex].getTopolsize()) / 3;  //number of triangles
-        
-        std::vector<std::vector<double>> Points = Tools::getPoints4();
-
-	std::vector<double> Weights = Tools::getWeights4();
-
-	for (mu1 = gran1; mu1 < gran2 ; mu1++){
-      
-	std::complex<double> I11s(0.0,0.0), I21s(0.0,0.0), I31s(0.0,0.0), I12s(0.0,0.0), I22s(0.0,0.0), I32s(0.0,0.0);
-        	
-	int nn = mu1.first;
-	int mm =  mu1.second;
-	mup = nn * (nn + 1) + mm - 1;
-	
-	
-	for (int ele1 = 0; ele1 < Nt; ++ele1){
-	        
-	        const int* n1 = objects[objIndex].getNOvertex(ele1);
-	
-		const double* p1 = objects[objIndex].getCoord(n1[0]);
-
-		const double* p2 = objects[objIndex].getCoord(n1[1]);
-	
-		const double* p3 = objects[objIndex].getCoord(n1[2]);
-                
-                Trian trian(p1, p2, p3); 
-                
-		double det = trian.getDeter();
-		std::vector<double> nvec = trian.getnorm();
-		
-	// surface integration	
-	for (int ni = 0; ni != Weights.size(); ++ni) {
-      
-      Eint_FF = SphericalP<std::complex<double>>(std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-	
-	double N1 = Points[ni][0];
-	double N2 = Points[ni][1];
-        double N0 = 1.0 - N1 - N2;
-
-	double wi = Weights[ni];
-         
-	intpoinCar.x = (p1[0])*N1 + (p2[0])*N2 + (p3[0])*N0;
-	intpoinCar.y = (p1[1])*N1 + (p2[1])*N2 + (p3[1])*N0;
-	intpoinCar.z = (p1[2])*N1 + (p2[2])*N2 + (p3[2])*N0;
-        
-      	
-	intpoinSph = Tools::toSpherical(intpoinCar); 
-	
-	// Internal fields
-
-      optimet::AuxCoefficients aCoefInt(intpoinSph, k_s, 1, nMax); //internal FF field
-
-
-     
-      for(pp = 0; pp < ppMax; pp++) {
-
-        Eint_FF = Eint_FF + (aCoefInt.M(static_cast<long>(pp)) * internalCoef_FF_[objIndex*2*ppMax + pp] +
-                       aCoefInt.N(static_cast<long>(pp)) * internalCoef_FF_[objIndex*2*ppMax + ppMax + pp]);
-                          
-                                          
+  int const size = gran2 - gran1;
+  int const Nt = object.getNOtriangles();   // number of triangles
+  int const Nq = object.getNOpoints() / Nt; // points per triangle
+  auto const angular = object.getPointAngular(std::max(nMax, nMaxS));
+  auto const indices = harmonic_indices(nMaxS);
+  std::vector<t_uint> outer_index(size);
+  for(int row = 0; row < size; ++row)
+    outer_index[row] = flatten_indices(indices[gran1 + row].first, -indices[gran1 + row].second);
+
+  Matrix<t_complex> result(4 * size, 4 * Nt * Nq);
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for(int ele1 = 0; ele1 < Nt; ++ele1) {
+    const double *nvec = object.getNormal(ele1);
+    for(int regular = 0; regular < 2; ++regular) {
+      AuxCoefficientsBatch const aCoefext(*angular, ele1 * Nq, (ele1 + 1) * Nq, k_b_SH, regular,
+                                          nMaxS);
+      for(int q = 0; q < Nq; ++q) {
+        auto const column = 4 * (ele1 * Nq + q);
+        for(int row = 0; row < size; ++row) {
+          auto const Mext = aCoefext.M(outer_index[row], q);
+          auto const Next = aCoefext.N(outer_index[row], q);
+          result.block<1, 4>(row + 2 * regular * size, column) << Mext.rrr, Mext.the, Mext.phi,
+              Tools::dot(nvec, Mext);
+          result.block<1, 4>(row + (2 * regular + 1) * size, column) << Next.rrr, Next.the,
+              Next.phi, Tools::dot(nvec, Next);
+        }
       }
-            
-      //tangential component -nxnxEext
-      Tools::crossTanTr(Etan, resCR, &nvec[0], Eint_FF);
- 
-      // inner component of normal field at FF
-      Enorm = Tools::dot (&nvec[0], Eint_FF);
-      
-      Tools::crossTan(Tan, resCR, &nvec[0], &Etan[0]);
-      
-      optimet::AuxCoefficients aCoefext1(intpoinSph, k_b_SH, 1, nMaxS); //incoming VSWFs (1)
-     
-      resDOT1 = Tools::dot (&Tan[0], aCoefext1.M(static_cast<long>(mup)));
-      resDOT2 = Tools::dot (&Tan[0], aCoefext1.N(static_cast<long>(mup)));
-      
-      I11s = I11s + wi * det * 2.0 * Enorm * ksiparppar * k_0_SH * k_0_SH * resDOT1;
-      I12s = I12s + wi * det * 2.0 * Enorm * ksiparppar * k_0_SH * k_0_SH * resDOT2;
-      
-      resDOT1 = Tools::dot (&nvec[0], aCoefext1.M(static_cast<long>(mup)));
-      resDOT2 = Tools::dot (&nvec[0], aCoefext1.N(static_cast<long>(mup)));
-      
-       I21s = I21s - wi * det * k_b_SH * k_b_SH * ksippp * Enorm*Enorm * resDOT1;
-      I22s = I22s - wi * det * k_b_SH * k_b_SH * ksippp * Enorm*Enorm * resDOT2 ;
-                                                                             
-      // calculation of the particular solution on the surface 
-      EE =  Etan[0] * Etan[0] + Etan[1] * Etan[1] + Etan[2] * Etan[2] + Enorm*Enorm;
-      
-     resDOT1 = Tools::dot (&nvec[0], aCoefext1.M(static_cast<long>(mup)));
-     resDOT2 = Tools::dot (&nvec[0], aCoefext1.N(static_cast<long>(mup)));
-
-     I31s = I31s - ( wi * det * k_b_SH * Cf) * EE * resDOT1;
-     I32s = I32s - ( wi * det * k_b_SH * Cf) * EE * resDOT2; 
-  
-  }// surface integration over the triangle is OVER
-  
-  } // all the triangles surface integration
-  
-
-  EXvec (brojac) = I11s + I21s + I31s;
-  EXvec (brojac + size) = I12s + I22s + I32s;
-  brojac++;
+    }
   }
+  return result;
+}
+
+//! The matrix cached under the given key, built on first use
+template <class F>
+std::shared_ptr<optimet::Matrix<optimet::t_complex> const>
+cached(std::unordered_map<std::string, std::shared_ptr<optimet::Matrix<optimet::t_complex> const>>
+           &cache,
+       std::string const &key, F const &build) {
+  auto found = cache.find(key);
+  if(found == cache.end())
+    found = cache.emplace(key, std::make_shared<optimet::Matrix<optimet::t_complex> const>(build()))
+                .first;
+  return found->second;
+}
+
+//! \brief The SH sources on the surface of a meshed object, for rows gran1 to gran2 of each half
+//! \details The sources are quadratic in the fundamental field inside the object: the inner
+//! functions give that field at the quadrature points, which sets the weights of the tangential
+//! and normal projections of the outer functions at each point. Both sets of functions are the
+//! same for all the FF coefficients, so only the two products are left for each solution, the
+//! weights being shared by the radiative and the regular outer functions.
+void sh_surface_sources(optimet::Vector<optimet::t_complex> &EXvec, Scatterer const &object,
+                        ElectroMagnetic const &bground, optimet::t_real omega,
+                        optimet::Vector<optimet::t_complex> const &internalCoef_FF_,
+                        int objIndex, int nMax, optimet::Matrix<optimet::t_complex> const &inner,
+                        optimet::Matrix<optimet::t_complex> const &outer) {
+  using namespace optimet;
+
+  auto const k_0_SH = 2 * omega * std::sqrt(consEpsilon0 * consMu0);
+  auto const k_b_SH = 2 * omega * std::sqrt(bground.epsilon * bground.mu);
+  auto const ksiparppar = object.elmag.ksiparppar; // SH surface tensor coefficient
+  auto const ksippp = object.elmag.ksippp;         // SH surface tensor coefficient
+  auto const Cf = (k_b_SH * consEpsilon0 * object.elmag.gamma) / object.elmag.epsilon_SH;
+
+  int const ppMax = nMax * (nMax + 2);
+  int const Nt = object.getNOtriangles();   // number of triangles
+  int const Nq = object.getNOpoints() / Nt; // points per triangle
+
+  // internal FF field, sum_p M_p a_p + N_p b_p at each point
+  Vector<t_complex> const field = inner * internalCoef_FF_.segment(objIndex * 2 * ppMax, 2 * ppMax);
+
+  // surface integration
+  Vector<t_complex> weights(4 * Nt * Nq);
+  t_complex Etan[3], Tan[3], resCR[3];
+  for(int point = 0; point < Nt * Nq; ++point) {
+    const double *nvec = object.getNormal(point / Nq);
+    SphericalP<t_complex> const Eint_FF(field(3 * point), field(3 * point + 1),
+                                        field(3 * point + 2));
+    double const wdet = object.getPointWdet(point);
+
+    // tangential component -nxnxE and normal component of the field at FF
+    Tools::crossTanTr(Etan, resCR, nvec, Eint_FF);
+    auto const Enorm = Tools::dot(nvec, Eint_FF);
+    Tools::crossTan(Tan, resCR, nvec, Etan);
+    // particular solution on the surface
+    auto const EE = Etan[0] * Etan[0] + Etan[1] * Etan[1] + Etan[2] * Etan[2] + Enorm * Enorm;
+
+    // factors of the tangential and normal projections of the outer VSWFs
+    auto const tangential = wdet * 2.0 * Enorm * ksiparppar * k_0_SH * k_0_SH;
+    weights.segment<4>(4 * point) << tangential * Tan[0], tangential * Tan[1],
+        tangential * Tan[2],
+        -wdet * k_b_SH * k_b_SH * ksippp * Enorm * Enorm - wdet * k_b_SH * Cf * EE;
   }
+  EXvec = outer * weights;
+}
+} // namespace
+
+void Geometry::shSurfaceSources(optimet::Vector<optimet::t_complex> &EXvec, optimet::t_real omega,
+                                optimet::Vector<optimet::t_complex> const &internalCoef_FF_,
+                                int gran1, int gran2, int objIndex) {
+  auto const &object = objects[objIndex];
+  auto const k_s = omega * std::sqrt(object.elmag.epsilon * object.elmag.mu);
+  auto const k_b_SH = 2 * omega * std::sqrt(bground.epsilon * bground.mu);
+  int const nMax = this->nMax(), nMaxS = this->nMaxS();
+  // the keys of the T-matrices cover the mesh, the materials, the harmonics and the frequency
+  auto const inner = cached(shsurface_, object.TmatrixKey(bground, omega, false) + "/inner", [&] {
+    return sh_inner_functions(object, k_s, nMax, nMaxS);
+  });
+  auto const outer = cached(
+      shsurface_, object.TmatrixKey(bground, omega, true) + "/" + std::to_string(gran1) + "/" +
+                      std::to_string(gran2),
+      [&] { return sh_outer_functions(object, k_b_SH, nMax, nMaxS, gran1, gran2); });
+  sh_surface_sources(EXvec, object, bground, omega, internalCoef_FF_, objIndex, nMax, *inner,
+                     *outer);
+}
+
+void Geometry::getEXCvecSH_ARB_parall(optimet::Vector<optimet::t_complex>& EXvec, std::shared_ptr<optimet::Excitation const> excitation, optimet::Vector<optimet::t_complex> &internalCoef_FF_, int gran1, int gran2, int objIndex){
+  // radiative VSWFs (3) then incoming VSWFs (1)
+  shSurfaceSources(EXvec, excitation->omega(), internalCoef_FF_, gran1, gran2, objIndex);
+}
 #endif
 
 void Geometry::update(std::shared_ptr<optimet::Excitation const> incWave_) {
-  // Update the ElectroMagnetic properties of each object
-  for(auto &object : objects)
-    object.elmag.update(incWave_->lambda());
+  // the VSWFs of the SH surface sources depend on the wavelength
+  shsurface_.clear();
+  // Update the ElectroMagnetic properties of each object, each distinct dispersive material being
+  // evaluated once and copied to the other objects made of it
+  std::vector<ElectroMagnetic const *> materials;
+  for(auto &object : objects) {
+    if(object.elmag.modelType == 0)
+      continue;
+    auto const material = std::find_if(
+        materials.begin(), materials.end(),
+        [&object](ElectroMagnetic const *other) { return other->same_model(object.elmag); });
+    if(material != materials.end())
+      object.elmag = **material;
+    else {
+      object.elmag.update(incWave_->lambda());
+      materials.push_back(&object.elmag);
+    }
+  }
+
+  // Wiscombe's order x + 4.05 x^(1/3) + 2 for the size parameter x = k r of each particle, with a
+  // margin for the fields of its neighbours, up to the harmonics of the simulation
+  for(auto &object : objects) {
+    object.wavelength_order = 0;
+    if(not automatic_harmonics_)
+      continue;
+    auto const x = std::abs(incWave_->waveK) * object.radius;
+    auto const order = std::ceil(x + 4.05 * std::cbrt(x) + 2) + harmonics_margin_;
+    object.wavelength_order = static_cast<int>(std::min<double>(order, object.nMax));
+  }
+}
+
+void Geometry::preload(std::vector<double> const &lambdas) {
+  scan_ = lambdas;
+  // Preload each distinct tabulated material once, for all the objects made of it
+  std::vector<ElectroMagnetic const *> materials;
+  for(auto &object : objects) {
+    if(object.elmag.modelType != 5)
+      continue;
+    auto const material = std::find_if(
+        materials.begin(), materials.end(),
+        [&object](ElectroMagnetic const *other) { return other->same_model(object.elmag); });
+    if(material != materials.end())
+      object.elmag.preloaded = (*material)->preloaded;
+    else {
+      object.elmag.preload(lambdas);
+      materials.push_back(&object.elmag);
+    }
+  }
+
+  // The Mie coefficients of each distinct sphere at all the wavelengths at once, its material
+  // evaluated as update will, and looked up by the same keys as the T-matrices
+  spheres_.clear();
+  Tahead_.clear();
+  std::vector<optimet::t_real> omegas(lambdas.size());
+  for(std::size_t w = 0; w < lambdas.size(); ++w)
+    omegas[w] = optimet::constant::c * (2 * optimet::constant::pi / lambdas[w]);
+  for(std::size_t j = 0; j < objects.size(); ++j) {
+    auto const &object = objects[j];
+    if(object.kind() != Scatterer::sphere or lambdas.empty())
+      continue;
+    auto const same = [&object](Scatterer const &other) {
+      return other.kind() == Scatterer::sphere and object.sameTmatrix(other) and
+             ((object.elmag.modelType == 0 and other.elmag.modelType == 0) or
+              object.elmag.same_model(other.elmag));
+    };
+    if(std::any_of(objects.begin(), objects.begin() + j, same))
+      continue;
+    std::vector<ElectroMagnetic> materials(lambdas.size(), object.elmag);
+    for(std::size_t w = 0; w < lambdas.size(); ++w)
+      if(object.elmag.modelType != 0)
+        materials[w].update(lambdas[w]);
+    Scatterer sphere = object;
+    for(bool const SH : {false, true}) {
+      // SH matrices only for the spheres with an SH material
+      if(SH and (materials.front().epsilon_SH == 0e0 or materials.front().mu_SH == 0e0))
+        continue;
+      optimet::Matrix<optimet::t_complex> T, RgQ;
+      object.getTRgQSpheres(omegas, materials, bground, SH, T, RgQ);
+      for(std::size_t w = 0; w < lambdas.size(); ++w) {
+        sphere.elmag = materials[w];
+        spheres_[sphere.TmatrixKey(bground, omegas[w], SH)] = {T.col(w), RgQ.col(w)};
+      }
+    }
+  }
+}
+
+bool Geometry::sphereTmatrix(std::string const &key, optimet::Matrix<optimet::t_complex> &Tmatrix,
+                             optimet::Matrix<optimet::t_complex> &RgQmatrix) const {
+  auto const found = spheres_.find(key);
+  if(found == spheres_.end())
+    return false;
+  Tmatrix = found->second.first.asDiagonal();
+  RgQmatrix = found->second.second.asDiagonal();
+  return true;
+}
+
+bool Geometry::scanned(double lambda) const {
+  return std::any_of(scan_.begin(), scan_.end(), [lambda](double other) {
+    return std::abs(other - lambda) <= 1e-12 * lambda;
+  });
 }
 
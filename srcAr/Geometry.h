@@ -18,10 +18,18 @@
 #define GEOMETRY_H_
 
 #include "Excitation.h"
+#include "PointLocator.h"
 #include "Scatterer.h"
+#include "Symbol.h"
 #include "Types.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 /**
@@ -34,12 +42,76 @@
  */
 class Geometry {
 private:
-  //
+  std::string Tlibrary_; // hdf5 file caching the T-matrices, none if empty
+  std::string Tdistribution_ = "auto"; // processes, particles or auto: parallelism of the T-matrices
+  bool Tshared_ = false; // T-matrices of all the particles held once per node rather than per process
+  optimet::symbol::CouplingPattern couplings_; // couplings of the Clebsch Gordan series
+  std::shared_ptr<optimet::PointLocator const> locator_; // built on first use after the last pushObject
+  // Objects binned into cells by their bounding spheres, all but the last pushed one which the
+  // structure readers may still move
+  optimet::t_real cell_ = 0; // size of the cells, at least the diameter of the binned objects
+  std::unordered_map<std::uint64_t, std::vector<optimet::t_uint>> cells_; // objects in each cell
+  optimet::t_uint binned_ = 0; // number of binned objects
+  // VSWFs at the quadrature points of the SH surface sources, kept between FF solutions
+  std::unordered_map<std::string, std::shared_ptr<optimet::Matrix<optimet::t_complex> const>>
+      shsurface_;
+  // T and RgQ matrices of the meshed particles at the Chebyshev nodes of the scan, by the key of
+  // each particle at the first node, none for the particles whose check failed
+  mutable std::map<std::string, std::vector<std::pair<optimet::Matrix<optimet::t_complex>,
+                                                      optimet::Matrix<optimet::t_complex>>>>
+      Tnodes_;
+  // T and RgQ matrices of the meshed particles computed ahead at the wavelengths of the scan, by
+  // key, each dropped when used
+  mutable std::map<std::string, std::pair<optimet::Matrix<optimet::t_complex>,
+                                          optimet::Matrix<optimet::t_complex>>>
+      Tahead_;
+  // diagonals of the T and RgQ matrices of the spheres at the wavelengths of the scan, by key
+  std::map<std::string, std::pair<optimet::Vector<optimet::t_complex>,
+                                  optimet::Vector<optimet::t_complex>>>
+      spheres_;
 public:
   std::vector<Scatterer> objects; /**< The list of scatterers. */
 
   ElectroMagnetic bground; /**< The properties of the background. */
 
+  bool ACA_cond_ = false; //condition for the existence of ACA compression
+  optimet::t_real ACA_tolerance_ = 1e-3; //relative tolerance of the ACA compression
+  bool ACA_recompress_ = false; //compressed blocks cut to their rank at that tolerance by QR and SVD
+  bool ACA_single_ = false; //factors of the compressed blocks stored in single precision
+
+  bool rotation_cond_ = false; //couplings through rotation and coaxial translation
+
+  bool matrixfree_cond_ = false; //scattering matrix applied without assembly
+  bool cache_cond_ = true; //couplings kept between products of the matrix-free operator
+  bool lattice_cond_ = false; //matrix-free couplings as convolutions over a regular grid
+  optimet::t_real coupling_tolerance_ = 0; //weak matrix-free couplings neglected within this norm, none if zero
+
+  bool symmetry_cond_ = false; //dense FF solves split over the rotations about z the objects are invariant under
+  optimet::t_uint symmetry_order_ = 0; //number of those rotations, the largest the objects allow if zero
+
+  bool FMM_cond_ = false; //scattering matrix applied through the fast multipole method
+  optimet::t_uint FMMleaf_ = 8; //average number of scatterers in a leaf of the octree
+  optimet::t_real FMMdigits_ = 6; //accurate digits sought from the multipole expansions
+
+  optimet::t_uint recycle_ = 0; //Krylov vectors recycled by GCRO-DR, plain GMRES if zero
+  optimet::t_real krylov_tolerance_ = 1e-7; //relative residual sought by the iterative solvers
+  optimet::t_uint krylov_restart_ = 250; //Krylov vectors of a cycle before a restart
+  optimet::t_uint krylov_cycles_ = 3; //cycles of the iterative solvers
+  optimet::t_real nearfield_gap_ = 0; //gap, relative to the radii, below which scatterers are preconditioned together
+  optimet::t_uint nearfield_size_ = 8; //largest number of scatterers preconditioned together
+  bool schwarz_cond_ = false; //iterative solves preconditioned over subdomains rather than near-field clusters
+  optimet::t_uint schwarz_subdomains_ = 0; //number of those subdomains, one per process if zero
+  optimet::t_real schwarz_overlap_ = 0; //gap, relative to the radii, within which scatterers join a neighbouring subdomain
+
+  std::vector<Cartesian<optimet::t_real>> periodic_; //vectors of the lattice repeating the objects, none if finite
+  std::vector<double> scan_; //wavelengths of the scan, as preloaded
+  bool automatic_harmonics_ = false; //orders of the particles picked at each wavelength
+  optimet::t_uint harmonics_margin_ = 1; //orders added to the Wiscombe criterion
+  optimet::t_uint Tinterpolation_ = 0; //Chebyshev nodes of the meshed T-matrices over the scan, none if zero
+  optimet::t_uint Tcheck_ = 10; //wavelengths of the scan between two direct checks of the interpolation
+  optimet::t_real Ttolerance_ = 1e-3; //relative error of the interpolated T-matrices at the checks
+  optimet::t_uint Tbatch_ = 1; //wavelengths of the meshed T-matrices per pass over the mesh
+
   /**
    * Default constructor for the Geometry class. Does not initialize.
    */
@@ -73,7 +145,113 @@ public:
    * @return the index of the object in which this point is or -1 if outside.
    */
   int checkInner(Spherical<double> R_);
+  /**
+   * Checks in which objects a set of points, e.g. a slab of a grid, are located.
+   * @param R the coordinates of the points to check.
+   * @return the index of the object of each point, -1 outside all of them.
+   */
+  std::vector<int> checkInner(std::vector<Spherical<double>> const &R);
+  /**
+   * Counts the objects whose surface passes near a point, e.g. to refine a grid.
+   * @param R the point, in Cartesian coordinates.
+   * @param reach the largest distance to a surface.
+   * @return the number of distinct objects within reach, meshes by their bounding spheres.
+   */
+  optimet::t_uint nearSurfaces(Cartesian<double> const &R, double reach);
+
+  // conditions for ACA compression
+  void ACAcompression(bool ACA_cond, optimet::t_real tolerance = 1e-3, bool recompress = false, bool single = false){ACA_cond_ = ACA_cond; ACA_tolerance_ = tolerance; ACA_recompress_ = recompress; ACA_single_ = single;}
+  bool get_ACAcond()const{return ACA_cond_;}
+  optimet::t_real get_ACAtolerance()const{return ACA_tolerance_;}
+  bool get_ACArecompress()const{return ACA_recompress_;}
+  bool get_ACAsingle()const{return ACA_single_;}
+
+  // conditions for the rotation-coaxial translation engine
+  void rotationCoupling(bool rotation_cond){rotation_cond_ = rotation_cond;}
+  bool get_rotationcond()const{return rotation_cond_;}
+
+  // conditions for the matrix-free scattering operator
+  void matrixFree(bool matrixfree_cond, bool cache_cond){matrixfree_cond_ = matrixfree_cond; cache_cond_ = cache_cond;}
+  bool get_matrixfreecond()const{return matrixfree_cond_;}
+  bool get_cachecond()const{return cache_cond_;}
+  void latticeCoupling(bool lattice_cond){lattice_cond_ = lattice_cond;}
+  bool get_latticecond()const{return lattice_cond_;}
+  void couplingSparsification(optimet::t_real tolerance){coupling_tolerance_ = tolerance;}
+  optimet::t_real get_couplingtolerance()const{return coupling_tolerance_;}
+
+  // conditions for the cyclic symmetry of the dense solves
+  void cyclicSymmetry(bool symmetry_cond, optimet::t_uint order){symmetry_cond_ = symmetry_cond; symmetry_order_ = order;}
+  bool get_symmetrycond()const{return symmetry_cond_;}
+  optimet::t_uint get_symmetryorder()const{return symmetry_order_;}
+
+  // conditions for the fast multipole method
+  void fastMultipole(bool FMM_cond, optimet::t_uint leaf, optimet::t_real digits){FMM_cond_ = FMM_cond; FMMleaf_ = leaf; FMMdigits_ = digits;}
+  bool get_FMMcond()const{return FMM_cond_;}
+  optimet::t_uint get_FMMleaf()const{return FMMleaf_;}
+  optimet::t_real get_FMMdigits()const{return FMMdigits_;}
+
+  // conditions for the recycling of Krylov subspaces
+  void krylovRecycling(optimet::t_uint recycle){recycle_ = recycle;}
+  optimet::t_uint get_recycle()const{return recycle_;}
+
+  // tolerance, restart length and number of cycles of the iterative solvers
+  void krylovSolver(optimet::t_real tolerance, optimet::t_uint restart, optimet::t_uint cycles){krylov_tolerance_ = tolerance; krylov_restart_ = restart; krylov_cycles_ = cycles;}
+  optimet::t_real get_krylovtolerance()const{return krylov_tolerance_;}
+  optimet::t_uint get_krylovrestart()const{return krylov_restart_;}
+  optimet::t_uint get_krylovcycles()const{return krylov_cycles_;}
+
+  // conditions for the near-field block-Jacobi preconditioner of the iterative solvers
+  void nearFieldPreconditioner(optimet::t_real gap, optimet::t_uint size){nearfield_gap_ = gap; nearfield_size_ = size;}
+  optimet::t_real get_nearfieldgap()const{return nearfield_gap_;}
+  optimet::t_uint get_nearfieldsize()const{return nearfield_size_;}
+  // conditions for the additive Schwarz preconditioner of the iterative solvers
+  void schwarzPreconditioner(bool schwarz_cond, optimet::t_uint subdomains, optimet::t_real overlap){schwarz_cond_ = schwarz_cond; schwarz_subdomains_ = subdomains; schwarz_overlap_ = overlap;}
+  bool get_schwarzcond()const{return schwarz_cond_;}
+  optimet::t_uint get_schwarzsubdomains()const{return schwarz_subdomains_;}
+  optimet::t_real get_schwarzoverlap()const{return schwarz_overlap_;}
+
+  // conditions for the orders of the particles picked from their size parameters
+  void automaticHarmonics(bool automatic, optimet::t_uint margin){automatic_harmonics_ = automatic; harmonics_margin_ = margin;}
+  bool get_automaticharmonics()const{return automatic_harmonics_;}
+
+  // the objects are the unit cell of an infinite array along two or three lattice vectors
+  void periodicLattice(std::vector<Cartesian<optimet::t_real>> const &periodic){periodic_ = periodic;}
+  std::vector<Cartesian<optimet::t_real>> const &get_periodic()const{return periodic_;}
 
+  // T-matrix library shared by successive runs
+  void TmatrixLibrary(std::string const &Tlibrary){Tlibrary_ = Tlibrary;}
+  std::string const &get_TmatrixLibrary()const{return Tlibrary_;}
+
+  // T-matrices of the meshed particles interpolated between Chebyshev nodes of the scan
+  void TmatrixInterpolation(optimet::t_uint nodes, optimet::t_uint check, optimet::t_real tolerance){Tinterpolation_ = nodes; Tcheck_ = check; Ttolerance_ = tolerance;}
+  optimet::t_uint get_TmatrixInterpolation()const{return Tinterpolation_;}
+  optimet::t_uint get_TmatrixCheck()const{return Tcheck_;}
+  optimet::t_real get_TmatrixTolerance()const{return Ttolerance_;}
+  std::map<std::string, std::vector<std::pair<optimet::Matrix<optimet::t_complex>,
+                                              optimet::Matrix<optimet::t_complex>>>> &
+  TmatrixNodes() const {
+    return Tnodes_;
+  }
+
+  // T-matrices of the meshed particles at batch wavelengths of the scan per pass over their meshes
+  void TmatrixBatch(optimet::t_uint batch){Tbatch_ = std::max<optimet::t_uint>(batch, 1);}
+  optimet::t_uint get_TmatrixBatch()const{return Tbatch_;}
+  std::map<std::string, std::pair<optimet::Matrix<optimet::t_complex>,
+                                  optimet::Matrix<optimet::t_complex>>> &
+  TmatrixAhead() const {
+    return Tahead_;
+  }
+
+  // T-matrices computed by all the processes in turn, by groups of processes in parallel, or either
+  void TmatrixDistribution(std::string const &Tdistribution){Tdistribution_ = Tdistribution;}
+  std::string const &get_TmatrixDistribution()const{return Tdistribution_;}
+
+  // T-matrices of all the particles in a shared memory window of each node
+  void TmatrixShared(bool Tshared){Tshared_ = Tshared;}
+  bool get_TmatrixShared()const{return Tshared_;}
+
+  // Couplings of the Clebsch Gordan series allowed by the selection rules, one entry of the tables each
+  optimet::symbol::CouplingPattern const &couplings(int nMax, int nMaxS);
   #ifdef OPTIMET_MPI
   // Clebsch Gordan series coeff
   void Coefficients(int nMax, int nMaxS, std::vector<double *> CLGcoeff, int gran1, int gran2);     
@@ -85,9 +263,15 @@ public:
 
 // vectors needed for the SH arbitrary shape in parallel
 #ifdef OPTIMET_MPI
-void getEXCvecSH_ARB3_parall(optimet::Vector<optimet::t_complex>& EXvec, std::shared_ptr<optimet::Excitation const> excitation, optimet::Vector<optimet::t_complex> &externalCoef_FF_, optimet::Vector<optimet::t_complex> &internalCoef_FF_, int gran1, int gran2, int objIndex);
+void getEXCvecSH_ARB_parall(optimet::Vector<optimet::t_complex>& EXvec, std::shared_ptr<optimet::Excitation const> excitation, optimet::Vector<optimet::t_complex> &internalCoef_FF_, int gran1, int gran2, int objIndex);
 
-void getEXCvecSH_ARB1_parall(optimet::Vector<optimet::t_complex>& EXvec, std::shared_ptr<optimet::Excitation const> excitation, optimet::Vector<optimet::t_complex> &externalCoef_FF_, optimet::Vector<optimet::t_complex> &internalCoef_FF_, int gran1, int gran2, int objIndex);
+//! \brief SH surface sources of rows gran1 to gran2 of a meshed object, radiative then regular
+//! \details The VSWFs at the quadrature points are computed on the first call and kept until the
+//! next update, each further call only contracting them with the FF coefficients. Both sources
+//! come from the same field and weights at each point.
+void shSurfaceSources(optimet::Vector<optimet::t_complex> &EXvec, optimet::t_real omega,
+                      optimet::Vector<optimet::t_complex> const &internalCoef_FF_, int gran1,
+                      int gran2, int objIndex);
 #endif
   /**
    * Updates the Geometry object to a new Excitation.
@@ -95,6 +279,26 @@ void getEXCvecSH_ARB1_parall(optimet::Vector<optimet::t_complex>& EXvec, std::sh
    */
   void update(std::shared_ptr<optimet::Excitation const> incWave_);
 
+  /**
+   * Preloads the tabulated materials of the objects for the wavelengths of a scan, and computes
+   * the Mie coefficients of each distinct sphere at all of them.
+   * @param lambdas the wavelengths of the scan.
+   */
+  void preload(std::vector<double> const &lambdas);
+
+  /**
+   * T and RgQ matrices of a sphere computed by preload.
+   * @param key the key of the sphere, Scatterer::TmatrixKey.
+   * @param Tmatrix the T-matrix.
+   * @param RgQmatrix the RgQ matrix.
+   * @return false if the scan did not reach this sphere at this wavelength.
+   */
+  bool sphereTmatrix(std::string const &key, optimet::Matrix<optimet::t_complex> &Tmatrix,
+                     optimet::Matrix<optimet::t_complex> &RgQmatrix) const;
+
+  //! Whether the scan goes through this wavelength, up to round-off
+  bool scanned(double lambda) const;
+
   //! Size of the scattering vector
   optimet::t_uint scatterer_size() const;
 
@@ -122,9 +326,27 @@ void getEXCvecSH_ARB1_parall(optimet::Vector<optimet::t_complex>& EXvec, std::sh
                            });
   }
 
+  //! Harmonics of the FF couplings of ii and jj, those of the larger of the two truncated objects
+  optimet::t_uint coupling_order(optimet::t_uint ii, optimet::t_uint jj) const {
+    return std::max(objects[ii].truncation(), objects[jj].truncation());
+  }
+
+  //! Whether some object has fewer harmonics in the FF system than the others
+  bool truncated() const {
+    return std::any_of(objects.begin(), objects.end(), [this](Scatterer const &object) {
+      return static_cast<optimet::t_uint>(object.truncation()) < nMax();
+    });
+  }
+
 protected:
   //! Validate last added sphere
   bool no_overlap(Scatterer const &object);
+
+private:
+  //! Bins object j, and all the others again if its diameter exceeds the cells
+  void bin(optimet::t_uint j);
+  //! Index of an object overlapping the given one, -1 if none
+  int overlap(Scatterer const &object) const;
 };
 
 #endif /* GEOMETRY_H_ */
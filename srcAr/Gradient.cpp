@@ -0,0 +1,172 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Gradient.h"
+#ifdef OPTIMET_MPI
+#include "Coupling.h"
+#include "Excitation.h"
+#include "Geometry.h"
+#include "PreconditionedMatrix.h"
+#include "Profile.h"
+#include "Tools.h"
+#include <Eigen/LU>
+#include <mpi.h>
+#include <stdexcept>
+
+namespace optimet {
+namespace {
+//! The coupling block [A^T B^T; B^T A^T] of a translation by R
+Matrix<t_complex> coupling_block(Cartesian<t_real> const &R, t_complex waveK, t_uint nMax,
+                                 bool regular) {
+  Coupling const AB(Tools::toSpherical(R), waveK, nMax, regular);
+  t_uint const n = nMax * (nMax + 2);
+  Matrix<t_complex> result(2 * n, 2 * n);
+  result << AB.diagonal.transpose(), AB.offdiagonal.transpose(), AB.offdiagonal.transpose(),
+      AB.diagonal.transpose();
+  return result;
+}
+
+//! R moved by h along axis 0, 1 or 2
+Cartesian<t_real> moved(Cartesian<t_real> R, t_uint axis, t_real h) {
+  (axis == 0 ? R.x : axis == 1 ? R.y : R.z) += h;
+  return R;
+}
+} // namespace
+
+CrossSectionGradient
+cross_section_gradient(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                       Matrix<t_complex> const &TmatrixFF, mpi::Communicator const &communicator) {
+  if(not geometry.get_periodic().empty())
+    throw std::runtime_error("The gradients of the cross sections need objects without a lattice");
+  auto const &objects = geometry.objects;
+  t_int const nobj = objects.size();
+  auto const nMax = objects.front().nMax;
+  for(auto const &object : objects)
+    if(object.nMax != nMax)
+      throw std::runtime_error("All objects must have same number of harmonics");
+  Profile::Region const timer("cross section gradient");
+  t_int const n = 2 * nMax * (nMax + 2);
+  t_complex const waveK = incWave->waveK;
+  auto const k2 = std::real(waveK) * std::real(waveK);
+  // the step of the central differences, the error of which is of order (k h)^2
+  auto const h = 1e-4 / std::abs(waveK);
+  t_int const nInc = incWave->nIncidences();
+  std::vector<std::shared_ptr<Excitation const>> incidences;
+  for(t_int i = 0; i < nInc; ++i)
+    incidences.push_back(nInc == 1 ? incWave : incWave->incidence(i));
+  std::vector<Cartesian<t_real>> centres;
+  for(auto const &object : objects)
+    centres.push_back(Tools::toCartesian(object.vR));
+
+  auto const size = static_cast<t_int>(communicator.size());
+  auto const rank = static_cast<t_int>(communicator.rank());
+  auto const first = [nobj, size](t_int r) { return r * (nobj / size) + std::min(r, nobj % size); };
+
+  Eigen::PartialPivLU<Matrix<t_complex>> const lu(
+      ScatteringMatrixFF_parr(TmatrixFF, geometry, incWave, communicator));
+
+  // the sources, the indirect and the scattered coefficients
+  Matrix<t_complex> sources(n * nobj, nInc);
+  for(t_int i = 0; i < nInc; ++i)
+    sources.col(i) = source_vector(geometry, incidences[i]);
+  Matrix<t_complex> const indirect = lu.solve(sources);
+  Matrix<t_complex> scattered(n * nobj, nInc);
+  for(t_int j = 0; j < nobj; ++j)
+    scattered.middleRows(j * n, n) =
+        TmatrixFF.block(0, j * n, n, n) * indirect.middleRows(j * n, n);
+
+  // The cross sections, with the derivatives of each with respect to the scattered coefficients:
+  // extinction then scattering for each incidence, sigma = Re(w^H f) to first order.
+  CrossSectionGradient result;
+  result.extinction = Vector<t_real>::Zero(nInc);
+  result.scattering = Vector<t_real>::Zero(nInc);
+  Matrix<t_complex> weights(n * nobj, 2 * nInc);
+  for(t_int j = 0; j < nobj; ++j) {
+    Matrix<t_complex> const translation = coupling_block(centres[j], waveK, nMax, false);
+    for(t_int i = 0; i < nInc; ++i) {
+      auto const f = scattered.col(i).segment(j * n, n);
+      auto const a = sources.col(i).segment(j * n, n);
+      Vector<t_complex> const y = translation * f;
+      result.extinction(i) -= std::real(a.dot(f)) / k2;
+      result.scattering(i) += y.squaredNorm() / k2;
+      weights.col(2 * i).segment(j * n, n) = -a / k2;
+      weights.col(2 * i + 1).segment(j * n, n) = 2.0 / k2 * translation.adjoint() * y;
+    }
+  }
+  result.absorption = result.extinction - result.scattering;
+
+  // the adjoint coefficients, S^H l = T^H w, with the factorization of S
+  for(t_int j = 0; j < nobj; ++j)
+    weights.middleRows(j * n, n) =
+        TmatrixFF.block(0, j * n, n, n).adjoint() * weights.middleRows(j * n, n).eval();
+  Matrix<t_complex> const adjoint = lu.adjoint().solve(weights);
+
+  // d sigma = Re(w^H df) + Re(l^H (da - dS y)) + the explicit terms, with dS y = -dC_ij f_j
+  Matrix<t_real> gradient = Matrix<t_real>::Zero(3 * nobj, 2 * nInc);
+  Vector<t_complex> plus(n), minus(n);
+  for(t_int j = first(rank); j < first(rank + 1); ++j)
+    for(t_uint axis = 0; axis < 3; ++axis) {
+      auto const forward = moved(centres[j], axis, h), backward = moved(centres[j], axis, -h);
+      Matrix<t_complex> const translation = coupling_block(centres[j], waveK, nMax, false);
+      Matrix<t_complex> const derivative = (coupling_block(forward, waveK, nMax, false) -
+                                            coupling_block(backward, waveK, nMax, false)) /
+                                           (2 * h);
+      for(t_int i = 0; i < nInc; ++i) {
+        incidences[i]->getIncLocal(Tools::toSpherical(forward), plus.data(), nMax);
+        incidences[i]->getIncLocal(Tools::toSpherical(backward), minus.data(), nMax);
+        Vector<t_complex> const da = (plus - minus) / (2 * h);
+        auto const f = scattered.col(i).segment(j * n, n);
+        Vector<t_complex> const y = translation * f;
+        gradient(3 * j + axis, 2 * i) +=
+            -std::real(da.dot(f)) / k2 + std::real(adjoint.col(2 * i).segment(j * n, n).dot(da));
+        gradient(3 * j + axis, 2 * i + 1) +=
+            2.0 / k2 * std::real(y.dot(derivative * f)) +
+            std::real(adjoint.col(2 * i + 1).segment(j * n, n).dot(da));
+      }
+    }
+  // the couplings of the pairs, each moving with both of its objects
+  for(t_int ii = first(rank); ii < first(rank + 1); ++ii)
+    for(t_int jj = 0; jj < nobj; ++jj) {
+      if(ii == jj)
+        continue;
+      auto const R = centres[ii] - centres[jj];
+      for(t_uint axis = 0; axis < 3; ++axis) {
+        Matrix<t_complex> const derivative =
+            (coupling_block(moved(R, axis, h), waveK, nMax, true) -
+             coupling_block(moved(R, axis, -h), waveK, nMax, true)) /
+            (2 * h);
+        Matrix<t_complex> const df = derivative * scattered.middleRows(jj * n, n);
+        for(t_int c = 0; c < 2 * nInc; ++c) {
+          auto const term = std::real(adjoint.col(c).segment(ii * n, n).dot(df.col(c / 2)));
+          gradient(3 * ii + axis, c) += term;
+          gradient(3 * jj + axis, c) -= term;
+        }
+      }
+    }
+  MPI_Allreduce(MPI_IN_PLACE, gradient.data(), gradient.size(), MPI_DOUBLE, MPI_SUM, *communicator);
+
+  result.d_extinction.resize(3 * nobj, nInc);
+  result.d_scattering.resize(3 * nobj, nInc);
+  for(t_int i = 0; i < nInc; ++i) {
+    result.d_extinction.col(i) = gradient.col(2 * i);
+    result.d_scattering.col(i) = gradient.col(2 * i + 1);
+  }
+  result.d_absorption = result.d_extinction - result.d_scattering;
+  return result;
+}
+} // namespace optimet
+#endif
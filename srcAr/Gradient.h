@@ -0,0 +1,59 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef OPTIMET_GRADIENT_H
+#define OPTIMET_GRADIENT_H
+
+#include "Types.h"
+#include "mpi/Communicator.h"
+#include <memory>
+
+#ifdef OPTIMET_MPI
+class Geometry;
+namespace optimet {
+class Excitation;
+
+/**
+ * The cross sections of a geometry at the fundamental frequency and their
+ * derivatives with respect to the centres of its objects, one column per
+ * incidence. The derivatives have the x, y and z of each object in turn, in
+ * m^2 per m.
+ */
+struct CrossSectionGradient {
+  Vector<t_real> extinction, scattering, absorption;
+  Matrix<t_real> d_extinction, d_scattering, d_absorption;
+};
+
+/**
+ * Computes the cross sections and their gradients with one factorization of the scattering
+ * matrix, solved for the scattered coefficients and, transposed, for the adjoint ones. The rest
+ * only takes the derivatives of the coupling blocks and of the sources, so that the gradient
+ * costs about as much as the cross sections, whatever the number of objects.
+ * The matrix is held whole by each process, the couplings shared out. Collective over
+ * communicator. Periodic lattices are not supported.
+ * @param geometry the objects, all with the same number of harmonics.
+ * @param incWave the excitation, at the wavelength of the T-matrices.
+ * @param TmatrixFF the T-matrices of the objects side by side, as the first half of the columns
+ * of getTRgQmatrix_FF_parr.
+ */
+CrossSectionGradient
+cross_section_gradient(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                       Matrix<t_complex> const &TmatrixFF,
+                       mpi::Communicator const &communicator = mpi::Communicator());
+} // namespace optimet
+#endif
+#endif
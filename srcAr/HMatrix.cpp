@@ -0,0 +1,929 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "HMatrix.h"
+#include "SolverStatistics.h"
+#include "Tools.h"
+#include "mpi/Communicator.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+namespace optimet {
+
+HMatrix::HMatrix(Geometry const &geometry, t_uint n, PairBlock const &block,
+                 PairSlice const &slice, t_real eta, t_real eps, t_uint leaf, bool recompress,
+                 bool single)
+    : n_(n), nobj_(geometry.objects.size()), single_(single) {
+  if(nobj_ == 0)
+    return;
+
+  std::vector<t_uint> objects(nobj_);
+  for(t_uint i = 0; i < nobj_; ++i)
+    objects[i] = i;
+  clusters_.reserve(2 * nobj_);
+  cluster(geometry, objects, std::max<t_uint>(leaf, 1));
+
+  // {rows, cols, admissible} for every leaf of the block cluster tree
+  std::vector<std::array<int, 3>> pairs;
+  partition(0, 0, eta, pairs);
+
+  // the blocks are dealt to the processes in turn
+  mpi::Communicator communicator;
+  int const rank = communicator.rank();
+  int const size = communicator.size();
+  for(std::size_t p = rank; p < pairs.size(); p += size) {
+    Block current;
+    current.rows = pairs[p][0];
+    current.cols = pairs[p][1];
+    current.compressed = pairs[p][2] and compress(current, block, slice, eps);
+    if(not current.compressed)
+      current.S_sub = dense(current, block);
+    else if(recompress)
+      HMatrix::recompress(current, eps);
+    blocks_.push_back(std::move(current));
+  }
+  schedule();
+  if(single_)
+    narrow();
+}
+
+int HMatrix::cluster(Geometry const &geometry, std::vector<t_uint> objects, t_uint leaf,
+                     t_uint first) {
+  int const index = clusters_.size();
+  clusters_.emplace_back();
+  clusters_[index].first = first;
+
+  // bounding box of the centers
+  std::array<t_real, 3> lower, upper;
+  lower.fill(std::numeric_limits<t_real>::max());
+  upper.fill(-std::numeric_limits<t_real>::max());
+  std::vector<std::array<t_real, 3>> centers;
+  for(auto const object : objects) {
+    auto const R = Tools::toCartesian(geometry.objects[object].vR);
+    centers.push_back({{R.x, R.y, R.z}});
+    for(int d = 0; d < 3; ++d) {
+      lower[d] = std::min(lower[d], centers.back()[d]);
+      upper[d] = std::max(upper[d], centers.back()[d]);
+    }
+  }
+
+  Cluster &current = clusters_[index];
+  for(int d = 0; d < 3; ++d)
+    current.center[d] = 0.5 * (lower[d] + upper[d]);
+  current.radius = 0;
+  for(std::size_t i = 0; i < objects.size(); ++i) {
+    t_real distance = 0;
+    for(int d = 0; d < 3; ++d)
+      distance += (centers[i][d] - current.center[d]) * (centers[i][d] - current.center[d]);
+    current.radius =
+        std::max(current.radius, std::sqrt(distance) + geometry.objects[objects[i]].radius);
+  }
+  current.children = {{-1, -1}};
+
+  if(objects.size() <= leaf) {
+    current.objects = std::move(objects);
+    return index;
+  }
+
+  // split in two halves along the longest axis
+  int axis = 0;
+  for(int d = 1; d < 3; ++d)
+    if(upper[d] - lower[d] > upper[axis] - lower[axis])
+      axis = d;
+  std::vector<std::size_t> order(objects.size());
+  for(std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&centers, axis](std::size_t a, std::size_t b) {
+    return centers[a][axis] < centers[b][axis];
+  });
+  std::vector<t_uint> lowerHalf, upperHalf;
+  for(std::size_t i = 0; i < order.size(); ++i)
+    (2 * i < order.size() ? lowerHalf : upperHalf).push_back(objects[order[i]]);
+
+  // clusters_ may be reallocated by the recursion
+  auto const left = cluster(geometry, lowerHalf, leaf, first);
+  auto const right = cluster(geometry, upperHalf, leaf, first + lowerHalf.size());
+  objects = clusters_[left].objects;
+  objects.insert(objects.end(), clusters_[right].objects.begin(), clusters_[right].objects.end());
+  clusters_[index].objects = std::move(objects);
+  clusters_[index].children = {{left, right}};
+  return index;
+}
+
+void HMatrix::partition(int rows, int cols, t_real eta,
+                        std::vector<std::array<int, 3>> &pairs) const {
+  auto const &A = clusters_[rows];
+  auto const &B = clusters_[cols];
+  t_real distance = 0;
+  for(int d = 0; d < 3; ++d)
+    distance += (A.center[d] - B.center[d]) * (A.center[d] - B.center[d]);
+  distance = std::sqrt(distance) - A.radius - B.radius;
+
+  // admissibility criterion for ACA
+  if(rows != cols and distance > 0 and 2.0 * std::max(A.radius, B.radius) <= eta * distance) {
+    pairs.push_back({{rows, cols, 1}});
+    return;
+  }
+
+  bool const leafA = A.children[0] < 0, leafB = B.children[0] < 0;
+  if(leafA and leafB)
+    pairs.push_back({{rows, cols, 0}});
+  else if(leafA)
+    for(auto const child : B.children)
+      partition(rows, child, eta, pairs);
+  else if(leafB)
+    for(auto const child : A.children)
+      partition(child, cols, eta, pairs);
+  else
+    for(auto const childA : A.children)
+      for(auto const childB : B.children)
+        partition(childA, childB, eta, pairs);
+}
+
+Matrix<t_complex> HMatrix::dense(Block const &block, PairBlock const &pair) const {
+  auto const &rows = clusters_[block.rows].objects;
+  auto const &cols = clusters_[block.cols].objects;
+  Matrix<t_complex> result(n_ * rows.size(), n_ * cols.size());
+  for(std::size_t j = 0; j < cols.size(); ++j)
+    for(std::size_t i = 0; i < rows.size(); ++i)
+      result.block(i * n_, j * n_, n_, n_) = pair(rows[i], cols[j]);
+  return result;
+}
+
+bool HMatrix::compress(Block &block, PairBlock const &pair, PairSlice const &slice,
+                       t_real eps) const {
+  auto const &rowObjects = clusters_[block.rows].objects;
+  auto const &colObjects = clusters_[block.cols].objects;
+  t_uint const m = n_ * rowObjects.size();
+  t_uint const p = n_ * colObjects.size();
+
+  // without slices, the pair blocks are only computed when one of their rows or columns is needed
+  std::map<std::pair<t_uint, t_uint>, Matrix<t_complex>> cache;
+  auto const entries = [&](t_uint i, t_uint j) -> Matrix<t_complex> const & {
+    auto const key = std::make_pair(i, j);
+    auto found = cache.find(key);
+    if(found == cache.end())
+      found = cache.emplace(key, pair(rowObjects[i], colObjects[j])).first;
+    return found->second;
+  };
+  auto const row = [&](t_uint i) {
+    Vector<t_complex> result(p);
+    for(t_uint j = 0; j < colObjects.size(); ++j)
+      result.segment(j * n_, n_) =
+          slice ? slice(rowObjects[i / n_], colObjects[j], i % n_, false) :
+                  Vector<t_complex>(entries(i / n_, j).row(i % n_).transpose());
+    return result;
+  };
+  auto const col = [&](t_uint j) {
+    Vector<t_complex> result(m);
+    for(t_uint i = 0; i < rowObjects.size(); ++i)
+      result.segment(i * n_, n_) = slice ? slice(rowObjects[i], colObjects[j / n_], j % n_, true) :
+                                           Vector<t_complex>(entries(i, j / n_).col(j % n_));
+    return result;
+  };
+  // largest unused entry, -1 if all are used or zero
+  auto const pivot = [](Vector<t_complex> const &vector, std::vector<bool> const &used) {
+    int result = -1;
+    t_real max = 0;
+    for(Eigen::Index i = 0; i < vector.size(); ++i)
+      if(not used[i] and std::abs(vector(i)) > max) {
+        max = std::abs(vector(i));
+        result = i;
+      }
+    return result;
+  };
+
+  // a compressed block should hold fewer entries than the dense one, which bounds its rank
+  t_uint const maxRank = (m * p) / (m + p);
+  Matrix<t_complex> U(m, maxRank), V(maxRank, p);
+  t_uint rank = 0;
+  std::vector<bool> usedRows(m, false), usedCols(p, false);
+  t_real norm2 = 0;
+  int i = 0;
+  while(i >= 0) {
+    if((rank + 1) * (m + p) >= m * p)
+      return false;
+
+    usedRows[i] = true;
+    Vector<t_complex> residualRow = row(i);
+    residualRow -= V.topRows(rank).transpose() * U.row(i).head(rank).transpose();
+    auto const j = pivot(residualRow, usedCols);
+    if(j < 0) {
+      // this row is already approximated, try the next one
+      i = std::find(usedRows.begin(), usedRows.end(), false) - usedRows.begin();
+      if(i == static_cast<int>(m))
+        break;
+      continue;
+    }
+    usedCols[j] = true;
+    Vector<t_complex> const v = residualRow / residualRow(j);
+    Vector<t_complex> u = col(j);
+    u -= U.leftCols(rank) * V.col(j).head(rank);
+
+    // squared Frobenius norm of the approximation
+    t_real const uv = u.squaredNorm() * v.squaredNorm();
+    norm2 += 2.0 * std::real((U.leftCols(rank).adjoint() * u)
+                                 .cwiseProduct(V.topRows(rank).conjugate() * v)
+                                 .sum());
+    norm2 += uv;
+    U.col(rank) = u;
+    V.row(rank) = v.transpose();
+    ++rank;
+    if(std::sqrt(uv) <= eps * std::sqrt(norm2))
+      break;
+
+    i = pivot(u, usedRows);
+  }
+
+  block.U = U.leftCols(rank);
+  block.V = V.topRows(rank);
+  return true;
+}
+
+void HMatrix::recompress(Block &block, t_real eps) {
+  t_uint const rank = block.U.cols();
+  if(rank <= 1)
+    return;
+  // U V = Qu Ru Rv^T Qv^T, with the SVD of the small Ru Rv^T
+  Eigen::HouseholderQR<Matrix<t_complex>> const qrU(block.U);
+  Eigen::HouseholderQR<Matrix<t_complex>> const qrV(block.V.transpose());
+  Matrix<t_complex> const Ru = qrU.matrixQR().topRows(rank).triangularView<Eigen::Upper>();
+  Matrix<t_complex> const Rv = qrV.matrixQR().topRows(rank).triangularView<Eigen::Upper>();
+  Eigen::JacobiSVD<Matrix<t_complex>> const svd(Ru * Rv.transpose(),
+                                                Eigen::ComputeFullU | Eigen::ComputeFullV);
+  auto const &sigma = svd.singularValues();
+
+  // the smallest rank leaving out at most eps of the Frobenius norm
+  t_real const threshold = eps * eps * sigma.squaredNorm();
+  t_uint cut = rank;
+  t_real tail = 0;
+  while(cut > 1 and tail + sigma(cut - 1) * sigma(cut - 1) <= threshold) {
+    --cut;
+    tail += sigma(cut) * sigma(cut);
+  }
+  if(cut == rank)
+    return;
+
+  Matrix<t_complex> const Qu = qrU.householderQ() * Matrix<t_complex>::Identity(block.U.rows(), rank);
+  Matrix<t_complex> const Qv = qrV.householderQ() * Matrix<t_complex>::Identity(block.V.cols(), rank);
+  block.U = Qu * (svd.matrixU().leftCols(cut) * sigma.head(cut).asDiagonal());
+  block.V = svd.matrixV().leftCols(cut).adjoint() * Qv.transpose();
+}
+
+void HMatrix::schedule() {
+  // the right factors of the compressed blocks of each cluster of columns, in a single matrix
+  std::vector<int> sources(clusters_.size(), -1);
+  std::vector<t_uint> sizes;
+  for(auto &block : blocks_) {
+    if(not block.compressed)
+      continue;
+    if(sources[block.cols] < 0) {
+      sources[block.cols] = sources_.size();
+      sources_.push_back(Source{block.cols, Matrix<t_complex>(), Matrix<std::complex<float>>()});
+      sizes.push_back(0);
+    }
+    block.source = sources[block.cols];
+    block.offset = sizes[block.source];
+    sizes[block.source] += block.V.rows();
+  }
+  for(t_uint s = 0; s < sources_.size(); ++s)
+    sources_[s].V.resize(sizes[s], n_ * clusters_[sources_[s].cols].objects.size());
+  for(auto &block : blocks_)
+    if(block.compressed) {
+      sources_[block.source].V.middleRows(block.offset, block.V.rows()) = block.V;
+      block.V.resize(0, 0);
+    }
+
+  // the rows of a cluster contain a leaf if its range in the root does
+  for(t_uint c = 0; c < clusters_.size(); ++c)
+    if(clusters_[c].children[0] < 0)
+      leaves_.push_back(c);
+  leafBlocks_.resize(leaves_.size());
+  for(t_uint b = 0; b < blocks_.size(); ++b) {
+    auto const &rows = clusters_[blocks_[b].rows];
+    for(t_uint l = 0; l < leaves_.size(); ++l) {
+      auto const &leaf = clusters_[leaves_[l]];
+      if(leaf.first >= rows.first and leaf.first < rows.first + rows.objects.size())
+        leafBlocks_[l].push_back(b);
+    }
+  }
+}
+
+void HMatrix::narrow() {
+  for(auto &block : blocks_)
+    if(block.compressed) {
+      block.U_single = block.U.cast<std::complex<float>>();
+      block.U.resize(0, 0);
+    }
+  for(auto &source : sources_) {
+    source.V_single = source.V.cast<std::complex<float>>();
+    source.V.resize(0, 0);
+  }
+}
+
+Vector<t_complex> HMatrix::operator*(Vector<t_complex> const &x) const {
+  return (*this * Matrix<t_complex>(x)).col(0);
+}
+
+Matrix<t_complex> HMatrix::operator*(Matrix<t_complex> const &X) const {
+  Matrix<t_complex> result = partial_product(X);
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *mpi::Communicator());
+#endif
+  return result;
+}
+
+Vector<t_complex> HMatrix::distributed_product(Vector<t_complex> const &x,
+                                               std::vector<int> const &counts) const {
+  Vector<t_complex> const partial = partial_product(x).col(0);
+  mpi::Communicator communicator;
+  Vector<t_complex> result(counts[communicator.rank()]);
+#ifdef OPTIMET_MPI
+  MPI_Reduce_scatter(partial.data(), result.data(), counts.data(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                     *communicator);
+#else
+  result = partial;
+#endif
+  return result;
+}
+
+Matrix<t_complex> HMatrix::partial_product(Matrix<t_complex> const &X) const {
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(rows(), X.cols());
+  if(nobj_ == 0)
+    return result;
+  // the vectors in the order of the root cluster, where each cluster is a contiguous segment
+  auto const &order = clusters_.front().objects;
+  Matrix<t_complex> input(rows(), X.cols()), output = Matrix<t_complex>::Zero(rows(), X.cols());
+  for(t_uint k = 0; k < nobj_; ++k)
+    input.middleRows(k * n_, n_) = X.middleRows(order[k] * n_, n_);
+
+  std::vector<Matrix<t_complex>> projections(sources_.size());
+  t_int const panel = 256;
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for(t_int s = 0; s < static_cast<t_int>(sources_.size()); ++s) {
+    auto const &cols = clusters_[sources_[s].cols];
+    auto const columns = input.middleRows(cols.first * n_, cols.objects.size() * n_);
+    if(not single_) {
+      projections[s] = sources_[s].V * columns;
+      continue;
+    }
+    // widened to double a panel at a time, so that the copy stays in cache
+    auto const &V = sources_[s].V_single;
+    projections[s] = Matrix<t_complex>::Zero(V.rows(), X.cols());
+    for(t_int c = 0; c < V.cols(); c += panel) {
+      auto const w = std::min<t_int>(panel, V.cols() - c);
+      projections[s].noalias() += V.middleCols(c, w).cast<t_complex>() * columns.middleRows(c, w);
+    }
+  }
+
+  // each leaf is written by one thread only
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for(t_int l = 0; l < static_cast<t_int>(leaves_.size()); ++l) {
+    auto const &leaf = clusters_[leaves_[l]];
+    auto rows = output.middleRows(leaf.first * n_, leaf.objects.size() * n_);
+    for(auto const b : leafBlocks_[l]) {
+      auto const &block = blocks_[b];
+      auto const row = (leaf.first - clusters_[block.rows].first) * n_;
+      if(block.compressed and single_)
+        rows.noalias() +=
+            block.U_single.middleRows(row, rows.rows()).cast<t_complex>() *
+            projections[block.source].middleRows(block.offset, block.U_single.cols());
+      else if(block.compressed)
+        rows.noalias() += block.U.middleRows(row, rows.rows()) *
+                          projections[block.source].middleRows(block.offset, block.U.cols());
+      else {
+        auto const &cols = clusters_[block.cols];
+        rows.noalias() += block.S_sub.middleRows(row, rows.rows()) *
+                          input.middleRows(cols.first * n_, cols.objects.size() * n_);
+      }
+    }
+  }
+  for(t_uint k = 0; k < nobj_; ++k)
+    result.middleRows(order[k] * n_, n_) = output.middleRows(k * n_, n_);
+  return result;
+}
+
+t_real HMatrix::memory() const {
+  t_real result = 0;
+  for(auto const &block : blocks_)
+    result += (block.U.size() + block.V.size() + block.S_sub.size()) * (16.0 / 1e6) +
+              block.U_single.size() * (8.0 / 1e6);
+  for(auto const &source : sources_)
+    result += source.V.size() * (16.0 / 1e6) + source.V_single.size() * (8.0 / 1e6);
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &result, 1, MPI_DOUBLE, MPI_SUM, *mpi::Communicator());
+#endif
+  return result;
+}
+
+Vector<t_complex> Gmres_Hcomp(HMatrix const &H, Vector<t_complex> const &Y, double tol, int maxit,
+                              int no_rest, Vector<t_complex> const &x0) {
+  return DistributedGmres(
+      [&H](Vector<t_complex> const &x, std::vector<int> const &counts) -> Vector<t_complex> {
+        return H.distributed_product(x, counts);
+      },
+      H.rows(), Y, tol, maxit, no_rest, x0);
+}
+
+Vector<t_complex> Gcrodr_Zcomp(HMatrix const &H, Vector<t_complex> const &Y, double tol, int maxit,
+                               int no_rest, KrylovRecycler &recycler, Vector<t_complex> const &x0) {
+  if(recycler.k == 0)
+    return Gmres_Hcomp(H, Y, tol, maxit, no_rest, x0);
+  return GcroDr([&H](Vector<t_complex> const &x) -> Vector<t_complex> { return H * x; }, H.rows(), Y,
+                tol, maxit, no_rest, recycler, x0);
+}
+
+namespace {
+//! \brief Right hand side and initial guess of the iterative solvers, known on all processes
+//! \details A guess further from the solution than zero is replaced by zero.
+std::tuple<Vector<t_complex>, Vector<t_complex>>
+initial_state(LinearOperator const &A, t_uint rows, Vector<t_complex> const &Y,
+              Vector<t_complex> const &x0) {
+  int const N = rows;
+  mpi::Communicator communicator;
+  int const rank = communicator.rank();
+
+  // the right hand side may only be known on the root
+  Vector<t_complex> b = rank == 0 ? Y : Vector<t_complex>::Zero(N);
+#ifdef OPTIMET_MPI
+  MPI_Bcast(b.data(), N, MPI_DOUBLE_COMPLEX, 0, *communicator);
+#endif
+
+  // so may the initial guess
+  bool guess = x0.size() == N;
+#ifdef OPTIMET_MPI
+  MPI_Bcast(&guess, 1, MPI_C_BOOL, 0, *communicator);
+#endif
+  Vector<t_complex> x = guess and rank == 0 ? x0 : Vector<t_complex>::Zero(N);
+#ifdef OPTIMET_MPI
+  if(guess)
+    MPI_Bcast(x.data(), N, MPI_DOUBLE_COMPLEX, 0, *communicator);
+#endif
+  if(guess and (b - A(x)).norm() > b.norm())
+    x = Vector<t_complex>::Zero(N);
+  return std::make_tuple(std::move(b), std::move(x));
+}
+
+//! Seconds elapsed since start
+t_real seconds_since(std::chrono::steady_clock::time_point const &start) {
+  return std::chrono::duration<t_real>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! Record of a solve, before its iterations
+KrylovRecord krylov_record(std::string const &method, t_uint rows) {
+  return KrylovRecord{method, rows, 0, std::vector<t_real>(), 0, 0, 0, 0};
+}
+
+//! \brief Orthogonalizes w against the first n columns of V, adding its components to h
+//! \details Classical Gram-Schmidt run twice, each pass being two matrix-vector products over
+//! the basis rather than n dot products and updates.
+void orthogonalize(Matrix<t_complex> const &V, int n, Vector<t_complex> &w,
+                   Eigen::Ref<Vector<t_complex>> h) {
+  for(int pass = 0; pass < 2; ++pass) {
+    Vector<t_complex> const c = V.leftCols(n).adjoint() * w;
+    w -= V.leftCols(n) * c;
+    h += c;
+  }
+}
+
+//! Givens rotations of the previous columns, then a new one zeroing h(n + 1, n)
+void givens(Matrix<t_complex> &h, Vector<t_complex> &cs, Vector<t_complex> &sn,
+            Vector<t_complex> &g, int n) {
+  for(int t = 0; t < n; ++t) {
+    auto const temp = std::conj(cs(t)) * h(t, n) + std::conj(sn(t)) * h(t + 1, n);
+    h(t + 1, n) = -sn(t) * h(t, n) + cs(t) * h(t + 1, n);
+    h(t, n) = temp;
+  }
+  double const r = std::sqrt(std::norm(h(n, n)) + std::norm(h(n + 1, n)));
+  cs(n) = h(n, n) / r;
+  sn(n) = h(n + 1, n) / r;
+  h(n, n) = r;
+  h(n + 1, n) = 0;
+  g(n + 1) = -sn(n) * g(n);
+  g(n) = std::conj(cs(n)) * g(n);
+}
+}
+
+Vector<t_complex> Gmres(LinearOperator const &A, t_uint rows, Vector<t_complex> const &Y, double tol,
+                        int maxit, int no_rest, Vector<t_complex> const &x0) {
+  int const N = rows;
+  mpi::Communicator communicator;
+  int const rank = communicator.rank();
+
+  Vector<t_complex> b, x;
+  std::tie(b, x) = initial_state(A, rows, Y, x0);
+  double const abs_y = b.norm();
+  if(abs_y == 0)
+    return Vector<t_complex>::Zero(N);
+  auto record = krylov_record("GMRES", rows);
+  auto const product = [&A, &record](Vector<t_complex> const &v) {
+    auto const start = std::chrono::steady_clock::now();
+    Vector<t_complex> result = A(v);
+    record.product += seconds_since(start);
+    return result;
+  };
+
+  double err = 1;
+  int iterations = 0;
+  // the basis of a cycle, allocated once for all of them
+  Matrix<t_complex> v(N, maxit + 1);
+  Matrix<t_complex> h(maxit + 1, maxit);
+  Vector<t_complex> cs(maxit), sn(maxit), g(maxit + 1);
+  for(int rest = 0; rest < no_rest and err > tol; ++rest) {
+    Vector<t_complex> res = b - product(x);
+    double const beta = res.norm();
+    err = beta / abs_y;
+    if(err <= tol)
+      break;
+
+    h.setZero();
+    g.setZero();
+    v.col(0) = res / beta;
+    g(0) = beta;
+
+    int n = 0;
+    while(n < maxit and err > tol) {
+      Vector<t_complex> w = product(v.col(n));
+      auto const start = std::chrono::steady_clock::now();
+      orthogonalize(v, n + 1, w, h.col(n).head(n + 1));
+      record.orthogonalization += seconds_since(start);
+      h(n + 1, n) = w.norm();
+      if(std::abs(h(n + 1, n)) > 0)
+        v.col(n + 1) = w / h(n + 1, n);
+
+      // Givens rotations bring the Hessenberg matrix to triangular form
+      givens(h, cs, sn, g, n);
+
+      err = std::abs(g(n + 1)) / abs_y;
+      record.residuals.push_back(err);
+      ++n;
+      ++iterations;
+    }
+
+    Vector<t_complex> const ym =
+        h.topLeftCorner(n, n).triangularView<Eigen::Upper>().solve(g.head(n));
+    x += v.leftCols(n) * ym;
+  }
+
+  record.iterations = iterations;
+  SolverStatistics::record(std::move(record));
+  if(rank == 0) {
+    std::cout << "GMRES converged at iteration" << '\t' << iterations << std::endl;
+    std::cout << "The relative residual is" << '\t' << err << std::endl;
+  }
+
+  return x;
+}
+
+namespace {
+//! Numbers of consecutive rows held by each process, as evenly as can be
+std::vector<int> row_counts(int N, mpi::Communicator const &communicator) {
+  int const size = communicator.size();
+  std::vector<int> result(size);
+  for(int p = 0; p < size; ++p)
+    result[p] = (N * (p + 1)) / size - (N * p) / size;
+  return result;
+}
+
+//! Sums the local values over the processes
+template <class T> T sum_all(T value, mpi::Communicator const &communicator) {
+#ifdef OPTIMET_MPI
+  if(communicator.size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, value.data(), value.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                  *communicator);
+#else
+  (void)communicator;
+#endif
+  return value;
+}
+t_real sum_all(t_real value, mpi::Communicator const &communicator) {
+#ifdef OPTIMET_MPI
+  if(communicator.size() > 1)
+    MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_SUM, *communicator);
+#else
+  (void)communicator;
+#endif
+  return value;
+}
+
+//! The whole vector, from the rows held by each process
+Vector<t_complex> gather_rows(Vector<t_complex> const &local, std::vector<int> const &counts,
+                              mpi::Communicator const &communicator) {
+  std::vector<int> displacements(counts.size(), 0);
+  for(std::size_t p = 1; p < counts.size(); ++p)
+    displacements[p] = displacements[p - 1] + counts[p - 1];
+  Vector<t_complex> result(displacements.back() + counts.back());
+#ifdef OPTIMET_MPI
+  MPI_Allgatherv(local.data(), local.size(), MPI_DOUBLE_COMPLEX, result.data(), counts.data(),
+                 displacements.data(), MPI_DOUBLE_COMPLEX, *communicator);
+#else
+  (void)communicator;
+  result = local;
+#endif
+  return result;
+}
+}
+
+Vector<t_complex> DistributedGmres(DistributedOperator const &A, t_uint rows,
+                                   Vector<t_complex> const &Y, double tol, int maxit, int no_rest,
+                                   Vector<t_complex> const &x0) {
+  int const N = rows;
+  mpi::Communicator communicator;
+  int const rank = communicator.rank();
+  auto const counts = row_counts(N, communicator);
+  int first = 0;
+  for(int p = 0; p < rank; ++p)
+    first += counts[p];
+  int const local = counts[rank];
+  auto record = krylov_record("distributed GMRES", rows);
+  auto const norm = [&communicator, &record](Vector<t_complex> const &v) {
+    auto const start = std::chrono::steady_clock::now();
+    auto const result = std::sqrt(sum_all(v.squaredNorm(), communicator));
+    record.communication += seconds_since(start);
+    return result;
+  };
+  auto const product = [&](Vector<t_complex> const &local) {
+    auto start = std::chrono::steady_clock::now();
+    auto const whole = gather_rows(local, counts, communicator);
+    record.communication += seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    Vector<t_complex> result = A(whole, counts);
+    record.product += seconds_since(start);
+    return result;
+  };
+
+  // the right hand side and the guess are only known on the root, then each keeps its rows
+  Vector<t_complex> b = rank == 0 ? Y : Vector<t_complex>::Zero(N);
+  bool guess = x0.size() == N;
+#ifdef OPTIMET_MPI
+  MPI_Bcast(b.data(), N, MPI_DOUBLE_COMPLEX, 0, *communicator);
+  MPI_Bcast(&guess, 1, MPI_C_BOOL, 0, *communicator);
+#endif
+  Vector<t_complex> x = guess and rank == 0 ? x0 : Vector<t_complex>::Zero(N);
+#ifdef OPTIMET_MPI
+  if(guess)
+    MPI_Bcast(x.data(), N, MPI_DOUBLE_COMPLEX, 0, *communicator);
+#endif
+  double const abs_y = b.norm();
+  if(abs_y == 0)
+    return Vector<t_complex>::Zero(N);
+  Vector<t_complex> const bl = b.segment(first, local);
+  Vector<t_complex> xl = x.segment(first, local);
+  // a guess further from the solution than zero is replaced by zero
+  Vector<t_complex> res = bl - A(x, counts);
+  if(guess and norm(res) > abs_y) {
+    xl.setZero();
+    res = bl;
+  }
+
+  double err = 1;
+  int iterations = 0;
+  // the rows of the basis held by this process, allocated once for all the cycles
+  Matrix<t_complex> v(local, maxit + 1);
+  Matrix<t_complex> h(maxit + 1, maxit);
+  Vector<t_complex> cs(maxit), sn(maxit), g(maxit + 1);
+  for(int rest = 0; rest < no_rest and err > tol; ++rest) {
+    if(rest > 0)
+      res = bl - product(xl);
+    double const beta = norm(res);
+    err = beta / abs_y;
+    if(err <= tol)
+      break;
+
+    h.setZero();
+    g.setZero();
+    v.col(0) = res / beta;
+    g(0) = beta;
+
+    int n = 0;
+    while(n < maxit and err > tol) {
+      Vector<t_complex> w = product(v.col(n));
+      // classical Gram-Schmidt twice, with one sum over the processes per pass
+      for(int pass = 0; pass < 2; ++pass) {
+        auto start = std::chrono::steady_clock::now();
+        Vector<t_complex> c = v.leftCols(n + 1).adjoint() * w;
+        record.orthogonalization += seconds_since(start);
+        start = std::chrono::steady_clock::now();
+        c = sum_all(c, communicator);
+        record.communication += seconds_since(start);
+        start = std::chrono::steady_clock::now();
+        w -= v.leftCols(n + 1) * c;
+        h.col(n).head(n + 1) += c;
+        record.orthogonalization += seconds_since(start);
+      }
+      h(n + 1, n) = norm(w);
+      if(std::abs(h(n + 1, n)) > 0)
+        v.col(n + 1) = w / h(n + 1, n);
+
+      givens(h, cs, sn, g, n);
+
+      err = std::abs(g(n + 1)) / abs_y;
+      record.residuals.push_back(err);
+      ++n;
+      ++iterations;
+    }
+
+    Vector<t_complex> const ym =
+        h.topLeftCorner(n, n).triangularView<Eigen::Upper>().solve(g.head(n));
+    xl += v.leftCols(n) * ym;
+  }
+
+  record.iterations = iterations;
+  SolverStatistics::record(std::move(record));
+  if(rank == 0) {
+    std::cout << "GMRES converged at iteration" << '\t' << iterations << std::endl;
+    std::cout << "The relative residual is" << '\t' << err << std::endl;
+  }
+
+  return gather_rows(xl, counts, communicator);
+}
+
+namespace {
+/**
+ * The recycled vectors of the next cycle, from the harmonic Ritz vectors of the smallest magnitude of
+ * A restricted to W, with A W = Vh G. Their images through A are the orthonormal columns of C.
+ */
+void harmonic_ritz(Matrix<t_complex> const &G, Matrix<t_complex> const &W,
+                   Matrix<t_complex> const &Vh, Matrix<t_complex> const &VhW, t_uint k,
+                   Matrix<t_complex> &U, Matrix<t_complex> &C) {
+  // G^H G z = theta G^H Vh^H W z, solved as an ordinary eigenproblem for 1 / theta
+  Matrix<t_complex> const GG = G.adjoint() * G;
+  Eigen::ComplexEigenSolver<Matrix<t_complex>> const eigen(GG.llt().solve(G.adjoint() * VhW));
+  std::vector<t_uint> order(GG.rows());
+  for(t_uint i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&eigen](t_uint a, t_uint b) {
+    return std::abs(eigen.eigenvalues()(a)) > std::abs(eigen.eigenvalues()(b));
+  });
+  Matrix<t_complex> P(GG.rows(), k);
+  for(t_uint i = 0; i < k; ++i)
+    P.col(i) = eigen.eigenvectors().col(order[i]);
+
+  Eigen::HouseholderQR<Matrix<t_complex>> const qr(G * P);
+  Matrix<t_complex> const R = qr.matrixQR().topRows(k).triangularView<Eigen::Upper>();
+  C = Vh * (qr.householderQ() * Matrix<t_complex>::Identity(G.rows(), k));
+  U = R.triangularView<Eigen::Upper>().solve<Eigen::OnTheRight>(W * P);
+}
+}
+
+Vector<t_complex> GcroDr(LinearOperator const &A, t_uint rows, Vector<t_complex> const &Y, double tol,
+                         int maxit, int no_rest, KrylovRecycler &recycler,
+                         Vector<t_complex> const &x0) {
+  if(recycler.k == 0)
+    return Gmres(A, rows, Y, tol, maxit, no_rest, x0);
+  if(recycler.k >= static_cast<t_uint>(maxit))
+    throw std::runtime_error("The recycled subspace should be smaller than a cycle");
+  int const N = rows;
+  t_uint const k = recycler.k;
+  mpi::Communicator communicator;
+  int const rank = communicator.rank();
+
+  Vector<t_complex> b, x;
+  std::tie(b, x) = initial_state(A, rows, Y, x0);
+  double const abs_y = b.norm();
+  if(abs_y == 0)
+    return Vector<t_complex>::Zero(N);
+  auto record = krylov_record("GCRO-DR", rows);
+  auto const product = [&A, &record](Vector<t_complex> const &v) {
+    auto const start = std::chrono::steady_clock::now();
+    Vector<t_complex> result = A(v);
+    record.product += seconds_since(start);
+    return result;
+  };
+  Vector<t_complex> res = b - product(x);
+
+  // the recycled vectors of a previous system, made into C = A U with orthonormal columns
+  Matrix<t_complex> U, C;
+  int iterations = 0;
+  if(recycler.U.rows() == N and recycler.U.cols() == static_cast<int>(k)) {
+    C.resize(N, k);
+    for(t_uint j = 0; j < k; ++j)
+      C.col(j) = product(recycler.U.col(j));
+    iterations += k;
+    Eigen::HouseholderQR<Matrix<t_complex>> const qr(C);
+    Matrix<t_complex> const R = qr.matrixQR().topRows(k).triangularView<Eigen::Upper>();
+    // a nearly singular image means the vectors no longer span anything useful
+    if(R.diagonal().cwiseAbs().minCoeff() >
+       std::numeric_limits<t_real>::epsilon() * R.diagonal().cwiseAbs().maxCoeff() * N) {
+      C = qr.householderQ() * Matrix<t_complex>::Identity(N, k);
+      U = R.triangularView<Eigen::Upper>().solve<Eigen::OnTheRight>(recycler.U);
+      Vector<t_complex> const c = C.adjoint() * res;
+      x += U * c;
+      res -= C * c;
+    }
+    else
+      C.resize(0, 0);
+  }
+
+  double err = res.norm() / abs_y;
+  // the Arnoldi basis of a cycle, allocated once for all of them
+  Matrix<t_complex> v(N, maxit + 1);
+  for(int rest = 0; rest < no_rest and err > tol; ++rest) {
+    // Arnoldi with (I - C C^H) A, for the vectors left over by the recycled ones
+    int const kk = U.cols();
+    int const m = maxit - kk;
+    double const beta = res.norm();
+    Matrix<t_complex> h = Matrix<t_complex>::Zero(m + 1, m), hr = h;
+    Matrix<t_complex> B(kk, m);
+    Vector<t_complex> cs(m), sn(m);
+    Vector<t_complex> g = Vector<t_complex>::Zero(m + 1);
+    v.col(0) = res / beta;
+    g(0) = beta;
+
+    int n = 0;
+    while(n < m and err > tol) {
+      Vector<t_complex> w = product(v.col(n));
+      auto const start = std::chrono::steady_clock::now();
+      if(kk > 0) {
+        B.col(n) = C.adjoint() * w;
+        w -= C * B.col(n);
+      }
+      orthogonalize(v, n + 1, w, h.col(n).head(n + 1));
+      record.orthogonalization += seconds_since(start);
+      h(n + 1, n) = w.norm();
+      if(std::abs(h(n + 1, n)) > 0)
+        v.col(n + 1) = w / h(n + 1, n);
+
+      // the components along C can always be cancelled, the residual is that of the Arnoldi part
+      hr.col(n) = h.col(n);
+      givens(hr, cs, sn, g, n);
+
+      err = std::abs(g(n + 1)) / abs_y;
+      record.residuals.push_back(err);
+      ++n;
+      ++iterations;
+    }
+
+    Vector<t_complex> const ym =
+        hr.topLeftCorner(n, n).triangularView<Eigen::Upper>().solve(g.head(n));
+    x += v.leftCols(n) * ym;
+    if(kk > 0)
+      x -= U * (B.leftCols(n) * ym);
+    res = b - product(x);
+    err = res.norm() / abs_y;
+
+    // G is the projection of A onto W = [U D, V_n], with A W = [C, V_{n+1}] G
+    if(kk + n <= static_cast<int>(k))
+      continue;
+    Matrix<t_complex> G = Matrix<t_complex>::Zero(kk + n + 1, kk + n);
+    Matrix<t_complex> W(N, kk + n), Vh(N, kk + n + 1);
+    Matrix<t_complex> VhW = Matrix<t_complex>::Zero(kk + n + 1, kk + n);
+    Vector<t_complex> D(kk);
+    for(int j = 0; j < kk; ++j)
+      D(j) = 1e0 / U.col(j).norm();
+    W.rightCols(n) = v.leftCols(n);
+    Vh.rightCols(n + 1) = v.leftCols(n + 1);
+    G.bottomRightCorner(n + 1, n) = h.topLeftCorner(n + 1, n);
+    VhW.bottomRightCorner(n + 1, n) = Matrix<t_complex>::Identity(n + 1, n);
+    if(kk > 0) {
+      W.leftCols(kk) = U * D.asDiagonal();
+      Vh.leftCols(kk) = C;
+      G.topLeftCorner(kk, kk) = D.asDiagonal();
+      G.topRightCorner(kk, n) = B.leftCols(n);
+      VhW.topLeftCorner(kk, kk) = C.adjoint() * W.leftCols(kk);
+      VhW.bottomLeftCorner(n + 1, kk) = v.leftCols(n + 1).adjoint() * W.leftCols(kk);
+    }
+    harmonic_ritz(G, W, Vh, VhW, k, U, C);
+
+    // the new C is orthogonal to the residual only up to round-off
+    Vector<t_complex> const c = C.adjoint() * res;
+    x += U * c;
+    res -= C * c;
+  }
+  recycler.U = U;
+
+  record.iterations = iterations;
+  SolverStatistics::record(std::move(record));
+  if(rank == 0) {
+    std::cout << "GCRO-DR converged at iteration" << '\t' << iterations << std::endl;
+    std::cout << "The relative residual is" << '\t' << err << std::endl;
+  }
+
+  return x;
+}
+}
@@ -0,0 +1,217 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_HMATRIX_H
+#define OPTIMET_HMATRIX_H
+
+#include "Excitation.h"
+#include "Geometry.h"
+#include "Types.h"
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The HMatrix class implements a hierarchical (H-matrix) representation of the
+ * scattering matrix. The scatterers are clustered into a binary tree and the
+ * blocks coupling well separated clusters are compressed with ACA, so
+ * that the storage grows as O(N log N) instead of O(N^2).
+ * The blocks are shared between the MPI processes, and so is the product with a vector.
+ */
+class HMatrix {
+public:
+  //! Block of the scattering matrix coupling object ii to object jj
+  typedef std::function<Matrix<t_complex>(t_uint ii, t_uint jj)> PairBlock;
+  //! Row, or column, index of the block of the scattering matrix coupling object ii to object jj
+  typedef std::function<Vector<t_complex>(t_uint ii, t_uint jj, t_uint index, bool column)>
+      PairSlice;
+
+  //! Node of the cluster tree
+  struct Cluster {
+    std::vector<t_uint> objects;    /**< The indices of the scatterers in the cluster. */
+    std::array<t_real, 3> center;   /**< The center of the bounding sphere. */
+    t_real radius;                  /**< The radius of the bounding sphere. */
+    std::array<int, 2> children;    /**< The two sub-clusters, -1 for leaves. */
+    t_uint first;                   /**< The position of its first scatterer in the root. */
+  };
+
+  //! Block of the scattering matrix coupling two clusters
+  struct Block {
+    int rows;           /**< The cluster of the rows. */
+    int cols;           /**< The cluster of the columns. */
+    Matrix<t_complex> U; /**< Left factor of a compressed block. */
+    Matrix<t_complex> V; /**< Right factor of a compressed block, until stacked. */
+    Matrix<t_complex> S_sub; /**< The block itself if not compressed. */
+    Matrix<std::complex<float>> U_single; /**< Left factor in single precision, replacing U. */
+    bool compressed;    /**< Whether the block is stored as U V. */
+    t_uint source;      /**< The stacked right factors holding V. */
+    t_uint offset;      /**< The first row of V in the stacked right factors. */
+  };
+
+  //! Right factors of all the compressed blocks of a cluster of columns, one on top of the other
+  struct Source {
+    int cols;           /**< The cluster of the columns. */
+    Matrix<t_complex> V; /**< The stacked right factors. */
+    Matrix<std::complex<float>> V_single; /**< The stacked right factors in single precision. */
+  };
+
+  /**
+   * Initialization constructor for the HMatrix class.
+   * @param geometry the geometry of the simulation.
+   * @param n the size of the block of one scatterer, 2 * nMax * (nMax + 2).
+   * @param block function returning the block coupling two scatterers.
+   * @param eta the admissibility parameter, clusters are compressed if
+   * 2 max(radius) <= eta * distance.
+   * @param eps the relative ACA tolerance.
+   * @param leaf the maximum number of scatterers in a leaf of the cluster tree.
+   * @param recompress whether the compressed blocks are cut to their rank at eps by QR and SVD.
+   * @param single whether the factors of the compressed blocks are stored in single precision.
+   */
+  HMatrix(Geometry const &geometry, t_uint n, PairBlock const &block, t_real eta = 1.0,
+          t_real eps = 1e-3, t_uint leaf = 4, bool recompress = false, bool single = false)
+      : HMatrix(geometry, n, block, PairSlice(), eta, eps, leaf, recompress, single) {}
+  /**
+   * Initialization constructor for the HMatrix class, the compressed blocks being built from
+   * single rows and columns of the pair blocks, which are then never computed whole.
+   * @param geometry the geometry of the simulation.
+   * @param n the size of the block of one scatterer, 2 * nMax * (nMax + 2).
+   * @param block function returning the block coupling two scatterers.
+   * @param slice function returning a row or a column of the block coupling two scatterers.
+   * @param eta the admissibility parameter, clusters are compressed if
+   * 2 max(radius) <= eta * distance.
+   * @param eps the relative ACA tolerance.
+   * @param leaf the maximum number of scatterers in a leaf of the cluster tree.
+   * @param recompress whether the compressed blocks are cut to their rank at eps by QR and SVD.
+   * @param single whether the factors of the compressed blocks are stored in single precision,
+   * the products still being accumulated in double precision.
+   */
+  HMatrix(Geometry const &geometry, t_uint n, PairBlock const &block, PairSlice const &slice,
+          t_real eta = 1.0, t_real eps = 1e-3, t_uint leaf = 4, bool recompress = false,
+          bool single = false);
+
+  //! \brief Product of the matrix with a vector, the result is known on all processes
+  //! \details The right factors sharing a cluster of columns are applied at once, then each leaf
+  //! of rows is accumulated by a single thread.
+  Vector<t_complex> operator*(Vector<t_complex> const &x) const;
+  //! Product with the columns of a matrix at once, each block being read once for all of them
+  Matrix<t_complex> operator*(Matrix<t_complex> const &X) const;
+  //! \brief Rows of the product with a vector held by this process
+  //! \details The processes hold counts[p] consecutive rows each, in the order of their ranks. Only
+  //! these rows are sent to each process, rather than the whole product to all of them.
+  Vector<t_complex> distributed_product(Vector<t_complex> const &x,
+                                        std::vector<int> const &counts) const;
+
+  //! Number of rows of the matrix
+  t_uint rows() const { return n_ * nobj_; }
+  //! Memory held by all the processes, in MB
+  t_real memory() const;
+
+protected:
+  //! The size of the block of one scatterer
+  t_uint n_;
+  //! The number of scatterers
+  t_uint nobj_;
+  //! Whether the factors of the compressed blocks are held in single precision
+  bool single_;
+  //! The cluster tree, the root is the first element
+  std::vector<Cluster> clusters_;
+  //! The blocks held by this process
+  std::vector<Block> blocks_;
+  //! The stacked right factors of the compressed blocks held by this process
+  std::vector<Source> sources_;
+  //! The leaves of the cluster tree
+  std::vector<int> leaves_;
+  //! The blocks held by this process whose rows contain each leaf
+  std::vector<std::vector<t_uint>> leafBlocks_;
+
+  //! \brief Recursively splits the scatterers along the longest axis of their bounding box
+  //! \details The scatterers of a cluster are those of its first child followed by those of the
+  //! second, starting at position first in the root.
+  int cluster(Geometry const &geometry, std::vector<t_uint> objects, t_uint leaf, t_uint first = 0);
+  //! Recursively builds the blocks of the pair of clusters (rows, cols)
+  void partition(int rows, int cols, t_real eta, std::vector<std::array<int, 3>> &pairs) const;
+  //! All the entries of a block
+  Matrix<t_complex> dense(Block const &block, PairBlock const &pair) const;
+  //! \brief Compresses a block with ACA and partial pivoting, false if it does not pay off
+  //! \details The rows and columns come from slice if given, from the pair blocks otherwise.
+  bool compress(Block &block, PairBlock const &pair, PairSlice const &slice, t_real eps) const;
+  //! Cuts a compressed block to its rank at relative tolerance eps, from the SVD of its factors
+  static void recompress(Block &block, t_real eps);
+  //! Stacks the right factors by clusters of columns and lists the blocks of each leaf of rows
+  void schedule();
+  //! Converts the factors of the compressed blocks to single precision, freeing the others
+  void narrow();
+  //! Contributions of the blocks held by this process to the product
+  Matrix<t_complex> partial_product(Matrix<t_complex> const &X) const;
+};
+
+//! Linear operator of the iterative solvers, the product is known on all processes
+typedef std::function<Vector<t_complex>(Vector<t_complex> const &)> LinearOperator;
+
+//! \brief Solves A x = Y with restarted GMRES, A being N by N
+//! \details Starts from x0 if it has N entries, from zero otherwise.
+Vector<t_complex> Gmres(LinearOperator const &A, t_uint N, Vector<t_complex> const &Y, double tol,
+                        int maxit, int no_rest, Vector<t_complex> const &x0 = Vector<t_complex>());
+
+//! Operator of the distributed solves, from a whole vector to the rows of its product held here
+typedef std::function<Vector<t_complex>(Vector<t_complex> const &, std::vector<int> const &counts)>
+    DistributedOperator;
+
+//! \brief Solves A x = Y with restarted GMRES, the Krylov vectors being shared between processes
+//! \details Each process holds counts[p] consecutive rows of the vectors, so that the basis and the
+//! orthogonalization cost N / P per process, the inner products being summed over the processes.
+//! The solution is known on all processes.
+Vector<t_complex> DistributedGmres(DistributedOperator const &A, t_uint N,
+                                   Vector<t_complex> const &Y, double tol, int maxit, int no_rest,
+                                   Vector<t_complex> const &x0 = Vector<t_complex>());
+
+//! Recycled subspace of GCRO-DR, carried from one linear system to the next
+struct KrylovRecycler {
+  //! Number of harmonic Ritz vectors kept between cycles and systems
+  t_uint k = 0;
+  //! The recycled vectors, empty before the first cycle
+  Matrix<t_complex> U;
+};
+
+//! \brief Solves A x = Y with GCRO-DR, A being N by N
+//! \details Each cycle of maxit vectors keeps recycler.k harmonic Ritz vectors of the smallest
+//! magnitude, which then deflate the next cycles and the next systems solved with the same recycler.
+//! Plain GMRES if recycler.k is zero.
+Vector<t_complex> GcroDr(LinearOperator const &A, t_uint N, Vector<t_complex> const &Y, double tol,
+                         int maxit, int no_rest, KrylovRecycler &recycler,
+                         Vector<t_complex> const &x0 = Vector<t_complex>());
+
+//! Solves S x = Y with GCRO-DR, S being any operator with a product and a number of rows
+template <class OPERATOR>
+Vector<t_complex> Gcrodr_Zcomp(OPERATOR const &S, Vector<t_complex> const &Y, double tol, int maxit,
+                               int no_rest, KrylovRecycler &recycler,
+                               Vector<t_complex> const &x0 = Vector<t_complex>()) {
+  return GcroDr([&S](Vector<t_complex> const &x) -> Vector<t_complex> { return S * x; }, S.rows(), Y,
+                tol, maxit, no_rest, recycler, x0);
+}
+
+//! Solves H x = Y with restarted GMRES on vectors shared between the processes, from x0 if given
+Vector<t_complex> Gmres_Hcomp(HMatrix const &H, Vector<t_complex> const &Y, double tol, int maxit,
+                              int no_rest, Vector<t_complex> const &x0 = Vector<t_complex>());
+//! Solves H x = Y with GCRO-DR, or with the distributed GMRES without recycled vectors
+Vector<t_complex> Gcrodr_Zcomp(HMatrix const &H, Vector<t_complex> const &Y, double tol, int maxit,
+                               int no_rest, KrylovRecycler &recycler,
+                               Vector<t_complex> const &x0 = Vector<t_complex>());
+}
+#endif
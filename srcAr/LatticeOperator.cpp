@@ -0,0 +1,226 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "LatticeOperator.h"
+#include "Coupling.h"
+#include "HMatrix.h"
+#include "Threads.h"
+#include "Tools.h"
+#include "constants.h"
+#include "mpi/Communicator.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <tuple>
+
+namespace optimet {
+namespace {
+//! \brief Spacing and number of sites of a grid holding the given coordinates
+//! \details Tries the smallest gap between coordinates and its fractions down to an eighth.
+std::tuple<t_real, t_real, t_uint> grid_axis(std::vector<t_real> coordinates) {
+  std::sort(coordinates.begin(), coordinates.end());
+  t_real const lowest = coordinates.front(), extent = coordinates.back() - lowest;
+  t_real const tolerance = 1e-6;
+  if(not(extent > 0))
+    return std::make_tuple(lowest, 1.0, 1);
+  t_real gap = extent;
+  for(std::size_t i = 1; i < coordinates.size(); ++i)
+    if(coordinates[i] - coordinates[i - 1] > tolerance * extent)
+      gap = std::min(gap, coordinates[i] - coordinates[i - 1]);
+  for(t_uint fraction = 1; fraction <= 8; ++fraction) {
+    t_real const spacing = gap / fraction;
+    bool const fits = std::all_of(coordinates.begin(), coordinates.end(), [&](t_real c) {
+      t_real const u = (c - lowest) / spacing;
+      return std::abs(u - std::round(u)) < tolerance * std::max<t_real>(1, u);
+    });
+    if(fits)
+      return std::make_tuple(lowest, spacing, static_cast<t_uint>(std::round(extent / spacing)) + 1);
+  }
+  throw std::runtime_error("The lattice couplings need scatterers on the sites of a regular grid");
+}
+
+//! Smallest power of two not below n
+t_uint power_of_two(t_uint n) {
+  t_uint result = 1;
+  while(result < n)
+    result *= 2;
+  return result;
+}
+
+//! In-place radix-2 FFT of n values, stride apart, with a forward or backward sign
+void fft(t_complex *data, t_uint n, t_uint stride, bool backward) {
+  for(t_uint i = 1, j = 0; i < n; ++i) {
+    t_uint bit = n >> 1;
+    for(; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if(i < j)
+      std::swap(data[i * stride], data[j * stride]);
+  }
+  for(t_uint length = 2; length <= n; length *= 2) {
+    t_real const angle = (backward ? 2 : -2) * consPi / length;
+    t_complex const root(std::cos(angle), std::sin(angle));
+    for(t_uint start = 0; start < n; start += length) {
+      t_complex w(1, 0);
+      for(t_uint k = 0; k < length / 2; ++k, w *= root) {
+        auto &even = data[(start + k) * stride];
+        auto &odd = data[(start + k + length / 2) * stride];
+        t_complex const t = w * odd;
+        odd = even - t;
+        even += t;
+      }
+    }
+  }
+}
+
+//! \brief FFT of each column of a matrix, holding a grid of the given dimensions
+//! \details The last axis is contiguous. The backward transform is not scaled.
+void fft(Matrix<t_complex> &grids, std::array<t_uint, 3> const &dims, bool backward) {
+  t_uint const strides[3] = {dims[1] * dims[2], dims[2], 1};
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for
+#endif
+  for(t_int c = 0; c < grids.cols(); ++c)
+    for(int a = 0; a < 3; ++a) {
+      if(dims[a] == 1)
+        continue;
+      for(t_uint i = 0; i < static_cast<t_uint>(grids.rows()); ++i)
+        // the first site of each line along axis a
+        if((i / strides[a]) % dims[a] == 0)
+          fft(grids.col(c).data() + i, dims[a], strides[a], backward);
+    }
+}
+}
+
+LatticeOperator::LatticeOperator(Matrix<t_complex> const &T, Geometry const &geometry,
+                                 t_complex waveK, t_uint nMax, bool SH)
+    : n_(2 * nMax * (nMax + 2)), nobj_(geometry.objects.size()), SH_(SH), T_(T, n_) {
+  // integer coordinates of the scatterers on the grid
+  std::vector<t_real> coordinates[3];
+  for(auto const &object : geometry.objects) {
+    auto const R = Tools::toCartesian(object.vR);
+    coordinates[0].push_back(R.x);
+    coordinates[1].push_back(R.y);
+    coordinates[2].push_back(R.z);
+  }
+  t_real lowest[3], spacing[3];
+  t_uint sites[3];
+  for(int a = 0; a < 3; ++a) {
+    std::tie(lowest[a], spacing[a], sites[a]) = grid_axis(coordinates[a]);
+    // the linear convolution fits without wrapping around
+    padded_[a] = power_of_two(2 * sites[a] - 1);
+  }
+  for(t_uint j = 0; j < nobj_; ++j) {
+    t_uint site = 0;
+    for(int a = 0; a < 3; ++a)
+      site = site * padded_[a] +
+             static_cast<t_uint>(std::round((coordinates[a][j] - lowest[a]) / spacing[a]));
+    sites_.push_back(site);
+  }
+
+  // the columns of the couplings are shared between the processes
+  mpi::Communicator communicator;
+  t_uint const rank = communicator.rank(), size = communicator.size();
+  columns_ = {{rank * n_ / size, (rank + 1) * n_ / size}};
+  t_uint const width = columns_[1] - columns_[0];
+  t_uint const P = padded_[0] * padded_[1] * padded_[2];
+  // the grids and the kernel are first written by the threads transforming and applying them
+  Matrix<t_complex> grids(P, n_ * width);
+  first_touch(grids.data(), grids.cols(), P);
+  if(width > 0) {
+    Matrix<t_complex> const columns = Matrix<t_complex>::Identity(n_, n_).middleCols(columns_[0], width);
+    t_int const span[3] = {static_cast<t_int>(sites[0]), static_cast<t_int>(sites[1]),
+                           static_cast<t_int>(sites[2])};
+    for(t_int u = 1 - span[0]; u < span[0]; ++u)
+      for(t_int v = 1 - span[1]; v < span[1]; ++v)
+        for(t_int w = 1 - span[2]; w < span[2]; ++w) {
+          if(u == 0 and v == 0 and w == 0)
+            continue;
+          // coupling from the site at the origin to the site at (u, v, w), wrapped around
+          Spherical<t_real> const R = Tools::toSpherical(
+              Cartesian<t_real>(u * spacing[0], v * spacing[1], w * spacing[2]));
+          Matrix<t_complex> const C = RotationCoupling(R, waveK, nMax).apply(columns, true);
+          t_uint const site = ((u + padded_[0]) % padded_[0] * padded_[1] + (v + padded_[1]) % padded_[1]) *
+                                  padded_[2] +
+                              (w + padded_[2]) % padded_[2];
+          for(t_uint b = 0; b < width; ++b)
+            for(t_uint a = 0; a < n_; ++a)
+              grids(site, a + n_ * b) = C(a, b);
+        }
+  }
+  fft(grids, padded_, false);
+  kernel_.resize(n_, width * P);
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for
+#endif
+  for(t_int k = 0; k < static_cast<t_int>(P); ++k)
+    for(t_uint b = 0; b < width; ++b)
+      for(t_uint a = 0; a < n_; ++a)
+        kernel_(a, k * width + b) = grids(k, a + n_ * b);
+}
+
+Vector<t_complex> LatticeOperator::operator*(Vector<t_complex> const &x) const {
+  t_uint const P = padded_[0] * padded_[1] * padded_[2];
+  t_uint const width = columns_[1] - columns_[0];
+  Vector<t_complex> result = Vector<t_complex>::Zero(rows());
+  if(width > 0) {
+    // the first harmonic couples T_j x_j, the second harmonic x_j
+    Matrix<t_complex> inputs = Matrix<t_complex>::Zero(P, width);
+    for(t_uint jj = 0; jj < nobj_; ++jj) {
+      Vector<t_complex> const y =
+          SH_ ? Vector<t_complex>(x.segment(jj * n_, n_)) :
+                Vector<t_complex>(T_.left(jj, x.segment(jj * n_, n_)));
+      inputs.row(sites_[jj]) = y.segment(columns_[0], width).transpose();
+    }
+    fft(inputs, padded_, false);
+
+    // product at each frequency, then back to the sites
+    Matrix<t_complex> outputs(P, n_);
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for
+#endif
+    for(t_int k = 0; k < static_cast<t_int>(P); ++k)
+      outputs.row(k) = (kernel_.middleCols(k * width, width) * inputs.row(k).transpose()).transpose();
+    fft(outputs, padded_, true);
+    for(t_uint ii = 0; ii < nobj_; ++ii)
+      result.segment(ii * n_, n_) = outputs.row(sites_[ii]).transpose() / static_cast<t_real>(P);
+  }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *mpi::Communicator());
+#endif
+  if(SH_)
+    for(t_uint ii = 0; ii < nobj_; ++ii)
+      result.segment(ii * n_, n_) = T_.left(ii, result.segment(ii * n_, n_));
+  else
+    result = -result;
+  return result + x;
+}
+
+t_real LatticeOperator::memory() const {
+  t_real result = T_.memory() + kernel_.size() * (16.0 / 1e6);
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &result, 1, MPI_DOUBLE, MPI_SUM, *mpi::Communicator());
+#endif
+  return result;
+}
+
+Vector<t_complex> Gmres_Zcomp(LatticeOperator const &S, Vector<t_complex> const &Y, double tol,
+                              int maxit, int no_rest, Vector<t_complex> const &x0) {
+  return Gmres([&S](Vector<t_complex> const &x) -> Vector<t_complex> { return S * x; }, S.rows(), Y,
+               tol, maxit, no_rest, x0);
+}
+}
@@ -0,0 +1,84 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_LATTICE_OPERATOR_H
+#define OPTIMET_LATTICE_OPERATOR_H
+
+#include "Geometry.h"
+#include "TmatrixBlocks.h"
+#include "Types.h"
+#include <array>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The LatticeOperator class applies the scattering matrix of scatterers on
+ * the sites of a regular grid, e.g. a crystal built by read_structure. The
+ * coupling of two scatterers then only depends on the displacement between
+ * their sites, so the sum over j of C_ij y_j is a discrete convolution over
+ * the grid. The couplings of all the displacements are computed once and
+ * transformed with FFTs over a grid padded to twice its size, after which a
+ * product costs O(P log P) for P sites of the grid. The columns of the
+ * couplings are shared between the MPI processes.
+ */
+class LatticeOperator {
+public:
+  /**
+   * Initialization constructor for the LatticeOperator class.
+   * @param T the T-matrices of the scatterers side by side, 2 pMax by nobj 2 pMax.
+   * @param geometry the geometry of the simulation, whose scatterers sit on a regular grid.
+   * @param waveK the wave number of the couplings.
+   * @param nMax the maximum value of the n iterator.
+   * @param SH whether the blocks are T_i C_ij, as for the second harmonic, or -C_ij T_j.
+   */
+  LatticeOperator(Matrix<t_complex> const &T, Geometry const &geometry, t_complex waveK,
+                  t_uint nMax, bool SH);
+
+  //! Product of the scattering matrix with a vector, the result is known on all processes
+  Vector<t_complex> operator*(Vector<t_complex> const &x) const;
+
+  //! Number of rows of the matrix
+  t_uint rows() const { return n_ * nobj_; }
+  //! Memory held by all the processes, in MB
+  t_real memory() const;
+  //! Number of sites of the padded grid along each axis
+  std::array<t_uint, 3> const &padded() const { return padded_; }
+
+protected:
+  //! The size of the block of one scatterer
+  t_uint n_;
+  //! The number of scatterers
+  t_uint nobj_;
+  //! Whether this is the second harmonic operator
+  bool SH_;
+  //! The T-matrices of the scatterers
+  TmatrixBlocks T_;
+  //! Sites of the padded grid along each axis, powers of two
+  std::array<t_uint, 3> padded_;
+  //! Site of each scatterer in the padded grid
+  std::vector<t_uint> sites_;
+  //! The first and one past the last column of the couplings held by this process
+  std::array<t_uint, 2> columns_;
+  //! Transformed couplings of these columns, n by their number for each frequency side by side
+  Matrix<t_complex> kernel_;
+};
+
+//! Solves S x = Y with restarted GMRES, S applied through the lattice operator
+Vector<t_complex> Gmres_Zcomp(LatticeOperator const &S, Vector<t_complex> const &Y, double tol,
+                              int maxit, int no_rest, Vector<t_complex> const &x0 = Vector<t_complex>());
+}
+#endif
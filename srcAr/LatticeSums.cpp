@@ -0,0 +1,309 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "LatticeSums.h"
+#include "Tools.h"
+#include "TranslationAdditionCoefficients.h"
+#include "constants.h"
+#include <Eigen/Cholesky>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <tuple>
+
+namespace optimet {
+namespace {
+typedef LatticeSums::t_vector t_vector;
+
+//! Largest shell of the Ewald sums, which converge well before
+constexpr t_int max_shells = 64;
+//! Relative contribution of a shell below which a sum has converged
+constexpr t_real tolerance = 1e-16;
+
+//! \brief Faddeeva function w(z) = exp(-z^2) erfc(-iz)
+//! \details Rational approximation of Weideman (1994) with 40 terms in the upper half-plane.
+t_complex faddeeva(t_complex z) {
+  if(z.imag() < 0)
+    return 2e0 * std::exp(-z * z) - faddeeva(-z);
+  constexpr t_int N = 40, M = 2 * N;
+  static t_real const L = std::sqrt(N / std::sqrt(2e0));
+  static std::vector<t_real> const coefficients = [] {
+    std::vector<t_real> result(N + 1, 0e0);
+    for(t_int k = 1 - M; k < M; ++k) {
+      auto const t = L * std::tan(0.5 * k * constant::pi / M);
+      auto const f = std::exp(-t * t) * (L * L + t * t);
+      for(t_int n = 1; n <= N; ++n)
+        result[n] += f * std::cos(constant::pi * n * k / M) / (2 * M);
+    }
+    return result;
+  }();
+  t_complex const iz(-z.imag(), z.real());
+  auto const Z = (L + iz) / (L - iz);
+  t_complex p = 0;
+  for(t_int n = N; n > 0; --n)
+    p = p * Z + coefficients[n];
+  return 2e0 * p / ((L - iz) * (L - iz)) + 1e0 / (std::sqrt(constant::pi) * (L - iz));
+}
+
+//! exp(c) erfc(u), given exp(c - u^2) which stays bounded where exp(c) or erfc(u) do not
+t_complex exp_erfc(t_complex u, t_complex c, t_complex gaussian) {
+  t_complex const iu(-u.imag(), u.real());
+  if(u.real() >= 0)
+    return gaussian * faddeeva(iu);
+  return 2e0 * std::exp(c) - gaussian * faddeeva(-iu);
+}
+
+//! Calls f on the integer offsets of the dimensions whose largest component is s
+template <class F> void shell(t_int s, t_uint dimensions, F const &f) {
+  t_int const j = dimensions > 1 ? s : 0, l = dimensions > 2 ? s : 0;
+  for(t_int a = -s; a <= s; ++a)
+    for(t_int b = -j; b <= j; ++b)
+      for(t_int c = -l; c <= l; ++c)
+        if(std::max(std::abs(a), std::max(std::abs(b), std::abs(c))) == s)
+          f(a, b, c);
+}
+
+//! sqrt((2l + 1) / 4 pi (l - k)! / (l + k)!), the normalization of Y_lk for k >= 0
+t_real normalization(t_int l, t_int k) {
+  t_real result = (2 * l + 1) / (4 * constant::pi);
+  for(t_int i = l - k + 1; i <= l + k; ++i)
+    result /= i;
+  return std::sqrt(result);
+}
+
+//! Y_lk(r) for l <= lMax at l (l + 1) + k
+void harmonics(t_vector const &r, t_int lMax, std::vector<t_complex> &result) {
+  spherical_harmonics(Tools::toSpherical(Cartesian<t_real>(r(0), r(1), r(2))), lMax, result);
+}
+
+//! Adds a shell to the sums, true once it no longer changes any l of them
+bool converged(std::vector<t_complex> const &shell, std::vector<t_complex> &sums, t_uint lMax) {
+  bool result = true;
+  for(t_uint l = 0; l <= lMax; ++l) {
+    t_real added = 0, total = 0;
+    for(t_uint i = l * l; i < (l + 1) * (l + 1); ++i) {
+      sums[i] += shell[i];
+      added += std::norm(shell[i]);
+      total += std::norm(sums[i]);
+    }
+    result = result and added <= tolerance * tolerance * total;
+  }
+  return result;
+}
+} // namespace
+
+LatticeSums::LatticeSums(std::vector<Cartesian<t_real>> const &lattice, t_complex waveK,
+                         Cartesian<t_real> const &bloch, t_uint lMax)
+    : waveK_(waveK), bloch_(bloch.x, bloch.y, bloch.z), lMax_(lMax) {
+  for(auto const &vector : lattice)
+    lattice_.emplace_back(vector.x, vector.y, vector.z);
+  if(lattice_.size() == 2) {
+    if(lattice_[0](2) != 0 or lattice_[1](2) != 0 or bloch_(2) != 0)
+      throw std::runtime_error("The vectors of a two-dimensional lattice must lie in the xy plane");
+    t_vector const normal = t_vector::UnitZ();
+    cell_ = std::abs(lattice_[0].cross(lattice_[1]).dot(normal));
+    reciprocal_.push_back(2 * constant::pi / cell_ * lattice_[1].cross(normal));
+    reciprocal_.push_back(2 * constant::pi / cell_ * normal.cross(lattice_[0]));
+    ewald_ = std::sqrt(constant::pi / cell_);
+  } else if(lattice_.size() == 3) {
+    cell_ = lattice_[0].dot(lattice_[1].cross(lattice_[2]));
+    for(t_uint i = 0; i < 3; ++i)
+      reciprocal_.push_back(2 * constant::pi / cell_ *
+                            lattice_[(i + 1) % 3].cross(lattice_[(i + 2) % 3]));
+    cell_ = std::abs(cell_);
+    ewald_ = std::sqrt(constant::pi) / std::cbrt(cell_);
+  } else
+    throw std::runtime_error("A lattice has two or three vectors");
+  if(cell_ == 0)
+    throw std::runtime_error("The vectors of the lattice are not independent");
+  // exp(k^2 / 4 E^2) grows large beyond the default splitting at short wavelengths
+  ewald_ = std::max(ewald_, std::abs(waveK_) / 3);
+}
+
+std::vector<t_complex> LatticeSums::operator()(Cartesian<t_real> const &d) const {
+  t_vector const position(d.x, d.y, d.z);
+  std::vector<t_complex> sums((lMax_ + 1) * (lMax_ + 1), 0e0);
+  auto const self = direct(position, sums);
+  reciprocal(position, sums);
+
+  auto const k = waveK_;
+  auto const E = ewald_;
+  if(self) {
+    // smooth part of the image left out of the direct sum, only its l = 0 term is non-zero at d
+    auto const smooth = std::exp(k * k / (4 * E * E)) *
+                        (t_complex(0, 1) * k * faddeeva(k / (2 * E)) +
+                         2 * E / std::sqrt(constant::pi));
+    sums[0] -= smooth / std::sqrt(4 * constant::pi);
+  }
+  // h_l(kr) Y_lk = (-1)^l / k^l Y_lk(grad) h_0(kr), with h_0(kr) = exp(ikr) / (ikr)
+  t_complex factor = 1e0 / (t_complex(0, 1) * k);
+  for(t_uint l = 0; l <= lMax_; ++l, factor *= -1e0 / k)
+    for(t_uint i = l * l; i < (l + 1) * (l + 1); ++i)
+      sums[i] *= factor;
+  return sums;
+}
+
+bool LatticeSums::direct(t_vector const &d, std::vector<t_complex> &sums) const {
+  // lattice vector closest to d, around which the shells are centered
+  Eigen::Matrix<t_real, 3, Eigen::Dynamic> vectors(3, lattice_.size());
+  for(t_uint i = 0; i < lattice_.size(); ++i)
+    vectors.col(i) = lattice_[i];
+  Vector<t_real> const coordinates = (vectors.transpose() * vectors).ldlt().solve(vectors.transpose() * d);
+  t_vector center = t_vector::Zero();
+  for(t_uint i = 0; i < lattice_.size(); ++i)
+    center += std::round(coordinates(i)) * lattice_[i];
+
+  auto const k = waveK_;
+  auto const E = ewald_;
+  auto const scale = std::sqrt(vectors.colwise().squaredNorm().minCoeff());
+  bool self = false;
+  std::vector<t_complex> added(sums.size());
+  std::vector<t_complex> J(lMax_ + 2), Y(sums.size());
+  for(t_int s = 0; s < max_shells; ++s) {
+    std::fill(added.begin(), added.end(), 0e0);
+    shell(s, lattice_.size(), [&](t_int a, t_int b, t_int c) {
+      t_vector R = center + a * lattice_[0] + b * lattice_[1];
+      if(lattice_.size() > 2)
+        R += c * lattice_[2];
+      t_vector const r = d - R;
+      t_real const distance = r.norm();
+      if(distance < 1e-12 * scale) {
+        self = true;
+        return;
+      }
+      // J_l = int_E^infty t^2l exp(-r^2 t^2 + k^2 / 4 t^2), by recurrence from J_-1 and J_0
+      auto const gaussian = std::exp(-distance * distance * E * E + k * k / (4 * E * E));
+      t_complex const ikr(-k.imag() * distance, k.real() * distance);
+      auto const plus = exp_erfc(distance * E + t_complex(0, 0.5) * k / E, ikr, gaussian);
+      auto const minus = exp_erfc(distance * E - t_complex(0, 0.5) * k / E, -ikr, gaussian);
+      J[0] = t_complex(0, 0.5) * std::sqrt(constant::pi) / k * (plus - minus);
+      J[1] = 0.25 * std::sqrt(constant::pi) / distance * (plus + minus);
+      for(t_uint l = 1; l <= lMax_; ++l)
+        J[l + 1] = (static_cast<t_real>(2 * l - 1) * J[l] - 0.5 * k * k * J[l - 1] +
+                    std::pow(E, 2 * l - 1) * gaussian) /
+                   (2 * distance * distance);
+
+      // Y_lk(grad) f(r) = r^l Y_lk(r) (d / r dr)^l f(r) for radial functions f
+      auto const phase = std::exp(t_complex(0, bloch_.dot(R)));
+      harmonics(r, lMax_, Y);
+      t_complex factor = phase * 2e0 / std::sqrt(constant::pi);
+      for(t_uint l = 0; l <= lMax_; ++l, factor *= -2e0 * distance)
+        for(t_uint i = l * l; i < (l + 1) * (l + 1); ++i)
+          added[i] += factor * J[l + 1] * Y[i];
+    });
+    if(converged(added, sums, lMax_) and s > 1)
+      break;
+  }
+  return self;
+}
+
+void LatticeSums::reciprocal(t_vector const &d, std::vector<t_complex> &sums) const {
+  auto const k = waveK_;
+  auto const E = ewald_;
+  t_int const lMax = lMax_;
+  std::vector<t_complex> added(sums.size()), Y(sums.size());
+  // derivatives along z of the two-dimensional terms, and the polynomials in d / dz applied to
+  // them
+  std::vector<t_complex> S(lMax + 1), D(lMax + 1), hermite(lMax + 1);
+  std::vector<std::vector<t_real>> polynomials(lMax + 1, std::vector<t_real>(lMax + 1));
+  for(t_int s = 0; s < max_shells; ++s) {
+    std::fill(added.begin(), added.end(), 0e0);
+    shell(s, reciprocal_.size(), [&](t_int a, t_int b, t_int c) {
+      t_vector K = bloch_ + a * reciprocal_[0] + b * reciprocal_[1];
+      if(reciprocal_.size() > 2)
+        K += c * reciprocal_[2];
+      auto const phase = std::exp(t_complex(0, K.dot(d)));
+
+      if(reciprocal_.size() > 2) {
+        // Y_lk(grad) exp(iK.d) = i^l |K|^l Y_lk(K) exp(iK.d)
+        auto const K2 = K.squaredNorm() - k * k;
+        auto const term = 4 * constant::pi / cell_ * phase * std::exp(-K2 / (4 * E * E)) / K2;
+        if(K.squaredNorm() == 0) {
+          added[0] += term / std::sqrt(4 * constant::pi);
+          return;
+        }
+        harmonics(K, lMax, Y);
+        t_complex factor = term;
+        for(t_int l = 0; l <= lMax; ++l, factor *= t_complex(0, K.norm()))
+          for(t_int i = l * l; i < (l + 1) * (l + 1); ++i)
+            added[i] += factor * Y[i];
+        return;
+      }
+
+      // pi / A exp(iK.r) g(z) / kappa, g(z) = exp(kappa z) erfc(kappa / 2E + z E) + (z -> -z)
+      auto const K2 = K(0) * K(0) + K(1) * K(1);
+      auto kappa = t_complex(0, -1) * std::sqrt(k * k - K2);
+      if(kappa.real() < 0)
+        kappa = -kappa;
+      auto const z = d(2);
+      auto const gaussian = std::exp(-kappa * kappa / (4 * E * E) - z * z * E * E);
+      auto const plus = exp_erfc(0.5 * kappa / E + z * E, kappa * z, gaussian);
+      auto const minus = exp_erfc(0.5 * kappa / E - z * E, -kappa * z, gaussian);
+      // g' = kappa (plus - minus), (plus - minus)' = kappa g - 2 H, with H(z) a Gaussian
+      S[0] = plus + minus;
+      D[0] = plus - minus;
+      t_real h0 = 1, h1 = 2 * z * E;
+      for(t_int n = 0; n <= lMax; ++n) {
+        hermite[n] = 2 * E / std::sqrt(constant::pi) * gaussian * std::pow(-E, n) * h0;
+        std::tie(h0, h1) = std::make_tuple(h1, 2 * z * E * h1 - 2 * (n + 1) * h0);
+      }
+      for(t_int n = 0; n < lMax; ++n) {
+        S[n + 1] = kappa * D[n];
+        D[n + 1] = kappa * S[n] - 2e0 * hermite[n];
+      }
+
+      // Y_lk(x, y, z) = N_lk (x + iy)^k P_lk(z, r^2), with z -> d / dz, r^2 -> d^2 / dz^2 - K^2
+      auto const term = constant::pi / (cell_ * kappa) * phase;
+      t_complex const up(-K(1), K(0)), down(K(1), K(0));
+      t_complex powers = 1e0;
+      for(t_int m = 0; m <= lMax; ++m, powers *= up) {
+        polynomials[m].assign(lMax + 1, 0e0);
+        polynomials[m][0] = m % 2 == 0 ? 1 : -1;
+        for(t_int i = 1; i <= m; ++i)
+          polynomials[m][0] *= 2 * i - 1;
+        auto previous = std::vector<t_real>(lMax + 1, 0e0);
+        auto const conjugate = std::pow(down, m) * (m % 2 == 0 ? 1e0 : -1e0);
+        for(t_int l = m; l <= lMax; ++l) {
+          t_complex value = 0;
+          for(t_int i = 0; i <= l - m; ++i)
+            value += polynomials[m][i] * S[i];
+          value *= term * normalization(l, m);
+          added[l * (l + 1) + m] += value * powers;
+          if(m > 0)
+            added[l * (l + 1) - m] += value * conjugate;
+          if(l == lMax)
+            break;
+          // (l - m + 1) P_l+1 = (2l + 1) z P_l - (l + m) r^2 P_l-1
+          std::vector<t_real> next(lMax + 1, 0e0);
+          for(t_int i = 0; i <= l - m; ++i) {
+            next[i + 1] += (2 * l + 1) * polynomials[m][i];
+            if(i + 2 <= lMax)
+              next[i + 2] -= (l + m) * previous[i];
+            next[i] += (l + m) * K2 * previous[i];
+          }
+          for(auto &coefficient : next)
+            coefficient /= l - m + 1;
+          previous = std::move(polynomials[m]);
+          polynomials[m] = std::move(next);
+        }
+      }
+    });
+    if(converged(added, sums, lMax_) and s > 1)
+      break;
+  }
+}
+}
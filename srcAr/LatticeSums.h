@@ -0,0 +1,82 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_LATTICE_SUMS_H
+#define OPTIMET_LATTICE_SUMS_H
+
+#include "Cartesian.h"
+#include "Types.h"
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The LatticeSums class implements the sums of the outgoing scalar waves
+ * h_l(k |d - R|) Y_lk(d - R) exp(i kB.R) over the vectors R of an infinite
+ * lattice, periodic along two or three directions, with Bloch vector kB.
+ * The translation addition coefficients are linear in these waves, so that
+ * their sums give the couplings of a scatterer with all the images of
+ * another, see TranslationAdditionCoefficients. The sums converge too slowly
+ * to be taken directly and are split as per Ewald into a sum over the lattice
+ * and a sum over the reciprocal lattice, both converging like Gaussians. Each
+ * wave is the solid harmonic Y_lk(grad) applied to h_0, which is applied
+ * term by term to both sums.
+ */
+class LatticeSums {
+public:
+  //! Vectors of the lattice
+  typedef Eigen::Matrix<t_real, 3, 1> t_vector;
+
+  /**
+   * Initialization constructor for the LatticeSums class.
+   * @param lattice the two or three vectors of the lattice, two in the xy plane.
+   * @param waveK the wave number of the background.
+   * @param bloch the Bloch vector, in the plane of the lattice if it has two vectors.
+   * @param lMax the largest l of the sums.
+   */
+  LatticeSums(std::vector<Cartesian<t_real>> const &lattice, t_complex waveK,
+              Cartesian<t_real> const &bloch, t_uint lMax);
+
+  //! \brief Sums at displacement d, for l <= lMax, at l (l + 1) + k
+  //! \details The image at d - R = 0, if any, is left out of the sums.
+  std::vector<t_complex> operator()(Cartesian<t_real> const &d) const;
+
+  //! Largest l of the sums
+  t_uint lMax() const { return lMax_; }
+
+protected:
+  //! Vectors of the lattice
+  std::vector<t_vector> lattice_;
+  //! Vectors of the reciprocal lattice
+  std::vector<t_vector> reciprocal_;
+  //! Area or volume of the unit cell
+  t_real cell_;
+  //! Splitting parameter of the Ewald sums, inverse of a length
+  t_real ewald_;
+  //! Wave number of the background
+  t_complex waveK_;
+  //! Bloch vector
+  t_vector bloch_;
+  //! Largest l of the sums
+  t_uint lMax_;
+
+  //! Adds Y_lk(grad) of the sum over the lattice, returns true if d - R = 0 for some R
+  bool direct(t_vector const &d, std::vector<t_complex> &sums) const;
+  //! Adds Y_lk(grad) of the sum over the reciprocal lattice
+  void reciprocal(t_vector const &d, std::vector<t_complex> &sums) const;
+};
+}
+#endif
@@ -0,0 +1,72 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "LowRankUpdate.h"
+
+namespace optimet {
+LowRankUpdate::LowRankUpdate(std::vector<t_uint> const &moved, t_uint nobj, t_uint n,
+                             PairBlock const &before, PairBlock const &after,
+                             Solve const &solve)
+    : moved_(moved), n_(n) {
+  t_uint const N = nobj * n;
+  t_uint const m = moved.size() * n;
+  std::vector<bool> is_moved(nobj, false);
+  for(auto const k : moved)
+    is_moved[k] = true;
+
+  // A_after - A_before = E rows_ + C E^T, where E picks the moved objects and C holds the changes
+  // of their block columns in the rows of the others: U = [E C] and V^T = [rows_; E^T]
+  rows_ = Matrix<t_complex>::Zero(m, N);
+  Matrix<t_complex> U = Matrix<t_complex>::Zero(N, 2 * m);
+  for(t_uint k = 0; k < moved.size(); ++k) {
+    U.block(moved[k] * n, k * n, n, n) = Matrix<t_complex>::Identity(n, n);
+    for(t_uint jj = 0; jj < nobj; ++jj)
+      rows_.block(k * n, jj * n, n, n) = after(moved[k], jj) - before(moved[k], jj);
+    for(t_uint ii = 0; ii < nobj; ++ii)
+      if(not is_moved[ii])
+        U.block(ii * n, m + k * n, n, n) = after(ii, moved[k]) - before(ii, moved[k]);
+  }
+
+  Z_ = solve(U);
+  Matrix<t_complex> capacitance = Matrix<t_complex>::Identity(2 * m, 2 * m);
+  capacitance.topRows(m) += rows_ * Z_;
+  for(t_uint k = 0; k < moved.size(); ++k)
+    capacitance.middleRows(m + k * n, n) += Z_.middleRows(moved[k] * n, n);
+  capacitance_ = capacitance.partialPivLu();
+}
+
+Matrix<t_complex> LowRankUpdate::solve(Matrix<t_complex> const &Y, Solve const &solve) const {
+  t_uint const m = moved_.size() * n_;
+  Matrix<t_complex> const X = solve(Y);
+  if(m == 0)
+    return X;
+  Matrix<t_complex> VX(2 * m, X.cols());
+  VX.topRows(m) = rows_ * X;
+  for(t_uint k = 0; k < moved_.size(); ++k)
+    VX.middleRows(m + k * n_, n_) = X.middleRows(moved_[k] * n_, n_);
+  return X - Z_ * capacitance_.solve(VX);
+}
+
+std::vector<t_uint> LowRankUpdate::moved(std::vector<t_real> const &before,
+                                         std::vector<t_real> const &after) {
+  std::vector<t_uint> result;
+  for(t_uint j = 0; 3 * j + 2 < std::min(before.size(), after.size()); ++j)
+    if(before[3 * j] != after[3 * j] or before[3 * j + 1] != after[3 * j + 1] or
+       before[3 * j + 2] != after[3 * j + 2])
+      result.push_back(j);
+  return result;
+}
+}
@@ -0,0 +1,81 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_LOW_RANK_UPDATE_H
+#define OPTIMET_LOW_RANK_UPDATE_H
+
+#include "Types.h"
+#include <Eigen/LU>
+#include <functional>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The LowRankUpdate class solves the scattering matrix of particles some of
+ * which moved since it was factorised, from the factors of the matrix before
+ * the moves. Moving a particle changes only its block row and column, so
+ * that the two matrices differ by U V^T, of rank twice the rows of the moved
+ * blocks. The Woodbury identity then gives the solutions of the new matrix
+ * from those of the old one, for U and for each source, and from a
+ * factorisation of the small matrix I + V^T A^{-1} U. The cost is that of as
+ * many solves with the old factors as the rank, rather than of a new
+ * factorisation.
+ */
+class LowRankUpdate {
+public:
+  //! Block of the scattering matrix coupling object ii to object jj
+  typedef std::function<Matrix<t_complex>(t_uint ii, t_uint jj)> PairBlock;
+  //! Solves the factorised matrix for the columns of its argument, known on all the processes
+  typedef std::function<Matrix<t_complex>(Matrix<t_complex> const &)> Solve;
+
+  /**
+   * Constructor. Each process computes all the changed blocks, fewer operations than the solves.
+   * @param moved the objects moved since the factorisation.
+   * @param nobj the number of objects.
+   * @param n the rows of a block.
+   * @param before the blocks of the factorised matrix.
+   * @param after the blocks of the matrix now.
+   * @param solve the solves with the factors of the matrix before the moves.
+   */
+  LowRankUpdate(std::vector<t_uint> const &moved, t_uint nobj, t_uint n, PairBlock const &before,
+                PairBlock const &after, Solve const &solve);
+
+  //! \brief Solves the matrix now for the columns of Y
+  //! \details Collective if the solves are, the result being known on all the processes.
+  Matrix<t_complex> solve(Matrix<t_complex> const &Y, Solve const &solve) const;
+
+  //! The rank of the difference between the two matrices
+  t_uint rank() const { return 2 * moved_.size() * n_; }
+
+  //! The objects whose positions, three coordinates each, differ between before and after
+  static std::vector<t_uint> moved(std::vector<t_real> const &before,
+                                   std::vector<t_real> const &after);
+
+protected:
+  //! The moved objects
+  std::vector<t_uint> moved_;
+  //! The rows of a block
+  t_uint n_;
+  //! The changes of the block rows of the moved objects, one after the other
+  Matrix<t_complex> rows_;
+  //! The solutions of the old matrix for U
+  Matrix<t_complex> Z_;
+  //! The factorisation of I + V^T Z
+  Eigen::PartialPivLU<Matrix<t_complex>> capacitance_;
+};
+}
+#endif
@@ -0,0 +1,126 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "MaterialTable.h"
+#include "constants.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace optimet {
+namespace {
+//! Largest number of samples of the resampled data
+constexpr t_uint max_samples = 1 << 20;
+
+//! The materials in use, by file
+std::map<std::string, std::weak_ptr<MaterialTable const>> &tables() {
+  static std::map<std::string, std::weak_ptr<MaterialTable const>> tables;
+  return tables;
+}
+}
+
+MaterialTable::MaterialTable(std::vector<t_real> const &lambdas,
+                             std::vector<t_complex> const &epsilon) {
+  if(lambdas.size() < 2 or lambdas.size() != epsilon.size())
+    throw std::runtime_error("A tabulated material needs at least two wavelengths");
+  auto step = lambdas.back() - lambdas.front();
+  for(t_uint i = 1; i < lambdas.size(); ++i) {
+    if(lambdas[i] <= lambdas[i - 1])
+      throw std::runtime_error("The wavelengths of a tabulated material must increase");
+    step = std::min(step, lambdas[i] - lambdas[i - 1]);
+  }
+  // as fine as the closest wavelengths, even data being kept as is
+  auto const span = lambdas.back() - lambdas.front();
+  auto const intervals = std::min<t_uint>(std::ceil(span / step - 1e-6), max_samples - 1);
+  first_ = lambdas.front();
+  step_ = span / intervals;
+  samples_.resize(intervals + 1);
+  t_uint j = 0;
+  for(t_uint i = 0; i <= intervals; ++i) {
+    auto const lambda = i == intervals ? lambdas.back() : first_ + i * step_;
+    while(j + 2 < lambdas.size() and lambdas[j + 1] < lambda)
+      ++j;
+    auto const t = (lambda - lambdas[j]) / (lambdas[j + 1] - lambdas[j]);
+    samples_[i] = (1 - t) * epsilon[j] + t * epsilon[j + 1];
+  }
+}
+
+MaterialTable::MaterialTable(t_real first, t_real step, std::vector<t_complex> samples)
+    : first_(first), step_(step), samples_(std::move(samples)) {
+  if(samples_.size() < 2 or not(step_ > 0))
+    throw std::runtime_error("A tabulated material needs at least two wavelengths");
+}
+
+std::shared_ptr<MaterialTable const> MaterialTable::load(std::string const &filename) {
+  auto result = tables()[filename].lock();
+  if(result)
+    return result;
+  std::ifstream file(filename);
+  if(not file)
+    throw std::runtime_error("Cannot open the material file " + filename);
+  std::vector<t_real> lambdas;
+  std::vector<t_complex> epsilon;
+  std::string line;
+  while(std::getline(file, line)) {
+    std::istringstream values(line);
+    t_real lambda, real, imag;
+    if(line.empty() or line[0] == '#' or not(values >> lambda))
+      continue;
+    if(not(values >> real >> imag))
+      throw std::runtime_error("Expected a wavelength and a permittivity in " + filename);
+    lambdas.push_back(lambda * consFrnmTom);
+    epsilon.emplace_back(real, imag);
+  }
+  result = std::make_shared<MaterialTable const>(lambdas, epsilon);
+  tables()[filename] = result;
+  return result;
+}
+
+void MaterialTable::share(std::string const &filename,
+                          std::shared_ptr<MaterialTable const> const &table) {
+  tables()[filename] = table;
+}
+
+t_complex MaterialTable::operator()(t_real lambda) const {
+  auto const position = (lambda - first_) / step_;
+  auto const last = samples_.size() - 1;
+  if(position < -1e-9 or position > last + 1e-9)
+    throw std::runtime_error("Wavelength outside of the tabulated material");
+  auto const i = std::min<t_uint>(std::max(position, 0e0), last - 1);
+  auto const t = position - i;
+  return (1 - t) * samples_[i] + t * samples_[i + 1];
+}
+
+Vector<t_complex> MaterialTable::operator()(Vector<t_real> const &lambdas) const {
+  t_real const last = samples_.size() - 1;
+  Eigen::Array<t_real, Eigen::Dynamic, 1> const positions = (lambdas.array() - first_) / step_;
+  if(lambdas.size() > 0 and (positions.minCoeff() < -1e-9 or positions.maxCoeff() > last + 1e-9))
+    throw std::runtime_error("Wavelength outside of the tabulated material");
+  Eigen::Array<t_real, Eigen::Dynamic, 1> const bins =
+      positions.max(0e0).floor().min(last - 1);
+  Eigen::Array<t_real, Eigen::Dynamic, 1> const t = positions - bins;
+  Vector<t_complex> result(lambdas.size());
+  for(t_int i = 0; i < lambdas.size(); ++i) {
+    auto const bin = static_cast<t_uint>(bins(i));
+    result(i) = (1 - t(i)) * samples_[bin] + t(i) * samples_[bin + 1];
+  }
+  return result;
+}
+}
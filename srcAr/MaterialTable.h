@@ -0,0 +1,92 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MATERIAL_TABLE_H_
+#define MATERIAL_TABLE_H_
+
+#include "Types.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The MaterialTable class holds the relative permittivity of a material
+ * tabulated against the wavelength, read-only. The data of a file need not
+ * be evenly spaced: it is resampled once onto an even grid as fine as its
+ * closest wavelengths, so that a permittivity is interpolated linearly
+ * from the two samples around it without any search.
+ *
+ * A file holds one wavelength in nm and the real and imaginary parts of
+ * the relative permittivity per line, lines starting with # being
+ * comments. The objects using the same file share a single instance.
+ */
+class MaterialTable {
+public:
+  /**
+   * Initializing constructor for the MaterialTable class.
+   * @param lambdas the wavelengths in m, increasing.
+   * @param epsilon the relative permittivities at these wavelengths.
+   */
+  MaterialTable(std::vector<t_real> const &lambdas, std::vector<t_complex> const &epsilon);
+  /**
+   * Initializing constructor for evenly resampled data.
+   * @param first the first wavelength in m.
+   * @param step the step between the wavelengths in m.
+   * @param samples the relative permittivities at these wavelengths.
+   */
+  MaterialTable(t_real first, t_real step, std::vector<t_complex> samples);
+
+  /**
+   * Returns the material of a file.
+   * @param filename the file of wavelengths and permittivities.
+   * @return the instance shared with the other users of the file.
+   */
+  static std::shared_ptr<MaterialTable const> load(std::string const &filename);
+
+  /**
+   * Makes a material the one load() returns for the given file while it is
+   * in use, e.g. once received from the process which read it.
+   * @param filename the file of wavelengths and permittivities.
+   * @param table the material.
+   */
+  static void share(std::string const &filename, std::shared_ptr<MaterialTable const> const &table);
+
+  //! Relative permittivity at a wavelength in m
+  t_complex operator()(t_real lambda) const;
+  //! Relative permittivities at all the wavelengths in m at once
+  Vector<t_complex> operator()(Vector<t_real> const &lambdas) const;
+
+  //! First wavelength of the resampled data
+  t_real first() const { return first_; }
+  //! Step between the wavelengths of the resampled data
+  t_real step() const { return step_; }
+  //! Relative permittivities of the resampled data
+  std::vector<t_complex> const &samples() const { return samples_; }
+
+private:
+  //! First wavelength of the resampled data
+  t_real first_;
+  //! Step between the wavelengths of the resampled data
+  t_real step_;
+  //! Relative permittivities of the resampled data
+  std::vector<t_complex> samples_;
+};
+}
+
+#endif
@@ -15,6 +15,10 @@
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
 #include "MatrixBelosSolver.h"
+#include "CouplingOperator.h"
+#include "FMM.h"
+#include "NearFieldPreconditioner.h"
+#include "SchwarzPreconditioner.h"
 #include "scalapack/LinearSystemSolver.h"
 #include "scalapack/BroadcastToOutOfContext.h"
 #include <chrono>
@@ -25,44 +29,66 @@ namespace solver {
 
 void MatrixBelos::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_,Vector<t_complex> &X_sca_SH,
                          Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const {
+  // the scattering matrices are applied without assembly, with the Belos parameters of the run
+  auto const tol = belos_parameters()->get<double>("Convergence Tolerance", 1e-7);
+  auto const maxit = belos_parameters()->get<int>("Num Blocks", 250);
+  auto const no_rest = belos_parameters()->get<int>("Maximum Restarts", 3);
+  recycleFF_.k = recycleSH_.k = geometry->get_recycle();
+  // kept for the extinction, which needs the incident coefficients about each object
+  sources_ = Q;
   //FF
-  if(context().is_valid()) {
-   
-    Matrix<t_complex> TmatrixFF, RgQmatrixFF;
-    int nMax = geometry->nMax();
-    int pMax = nMax * (nMax + 2);
-    TmatrixFF = S.block(0 ,0 , 2*pMax, 2*pMax);
-    RgQmatrixFF = S.block(0 , 2*pMax , 2*pMax, 2*pMax);
+  Matrix<t_complex> const &TmatrixFF = S.T, &RgQmatrixFF = S.RgQ;
+  int nMax = geometry->nMax();
+  int pMax = nMax * (nMax + 2);
 
-    X_sca_ = Q;
+  // preconditioned with the couplings of the nearly touching scatterers
+  auto const nearFF = preconditioner(
+      *geometry, 2 * pMax,
+      [&](t_uint ii, t_uint jj) { return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj); },
+      true, communicator());
+
+  if(geometry->get_FMMcond()) {
+    FMMOperator const SCATmatFF(TmatrixFF, *geometry, incWave->waveK, nMax, false,
+                                geometry->get_FMMleaf(), geometry->get_FMMdigits());
+    X_sca_ = Gcrodr_Zcomp(SCATmatFF, *nearFF, Q, tol, maxit, no_rest, recycleFF_,
+                          preconditioned_guess(0, TmatrixFF));
+  } else {
+    CouplingOperator const SCATmatFF(TmatrixFF, *geometry, incWave->waveK, nMax, false,
+                                     geometry->get_cachecond(), &couplings_,
+                                     keep_couplings(false));
+    X_sca_ = Gcrodr_Zcomp(SCATmatFF, *nearFF, Q, tol, maxit, no_rest, recycleFF_,
+                          preconditioned_guess(0, TmatrixFF));
+  }
+  PreconditionedMatrix::unprecondition(X_sca_, X_int_, TmatrixFF, RgQmatrixFF);
 
-    PreconditionedMatrix::unprecondition(X_sca_, X_int_, TmatrixFF, RgQmatrixFF);
- }
   //SH
   if(incWave->SH_cond){
   Vector<t_complex> KmNOD, K1;
-  Matrix<t_complex> TmatrixSH, RgQmatrixSH;
+  Matrix<t_complex> const &TmatrixSH = V.T, &RgQmatrixSH = V.RgQ;
 
    int nMaxS = geometry->nMaxS();
    int pMax = nMaxS * (nMaxS + 2);
-  TmatrixSH = V.block(0 ,0 , 2*pMax, 2*pMax);
-  RgQmatrixSH = V.block(0 , 2*pMax , 2*pMax, 2*pMax);
-
-  KmNOD = distributed_source_vector_SH_Mnode(*geometry, incWave, X_int_, X_sca_, TmatrixSH);
-  MPI_Barrier(MPI_COMM_WORLD);
 
-  K1 =  distributed_vector_SH_AR1(*geometry, incWave, X_int_, X_sca_);
-  MPI_Barrier(MPI_COMM_WORLD);
+  std::tie(KmNOD, K1) = distributed_source_vectors_SH(*geometry, incWave, X_int_, TmatrixSH);
 
-  if(context().is_valid()) {
-  
-    X_sca_SH = KmNOD;
+  auto const nearSH = preconditioner(
+      *geometry, 2 * pMax,
+      [&](t_uint ii, t_uint jj) { return ScatteringBlockSH(TmatrixSH, *geometry, incWave, ii, jj); },
+      true, communicator());
 
-    PreconditionedMatrix::unprecondition_SH(X_sca_SH, X_int_SH, K1, RgQmatrixSH);
- 
-   
+  if(geometry->get_FMMcond()) {
+    FMMOperator const SCATmatSH(TmatrixSH, *geometry, 2.0 * incWave->waveK, nMaxS, true,
+                                geometry->get_FMMleaf(), geometry->get_FMMdigits());
+    X_sca_SH = Gcrodr_Zcomp(SCATmatSH, *nearSH, KmNOD, tol, maxit, no_rest, recycleSH_,
+                            preconditioned_guess_SH(0, KmNOD.size()));
+  } else {
+    CouplingOperator const SCATmatSH(TmatrixSH, *geometry, 2.0 * incWave->waveK, nMaxS, true,
+                                     geometry->get_cachecond(), &couplings_,
+                                     keep_couplings(true));
+    X_sca_SH = Gcrodr_Zcomp(SCATmatSH, *nearSH, KmNOD, tol, maxit, no_rest, recycleSH_,
+                            preconditioned_guess_SH(0, KmNOD.size()));
   }
-  
+  PreconditionedMatrix::unprecondition_SH(X_sca_SH, X_int_SH, K1, RgQmatrixSH);
  }
 }
 }
@@ -0,0 +1,142 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "MeshFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace optimet {
+namespace {
+char const magic[8] = {'O', 'P', 'T', 'M', 'E', 'S', 'H', '1'};
+std::size_t const header = sizeof(magic) + 2 * sizeof(std::uint64_t);
+
+std::string filename(std::string const &directory, std::string const &kind,
+                     std::string const &dims, std::string const &extension) {
+  return directory + "/" + kind + "_" + dims + extension;
+}
+
+//! Meshes in use, by name of their binary file
+std::map<std::string, std::weak_ptr<MeshFile const>> &meshes() {
+  static std::map<std::string, std::weak_ptr<MeshFile const>> meshes;
+  return meshes;
+}
+
+//! Reads the text files of a mesh, with one-based vertices of the triangles
+void read_text(std::string const &dims, std::string const &directory, std::vector<double> &coord,
+               std::vector<int> &topol) {
+  std::ifstream file1(filename(directory, "coord", dims, ".txt")); // coordinates of the vertices
+  std::ifstream file2(filename(directory, "topol", dims, ".txt")); // vertices forming a triangle in a counterclockwise manner
+  if(not file1.is_open())
+    throw std::runtime_error(
+        "This mesh does not exist in the library, please create it and name it accordingly");
+  double num1 = 0;
+  while(file1 >> num1)
+    coord.emplace_back(num1);
+  int num2 = 0;
+  while(file2 >> num2)
+    topol.emplace_back(num2 - 1);
+}
+}
+
+MeshFile::MeshFile(std::vector<double> coord, std::vector<int> topol)
+    : coordVector_(std::move(coord)), topolVector_(std::move(topol)), coord_(coordVector_.data()),
+      topol_(topolVector_.data()), vertices_(coordVector_.size() / 3),
+      triangles_(topolVector_.size() / 3) {}
+
+MeshFile::~MeshFile() {
+  if(map_)
+    munmap(map_, length_);
+}
+
+std::shared_ptr<MeshFile const> MeshFile::map(std::string const &filename) {
+  int const descriptor = open(filename.c_str(), O_RDONLY);
+  if(descriptor < 0)
+    return nullptr;
+  struct stat status;
+  void *start = MAP_FAILED;
+  std::size_t length = 0;
+  if(fstat(descriptor, &status) == 0 and status.st_size >= static_cast<off_t>(header)) {
+    length = status.st_size;
+    start = mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0);
+  }
+  close(descriptor);
+  if(start == MAP_FAILED)
+    throw std::runtime_error("Could not map the mesh file " + filename);
+
+  std::shared_ptr<MeshFile> result(new MeshFile);
+  result->map_ = start;
+  result->length_ = length;
+  char const *bytes = static_cast<char const *>(start);
+  std::uint64_t counts[2];
+  std::memcpy(counts, bytes + sizeof(magic), sizeof(counts));
+  if(std::memcmp(bytes, magic, sizeof(magic)) != 0 or
+     length != header + 3 * counts[0] * sizeof(double) + 3 * counts[1] * sizeof(std::int32_t))
+    throw std::runtime_error("The mesh file " + filename + " is not a valid binary mesh");
+  result->vertices_ = counts[0];
+  result->triangles_ = counts[1];
+  result->coord_ = reinterpret_cast<double const *>(bytes + header);
+  result->topol_ = reinterpret_cast<int const *>(bytes + header + 3 * counts[0] * sizeof(double));
+  return result;
+}
+
+std::shared_ptr<MeshFile const> MeshFile::load(std::string const &dims,
+                                               std::string const &directory) {
+  // meshes stay shared while any scatterer uses them
+  auto const binary = filename(directory, "mesh", dims, ".bin");
+  auto result = meshes()[binary].lock();
+  if(result)
+    return result;
+  result = map(binary);
+  if(not result) {
+    std::vector<double> coord;
+    std::vector<int> topol;
+    read_text(dims, directory, coord, topol);
+    result = std::make_shared<MeshFile const>(std::move(coord), std::move(topol));
+  }
+  meshes()[binary] = result;
+  return result;
+}
+
+void MeshFile::share(std::string const &dims, std::shared_ptr<MeshFile const> const &mesh,
+                     std::string const &directory) {
+  meshes()[filename(directory, "mesh", dims, ".bin")] = mesh;
+}
+
+void MeshFile::convert(std::string const &dims, std::string const &directory) {
+  static_assert(sizeof(int) == sizeof(std::int32_t), "The binary meshes hold 32-bit integers");
+  std::vector<double> coord;
+  std::vector<int> topol;
+  read_text(dims, directory, coord, topol);
+  std::uint64_t const counts[2] = {coord.size() / 3, topol.size() / 3};
+  auto const binary = filename(directory, "mesh", dims, ".bin");
+  std::ofstream file(binary, std::ios::binary);
+  file.write(magic, sizeof(magic));
+  file.write(reinterpret_cast<char const *>(counts), sizeof(counts));
+  file.write(reinterpret_cast<char const *>(coord.data()), 3 * counts[0] * sizeof(double));
+  file.write(reinterpret_cast<char const *>(topol.data()), 3 * counts[1] * sizeof(int));
+  if(not file)
+    throw std::runtime_error("Could not write the mesh file " + binary);
+}
+}
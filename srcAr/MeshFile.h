@@ -0,0 +1,104 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MESH_FILE_H_
+#define MESH_FILE_H_
+
+#include "Types.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The MeshFile class holds the vertices and triangles of a mesh, read-only.
+ * A mesh of the library is read from the binary file mesh_<dims>.bin, which
+ * is mapped in memory so that the processes of a node share its pages, or
+ * else parsed from the text files coord_<dims>.txt and topol_<dims>.txt.
+ * The scatterers using the same dims share a single instance.
+ *
+ * The binary file holds the characters OPTMESH1, the numbers of vertices
+ * and triangles as 64-bit integers, the coordinates of the vertices as
+ * doubles and the zero-based vertices of the triangles as 32-bit integers,
+ * all in the byte order of the machine.
+ */
+class MeshFile {
+public:
+  /**
+   * Initializing constructor for the MeshFile class.
+   * @param coord the coordinates of the vertices, 3 per vertex.
+   * @param topol the zero-based vertices of the triangles, 3 per triangle.
+   */
+  MeshFile(std::vector<double> coord, std::vector<int> topol);
+  MeshFile(MeshFile const &) = delete;
+  MeshFile &operator=(MeshFile const &) = delete;
+  ~MeshFile();
+
+  /**
+   * Returns the mesh of the library with the given dimensions.
+   * @param dims the dimensions naming the files of the mesh.
+   * @param directory the directory of the library.
+   * @return the instance shared with the other users of the mesh.
+   */
+  static std::shared_ptr<MeshFile const>
+  load(std::string const &dims, std::string const &directory = "meshlib");
+
+  /**
+   * Makes a mesh the one load() returns for the given dimensions while it is
+   * in use, e.g. once received from the process which read it.
+   * @param dims the dimensions naming the files of the mesh.
+   * @param mesh the vertices and triangles of the mesh.
+   * @param directory the directory of the library.
+   */
+  static void share(std::string const &dims, std::shared_ptr<MeshFile const> const &mesh,
+                    std::string const &directory = "meshlib");
+
+  /**
+   * Writes the binary file of a mesh of the library from its text files.
+   * @param dims the dimensions naming the files of the mesh.
+   * @param directory the directory of the library.
+   */
+  static void convert(std::string const &dims, std::string const &directory = "meshlib");
+
+  //! Coordinates of the vertices, 3 per vertex
+  double const *coord() const { return coord_; }
+  //! Zero-based vertices of the triangles, 3 per triangle
+  int const *topol() const { return topol_; }
+  //! Number of vertices
+  t_uint vertices() const { return vertices_; }
+  //! Number of triangles
+  t_uint triangles() const { return triangles_; }
+
+private:
+  //! Maps a binary file, nullptr if it cannot be mapped
+  static std::shared_ptr<MeshFile const> map(std::string const &filename);
+  MeshFile() = default;
+
+  //! Arrays read from text files, empty when the mesh is mapped
+  std::vector<double> coordVector_;
+  std::vector<int> topolVector_;
+  //! Mapped binary file, if any
+  void *map_ = nullptr;
+  std::size_t length_ = 0;
+
+  double const *coord_ = nullptr;
+  int const *topol_ = nullptr;
+  t_uint vertices_ = 0, triangles_ = 0;
+};
+}
+#endif
@@ -0,0 +1,120 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "MirrorSymmetry.h"
+#include "Aliases.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace optimet {
+namespace {
+char const axes[3] = {'x', 'y', 'z'};
+
+//! Component c of a cartesian vector
+t_real component(Cartesian<t_real> const &x, t_uint c) {
+  return c == 0 ? x.x : c == 1 ? x.y : x.z;
+}
+
+//! \brief Whether the objects are their own images in the plane normal to axis c
+//! \details Each object needs a copy with the same T-matrix at the image of its center.
+bool symmetric(Geometry const &geometry, t_uint c, bool spheres) {
+  auto const &objects = geometry.objects;
+  for(auto const &a : objects) {
+    if(spheres and a.kind() != Scatterer::sphere)
+      return false;
+    auto const x = Tools::toCartesian(a.vR);
+    Cartesian<t_real> const image(c == 0 ? -x.x : x.x, c == 1 ? -x.y : x.y, c == 2 ? -x.z : x.z);
+    bool found = false;
+    for(auto const &b : objects)
+      if(Tools::findDistance(image, Tools::toCartesian(b.vR)) <= 1e-9 * a.radius and
+         a.sameTmatrix(b) and a.truncation() == b.truncation()) {
+        found = true;
+        break;
+      }
+    if(not found)
+      return false;
+  }
+  return true;
+}
+} // namespace
+
+MirrorSymmetry::MirrorSymmetry(Geometry const &geometry, Excitation const &excitation,
+                               std::string const &planes)
+    : given_(planes != "auto") {
+  if(planes.empty())
+    return;
+  for(auto const p : given_ ? planes : std::string("xyz")) {
+    if(p != 'x' and p != 'y' and p != 'z')
+      throw std::runtime_error("The mirror planes should be any of x, y and z, or auto");
+    t_uint const c = p - 'x';
+    // the direction and the polarization of the incident wave in cartesian components, the
+    // direction lying in the plane and the polarization along or normal to it
+    Spherical<t_real> const direction(1, excitation.vKInc.the, excitation.vKInc.phi);
+    auto const k = Tools::toCartesian(direction);
+    auto const E = Tools::toProjection(direction, excitation.Einc);
+    t_complex const e[3] = {E.rrr, E.the, E.phi};
+    t_real const norm = std::sqrt(std::norm(e[0]) + std::norm(e[1]) + std::norm(e[2]));
+    t_real const normal = std::abs(e[c]);
+    bool const plane_wave = excitation.type == 0 and excitation.incidences.empty() and
+                            geometry.get_periodic().empty();
+    bool const even = normal <= 1e-9 * norm, odd = normal >= (1 - 1e-9) * norm;
+    if(plane_wave and std::abs(component(k, c)) <= 1e-9 and (even or odd) and
+       symmetric(geometry, c, not given_)) {
+      planes_[c] = true;
+      parity_[c] = even ? 1 : -1;
+    } else if(given_)
+      throw std::runtime_error(std::string("The geometry and the plane wave are not symmetric "
+                                           "about the plane ") +
+                               axes[c] + " = 0");
+  }
+}
+
+void MirrorSymmetry::restrict(OutputGrid const &grid) {
+  auto const &p = grid.gridParameters;
+  for(t_uint c = 0; c < 3; ++c) {
+    if(not planes_[c])
+      continue;
+    t_real const low = p[3 * c], high = p[3 * c + 1];
+    if(grid.type == O3DCartesianRegular and
+       std::abs(low + high) <= 1e-9 * std::max(std::abs(high - low), 1e-300))
+      continue;
+    if(given_)
+      throw std::runtime_error(std::string("The field grid is not symmetric about the plane ") +
+                               axes[c] + " = 0");
+    planes_[c] = false;
+  }
+}
+
+void MirrorSymmetry::reflect(t_uint mask, t_complex *values) const {
+  // the parity of E, and P negating the components normal to the planes
+  t_real sign = 1;
+  t_uint planes = 0;
+  for(t_uint c = 0; c < 3; ++c)
+    if(mask & (1u << c)) {
+      sign *= parity_[c];
+      ++planes;
+    }
+  // H is a pseudo vector, of the opposite parity in each plane
+  t_real const pseudo = planes % 2 == 0 ? 1 : -1;
+  t_real const factors[4] = {sign, sign * pseudo, 1, pseudo};
+  for(t_uint field = 0; field < 4; ++field)
+    for(t_uint c = 0; c < 3; ++c)
+      values[3 * field + c] *= (mask & (1u << c) ? -1.0 : 1.0) * factors[field];
+}
+
+} // namespace optimet
@@ -0,0 +1,82 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_MIRROR_SYMMETRY_H
+#define OPTIMET_MIRROR_SYMMETRY_H
+
+#include "Excitation.h"
+#include "Geometry.h"
+#include "OutputGrid.h"
+#include "Types.h"
+#include <array>
+#include <string>
+
+namespace optimet {
+
+/**
+ * The MirrorSymmetry class holds the planes x = 0, y = 0 and z = 0 that both
+ * the geometry and the excitation are symmetric about. The reflection P in
+ * such a plane takes the FF E field to its parity times P E, the parity being
+ * that of the polarization of the incident wave, and the H field, a pseudo
+ * vector, to minus that. The SH fields are quadratic in the FF ones, so that
+ * their parity is always even. The fields at the image of a point then follow
+ * from those at the point.
+ */
+class MirrorSymmetry {
+public:
+  //! No planes
+  MirrorSymmetry() = default;
+
+  /**
+   * Finds the planes shared by the geometry and the excitation.
+   * @param geometry the geometry of the simulation, finite.
+   * @param excitation the plane wave, a single incidence.
+   * @param planes the planes, any of x, y and z, e.g. "xz" for x = 0 and z = 0, or "auto" for
+   * all those found. Only spheres are compared in auto, the shapes being trusted otherwise.
+   * @throw std::runtime_error if a plane given is not shared by the geometry and the excitation.
+   */
+  MirrorSymmetry(Geometry const &geometry, Excitation const &excitation,
+                 std::string const &planes);
+
+  //! Whether there is no plane
+  bool empty() const { return not(planes_[0] or planes_[1] or planes_[2]); }
+  //! Whether the plane normal to axis 0, 1 or 2 is one of the planes
+  bool plane(t_uint axis) const { return planes_[axis]; }
+
+  /**
+   * Keeps the planes a regular grid is symmetric about too.
+   * @throw std::runtime_error if the planes were given and the grid is not symmetric about one.
+   */
+  void restrict(OutputGrid const &grid);
+
+  /**
+   * Turns the fields at a point into those at its image in some of the planes.
+   * @param mask the planes, bit c for the plane normal to axis c.
+   * @param values the FF E and H then the SH E and H, cartesian components.
+   */
+  void reflect(t_uint mask, t_complex *values) const;
+
+private:
+  //! The planes normal to x, y and z
+  std::array<bool, 3> planes_{{false, false, false}};
+  //! Parity of the FF E field in each plane
+  std::array<t_real, 3> parity_{{1, 1, 1}};
+  //! Whether the planes were given rather than found
+  bool given_ = false;
+};
+
+} // namespace optimet
+
+#endif
@@ -0,0 +1,118 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "NearFieldPreconditioner.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <tuple>
+
+namespace optimet {
+
+NearFieldPreconditioner::NearFieldPreconditioner(Geometry const &geometry, t_uint n,
+                                                 PairBlock const &block, t_real gap, t_uint size)
+    : n_(n), nobj_(geometry.objects.size()) {
+  if(not(gap > 0) or size < 2 or nobj_ < 2)
+    return;
+
+  // the pairs close enough, closest first
+  std::vector<std::tuple<t_real, t_uint, t_uint>> pairs;
+  for(t_uint ii = 0; ii < nobj_; ++ii) {
+    auto Ri = Tools::toCartesian(geometry.objects[ii].vR);
+    auto const ri = geometry.objects[ii].radius;
+    for(t_uint jj = ii + 1; jj < nobj_; ++jj) {
+      auto const rj = geometry.objects[jj].radius;
+      auto Rij = Ri - Tools::toCartesian(geometry.objects[jj].vR);
+      auto const distance = std::sqrt(Rij * Rij) - ri - rj;
+      if(distance <= gap * std::min(ri, rj))
+        pairs.emplace_back(distance, ii, jj);
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+
+  // the clusters of the closest pairs are merged while they stay small enough
+  std::vector<t_uint> root(nobj_), count(nobj_, 1);
+  std::iota(root.begin(), root.end(), 0);
+  auto const find = [&root](t_uint i) {
+    while(root[i] != i)
+      i = root[i] = root[root[i]];
+    return i;
+  };
+  for(auto const &pair : pairs) {
+    auto const a = find(std::get<1>(pair)), b = find(std::get<2>(pair));
+    if(a == b or count[a] + count[b] > size)
+      continue;
+    root[b] = a;
+    count[a] += count[b];
+  }
+
+  std::vector<int> cluster(nobj_, -1);
+  for(t_uint i = 0; i < nobj_; ++i) {
+    auto const r = find(i);
+    if(count[r] < 2)
+      continue;
+    if(cluster[r] < 0) {
+      cluster[r] = clusters_.size();
+      clusters_.emplace_back();
+    }
+    clusters_[cluster[r]].objects.push_back(i);
+  }
+
+  for(auto &current : clusters_) {
+    auto const m = current.objects.size();
+    current.S.resize(m * n_, m * n_);
+    for(t_uint j = 0; j < m; ++j)
+      for(t_uint i = 0; i < m; ++i)
+        current.S.block(i * n_, j * n_, n_, n_) = block(current.objects[i], current.objects[j]);
+    current.lu.compute(current.S);
+  }
+}
+
+Vector<t_complex> NearFieldPreconditioner::solve(Vector<t_complex> const &x) const {
+  return solve(Matrix<t_complex>(x)).col(0);
+}
+
+Matrix<t_complex> NearFieldPreconditioner::solve(Matrix<t_complex> const &X) const {
+  Matrix<t_complex> result = X;
+  for(auto const &current : clusters_) {
+    Matrix<t_complex> input(current.S.rows(), X.cols());
+    for(t_uint i = 0; i < current.objects.size(); ++i)
+      input.middleRows(i * n_, n_) = X.middleRows(current.objects[i] * n_, n_);
+    Matrix<t_complex> const output = current.lu.solve(input);
+    for(t_uint i = 0; i < current.objects.size(); ++i)
+      result.middleRows(current.objects[i] * n_, n_) = output.middleRows(i * n_, n_);
+  }
+  return result;
+}
+
+Vector<t_complex> NearFieldPreconditioner::operator*(Vector<t_complex> const &x) const {
+  return (*this * Matrix<t_complex>(x)).col(0);
+}
+
+Matrix<t_complex> NearFieldPreconditioner::operator*(Matrix<t_complex> const &X) const {
+  Matrix<t_complex> result = X;
+  for(auto const &current : clusters_) {
+    Matrix<t_complex> input(current.S.rows(), X.cols());
+    for(t_uint i = 0; i < current.objects.size(); ++i)
+      input.middleRows(i * n_, n_) = X.middleRows(current.objects[i] * n_, n_);
+    Matrix<t_complex> const output = current.S * input;
+    for(t_uint i = 0; i < current.objects.size(); ++i)
+      result.middleRows(current.objects[i] * n_, n_) = output.middleRows(i * n_, n_);
+  }
+  return result;
+}
+}
@@ -0,0 +1,104 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_NEAR_FIELD_PRECONDITIONER_H
+#define OPTIMET_NEAR_FIELD_PRECONDITIONER_H
+
+#include "Geometry.h"
+#include "HMatrix.h"
+#include "Types.h"
+#include <Eigen/LU>
+#include <functional>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The NearFieldPreconditioner class implements a block-Jacobi preconditioner
+ * of the scattering matrix. The scatterers nearly touching one another are
+ * gathered into small clusters, whose diagonal blocks of the scattering matrix,
+ * holding the strong couplings between them, are factorised exactly. The other
+ * diagonal blocks are the identity. Every process holds all the clusters, so
+ * that the preconditioner is applied without communication.
+ */
+class NearFieldPreconditioner {
+public:
+  //! Block of the scattering matrix coupling object ii to object jj
+  typedef std::function<Matrix<t_complex>(t_uint ii, t_uint jj)> PairBlock;
+
+  /**
+   * Initialization constructor for the NearFieldPreconditioner class.
+   * @param geometry the geometry of the simulation.
+   * @param n the size of the block of one scatterer, 2 * nMax * (nMax + 2).
+   * @param block function returning the block coupling two scatterers.
+   * @param gap two scatterers are in the same cluster if the gap between their circumscribed
+   * spheres is at most gap times the smaller radius, none are if zero.
+   * @param size the largest number of scatterers in a cluster.
+   */
+  NearFieldPreconditioner(Geometry const &geometry, t_uint n, PairBlock const &block, t_real gap,
+                          t_uint size);
+  virtual ~NearFieldPreconditioner() {}
+
+  //! Applies the inverse of the preconditioner
+  Vector<t_complex> solve(Vector<t_complex> const &x) const;
+  //! Applies the inverse of the preconditioner to the columns of a matrix at once
+  virtual Matrix<t_complex> solve(Matrix<t_complex> const &X) const;
+  //! Applies the preconditioner, i.e. the diagonal blocks of the clusters
+  Vector<t_complex> operator*(Vector<t_complex> const &x) const;
+  //! Applies the preconditioner to the columns of a matrix at once
+  virtual Matrix<t_complex> operator*(Matrix<t_complex> const &X) const;
+
+  //! Whether the preconditioner is the identity
+  virtual bool empty() const { return clusters_.empty(); }
+  //! Number of rows of the matrix
+  t_uint rows() const { return n_ * nobj_; }
+
+protected:
+  //! The identity, for the classes holding clusters of their own
+  NearFieldPreconditioner(t_uint n, t_uint nobj) : n_(n), nobj_(nobj) {}
+
+  //! Scatterers of a cluster with their diagonal block of the scattering matrix
+  struct Cluster {
+    std::vector<t_uint> objects;                 /**< The indices of the scatterers. */
+    Matrix<t_complex> S;                         /**< The diagonal block. */
+    Eigen::PartialPivLU<Matrix<t_complex>> lu;   /**< Its factorisation. */
+  };
+
+  //! The size of the block of one scatterer
+  t_uint n_;
+  //! The number of scatterers
+  t_uint nobj_;
+  //! The clusters of more than one scatterer
+  std::vector<Cluster> clusters_;
+};
+
+//! \brief Solves S x = Y with GCRO-DR, right preconditioned with P
+//! \details The Krylov space is that of S P^-1, and the recycled vectors are kept in its unknowns.
+template <class OPERATOR>
+Vector<t_complex> Gcrodr_Zcomp(OPERATOR const &S, NearFieldPreconditioner const &P,
+                               Vector<t_complex> const &Y, double tol, int maxit, int no_rest,
+                               KrylovRecycler &recycler,
+                               Vector<t_complex> const &x0 = Vector<t_complex>()) {
+  if(P.empty())
+    return Gcrodr_Zcomp(S, Y, tol, maxit, no_rest, recycler, x0);
+  Vector<t_complex> const y0 =
+      x0.size() == static_cast<Eigen::Index>(S.rows()) ? Vector<t_complex>(P * x0) : x0;
+  return P.solve(GcroDr(
+      [&S, &P](Vector<t_complex> const &y) -> Vector<t_complex> { return S * P.solve(y); },
+      S.rows(), Y, tol, maxit, no_rest, recycler, y0));
+}
+}
+#endif
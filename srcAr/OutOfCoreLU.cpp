@@ -0,0 +1,119 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#include "OutOfCoreLU.h"
+#include "Profile.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace optimet {
+namespace {
+//! \brief Applies the interchanges and the elimination of a factorized panel to the rows of X
+//! \details The panel holds the columns from first, its unit lower triangle from row first.
+void eliminate(Matrix<t_complex> const &factors, t_uint first, std::vector<t_uint> const &pivots,
+               Matrix<t_complex> &X) {
+  auto const w = factors.cols(), N = factors.rows();
+  for(t_uint i = first; i < first + w; ++i)
+    if(pivots[i] != i)
+      X.row(i).swap(X.row(pivots[i]));
+  auto const diagonal = factors.block(first, 0, w, w);
+  X.middleRows(first, w) = diagonal.triangularView<Eigen::UnitLower>().solve(X.middleRows(first, w));
+  X.bottomRows(N - first - w).noalias() -= factors.bottomRows(N - first - w) * X.middleRows(first, w);
+}
+} // namespace
+
+OutOfCoreLU::OutOfCoreLU(std::string const &path, t_uint N, t_uint width, Panel const &panel)
+    : path_(path), N_(N), width_(std::max<t_uint>(1, std::min(width, N))), pivots_(N) {
+  Profile::Region const timer("out-of-core factorization");
+  // the file is sized once, the panels written in turn at their offsets
+  std::ofstream(path_, std::ios::binary | std::ios::trunc);
+  Matrix<t_complex> current, left;
+  for(t_uint k = 0; k < panels(); ++k) {
+    auto const c0 = first(k), w = columns(k);
+    current = panel(c0, w);
+    if(current.rows() != static_cast<Eigen::Index>(N_) or
+       current.cols() != static_cast<Eigen::Index>(w))
+      throw std::runtime_error("A panel of the out-of-core matrix has the wrong size");
+
+    // left-looking: the updates of all the panels on the left, in the order of their steps
+    for(t_uint j = 0; j < k; ++j) {
+      read(j, left);
+      eliminate(left, first(j), pivots_, current);
+    }
+
+    // factorization of the panel with partial pivoting, over its rows from its first column
+    for(t_uint c = 0; c < w; ++c) {
+      auto const row = c0 + c;
+      Vector<t_complex>::Index p;
+      current.col(c).tail(N_ - row).cwiseAbs().maxCoeff(&p);
+      pivots_[row] = row + p;
+      if(pivots_[row] != row)
+        current.row(row).swap(current.row(pivots_[row]));
+      auto const pivot = current(row, c);
+      if(pivot == t_complex(0))
+        throw std::runtime_error("Singular matrix in the out-of-core factorization");
+      auto const below = N_ - row - 1;
+      current.col(c).tail(below) /= pivot;
+      current.block(row + 1, c + 1, below, w - c - 1).noalias() -=
+          current.col(c).tail(below) * current.row(row).segment(c + 1, w - c - 1);
+    }
+    write(k, current);
+  }
+}
+
+OutOfCoreLU::~OutOfCoreLU() { std::remove(path_.c_str()); }
+
+t_uint OutOfCoreLU::columns(t_uint k) const { return std::min(width_, N_ - first(k)); }
+
+void OutOfCoreLU::read(t_uint k, Matrix<t_complex> &panel) const {
+  panel.resize(N_, columns(k));
+  std::ifstream file(path_, std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(first(k)) * N_ * sizeof(t_complex));
+  file.read(reinterpret_cast<char *>(panel.data()), panel.size() * sizeof(t_complex));
+  if(not file)
+    throw std::runtime_error("Could not read the out-of-core factors from " + path_);
+}
+
+void OutOfCoreLU::write(t_uint k, Matrix<t_complex> const &panel) const {
+  std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(static_cast<std::streamoff>(first(k)) * N_ * sizeof(t_complex));
+  file.write(reinterpret_cast<char const *>(panel.data()), panel.size() * sizeof(t_complex));
+  if(not file)
+    throw std::runtime_error("Could not write the out-of-core factors to " + path_);
+}
+
+Matrix<t_complex> OutOfCoreLU::solve(Matrix<t_complex> const &B) const {
+  if(static_cast<t_uint>(B.rows()) != N_)
+    throw std::runtime_error("The right hand sides do not match the out-of-core matrix");
+  Profile::Region const timer("out-of-core solve");
+  Matrix<t_complex> X = B, factors;
+  // forward, replaying the steps of the factorization
+  for(t_uint k = 0; k < panels(); ++k) {
+    read(k, factors);
+    eliminate(factors, first(k), pivots_, X);
+  }
+  // backward, with the upper triangle of each panel and the rows above it
+  for(t_uint k = panels(); k-- > 0;) {
+    read(k, factors);
+    auto const c0 = first(k), w = columns(k);
+    X.middleRows(c0, w) =
+        factors.block(c0, 0, w, w).triangularView<Eigen::Upper>().solve(X.middleRows(c0, w));
+    X.topRows(c0).noalias() -= factors.topRows(c0) * X.middleRows(c0, w);
+  }
+  return X;
+}
+} // namespace optimet
@@ -0,0 +1,77 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_OUT_OF_CORE_LU_H
+#define OPTIMET_OUT_OF_CORE_LU_H
+
+#include "Types.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The OutOfCoreLU class factorizes a dense matrix too large for the memory
+ * with partial pivoting, the factors being kept in a scratch file. The matrix
+ * is split into panels of consecutive columns, each assembled when its turn
+ * comes and factorized left-looking: it is updated with the factors of the
+ * panels on its left, read back one at a time, then factorized and written
+ * out. Only two panels are in memory at any time. The factors of each panel
+ * are stored with its rows in the order of its own step, so that the solves
+ * replay the row interchanges and eliminations of the factorization.
+ */
+class OutOfCoreLU {
+public:
+  //! Returns the N rows of the given number of columns from first
+  typedef std::function<Matrix<t_complex>(t_uint first, t_uint cols)> Panel;
+
+  /**
+   * Assembles and factorizes the matrix.
+   * @param path the scratch file, removed with the factors.
+   * @param N the size of the matrix.
+   * @param width the number of columns of a panel.
+   * @param panel the columns of the matrix.
+   */
+  OutOfCoreLU(std::string const &path, t_uint N, t_uint width, Panel const &panel);
+  ~OutOfCoreLU();
+  OutOfCoreLU(OutOfCoreLU const &) = delete;
+  OutOfCoreLU &operator=(OutOfCoreLU const &) = delete;
+
+  //! Solves A X = B for all the columns of B
+  Matrix<t_complex> solve(Matrix<t_complex> const &B) const;
+
+  //! Size of the matrix
+  t_uint rows() const { return N_; }
+  //! Number of columns of a panel
+  t_uint width() const { return width_; }
+
+private:
+  std::string path_;
+  t_uint N_, width_;
+  //! Row exchanged with each row at its step of the elimination
+  std::vector<t_uint> pivots_;
+
+  //! First column and number of columns of panel k
+  t_uint first(t_uint k) const { return k * width_; }
+  t_uint columns(t_uint k) const;
+  //! Number of panels
+  t_uint panels() const { return (N_ + width_ - 1) / width_; }
+  //! Reads or writes panel k
+  void read(t_uint k, Matrix<t_complex> &panel) const;
+  void write(t_uint k, Matrix<t_complex> const &panel) const;
+};
+} // namespace optimet
+#endif
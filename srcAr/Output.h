@@ -17,7 +17,10 @@
 #ifndef OUTPUT_H_
 #define OUTPUT_H_
 
+#include <complex>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <hdf5.h>
 
 /**
@@ -43,6 +46,11 @@ class Output {
 private:
   bool initDone;
 
+  /**
+   * Creates the base groups of a new file.
+   */
+  void createGroups();
+
 public:
   hid_t outputFile; /**< Handle to the HDF5 output file. */
 
@@ -59,12 +67,29 @@ public:
    */
   Output(std::string const &outputFileName_);
 
+#ifdef H5_HAVE_PARALLEL
+  /**
+   * Initialization constructor for a file written collectively with MPI-IO.
+   * @param outputFileName_ the name of the hdf5 output file.
+   * @param comm_ the processes writing to the file.
+   */
+  Output(std::string const &outputFileName_, MPI_Comm comm_);
+#endif
+
   /**
    * Default destructor for the Output class.
    * Closes the HDF5 file if it was opened.
    */
   virtual ~Output();
 
+  /**
+   * The lock of the HDF5 calls of the threads of a process.
+   * The library is not thread-safe unless built so: a thread calling it
+   * while another may, as when output is written in the background, holds
+   * the lock throughout.
+   */
+  static std::mutex &mutex();
+
   /**
    * Initialization method for the Output class.
    * @param outputFileName_ the name of the hdf5 output file.
@@ -72,13 +97,95 @@ public:
    */
   hid_t init(std::string const &outputFileName_);
 
+#ifdef H5_HAVE_PARALLEL
   /**
-   * Returns the handle to the base GroupID.
+   * Initialization method for a file written collectively with MPI-IO.
+   * All the processes of comm_ must call it, and every later call creating
+   * groups or datasets, and close().
+   * @param outputFileName_ the name of the hdf5 output file.
+   * @param comm_ the processes writing to the file.
+   * @return the handle to the HDF5 file.
+   */
+  hid_t init(std::string const &outputFileName_, MPI_Comm comm_);
+#endif
+
+  /**
+   * Returns the handle to the base GroupID, created if the file lacks it.
    * @param code_ the GroupID code (see class documentation).
    * @return the handle to the the base GroupID.
    */
   hid_t getHandle(std::string code_);
 
+  /**
+   * Opens an existing HDF5 file for reading and writing, or creates an empty
+   * one. Unlike init(), the file is not truncated and no base groups are made.
+   * @param outputFileName_ the name of the hdf5 file.
+   * @return the handle to the HDF5 file.
+   */
+  hid_t open(std::string const &outputFileName_);
+
+  /**
+   * Checks if a group or dataset exists.
+   * @param path_ the path of the object, e.g. "group/subgroup".
+   * @return true if every element of the path exists.
+   */
+  bool exists(std::string const &path_);
+
+  /**
+   * Writes a complex array as the datasets path_/real and path_/imag.
+   * Missing intermediate groups are created.
+   * @param path_ the group holding the two datasets.
+   * @param data_ the array, rows_ * cols_ values.
+   * @param rows_ the slowest varying dimension of the datasets.
+   * @param cols_ the fastest varying dimension of the datasets.
+   */
+  void writeComplex(std::string const &path_, std::complex<double> const *data_, hsize_t rows_,
+                    hsize_t cols_);
+
+  /**
+   * Reads a complex array written by writeComplex.
+   * @param path_ the group holding the two datasets.
+   * @param data_ the array to fill, rows_ * cols_ values.
+   * @return false if path_ does not exist or its datasets have other dimensions.
+   */
+  bool readComplex(std::string const &path_, std::complex<double> *data_, hsize_t rows_,
+                   hsize_t cols_);
+
+  /**
+   * Writes a real array as the dataset path_.
+   * Missing intermediate groups are created.
+   * @param path_ the dataset.
+   * @param data_ the array, size_ values.
+   * @param size_ the dimension of the dataset.
+   */
+  void writeReal(std::string const &path_, double const *data_, hsize_t size_);
+
+  /**
+   * Reads a real array written by writeReal.
+   * @param path_ the dataset.
+   * @param data_ the array to fill, size_ values.
+   * @return false if path_ does not exist or has another dimension.
+   */
+  bool readReal(std::string const &path_, double *data_, hsize_t size_);
+
+  /**
+   * Reads a real dataset of any shape and numeric type.
+   * @param path_ the dataset.
+   * @param data_ the values, the last dimension varying the fastest.
+   * @return false if path_ does not exist.
+   */
+  bool readReal(std::string const &path_, std::vector<double> &data_);
+  /**
+   * Appends rows to the real dataset path_, of unlimited rows.
+   * The dataset is created, chunked, on the first call, and missing
+   * intermediate groups with it.
+   * @param path_ the dataset.
+   * @param data_ the rows, rows_ * cols_ values.
+   * @param rows_ the number of rows added.
+   * @param cols_ the fastest varying dimension of the dataset.
+   */
+  void appendReal(std::string const &path_, double const *data_, hsize_t rows_, hsize_t cols_);
+
   void close();
 };
 
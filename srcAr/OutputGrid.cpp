@@ -19,41 +19,62 @@
 #include "Aliases.h"
 #include "Cartesian.h"
 #include "Tools.h"
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <stdexcept>
 
 namespace optimet {
-OutputGrid::OutputGrid() : initDone(false), gridDone(false), iterator(0), gridPoints(0) {}
+namespace {
+//! Stores the seven values of a point, as written to the datasets
+void set_values(std::array<std::vector<t_real>, 7> &values, std::size_t index,
+                SphericalP<std::complex<double>> const &data) {
+  values[0][index] = data.rrr.real();
+  values[1][index] = data.rrr.imag();
+  values[2][index] = data.the.real();
+  values[3][index] = data.the.imag();
+  values[4][index] = data.phi.real();
+  values[5][index] = data.phi.imag();
+  values[6][index] = std::sqrt(std::norm(data.rrr) + std::norm(data.the) + std::norm(data.phi));
+}
+
+//! Whether the points of the grid are laid out in datasets of parameters[2, 5, 8] points
+bool laid_out(int type) {
+  return type == O3DCartesianRegular or type == O3DPlane or type == O3DLine or
+         type == O3DPointList;
+}
+} // namespace
+
+OutputGrid::OutputGrid()
+    : slabPlanes(1), slabStart(-1), slabCount(0), initDone(false), gridDone(false), iterator(0),
+      gridPoints(0) {}
 
 OutputGrid::~OutputGrid() {
   // Destructor does nothing. Close
 }
 
-OutputGrid::OutputGrid(int type_, std::array<t_real, 9> const &parameters_, hid_t groupID_)
+OutputGrid::OutputGrid(int type_, std::array<t_real, 9> const &parameters_, hid_t groupID_,
+                       GridStorage const &storage_,
+                       std::shared_ptr<std::vector<t_real> const> points_)
     : OutputGrid() {
-  init(type_, parameters_, groupID_);
+  init(type_, parameters_, groupID_, storage_, points_);
 }
 
-OutputGrid::OutputGrid(int type_, std::array<t_real, 9> const &parameters_)
+OutputGrid::OutputGrid(int type_, std::array<t_real, 9> const &parameters_,
+                       std::shared_ptr<std::vector<t_real> const> points_)
     : OutputGrid() {
-  init(type_, parameters_);
+  init(type_, parameters_, points_);
 }
 
-void OutputGrid::init(int type_, std::array<t_real, 9> const &parameters_, hid_t groupID_) {
-  type = type_;
-  gridParameters = parameters_;
+void OutputGrid::init(int type_, std::array<t_real, 9> const &parameters_, hid_t groupID_,
+                      GridStorage const &storage_,
+                      std::shared_ptr<std::vector<t_real> const> points_) {
+  init(type_, parameters_, points_);
   groupID = groupID_;
+  storage = storage_;
 
-  // Cartesian Regular
-  if(type == O3DCartesianRegular) {
-
-    iterator = 0;
-    gridPoints = (int)(gridParameters[2] * gridParameters[5] * gridParameters[8]);
-
-    cursor = {{0, 0, 0}};
-    // Step sizes (X, Y, Z)
-    aux = {{std::abs(gridParameters[1] - gridParameters[0]) / (gridParameters[2] - 1),
-            std::abs(gridParameters[4] - gridParameters[3]) / (gridParameters[5] - 1),
-            std::abs(gridParameters[7] - gridParameters[6]) / (gridParameters[8] - 1)}};
+  // Cartesian Regular and explicit points
+  if(laid_out(type)) {
 
     // Create the HDF5 SubGroups
     vecGroupId[0] = H5Gcreate(groupID, "X", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
@@ -72,21 +93,54 @@ void OutputGrid::init(int type_, std::array<t_real, 9> const &parameters_, hid_t
       vecDSpaceId[i] = H5Screate_simple(3, dims, NULL);
     }
 
+    // Chunks and filters of the datasets
+    hid_t const plist = H5Pcreate(H5P_DATASET_CREATE);
+    if(storage.chunked || storage.deflate > 0 || storage.shuffle || storage.szip) {
+      hsize_t chunk[3];
+      for(int i = 0; i < 3; i++)
+        chunk[i] = storage.chunk[i] > 0 ? std::min<hsize_t>(storage.chunk[i], dims[i]) : dims[i];
+      H5Pset_chunk(plist, 3, chunk);
+      if(storage.shuffle)
+        H5Pset_shuffle(plist);
+      if(storage.deflate > 0) {
+        if(H5Zfilter_avail(H5Z_FILTER_DEFLATE) <= 0)
+          throw std::runtime_error("HDF5 was built without the deflate filter");
+        H5Pset_deflate(plist, storage.deflate);
+      }
+      if(storage.szip) {
+        if(H5Zfilter_avail(H5Z_FILTER_SZIP) <= 0)
+          throw std::runtime_error("HDF5 was built without the szip filter");
+        H5Pset_szip(plist, H5_SZIP_NN_OPTION_MASK, 16);
+      }
+      // Slabs of whole chunks are compressed once
+      if(chunk[0] == dims[0] && chunk[1] == dims[1])
+        slabPlanes = chunk[2];
+    }
+
+    // Type of the values in the file
+    hid_t const value = storage.single ? H5T_NATIVE_FLOAT : H5T_NATIVE_DOUBLE;
+    hid_t const complex = H5Tcreate(H5T_COMPOUND, 2 * H5Tget_size(value));
+    H5Tinsert(complex, "r", 0, value);
+    H5Tinsert(complex, "i", H5Tget_size(value), value);
+
     // Create the associated datasets
-    vecDataId[0] = H5Dcreate(vecGroupId[0], "real", H5T_NATIVE_DOUBLE, vecDSpaceId[0], H5P_DEFAULT,
-                             H5P_DEFAULT, H5P_DEFAULT);
-    vecDataId[1] = H5Dcreate(vecGroupId[0], "imag", H5T_NATIVE_DOUBLE, vecDSpaceId[1], H5P_DEFAULT,
-                             H5P_DEFAULT, H5P_DEFAULT);
-    vecDataId[2] = H5Dcreate(vecGroupId[1], "real", H5T_NATIVE_DOUBLE, vecDSpaceId[2], H5P_DEFAULT,
-                             H5P_DEFAULT, H5P_DEFAULT);
-    vecDataId[3] = H5Dcreate(vecGroupId[1], "imag", H5T_NATIVE_DOUBLE, vecDSpaceId[3], H5P_DEFAULT,
-                             H5P_DEFAULT, H5P_DEFAULT);
-    vecDataId[4] = H5Dcreate(vecGroupId[2], "real", H5T_NATIVE_DOUBLE, vecDSpaceId[4], H5P_DEFAULT,
-                             H5P_DEFAULT, H5P_DEFAULT);
-    vecDataId[5] = H5Dcreate(vecGroupId[2], "imag", H5T_NATIVE_DOUBLE, vecDSpaceId[5], H5P_DEFAULT,
-                             H5P_DEFAULT, H5P_DEFAULT);
-    vecDataId[6] = H5Dcreate(vecGroupId[3], "abs", H5T_NATIVE_DOUBLE, vecDSpaceId[6], H5P_DEFAULT,
-                             H5P_DEFAULT, H5P_DEFAULT);
+    for(int i = 0; i < 3; i++) {
+      if(storage.compound) {
+        vecDataId[2 * i] = H5Dcreate(vecGroupId[i], "complex", complex, vecDSpaceId[2 * i],
+                                     H5P_DEFAULT, plist, H5P_DEFAULT);
+        vecDataId[2 * i + 1] = -1;
+      } else {
+        vecDataId[2 * i] = H5Dcreate(vecGroupId[i], "real", value, vecDSpaceId[2 * i], H5P_DEFAULT,
+                                     plist, H5P_DEFAULT);
+        vecDataId[2 * i + 1] = H5Dcreate(vecGroupId[i], "imag", value, vecDSpaceId[2 * i + 1],
+                                         H5P_DEFAULT, plist, H5P_DEFAULT);
+      }
+    }
+    vecDataId[6] = H5Dcreate(vecGroupId[3], "abs", value, vecDSpaceId[6], H5P_DEFAULT, plist,
+                             H5P_DEFAULT);
+
+    H5Tclose(complex);
+    H5Pclose(plist);
   }
 
   gridDone = false;
@@ -94,13 +148,14 @@ void OutputGrid::init(int type_, std::array<t_real, 9> const &parameters_, hid_t
 }
 
 
-void OutputGrid::init(int type_, std::array<t_real, 9> const &parameters_) {
+void OutputGrid::init(int type_, std::array<t_real, 9> const &parameters_,
+                      std::shared_ptr<std::vector<t_real> const> points_) {
   type = type_;
   gridParameters = parameters_;
-  
+  points = points_;
 
-  // Cartesian Regular
-  if(type == O3DCartesianRegular) {
+  // Cartesian Regular and explicit points
+  if(laid_out(type)) {
 
     iterator = 0;
     gridPoints = (int)(gridParameters[2] * gridParameters[5] * gridParameters[8]);
@@ -110,6 +165,9 @@ void OutputGrid::init(int type_, std::array<t_real, 9> const &parameters_) {
     aux = {{std::abs(gridParameters[1] - gridParameters[0]) / (gridParameters[2] - 1),
             std::abs(gridParameters[4] - gridParameters[3]) / (gridParameters[5] - 1),
             std::abs(gridParameters[7] - gridParameters[6]) / (gridParameters[8] - 1)}};
+    if(type != O3DCartesianRegular and
+       (not points or points->size() != 3 * static_cast<std::size_t>(gridPoints)))
+      throw std::runtime_error("The grid should have the coordinates of each of its points");
 }
 gridDone = false;
   initDone = true;
@@ -137,89 +195,232 @@ Spherical<double> OutputGrid::getPoint() {
     gridDone = true;
   }
 
-  if(type == O3DCartesianRegular) // Regular Cartesian grid
+  if(laid_out(type)) // Regular Cartesian grid or explicit points
   {
     // Get the cursor coordinates from the iterator.
     cursor[0] = iterator % ((int)gridParameters[2]);
     cursor[1] = (iterator / ((int)gridParameters[2])) % ((int)gridParameters[5]);
     cursor[2] = iterator / (((int)gridParameters[2]) * ((int)gridParameters[5]));
+  }
 
-    double local_x = gridParameters[0] + cursor[0] * aux[0] + 1e-12; // Correct for 0
-    double local_y = gridParameters[3] + cursor[1] * aux[1] + 1e-12; // Correct for 0
-    double local_z = gridParameters[6] + cursor[2] * aux[2] + 1e-12; // Correct for 0
+  return getPoint(iterator);
+}
+
+Spherical<double> OutputGrid::getPoint(t_int index_) const {
+  if(type == O3DCartesianRegular) // Regular Cartesian grid
+  {
+    // Get the coordinates along each axis from the index.
+    t_int const x = index_ % ((int)gridParameters[2]);
+    t_int const y = (index_ / ((int)gridParameters[2])) % ((int)gridParameters[5]);
+    t_int const z = index_ / (((int)gridParameters[2]) * ((int)gridParameters[5]));
+
+    double local_x = gridParameters[0] + x * aux[0] + 1e-12; // Correct for 0
+    double local_y = gridParameters[3] + y * aux[1] + 1e-12; // Correct for 0
+    double local_z = gridParameters[6] + z * aux[2] + 1e-12; // Correct for 0
     // diagonal plane just for zincblende lattice: local_z=local_y
     // Create a spherical vector from Cartesian and return it with the local
     // coordinates
     return Tools::toSpherical(Cartesian<double>(local_x, local_y, local_z));
   }
+  if(laid_out(type)) {
+    auto const xyz = points->data() + 3 * index_;
+    return Tools::toSpherical(Cartesian<double>(xyz[0] + 1e-12, xyz[1] + 1e-12, xyz[2] + 1e-12));
+  }
 
   // Default return is 0
   return Spherical<double>(0.0, 0.0, 0.0);
 }
 
-void OutputGrid::pushData(SphericalP<std::complex<double>> data_) {
-  if(type == O3DCartesianRegular) // Cartesian Regular grid
-  {
-    hsize_t dim2[] = {1}; // Dimension size of the auxiliary dataset (in memory)
-    hsize_t coord[1][3];  // Array to store selected points from the file dataspace
-
-    // Create dataspace for the auxiliary dataset.
-    hid_t mid2 = H5Screate_simple(1, dim2, NULL);
+void OutputGrid::bounds(Cartesian<double> &low, Cartesian<double> &high) const {
+  // with the offset of getPoint
+  if(type == O3DCartesianRegular) {
+    low.init(std::min(gridParameters[0], gridParameters[1]) + 1e-12,
+             std::min(gridParameters[3], gridParameters[4]) + 1e-12,
+             std::min(gridParameters[6], gridParameters[7]) + 1e-12);
+    high.init(std::max(gridParameters[0], gridParameters[1]) + 1e-12,
+              std::max(gridParameters[3], gridParameters[4]) + 1e-12,
+              std::max(gridParameters[6], gridParameters[7]) + 1e-12);
+    return;
+  }
+  std::array<t_real, 3> lo{{0, 0, 0}}, hi{{0, 0, 0}};
+  if(laid_out(type) and gridPoints > 0) {
+    for(int c = 0; c < 3; ++c)
+      lo[c] = hi[c] = (*points)[c];
+    for(int i = 0; i < gridPoints; ++i)
+      for(int c = 0; c < 3; ++c) {
+        lo[c] = std::min(lo[c], (*points)[3 * i + c]);
+        hi[c] = std::max(hi[c], (*points)[3 * i + c]);
+      }
+  }
+  low.init(lo[0] + 1e-12, lo[1] + 1e-12, lo[2] + 1e-12);
+  high.init(hi[0] + 1e-12, hi[1] + 1e-12, hi[2] + 1e-12);
+}
 
-    // Set cursor position
-    coord[0][0] = cursor[0];
-    coord[0][1] = cursor[1];
-    coord[0][2] = cursor[2];
+void OutputGrid::getPoints(t_int first_, t_int last_, std::vector<double> &Rr,
+                           std::vector<double> &Rthe, std::vector<double> &Rphi) const {
+  Rr.resize(last_ - first_);
+  Rthe.resize(last_ - first_);
+  Rphi.resize(last_ - first_);
+  for(t_int i = first_; i < last_; i++) {
+    auto const point = getPoint(i);
+    Rr[i - first_] = point.rrr;
+    Rthe[i - first_] = point.the;
+    Rphi[i - first_] = point.phi;
+  }
+}
 
-    // Select sequence of points in the file dataspace(fid).
-    // Write new selection of points to the dataset(dataset).
-    // Repeat for all six components.
-    double real, imag, data_abs;
-    real = data_.rrr.real();
+void OutputGrid::pushData(SphericalP<std::complex<double>> data_) {
+  if(laid_out(type)) // Cartesian Regular grid or explicit points
+  {
+    t_int const ny = gridParameters[5];
+    t_int const nz = gridParameters[8];
+
+    // Move the buffer to the slab of the cursor
+    if(slabStart < 0 || cursor[2] < slabStart || cursor[2] - slabStart >= slabPlanes) {
+      flush();
+      slabStart = cursor[2] - cursor[2] % slabPlanes;
+      auto const size =
+          static_cast<t_int>(gridParameters[2]) * ny * std::min(slabPlanes, nz - slabStart);
+      for(auto &values : slab)
+        values.assign(size, 0e0);
+    }
 
-     data_abs = std::sqrt( std::pow((std::abs(data_.rrr)), 2) + std::pow((std::abs(data_.the)), 2) + std::pow((std::abs(data_.phi)), 2) );
+    // Position of the cursor in the slab, in the order of the HDF5 dataset
+    auto const planes = std::min(slabPlanes, nz - slabStart);
+    auto const index = (cursor[0] * ny + cursor[1]) * planes + cursor[2] - slabStart;
+    set_values(slab, index, data_);
 
-    H5Sselect_elements(vecDSpaceId[0], H5S_SELECT_SET, 1, (const hsize_t *)coord);
-    H5Dwrite(vecDataId[0], H5T_NATIVE_DOUBLE, mid2, vecDSpaceId[0], H5P_DEFAULT, &real);
+    if(++slabCount == static_cast<t_int>(slab[0].size()))
+      flush();
+  }
+}
 
-    imag = data_.rrr.imag();
-    H5Sselect_elements(vecDSpaceId[1], H5S_SELECT_SET, 1, (const hsize_t *)coord);
-    H5Dwrite(vecDataId[1], H5T_NATIVE_DOUBLE, mid2, vecDSpaceId[1], H5P_DEFAULT, &imag);
+void OutputGrid::pushDataNext(SphericalP<std::complex<double>> data_) {
+  pushData(data_);
+  gotoNext();
+}
 
-    real = data_.the.real();
-    H5Sselect_elements(vecDSpaceId[2], H5S_SELECT_SET, 1, (const hsize_t *)coord);
-    H5Dwrite(vecDataId[2], H5T_NATIVE_DOUBLE, mid2, vecDSpaceId[2], H5P_DEFAULT, &real);
+void OutputGrid::setSlabPlanes(t_int planes_) {
+  flush();
+  slabPlanes = planes_ > 0 ? planes_ : std::numeric_limits<t_int>::max();
+}
 
-    imag = data_.the.imag();
-    H5Sselect_elements(vecDSpaceId[3], H5S_SELECT_SET, 1, (const hsize_t *)coord);
-    H5Dwrite(vecDataId[3], H5T_NATIVE_DOUBLE, mid2, vecDSpaceId[3], H5P_DEFAULT, &imag);
+void OutputGrid::flush() {
+  if(slabStart < 0)
+    return;
 
-    real = data_.phi.real();
-    H5Sselect_elements(vecDSpaceId[4], H5S_SELECT_SET, 1, (const hsize_t *)coord);
-    H5Dwrite(vecDataId[4], H5T_NATIVE_DOUBLE, mid2, vecDSpaceId[4], H5P_DEFAULT, &real);
+  // Select the slab in the file dataspaces and write each dataset at once
+  t_int const nz = gridParameters[8];
+  hsize_t const start[] = {0, 0, static_cast<hsize_t>(slabStart)};
+  hsize_t const count[] = {static_cast<hsize_t>(gridParameters[2]),
+                           static_cast<hsize_t>(gridParameters[5]),
+                           static_cast<hsize_t>(std::min(slabPlanes, nz - slabStart))};
+  write(start, count, slab, H5P_DEFAULT);
 
-    imag = data_.phi.imag();
-    H5Sselect_elements(vecDSpaceId[5], H5S_SELECT_SET, 1, (const hsize_t *)coord);
-    H5Dwrite(vecDataId[5], H5T_NATIVE_DOUBLE, mid2, vecDSpaceId[5], H5P_DEFAULT, &imag);
-    
-    H5Sselect_elements(vecDSpaceId[6], H5S_SELECT_SET, 1, (const hsize_t *)coord);
-    H5Dwrite(vecDataId[6], H5T_NATIVE_DOUBLE, mid2, vecDSpaceId[6], H5P_DEFAULT, &data_abs);
+  slabStart = -1;
+  slabCount = 0;
+}
 
-    // Close the auxiliary dataspace
-    H5Sclose(mid2);
+void OutputGrid::writeRange(t_int first_,
+                            std::vector<SphericalP<std::complex<double>>> const &data_) {
+  if(not laid_out(type))
+    return;
+
+  // Collective transfers on files opened with MPI-IO
+  hid_t const transfer = H5Pcreate(H5P_DATASET_XFER);
+#ifdef H5_HAVE_PARALLEL
+  hid_t const file = H5Iget_file_id(groupID);
+  hid_t const access = H5Fget_access_plist(file);
+  if(H5Pget_driver(access) == H5FD_MPIO)
+    H5Pset_dxpl_mpio(transfer, H5FD_MPIO_COLLECTIVE);
+  H5Pclose(access);
+  H5Fclose(file);
+#endif
+
+  // The range is cut into at most five blocks of the datasets: the end of the first row, the
+  // rows to the end of the first plane, the whole planes, the rows and the start of the last row.
+  // Every process writes five blocks, empty if need be, to match the collective calls.
+  t_int const nx = gridParameters[2];
+  t_int const ny = gridParameters[5];
+  t_int const last = first_ + static_cast<t_int>(data_.size());
+  t_int position = first_;
+  std::array<std::vector<t_real>, 7> values;
+  for(int block = 0; block < 5; block++) {
+    t_int const x = position % nx, y = (position / nx) % ny, z = position / (nx * ny);
+    t_int const left = last - position;
+    std::array<t_int, 3> size{{0, 0, 0}};
+    if(left <= 0)
+      size = {{0, 0, 0}};
+    else if(x > 0 || left < nx)
+      size = {{std::min(nx - x, left), 1, 1}};
+    else if(y > 0 || left < nx * ny)
+      size = {{nx, std::min(ny - y, left / nx), 1}};
+    else
+      size = {{nx, ny, left / (nx * ny)}};
+
+    // Values in the order of the block in the dataset
+    for(auto &component : values)
+      component.resize(size[0] * size[1] * size[2]);
+    std::size_t index = 0;
+    for(t_int i = 0; i < size[0]; i++)
+      for(t_int j = 0; j < size[1]; j++)
+        for(t_int k = 0; k < size[2]; k++)
+          set_values(values, index++, data_[x + i + nx * (y + j + ny * (z + k)) - first_]);
+
+    hsize_t const start[] = {static_cast<hsize_t>(x), static_cast<hsize_t>(y),
+                             static_cast<hsize_t>(z)};
+    hsize_t const count[] = {static_cast<hsize_t>(size[0]), static_cast<hsize_t>(size[1]),
+                             static_cast<hsize_t>(size[2])};
+    write(start, count, values, transfer);
+    position += size[0] * size[1] * size[2];
   }
+  H5Pclose(transfer);
 }
 
-void OutputGrid::pushDataNext(SphericalP<std::complex<double>> data_) {
-  pushData(data_);
-  gotoNext();
+void OutputGrid::write(hsize_t const *start, hsize_t const *count,
+                       std::array<std::vector<t_real>, 7> const &values, hid_t transfer) {
+  // An empty block selects no point, for the collective calls
+  bool const empty = count[0] * count[1] * count[2] == 0;
+  hsize_t const one[] = {1, 1, 1};
+  hid_t const mid = H5Screate_simple(3, empty ? one : count, NULL);
+  if(empty)
+    H5Sselect_none(mid);
+  // HDF5 expects a buffer even when nothing is written
+  t_complex dummy[1];
+  for(int i = 0; i < 7; i++) {
+    if(vecDataId[i] < 0)
+      continue;
+    if(empty)
+      H5Sselect_none(vecDSpaceId[i]);
+    else
+      H5Sselect_hyperslab(vecDSpaceId[i], H5S_SELECT_SET, start, NULL, count, NULL);
+    if(storage.compound && i < 6) {
+      // Interleave the real and imaginary parts of the component
+      std::vector<t_complex> complexValues(values[i].size());
+      for(std::size_t j = 0; j < complexValues.size(); j++)
+        complexValues[j] = t_complex(values[i][j], values[i + 1][j]);
+      hid_t const complex = H5Tcreate(H5T_COMPOUND, sizeof(t_complex));
+      H5Tinsert(complex, "r", 0, H5T_NATIVE_DOUBLE);
+      H5Tinsert(complex, "i", sizeof(t_real), H5T_NATIVE_DOUBLE);
+      H5Dwrite(vecDataId[i], complex, mid, vecDSpaceId[i], transfer,
+               empty ? dummy : complexValues.data());
+      H5Tclose(complex);
+    } else
+      H5Dwrite(vecDataId[i], H5T_NATIVE_DOUBLE, mid, vecDSpaceId[i], transfer,
+               empty ? static_cast<void const *>(dummy) : values[i].data());
+  }
+  H5Sclose(mid);
 }
 
 void OutputGrid::close() {
   if(initDone) {
+    // Write the last slab
+    flush();
+
     // Close datasets
     for(int i = 0; i < 7; i++)
-      H5Dclose(vecDataId[i]);
+      if(vecDataId[i] >= 0)
+        H5Dclose(vecDataId[i]);
 
     // Close dataspaces
     for(int i = 0; i < 7; i++)
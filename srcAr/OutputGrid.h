@@ -23,8 +23,32 @@
 #include <array>
 #include <complex>
 #include <hdf5.h>
+#include <memory>
+#include <vector>
 
 namespace optimet {
+/**
+ * Layout of the HDF5 datasets of an OutputGrid.
+ * By default the datasets are contiguous, in double precision, with separate
+ * real and imag datasets for each component.
+ */
+struct GridStorage {
+  //! Whether the datasets are chunked, implied by any filter
+  bool chunked = false;
+  //! Chunk sizes along X, Y and Z, the whole axis if zero
+  std::array<t_uint, 3> chunk = {{0, 0, 1}};
+  //! Deflate (gzip) level, no deflate if zero
+  t_uint deflate = 0;
+  //! Whether the bytes are shuffled before compression
+  bool shuffle = false;
+  //! Whether the datasets are compressed with szip
+  bool szip = false;
+  //! Whether the values are stored in single precision
+  bool single = false;
+  //! Whether each component is one compound dataset, with real and imaginary members r and i
+  bool compound = false;
+};
+
 /**
  * The OutputGrid class implements the field output grid and processes the HDF5
  * datasets.
@@ -45,7 +69,20 @@ namespace optimet {
  *          parameters[7] - the end value for the Z axis.
  *          parameters[8] - the number of points on the Z axis.
  *
+ * 2. O3DPlane (912), O3DLine (913) and O3DPointList (914)
+ *    Explicit points, given as their x, y and z Cartesian coordinates. The
+ *    datasets have the shape parameters[2] x parameters[5] x parameters[8],
+ *    e.g. nu x nv x 1 for a plane spanned by two edges of nu and nv points,
+ *    n x 1 x 1 for a line or a list of n points, the first index varying the
+ *    fastest through the points.
+ *
  * At the moment, output will be E fields for all values.
+ *
+ * The data pushed to the grid is buffered in slabs of constant Z, and each
+ * slab is written with one hyperslab write per dataset once it is full.
+ * The layout of the datasets is set by a GridStorage. With compound storage
+ * the X, Y and Z groups hold a single "complex" dataset rather than "real" and
+ * "imag".
  */
 class OutputGrid {
 private:
@@ -58,6 +95,24 @@ private:
   std::array<t_real, 3> aux;
   //! Cursor in the current grid mapped to the HDF5 dataset
   std::array<t_int, 3> cursor;
+  //! The buffered values of each of the seven datasets, indexed as the slab in the dataset
+  std::array<std::vector<t_real>, 7> slab;
+  t_int slabPlanes; /**< The number of Z planes in a slab. */
+  t_int slabStart;  /**< The first Z plane of the buffered slab, negative if none. */
+  t_int slabCount;  /**< The number of points pushed to the buffered slab. */
+  GridStorage storage; /**< The layout of the datasets. */
+  //! The x, y and z of each point of the explicit grids, none for a regular grid
+  std::shared_ptr<std::vector<t_real> const> points;
+
+  /**
+   * Writes a block of the grid to each dataset.
+   * @param start the first point of the block along X, Y and Z.
+   * @param count the size of the block along X, Y and Z, possibly empty.
+   * @param values the values of each dataset, in the order of the block.
+   * @param transfer the HDF5 transfer property list.
+   */
+  void write(hsize_t const *start, hsize_t const *count,
+             std::array<std::vector<t_real>, 7> const &values, hid_t transfer);
   bool initDone;        /**< Specifies the initialization state of the object. */
 public:
   bool gridDone;  /**< Specifies if the grid has been fully parsed. */
@@ -85,20 +140,30 @@ public:
    * @param parameters_ the parameters (depending on the grid type). See class
    * docs.
    * @param groupID_ the HDF5 data space.
+   * @param storage_ the layout of the HDF5 datasets.
+   * @param points_ the coordinates of the points of an explicit grid.
    */
-  OutputGrid(int type_, std::array<t_real, 9> const & parameters_, hid_t groupID_);
+  OutputGrid(int type_, std::array<t_real, 9> const & parameters_, hid_t groupID_,
+             GridStorage const &storage_ = GridStorage(),
+             std::shared_ptr<std::vector<t_real> const> points_ = nullptr);
 
-  OutputGrid(int type_, std::array<t_real, 9> const & parameters_);
+  OutputGrid(int type_, std::array<t_real, 9> const & parameters_,
+             std::shared_ptr<std::vector<t_real> const> points_ = nullptr);
   /**
    * Initialization method for the OutputGrid class.
    * @param type_ the grid type as defined in "Aliases.h".
    * @param parameters_ the parameters (depending on the grid type). See class
    * docs.
    * @param groupID_ the HDF5 data space.
+   * @param storage_ the layout of the HDF5 datasets.
+   * @param points_ the coordinates of the points of an explicit grid.
    */
-  void init(int type_, std::array<t_real, 9> const & parameters_, hid_t groupID_);
+  void init(int type_, std::array<t_real, 9> const & parameters_, hid_t groupID_,
+            GridStorage const &storage_ = GridStorage(),
+            std::shared_ptr<std::vector<t_real> const> points_ = nullptr);
 
-   void init(int type_, std::array<t_real, 9> const & parameters_);
+   void init(int type_, std::array<t_real, 9> const & parameters_,
+             std::shared_ptr<std::vector<t_real> const> points_ = nullptr);
 
   /**
    * Sets the iterator to the first point.
@@ -117,6 +182,32 @@ public:
    */
   Spherical<double> getPoint();
 
+  /**
+   * Returns any point of the grid, without moving the iterator.
+   * @param index_ the position of the point, as the iterator.
+   * @return the grid point in Spherical<double> format.
+   */
+  Spherical<double> getPoint(t_int index_) const;
+
+  /**
+   * Returns the box holding all the points of the grid.
+   * @param low the smallest x, y and z of the points.
+   * @param high the largest x, y and z of the points.
+   */
+  void bounds(Cartesian<double> &low, Cartesian<double> &high) const;
+
+  /**
+   * Returns the consecutive points first_ to last_ - 1 of the grid, without
+   * moving the iterator.
+   * @param first_ the position of the first point, as the iterator.
+   * @param last_ the position after the last point.
+   * @param Rr the radial coordinates of the points.
+   * @param Rthe the polar coordinates of the points.
+   * @param Rphi the azimuthal coordinates of the points.
+   */
+  void getPoints(t_int first_, t_int last_, std::vector<double> &Rr, std::vector<double> &Rthe,
+                 std::vector<double> &Rphi) const;
+
   /**
    * Push data to current iterator position in HDF5 file.
    * @param data_ the data in SphericalP<complex <double> > format.
@@ -130,8 +221,32 @@ public:
    */
   void pushDataNext(SphericalP<std::complex<double>> data_);
 
+  /**
+   * Sets the number of Z planes buffered before they are written to the HDF5
+   * file. One plane or one chunk by default, the whole grid if planes_ is not
+   * positive.
+   * Writes the data buffered so far.
+   * @param planes_ the number of Z planes in a slab.
+   */
+  void setSlabPlanes(t_int planes_);
+
+  /**
+   * Writes the buffered slab to the HDF5 file.
+   */
+  void flush();
+
+  /**
+   * Writes the data of consecutive points of the grid to the HDF5 file,
+   * without buffering. On a file opened with MPI-IO the write is collective:
+   * each process writes its own range, possibly empty.
+   * @param first_ the position of the first point, as the iterator.
+   * @param data_ the data of each point of the range.
+   */
+  void writeRange(t_int first_, std::vector<SphericalP<std::complex<double>>> const &data_);
+
   /**
    * Close the grid to close all HDF5 structures.
+   * Writes the buffered slab first.
    */
   void close();
 };
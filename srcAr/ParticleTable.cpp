@@ -0,0 +1,78 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#include "ParticleTable.h"
+#include "Output.h"
+
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace optimet {
+namespace {
+//! The tables in use, by file
+std::map<std::string, std::weak_ptr<ParticleTable const>> &tables() {
+  static std::map<std::string, std::weak_ptr<ParticleTable const>> tables;
+  return tables;
+}
+}
+
+ParticleTable::ParticleTable(std::vector<t_real> positions, std::vector<int> types,
+                             std::vector<t_real> radii, std::vector<t_real> orientations)
+    : positions_(std::move(positions)), types_(std::move(types)), radii_(std::move(radii)),
+      orientations_(std::move(orientations)) {
+  if(positions_.empty() or positions_.size() % 3 != 0)
+    throw std::runtime_error("A particle table needs the x, y and z of each particle");
+  if((not types_.empty() and types_.size() != size()) or
+     (not radii_.empty() and radii_.size() != size()) or
+     (not orientations_.empty() and orientations_.size() != 3 * size()))
+    throw std::runtime_error("The datasets of a particle table do not have as many particles");
+}
+
+std::shared_ptr<ParticleTable const> ParticleTable::load(std::string const &filename) {
+  auto result = tables()[filename].lock();
+  if(result)
+    return result;
+  if(not std::ifstream(filename).good())
+    throw std::runtime_error("Cannot open the particle table " + filename);
+  Output file;
+  if(file.open(filename) < 0)
+    throw std::runtime_error("Cannot open the particle table " + filename);
+  std::vector<t_real> positions, types, radii, orientations;
+  file.readReal("positions", positions);
+  file.readReal("type", types);
+  file.readReal("radius", radii);
+  file.readReal("orientation", orientations);
+  file.close();
+  std::vector<int> kinds;
+  for(auto const type : types) {
+    if(type != std::floor(type))
+      throw std::runtime_error("The types of the particle table " + filename +
+                               " should be integers");
+    kinds.push_back(type);
+  }
+  result = std::make_shared<ParticleTable const>(std::move(positions), std::move(kinds),
+                                                 std::move(radii), std::move(orientations));
+  tables()[filename] = result;
+  return result;
+}
+
+void ParticleTable::share(std::string const &filename,
+                          std::shared_ptr<ParticleTable const> const &table) {
+  tables()[filename] = table;
+}
+}
@@ -0,0 +1,88 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_PARTICLE_TABLE_H
+#define OPTIMET_PARTICLE_TABLE_H
+
+#include "Types.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The ParticleTable class holds the particles of a large assembly, read in
+ * bulk from an HDF5 file rather than from an object node each, read-only.
+ * Each particle is a copy of one of the object nodes of its structure, its
+ * type, moved to its position.
+ *
+ * The file holds the dataset positions, the x, y and z of each particle in
+ * nm, and optionally the datasets
+ *    type        - the index of the object node of each particle, 0 if none
+ *    radius      - the radius of each sphere in nm, that of its type if none
+ *    orientation - the z-y-z Euler angles of each particle in degrees,
+ *                  those of its type if none
+ * in the order of the particles, whatever the shape or numeric type of the
+ * datasets. The structures using the same file share a single instance.
+ */
+class ParticleTable {
+public:
+  /**
+   * Initializing constructor for the ParticleTable class.
+   * @param positions the x, y and z of each particle in nm.
+   * @param types the type of each particle, or none.
+   * @param radii the radius of each particle in nm, or none.
+   * @param orientations the Euler angles of each particle in degrees, or none.
+   */
+  ParticleTable(std::vector<t_real> positions, std::vector<int> types, std::vector<t_real> radii,
+                std::vector<t_real> orientations);
+
+  /**
+   * Returns the particles of a file.
+   * @param filename the HDF5 file of the particles.
+   * @return the instance shared with the other users of the file.
+   */
+  static std::shared_ptr<ParticleTable const> load(std::string const &filename);
+
+  /**
+   * Makes a table the one load() returns for the given file while it is in
+   * use, e.g. once received from the process which read it.
+   * @param filename the HDF5 file of the particles.
+   * @param table the particles.
+   */
+  static void share(std::string const &filename, std::shared_ptr<ParticleTable const> const &table);
+
+  //! Number of particles
+  t_uint size() const { return positions_.size() / 3; }
+  //! x, y and z of each particle in nm
+  std::vector<t_real> const &positions() const { return positions_; }
+  //! Type of each particle, none if all are of the first type
+  std::vector<int> const &types() const { return types_; }
+  //! Radius of each particle in nm, none if those of their types
+  std::vector<t_real> const &radii() const { return radii_; }
+  //! z-y-z Euler angles of each particle in degrees, none if those of their types
+  std::vector<t_real> const &orientations() const { return orientations_; }
+
+private:
+  std::vector<t_real> positions_;
+  std::vector<int> types_;
+  std::vector<t_real> radii_;
+  std::vector<t_real> orientations_;
+};
+}
+
+#endif
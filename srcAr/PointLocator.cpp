@@ -0,0 +1,274 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "PointLocator.h"
+
+#include "Tools.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace optimet {
+namespace {
+//! Faces in a leaf of the hierarchies
+t_uint const leaf_faces = 4;
+
+//! \brief Twice the signed area of the triangle a, b, p in the xy plane
+//! \details Positive when p is on the left of a to b. The endpoints are taken in a fixed order, so
+//! that the faces sharing an edge get exactly opposite values and agree on which side p is.
+t_real edge(t_real const *a, t_real const *b, t_real x, t_real y) {
+  if(a[0] > b[0] or (a[0] == b[0] and a[1] > b[1]))
+    return -((a[0] - b[0]) * (y - b[1]) - (a[1] - b[1]) * (x - b[0]));
+  return (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+}
+
+//! \brief Whether the face whose edge goes from a to b owns the points on that edge
+//! \details Of two faces sharing the edge in opposite directions, exactly one owns it, so that a
+//! ray through the edge crosses the surface once.
+bool owns(t_real const *a, t_real const *b) {
+  return b[1] < a[1] or (b[1] == a[1] and b[0] > a[0]);
+}
+
+//! Whether the point is on the inner side of the edge, or on an edge owned by the face
+bool inside(t_real w, t_real const *a, t_real const *b) {
+  return w > 0 or (w == 0 and owns(a, b));
+}
+}
+
+PointLocator::PointLocator(std::vector<Scatterer> const &objects) {
+  t_uint const N = objects.size();
+  for(auto const &object : objects) {
+    auto const center = Tools::toCartesian(object.vR);
+    cx_.push_back(center.x);
+    cy_.push_back(center.y);
+    cz_.push_back(center.z);
+    sphere_.push_back(object.kind() == Scatterer::sphere);
+    roots_.push_back(nodes_.size());
+    if(sphere_.back()) {
+      r2_.push_back(object.radius * object.radius);
+      continue;
+    }
+
+    // the vertices and centroids are relative to the center of the scatterer
+    t_real r2 = 0;
+    for(int v = 0; v < object.getNOvertices(); ++v) {
+      double const *p = object.getCoord(v);
+      r2 = std::max(r2, p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    }
+    r2_.push_back(r2);
+    // the faces seen edge-on from +z are never crossed, the others turn counterclockwise
+    std::vector<t_real> faces;
+    int const Nt = object.getTopolsize() / 3;
+    for(int ele1 = 0; ele1 < Nt; ++ele1) {
+      int const *vertices = object.getNOvertex(ele1);
+      double const *a = object.getCoord(vertices[0]);
+      double const *b = object.getCoord(vertices[1]);
+      double const *c = object.getCoord(vertices[2]);
+      t_real const area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+      if(area == 0)
+        continue;
+      if(area < 0)
+        std::swap(b, c);
+      faces.insert(faces.end(), {a[0], a[1], a[2], b[0], b[1], b[2], c[0], c[1], c[2]});
+    }
+    std::vector<t_uint> order(faces.size() / 9);
+    for(t_uint f = 0; f < order.size(); ++f)
+      order[f] = f;
+    subdivide(order, 0, order.size(), faces);
+  }
+
+  // cells about the size of the scatterers, at most 64 along the longest side
+  t_real upper[3] = {0, 0, 0}, mean = 0;
+  origin_[0] = origin_[1] = origin_[2] = 0;
+  for(t_uint j = 0; j < N; ++j) {
+    t_real const r = std::sqrt(r2_[j]);
+    t_real const c[3] = {cx_[j], cy_[j], cz_[j]};
+    for(int a = 0; a < 3; ++a) {
+      origin_[a] = j == 0 ? c[a] - r : std::min(origin_[a], c[a] - r);
+      upper[a] = j == 0 ? c[a] + r : std::max(upper[a], c[a] + r);
+    }
+    mean += 2 * r / N;
+  }
+  t_real const extent =
+      std::max(upper[0] - origin_[0], std::max(upper[1] - origin_[1], upper[2] - origin_[2]));
+  cell_ = std::max(mean, extent / 64);
+  if(not(cell_ > 0))
+    cell_ = 1;
+  for(int a = 0; a < 3; ++a)
+    cells_[a] = std::max<t_int>(1, std::ceil((upper[a] - origin_[a]) / cell_));
+
+  std::vector<std::vector<t_uint>> bins(cells_[0] * cells_[1] * cells_[2]);
+  for(t_uint j = 0; j < N; ++j) {
+    t_real const r = std::sqrt(r2_[j]);
+    t_real const c[3] = {cx_[j], cy_[j], cz_[j]};
+    t_int lo[3], hi[3];
+    for(int a = 0; a < 3; ++a) {
+      lo[a] = std::max<t_int>(0, std::floor((c[a] - r - origin_[a]) / cell_));
+      hi[a] = std::min<t_int>(cells_[a] - 1, std::floor((c[a] + r - origin_[a]) / cell_));
+    }
+    for(t_int i = lo[0]; i <= hi[0]; ++i)
+      for(t_int k = lo[1]; k <= hi[1]; ++k)
+        for(t_int l = lo[2]; l <= hi[2]; ++l)
+          bins[(i * cells_[1] + k) * cells_[2] + l].push_back(j);
+  }
+  first_.push_back(0);
+  for(auto const &bin : bins) {
+    candidates_.insert(candidates_.end(), bin.begin(), bin.end());
+    first_.push_back(candidates_.size());
+  }
+}
+
+t_uint PointLocator::subdivide(std::vector<t_uint> &order, t_uint first, t_uint last,
+                               std::vector<t_real> const &faces) {
+  Node node = {{0, 0}, {0, 0}, 0, 0, 0, 0};
+  for(t_uint i = first; i < last; ++i)
+    for(int v = 0; v < 3; ++v) {
+      t_real const *p = &faces[9 * order[i] + 3 * v];
+      bool const start = i == first and v == 0;
+      for(int a = 0; a < 2; ++a) {
+        node.lo[a] = start ? p[a] : std::min(node.lo[a], p[a]);
+        node.hi[a] = start ? p[a] : std::max(node.hi[a], p[a]);
+      }
+      node.top = start ? p[2] : std::max(node.top, p[2]);
+    }
+  t_uint const index = nodes_.size();
+  if(last - first <= leaf_faces) {
+    node.first = triangles_.size() / 9;
+    node.count = last - first;
+    for(t_uint i = first; i < last; ++i)
+      triangles_.insert(triangles_.end(), faces.begin() + 9 * order[i],
+                        faces.begin() + 9 * order[i] + 9);
+    nodes_.push_back(node);
+    return index;
+  }
+
+  // halves of the faces on either side of the median of their centroids, along the wider side
+  nodes_.push_back(node);
+  int const a = node.hi[0] - node.lo[0] >= node.hi[1] - node.lo[1] ? 0 : 1;
+  auto const centroid = [&faces, a](t_uint f) {
+    return faces[9 * f + a] + faces[9 * f + 3 + a] + faces[9 * f + 6 + a];
+  };
+  t_uint const middle = (first + last) / 2;
+  std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + last,
+                   [&centroid](t_uint f, t_uint g) { return centroid(f) < centroid(g); });
+  subdivide(order, first, middle, faces);
+  auto const right = subdivide(order, middle, last, faces);
+  nodes_[index].right = right;
+  return index;
+}
+
+bool PointLocator::crosses(t_uint f, t_real x, t_real y, t_real z) const {
+  t_real const *a = &triangles_[9 * f], *b = a + 3, *c = a + 6;
+  t_real const wc = edge(a, b, x, y);
+  if(not inside(wc, a, b))
+    return false;
+  t_real const wa = edge(b, c, x, y);
+  if(not inside(wa, b, c))
+    return false;
+  t_real const wb = edge(c, a, x, y);
+  if(not inside(wb, c, a))
+    return false;
+  // the face crosses the vertical through the point above it
+  return wa * a[2] + wb * b[2] + wc * c[2] > z * (wa + wb + wc);
+}
+
+bool PointLocator::contains(t_uint j, t_real x, t_real y, t_real z) const {
+  t_real const dx = x - cx_[j], dy = y - cy_[j], dz = z - cz_[j];
+  t_real const r2 = dx * dx + dy * dy + dz * dz;
+  if(sphere_[j])
+    return r2 <= r2_[j];
+  if(r2 > r2_[j])
+    return false;
+  // the ray leaves a closed mesh after crossing its surface an odd number of times
+  bool odd = false;
+  t_uint stack[64], depth = 0;
+  stack[depth++] = roots_[j];
+  while(depth > 0) {
+    t_uint n = stack[--depth];
+    for(;;) {
+      Node const &node = nodes_[n];
+      if(dx < node.lo[0] or dx > node.hi[0] or dy < node.lo[1] or dy > node.hi[1] or
+         not(node.top > dz))
+        break;
+      if(node.right == 0) {
+        for(t_uint f = node.first; f < node.first + node.count; ++f)
+          odd ^= crosses(f, dx, dy, dz);
+        break;
+      }
+      stack[depth++] = node.right;
+      ++n;
+    }
+  }
+  return odd;
+}
+
+int PointLocator::locate(Cartesian<t_real> const &R) const {
+  t_real const p[3] = {R.x, R.y, R.z};
+  t_int cell[3];
+  for(int a = 0; a < 3; ++a) {
+    t_real const u = std::floor((p[a] - origin_[a]) / cell_);
+    // points on the upper boundary belong to the last cell
+    if(not(u >= 0 and u <= cells_[a]))
+      return -1;
+    cell[a] = std::min<t_int>(u, cells_[a] - 1);
+  }
+  t_uint const c = (cell[0] * cells_[1] + cell[1]) * cells_[2] + cell[2];
+  for(t_uint i = first_[c]; i < first_[c + 1]; ++i)
+    if(contains(candidates_[i], p[0], p[1], p[2]))
+      return candidates_[i];
+  return -1;
+}
+
+int PointLocator::locate(Spherical<t_real> const &R) const {
+  return locate(Tools::toCartesian(R));
+}
+
+t_uint PointLocator::surfaces(Cartesian<t_real> const &R, t_real reach) const {
+  t_real const p[3] = {R.x, R.y, R.z};
+  t_int lo[3], hi[3];
+  for(int a = 0; a < 3; ++a) {
+    lo[a] = std::max<t_int>(0, std::floor((p[a] - reach - origin_[a]) / cell_));
+    hi[a] = std::min<t_int>(cells_[a] - 1, std::floor((p[a] + reach - origin_[a]) / cell_));
+    if(lo[a] > hi[a])
+      return 0;
+  }
+  // a scatterer spanning several cells is listed in each of them
+  std::vector<t_uint> found;
+  for(t_int i = lo[0]; i <= hi[0]; ++i)
+    for(t_int k = lo[1]; k <= hi[1]; ++k)
+      for(t_int l = lo[2]; l <= hi[2]; ++l) {
+        t_uint const c = (i * cells_[1] + k) * cells_[2] + l;
+        for(t_uint n = first_[c]; n < first_[c + 1]; ++n) {
+          auto const j = candidates_[n];
+          t_real const dx = p[0] - cx_[j], dy = p[1] - cy_[j], dz = p[2] - cz_[j];
+          if(std::abs(std::sqrt(dx * dx + dy * dy + dz * dz) - std::sqrt(r2_[j])) <= reach and
+             std::find(found.begin(), found.end(), j) == found.end())
+            found.push_back(j);
+        }
+      }
+  return found.size();
+}
+
+std::vector<int> PointLocator::locate(std::vector<Spherical<t_real>> const &R) const {
+  std::vector<int> result(R.size());
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for
+#endif
+  for(std::size_t i = 0; i < R.size(); ++i)
+    result[i] = locate(R[i]);
+  return result;
+}
+}
@@ -0,0 +1,101 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef POINT_LOCATOR_H_
+#define POINT_LOCATOR_H_
+
+#include "Cartesian.h"
+#include "Scatterer.h"
+#include "Spherical.h"
+#include "Types.h"
+
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The PointLocator class finds the scatterer containing a point.
+ * The bounding spheres of the scatterers are binned into a uniform grid of
+ * cells, so that a point is only tested against the few scatterers whose
+ * sphere overlaps its cell, and only if it lies within that sphere. Meshed
+ * scatterers, convex or not, then count the faces crossed by a ray from the
+ * point along +z, an odd number meaning inside. The faces of each mesh are
+ * sorted into a bounding volume hierarchy, so that only the O(log Ntri)
+ * boxes above the point are visited.
+ */
+class PointLocator {
+public:
+  /**
+   * Initializing constructor for the PointLocator class.
+   * @param objects the scatterers, in the order of their indices.
+   */
+  PointLocator(std::vector<Scatterer> const &objects);
+
+  /**
+   * Finds the scatterer containing a point.
+   * @param R the point, in Cartesian coordinates.
+   * @return the index of the first scatterer containing the point, -1 if none.
+   */
+  int locate(Cartesian<t_real> const &R) const;
+  //! Index of the first scatterer containing the point, -1 if none
+  int locate(Spherical<t_real> const &R) const;
+  //! Indices of the scatterers containing each of the points, -1 outside all of them
+  std::vector<int> locate(std::vector<Spherical<t_real>> const &R) const;
+  /**
+   * Counts the scatterers whose surface passes near a point.
+   * Meshed scatterers count by their bounding spheres.
+   * @param R the point, in Cartesian coordinates.
+   * @param reach the largest distance to a surface.
+   * @return the number of distinct scatterers within reach of the point.
+   */
+  t_uint surfaces(Cartesian<t_real> const &R, t_real reach) const;
+
+private:
+  //! Centers and squared radii of the bounding spheres
+  std::vector<t_real> cx_, cy_, cz_, r2_;
+  //! Whether a scatterer is a sphere, or else tested against its faces
+  std::vector<bool> sphere_;
+
+  //! \brief Node of the hierarchy of a mesh
+  //! \details Only the extent of the faces in the xy plane and their highest point matter to a
+  //! ray along +z. A leaf holds the faces first to first + count, otherwise the children are
+  //! the next node and the node at index right.
+  struct Node {
+    t_real lo[2], hi[2], top;
+    t_uint first, count, right;
+  };
+  //! Root node of the hierarchy of scatterer j, unused for spheres
+  std::vector<t_uint> roots_;
+  std::vector<Node> nodes_;
+  //! Vertices of the faces relative to the center, 9 per face, counterclockwise seen from +z
+  std::vector<t_real> triangles_;
+
+  //! Lower corner, size and number of the cells of the grid
+  t_real origin_[3], cell_;
+  t_int cells_[3];
+  //! Scatterers overlapping cell c, from first_[c] to first_[c + 1] of candidates_, lowest first
+  std::vector<t_uint> first_, candidates_;
+
+  //! Whether scatterer j contains the point
+  bool contains(t_uint j, t_real x, t_real y, t_real z) const;
+  //! Whether the ray from the local point along +z crosses face f
+  bool crosses(t_uint f, t_real x, t_real y, t_real z) const;
+  //! Builds the node of the faces first to last of the order, returns its index
+  t_uint subdivide(std::vector<t_uint> &order, t_uint first, t_uint last,
+                   std::vector<t_real> const &faces);
+};
+}
+#endif
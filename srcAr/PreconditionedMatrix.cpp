@@ -14,238 +14,237 @@
 // You should have received a copy of the GNU General Public License
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
+#include "ClusterTmatrix.h"
 #include "Coupling.h"
+#include "LatticeSums.h"
+#include "Output.h"
 #include "PreconditionedMatrix.h"
+#include "Profile.h"
+#include "TmatrixBlocks.h"
 #include "Types.h"
+#include "mpi/Collectives.h"
 #include "scalapack/BroadcastToOutOfContext.h"
+#include <algorithm>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <chrono>
 using namespace std::chrono;
 
 namespace optimet {
-#ifdef OPTIMET_MPI
-Vector<t_complex> distributed_vector_SH_AR1(Geometry &geometry,
-                                           std::shared_ptr<Excitation const> incWave,
-                                           Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_) {
-auto const nobj = geometry.objects.size();
-  if(nobj == 0)
-     return Vector<t_complex>::Zero(0); 
-  int gran1, gran2, gran11, gran22, sizeVec2;
-  mpi::Communicator communicator;
-  int rank = communicator.rank();
-  int size = communicator.size();
-  auto const nMaxS = geometry.objects.front().nMaxS;
-
-  t_uint const pMax = nMaxS * (nMaxS + 2);
-
-  Vector<t_complex> result1(2*pMax), resultK1(2*pMax), resultK1MNY(2*nobj*pMax);
- 
-  Vector<t_complex> X_int_proc, X_sca_proc;
-
-  int sizeFFint;
-    
-    if (rank==0){
-    sizeFFint =X_int_.size();
-    X_int_proc = X_int_;
-    X_sca_proc = X_sca_;
-    }
-
-    MPI_Bcast(&sizeFFint, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    X_int_proc.resize(sizeFFint); // broadcasting internal and external FF field coeff
-    X_sca_proc.resize(sizeFFint);
-    MPI_Bcast(&X_int_proc(0), sizeFFint, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&X_sca_proc(0), sizeFFint, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-
-    if (rank < (pMax % size)) {
-    gran1 = rank * (pMax/size + 1);
-    gran2 = gran1 + pMax/size + 1;
-    } else {
-    gran1 = rank * (pMax/size) + (pMax % size);
-    gran2 = gran1 + (pMax/size);
-    }
-
-
-  if (geometry.objects[0].scatterer_type == "arbitrary.shape"){
-
-   for (int objIndex = 0; objIndex < nobj; objIndex++){
-
-    int sizeVec = 2 * (gran2 - gran1);
-
-     resultK1.setZero();
-
-    Vector<t_complex> resultProc1(sizeVec);
-
-    Vector<int> sizesProc(size), disps(size);
-
-   MPI_Allgather (&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
+#ifdef OPTIMET_SCALAPACK
+scalapack::Matrix<t_complex> distributed_matrix(Matrix<t_complex> const &input, t_uint rows,
+                                                t_uint cols, scalapack::Context const &context,
+                                                scalapack::Sizes const &blocks) {
+  auto const serial = context.serial();
+  Eigen::Map<Matrix<t_complex> const> const input_map(input.data(), serial.is_valid() ? rows : 0,
+                                                      serial.is_valid() ? cols : 0);
+  scalapack::Matrix<t_complex const *> const serial_matrix(input_map, serial, {rows, cols},
+                                                           {rows, cols});
+  scalapack::Matrix<t_complex> result(context, {rows, cols}, blocks);
+  serial_matrix.transfer_to(context, result);
+  return result;
+}
 
-   for (int kk = 0; kk < size; kk++)
-   disps(kk) = (kk > 0) ? (disps(kk-1) + sizesProc(kk-1)) : 0;
+Vector<t_complex> gather_all_source_vector(scalapack::Matrix<t_complex> const &matrix) {
+  scalapack::Matrix<t_complex> result(matrix.context().serial(), {matrix.rows(), 1},
+                                      {matrix.rows(), 1});
+  matrix.transfer_to(matrix.context(), result);
+  auto const result_vector = matrix.context().broadcast(result.local(), 0, 0);
+  if(result_vector.size() == 0)
+    return Vector<t_complex>::Zero(0);
 
-    
-    resultProc1 = source_vectorSH_parallelAR1(geometry, gran1, gran2, incWave, X_int_proc, X_sca_proc, objIndex);
+  return result_vector;
+}
 
-    MPI_Gatherv (&resultProc1(0), sizeVec, MPI_DOUBLE_COMPLEX, &result1(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+Matrix<t_complex> gather_all_source_matrix(scalapack::Matrix<t_complex> const &matrix) {
+  scalapack::Matrix<t_complex> result(matrix.context().serial(), {matrix.rows(), matrix.cols()},
+                                      {matrix.rows(), matrix.cols()});
+  matrix.transfer_to(matrix.context(), result);
+  auto const result_matrix = matrix.context().broadcast(result.local(), 0, 0);
+  if(result_matrix.size() == 0)
+    return Matrix<t_complex>::Zero(0, matrix.cols());
 
-    if (rank == 0){
+  return result_matrix;
+}
 
-    for (int ranki = 0; ranki < size; ranki++){
+namespace {
+//! \brief Fills the local tiles of a matrix made of 2n by 2n blocks, one per pair of objects
+//! \details block(ii, jj) is only called for the pairs overlapping the local tiles. When the tiles
+//! of both (ii, jj) and (jj, ii) are local, both blocks come from a single call to pair(ii, jj).
+template <class BLOCK, class PAIR>
+scalapack::Matrix<t_complex>
+distributed_block_matrix(t_uint nobj, t_uint n, scalapack::Context const &context,
+                         scalapack::Sizes const &blocks, BLOCK const &block, PAIR const &pair) {
+  scalapack::Matrix<t_complex> result(context, {2 * n * nobj, 2 * n * nobj}, blocks);
+  if(result.local().size() == 0)
+    return result;
+
+  // local rows and columns, sorted by object
+  std::vector<std::vector<std::pair<t_uint, t_uint>>> rows(nobj), cols(nobj);
+  for(Eigen::Index i = 0; i < result.local().rows(); ++i) {
+    auto const global = std::get<0>(result.global_indices(i, 0));
+    rows[global / (2 * n)].emplace_back(i, global % (2 * n));
+  }
+  for(Eigen::Index j = 0; j < result.local().cols(); ++j) {
+    auto const global = std::get<1>(result.global_indices(0, j));
+    cols[global / (2 * n)].emplace_back(j, global % (2 * n));
+  }
 
-     if (ranki < (pMax % size)) {
-    gran11 = ranki * (pMax/size + 1);
-    gran22 = gran11 + pMax/size + 1;
-    } else {
-    gran11 = ranki * (pMax/size) + (pMax % size);
-    gran22 = gran11 + (pMax/size);
+  auto const fill = [&](t_uint ii, t_uint jj, Matrix<t_complex> const &values) {
+    for(auto const &col : cols[jj])
+      for(auto const &row : rows[ii])
+        result.local()(row.first, col.first) = values(row.second, col.second);
+  };
+  for(t_uint jj = 0; jj < nobj; ++jj) {
+    if(cols[jj].empty())
+      continue;
+    for(t_uint ii = 0; ii < nobj; ++ii) {
+      if(rows[ii].empty())
+        continue;
+      bool const both = ii != jj and not rows[jj].empty() and not cols[ii].empty();
+      if(not both)
+        fill(ii, jj, block(ii, jj));
+      else if(ii < jj) {
+        auto const values = pair(ii, jj);
+        fill(ii, jj, values.first);
+        fill(jj, ii, values.second);
+      }
     }
+  }
+  return result;
+}
+}
 
+scalapack::Matrix<t_complex> ScatteringMatrixFF(Matrix<t_complex> const &TMatrixFF,
+                                                Geometry const &geometry,
+                                                std::shared_ptr<Excitation const> incWave,
+                                                scalapack::Context const &context,
+                                                scalapack::Sizes const &blocks) {
+  Profile::Region const timer("scattering matrix");
+  auto const nMax = geometry.objects.front().nMax;
+  t_uint const n = nMax * (nMax + 2);
+  auto result = distributed_block_matrix(
+      geometry.objects.size(), n, context, blocks, [&](t_uint ii, t_uint jj) {
+        return ScatteringBlockFF(TMatrixFF, geometry, incWave, ii, jj);
+      },
+      [&](t_uint ii, t_uint jj) { return ScatteringBlocksFF(TMatrixFF, geometry, incWave, ii, jj); });
+  Profile::memory("scattering matrix", result.local().size() * sizeof(t_complex));
+  return result;
+}
 
-      sizeVec2 = 2 * (gran22 - gran11);
-
-    int brojac (0);
-
-    for (int ii = gran11; ii < gran22; ii++){
- 
-   resultK1(ii) = result1(disps(ranki) + brojac);
-   resultK1(ii + pMax) = result1(disps(ranki) + (sizeVec2/2) + brojac);
- 
-   brojac++;
- 
-   } // for ii
- 
-   }  // for ranki
-  
-   resultK1MNY.segment(objIndex*2*pMax, 2*pMax) = resultK1;
-   }// rank0
-
-     MPI_Barrier(MPI_COMM_WORLD);
- 
-    }// loop through the objects
-
-      MPI_Bcast(&resultK1MNY(0), 2*nobj*pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+scalapack::Matrix<t_complex> ScatteringMatrixSH(Matrix<t_complex> const &TMatrixSH,
+                                                Geometry const &geometry,
+                                                std::shared_ptr<Excitation const> incWave,
+                                                scalapack::Context const &context,
+                                                scalapack::Sizes const &blocks) {
+  Profile::Region const timer("scattering matrix");
+  auto const nMaxS = geometry.objects.front().nMaxS;
+  t_uint const n = nMaxS * (nMaxS + 2);
+  auto result = distributed_block_matrix(
+      geometry.objects.size(), n, context, blocks, [&](t_uint ii, t_uint jj) {
+        return ScatteringBlockSH(TMatrixSH, geometry, incWave, ii, jj);
+      },
+      [&](t_uint ii, t_uint jj) { return ScatteringBlocksSH(TMatrixSH, geometry, incWave, ii, jj); });
+  Profile::memory("SH scattering matrix", result.local().size() * sizeof(t_complex));
+  return result;
+}
+#endif
 
-     }// end if arb.shapes
- 
-       return resultK1MNY;
- 
-       }
- 
-Vector<t_complex> distributed_source_vector_SH_Mnode(Geometry &geometry,
-                                           std::shared_ptr<Excitation const> incWave,
-                                           Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_, 
-                                           Matrix<t_complex> &TmatrixSH) {
-auto const nobj = geometry.objects.size();
+#ifdef OPTIMET_MPI
+std::tuple<Vector<t_complex>, Vector<t_complex>>
+distributed_source_vectors_SH(Geometry &geometry, std::shared_ptr<Excitation const> incWave,
+                              Vector<t_complex> &X_int_, Matrix<t_complex> const &TmatrixSH,
+                              mpi::Communicator const &communicator) {
+  Profile::Region const timer("SH source vectors");
+  auto const nobj = geometry.objects.size();
   if(nobj == 0)
-     return Vector<t_complex>::Zero(0);
+    return std::make_tuple(Vector<t_complex>::Zero(0), Vector<t_complex>::Zero(0));
 
-  int gran1, gran2, gran11, gran22, kk, sizeVec2;
-  mpi::Communicator communicator;
-  int rank = communicator.rank();
-  int size = communicator.size();
+  int const rank = communicator.rank();
+  int const size = communicator.size();
   auto const nMaxS = geometry.objects.front().nMaxS;
   auto const k_b_SH = 2.0 * incWave->omega() * std::sqrt(geometry.bground.epsilon * geometry.bground.mu);
-
-  t_uint const pMax = nMaxS * (nMaxS + 2);
-
-  Vector<t_complex> resultK(2*pMax), result3(2*pMax), result1(2*pMax), resultK3(2*pMax), resultK1(2*pMax), resultKMNY(2*nobj*pMax);
-  Vector<t_complex> X_int_proc, X_sca_proc;
-  Matrix<t_complex> TmatrixSINGLE;
-
-  int sizeFFint;
-    
-    if (rank==0){
-    sizeFFint =X_int_.size();
-    X_int_proc = X_int_;
-    X_sca_proc = X_sca_;
-    }
-    
-    MPI_Bcast(&sizeFFint, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    X_int_proc.resize(sizeFFint); // broadcasting internal and external FF field coeff
-    X_sca_proc.resize(sizeFFint);
-    MPI_Bcast(&X_int_proc(0), sizeFFint, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&X_sca_proc(0), sizeFFint, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-    
-    if (rank < (pMax % size)) {
-    gran1 = rank * (pMax/size + 1);
-    gran2 = gran1 + pMax/size + 1;
-    } else {
-    gran1 = rank * (pMax/size) + (pMax % size);
-    gran2 = gran1 + (pMax/size);
-    }
-    
-  
-// arbitrary shapes
- if (geometry.objects[0].scatterer_type == "arbitrary.shape"){
-
-  for (int objIndex = 0; objIndex < nobj; objIndex++){
-    int sizeVec = 2 * (gran2 - gran1);
-     TmatrixSINGLE = TmatrixSH.block(0, objIndex*2*pMax, 2*pMax, 2*pMax);
-     resultK.setZero();
-     resultK1.setZero();
-     resultK3.setZero();
-
-    Vector<t_complex> resultProc3(sizeVec), resultProc1(sizeVec);
-
-    Vector<int> sizesProc(size), disps(size);
-   
-   MPI_Allgather (&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
-   
-   for (int kk = 0; kk < size; kk++)
-   disps(kk) = (kk > 0) ? (disps(kk-1) + sizesProc(kk-1)) : 0;
- 
-    resultProc3 = source_vectorSH_parallelAR3(geometry, gran1, gran2, incWave, X_int_proc, X_sca_proc, objIndex);
-    resultProc1 = source_vectorSH_parallelAR1(geometry, gran1, gran2, incWave, X_int_proc, X_sca_proc, objIndex); 
-     
-    MPI_Gatherv (&resultProc3(0), sizeVec, MPI_DOUBLE_COMPLEX, &result3(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-    MPI_Gatherv (&resultProc1(0), sizeVec, MPI_DOUBLE_COMPLEX, &result1(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-      
-    if (rank == 0){
-
-    for (int ranki = 0; ranki < size; ranki++){
-
-     if (ranki < (pMax % size)) {
-    gran11 = ranki * (pMax/size + 1);
-    gran22 = gran11 + pMax/size + 1;
-    } else {
-    gran11 = ranki * (pMax/size) + (pMax % size);
-    gran22 = gran11 + (pMax/size);
+  int const pMax = nMaxS * (nMaxS + 2);
+
+  Vector<t_complex> KmNOD = Vector<t_complex>::Zero(2 * nobj * pMax);
+  Vector<t_complex> K1 = Vector<t_complex>::Zero(2 * nobj * pMax);
+  // only the arbitrary shapes have SH sources, the spheres keeping zeros
+  std::vector<int> meshed;
+  for(int objIndex = 0; objIndex < static_cast<int>(nobj); objIndex++)
+    if(geometry.objects[objIndex].kind() == Scatterer::arbitrary_shape)
+      meshed.push_back(objIndex);
+  if(meshed.empty())
+    return std::make_tuple(KmNOD, K1);
+
+  // broadcasting internal and external FF field coeff
+  int sizeFF = X_int_.size();
+  MPI_Bcast(&sizeFF, 1, MPI_INT, 0, *communicator);
+  Vector<t_complex> X_int_proc = X_int_;
+  X_int_proc.resize(sizeFF);
+  MPI_Bcast(X_int_proc.data(), sizeFF, MPI_DOUBLE_COMPLEX, 0, *communicator);
+
+  // each process computes the rows gran1 to gran2, and the same rows shifted by pMax
+  Vector<int> firsts(size), sizesProc(size), disps(size);
+  for(int ranki = 0; ranki < size; ranki++) {
+    firsts(ranki) = ranki < pMax % size ? ranki * (pMax / size + 1) : ranki * (pMax / size) + pMax % size;
+    sizesProc(ranki) = 2 * (pMax / size + (ranki < pMax % size ? 1 : 0));
+    disps(ranki) = ranki > 0 ? disps(ranki - 1) + sizesProc(ranki - 1) : 0;
+  }
+  int const gran1 = firsts(rank);
+  int const gran2 = gran1 + sizesProc(rank) / 2;
+
+  // the radiative and regular sources of each process are gathered together, and the gather of a
+  // particle completes while the integrals of the next one are computed
+  Vector<int> sizesBoth = 2 * sizesProc, dispsBoth = 2 * disps;
+  Vector<t_complex> resultProc[2], result[2];
+  MPI_Request requests[2];
+  auto const finish = [&](int i) {
+    int const b = i % 2;
+    int const objIndex = meshed[i];
+    MPI_Wait(&requests[b], MPI_STATUS_IGNORE);
+    if(rank != 0)
+      return;
+    Vector<t_complex> resultK3(2 * pMax), resultK1(2 * pMax);
+    for(int ranki = 0; ranki < size; ranki++) {
+      int const n = sizesProc(ranki) / 2;
+      auto const parts = result[b].segment(dispsBoth(ranki), 4 * n);
+      resultK3.segment(firsts(ranki), n) = parts.segment(0, n);
+      resultK3.segment(firsts(ranki) + pMax, n) = parts.segment(n, n);
+      resultK1.segment(firsts(ranki), n) = parts.segment(2 * n, n);
+      resultK1.segment(firsts(ranki) + pMax, n) = parts.segment(3 * n, n);
     }
+    K1.segment(objIndex * 2 * pMax, 2 * pMax) = resultK1;
+    KmNOD.segment(objIndex * 2 * pMax, 2 * pMax) =
+        (-consCi * k_b_SH) * resultK1 +
+        (consCi * k_b_SH) * TmatrixSH.block(0, objIndex * 2 * pMax, 2 * pMax, 2 * pMax) * resultK3;
+  };
+
+  for(int i = 0; i < static_cast<int>(meshed.size()); i++) {
+    int const b = i % 2;
+    int const objIndex = meshed[i];
+    resultProc[b] = source_vectorSH_parallelAR(geometry, gran1, gran2, incWave, X_int_proc, objIndex);
+    result[b].resize(4 * pMax);
+    MPI_Igatherv(resultProc[b].data(), sizesBoth(rank), MPI_DOUBLE_COMPLEX, result[b].data(),
+                 sizesBoth.data(), dispsBoth.data(), MPI_DOUBLE_COMPLEX, 0, *communicator, &requests[b]);
+    if(i > 0)
+      finish(i - 1);
+  }
+  finish(meshed.size() - 1);
 
-      sizeVec2 = 2 * (gran22 - gran11);
-
-  int brojac (0);
-  for (int ii = gran11; ii < gran22; ii++){
-
-  resultK3(ii) = result3(disps(ranki) + brojac);
-  resultK3(ii + pMax) = result3(disps(ranki) + (sizeVec2/2) + brojac);
-  resultK1(ii) = result1(disps(ranki) + brojac);
-  resultK1(ii + pMax) = result1(disps(ranki) + (sizeVec2/2) + brojac);
-
-  brojac++;
-
-  } // for ii
-
-  }  // for ranki
-        
-  resultK = (-consCi * k_b_SH ) * resultK1 + (consCi * k_b_SH) * TmatrixSINGLE * resultK3;
-  resultKMNY.segment(objIndex*2*pMax, 2*pMax) = resultK;
-  }// rank0
-
-  MPI_Barrier(MPI_COMM_WORLD);
-
-
-  } // end loop on objects
-
- MPI_Bcast(&resultKMNY(0), 2*nobj*pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-}// end if arb.shapes
-
-return resultKMNY;
-
+  MPI_Request broadcasts[2];
+  MPI_Ibcast(KmNOD.data(), KmNOD.size(), MPI_DOUBLE_COMPLEX, 0, *communicator, &broadcasts[0]);
+  MPI_Ibcast(K1.data(), K1.size(), MPI_DOUBLE_COMPLEX, 0, *communicator, &broadcasts[1]);
+  MPI_Waitall(2, broadcasts, MPI_STATUSES_IGNORE);
+  return std::make_tuple(KmNOD, K1);
 }
 
 
  Vector<t_complex> getQmatrix_FF(Geometry const &geometry, ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex) {
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2) {
   
   auto const nMax = geometry.objects.front().nMax;                    
   auto const n = nMax * (nMax + 2);
@@ -253,13 +252,14 @@ return resultKMNY;
   
   Vector<t_complex> Qmatrix (4 * n * numRow);   
 
-  geometry.objects[objIndex].getQLocal(Qmatrix, incWave->omega(), bground, gran1, gran2);       
+  geometry.objects[objIndex].getQLocal(Qmatrix, incWave->omega(), bground, gran1, gran2, tri1, tri2);       
   
   return Qmatrix;
 }
 
  Vector<t_complex> getRgQmatrix_FF(Geometry const &geometry, ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex) {
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2) {
 
   auto const nMax = geometry.objects.front().nMax;
   auto const n = nMax * (nMax + 2);
@@ -267,7 +267,7 @@ return resultKMNY;
 
   Vector<t_complex> RgQmatrix (4 * n * numRow);
 
-  geometry.objects[objIndex].getRgQLocal(RgQmatrix, incWave->omega(), bground, gran1, gran2);
+  geometry.objects[objIndex].getRgQLocal(RgQmatrix, incWave->omega(), bground, gran1, gran2, tri1, tri2);
 
 
   return RgQmatrix;
@@ -276,7 +276,8 @@ return resultKMNY;
 
  Vector<t_complex> getQmatrix_SH(Geometry const &geometry,
                                  ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex) {
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2) {
                                  
   auto const nMaxS = geometry.objects.front().nMaxS;        
   auto const n = nMaxS * (nMaxS + 2);
@@ -284,7 +285,7 @@ return resultKMNY;
 
   Vector<t_complex> QmatrixSH (4 * n * numRow);
 
-  geometry.objects[objIndex].getQLocalSH(QmatrixSH, incWave->omega(), bground, gran1, gran2);
+  geometry.objects[objIndex].getQLocalSH(QmatrixSH, incWave->omega(), bground, gran1, gran2, tri1, tri2);
      
   return QmatrixSH;
   
@@ -292,7 +293,8 @@ return resultKMNY;
 
  Vector<t_complex> getRgQmatrix_SH(Geometry const &geometry,
                                  ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex) {
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2) {
 
   auto const nMaxS = geometry.objects.front().nMaxS;
   auto const n = nMaxS * (nMaxS + 2);
@@ -300,7 +302,7 @@ return resultKMNY;
 
   Vector<t_complex> RgQmatrixSH (4 * n * numRow);
 
-  geometry.objects[objIndex].getRgQLocalSH(RgQmatrixSH, incWave->omega(), bground, gran1, gran2);
+  geometry.objects[objIndex].getRgQLocalSH(RgQmatrixSH, incWave->omega(), bground, gran1, gran2, tri1, tri2);
  
     
   return RgQmatrixSH;
@@ -315,41 +317,19 @@ return resultKMNY;
   auto const nMax = geometry.objects.front().nMax;
   auto const n = nMax * (nMax + 2);
   auto const nobj = geometry.objects.size();
-  Matrix<t_complex> TmatrixSingle (2*n , 2*n);  
 
   Matrix<t_complex> result(2 * n * nobj, 2 * n * nobj);
 
-  size_t y(0);
-  for(int jj = 0; jj != nobj; ++jj, y += 2 * n) {
-
-  TmatrixSingle = TMatrixFF.block(0, jj*2*n, 2 * n, 2 * n);
-
-  size_t x(0);
-  for(int ii = 0; ii != nobj; ++ii, x += 2 * n) {
-
-
-      if(ii == jj) {
-        result.block(x, y, 2 * n, 2 * n) = Matrix<t_complex>::Identity(2 * n, 2 * n);
-
-
-      } else {
-
-        Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 1.0 * incWave->waveK, nMax);
-
-        result.block(x, y, n, n) = AB.diagonal.transpose();
-        result.block(x + n, y + n, n, n) = AB.diagonal.transpose();
-        result.block(x, y + n, n, n) = AB.offdiagonal.transpose();
-        result.block(x + n, y, n, n) = AB.offdiagonal.transpose();
-        result.block(x, y, 2 * n, 2 * n) = - result.block(x, y, 2 * n, 2 * n) * (TmatrixSingle);
-
-
-  }
-
+  // each pair of objects is coupled once, for both of its blocks
+  for(t_uint jj = 0; jj < nobj; ++jj)
+    for(t_uint ii = 0; ii <= jj; ++ii) {
+      auto const blocks = ScatteringBlocksFF(TMatrixFF, geometry, incWave, ii, jj);
+      result.block(2 * n * ii, 2 * n * jj, 2 * n, 2 * n) = blocks.first;
+      if(ii != jj)
+        result.block(2 * n * jj, 2 * n * ii, 2 * n, 2 * n) = blocks.second;
     }
-
-     }
-return result;   
-       }
+  return result;
+}
 
 // Scattering matrix for SH
  Matrix<t_complex> ScatteringMatrixSH(Matrix<t_complex> &TMatrixSH, Geometry const &geometry,
@@ -358,286 +338,1062 @@ return result;
   auto const nMaxS = geometry.objects.front().nMaxS;
   auto const n = nMaxS * (nMaxS + 2);
   auto const nobj = geometry.objects.size();
-  auto const k_b_SH = 2 * incWave->omega() * std::sqrt(geometry.bground.epsilon * geometry.bground.mu);
-  Matrix<t_complex> TmatrixSingle (2*n , 2*n);
 
   Matrix<t_complex> result(2 * n * nobj, 2 * n * nobj);
 
-  size_t x(0);
-  for(int ii = 0; ii != nobj; ++ii, x += 2 * n) {
-
-  TmatrixSingle = TMatrixSH.block(0, ii*2*n, 2 * n, 2 * n);
+  // each pair of objects is coupled once, for both of its blocks
+  for(t_uint jj = 0; jj < nobj; ++jj)
+    for(t_uint ii = 0; ii <= jj; ++ii) {
+      auto const blocks = ScatteringBlocksSH(TMatrixSH, geometry, incWave, ii, jj);
+      result.block(2 * n * ii, 2 * n * jj, 2 * n, 2 * n) = blocks.first;
+      if(ii != jj)
+        result.block(2 * n * jj, 2 * n * ii, 2 * n, 2 * n) = blocks.second;
+    }
+  return result;
+}
 
-  size_t y(0);
-  for(int jj = 0; jj != nobj; ++jj, y += 2 * n) {
 
 
-      if(ii == jj) {
-        result.block(x, y, 2 * n, 2 * n) = Matrix<t_complex>::Identity(2 * n, 2 * n);
+namespace {
+//! \brief Reads the T and RgQ matrices of a scatterer from the T-matrix library
+//! \details Only the root reads the file, the result is broadcast to all processes.
+bool load_tmatrix(std::string const &library, std::string const &key, Matrix<t_complex> &T,
+                  Matrix<t_complex> &RgQ, mpi::Communicator const &communicator) {
+  if(library.empty())
+    return false;
+  int found = 0;
+  if(communicator.rank() == 0) {
+    std::ifstream existing(library.c_str());
+    if(existing.good()) {
+      std::lock_guard<std::mutex> const lock(Output::mutex());
+      Output file;
+      if(file.open(library) >= 0) {
+        found = file.readComplex("Tmatrix/" + key + "/T", T.data(), T.cols(), T.rows()) and
+                file.readComplex("Tmatrix/" + key + "/RgQ", RgQ.data(), RgQ.cols(), RgQ.rows());
+        file.close();
+      }
+    }
+  }
+  found = communicator.broadcast(found, 0);
+  if(found) {
+    MPI_Bcast(T.data(), T.size(), MPI_DOUBLE_COMPLEX, 0, *communicator);
+    MPI_Bcast(RgQ.data(), RgQ.size(), MPI_DOUBLE_COMPLEX, 0, *communicator);
+  }
+  return found;
+}
 
+//! Adds the T and RgQ matrices of a scatterer to the T-matrix library
+void save_tmatrix(std::string const &library, std::string const &key, Matrix<t_complex> const &T,
+                  Matrix<t_complex> const &RgQ, mpi::Communicator const &communicator) {
+  if(library.empty() or communicator.rank() != 0)
+    return;
+  std::lock_guard<std::mutex> const lock(Output::mutex());
+  Output file;
+  if(file.open(library) < 0) {
+    std::cerr << "Could not open T-matrix library " << library << std::endl;
+    return;
+  }
+  // column-major storage, hence the transposed dimensions
+  file.writeComplex("Tmatrix/" + key + "/T", T.data(), T.cols(), T.rows());
+  file.writeComplex("Tmatrix/" + key + "/RgQ", RgQ.data(), RgQ.cols(), RgQ.rows());
+  file.close();
+}
 
-      } else {
+//! \brief Rows and triangles of the surface integrals of a particle computed by this process
+//! \details The processes are laid out as row groups by triangle groups, rank r being in row group
+//! r % rowGroups. The rows are split among the row groups, the triangles among the processes of a
+//! row group, and the partial integrals are summed on the first process of each group. The inner
+//! VSWFs of a triangle are evaluated for all the rows, so splitting the triangles repeats no work:
+//! there are only as many row groups as needed for every process to get a chunk of triangles.
+struct IntegralsShare {
+  //! Rows held by each process once summed, none outside of the first processes
+  Vector<int> numRows, firsts;
+  int gran1, gran2, tri1, tri2;
+  //! Processes of the same row group
+  mpi::Communicator group;
+};
+
+IntegralsShare integrals_share(int pMax, int Nt, mpi::Communicator const &communicator) {
+  int const size = communicator.size();
+  // as many triangles as a chunk of Scatterer::surfaceIntegrals
+  int const chunk = 64;
+  int const rowGroups =
+      std::max(1, std::min(std::min(pMax, size), (chunk * size + Nt - 1) / std::max(Nt, 1)));
+
+  IntegralsShare share;
+  share.numRows = Vector<int>::Zero(size);
+  share.firsts = Vector<int>::Zero(size);
+  for(int ranki = 0; ranki < rowGroups; ranki++) {
+    share.numRows(ranki) = pMax / rowGroups + (ranki < pMax % rowGroups ? 1 : 0);
+    share.firsts(ranki) = ranki < pMax % rowGroups ? ranki * (pMax / rowGroups + 1) :
+                                                     ranki * (pMax / rowGroups) + pMax % rowGroups;
+  }
+  int const row = communicator.rank() % rowGroups;
+  share.gran1 = share.firsts(row);
+  share.gran2 = share.gran1 + share.numRows(row);
+  share.group = communicator.split(row);
+  long const n = share.group.size(), i = share.group.rank();
+  share.tri1 = static_cast<int>(Nt * i / n);
+  share.tri2 = static_cast<int>(Nt * (i + 1) / n);
+  return share;
+}
 
-        Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 2.0 * incWave->waveK, nMaxS);
+//! \brief Sums and gathers the rows of the Q and RgQ matrices computed by each process
+//! \details Each process holds its rows of the four pMax by pMax blocks, one block after the
+//! other. The partial sums over the triangles are first reduced within each row group. The
+//! datatypes then put the rows straight into their place in a row-major 2pMax by 2pMax matrix,
+//! hence QT and RgQT hold the transposed matrices. Only the root factorises Q, so only the root
+//! gets it, whereas all the processes get RgQ. Both steps are posted without waiting, each
+//! completed by wait.
+class QRgQGather {
+public:
+  QRgQGather(Vector<t_complex> &Qproc, Vector<t_complex> &RgQproc, int pMax,
+             IntegralsShare const &share, Matrix<t_complex> &QT, Matrix<t_complex> &RgQT,
+             mpi::Communicator const &communicator)
+      : Qproc_(Qproc), RgQproc_(RgQproc), pMax_(pMax), share_(share), QT_(QT), RgQT_(RgQT),
+        communicator_(communicator) {}
+  QRgQGather(QRgQGather const &) = delete;
+  ~QRgQGather() { free(); }
+
+  //! Posts the sums within the row group
+  void reduce() {
+    if(share_.group.size() < 2)
+      return;
+    bool const root = share_.group.rank() == 0;
+    MPI_Ireduce(root ? MPI_IN_PLACE : Qproc_.data(), Qproc_.data(), Qproc_.size(),
+                MPI_DOUBLE_COMPLEX, MPI_SUM, 0, *share_.group, &requests_[0]);
+    MPI_Ireduce(root ? MPI_IN_PLACE : RgQproc_.data(), RgQproc_.data(), RgQproc_.size(),
+                MPI_DOUBLE_COMPLEX, MPI_SUM, 0, *share_.group, &requests_[1]);
+  }
+  //! Posts the gathers of the summed rows, once the sums are waited for
+  void gather() {
+    int const numRow = share_.numRows(communicator_.rank());
+    // a row of the process is made of that row in each of the four blocks
+    int const sendDispls[] = {0, numRow * pMax_, 2 * numRow * pMax_, 3 * numRow * pMax_};
+    // and goes to rows ii and ii + pMax of the row-major matrix
+    int const recvDispls[] = {0, 2 * pMax_ * pMax_};
+    MPI_Type_create_indexed_block(4, pMax_, sendDispls, MPI_DOUBLE_COMPLEX, &sendBlocks_);
+    MPI_Type_create_resized(sendBlocks_, 0, pMax_ * sizeof(t_complex), &sendRow_);
+    MPI_Type_create_indexed_block(2, 2 * pMax_, recvDispls, MPI_DOUBLE_COMPLEX, &recvBlocks_);
+    MPI_Type_create_resized(recvBlocks_, 0, 2 * pMax_ * sizeof(t_complex), &recvRow_);
+    MPI_Type_commit(&sendRow_);
+    MPI_Type_commit(&recvRow_);
+    types_ = true;
+
+    QT_.resize(2 * pMax_, 2 * pMax_);
+    RgQT_.resize(2 * pMax_, 2 * pMax_);
+    MPI_Igatherv(Qproc_.data(), numRow, sendRow_, QT_.data(), share_.numRows.data(),
+                 share_.firsts.data(), recvRow_, 0, *communicator_, &requests_[0]);
+    MPI_Iallgatherv(RgQproc_.data(), numRow, sendRow_, RgQT_.data(), share_.numRows.data(),
+                    share_.firsts.data(), recvRow_, *communicator_, &requests_[1]);
+  }
+  //! Completes the step posted last
+  void wait() {
+    MPI_Waitall(2, requests_, MPI_STATUSES_IGNORE);
+    free();
+  }
 
-        result.block(x, y, n, n) = AB.diagonal.transpose();
-        result.block(x + n, y + n, n, n) = AB.diagonal.transpose();
-        result.block(x, y + n, n, n) = AB.offdiagonal.transpose();
-        result.block(x + n, y, n, n) = AB.offdiagonal.transpose();
-        result.block(x, y, 2 * n, 2 * n) = (TmatrixSingle) * result.block(x, y, 2 * n, 2 * n);
+private:
+  Vector<t_complex> &Qproc_, &RgQproc_;
+  int pMax_;
+  IntegralsShare const &share_;
+  Matrix<t_complex> &QT_, &RgQT_;
+  mpi::Communicator const &communicator_;
+  MPI_Request requests_[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+  MPI_Datatype sendBlocks_, sendRow_, recvBlocks_, recvRow_;
+  bool types_ = false;
+
+  void free() {
+    if(not types_)
+      return;
+    MPI_Type_free(&sendRow_);
+    MPI_Type_free(&recvRow_);
+    MPI_Type_free(&sendBlocks_);
+    MPI_Type_free(&recvBlocks_);
+    types_ = false;
+  }
+};
+
+//! As a QRgQGather, waited for at each step
+void gather_QRgQ(Vector<t_complex> &Qproc, Vector<t_complex> &RgQproc, int pMax,
+                 IntegralsShare const &share, Matrix<t_complex> &QT, Matrix<t_complex> &RgQT,
+                 mpi::Communicator const &communicator) {
+  QRgQGather gather(Qproc, RgQproc, pMax, share, QT, RgQT, communicator);
+  gather.reduce();
+  gather.wait();
+  gather.gather();
+  gather.wait();
+}
+}
 
+namespace {
+//! \brief Zeroes the rows and columns of a T or RgQ matrix beyond the harmonics up to order
+//! \details The M functions come first, then the N ones, each in the order n^2 + n + m - 1.
+template <class BLOCK> void truncate_harmonics(BLOCK &&block, t_uint order) {
+  t_uint const n = block.rows() / 2, q = order * (order + 2);
+  for(t_uint const first : {t_uint(0), n}) {
+    block.middleRows(first + q, n - q).setZero();
+    block.middleCols(first + q, n - q).setZero();
+  }
+}
 
+//! \brief Solves Q^T X = RgQ^T for a symmetric particle, one class of functions at a time
+//! \details The functions of m only couple to those of m' when the number of rotations divides
+//! m - m', and with the mirror to those of the same parity, n + m for M and n + m + 1 for N. When
+//! there are more rotations than 2 nMax, e.g. for a body of revolution, each m is on its own.
+Matrix<t_complex> symmetric_solve(Matrix<t_complex> const &QT, Matrix<t_complex> const &RgQT,
+                                  int nMax, int rotations, bool mirror) {
+  int const pMax = nMax * (nMax + 2);
+  int const classes = std::min(rotations, 2 * nMax + 1);
+  Matrix<t_complex> X(QT.rows(), RgQT.cols());
+  for(int residue = 0; residue < classes; ++residue)
+    for(int parity = 0; parity < (mirror ? 2 : 1); ++parity) {
+      std::vector<int> index;
+      for(int half = 0; half < 2; ++half)
+        for(int n = 1; n <= nMax; ++n)
+          for(int m = -n; m <= n; ++m)
+            if(((m + nMax) % rotations) % classes == residue and
+               (not mirror or (n + m + half) % 2 == parity))
+              index.push_back(half * pMax + n * (n + 1) + m - 1);
+      if(index.empty())
+        continue;
+      Matrix<t_complex> A(index.size(), index.size()), B(index.size(), RgQT.cols());
+      for(std::size_t i = 0; i < index.size(); ++i) {
+        for(std::size_t j = 0; j < index.size(); ++j)
+          A(i, j) = QT(index[i], index[j]);
+        B.row(i) = RgQT.row(index[i]);
+      }
+      Matrix<t_complex> const solution = A.partialPivLu().solve(B);
+      for(std::size_t i = 0; i < index.size(); ++i)
+        X.row(index[i]) = solution.row(i);
     }
+  return X;
 }
 
-}
-return result;
+//! \brief T-matrix of a motif about its centre, the cluster T-matrix of its particles
+//! \details The particles are solved together at their own harmonics, the cluster at those of
+//! the geometry. The internal fields of a motif are not known: its RgQ matrix is the identity.
+std::pair<Matrix<t_complex>, Matrix<t_complex>>
+motif_tmatrix(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+              Scatterer const &object, mpi::Communicator const &communicator) {
+  Profile::count("motif T-matrices");
+  Geometry motif;
+  motif.bground = geometry.bground;
+  motif.TmatrixLibrary(geometry.get_TmatrixLibrary());
+  for(auto const &particle : *object.particles)
+    motif.pushObject(particle);
+  // the dispersive materials of the particles at this wavelength
+  motif.update(incWave);
+  auto const T = getTRgQmatrices(motif, incWave, false, nullptr, communicator).T;
+  t_int const n = 2 * object.nMax * (object.nMax + 2);
+  return std::make_pair(cluster_tmatrix(motif, incWave, T, object.nMax, communicator),
+                        Matrix<t_complex>::Identity(n, n));
 }
 
+//! \brief T-matrix of a particle from its gathered Q and RgQ matrices, on the root
+//! \details T Q = -RgQ for FF and T Q = RgQ for SH, solved as Q^T T^T = RgQ^T with a single LU
+//! factorisation.
+Matrix<t_complex> solve_tmatrix(Scatterer const &object, Matrix<t_complex> const &QT,
+                                Matrix<t_complex> const &RgQT, int nMax, bool SH) {
+  Profile::Region const timer("T-matrix inverse");
+  Matrix<t_complex> T =
+      object.getNOwedge() > 0 ?
+          symmetric_solve(QT, RgQT, nMax, object.getNOrotations(), object.getMirror())
+              .transpose() :
+          Matrix<t_complex>(QT.partialPivLu().solve(RgQT).transpose());
+  if(not SH)
+    T = -T;
+  return T;
+}
 
+//! \brief T and RgQ matrices of a particle from the rows of its Q and RgQ matrices
+//! \details As computed on each process by the integrals of the share, gathered on the root.
+std::pair<Matrix<t_complex>, Matrix<t_complex>>
+tmatrix_from_integrals(Scatterer const &object, Vector<t_complex> &Qproc,
+                       Vector<t_complex> &RgQproc, int nMax, IntegralsShare const &share, bool SH,
+                       mpi::Communicator const &communicator) {
+  int const pMax = nMax * (nMax + 2);
+  Matrix<t_complex> QT, RgQT;
+  {
+    Profile::Region const timer("T-matrix gather");
+    gather_QRgQ(Qproc, RgQproc, pMax, share, QT, RgQT, communicator);
+  }
+  Profile::memory("T-matrix integrals",
+                  (Qproc.size() + RgQproc.size() + QT.size() + RgQT.size()) * sizeof(t_complex));
+
+  Matrix<t_complex> T(2 * pMax, 2 * pMax);
+  if(communicator.rank() == 0)
+    T = solve_tmatrix(object, QT, RgQT, nMax, SH);
+  MPI_Bcast(T.data(), T.size(), MPI_DOUBLE_COMPLEX, 0, *communicator);
+  RgQT.transposeInPlace();
+  return std::make_pair(T, RgQT);
+}
 
-Matrix<t_complex> getTRgQmatrix_FF_parr(Geometry const &geometry,
-                                                   std::shared_ptr<Excitation const> incWave
-                                                    ) {
- auto const nobj = geometry.objects.size();
- int gran1, gran2, gran11, gran22, rank, size, pMax, sizeVec2;
- mpi::Communicator communicator;
- rank = communicator.rank();
- size = communicator.size();
- auto const nMax = geometry.objects.front().nMax;
-
-   pMax = nMax * (nMax + 2);
-
-   if (rank < (pMax % size)) {
-    gran1 = rank * (pMax/size + 1);
-    gran2 = gran1 + pMax/size + 1;
+//! Surface integrals of the rows and triangles of the share of this process
+void surface_integrals(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                       int objIndex, bool SH, IntegralsShare const &share,
+                       Vector<t_complex> &Qproc, Vector<t_complex> &RgQproc) {
+  Profile::count("T-matrices computed");
+  {
+    Profile::Region const timer("T-matrix integrals");
+    if(SH) {
+      Qproc = getQmatrix_SH(geometry, geometry.bground, incWave, share.gran1, share.gran2,
+                            objIndex, share.tri1, share.tri2);
+      RgQproc = getRgQmatrix_SH(geometry, geometry.bground, incWave, share.gran1, share.gran2,
+                                objIndex, share.tri1, share.tri2);
     } else {
-    gran1 = rank * (pMax/size) + (pMax % size);
-    gran2 = gran1 + (pMax/size);
+      Qproc = getQmatrix_FF(geometry, geometry.bground, incWave, share.gran1, share.gran2,
+                            objIndex, share.tri1, share.tri2);
+      RgQproc = getRgQmatrix_FF(geometry, geometry.bground, incWave, share.gran1, share.gran2,
+                                objIndex, share.tri1, share.tri2);
     }
+  }
+}
 
- int numRow = gran2 - gran1;
-
- int sizeVec = 4 * numRow * pMax;
-
- Vector<t_complex> QmatrixFF_proc (sizeVec);
- Vector<t_complex> RgQmatrixFF_proc (sizeVec);
- Vector<t_complex> resultQ (4 * pMax * pMax);
- Vector<t_complex> resultRgQ (4 * pMax * pMax);
- Matrix<t_complex> QmatrixFF(2*pMax, 2*pMax), RgQmatrixFF(2*pMax, 2*pMax), TmatrixFF(2*pMax, 2*pMax), TRgQmatrixFF(2*pMax, 4*nobj*pMax);
- TRgQmatrixFF.setZero();
-
-for (int objIndex = 0; objIndex < nobj; objIndex++){
-
-  resultQ.setZero();
-  resultRgQ.setZero();
-
-  QmatrixFF_proc = getQmatrix_FF(geometry, geometry.bground, incWave, gran1, gran2, objIndex);
-  RgQmatrixFF_proc = getRgQmatrix_FF(geometry, geometry.bground, incWave, gran1, gran2, objIndex);
-
-    Vector<int> sizesProc(size), disps(size);
-
-   MPI_Allgather (&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
+//! \brief T-matrices of particles computed one after the other by the same processes
+//! \details The communications and the factorisation of a particle run while the surface integrals
+//! of the next ones are computed. A particle goes through the sums of its rows within the row
+//! groups, their gathers, its factorisation on the root and its broadcast, each posted without
+//! waiting and completed a particle later, so that at most three particles are in flight.
+class TmatrixPipeline {
+public:
+  explicit TmatrixPipeline(mpi::Communicator const &communicator) : communicator_(communicator) {}
+
+  //! Computes the integrals of a particle, moves those in flight a step on, then posts its own
+  void push(Geometry const &geometry, std::shared_ptr<Excitation const> incWave, int objIndex,
+            bool SH, std::pair<Matrix<t_complex>, Matrix<t_complex>> &result);
+  //! Completes the particles in flight
+  void finish();
+
+private:
+  struct Particle {
+    Scatterer const *object;
+    int nMax;
+    bool SH;
+    IntegralsShare share;
+    Vector<t_complex> Qproc, RgQproc;
+    Matrix<t_complex> QT, RgQT;
+    std::pair<Matrix<t_complex>, Matrix<t_complex>> *result;
+    std::unique_ptr<QRgQGather> gather;
+    MPI_Request broadcast = MPI_REQUEST_NULL;
+    int step = 0;
+  };
+  //! Completes the step of a particle and posts the next one, true once the particle is done
+  bool advance(Particle &particle);
+
+  mpi::Communicator const &communicator_;
+  std::deque<std::unique_ptr<Particle>> flight_;
+};
+
+void TmatrixPipeline::push(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                           int objIndex, bool SH,
+                           std::pair<Matrix<t_complex>, Matrix<t_complex>> &result) {
+  auto const &object = geometry.objects[objIndex];
+  if(object.kind() == Scatterer::motif) {
+    result = motif_tmatrix(geometry, incWave, object, communicator_);
+    return;
+  }
+  std::unique_ptr<Particle> particle(new Particle);
+  particle->object = &object;
+  particle->nMax = SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+  particle->SH = SH;
+  particle->result = &result;
+  int const pMax = particle->nMax * (particle->nMax + 2);
+  // the surface integrals of a body of revolution run along a single meridian
+  int const Nt = object.getNOwedge() > 0 ? object.getNOwedge() : object.getNOtriangles();
+  particle->share = integrals_share(pMax, Nt, communicator_);
+  surface_integrals(geometry, incWave, objIndex, SH, particle->share, particle->Qproc,
+                    particle->RgQproc);
+  for(auto &other : flight_)
+    advance(*other);
+  while(not flight_.empty() and flight_.front()->step > 3)
+    flight_.pop_front();
+  particle->gather.reset(new QRgQGather(particle->Qproc, particle->RgQproc, pMax,
+                                        particle->share, particle->QT, particle->RgQT,
+                                        communicator_));
+  advance(*particle);
+  flight_.push_back(std::move(particle));
+}
 
-   for (int kk = 0; kk < size; kk++)
-   disps(kk) = (kk > 0) ? (disps(kk-1) + sizesProc(kk-1)) : 0; // displacements
+void TmatrixPipeline::finish() {
+  for(; not flight_.empty(); flight_.pop_front())
+    while(not advance(*flight_.front()))
+      continue;
+}
 
-  MPI_Gatherv (&QmatrixFF_proc(0), sizeVec, MPI_DOUBLE_COMPLEX, &resultQ(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-  MPI_Gatherv (&RgQmatrixFF_proc(0), sizeVec, MPI_DOUBLE_COMPLEX, &resultRgQ(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
- 
-  MPI_Bcast(&resultQ(0), 4*pMax*pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-  MPI_Bcast(&resultRgQ(0), 4*pMax*pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-  
- // rearranging vectors to matrices 
+bool TmatrixPipeline::advance(Particle &particle) {
+  int const pMax = particle.nMax * (particle.nMax + 2);
+  switch(particle.step++) {
+  case 0:
+    particle.gather->reduce();
+    return false;
+  case 1: {
+    Profile::Region const timer("T-matrix gather");
+    particle.gather->wait();
+    particle.gather->gather();
+    return false;
+  }
+  case 2: {
+    {
+      Profile::Region const timer("T-matrix gather");
+      particle.gather->wait();
+    }
+    Profile::memory("T-matrix integrals", (particle.Qproc.size() + particle.RgQproc.size() +
+                                           particle.QT.size() + particle.RgQT.size()) *
+                                              sizeof(t_complex));
+    auto &T = particle.result->first;
+    T.resize(2 * pMax, 2 * pMax);
+    if(communicator_.rank() == 0)
+      T = solve_tmatrix(*particle.object, particle.QT, particle.RgQT, particle.nMax, particle.SH);
+    MPI_Ibcast(T.data(), T.size(), MPI_DOUBLE_COMPLEX, 0, *communicator_, &particle.broadcast);
+    particle.result->second = particle.RgQT.transpose();
+    // only the T-matrix is left in flight
+    particle.Qproc.resize(0);
+    particle.RgQproc.resize(0);
+    particle.QT.resize(0, 0);
+    particle.RgQT.resize(0, 0);
+    return false;
+  }
+  case 3:
+    MPI_Wait(&particle.broadcast, MPI_STATUS_IGNORE);
+    return true;
+  default:
+    return true;
+  }
+}
 
-    for (int ranki = 0; ranki < size; ranki++){
 
-    if (ranki < (pMax % size)) {
-    gran11 = ranki * (pMax/size + 1);
-    gran22 = gran11 + pMax/size + 1;
-    } else {
-    gran11 = ranki * (pMax/size) + (pMax % size);
-    gran22 = gran11 + (pMax/size);
+//! \brief T and RgQ matrices of a meshed particle at the wavelengths of lambdas
+//! \details The surface integrals of get_TmatrixBatch() wavelengths at a time are computed in a
+//! single pass over the mesh, the material of the particle at each wavelength as update gives it.
+std::vector<std::pair<Matrix<t_complex>, Matrix<t_complex>>>
+compute_tmatrix_scan(Geometry const &geometry, int objIndex, bool SH,
+                     std::vector<t_real> const &lambdas, mpi::Communicator const &communicator) {
+  int const nMax = SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+  int const pMax = nMax * (nMax + 2);
+  auto const &object = geometry.objects[objIndex];
+  int const Nt = object.getNOwedge() > 0 ? object.getNOwedge() : object.getNOtriangles();
+  auto const share = integrals_share(pMax, Nt, communicator);
+  t_uint const batch = geometry.get_TmatrixBatch();
+  std::vector<std::pair<Matrix<t_complex>, Matrix<t_complex>>> result;
+  for(t_uint first = 0; first < lambdas.size(); first += batch) {
+    std::vector<t_real> omegas;
+    std::vector<ElectroMagnetic> materials;
+    for(t_uint w = first; w < std::min<t_uint>(first + batch, lambdas.size()); ++w) {
+      omegas.push_back(constant::c * (2 * constant::pi / lambdas[w]));
+      materials.push_back(object.elmag);
+      if(object.elmag.modelType != 0)
+        materials.back().update(lambdas[w]);
     }
+    Profile::count("T-matrices computed", omegas.size());
+    Profile::count("batched T-matrix passes");
+    std::vector<Vector<t_complex>> Qprocs, RgQprocs;
+    {
+      Profile::Region const timer("T-matrix integrals");
+      object.getQRgQLocal(omegas, materials, geometry.bground, SH, share.gran1, share.gran2,
+                          share.tri1, share.tri2, Qprocs, RgQprocs);
+    }
+    for(std::size_t w = 0; w < omegas.size(); ++w)
+      result.push_back(
+          tmatrix_from_integrals(object, Qprocs[w], RgQprocs[w], nMax, share, SH, communicator));
+  }
+  return result;
+}
 
-    sizeVec2 = pMax * (gran22 - gran11);
-
-  int brojac (0);
- 
-   for (int ii = gran11; ii < gran22; ii++){
-    for (int jj = 0; jj < pMax; jj++){
- 
-  QmatrixFF(ii, jj) = resultQ(disps(ranki) + brojac);
-  QmatrixFF(ii, jj + pMax) = resultQ(disps(ranki) + sizeVec2 + brojac);
-  QmatrixFF(ii + pMax, jj) = resultQ(disps(ranki) + 2*sizeVec2 + brojac);
-  QmatrixFF(ii + pMax, jj + pMax) = resultQ(disps(ranki) + 3*sizeVec2 + brojac);
-
-  RgQmatrixFF(ii, jj) = resultRgQ(disps(ranki) + brojac);
-  RgQmatrixFF(ii, jj + pMax) = resultRgQ(disps(ranki) + sizeVec2 + brojac);
-  RgQmatrixFF(ii + pMax, jj) = resultRgQ(disps(ranki) + 2*sizeVec2 + brojac);
-  RgQmatrixFF(ii + pMax, jj + pMax) = resultRgQ(disps(ranki) + 3*sizeVec2 + brojac);
- 
-   brojac++;
- 
-   } // for jj
-   } // for ii
- 
-   }  // for ranki
- 
-  
-  TmatrixFF = - RgQmatrixFF * QmatrixFF.inverse();  
-  TRgQmatrixFF.block(0, objIndex*2*pMax, 2*pMax, 2*pMax) = TmatrixFF;
-  TRgQmatrixFF.block(0, nobj*2*pMax + objIndex*2*pMax, 2*pMax, 2*pMax) = RgQmatrixFF;
+//! A particle whose T-matrix is computed, at the FF or the SH
+struct TmatrixTask {
+  int object;
+  bool SH;
+};
+
+//! \brief Groups of processes computing the particles, and the group of each particle
+//! \details Contiguous ranks form the groups, each computing whole particles one after the other.
+//! With rough operation counts, a particle takes the time of its surface integrals over the
+//! processes they can keep busy (see integrals_share), plus that of its factorisation on a single
+//! process. Particles go to the groups longest first, each to the group that would finish it
+//! first. With "auto", the number of groups giving the shortest time is chosen, a single group
+//! meaning that all the processes compute each particle in turn.
+std::pair<int, std::vector<int>>
+tmatrix_groups(Geometry const &geometry, std::vector<TmatrixTask> const &todo, int size) {
+  std::vector<t_real> integrals, capacities, factorisations;
+  for(auto const &task : todo) {
+    auto const &object = geometry.objects[task.object];
+    t_real const nMax = task.SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+    t_real const pMax = nMax * (nMax + 2);
+    t_real const Nt = object.getNOwedge() > 0 ? object.getNOwedge() : object.getNOtriangles();
+    t_real const Nq = object.getNOpoints() / std::max<t_real>(object.getNOtriangles(), 1.0);
+    integrals.push_back(24 * Nq * Nt * pMax * pMax);
+    capacities.push_back(pMax * std::max(1.0, Nt / 64));
+    factorisations.push_back(21.0 * pMax * pMax * pMax);
+  }
 
- 
-  MPI_Barrier(MPI_COMM_WORLD);
-}// loop on many targets
+  std::vector<int> order(todo.size());
+  for(std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](int a, int b) { return integrals[a] > integrals[b]; });
+  auto const schedule = [&](int groups, std::vector<int> &owners) {
+    std::vector<t_real> finish(groups, 0);
+    owners.assign(todo.size(), 0);
+    for(auto const i : order) {
+      t_real best = std::numeric_limits<t_real>::infinity();
+      for(int g = 0; g < groups; ++g) {
+        // ranks g * size / groups to (g + 1) * size / groups
+        t_real const n = (static_cast<long>(g + 1) * size + groups - 1) / groups -
+                         (static_cast<long>(g) * size + groups - 1) / groups;
+        t_real const time =
+            finish[g] + integrals[i] / std::min(n, capacities[i]) + factorisations[i];
+        if(time < best) {
+          best = time;
+          owners[i] = g;
+        }
+      }
+      finish[owners[i]] = best;
+    }
+    return *std::max_element(finish.begin(), finish.end());
+  };
+
+  auto const &distribution = geometry.get_TmatrixDistribution();
+  int const most = std::min<int>(size, todo.size());
+  std::vector<int> owners;
+  if(todo.empty() or distribution == "processes")
+    return std::make_pair(1, std::vector<int>(todo.size(), 0));
+  if(distribution == "particles") {
+    schedule(most, owners);
+    return std::make_pair(most, owners);
+  }
+  int groups = 1;
+  t_real shortest = schedule(1, owners);
+  for(int g = 2; g <= most; ++g) {
+    t_real const time = schedule(g, owners);
+    if(time < shortest) {
+      shortest = time;
+      groups = g;
+    }
+  }
+  schedule(groups, owners);
+  return std::make_pair(groups, owners);
+}
 
-               
- return TRgQmatrixFF;
+//! \brief A particle alone in the background, with its material and the excitation at lambda
+//! \details Gives the T-matrix of the particle at another wavelength than that of the geometry.
+std::pair<Geometry, std::shared_ptr<Excitation>>
+particle_at(Geometry const &geometry, std::shared_ptr<Excitation const> incWave, int objIndex,
+            t_real lambda) {
+  auto const excitation = std::make_shared<Excitation>(*incWave);
+  excitation->updateWavelength(lambda);
+  Geometry single;
+  single.bground = geometry.bground;
+  single.objects.push_back(geometry.objects[objIndex]);
+  single.update(excitation);
+  return std::make_pair(single, excitation);
 }
 
-Matrix<t_complex> getTRgQmatrix_SH_parr(Geometry const &geometry,
-                                                  std::shared_ptr<Excitation const> incWave) {
-auto const nobj = geometry.objects.size();
- int gran1, gran2, gran11, gran22, rank, size, pMax, sizeVec2;
- mpi::Communicator communicator;
- rank = communicator.rank();
- size = communicator.size();
- auto const nMaxS = geometry.objects.front().nMaxS;
-
- pMax = nMaxS * (nMaxS + 2);
-
-    if (rank < (pMax % size)) {
-    gran1 = rank * (pMax/size + 1);
-    gran2 = gran1 + pMax/size + 1;
-    } else {
-    gran1 = rank * (pMax/size) + (pMax % size);
-    gran2 = gran1 + (pMax/size);
+//! \brief FF T and RgQ matrices of a meshed particle interpolated across the scan
+//! \details The matrices at the Chebyshev nodes of the wavelengths of the scan are read from the
+//! library or computed when the particle is first met, then interpolated elementwise in barycentric
+//! form. Returns false if the particle is computed directly instead: a sphere, a wavelength outside
+//! of the scan, or a particle whose check failed. check is set at every Tcheck-th wavelength of the
+//! scan, where the interpolated matrices are compared to direct ones. key is that of the particle
+//! at the first node.
+bool interpolated_tmatrix(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                          int objIndex, Matrix<t_complex> &T, Matrix<t_complex> &RgQ, bool &check,
+                          std::string &key, mpi::Communicator const &communicator) {
+  auto const n = geometry.get_TmatrixInterpolation();
+  auto const &scan = geometry.scan_;
+  if(n == 0 or n >= scan.size() or geometry.objects[objIndex].kind() == Scatterer::sphere)
+    return false;
+  auto const range = std::minmax_element(scan.begin(), scan.end());
+  auto const lambda = incWave->lambda();
+  if(lambda < *range.first * (1 - 1e-12) or lambda > *range.second * (1 + 1e-12))
+    return false;
+
+  // Chebyshev points of the first kind, with their barycentric weights
+  std::vector<t_real> nodes(n), weights(n);
+  for(t_uint k = 0; k < n; ++k) {
+    auto const angle = (2 * k + 1) * constant::pi / (2 * n);
+    nodes[k] = 0.5 * (*range.first + *range.second) +
+               0.5 * (*range.second - *range.first) * std::cos(angle);
+    weights[k] = (k % 2 ? -1 : 1) * std::sin(angle);
+  }
+  auto const keyAt = [&](std::pair<Geometry, std::shared_ptr<Excitation>> const &particle) {
+    return particle.first.objects.front().TmatrixKey(particle.first.bground,
+                                                     particle.second->omega(), false);
+  };
+  key = keyAt(particle_at(geometry, incWave, objIndex, nodes.front()));
+  auto &fits = geometry.TmatrixNodes();
+  auto fit = fits.find(key);
+  if(fit != fits.end() and fit->second.empty())
+    return false;
+  if(fit == fits.end()) {
+    std::vector<std::pair<Matrix<t_complex>, Matrix<t_complex>>> values(n);
+    std::vector<std::string> nodeKeys(n);
+    std::vector<t_uint> missing;
+    std::vector<t_real> lambdas;
+    for(t_uint k = 0; k < n; ++k) {
+      nodeKeys[k] = keyAt(particle_at(geometry, incWave, objIndex, nodes[k]));
+      values[k].first.resize(T.rows(), T.cols());
+      values[k].second.resize(RgQ.rows(), RgQ.cols());
+      if(load_tmatrix(geometry.get_TmatrixLibrary(), nodeKeys[k], values[k].first,
+                      values[k].second, communicator))
+        continue;
+      missing.push_back(k);
+      lambdas.push_back(nodes[k]);
     }
+    // the nodes left are computed a batch of them per pass over the mesh
+    Profile::count("T-matrices at Chebyshev nodes", missing.size());
+    auto const computed = compute_tmatrix_scan(geometry, objIndex, false, lambdas, communicator);
+    for(std::size_t i = 0; i < missing.size(); ++i) {
+      values[missing[i]] = computed[i];
+      save_tmatrix(geometry.get_TmatrixLibrary(), nodeKeys[missing[i]], computed[i].first,
+                   computed[i].second, communicator);
+    }
+    fit = fits.emplace(key, std::move(values)).first;
+  }
 
+  T.setZero();
+  RgQ.setZero();
+  t_real total = 0;
+  for(t_uint k = 0; k < n; ++k) {
+    if(std::abs(lambda - nodes[k]) <= 1e-12 * lambda) {
+      T = fit->second[k].first;
+      RgQ = fit->second[k].second;
+      total = 1;
+      break;
+    }
+    auto const w = weights[k] / (lambda - nodes[k]);
+    T += w * fit->second[k].first;
+    RgQ += w * fit->second[k].second;
+    total += w;
+  }
+  T /= total;
+  RgQ /= total;
+  Profile::count("interpolated T-matrices");
+
+  auto const where = std::find_if(scan.begin(), scan.end(), [lambda](t_real other) {
+    return std::abs(other - lambda) <= 1e-12 * lambda;
+  });
+  auto const step = where - scan.begin();
+  check = geometry.get_TmatrixCheck() > 0 and where != scan.end() and
+          (step + 1) % geometry.get_TmatrixCheck() == 0;
+  return true;
+}
 
- int numRow = gran2 - gran1;
-
- int sizeVec = 4 * numRow * pMax;
-
- Vector<t_complex> QmatrixSH_proc (sizeVec);
- Vector<t_complex> RgQmatrixSH_proc (sizeVec);
- Vector<t_complex> resultQ (4 * pMax * pMax);
- Vector<t_complex> resultRgQ (4 * pMax * pMax);
- Matrix<t_complex> QmatrixSH(2*pMax, 2*pMax), RgQmatrixSH(2*pMax, 2*pMax), TmatrixSH(2*pMax, 2*pMax), TRgQmatrixSH(2*pMax, 4*nobj*pMax);
- TRgQmatrixSH.setZero();
-
-for (int objIndex = 0; objIndex < nobj; objIndex++){
-
- QmatrixSH_proc = getQmatrix_SH(geometry, geometry.bground, incWave, gran1, gran2, objIndex);
- RgQmatrixSH_proc = getRgQmatrix_SH(geometry, geometry.bground, incWave, gran1, gran2, objIndex);
-
-    Vector<int> sizesProc(size), disps(size);
-
-   MPI_Allgather (&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
+//! \brief T and RgQ matrices of the particles of the tasks, in their order
+//! \details The tasks are independent of each other: with several groups of processes, each group
+//! computes its own, and the matrices are then broadcast in a single round.
+std::vector<std::pair<Matrix<t_complex>, Matrix<t_complex>>>
+compute_tmatrices(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                  std::vector<TmatrixTask> const &todo, mpi::Communicator const &communicator) {
+  auto const groups = tmatrix_groups(geometry, todo, communicator.size());
+  std::vector<std::pair<Matrix<t_complex>, Matrix<t_complex>>> computed(todo.size());
+  if(groups.first == 1) {
+    TmatrixPipeline pipeline(communicator);
+    for(std::size_t i = 0; i < todo.size(); ++i)
+      pipeline.push(geometry, incWave, todo[i].object, todo[i].SH, computed[i]);
+    pipeline.finish();
+    return computed;
+  }
+  int const size = communicator.size();
+  int const color = static_cast<long>(communicator.rank()) * groups.first / size;
+  auto const group = communicator.split(color);
+  std::vector<MPI_Request> requests;
+  TmatrixPipeline pipeline(group);
+  for(std::size_t i = 0; i < todo.size(); ++i) {
+    int const owner = groups.second[i];
+    if(owner == color)
+      pipeline.push(geometry, incWave, todo[i].object, todo[i].SH, computed[i]);
+    else {
+      int const nMax = todo[i].SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+      int const pMax = nMax * (nMax + 2);
+      computed[i].first.resize(2 * pMax, 2 * pMax);
+      computed[i].second.resize(2 * pMax, 2 * pMax);
+    }
+  }
+  pipeline.finish();
+  for(std::size_t i = 0; i < todo.size(); ++i) {
+    // first rank of the owner group
+    int const root = (static_cast<long>(groups.second[i]) * size + groups.first - 1) / groups.first;
+    requests.resize(requests.size() + 2);
+    MPI_Ibcast(computed[i].first.data(), computed[i].first.size(), MPI_DOUBLE_COMPLEX, root,
+               *communicator, &requests[requests.size() - 2]);
+    MPI_Ibcast(computed[i].second.data(), computed[i].second.size(), MPI_DOUBLE_COMPLEX, root,
+               *communicator, &requests.back());
+  }
+  MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+  return computed;
+}
 
-   for (int kk = 0; kk < size; kk++)
-   disps(kk) = (kk > 0) ? (disps(kk-1) + sizesProc(kk-1)) : 0; // displacements
+/**
+ * Tmatrix and RgQmatrix of all the particles, FF or SH, written to Tdata and RgQdata.
+ * All the processes take part in computing them, only those writing fill the data, of 2 pMax by
+ * 2 nobj pMax values each. The matrices are filled in before and after the particles found
+ * nowhere else are computed, so that the particles left by several fills can be computed together.
+ */
+class TmatrixFill {
+public:
+  //! Places the particles found in the cache or the library, or interpolated across the scan
+  TmatrixFill(Geometry const &geometry, std::shared_ptr<Excitation const> incWave, bool SH,
+              TmatrixCache *cache, mpi::Communicator const &communicator, t_complex *Tdata,
+              t_complex *RgQdata, bool write);
+  //! The particles left to compute
+  std::vector<TmatrixTask> tasks() const;
+  //! \brief Places the particles left, from their matrices in the order of the tasks
+  //! \details Then copies, turns and truncates the matrices of all the particles.
+  void finish(std::vector<std::pair<Matrix<t_complex>, Matrix<t_complex>>>::const_iterator computed);
+
+private:
+  Geometry const &geometry_;
+  std::shared_ptr<Excitation const> incWave_;
+  bool SH_;
+  TmatrixCache *cache_;
+  mpi::Communicator const &communicator_;
+  bool write_;
+  int nobj_, nMax_, pMax_;
+  Eigen::Map<Matrix<t_complex>> Tmatrix_, RgQmatrix_;
+  // identical particles reuse the T-matrix of the first one of their kind
+  std::vector<int> kinds_;
+  std::vector<std::string> keys_;
+  // first objects of the kinds found neither in the cache nor in the library
+  std::vector<int> todo_;
+  // interpolated T-matrices of the particles checked at this wavelength, and the keys of their fits
+  std::map<int, Matrix<t_complex>> interpolated_;
+  std::vector<std::string> nodeKeys_;
+
+  //! \brief Computes a meshed particle at this and the next wavelengths of the scan
+  //! \details Places it, and keeps the others for later. False if not batched.
+  bool batched(int objIndex, std::string const &key);
+
+  void place(int objIndex, Matrix<t_complex> const &T, Matrix<t_complex> const &RgQ) {
+    if(not write_)
+      return;
+    Tmatrix_.middleCols(objIndex * 2 * pMax_, 2 * pMax_) = T;
+    RgQmatrix_.middleCols(objIndex * 2 * pMax_, 2 * pMax_) = RgQ;
+  }
+};
+
+TmatrixFill::TmatrixFill(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                         bool SH, TmatrixCache *cache, mpi::Communicator const &communicator,
+                         t_complex *Tdata, t_complex *RgQdata, bool write)
+    : geometry_(geometry), incWave_(incWave), SH_(SH), cache_(cache), communicator_(communicator),
+      write_(write), nobj_(geometry.objects.size()),
+      nMax_(SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax),
+      pMax_(nMax_ * (nMax_ + 2)), Tmatrix_(Tdata, 2 * pMax_, 2 * nobj_ * pMax_),
+      RgQmatrix_(RgQdata, 2 * pMax_, 2 * nobj_ * pMax_), kinds_(nobj_), keys_(nobj_),
+      nodeKeys_(nobj_) {
+  if(write) {
+    Tmatrix_.setZero();
+    RgQmatrix_.setZero();
+  }
+  for(int objIndex = 0; objIndex < nobj_; objIndex++) {
+    kinds_[objIndex] = objIndex;
+    for(int kind = 0; kind < objIndex; kind++)
+      if(kinds_[kind] == kind and geometry.objects[kind].sameTmatrix(geometry.objects[objIndex])) {
+        kinds_[objIndex] = kind;
+        break;
+      }
+    if(kinds_[objIndex] != objIndex)
+      continue;
+
+    auto const &key = keys_[objIndex] =
+        geometry.objects[objIndex].TmatrixKey(geometry.bground, incWave->omega(), SH);
+    auto const cached = cache ? cache->find(key) : TmatrixCache::iterator();
+    if(cache and cached != cache->end()) {
+      place(objIndex, cached->second.first, cached->second.second);
+      continue;
+    }
+    Matrix<t_complex> T(2 * pMax_, 2 * pMax_), RgQ(2 * pMax_, 2 * pMax_);
+    // the spheres have their Mie coefficients, cheaper than reading them from the library
+    if(geometry.objects[objIndex].kind() == Scatterer::sphere) {
+      Profile::count("T-matrices of spheres");
+      // computed for the whole scan beforehand, unless the scan did not reach this wavelength
+      if(not geometry.sphereTmatrix(key, T, RgQ))
+        geometry.objects[objIndex].getTRgQSphere(T, RgQ, incWave->omega(), geometry.bground, SH);
+      place(objIndex, T, RgQ);
+      if(cache)
+        (*cache)[key] = std::make_pair(T, RgQ);
+      continue;
+    }
+    // computed with those of an earlier wavelength of the scan
+    auto &ahead = geometry.TmatrixAhead();
+    auto const early = ahead.find(key);
+    if(early != ahead.end()) {
+      place(objIndex, early->second.first, early->second.second);
+      if(cache)
+        (*cache)[key] = early->second;
+      ahead.erase(early);
+      continue;
+    }
+    if(load_tmatrix(geometry.get_TmatrixLibrary(), key, T, RgQ, communicator)) {
+      place(objIndex, T, RgQ);
+      if(cache)
+        (*cache)[key] = std::make_pair(T, RgQ);
+      continue;
+    }
+    // between the Chebyshev nodes of the scan, checked against the direct matrices now and then
+    bool check = false;
+    if(not SH and interpolated_tmatrix(geometry, incWave, objIndex, T, RgQ, check,
+                                       nodeKeys_[objIndex], communicator)) {
+      if(not check) {
+        place(objIndex, T, RgQ);
+        if(cache)
+          (*cache)[key] = std::make_pair(T, RgQ);
+        continue;
+      }
+      interpolated_[objIndex] = T;
+    }
+    // with the next wavelengths of the scan, in a single pass over the mesh
+    if(not check and batched(objIndex, key))
+      continue;
+    todo_.push_back(objIndex);
+  }
+}
 
-  MPI_Gatherv (&QmatrixSH_proc(0), sizeVec, MPI_DOUBLE_COMPLEX, &resultQ(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-  MPI_Gatherv (&RgQmatrixSH_proc(0), sizeVec, MPI_DOUBLE_COMPLEX, &resultRgQ(0), &sizesProc(0), &disps(0), MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-  
-  MPI_Bcast(&resultQ(0), 4*pMax*pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-  MPI_Bcast(&resultRgQ(0), 4*pMax*pMax, MPI_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+bool TmatrixFill::batched(int objIndex, std::string const &key) {
+  auto const &object = geometry_.objects[objIndex];
+  auto const &scan = geometry_.scan_;
+  auto const lambda = incWave_->lambda();
+  auto const where = std::find_if(scan.begin(), scan.end(), [lambda](t_real other) {
+    return std::abs(other - lambda) <= 1e-12 * lambda;
+  });
+  if(geometry_.get_TmatrixBatch() < 2 or object.kind() != Scatterer::arbitrary_shape or
+     where == scan.end())
+    return false;
+  std::vector<t_real> const lambdas(
+      where, where + std::min<std::ptrdiff_t>(geometry_.get_TmatrixBatch(), scan.end() - where));
+  auto const computed = compute_tmatrix_scan(geometry_, objIndex, SH_, lambdas, communicator_);
+  place(objIndex, computed.front().first, computed.front().second);
+  save_tmatrix(geometry_.get_TmatrixLibrary(), key, computed.front().first,
+               computed.front().second, communicator_);
+  if(cache_)
+    (*cache_)[key] = computed.front();
+  // the others are kept by the keys they will be looked up by, material and all
+  auto particle = object;
+  for(std::size_t w = 1; w < lambdas.size(); ++w) {
+    if(particle.elmag.modelType != 0) {
+      particle.elmag = object.elmag;
+      particle.elmag.update(lambdas[w]);
+    }
+    auto const omega = constant::c * (2 * constant::pi / lambdas[w]);
+    auto const later = particle.TmatrixKey(geometry_.bground, omega, SH_);
+    save_tmatrix(geometry_.get_TmatrixLibrary(), later, computed[w].first, computed[w].second,
+                 communicator_);
+    geometry_.TmatrixAhead()[later] = computed[w];
+  }
+  return true;
+}
 
- // rearranging vectors to matrices 
- 
-    for (int ranki = 0; ranki < size; ranki++){
+std::vector<TmatrixTask> TmatrixFill::tasks() const {
+  std::vector<TmatrixTask> result;
+  for(auto const objIndex : todo_)
+    result.push_back({objIndex, SH_});
+  return result;
+}
 
-     if (ranki < (pMax % size)) {
-    gran11 = ranki * (pMax/size + 1);
-    gran22 = gran11 + pMax/size + 1;
-    } else {
-    gran11 = ranki * (pMax/size) + (pMax % size);
-    gran22 = gran11 + (pMax/size);
+void TmatrixFill::finish(
+    std::vector<std::pair<Matrix<t_complex>, Matrix<t_complex>>>::const_iterator computed) {
+  auto const Tblock = [this](int objIndex) {
+    return Tmatrix_.middleCols(objIndex * 2 * pMax_, 2 * pMax_);
+  };
+  auto const RgQblock = [this](int objIndex) {
+    return RgQmatrix_.middleCols(objIndex * 2 * pMax_, 2 * pMax_);
+  };
+  for(std::size_t i = 0; i < todo_.size(); ++i, ++computed) {
+    place(todo_[i], computed->first, computed->second);
+    save_tmatrix(geometry_.get_TmatrixLibrary(), keys_[todo_[i]], computed->first,
+                 computed->second, communicator_);
+    if(cache_)
+      (*cache_)[keys_[todo_[i]]] = *computed;
+    auto const check = interpolated_.find(todo_[i]);
+    if(check == interpolated_.end())
+      continue;
+    auto const error = (check->second - computed->first).norm() / computed->first.norm();
+    if(error <= geometry_.get_TmatrixTolerance())
+      continue;
+    // the rest of the scan computes the particle directly
+    Profile::count("failed T-matrix checks");
+    geometry_.TmatrixNodes()[nodeKeys_[todo_[i]]].clear();
+    if(communicator_.is_root())
+      std::cout << "The interpolated T-matrix of object " << todo_[i] << " is off by " << error
+                << " at " << incWave_->lambda() << " m, computed directly from now on"
+                << std::endl;
+  }
+  for(int objIndex = 0; objIndex < nobj_; objIndex++)
+    if(write_ and kinds_[objIndex] != objIndex) {
+      Tblock(objIndex) = Tblock(kinds_[objIndex]);
+      RgQblock(objIndex) = RgQblock(kinds_[objIndex]);
     }
 
-    sizeVec2 = pMax * (gran22 - gran11);
+  // the matrices above are in the frames of the particles, shared by the turned copies of a shape
+  for(int objIndex = 0; objIndex < nobj_; objIndex++) {
+    auto const &angles = geometry_.objects[objIndex].orientation;
+    if(not write_ or geometry_.objects[objIndex].kind() == Scatterer::sphere or
+       (angles[0] == 0 and angles[1] == 0 and angles[2] == 0))
+      continue;
+    Profile::count("rotated T-matrices");
+    auto T = Tblock(objIndex);
+    auto RgQ = RgQblock(objIndex);
+    T = rotate_tmatrix(T, nMax_, angles[0], angles[1], angles[2]);
+    RgQ = rotate_tmatrix(RgQ, nMax_, angles[0], angles[1], angles[2], true);
+  }
 
-  int brojac (0);
- //single target only
- 
-for (int ii = gran11; ii < gran22; ii++){
-    for (int jj = 0; jj < pMax; jj++){
+  // the smaller particles keep their own harmonics only, whatever their orientation
+  for(int objIndex = 0; objIndex < nobj_; objIndex++) {
+    t_uint const order = geometry_.objects[objIndex].truncation();
+    if(not write_ or SH_ or order >= static_cast<t_uint>(nMax_))
+      continue;
+    Profile::count("truncated T-matrices");
+    truncate_harmonics(Tblock(objIndex), order);
+    truncate_harmonics(RgQblock(objIndex), order);
+  }
+}
 
-  QmatrixSH(ii, jj) = resultQ(disps(ranki) + brojac);
-  QmatrixSH(ii, jj + pMax) = resultQ(disps(ranki) + sizeVec2 + brojac);
-  QmatrixSH(ii + pMax, jj) = resultQ(disps(ranki) + 2*sizeVec2 + brojac);
-  QmatrixSH(ii + pMax, jj + pMax) = resultQ(disps(ranki) + 3*sizeVec2 + brojac);
+//! \brief Tmatrix and RgQmatrix of all the particles, FF or SH, written to Tdata and RgQdata
+//! \details As a TmatrixFill on its own.
+void fill_TRgQmatrix(Geometry const &geometry, std::shared_ptr<Excitation const> incWave, bool SH,
+                     TmatrixCache *cache, mpi::Communicator const &communicator, t_complex *Tdata,
+                     t_complex *RgQdata, bool write) {
+  Profile::Region const timer("T-matrices");
+  TmatrixFill fill(geometry, incWave, SH, cache, communicator, Tdata, RgQdata, write);
+  auto const computed = compute_tmatrices(geometry, incWave, fill.tasks(), communicator);
+  fill.finish(computed.begin());
+}
 
-  RgQmatrixSH(ii, jj) = resultRgQ(disps(ranki) + brojac);
-  RgQmatrixSH(ii, jj + pMax) = resultRgQ(disps(ranki) + sizeVec2 + brojac);
-  RgQmatrixSH(ii + pMax, jj) = resultRgQ(disps(ranki) + 2*sizeVec2 + brojac);
-  RgQmatrixSH(ii + pMax, jj + pMax) = resultRgQ(disps(ranki) + 3*sizeVec2 + brojac);
+//! Tmatrix and RgQmatrix of all the particles, FF or SH
+Matrix<t_complex> getTRgQmatrix_parr(Geometry const &geometry,
+                                     std::shared_ptr<Excitation const> incWave, bool SH,
+                                     TmatrixCache *cache, mpi::Communicator const &communicator) {
+  int const nMax = SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+  int const pMax = nMax * (nMax + 2);
+  Matrix<t_complex> TRgQmatrix(2 * pMax, 4 * geometry.objects.size() * pMax);
+  Profile::memory(SH ? "SH T-matrices" : "T-matrices", TRgQmatrix.size() * sizeof(t_complex));
+  fill_TRgQmatrix(geometry, incWave, SH, cache, communicator, TRgQmatrix.data(),
+                  TRgQmatrix.data() + TRgQmatrix.size() / 2, true);
+  return TRgQmatrix;
+}
 
-   brojac++;
+//! Tmatrix and RgQmatrix of all the particles, FF or SH, held once per node
+std::shared_ptr<mpi::SharedArray const>
+getTRgQmatrix_shared(Geometry const &geometry, std::shared_ptr<Excitation const> incWave, bool SH,
+                     TmatrixCache *cache, mpi::Communicator const &communicator,
+                     mpi::Communicator const &node) {
+  int const nMax = SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+  int const pMax = nMax * (nMax + 2);
+  t_uint const size = 2 * pMax * 4 * geometry.objects.size() * pMax;
+  // a complex is stored as two doubles
+  auto const result = std::make_shared<mpi::SharedArray>(2 * size, node);
+  Profile::memory(SH ? "SH T-matrices" : "T-matrices",
+                  node.is_root() ? size * sizeof(t_complex) : 0);
+  auto const data = reinterpret_cast<t_complex *>(result->data());
+  fill_TRgQmatrix(geometry, incWave, SH, cache, communicator, data, data + size / 2,
+                  node.is_root());
+  result->synchronize();
+  return result;
+}
+}
 
-   } // for jj
-   } // for ii
+TRgQmatrices getTRgQmatrices(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                             bool SH, TmatrixCache *cache, mpi::Communicator const &communicator) {
+  int const nMax = SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+  int const pMax = nMax * (nMax + 2);
+  TRgQmatrices result;
+  result.T.resize(2 * pMax, 2 * geometry.objects.size() * pMax);
+  result.RgQ.resize(2 * pMax, 2 * geometry.objects.size() * pMax);
+  Profile::memory(SH ? "SH T-matrices" : "T-matrices",
+                  2 * result.T.size() * sizeof(t_complex));
+  fill_TRgQmatrix(geometry, incWave, SH, cache, communicator, result.T.data(), result.RgQ.data(),
+                  true);
+  return result;
+}
 
-}  // for ranki
+std::pair<TRgQmatrices, TRgQmatrices>
+getTRgQmatrices(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                TmatrixCache *cacheFF, TmatrixCache *cacheSH,
+                mpi::Communicator const &communicator) {
+  std::pair<TRgQmatrices, TRgQmatrices> result;
+  for(bool const SH : {false, true}) {
+    int const nMax = SH ? geometry.objects.front().nMaxS : geometry.objects.front().nMax;
+    int const pMax = nMax * (nMax + 2);
+    auto &matrices = SH ? result.second : result.first;
+    matrices.T.resize(2 * pMax, 2 * geometry.objects.size() * pMax);
+    matrices.RgQ.resize(2 * pMax, 2 * geometry.objects.size() * pMax);
+    Profile::memory(SH ? "SH T-matrices" : "T-matrices",
+                    2 * matrices.T.size() * sizeof(t_complex));
+  }
+  Profile::Region const timer("T-matrices");
+  TmatrixFill FF(geometry, incWave, false, cacheFF, communicator, result.first.T.data(),
+                 result.first.RgQ.data(), true);
+  TmatrixFill SH(geometry, incWave, true, cacheSH, communicator, result.second.T.data(),
+                 result.second.RgQ.data(), true);
+  // the particles left at either harmonic in a single share of the processes
+  auto tasks = FF.tasks();
+  auto const tasksFF = tasks.size();
+  auto const tasksSH = SH.tasks();
+  tasks.insert(tasks.end(), tasksSH.begin(), tasksSH.end());
+  auto const computed = compute_tmatrices(geometry, incWave, tasks, communicator);
+  FF.finish(computed.begin());
+  SH.finish(computed.begin() + tasksFF);
+  return result;
+}
 
-  TmatrixSH = RgQmatrixSH * QmatrixSH.inverse();
-  TRgQmatrixSH.block(0, objIndex*2*pMax, 2*pMax, 2*pMax) = TmatrixSH;
-  TRgQmatrixSH.block (0, nobj*2*pMax + objIndex*2*pMax, 2*pMax, 2*pMax) = RgQmatrixSH;
+Matrix<t_complex> getTRgQmatrix_FF_parr(Geometry const &geometry,
+                                        std::shared_ptr<Excitation const> incWave,
+                                        TmatrixCache *cache, mpi::Communicator const &communicator) {
+  return getTRgQmatrix_parr(geometry, incWave, false, cache, communicator);
+}
 
-  MPI_Barrier(MPI_COMM_WORLD);
+Matrix<t_complex> getTRgQmatrix_SH_parr(Geometry const &geometry,
+                                        std::shared_ptr<Excitation const> incWave,
+                                        TmatrixCache *cache, mpi::Communicator const &communicator) {
+  return getTRgQmatrix_parr(geometry, incWave, true, cache, communicator);
+}
 
-}// loop over many targets
+std::shared_ptr<mpi::SharedArray const>
+getTRgQmatrix_FF_shared(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                        TmatrixCache *cache, mpi::Communicator const &communicator,
+                        mpi::Communicator const &node) {
+  return getTRgQmatrix_shared(geometry, incWave, false, cache, communicator, node);
+}
 
- return TRgQmatrixSH;
- 
+std::shared_ptr<mpi::SharedArray const>
+getTRgQmatrix_SH_shared(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                        TmatrixCache *cache, mpi::Communicator const &communicator,
+                        mpi::Communicator const &node) {
+  return getTRgQmatrix_shared(geometry, incWave, true, cache, communicator, node);
 }
 
 #endif
 
 Vector<t_complex> source_vector(std::vector<Scatterer>::const_iterator first,
                                 std::vector<Scatterer>::const_iterator const &last,
-                                std::shared_ptr<Excitation const> incWave) {
+                                std::shared_ptr<Excitation const> incWave,
+                                OriginCouplings *couplings) {
   if(first == last)
     return Vector<t_complex>::Zero(0);
   auto const nMax = first->nMax;
   auto const flatMax = nMax * (nMax + 2);
-  Vector<t_complex> result(2 * flatMax * (last - first));
-  for(size_t i(0); first != last; ++first, i += 2 * flatMax){
-    incWave->getIncLocal(first->vR, result.data() + i, nMax);
-    }
+  t_int const nobj = last - first;
+  Vector<t_complex> result(2 * flatMax * nobj);
+  // a plane wave only picks up a phase per object, other sources are translated to each of them
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for schedule(dynamic) if(incWave->type != 0 and nobj > 1)
+#endif
+  for(t_int i = 0; i < nobj; ++i)
+    incWave->getIncLocal((first + i)->vR, result.data() + 2 * flatMax * i, nMax, couplings);
   return result;
 }
 
 #ifdef OPTIMET_MPI
-Vector<t_complex> source_vectorSH_parallelAR3(Geometry &geometry, int gran1, int gran2,
-                                std::shared_ptr<Excitation const> incWave, Vector<t_complex> &internalCoef_FF_, 
-                                 Vector<t_complex> &scatteredCoef_FF_, int objIndex) {
-
-if(gran1 == gran2)
-  return Vector<t_complex>::Zero(0);
-
-  Vector<t_complex> resultProc(2*(gran2 - gran1));
-  
-  geometry.getEXCvecSH_ARB3_parall(resultProc, incWave, scatteredCoef_FF_, internalCoef_FF_, gran1, gran2, objIndex);
-
-  return resultProc;
-}
-
-
-Vector<t_complex> source_vectorSH_parallelAR1(Geometry &geometry, int gran1, int gran2,
+Vector<t_complex> source_vectorSH_parallelAR(Geometry &geometry, int gran1, int gran2,
                                 std::shared_ptr<Excitation const> incWave, Vector<t_complex> &internalCoef_FF_,
-                                 Vector<t_complex> &scatteredCoef_FF_, int objIndex) {
+                                 int objIndex) {
 if(gran1 == gran2)
   return Vector<t_complex>::Zero(0);
 
-  Vector<t_complex> resultProc(2*(gran2 - gran1));
-  
-if (geometry.objects[0].scatterer_type == "arbitrary.shape"){
+  Vector<t_complex> resultProc = Vector<t_complex>::Zero(4*(gran2 - gran1));
+
+if (geometry.objects[objIndex].kind() == Scatterer::arbitrary_shape){
 
-geometry.getEXCvecSH_ARB1_parall(resultProc, incWave, scatteredCoef_FF_, internalCoef_FF_, gran1, gran2, objIndex);
+geometry.getEXCvecSH_ARB_parall(resultProc, incWave, internalCoef_FF_, gran1, gran2, objIndex);
 
 }
 
@@ -652,15 +1408,372 @@ Vector<t_complex> source_vector(std::vector<Scatterer> const &objects, std::shar
 
 
 
-Vector<t_complex> source_vector(Geometry const &geometry, std::shared_ptr<Excitation const> incWave) {
-  if(geometry.objects.size() == 0)
-    return Vector<t_complex>(0, 0);
-  // Check nMax is same accross all objects
+namespace {
+//! Checks nMax is the same accross all objects
+void check_harmonics(Geometry const &geometry) {
   auto const nMax = geometry.objects.front().nMax;
   for(auto const &scatterer : geometry.objects)
     if(scatterer.nMax != nMax)
       throw std::runtime_error("All objects must have same number of harmonics");
+}
+
+#ifdef OPTIMET_MPI
+//! \brief Source vectors of the given incidences, one per column, known on all the processes
+//! \details Each process computes the sources of a contiguous share of the objects, for all the
+//! incidences, and a single gather assembles them. Plane waves only need a phase per object,
+//! cheaper than exchanging it, so every process computes them all.
+Matrix<t_complex> distributed_source_vectors(Geometry const &geometry,
+                                             std::vector<std::shared_ptr<Excitation const>> const &incWaves,
+                                             mpi::Communicator const &communicator,
+                                             OriginCouplings *couplings) {
+  auto const nobj = static_cast<t_int>(geometry.objects.size());
+  auto const nMax = geometry.objects.front().nMax;
+  t_int const n = 2 * nMax * (nMax + 2);
+  t_int const nInc = incWaves.size();
+  bool const plane = std::all_of(incWaves.begin(), incWaves.end(),
+                                 [](std::shared_ptr<Excitation const> const &incWave) {
+                                   return incWave->type == 0;
+                                 });
+  Matrix<t_complex> result(n * nobj, nInc);
+  if(plane or communicator.size() == 1) {
+    for(t_int i = 0; i < nInc; ++i)
+      result.col(i) = source_vector(geometry.objects.begin(), geometry.objects.end(), incWaves[i],
+                                    couplings);
+    return result;
+  }
+
+  auto const size = static_cast<t_int>(communicator.size());
+  auto const first = [nobj, size](t_int rank) {
+    return rank * (nobj / size) + std::min(rank, nobj % size);
+  };
+  auto const rank = static_cast<t_int>(communicator.rank());
+  auto const begin = geometry.objects.begin();
+  Matrix<t_complex> local(n * (first(rank + 1) - first(rank)), nInc);
+  for(t_int i = 0; i < nInc; ++i)
+    local.col(i) =
+        source_vector(begin + first(rank), begin + first(rank + 1), incWaves[i], couplings);
+
+  // the share of each process, column after column
+  Vector<t_complex> const shares =
+      mpi::all_gather(Vector<t_complex>(Eigen::Map<Vector<t_complex>>(local.data(), local.size())),
+                      communicator);
+  for(t_int r = 0; r < size; ++r) {
+    auto const rows = n * (first(r + 1) - first(r));
+    result.middleRows(n * first(r), rows) =
+        Eigen::Map<Matrix<t_complex> const>(shares.data() + n * first(r) * nInc, rows, nInc);
+  }
+  return result;
+}
+#endif
+} // namespace
+
+Vector<t_complex> source_vector(Geometry const &geometry, std::shared_ptr<Excitation const> incWave) {
+  if(geometry.objects.size() == 0)
+    return Vector<t_complex>(0, 0);
+  check_harmonics(geometry);
+  Profile::Region const timer("source vector");
   return source_vector(geometry.objects, incWave);
 }
 
+#ifdef OPTIMET_MPI
+Vector<t_complex> source_vector(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                                mpi::Communicator const &communicator,
+                                OriginCouplings *couplings) {
+  if(geometry.objects.size() == 0)
+    return Vector<t_complex>(0, 0);
+  check_harmonics(geometry);
+  Profile::Region const timer("source vector");
+  return distributed_source_vectors(geometry, {incWave}, communicator, couplings).col(0);
+}
+
+Matrix<t_complex> source_vectors(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                                 mpi::Communicator const &communicator,
+                                 OriginCouplings *couplings) {
+  if(geometry.objects.size() == 0)
+    return Matrix<t_complex>(0, incWave->nIncidences());
+  check_harmonics(geometry);
+  Profile::Region const timer("source vector");
+  std::vector<std::shared_ptr<Excitation const>> incWaves;
+  for(t_uint i = 0; i < incWave->nIncidences(); ++i)
+    incWaves.push_back(incWave->incidence(i));
+  return distributed_source_vectors(geometry, incWaves, communicator, couplings);
+}
+#endif
+
+namespace {
+//! \brief Couplings of ii with jj and all its images in a periodic array, [A^T B^T; B^T A^T]
+//! \details The images are in phase with the incident wave, with Bloch vector the projection of
+//! its wavevector onto the lattice. The diagonal blocks couple each object to its own images.
+Matrix<t_complex> periodic_coupling(Geometry const &geometry, Excitation const &incWave,
+                                    t_complex waveK, t_uint nMax, t_uint ii, t_uint jj) {
+  auto const &lattice = geometry.get_periodic();
+  auto bloch = Tools::toCartesian(Spherical<t_real>(waveK.real(), incWave.vKInc.the, incWave.vKInc.phi));
+  if(lattice.size() == 2)
+    bloch.z = 0;
+  auto const R = Tools::toCartesian(geometry.objects[ii].vR) - Tools::toCartesian(geometry.objects[jj].vR);
+  Coupling const AB(TranslationAdditionCoefficients(LatticeSums(lattice, waveK, bloch, 2 * nMax)(R),
+                                                    false, nMax),
+                    nMax);
+  t_uint const n = nMax * (nMax + 2);
+  Matrix<t_complex> coupling(2 * n, 2 * n);
+  coupling << AB.diagonal.transpose(), AB.offdiagonal.transpose(), AB.offdiagonal.transpose(),
+      AB.diagonal.transpose();
+  return coupling;
+}
+//! -C T, scaling the columns of C when T is diagonal
+Matrix<t_complex> coupled_tmatrix(Matrix<t_complex> const &coupling, Matrix<t_complex> const &T,
+                                  t_uint first, t_uint n) {
+  auto const block = T.block(0, first, n, n);
+  if(diagonal_tmatrix(T, first, n))
+    return -coupling * block.diagonal().asDiagonal();
+  return -coupling * block;
+}
+
+//! \brief Signs S = diag((-1)^n, -(-1)^n) of the parity relation C(-R) = S C(R) S
+//! \details A(-R) = (-1)^(n + l) A(R) and B(-R) = -(-1)^(n + l) B(R), for both the regular and
+//! the irregular couplings.
+Vector<t_real> parity_signs(t_uint nMax) {
+  t_uint const n = nMax * (nMax + 2);
+  Vector<t_real> result(2 * n);
+  for(t_uint l = 1; l <= nMax; ++l)
+    for(t_uint p = l * l - 1; p < l * (l + 2); ++p) {
+      result(p) = l % 2 == 0 ? 1 : -1;
+      result(n + p) = -result(p);
+    }
+  return result;
+}
+
+//! \brief The rows and columns of a 2 n by 2 n block for the q first M and N functions
+//! \details The block itself if q = n.
+Matrix<t_complex> leading_harmonics(Matrix<t_complex> const &block, t_uint q) {
+  t_uint const n = block.rows() / 2;
+  if(q == n)
+    return block;
+  Matrix<t_complex> result(2 * q, 2 * q);
+  result << block.block(0, 0, q, q), block.block(0, n, q, q), block.block(n, 0, q, q),
+      block.block(n, n, q, q);
+  return result;
+}
+
+//! \brief A 2 q by 2 q block set in the leading M and N functions of a 2 n by 2 n block
+//! \details The other rows and columns are left uncoupled, zero.
+Matrix<t_complex> padded_harmonics(Matrix<t_complex> const &block, t_uint n) {
+  t_uint const q = block.rows() / 2;
+  if(q == n)
+    return block;
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(2 * n, 2 * n);
+  result.block(0, 0, q, q) = block.block(0, 0, q, q);
+  result.block(0, n, q, q) = block.block(0, q, q, q);
+  result.block(n, 0, q, q) = block.block(q, 0, q, q);
+  result.block(n, n, q, q) = block.block(q, q, q, q);
+  return result;
+}
+
+//! T C, scaling the rows of C when T is diagonal
+Matrix<t_complex> tmatrix_coupled(Matrix<t_complex> const &T, Matrix<t_complex> const &coupling,
+                                  t_uint first, t_uint n) {
+  auto const block = T.block(0, first, n, n);
+  if(diagonal_tmatrix(T, first, n))
+    return block.diagonal().asDiagonal() * coupling;
+  return block * coupling;
+}
+} // namespace
+
+Matrix<t_complex> ScatteringBlockFF(Matrix<t_complex> const &TMatrixFF, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj) {
+  auto const nMax = geometry.objects.front().nMax;
+  t_uint const n = nMax * (nMax + 2);
+  if(not geometry.get_periodic().empty()) {
+    Matrix<t_complex> const coupling =
+        periodic_coupling(geometry, *incWave, 1.0 * incWave->waveK, nMax, ii, jj);
+    Matrix<t_complex> result = coupled_tmatrix(coupling, TMatrixFF, jj * 2 * n, 2 * n);
+    if(ii == jj)
+      result += Matrix<t_complex>::Identity(2 * n, 2 * n);
+    return result;
+  }
+  if(ii == jj)
+    return Matrix<t_complex>::Identity(2 * n, 2 * n);
+  // truncated particles are coupled up to the larger of their orders
+  auto const order = geometry.coupling_order(ii, jj);
+  t_uint const q = order * (order + 2);
+  auto const T = leading_harmonics(TMatrixFF.block(0, jj * 2 * n, 2 * n, 2 * n), q);
+  if(geometry.get_rotationcond()) {
+    RotationCoupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR,
+                              1.0 * incWave->waveK, order);
+    return padded_harmonics(-AB.apply(T, true), n);
+  }
+  Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 1.0 * incWave->waveK, order);
+  Matrix<t_complex> coupling(2 * q, 2 * q);
+  coupling << AB.diagonal.transpose(), AB.offdiagonal.transpose(), AB.offdiagonal.transpose(),
+      AB.diagonal.transpose();
+  return padded_harmonics(coupled_tmatrix(coupling, T, 0, 2 * q), n);
+}
+
+#ifdef OPTIMET_MPI
+Matrix<t_complex> ScatteringMatrixFF_parr(Matrix<t_complex> const &TMatrixFF,
+                                          Geometry const &geometry,
+                                          std::shared_ptr<Excitation const> incWave,
+                                          mpi::Communicator const &communicator) {
+  auto const nMax = geometry.objects.front().nMax;
+  t_int const n = 2 * nMax * (nMax + 2);
+  t_int const nobj = geometry.objects.size();
+  auto const size = static_cast<t_int>(communicator.size());
+  auto const rank = static_cast<t_int>(communicator.rank());
+  // the pairs of objects are dealt to the processes in turn, each coupled once for both blocks
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(n * nobj, n * nobj);
+  t_int pair = 0;
+  for(t_int jj = 0; jj < nobj; ++jj)
+    for(t_int ii = 0; ii <= jj; ++ii, ++pair) {
+      if(pair % size != rank)
+        continue;
+      auto const blocks = ScatteringBlocksFF(TMatrixFF, geometry, incWave, ii, jj);
+      result.block(ii * n, jj * n, n, n) = blocks.first;
+      if(ii != jj)
+        result.block(jj * n, ii * n, n, n) = blocks.second;
+    }
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *communicator);
+  return result;
+}
+#endif
+
+Matrix<t_complex> ScatteringBlockSH(Matrix<t_complex> const &TMatrixSH, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj) {
+  auto const nMaxS = geometry.objects.front().nMaxS;
+  t_uint const n = nMaxS * (nMaxS + 2);
+  if(not geometry.get_periodic().empty()) {
+    Matrix<t_complex> const coupling =
+        periodic_coupling(geometry, *incWave, 2.0 * incWave->waveK, nMaxS, ii, jj);
+    Matrix<t_complex> result = tmatrix_coupled(TMatrixSH, coupling, ii * 2 * n, 2 * n);
+    if(ii == jj)
+      result += Matrix<t_complex>::Identity(2 * n, 2 * n);
+    return result;
+  }
+  if(ii == jj)
+    return Matrix<t_complex>::Identity(2 * n, 2 * n);
+  if(geometry.get_rotationcond()) {
+    // T C^T = (C T^T)^T
+    RotationCoupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR,
+                              2.0 * incWave->waveK, nMaxS);
+    return AB.apply(TMatrixSH.block(0, ii * 2 * n, 2 * n, 2 * n).transpose()).transpose();
+  }
+  Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 2.0 * incWave->waveK, nMaxS);
+  Matrix<t_complex> coupling(2 * n, 2 * n);
+  coupling << AB.diagonal.transpose(), AB.offdiagonal.transpose(), AB.offdiagonal.transpose(),
+      AB.diagonal.transpose();
+  return tmatrix_coupled(TMatrixSH, coupling, ii * 2 * n, 2 * n);
+}
+
+std::pair<Matrix<t_complex>, Matrix<t_complex>>
+ScatteringBlocksFF(Matrix<t_complex> const &TMatrixFF, Geometry const &geometry,
+                   std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj) {
+  if(ii == jj or not geometry.get_periodic().empty())
+    return {ScatteringBlockFF(TMatrixFF, geometry, incWave, ii, jj),
+            ScatteringBlockFF(TMatrixFF, geometry, incWave, jj, ii)};
+  auto const nMax = geometry.objects.front().nMax;
+  t_uint const n = nMax * (nMax + 2);
+  auto const order = geometry.coupling_order(ii, jj);
+  t_uint const q = order * (order + 2);
+  auto const S = parity_signs(order);
+  auto const Ti = leading_harmonics(TMatrixFF.block(0, ii * 2 * n, 2 * n, 2 * n), q);
+  auto const Tj = leading_harmonics(TMatrixFF.block(0, jj * 2 * n, 2 * n, 2 * n), q);
+  if(geometry.get_rotationcond()) {
+    RotationCoupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR,
+                              1.0 * incWave->waveK, order);
+    Matrix<t_complex> reverse = S.asDiagonal() * Ti;
+    reverse = -(S.asDiagonal() * AB.apply(reverse, true));
+    return {padded_harmonics(-AB.apply(Tj, true), n), padded_harmonics(reverse, n)};
+  }
+  Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 1.0 * incWave->waveK, order);
+  Matrix<t_complex> coupling(2 * q, 2 * q);
+  coupling << AB.diagonal.transpose(), AB.offdiagonal.transpose(), AB.offdiagonal.transpose(),
+      AB.diagonal.transpose();
+  Matrix<t_complex> const direct = coupled_tmatrix(coupling, Tj, 0, 2 * q);
+  coupling = S.asDiagonal() * coupling * S.asDiagonal();
+  return {padded_harmonics(direct, n),
+          padded_harmonics(coupled_tmatrix(coupling, Ti, 0, 2 * q), n)};
+}
+
+std::pair<Matrix<t_complex>, Matrix<t_complex>>
+ScatteringBlocksSH(Matrix<t_complex> const &TMatrixSH, Geometry const &geometry,
+                   std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj) {
+  if(ii == jj or not geometry.get_periodic().empty())
+    return {ScatteringBlockSH(TMatrixSH, geometry, incWave, ii, jj),
+            ScatteringBlockSH(TMatrixSH, geometry, incWave, jj, ii)};
+  auto const nMaxS = geometry.objects.front().nMaxS;
+  t_uint const n = nMaxS * (nMaxS + 2);
+  auto const S = parity_signs(nMaxS);
+  if(geometry.get_rotationcond()) {
+    RotationCoupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR,
+                              2.0 * incWave->waveK, nMaxS);
+    // T C^T = (C T^T)^T, and T S C S = (S C S T^T)^T
+    Matrix<t_complex> reverse =
+        S.asDiagonal() * TMatrixSH.block(0, jj * 2 * n, 2 * n, 2 * n).transpose();
+    reverse = (S.asDiagonal() * AB.apply(reverse)).transpose();
+    return {AB.apply(TMatrixSH.block(0, ii * 2 * n, 2 * n, 2 * n).transpose()).transpose(),
+            reverse};
+  }
+  Coupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR, 2.0 * incWave->waveK, nMaxS);
+  Matrix<t_complex> coupling(2 * n, 2 * n);
+  coupling << AB.diagonal.transpose(), AB.offdiagonal.transpose(), AB.offdiagonal.transpose(),
+      AB.diagonal.transpose();
+  Matrix<t_complex> const direct = tmatrix_coupled(TMatrixSH, coupling, ii * 2 * n, 2 * n);
+  coupling = S.asDiagonal() * coupling * S.asDiagonal();
+  return {direct, tmatrix_coupled(TMatrixSH, coupling, jj * 2 * n, 2 * n)};
+}
+
+Vector<t_complex> ScatteringSliceFF(Matrix<t_complex> const &TMatrixFF, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj,
+                                    t_uint index, bool column) {
+  auto const nMax = geometry.objects.front().nMax;
+  t_uint const n = nMax * (nMax + 2);
+  if(ii == jj or not geometry.get_periodic().empty()) {
+    Matrix<t_complex> const block = ScatteringBlockFF(TMatrixFF, geometry, incWave, ii, jj);
+    return column ? Vector<t_complex>(block.col(index)) : Vector<t_complex>(block.row(index));
+  }
+  RotationCoupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR,
+                            1.0 * incWave->waveK, nMax);
+  auto const T = TMatrixFF.block(0, jj * 2 * n, 2 * n, 2 * n);
+  // the Mie coefficients of a sphere scale the coupling rather than multiply it
+  bool const sphere = geometry.objects[jj].kind() == Scatterer::sphere;
+  if(column and sphere) {
+    Matrix<t_complex> const unit = Vector<t_complex>::Unit(2 * n, index);
+    return -T(index, index) * AB.apply(unit, true);
+  }
+  if(column)
+    return -AB.apply(T.col(index), true);
+  // row index of -C T is -(C^T e_index)^T T
+  Matrix<t_complex> const unit = Vector<t_complex>::Unit(2 * n, index);
+  if(sphere)
+    return -T.diagonal().cwiseProduct(AB.apply(unit).col(0));
+  return -T.transpose() * AB.apply(unit);
+}
+
+Vector<t_complex> ScatteringSliceSH(Matrix<t_complex> const &TMatrixSH, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj,
+                                    t_uint index, bool column) {
+  auto const nMaxS = geometry.objects.front().nMaxS;
+  t_uint const n = nMaxS * (nMaxS + 2);
+  if(ii == jj or not geometry.get_periodic().empty()) {
+    Matrix<t_complex> const block = ScatteringBlockSH(TMatrixSH, geometry, incWave, ii, jj);
+    return column ? Vector<t_complex>(block.col(index)) : Vector<t_complex>(block.row(index));
+  }
+  RotationCoupling const AB(geometry.objects[ii].vR - geometry.objects[jj].vR,
+                            2.0 * incWave->waveK, nMaxS);
+  auto const T = TMatrixSH.block(0, ii * 2 * n, 2 * n, 2 * n);
+  bool const sphere = geometry.objects[ii].kind() == Scatterer::sphere;
+  if(column) {
+    Matrix<t_complex> const unit = Vector<t_complex>::Unit(2 * n, index);
+    if(sphere)
+      return T.diagonal().cwiseProduct(AB.apply(unit, true).col(0));
+    return T * AB.apply(unit, true);
+  }
+  // row index of T C is (C^T T^T e_index)^T
+  if(sphere) {
+    Matrix<t_complex> const unit = Vector<t_complex>::Unit(2 * n, index);
+    return T(index, index) * AB.apply(unit);
+  }
+  return AB.apply(T.row(index).transpose());
+}
+
 }
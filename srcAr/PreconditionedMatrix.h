@@ -19,38 +19,118 @@
 
 #include "Excitation.h"
 #include "mpi/Communicator.h"
+#include "mpi/SharedArray.h"
 #include "Geometry.h"
 #include "Types.h"
 #include "scalapack/Context.h"
 #include "scalapack/Matrix.h"
 #include <Eigen/LU>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
  
 namespace optimet {
 //Computes source vector
 Vector<t_complex>
 source_vector(Geometry const &geometry, std::shared_ptr<Excitation const> incWave);
-//Computes source vector from a range of scatterers
+//! \brief Computes source vector from a range of scatterers
+//! \details The couplings from the origin, if given, are looked up and kept for later stages.
 Vector<t_complex> source_vector(std::vector<Scatterer>::const_iterator first,
                                 std::vector<Scatterer>::const_iterator const &last,
-                                std::shared_ptr<Excitation const> incWave);  
+                                std::shared_ptr<Excitation const> incWave,
+                                OriginCouplings *couplings = nullptr);
+#ifdef OPTIMET_MPI
+//! \brief Computes the source vector, the objects shared between the processes
+//! \details The result is known on all the processes of the communicator.
+Vector<t_complex> source_vector(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                                mpi::Communicator const &communicator,
+                                OriginCouplings *couplings = nullptr);
+//! \brief Source vectors of all the incidences of the excitation, one per column
+//! \details All the incidences share the distribution of the objects and a single gather.
+Matrix<t_complex> source_vectors(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                                 mpi::Communicator const &communicator,
+                                 OriginCouplings *couplings = nullptr);
+#endif
                                                                  
-#ifdef OPTIMET_MPI                                 
-// source vectors needed for SH arbitrary shapes and parallel
-Vector<t_complex> source_vectorSH_parallelAR3(Geometry &geometry, int gran1, int gran2,
-          std::shared_ptr<Excitation const> incWave, Vector<t_complex> &internalCoef_FF_, Vector<t_complex> &scatteredCoef_FF_, int objIndex);
+//! \brief Block of the FF scattering matrix coupling objects ii and jj
+//! \details -C(ii, jj) T(jj), or the identity if ii == jj
+Matrix<t_complex> ScatteringBlockFF(Matrix<t_complex> const &TMatrixFF, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj);
+
+//! \brief Block of the SH scattering matrix coupling objects ii and jj
+//! \details T(ii) C(ii, jj), or the identity if ii == jj
+Matrix<t_complex> ScatteringBlockSH(Matrix<t_complex> const &TMatrixSH, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj);
+
+//! \brief Blocks (ii, jj) and (jj, ii) of the FF scattering matrix, from a single coupling
+//! \details The coupling of jj with ii follows from that of ii with jj by parity, C(-R) = S C(R) S
+//! with S = diag((-1)^n, -(-1)^n). The periodic couplings, whose Bloch phases are not symmetric,
+//! are computed twice.
+std::pair<Matrix<t_complex>, Matrix<t_complex>>
+ScatteringBlocksFF(Matrix<t_complex> const &TMatrixFF, Geometry const &geometry,
+                   std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj);
+
+//! \brief Blocks (ii, jj) and (jj, ii) of the SH scattering matrix, from a single coupling
+//! \details As for ScatteringBlocksFF.
+std::pair<Matrix<t_complex>, Matrix<t_complex>>
+ScatteringBlocksSH(Matrix<t_complex> const &TMatrixSH, Geometry const &geometry,
+                   std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj);
 
+//! \brief Row, or column, index of the block of the FF scattering matrix coupling objects ii and jj
+//! \details The coupling is only applied to a vector, in O(nMax^3) through its rotation onto the
+//! axis between the objects, so that the block itself is never computed. The T-matrix of a
+//! sphere, diagonal, scales the slice rather than multiplying it.
+Vector<t_complex> ScatteringSliceFF(Matrix<t_complex> const &TMatrixFF, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj,
+                                    t_uint index, bool column);
 
-Vector<t_complex> source_vectorSH_parallelAR1(Geometry &geometry, int gran1, int gran2,
-              std::shared_ptr<Excitation const> incWave, Vector<t_complex> &internalCoef_FF_, Vector<t_complex> &scatteredCoef_FF_, int objIndex);
+//! \brief Row, or column, index of the block of the SH scattering matrix coupling objects ii and jj
+//! \details As for ScatteringSliceFF.
+Vector<t_complex> ScatteringSliceSH(Matrix<t_complex> const &TMatrixSH, Geometry const &geometry,
+                                    std::shared_ptr<Excitation const> incWave, t_uint ii, t_uint jj,
+                                    t_uint index, bool column);
 
-// computes the distributed source vector for SH on many nodes
-Vector<t_complex> distributed_source_vector_SH_Mnode(Geometry &geometry,
-                                           std::shared_ptr<Excitation const> incWave,
-                                           Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_, Matrix<t_complex> &TmatrixSH);
+/**
+ * The TRgQmatrices struct holds the T and RgQ matrices of all the particles,
+ * FF or SH, each kind side by side, 2 pMax by nobj 2 pMax. Kept apart, they
+ * are passed to the solvers and operators as they are, and the block of a
+ * particle is a view into them.
+ */
+struct TRgQmatrices {
+  Matrix<t_complex> T;   /**< T-matrices of the particles side by side. */
+  Matrix<t_complex> RgQ; /**< RgQ matrices of the particles side by side. */
 
-Vector<t_complex> distributed_vector_SH_AR1(Geometry &geometry,
-                                           std::shared_ptr<Excitation const> incWave,
-                                           Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_);
+  //! T-matrix of particle i
+  Eigen::Map<Matrix<t_complex> const> Tblock(t_uint i) const {
+    return Eigen::Map<Matrix<t_complex> const>(T.data() + i * T.rows() * T.rows(), T.rows(),
+                                               T.rows());
+  }
+  //! RgQ matrix of particle i
+  Eigen::Map<Matrix<t_complex> const> RgQblock(t_uint i) const {
+    return Eigen::Map<Matrix<t_complex> const>(RgQ.data() + i * RgQ.rows() * RgQ.rows(),
+                                               RgQ.rows(), RgQ.rows());
+  }
+  bool empty() const { return T.size() == 0; }
+  void clear() {
+    T.resize(0, 0);
+    RgQ.resize(0, 0);
+  }
+};
+
+#ifdef OPTIMET_MPI                                 
+// source vectors needed for SH arbitrary shapes and parallel, radiative then regular
+Vector<t_complex> source_vectorSH_parallelAR(Geometry &geometry, int gran1, int gran2,
+          std::shared_ptr<Excitation const> incWave, Vector<t_complex> &internalCoef_FF_, int objIndex);
+
+//! \brief Computes the distributed SH source vectors on many nodes, KmNOD then K1
+//! \details K1 is the part of KmNOD coming from the internal FF coefficients, both are obtained
+//! from the same integrals. The gathers of each particle overlap with the integrals of the next.
+std::tuple<Vector<t_complex>, Vector<t_complex>>
+distributed_source_vectors_SH(Geometry &geometry, std::shared_ptr<Excitation const> incWave,
+                              Vector<t_complex> &X_int_, Matrix<t_complex> const &TmatrixSH,
+                              mpi::Communicator const &communicator = mpi::Communicator());
 
 
 // computes scattering matrix of many targets at FF
@@ -61,32 +141,111 @@ Matrix<t_complex> ScatteringMatrixFF(Matrix<t_complex> &TMatrixFF, Geometry cons
 Matrix<t_complex> ScatteringMatrixSH(Matrix<t_complex> &TMatrixSH, Geometry const &geometry,
                                                    std::shared_ptr<Excitation const> incWave);
 
-// computes the Qmatrix for FF, single target
+#ifdef OPTIMET_MPI
+//! \brief Scattering matrix at FF, known whole on all the processes
+//! \details The pairs of objects are dealt to the processes, each computing both blocks of its
+//! pairs from a single coupling.
+Matrix<t_complex> ScatteringMatrixFF_parr(Matrix<t_complex> const &TMatrixFF,
+                                          Geometry const &geometry,
+                                          std::shared_ptr<Excitation const> incWave,
+                                          mpi::Communicator const &communicator);
+#endif
+
+// computes the rows gran1 to gran2 of the Qmatrix for FF, single target, integrated over the
+// triangles tri1 to tri2
 Vector<t_complex>getQmatrix_FF(Geometry const &geometry, ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex);
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2);
 
 
 // computes the RgQmatrix for FF, single target
 Vector<t_complex>getRgQmatrix_FF(Geometry const &geometry, ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex);
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2);
 
 // Computes the Qmatrix for SH, single target
 Vector<t_complex>getQmatrix_SH(Geometry const &geometry, ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex);
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2);
 
 // Computes the RgQmatrix for SH, single target
 Vector<t_complex>getRgQmatrix_SH(Geometry const &geometry, ElectroMagnetic const &bground,
-                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex);
+                                 std::shared_ptr<Excitation const> incWave, int gran1, int gran2, int objIndex,
+                                 int tri1, int tri2);
                                                  
-//! Computes Tmatrix and RgQmatrix in paralllel, single target, FF
+//! T and RgQ matrices of the distinct particles, by T-matrix key
+typedef std::map<std::string, std::pair<Matrix<t_complex>, Matrix<t_complex>>> TmatrixCache;
+
+//! \brief Computes Tmatrix and RgQmatrix in paralllel, single target, FF
+//! \details Particles found in the cache are not recomputed, the others are added to it.
 Matrix<t_complex> getTRgQmatrix_FF_parr(Geometry const &geometry,
-                                                   std::shared_ptr<Excitation const> incWave
-                                                   );
+                                                   std::shared_ptr<Excitation const> incWave,
+                                                   TmatrixCache *cache = nullptr,
+                                                   mpi::Communicator const &communicator = mpi::Communicator());
 
-//! Computes Tmatrix and RgQmatrix in paralllel, single target, SH
+//! \brief Computes Tmatrix and RgQmatrix in paralllel, single target, SH
+//! \details Particles found in the cache are not recomputed, the others are added to it.
 Matrix<t_complex> getTRgQmatrix_SH_parr(Geometry const &geometry,
-                                                   std::shared_ptr<Excitation const> incWave
-                                                   );
+                                                   std::shared_ptr<Excitation const> incWave,
+                                                   TmatrixCache *cache = nullptr,
+                                                   mpi::Communicator const &communicator = mpi::Communicator());
+
+//! \brief Tmatrix and RgQmatrix of all the particles, FF or SH, each in a matrix of its own
+//! \details As getTRgQmatrix_FF_parr, without the matrix holding them both.
+TRgQmatrices getTRgQmatrices(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                             bool SH, TmatrixCache *cache = nullptr,
+                             mpi::Communicator const &communicator = mpi::Communicator());
+
+//! \brief Tmatrix and RgQmatrix of all the particles, FF then SH, each harmonic with its cache
+//! \details The particles left to compute at both harmonics are independent, and are shared out
+//! among the groups of processes together rather than one harmonic after the other.
+std::pair<TRgQmatrices, TRgQmatrices>
+getTRgQmatrices(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                TmatrixCache *cacheFF, TmatrixCache *cacheSH,
+                mpi::Communicator const &communicator = mpi::Communicator());
+
+//! \brief Tmatrix and RgQmatrix of all the particles held once per node, FF
+//! \details As getTRgQmatrix_FF_parr, in the memory of the root of node, shared with its other
+//! processes. Collective over communicator, node holding the processes of a node, as given by
+//! Communicator::split_shared.
+std::shared_ptr<mpi::SharedArray const>
+getTRgQmatrix_FF_shared(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                        TmatrixCache *cache, mpi::Communicator const &communicator,
+                        mpi::Communicator const &node);
+//! Tmatrix and RgQmatrix of all the particles held once per node, SH
+std::shared_ptr<mpi::SharedArray const>
+getTRgQmatrix_SH_shared(Geometry const &geometry, std::shared_ptr<Excitation const> incWave,
+                        TmatrixCache *cache, mpi::Communicator const &communicator,
+                        mpi::Communicator const &node);
+#endif
+
+#ifdef OPTIMET_SCALAPACK
+//! \brief Distributes a matrix held by the root of the context block-cyclically
+//! \details Only the root process of the context needs to hold the rows by cols input.
+scalapack::Matrix<t_complex> distributed_matrix(Matrix<t_complex> const &input, t_uint rows,
+                                                t_uint cols, scalapack::Context const &context,
+                                                scalapack::Sizes const &blocks);
+
+//! Gather the distributed vector into a single vector
+Vector<t_complex> gather_all_source_vector(scalapack::Matrix<t_complex> const &matrix);
+//! Gather the distributed columns into a single matrix
+Matrix<t_complex> gather_all_source_matrix(scalapack::Matrix<t_complex> const &matrix);
+
+//! \brief Computes the scattering matrix of many targets at FF, block-cyclically distributed
+//! \details Each process only computes the coupling blocks overlapping its local tiles.
+scalapack::Matrix<t_complex> ScatteringMatrixFF(Matrix<t_complex> const &TMatrixFF,
+                                                Geometry const &geometry,
+                                                std::shared_ptr<Excitation const> incWave,
+                                                scalapack::Context const &context,
+                                                scalapack::Sizes const &blocks);
+
+//! \brief Computes the scattering matrix of many targets at SH, block-cyclically distributed
+//! \details Each process only computes the coupling blocks overlapping its local tiles.
+scalapack::Matrix<t_complex> ScatteringMatrixSH(Matrix<t_complex> const &TMatrixSH,
+                                                Geometry const &geometry,
+                                                std::shared_ptr<Excitation const> incWave,
+                                                scalapack::Context const &context,
+                                                scalapack::Sizes const &blocks);
 #endif
 }
 #endif
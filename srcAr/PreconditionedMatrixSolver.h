@@ -59,21 +59,42 @@ public:
 
 protected:
   
-  Matrix<t_complex> S;
+  //! FF T and RgQ matrices
+  TRgQmatrices S;
   
   Vector<t_complex> Q;
   
-  Matrix<t_complex> V;
+  //! SH T and RgQ matrices, which the solvers may only build when a SH solve needs them
+  mutable TRgQmatrices V;
   
   Vector<t_complex> K;
 
-  void unprecondition(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Matrix<t_complex> &Tmat, Matrix<t_complex> &RgQ) const {
+  //! \brief Preconditioned unknowns of the guess of incidence i, empty if there is none
+  //! \details Undoes convertIndirect, one T-matrix at a time.
+  Vector<t_complex> preconditioned_guess(Eigen::Index i, Matrix<t_complex> const &Tmat) const {
+    auto const N = Tmat.rows();
+    if(i >= guess_.cols() or guess_.rows() != Tmat.cols())
+      return Vector<t_complex>();
+    Vector<t_complex> result(guess_.rows());
+    for(Eigen::Index ii = 0; ii < guess_.rows() / N; ++ii)
+      result.segment(ii * N, N) =
+          Tmat.block(0, ii * N, N, N).partialPivLu().solve(guess_.col(i).segment(ii * N, N));
+    return result;
+  }
+  //! Preconditioned unknowns of the SH guess of incidence i, empty if there is none
+  Vector<t_complex> preconditioned_guess_SH(Eigen::Index i, Eigen::Index rows) const {
+    if(i >= guess_SH_.cols() or guess_SH_.rows() != rows)
+      return Vector<t_complex>();
+    return guess_SH_.col(i);
+  }
+
+  void unprecondition(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Matrix<t_complex> const &Tmat, Matrix<t_complex> const &RgQ) const {
     X_sca_ = AbstractSolver::convertIndirect(X_sca_, Tmat);
     X_int_ = AbstractSolver::solveInternal(X_sca_, RgQ);
     }
      
     
-    void unprecondition_SH(Vector<t_complex> &X_sca_SH, Vector<t_complex> &X_int_SH, Vector<t_complex> &K1, Matrix<t_complex> &RgQ) const {
+    void unprecondition_SH(Vector<t_complex> &X_sca_SH, Vector<t_complex> &X_int_SH, Vector<t_complex> &K1, Matrix<t_complex> const &RgQ) const {
     X_sca_SH = AbstractSolver::convertIndirect_SH_outer(X_sca_SH);
     X_int_SH = AbstractSolver::solveInternal_SH(X_sca_SH, K1, RgQ);
     
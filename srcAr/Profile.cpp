@@ -0,0 +1,393 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Profile.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <set>
+#if defined(OPTIMET_CALIPER)
+#include <caliper/cali.h>
+#elif defined(OPTIMET_SCOREP)
+#include <scorep/SCOREP_User.h>
+#elif defined(OPTIMET_NVTX)
+#include <nvToolsExt.h>
+#elif defined(OPTIMET_ITT)
+#include <ittnotify.h>
+#endif
+#ifdef OPTIMET_PAPI
+#include <papi.h>
+#endif
+
+namespace optimet {
+namespace {
+//! Total and number of additions of a region, counter or record
+struct Entry {
+  ProfileSummary::Kind kind;
+  t_real calls;
+  t_real total;
+};
+
+std::map<std::string, Entry> &entries() {
+  static std::map<std::string, Entry> entries;
+  return entries;
+}
+
+//! The names of the regions entered and not yet left, the innermost last
+std::vector<std::string const *> &open_regions() {
+  static std::vector<std::string const *> regions;
+  return regions;
+}
+
+void add(std::string const &name, ProfileSummary::Kind kind, t_real amount) {
+  auto &entry = entries().emplace(name, Entry{kind, 0, 0}).first->second;
+  entry.calls += 1;
+  entry.total = kind == ProfileSummary::memory ? std::max(entry.total, amount) :
+                                                 entry.total + amount;
+}
+
+//! A field of /proc/self/status in MB, zero if missing, e.g. on other systems than Linux
+t_real status(std::string const &field) {
+  std::ifstream file("/proc/self/status");
+  std::string name;
+  t_real kB;
+  while(file >> name) {
+    if(name == field and file >> kB)
+      return kB / 1024;
+    file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+#ifdef OPTIMET_ITT
+__itt_domain *domain() {
+  static __itt_domain *const domain = __itt_domain_create("Optimet");
+  return domain;
+}
+#endif
+
+#ifdef OPTIMET_PAPI
+//! A hardware event, the suffix of its counters and the bytes of each count
+struct Event {
+  int code;
+  char const *name;
+  t_real scale;
+};
+//! \brief The events of the regions, those missing here being left out
+//! \details The misses of the last level cache stand for the DRAM traffic, a line of 64 bytes each.
+Event const events[] = {{PAPI_DP_OPS, "flops", 1},
+                        {PAPI_L3_TCM, "DRAM bytes", 64},
+                        {PAPI_VEC_DP, "vector instructions", 1},
+                        {PAPI_TOT_INS, "instructions", 1}};
+
+//! The event set of the main thread, counting from the first region on
+struct Counters {
+  int set = PAPI_NULL;
+  std::vector<Event> counted;
+  Counters() {
+    if(PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT or
+       PAPI_create_eventset(&set) != PAPI_OK)
+      return;
+    for(auto const &event : events)
+      if(PAPI_add_event(set, event.code) == PAPI_OK)
+        counted.push_back(event);
+    if(not counted.empty() and PAPI_start(set) != PAPI_OK)
+      counted.clear();
+  }
+};
+
+Counters &counters() {
+  static Counters counters;
+  return counters;
+}
+
+std::vector<long long> read_counters() {
+  auto &counters = optimet::counters();
+  std::vector<long long> result(counters.counted.size(), 0);
+  if(not result.empty() and PAPI_read(counters.set, result.data()) != PAPI_OK)
+    std::fill(result.begin(), result.end(), 0);
+  return result;
+}
+#endif
+
+//! Enters a region in the timeline of the external profiler, if built with one
+void external_begin(std::string const &name) {
+#if defined(OPTIMET_CALIPER)
+  cali_begin_region(name.c_str());
+#elif defined(OPTIMET_SCOREP)
+  SCOREP_USER_REGION_BY_NAME_BEGIN(name.c_str(), SCOREP_USER_REGION_TYPE_COMMON)
+#elif defined(OPTIMET_NVTX)
+  nvtxRangePushA(name.c_str());
+#elif defined(OPTIMET_ITT)
+  __itt_task_begin(domain(), __itt_null, __itt_null, __itt_string_handle_create(name.c_str()));
+#else
+  (void)name;
+#endif
+}
+
+//! Leaves the innermost region in the timeline of the external profiler, if built with one
+void external_end(std::string const &name) {
+#if defined(OPTIMET_CALIPER)
+  cali_end_region(name.c_str());
+#elif defined(OPTIMET_SCOREP)
+  SCOREP_USER_REGION_BY_NAME_END(name.c_str())
+#elif defined(OPTIMET_NVTX)
+  (void)name;
+  nvtxRangePop();
+#elif defined(OPTIMET_ITT)
+  (void)name;
+  __itt_task_end(domain());
+#else
+  (void)name;
+#endif
+}
+}
+
+Profile::Region::Region(std::string name)
+    : name_(std::move(name)), start_(std::chrono::steady_clock::now()) {
+  open_regions().push_back(&name_);
+  external_begin(name_);
+#ifdef OPTIMET_PAPI
+  counters_ = read_counters();
+#endif
+}
+
+Profile::Region::~Region() {
+  external_end(name_);
+  open_regions().pop_back();
+#ifdef OPTIMET_PAPI
+  auto const end = read_counters();
+  for(std::size_t i = 0; i < end.size() and i < counters_.size(); ++i)
+    count(name_ + " " + counters().counted[i].name,
+          static_cast<t_real>(end[i] - counters_[i]) * counters().counted[i].scale);
+#endif
+  time(name_, std::chrono::duration<t_real>(std::chrono::steady_clock::now() - start_).count());
+  add(name_ + " RSS", ProfileSummary::memory, resident());
+}
+
+void Profile::time(std::string const &name, t_real seconds) {
+  add(name, ProfileSummary::region, seconds);
+}
+
+std::string Profile::current() {
+  return open_regions().empty() ? std::string() : *open_regions().back();
+}
+
+void Profile::count(std::string const &name, t_real amount) {
+  add(name, ProfileSummary::counter, amount);
+}
+
+void Profile::memory(std::string const &name, t_real bytes) {
+  add(name, ProfileSummary::memory, bytes / (1024 * 1024));
+}
+
+t_real Profile::resident() { return status("VmRSS:"); }
+
+t_real Profile::peak_resident() { return status("VmHWM:"); }
+
+void Profile::clear() { entries().clear(); }
+
+std::vector<ProfileSummary> Profile::summary() {
+  add("peak RSS", ProfileSummary::memory, peak_resident());
+  std::vector<ProfileSummary> result;
+  for(auto const &entry : entries()) {
+    auto const total = entry.second.total;
+    result.push_back({entry.first, entry.second.kind, entry.second.calls, total, total, total,
+                      std::vector<t_real>()});
+    if(entry.second.kind == ProfileSummary::memory)
+      result.back().ranks.push_back(total);
+  }
+  return result;
+}
+
+#ifdef OPTIMET_MPI
+std::vector<ProfileSummary> Profile::summary(mpi::Communicator const &communicator) {
+  if(communicator.size() == 1)
+    return summary();
+  add("peak RSS", ProfileSummary::memory, peak_resident());
+
+  // the names known to any process, each ending with a newline
+  std::string names;
+  for(auto const &entry : entries())
+    names += entry.first + '\n';
+  int const length = names.size();
+  std::vector<int> lengths(communicator.size()), displs(communicator.size() + 1, 0);
+  MPI_Allgather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, *communicator);
+  for(t_uint r = 0; r < communicator.size(); ++r)
+    displs[r + 1] = displs[r] + lengths[r];
+  std::string all(displs.back(), '\0');
+  MPI_Allgatherv(&names[0], length, MPI_CHAR, &all[0], lengths.data(), displs.data(), MPI_CHAR,
+                 *communicator);
+  std::set<std::string> known;
+  for(std::size_t first = 0, last; first < all.size(); first = last + 1) {
+    last = all.find('\n', first);
+    known.emplace(all, first, last - first);
+  }
+
+  // the totals of this process in the order of the names
+  auto const n = known.size();
+  std::vector<t_real> kind(n, 0), calls(n, 0), totals(n, 0);
+  std::size_t i = 0;
+  for(auto const &name : known) {
+    auto const found = entries().find(name);
+    if(found != entries().end()) {
+      kind[i] = found->second.kind;
+      calls[i] = found->second.calls;
+      totals[i] = found->second.total;
+    }
+    ++i;
+  }
+  std::vector<t_real> minima(totals), maxima(totals), sums(totals);
+  MPI_Allreduce(MPI_IN_PLACE, kind.data(), n, MPI_DOUBLE, MPI_MAX, *communicator);
+  MPI_Allreduce(MPI_IN_PLACE, calls.data(), n, MPI_DOUBLE, MPI_MAX, *communicator);
+  MPI_Allreduce(MPI_IN_PLACE, minima.data(), n, MPI_DOUBLE, MPI_MIN, *communicator);
+  MPI_Allreduce(MPI_IN_PLACE, maxima.data(), n, MPI_DOUBLE, MPI_MAX, *communicator);
+  MPI_Allreduce(MPI_IN_PLACE, sums.data(), n, MPI_DOUBLE, MPI_SUM, *communicator);
+  // the memory of each process, rank after rank
+  std::vector<t_real> ranks(n * communicator.size());
+  MPI_Allgather(totals.data(), n, MPI_DOUBLE, ranks.data(), n, MPI_DOUBLE, *communicator);
+
+  std::vector<ProfileSummary> result;
+  i = 0;
+  for(auto const &name : known) {
+    result.push_back({name, static_cast<ProfileSummary::Kind>(static_cast<int>(kind[i])), calls[i], minima[i],
+                      sums[i] / static_cast<t_real>(communicator.size()), maxima[i],
+                      std::vector<t_real>()});
+    if(result.back().kind == ProfileSummary::memory)
+      for(t_uint r = 0; r < communicator.size(); ++r)
+        result.back().ranks.push_back(ranks[r * n + i]);
+    ++i;
+  }
+  return result;
+}
+#endif
+
+void Profile::write_table(std::ostream &stream, std::vector<ProfileSummary> const &summary) {
+  std::size_t width = 6;
+  for(auto const &entry : summary)
+    width = std::max(width, entry.name.size());
+  auto const flags = stream.flags();
+  auto const precision = stream.precision(3);
+  stream << std::left << std::setw(width) << "Region" << std::right << std::setw(10) << "calls"
+         << std::setw(12) << "min" << std::setw(12) << "avg" << std::setw(12) << "max" << "\n";
+  char const *units[] = {" s", "", " MB"};
+  for(auto const kind : {ProfileSummary::region, ProfileSummary::counter, ProfileSummary::memory})
+    for(auto const &entry : summary) {
+      if(entry.kind != kind)
+        continue;
+      stream << std::left << std::setw(width) << entry.name << std::right << std::setw(10)
+             << static_cast<t_uint>(entry.calls) << std::scientific << std::setw(12) << entry.min
+             << std::setw(12) << entry.mean << std::setw(12) << entry.max << units[kind] << "\n";
+      stream.unsetf(std::ios_base::floatfield);
+    }
+  stream.precision(precision);
+  stream.flags(flags);
+  stream.flush();
+}
+
+void Profile::write_json(std::ostream &stream, std::vector<ProfileSummary> const &summary) {
+  auto const precision = stream.precision(std::numeric_limits<t_real>::max_digits10);
+  char const *kinds[] = {"{\"regions\": {", ", \"counters\": {", ", \"memory\": {"};
+  for(auto const kind : {ProfileSummary::region, ProfileSummary::counter, ProfileSummary::memory}) {
+    stream << kinds[kind];
+    char const *separator = "";
+    for(auto const &entry : summary) {
+      if(entry.kind != kind)
+        continue;
+      stream << separator << "\"" << entry.name << "\": {\"calls\": " << entry.calls
+             << ", \"min\": " << entry.min << ", \"avg\": " << entry.mean
+             << ", \"max\": " << entry.max;
+      if(not entry.ranks.empty()) {
+        stream << ", \"ranks\": [";
+        for(std::size_t r = 0; r < entry.ranks.size(); ++r)
+          stream << (r > 0 ? ", " : "") << entry.ranks[r];
+        stream << "]";
+      }
+      stream << "}";
+      separator = ", ";
+    }
+    stream << "}";
+  }
+  stream << "}\n";
+  stream.precision(precision);
+  stream.flush();
+}
+
+void Profile::write_roofline(std::ostream &stream, std::vector<ProfileSummary> const &summary,
+                             t_real peak_gflops, t_real peak_bandwidth) {
+  std::map<std::string, t_real> counters;
+  for(auto const &entry : summary)
+    if(entry.kind == ProfileSummary::counter)
+      counters[entry.name] = entry.mean;
+  auto const counter = [&counters](std::string const &name) {
+    auto const found = counters.find(name);
+    return found == counters.end() ? 0 : found->second;
+  };
+  auto const counted = [&counters](ProfileSummary const &entry) {
+    return entry.kind == ProfileSummary::region and counters.count(entry.name + " flops") > 0;
+  };
+  std::size_t width = 6;
+  bool any = false;
+  for(auto const &entry : summary)
+    if(counted(entry)) {
+      width = std::max(width, entry.name.size());
+      any = true;
+    }
+  if(not any)
+    return;
+
+  bool const peaks = peak_gflops > 0 and peak_bandwidth > 0;
+  auto const flags = stream.flags();
+  auto const precision = stream.precision(3);
+  stream << std::left << std::setw(width) << "Region" << std::right << std::setw(12) << "flop/byte"
+         << std::setw(12) << "GFLOP/s" << std::setw(12) << "GB/s" << std::setw(10) << "vector";
+  if(peaks)
+    stream << std::setw(10) << "bound" << std::setw(10) << "of roof";
+  stream << "\n";
+  for(auto const &entry : summary) {
+    if(not counted(entry))
+      continue;
+    auto const flops = counter(entry.name + " flops");
+    auto const bytes = counter(entry.name + " DRAM bytes");
+    auto const instructions = counter(entry.name + " instructions");
+    auto const seconds = entry.mean > 0 ? entry.mean : 1;
+    auto const intensity = bytes > 0 ? flops / bytes : std::numeric_limits<t_real>::infinity();
+    auto const gflops = flops / seconds / 1e9;
+    stream << std::left << std::setw(width) << entry.name << std::right << std::scientific
+           << std::setw(12) << intensity << std::setw(12) << gflops << std::setw(12)
+           << bytes / seconds / 1e9;
+    stream.unsetf(std::ios_base::floatfield);
+    if(instructions > 0 and counters.count(entry.name + " vector instructions"))
+      stream << std::setw(9) << std::fixed << std::setprecision(1)
+             << 100 * counter(entry.name + " vector instructions") / instructions << "%";
+    else
+      stream << std::setw(10) << "-";
+    if(peaks) {
+      auto const roof = std::min(peak_gflops, peak_bandwidth * intensity);
+      stream << std::setw(10) << (intensity < peak_gflops / peak_bandwidth ? "memory" : "compute")
+             << std::setw(9) << std::fixed << std::setprecision(1) << 100 * gflops / roof << "%";
+    }
+    stream.unsetf(std::ios_base::floatfield);
+    stream.precision(3);
+    stream << "\n";
+  }
+  stream.precision(precision);
+  stream.flags(flags);
+  stream.flush();
+}
+}
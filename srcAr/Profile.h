@@ -0,0 +1,117 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_PROFILE_H
+#define OPTIMET_PROFILE_H
+
+#include "Types.h"
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef OPTIMET_MPI
+#include "mpi/Communicator.h"
+#endif
+
+namespace optimet {
+
+//! Totals of a region, counter or memory record over the processes
+struct ProfileSummary {
+  //! What the totals measure
+  enum Kind { region, counter, memory };
+  std::string name;  /**< The name of the region, counter or memory record. */
+  Kind kind;         /**< Seconds of a region, sum of a counter or largest MB of a record. */
+  t_real calls;      /**< The most times a process entered the region or added to the record. */
+  t_real min;        /**< The smallest total of a process. */
+  t_real mean;       /**< The average total of the processes. */
+  t_real max;        /**< The largest total of a process. */
+  std::vector<t_real> ranks; /**< The total of each process, for the memory records. */
+};
+
+/**
+ * The Profile class gathers the time a process spends in the named regions
+ * of a simulation, e.g. the integration of the T-matrices, and the named
+ * counters they add to, until they are cleared. The regions nest, each
+ * holding the time of those within it. The memory records keep the largest
+ * size they were given, e.g. of the T-matrices, and the resident memory of
+ * the process when leaving each region. The registry is that of the process,
+ * and is not meant for the threads of a parallel loop: the regions are timed
+ * around the loops. When built with an external profiler, the regions are
+ * also entered and left in its timeline.
+ */
+class Profile {
+public:
+  //! \brief Adds the time from its construction to its destruction to a region
+  //! \details The resident memory at its destruction goes to the record "<name> RSS". When built
+  //! with PAPI, the hardware events of the calling thread go to the counters "<name> flops",
+  //! "<name> DRAM bytes", "<name> vector instructions" and "<name> instructions".
+  class Region {
+  public:
+    explicit Region(std::string name);
+    Region(Region const &) = delete;
+    Region &operator=(Region const &) = delete;
+    ~Region();
+
+  private:
+    //! The name of the region
+    std::string name_;
+    //! When the region was entered
+    std::chrono::steady_clock::time_point start_;
+#ifdef OPTIMET_PAPI
+    //! The hardware counters when the region was entered
+    std::vector<long long> counters_;
+#endif
+  };
+
+  //! Adds seconds spent in a region
+  static void time(std::string const &name, t_real seconds);
+  //! The innermost region entered and not yet left, empty outside any region
+  static std::string current();
+  //! Adds to a counter
+  static void count(std::string const &name, t_real amount = 1);
+  //! Records a size in bytes, keeping the largest in MB
+  static void memory(std::string const &name, t_real bytes);
+  //! Resident memory of the process in MB, zero if not known
+  static t_real resident();
+  //! Largest resident memory of the process so far in MB, zero if not known
+  static t_real peak_resident();
+  //! Forgets the regions, counters and records
+  static void clear();
+
+  //! \brief The totals of this process, by name
+  //! \details The records include the peak resident memory of the process so far.
+  static std::vector<ProfileSummary> summary();
+#ifdef OPTIMET_MPI
+  //! \brief The totals over the processes of a communicator, by name
+  //! \details Collective: every process gets the smallest, average and largest totals, a
+  //! process which never entered a region counting as zero.
+  static std::vector<ProfileSummary> summary(mpi::Communicator const &communicator);
+#endif
+
+  //! Writes the totals as a table, one line per region, counter or record
+  static void write_table(std::ostream &stream, std::vector<ProfileSummary> const &summary);
+  //! Writes the totals as a JSON object
+  static void write_json(std::ostream &stream, std::vector<ProfileSummary> const &summary);
+  //! \brief Writes where the regions counting flops stand on the roofline of a process
+  //! \details Their arithmetic intensity, flop and DRAM rates and share of vector instructions,
+  //! averaged over the processes. Given the peak GFLOP/s and GB/s of a process, also whether each
+  //! is bound by memory or compute and the fraction of the roof it reaches. Nothing without flops.
+  static void write_roofline(std::ostream &stream, std::vector<ProfileSummary> const &summary,
+                             t_real peak_gflops = 0, t_real peak_bandwidth = 0);
+};
+}
+#endif
@@ -0,0 +1,120 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "RadialTable.h"
+#include "constants.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace optimet {
+
+RadialTable::RadialTable(BESSEL_TYPE type, t_complex waveK, t_real rmin, t_real rmax,
+                         long int max_order, t_real tolerance)
+    : type_(type), waveK_(waveK), max_order_(max_order) {
+  if(not(rmax > rmin) or rmin < 0 or (type != Bessel and rmin <= 0))
+    throw std::runtime_error("The interval of a radial table should be increasing, and above "
+                             "zero for Hankel functions");
+  starts_.push_back(rmin);
+  // segments narrower than this are left to the functions
+  fit(rmin, rmax, (rmax - rmin) / 65536, tolerance);
+}
+
+void RadialTable::fit(t_real a, t_real b, t_real width, t_real tolerance) {
+  // the functions at the Chebyshev nodes of the segment, by node and order
+  t_uint const orders = max_order_ + 1;
+  std::vector<t_complex> f(degree * orders), df(degree * orders);
+  BesselWorkspace workspace;
+  for(t_uint j = 0; j < degree; ++j) {
+    t_real const x = std::cos(consPi * (j + 0.5) / degree);
+    auto const &values = bessel(waveK_ * (0.5 * (a + b) + 0.5 * (b - a) * x), type_, false,
+                                max_order_, workspace);
+    std::copy(values.data.begin(), values.data.begin() + orders, f.begin() + j * orders);
+    std::copy(values.ddata.begin(), values.ddata.begin() + orders, df.begin() + j * orders);
+  }
+
+  // the coefficients of each order, functions then derivatives, and whether the last two are
+  // small enough
+  std::vector<t_complex> c(2 * orders * degree);
+  bool converged = true;
+  for(t_uint g = 0; g < 2; ++g)
+    for(t_uint n = 0; n < orders; ++n) {
+      auto const &values = g == 0 ? f : df;
+      t_real scale = type_ == Bessel ? 0 : std::numeric_limits<t_real>::max();
+      for(t_uint j = 0; j < degree; ++j)
+        scale = type_ == Bessel ? std::max(scale, std::abs(values[j * orders + n])) :
+                                  std::min(scale, std::abs(values[j * orders + n]));
+      t_complex *const cn = &c[(g * orders + n) * degree];
+      for(t_uint k = 0; k < degree; ++k) {
+        t_complex sum(0, 0);
+        for(t_uint j = 0; j < degree; ++j)
+          sum += values[j * orders + n] * std::cos(consPi * k * (j + 0.5) / degree);
+        cn[k] = (k == 0 ? 1.0 : 2.0) / degree * sum;
+      }
+      if(std::abs(cn[degree - 2]) + std::abs(cn[degree - 1]) > tolerance * scale)
+        converged = false;
+    }
+
+  if(not converged and b - a > width) {
+    fit(a, 0.5 * (a + b), width, tolerance);
+    fit(0.5 * (a + b), b, width, tolerance);
+    return;
+  }
+  starts_.push_back(b);
+  offsets_.push_back(converged ? static_cast<long int>(coefficients_.size()) : -1);
+  if(converged)
+    coefficients_.insert(coefficients_.end(), c.begin(), c.end());
+}
+
+std::vector<std::size_t> RadialTable::operator()(t_real const *r, std::size_t count,
+                                                 long int max_order, t_complex *data,
+                                                 t_complex *ddata) const {
+  if(max_order > max_order_)
+    throw std::runtime_error("The radial table does not reach the requested order");
+  std::vector<std::size_t> misses;
+  t_uint const orders = max_order_ + 1;
+  for(std::size_t i = 0; i < count; ++i) {
+    if(r[i] < starts_.front() or r[i] > starts_.back()) {
+      misses.push_back(i);
+      continue;
+    }
+    auto const s = std::min<std::size_t>(
+        std::upper_bound(starts_.begin(), starts_.end(), r[i]) - starts_.begin() - 1,
+        segments() - 1);
+    if(offsets_[s] < 0) {
+      misses.push_back(i);
+      continue;
+    }
+    t_real const a = starts_[s], b = starts_[s + 1];
+    t_real const t = (2 * r[i] - a - b) / (b - a);
+    // Clenshaw's recurrence of each order, functions then derivatives
+    for(t_uint g = 0; g < 2; ++g)
+      for(long int n = 0; n <= max_order; ++n) {
+        t_complex const *const cn = &coefficients_[offsets_[s] + (g * orders + n) * degree];
+        t_complex b1(0, 0), b2(0, 0);
+        for(t_uint k = degree - 1; k > 0; --k) {
+          t_complex const b0 = 2 * t * b1 - b2 + cn[k];
+          b2 = b1;
+          b1 = b0;
+        }
+        (g == 0 ? data : ddata)[n * count + i] = t * b1 - b2 + cn[0];
+      }
+  }
+  return misses;
+}
+
+} // namespace optimet
@@ -0,0 +1,91 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_RADIAL_TABLE_H
+#define OPTIMET_RADIAL_TABLE_H
+
+#include "Bessel.h"
+#include "Types.h"
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The RadialTable class interpolates the spherical Bessel or Hankel functions
+ * z_n(k r) of one wave number, and their derivatives, over an interval of
+ * distances. The interval is cut into segments by bisection until the
+ * Chebyshev expansion of every order on each segment converges to the
+ * tolerance, relative to the largest value of the order on the segment for
+ * Bessel functions and to the smallest for Hankel functions, which have no
+ * zeros. A segment that does not converge at the finest width is left to the
+ * functions themselves, as are the distances outside the interval.
+ */
+class RadialTable {
+public:
+  /**
+   * Initialization constructor for the RadialTable class.
+   * @param type the functions, Bessel or Hankel of the first or second kind.
+   * @param waveK the wave number.
+   * @param rmin the smallest distance of the interval, above zero for Hankel functions.
+   * @param rmax the largest distance of the interval.
+   * @param max_order the largest order of the functions.
+   * @param tolerance the relative accuracy of the interpolation.
+   */
+  RadialTable(BESSEL_TYPE type, t_complex waveK, t_real rmin, t_real rmax, long int max_order,
+              t_real tolerance);
+
+  //! The type of the functions
+  BESSEL_TYPE type() const { return type_; }
+  //! The wave number
+  t_complex waveK() const { return waveK_; }
+  //! The largest order of the functions
+  long int max_order() const { return max_order_; }
+  //! Number of segments, including those left to the functions
+  t_uint segments() const { return static_cast<t_uint>(starts_.size()) - 1; }
+
+  /**
+   * Interpolates the functions and derivatives of the distances r, as bessel_batch of k r.
+   * @param r the distances.
+   * @param count the number of distances.
+   * @param max_order the maximum order, at most that of the table.
+   * @param data the functions, data[n * count + i] of order n at r[i].
+   * @param ddata the derivatives with respect to k r, as data.
+   * @return the indices of the distances the table does not cover, whose values are left as is.
+   */
+  std::vector<std::size_t> operator()(t_real const *r, std::size_t count, long int max_order,
+                                      t_complex *data, t_complex *ddata) const;
+
+private:
+  //! Number of Chebyshev coefficients of each function on a segment
+  static constexpr t_uint degree = 16;
+
+  //! \brief Fits the segment [a, b], or bisects it while it does not converge
+  void fit(t_real a, t_real b, t_real width, t_real tolerance);
+
+  BESSEL_TYPE type_;
+  t_complex waveK_;
+  long int max_order_;
+  //! Bounds of the segments, one more than the segments
+  std::vector<t_real> starts_;
+  //! \brief Offsets of the coefficients of each segment, -1 if left to the functions
+  //! \details degree coefficients for each order of the functions, then as many for the
+  //! derivatives
+  std::vector<long int> offsets_;
+  std::vector<t_complex> coefficients_;
+};
+
+} // namespace optimet
+
+#endif
@@ -20,14 +20,24 @@
 #include <fstream>
 #include "Cartesian.h"
 #include "Geometry.h"
+#include "MaterialTable.h"
+#include "ParticleTable.h"
 #include "Scatterer.h"
 #include "Spherical.h"
 #include "Tools.h"
 #include "constants.h"
+#include "mpi/Collectives.h"
 #include "mpi/Communicator.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <map>
+#include <set>
+#include <sstream>
 #include <stdexcept>
 #include <tuple>
 #include <vector>
@@ -43,13 +53,18 @@ namespace optimet {
 namespace {
 std::shared_ptr<Geometry> read_geometry(pugi::xml_document const &node);
 Scatterer read_scatterer(pugi::xml_node const &node, t_int nMax, t_int nMaxS);
+std::shared_ptr<std::vector<Scatterer> const> read_motif(pugi::xml_node const &node, t_int nMax);
+Scatterer read_motif_object(
+    pugi::xml_node const &node,
+    std::map<std::string, std::shared_ptr<std::vector<Scatterer> const>> const &motifs, t_int nMax,
+    t_int nMaxS);
 std::shared_ptr<Geometry> read_structure(pugi::xml_node const &inputFile, t_int nMax, t_int nMaxS);
 std::shared_ptr<Excitation> read_excitation(pugi::xml_document const &inputFile, t_int nMax, ElectroMagnetic &bground);
 scalapack::Parameters read_parallel(const pugi::xml_node &node);
 #ifdef OPTIMET_BELOS
 Teuchos::RCP<Teuchos::ParameterList> read_parameter_list(pugi::xml_document const &root_node);
-std::tuple<bool, t_int> read_fmm_input(pugi::xml_node const &node);
 #endif
+std::tuple<bool, t_int> read_fmm_input(pugi::xml_node const &node);
 Run simulation_input(pugi::xml_document const &inputFile);
 
 std::shared_ptr<Geometry> read_geometry(pugi::xml_document const &inputFile) {
@@ -71,9 +86,17 @@ std::shared_ptr<Geometry> read_geometry(pugi::xml_document const &inputFile) {
 
   auto result = std::make_shared<Geometry>();
 
+  // groups of particles solved once for their T-matrix, then placed as single objects
+  std::map<std::string, std::shared_ptr<std::vector<Scatterer> const>> motifs;
+  for(xml_node node = geo_node.child("motif"); node; node = node.next_sibling("motif"))
+    motifs[node.attribute("name").value()] = read_motif(node, nMax);
+
   // Find all scattering objects
   for(xml_node node = geo_node.child("object"); node; node = node.next_sibling("object")){
-    result->pushObject(read_scatterer(node, nMax, nMaxS));
+    if(node.attribute("type").value() == std::string("motif"))
+      result->pushObject(read_motif_object(node, motifs, nMax, nMaxS));
+    else
+      result->pushObject(read_scatterer(node, nMax, nMaxS));
    }
 
   // Add the background properties
@@ -116,6 +139,40 @@ std::shared_ptr<Geometry> read_structure(xml_node const &geo_node_, t_int nMax,
   }
   
   
+  // copies of the objects of the structure, each particle a row of a table read in bulk
+  if(!std::strcmp(struct_node.attribute("type").value(), "table")) {
+    std::vector<Scatterer> kinds;
+    for(xml_node node = struct_node.child("object"); node; node = node.next_sibling("object"))
+      kinds.push_back(read_scatterer(node, nMax, nMaxS));
+    if(kinds.empty())
+      throw std::runtime_error("A table structure needs an object for each type of particle");
+    auto const table = optimet::ParticleTable::load(struct_node.attribute("file").value());
+    auto const &positions = table->positions();
+    auto const &orientations = table->orientations();
+    geometry->objects.reserve(table->size());
+    for(t_uint i = 0; i < table->size(); ++i) {
+      auto const type = table->types().empty() ? 0 : table->types()[i];
+      if(type < 0 or type >= static_cast<int>(kinds.size()))
+        throw std::runtime_error("Particle " + std::to_string(i) + " of the table has type " +
+                                 std::to_string(type) + ", with no object for it");
+      auto particle = kinds[type];
+      particle.vR = Tools::toSpherical(Cartesian<double>{positions[3 * i] * consFrnmTom,
+                                                         positions[3 * i + 1] * consFrnmTom,
+                                                         positions[3 * i + 2] * consFrnmTom});
+      // the radius of a meshed particle is that of its mesh
+      if(not table->radii().empty()) {
+        if(particle.scatterer_type != "sphere")
+          throw std::runtime_error("Only the spheres of a particle table have radii of their own");
+        particle.radius = table->radii()[i] * consFrnmTom;
+      }
+      if(not orientations.empty())
+        particle.orientation = {{orientations[3 * i] * consPi / 180.0,
+                                 orientations[3 * i + 1] * consPi / 180.0,
+                                 orientations[3 * i + 2] * consPi / 180.0}};
+      geometry->pushObject(particle);
+    }
+  }
+
   //assembly of particles into a cube
   if(!std::strcmp(struct_node.attribute("type").value(), "cube")) {
     // Build a cube of scatterers with a corner in origin
@@ -654,6 +711,21 @@ Scatterer read_scatterer(pugi::xml_node const &node, t_int nMax, t_int nMaxS) {
      result.elmag.initSiliconModel_r(aux_mu);  
  }
     
+    else if(node.child("epsilon").attribute("type").value() == std::string("Tabulated")) {
+      // Permittivity tabulated against the wavelength in a file, shared by the objects using it
+      std::complex<double> ksippp(node.child("ksippp").attribute("value.real").as_double(),
+                                  node.child("ksippp").attribute("value.imag").as_double());
+      std::complex<double> ksiparppar(node.child("ksiparppar").attribute("value.real").as_double(),
+                                      node.child("ksiparppar").attribute("value.imag").as_double());
+      std::complex<double> gamma(node.child("gamma").attribute("value.real").as_double(),
+                                 node.child("gamma").attribute("value.imag").as_double());
+
+      result.elmag.init_r(0.0, aux_mu, 0.0, 0.0, 0.0, 0.0);
+      result.elmag.initTabulatedModel_r(
+          optimet::MaterialTable::load(node.child("epsilon").attribute("file").value()), aux_mu,
+          ksippp, ksiparppar, gamma);
+    }
+
       else
       throw std::runtime_error("Unknown type for epsilon");
   }
@@ -680,58 +752,33 @@ else if(node.attribute("type").value() == std::string("arbitrary.shape")){
     if(node.child("properties").attribute("radius"))
     result.radius = node.child("properties").attribute("radius").as_double() * consFrnmTom; // radius of the circumscribed sphere
 
-    // reading the mesh data
-    std::string tpl = "meshlib/topol_";
-    std::string crd = "meshlib/coord_";
-    std::string restpl, rescrd;
-    
-    restpl = tpl + dimens;
-    rescrd = crd + dimens;
-    restpl = restpl + ".txt";
-    rescrd = rescrd + ".txt";
-    
-    std::ifstream file1(rescrd); // coordinates of the vertices
-    std::ifstream file2(restpl); // vertices forming a triangle in a counterclockwise manner
- 
-        std::vector<double> coord;
-	std::vector<int> topol;
-
-
-	double num1 = 0;
-	int num2 = 0;
-    
-    if (file1.is_open()) {	
-	while (file1 >> num1) {
-		coord.emplace_back(num1);
-		
-	}
-
-	while (file2 >> num2) {
-		topol.emplace_back(num2);
-	}
-
-
-	
-	file1.clear();
-	file1.seekg(0, std::ios::beg);
-	
-	file2.clear();
-	file2.seekg(0, std::ios::beg);  // go to the beginning of files
-        
-
-	for (int i = 0; i < topol.size(); ++i) {
-		topol[i] = topol[i] - 1;
-    
-	}
-        
-        result.Mesh(coord, topol);
-        
-       }// if the mesh exists in library
-
-     else{
-    std::ostringstream sstr;
-    sstr << "This mesh does not exist in the library, please create it and name it accordingly";
-    throw std::runtime_error(sstr.str()); }
+    // z-y-z Euler angles in degrees of the mesh in the laboratory frame
+    if(auto const orientation = node.child("orientation"))
+      result.orientation = {{orientation.attribute("alpha").as_double() * consPi / 180.0,
+                             orientation.attribute("beta").as_double() * consPi / 180.0,
+                             orientation.attribute("gamma").as_double() * consPi / 180.0}};
+
+    // the mesh data, shared with the other objects of the same dims
+    // the quadrature on each triangle is exact up to degree 3 unless asked otherwise
+    int const degree = node.child("quadrature") ? node.child("quadrature").attribute("degree").as_int() : 3;
+    if(degree < 1 or degree > 8)
+      throw std::runtime_error("The degree of the triangle quadrature must be between 1 and 8");
+    if(node.child("symmetry").attribute("type").value() == std::string("revolution")) {
+      // enough meridians for the products of the FF fields with the SH functions
+      int const most = std::max(nMax, nMaxS);
+      int const contour = node.child("symmetry").attribute("points").as_int(4 * most);
+      result.Revolution(optimet::MeshFile::load(dimens), contour, 2 * nMax + nMaxS + 1);
+    } else if(node.child("symmetry").attribute("type").value() == std::string("rotation")) {
+      // the rotations by 2 pi / order about z, and the mirror in z = 0 if asked
+      int const order = node.child("symmetry").attribute("order").as_int(1);
+      if(order < 1)
+        throw std::runtime_error("The order of the rotations of a particle must be positive");
+      bool const mirror = node.child("symmetry").attribute("mirror").value() == std::string("yes");
+      result.Mesh(optimet::MeshFile::load(dimens), degree, order, mirror);
+    } else if(node.child("symmetry"))
+      throw std::runtime_error("Unknown symmetry of a particle");
+    else
+      result.Mesh(optimet::MeshFile::load(dimens), degree);
 
        if(node.child("epsilon") || node.child("mu")) {
     
@@ -785,15 +832,86 @@ else if(node.attribute("type").value() == std::string("arbitrary.shape")){
 
     }
     
+    else if(node.child("epsilon").attribute("type").value() == std::string("Tabulated")) {
+      // Permittivity tabulated against the wavelength in a file, shared by the objects using it
+      std::complex<double> ksippp(node.child("ksippp").attribute("value.real").as_double(),
+                                  node.child("ksippp").attribute("value.imag").as_double());
+      std::complex<double> ksiparppar(node.child("ksiparppar").attribute("value.real").as_double(),
+                                      node.child("ksiparppar").attribute("value.imag").as_double());
+      std::complex<double> gamma(node.child("gamma").attribute("value.real").as_double(),
+                                 node.child("gamma").attribute("value.imag").as_double());
+
+      result.elmag.init_r(0.0, aux_mu, 0.0, 0.0, 0.0, 0.0);
+      result.elmag.initTabulatedModel_r(
+          optimet::MaterialTable::load(node.child("epsilon").attribute("file").value()), aux_mu,
+          ksippp, ksiparppar, gamma);
+    }
+
       else
       throw std::runtime_error("Unknown type for epsilon");
   }
  
 }
 
+  // a smaller particle may be truncated below the harmonics of the simulation
+  if(auto const harmonics = node.child("harmonics")) {
+    result.order = harmonics.attribute("nmax").as_int();
+    if(result.order < 1 or result.order > nMax)
+      throw std::runtime_error("The harmonics of an object must be between 1 and those of the simulation");
+  }
   return result;
 };
 
+//! The particles of a motif about its centre, at the harmonics of the motif
+std::shared_ptr<std::vector<Scatterer> const> read_motif(pugi::xml_node const &node, t_int nMax) {
+  auto const order = node.attribute("nmax").as_int(nMax);
+  if(order < 1 or order > nMax)
+    throw std::runtime_error("The harmonics of a motif must be between 1 and those of the simulation");
+  auto result = std::make_shared<std::vector<Scatterer>>();
+  for(xml_node object = node.child("object"); object; object = object.next_sibling("object")) {
+    std::string const type = object.attribute("type").value();
+    if(type != "sphere" and type != "arbitrary.shape")
+      throw std::runtime_error("The objects of a motif are spheres or arbitrary shapes");
+    result->push_back(read_scatterer(object, order, order));
+  }
+  if(result->empty())
+    throw std::runtime_error("The motif " + std::string(node.attribute("name").value()) +
+                             " holds no objects");
+  return result;
+}
+
+//! A copy of a motif, centred and turned as given, within the sphere holding all its particles
+Scatterer read_motif_object(
+    pugi::xml_node const &node,
+    std::map<std::string, std::shared_ptr<std::vector<Scatterer> const>> const &motifs, t_int nMax,
+    t_int nMaxS) {
+  auto const motif = motifs.find(node.attribute("name").value());
+  if(motif == motifs.end())
+    throw std::runtime_error("Unknown motif " + std::string(node.attribute("name").value()));
+  Scatterer result(nMax, nMaxS);
+  result.scatterer_type = "motif";
+  result.particles = motif->second;
+  if(node.child("cartesian"))
+    result.vR = Tools::toSpherical(
+        Cartesian<double>{node.child("cartesian").attribute("x").as_double() * consFrnmTom,
+                          node.child("cartesian").attribute("y").as_double() * consFrnmTom,
+                          node.child("cartesian").attribute("z").as_double() * consFrnmTom});
+  else if(node.child("spherical"))
+    result.vR = {node.child("spherical").attribute("rrr").as_double() * consFrnmTom,
+                 node.child("spherical").attribute("the").as_double(),
+                 node.child("spherical").attribute("phi").as_double()};
+  else
+    result.vR = {0.0, 0.0, 0.0};
+  // z-y-z Euler angles in degrees of the motif in the laboratory frame
+  if(auto const orientation = node.child("orientation"))
+    result.orientation = {{orientation.attribute("alpha").as_double() * consPi / 180.0,
+                           orientation.attribute("beta").as_double() * consPi / 180.0,
+                           orientation.attribute("gamma").as_double() * consPi / 180.0}};
+  for(auto const &particle : *result.particles)
+    result.radius = std::max(result.radius, particle.vR.rrr + particle.radius);
+  return result;
+}
+
 std::shared_ptr<Excitation> read_excitation(pugi::xml_document const &inputFile, t_int nMax, ElectroMagnetic &bground) {
   // Find the source node
   auto const ext_node = inputFile.child("source");
@@ -843,49 +961,234 @@ std::shared_ptr<Excitation> read_excitation(pugi::xml_document const &inputFile,
   
   // Initialize and populate the excitation
   auto result = std::make_shared<optimet::Excitation>(source_type, Einc, SH_cond, vKinc, nMax, bgcoeff);
+
+  // Further incidences solved with the same scattering matrix
+  auto const orientations = ext_node.child("orientations");
+  // the analytic average needs no incidences, it is taken from the T-matrix of the cluster
+  if(orientations and std::strcmp(orientations.attribute("method").value(), "analytic")) {
+    // Gauss-Legendre in cos(theta), uniform in phi, two orthogonal polarizations
+    int const nthe = orientations.attribute("theta").as_int(8);
+    int const nphi = orientations.attribute("phi").as_int(2 * nthe);
+    if(nthe < 1 or nphi < 1)
+      throw std::runtime_error("The orientation average needs at least one angle");
+    auto const points = Tools::getLinePts(nthe);
+    auto const weights = Tools::getLineWghts(nthe);
+    for(int i = 0; i < nthe; ++i)
+      for(int j = 0; j < nphi; ++j) {
+        Spherical<double> const direction(vKinc.rrr, std::acos(points[i]), 2 * consPi * j / nphi);
+        for(auto const &polarization : {SphericalP<std::complex<double>>(0, 1, 0),
+                                        SphericalP<std::complex<double>>(0, 0, 1)})
+          result->incidences.push_back(
+              {direction,
+               Tools::toProjection(Spherical<double>(0.0, direction.the, direction.phi), polarization),
+               weights[i] / (4e0 * nphi)});
+      }
+  } else if(ext_node.child("incidence")) {
+    result->incidences.push_back({vKinc, Einc, 1e0});
+    for(xml_node node = ext_node.child("incidence"); node; node = node.next_sibling("incidence")) {
+      Spherical<double> const direction(vKinc.rrr, node.attribute("theta").as_double() * consPi / 180.0,
+                                        node.attribute("phi").as_double() * consPi / 180.0);
+      SphericalP<std::complex<double>> const polarization(
+          std::complex<double>(0.0, 0.0),
+          std::complex<double>(node.attribute("Etheta.real").as_double(),
+                               node.attribute("Etheta.imag").as_double()),
+          std::complex<double>(node.attribute("Ephi.real").as_double(),
+                               node.attribute("Ephi.imag").as_double()));
+      result->incidences.push_back(
+          {direction, Tools::toProjection(Spherical<double>(0.0, direction.the, direction.phi), polarization), 1e0});
+    }
+    for(auto &incidence : result->incidences)
+      incidence.weight /= result->incidences.size();
+  }
+  if(result->incidences.size() > 0) {
+    result->vKInc = result->incidences.front().vKInc;
+    result->Einc = result->incidences.front().Einc;
+  }
   result->populate();
 
   return result;
 }
 
+//! The bounds in m and the steps of a Cartesian grid, along x, y then z
+std::array<t_real, 9> read_grid(pugi::xml_node const &node) {
+  std::array<t_real, 9> result;
+  char const *const axes[3] = {"x", "y", "z"};
+  for(int i = 0; i < 3; ++i) {
+    result[3 * i] = node.child(axes[i]).attribute("min").as_double() * 1e-9;
+    result[3 * i + 1] = node.child(axes[i]).attribute("max").as_double() * 1e-9;
+    result[3 * i + 2] = node.child(axes[i]).attribute("steps").as_double();
+  }
+  return result;
+}
+
+//! The x, y and z attributes of a node in nm, in m
+Cartesian<t_real> read_point(pugi::xml_node const &node) {
+  return Cartesian<t_real>(node.attribute("x").as_double() * 1e-9,
+                           node.attribute("y").as_double() * 1e-9,
+                           node.attribute("z").as_double() * 1e-9);
+}
+
+//! \brief The points of a plane, line or points child of a field output, if any
+//! \details The shape of their datasets goes to the steps of run.params.
+void read_points(pugi::xml_node const &out_node, Run &run) {
+  auto points = std::make_shared<std::vector<t_real>>();
+  t_uint nu = 0, nv = 1;
+  // the points o + i u / (nu - 1) + j v / (nv - 1), i varying the fastest
+  auto const span = [&](Cartesian<t_real> const &o, Cartesian<t_real> const &u,
+                        Cartesian<t_real> const &v) {
+    for(t_uint j = 0; j < nv; ++j)
+      for(t_uint i = 0; i < nu; ++i) {
+        t_real const a = nu > 1 ? t_real(i) / (nu - 1) : 0, b = nv > 1 ? t_real(j) / (nv - 1) : 0;
+        points->insert(points->end(), {o.x + a * u.x + b * v.x, o.y + a * u.y + b * v.y,
+                                       o.z + a * u.z + b * v.z});
+      }
+  };
+  if(auto const plane = out_node.child("plane")) {
+    run.gridType = O3DPlane;
+    nu = plane.attribute("nu").as_uint(0);
+    nv = plane.attribute("nv").as_uint(0);
+    if(nu < 1 or nv < 1)
+      throw std::runtime_error("A plane of the field output needs nu and nv points");
+    span(read_point(plane.child("origin")), read_point(plane.child("u")),
+         read_point(plane.child("v")));
+  } else if(auto const line = out_node.child("line")) {
+    run.gridType = O3DLine;
+    nu = line.attribute("steps").as_uint(0);
+    if(nu < 1)
+      throw std::runtime_error("A line of the field output needs steps");
+    auto start = read_point(line.child("start")), end = read_point(line.child("end"));
+    span(start, end - start, Cartesian<t_real>(0, 0, 0));
+  } else if(auto const list = out_node.child("points")) {
+    run.gridType = O3DPointList;
+    // x, y and z in nm of each point, as doubles in the byte order of the machine
+    std::string const name = list.attribute("file").value();
+    std::ifstream file(name, std::ios::binary | std::ios::ate);
+    if(not file)
+      throw std::runtime_error("Could not open the points of the field output " + name);
+    auto const bytes = static_cast<std::size_t>(file.tellg());
+    if(bytes == 0 or bytes % (3 * sizeof(double)) != 0)
+      throw std::runtime_error("The file " + name + " should hold the x, y and z of its points");
+    points->resize(bytes / sizeof(double));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(points->data()), bytes);
+    for(auto &value : *points)
+      value *= 1e-9;
+    nu = points->size() / 3;
+  } else
+    return;
+  run.params = {{0, 0, static_cast<t_real>(nu), 0, 0, static_cast<t_real>(nv), 0, 0, 1}};
+  run.gridPoints = points;
+}
+
 void read_output(pugi::xml_document const &inputFile, Run &run) {
   // Find the source node
   auto const out_node = inputFile.child("output");
   if(!out_node)
     throw std::runtime_error("Output not defined!");
 
+  // the SH matrices, sources and solves are skipped when only the FF outputs are asked for
+  std::string const harmonics = out_node.attribute("harmonics").as_string("all");
+  if(harmonics != "all" and harmonics != "fundamental")
+    throw std::runtime_error("The harmonics of the output must be all or fundamental");
+  if(harmonics == "fundamental")
+    run.excitation->SH_cond = false;
+
   // Determine type
   if(!std::strcmp(out_node.attribute("type").value(), "coefficients"))
     run.outputType = 2;
 
   if(!std::strcmp(out_node.attribute("type").value(), "field")) {
-    run.outputType = 0;      // Field output requested
-    run.singleComponent = 0; // Set this to zero as default
-
-    run.params[0] = out_node.child("grid").child("x").attribute("min").as_double() * 1e-9;
-    run.params[1] = out_node.child("grid").child("x").attribute("max").as_double() * 1e-9;
-    run.params[2] = out_node.child("grid").child("x").attribute("steps").as_double();
-    run.params[3] = out_node.child("grid").child("y").attribute("min").as_double() * 1e-9;
-    run.params[4] = out_node.child("grid").child("y").attribute("max").as_double() * 1e-9;
-    run.params[5] = out_node.child("grid").child("y").attribute("steps").as_double();
-    run.params[6] = out_node.child("grid").child("z").attribute("min").as_double() * 1e-9;
-    run.params[7] = out_node.child("grid").child("z").attribute("max").as_double() * 1e-9;
-    run.params[8] = out_node.child("grid").child("z").attribute("steps").as_double();
+    run.outputType = 0; // Field output requested
+
+    run.params = read_grid(out_node.child("grid"));
+    // a plane, a line or a list of points rather than a regular grid
+    read_points(out_node, run);
+    // cells of the grid split down to the surfaces of the particles, and further in the gaps
+    if(auto const octree = out_node.child("grid").child("octree")) {
+      run.octreeLevels = octree.attribute("levels").as_int(0);
+      run.octreeGaps = octree.attribute("gaps").as_int(0);
+      if(run.octreeLevels < 1 or run.octreeGaps < 0)
+        throw std::runtime_error("The octree of the grid needs levels, and gaps not negative");
+      if(run.gridPoints)
+        throw std::runtime_error("An octree refines a regular grid, not a plane, line or points");
+    }
+    // points handed out at once to each process
+    run.fieldBlock = out_node.child("grid").attribute("block").as_int(64);
+    // radial functions interpolated from tables to this accuracy, computed if zero
+    run.fieldRadial = out_node.child("grid").attribute("radial").as_double(0);
+    if(run.fieldRadial < 0)
+      throw std::runtime_error("The accuracy of the radial tables cannot be negative");
+    // points computed on one side of the mirror planes only, the others being their images
+    run.fieldMirror = out_node.child("grid").attribute("mirror").value();
+    // outgoing expansions cut to the orders above this fraction at each point, all if zero
+    run.fieldPrune = out_node.child("grid").attribute("prune").as_double(0);
+    if(run.fieldPrune < 0)
+      throw std::runtime_error("The tolerance of the pruned expansions cannot be negative");
+    // VSWFs of the points summed in single precision, the Bessel functions staying double
+    run.fieldSingle = !std::strcmp(out_node.child("grid").attribute("precision").value(), "single");
+    // reductions of the fields on the processes, with or without the fields themselves
+    if(auto const statistics = out_node.child("statistics")) {
+      run.fieldStatistics = true;
+      run.fieldHotspots = statistics.attribute("hotspots").as_uint(0);
+      run.fieldBins = statistics.attribute("bins").as_uint(0);
+      run.fieldLow = statistics.attribute("low").as_double(run.fieldLow);
+      run.fieldHigh = statistics.attribute("high").as_double(run.fieldHigh);
+      run.fieldWrite = std::strcmp(statistics.attribute("grid").value(), "no");
+      if(run.fieldBins > 0 and not(run.fieldLow > 0 and run.fieldHigh > run.fieldLow))
+        throw std::runtime_error("The histogram of the statistics needs 0 < low < high");
+    }
+    // single expansion of the whole cluster outside its circumscribing sphere
+    run.clusterExpansion =
+        !std::strcmp(out_node.child("cluster").attribute("expansion").value(), "yes");
+    run.clusterOrder = out_node.child("cluster").attribute("order").as_uint(0);
+    // fields of the coefficients written by an earlier coefficients run, without a solve
+    run.coefficientsFile = out_node.child("solution").attribute("file").value();
 
     run.projection =
         !std::strcmp(out_node.child("projection").attribute("spherical").value(), "true");
 
-    run.singleMode = out_node.child("singlemode");
-
-    if(!std::strcmp(out_node.child("singlemode").attribute("dominant").value(), "auto"))
-      run.dominantAuto = true;
-    else {
-      run.dominantAuto = false;
-      run.singleModeIndex.init(out_node.child("singlemode").attribute("n").as_int(),
-                               out_node.child("singlemode").attribute("m").as_int());
-      run.singleComponent =
-          !std::strcmp(out_node.child("singlemode").attribute("component").value(), "TE");
+    // parts of the fields evaluated in the same pass, a single harmonic or the TE or TM modes
+    run.fieldParts.clear();
+    for(auto const node : out_node.children()) {
+      if(std::strcmp(node.name(), "part") and std::strcmp(node.name(), "singlemode"))
+        continue;
+      FieldPart part;
+      part.dominant = !std::strcmp(node.attribute("dominant").value(), "auto");
+      part.n = node.attribute("n").as_int(0);
+      part.m = node.attribute("m").as_int(0);
+      std::string const component = node.attribute("component").value();
+      if(component == "TE")
+        part.component = FieldPart::TE;
+      else if(component == "TM")
+        part.component = FieldPart::TM;
+      else if(component != "" and component != "both")
+        throw std::runtime_error("The component of a part of the fields must be both, TE or TM");
+      if(not part.dominant and node.attribute("n") and
+         (part.n < 1 or part.n > run.nMax or std::abs(part.m) > part.n))
+        throw std::runtime_error("The harmonic of a part of the fields needs 1 <= n <= nmax, "
+                                 "|m| <= n");
+      run.fieldParts.push_back(part);
     }
+    if(not run.fieldParts.empty() and run.clusterExpansion)
+      throw std::runtime_error("The parts of the fields need the expansions of each particle, "
+                               "not that of the cluster");
+    if(not run.fieldMirror.empty() and run.fieldMirror != "auto" and
+       (not run.fieldParts.empty() or run.projection))
+      throw std::runtime_error("The mirror planes apply to the cartesian fields, without parts");
+
+    // Chunks, filters and types of the field datasets
+    auto const storage = out_node.child("storage");
+    run.fieldStorage.chunked = storage.attribute("chunk.x") || storage.attribute("chunk.y") ||
+                               storage.attribute("chunk.z");
+    run.fieldStorage.chunk[0] = storage.attribute("chunk.x").as_uint(0);
+    run.fieldStorage.chunk[1] = storage.attribute("chunk.y").as_uint(0);
+    run.fieldStorage.chunk[2] = storage.attribute("chunk.z").as_uint(1);
+    run.fieldStorage.deflate = storage.attribute("deflate").as_uint(0);
+    run.fieldStorage.shuffle = !std::strcmp(storage.attribute("shuffle").value(), "yes");
+    run.fieldStorage.szip = !std::strcmp(storage.attribute("szip").value(), "yes");
+    run.fieldStorage.single = run.fieldSingle or
+                              !std::strcmp(storage.attribute("precision").value(), "single");
+    run.fieldStorage.compound = !std::strcmp(storage.attribute("complex").value(), "compound");
   }
 
   if(!std::strcmp(out_node.attribute("type").value(), "response")) {
@@ -917,6 +1220,64 @@ void read_output(pugi::xml_document const &inputFile, Run &run) {
 
     if(out_node.child("scan").child("wavelength") && out_node.child("scan").child("radius"))
       run.outputType = 112;
+
+    // scattering cross sections from the radiation patterns rather than the couplings
+    run.farFieldCrossSection =
+        !std::strcmp(out_node.child("crosssection").attribute("method").value(), "farfield");
+
+    // radiation patterns at each wavelength, on a grid of directions
+    run.patternTheta = out_node.child("pattern").attribute("theta").as_uint(0);
+    run.patternPhi = out_node.child("pattern").attribute("phi").as_uint(1);
+
+    // convergence and timings of the iterative solves at each wavelength
+    run.solverStatistics =
+        !std::strcmp(out_node.child("solver").attribute("statistics").value(), "yes");
+
+    // groups of processes solving different wavelengths at the same time
+    run.scanGroups = std::max(1u, out_node.child("scan").attribute("groups").as_uint(1));
+
+    // field maps at some wavelengths of the scan, from the solutions of their steps
+    auto const fields = out_node.child("scan").child("fields");
+    std::istringstream wavelengths(fields.attribute("wavelengths").value());
+    for(t_real wavelength; wavelengths >> wavelength;)
+      run.fieldWavelengths.push_back(wavelength * 1e-9);
+    run.fieldMaxima = !std::strcmp(fields.attribute("maxima").value(), "yes");
+    run.fieldGrid = read_grid(fields.child("grid"));
+    if((run.fieldMaxima or not run.fieldWavelengths.empty()) and
+       (run.fieldGrid[2] < 1 or run.fieldGrid[5] < 1 or run.fieldGrid[8] < 1))
+      throw std::runtime_error("The field maps of a scan need a grid");
+
+    // fields at a few points, at every step of the scan
+    for(auto const point : out_node.child("scan").child("probes").children("point")) {
+      auto const xyz = read_point(point);
+      run.probes.insert(run.probes.end(), {xyz.x, xyz.y, xyz.z});
+    }
+
+    // many configurations of the objects, each solved over the scan
+    run.ensemble = out_node.child("ensemble").attribute("positions").value();
+    run.ensembleGroups = std::max(1u, out_node.child("ensemble").attribute("groups").as_uint(1));
+
+    // cross sections of the lower orders, truncated from the T-matrices of the highest one
+    run.convergenceFrom = out_node.child("convergence").attribute("from").as_uint(0);
+    run.convergenceStep = std::max(1u, out_node.child("convergence").attribute("step").as_uint(1));
+
+    // wavelengths done so far and their solutions, written every so many wavelengths
+    run.checkpointEvery = out_node.child("checkpoint").attribute("every").as_uint(0);
+
+    // output of the steps written on a thread of the root while the next ones are solved
+    run.writerDepth = out_node.child("writer").attribute("depth").as_uint(0);
+
+    // steps of the scan halved where the cross sections change fastest
+    run.adaptiveLevels = out_node.child("scan").child("adaptive").attribute("levels").as_uint(0);
+    run.adaptiveTolerance = out_node.child("scan").child("adaptive").attribute("tolerance").as_double(
+        run.adaptiveTolerance);
+
+    // solves within the span of the solutions at the other wavelengths
+    run.reducedTolerance = out_node.child("scan").child("reduced").attribute("tolerance").as_double(0);
+
+    // a maximum is known once the next step is solved, in the order of the scan
+    if(run.fieldMaxima and (run.scanGroups > 1 or run.adaptiveLevels > 0))
+      throw std::runtime_error("Field maps at the maxima need a scan without groups or adaptive steps");
   }
 }
 
@@ -925,6 +1286,34 @@ scalapack::Parameters read_parallel(const pugi::xml_node &node) {
   result.block_size = node.attribute("block_size").as_uint(result.block_size);
   result.grid.rows = node.child("grid").attribute("rows").as_uint(result.grid.rows);
   result.grid.cols = node.child("grid").attribute("cols").as_uint(result.grid.cols);
+  result.mixed_precision = !std::strcmp(node.attribute("precision").value(), "mixed");
+  std::string const factorization = node.attribute("factorization").as_string("lu");
+  if(factorization != "lu" and factorization != "qr" and factorization != "outofcore")
+    throw std::runtime_error("The factorization must be lu, qr or outofcore");
+  result.qr_factorization = factorization == "qr";
+  if(factorization == "outofcore") {
+    result.scratch = node.attribute("scratch").as_string(".");
+    result.scratch_memory = node.attribute("memory").as_uint(result.scratch_memory);
+  }
+  // LU factors corrected for the particles moved since, up to this fraction of them
+  result.lowrank = node.attribute("lowrank").as_double(0);
+  if(result.lowrank < 0 or result.lowrank > 1)
+    throw std::runtime_error("The fraction of moved particles of a low-rank update is within 0 and 1");
+  // block size and grid from calibration factorizations, or from those of earlier runs
+  result.tuning_profile = node.attribute("profile").value();
+  result.tune = !std::strcmp(node.attribute("tune").value(), "yes") or not result.tuning_profile.empty();
+  // rows or columns of the grid within the nodes, for the panel broadcasts to stay on them
+  result.mapping = node.attribute("mapping").as_string(result.mapping.c_str());
+  if(result.mapping != "ranks" and result.mapping != "rows" and result.mapping != "columns")
+    throw std::runtime_error("The mapping of the grid must be ranks, rows or columns");
+  // threads of each process and their places on the cores
+  result.threads = node.attribute("threads").as_uint(result.threads);
+  result.bind = node.attribute("bind").as_string(result.bind.c_str());
+  if(result.bind != "none" and result.bind != "close" and result.bind != "spread")
+    throw std::runtime_error("The binding of the threads must be none, close or spread");
+  result.places = node.attribute("places").as_string(result.places.c_str());
+  if(result.places != "threads" and result.places != "cores" and result.places != "sockets")
+    throw std::runtime_error("The places of the threads must be threads, cores or sockets");
   return result;
 }
 
@@ -941,6 +1330,7 @@ Teuchos::RCP<Teuchos::ParameterList> read_parameter_list(pugi::xml_document cons
     result->set("Solver", "scalapack");
   return result;
 }
+#endif
 
 std::tuple<bool, t_int> read_fmm_input(pugi::xml_node const &node) {
   if(not node)
@@ -949,40 +1339,361 @@ std::tuple<bool, t_int> read_fmm_input(pugi::xml_node const &node) {
     return std::make_tuple(true, std::numeric_limits<t_int>::max());
   return std::make_tuple(true, node.attribute("subdiagonals").as_int());
 }
-#endif
 
 Run simulation_input(pugi::xml_document const &inputFile) {
   Run result;
   result.geometry = read_geometry(inputFile);
+  // hierarchical ACA compression of the scattering matrices
+  auto const aca = inputFile.child("simulation").child("ACA");
+  result.geometry->ACAcompression(!std::strcmp(aca.attribute("compression").value(), "yes"),
+                                  aca.attribute("tolerance").as_double(1e-3),
+                                  !std::strcmp(aca.attribute("recompress").value(), "yes"),
+                                  !std::strcmp(aca.attribute("precision").value(), "single"));
+  if(not(result.geometry->get_ACAtolerance() > 0))
+    throw std::runtime_error("The ACA tolerance should be positive");
+  // couplings rotated onto the axis of each pair rather than translated directly
+  result.geometry->rotationCoupling(!std::strcmp(
+      inputFile.child("simulation").child("coupling").attribute("engine").value(), "rotation"));
+  // scattering matrix applied on the fly, with or without caching the couplings
+  result.geometry->matrixFree(
+      !std::strcmp(inputFile.child("simulation").child("coupling").attribute("matrixfree").value(), "yes"),
+      std::strcmp(inputFile.child("simulation").child("coupling").attribute("cache").value(), "no"));
+  // matrix-free couplings of scatterers on a regular grid applied as FFT convolutions
+  result.geometry->latticeCoupling(
+      !std::strcmp(inputFile.child("simulation").child("coupling").attribute("lattice").value(), "yes"));
+  // the weakest matrix-free couplings dropped or cut to fewer harmonics within this tolerance
+  result.geometry->couplingSparsification(
+      inputFile.child("simulation").child("coupling").attribute("tolerance").as_double(0));
+  if(result.geometry->get_couplingtolerance() < 0)
+    throw std::runtime_error("The coupling tolerance should not be negative");
+  if(result.geometry->get_couplingtolerance() > 0 and
+     (not result.geometry->get_matrixfreecond() or result.geometry->get_latticecond()))
+    throw std::runtime_error("The couplings are sparsified by the matrix-free operator only");
+  // dense FF solves split over the rotations about z, as many as given or as the objects allow
+  auto const symmetry = inputFile.child("simulation").child("symmetry");
+  if(symmetry and symmetry.attribute("type").value() != std::string("cyclic"))
+    throw std::runtime_error("The type of the symmetry should be cyclic");
+  result.geometry->cyclicSymmetry(static_cast<bool>(symmetry),
+                                  symmetry.attribute("order").as_uint(0));
+  if(symmetry and symmetry.attribute("order") and result.geometry->get_symmetryorder() < 2)
+    throw std::runtime_error("The order of the symmetry should be at least 2");
+  // orders of the particles from their size parameters at each wavelength, up to nmax
+  auto const harmonics = inputFile.child("simulation").child("harmonics");
+  result.geometry->automaticHarmonics(!std::strcmp(harmonics.attribute("automatic").value(), "yes"),
+                                      harmonics.attribute("margin").as_uint(1));
+  // T-matrices are read from and added to this library, if any
+  result.geometry->TmatrixLibrary(
+      inputFile.child("simulation").child("Tmatrix").attribute("library").value());
+  // T-matrices of the meshed particles interpolated over the scan between Chebyshev nodes
+  result.geometry->TmatrixInterpolation(
+      inputFile.child("simulation").child("Tmatrix").attribute("interpolation").as_uint(0),
+      inputFile.child("simulation").child("Tmatrix").attribute("check").as_uint(10),
+      inputFile.child("simulation").child("Tmatrix").attribute("tolerance").as_double(1e-3));
+  // T-matrices of the meshed particles at several wavelengths of the scan per pass over the mesh
+  result.geometry->TmatrixBatch(
+      inputFile.child("simulation").child("Tmatrix").attribute("batch").as_uint(1));
+  // distinct particles computed in turn by all processes, or by groups of processes in parallel
+  std::string const distribution =
+      inputFile.child("simulation").child("Tmatrix").attribute("distribution").as_string("auto");
+  if(distribution != "auto" and distribution != "processes" and distribution != "particles")
+    throw std::runtime_error("The T-matrix distribution should be auto, processes or particles");
+  result.geometry->TmatrixDistribution(distribution);
+  // the T-matrices of all the particles held once per node by the scalapack solver
+  result.geometry->TmatrixShared(
+      !std::strcmp(inputFile.child("simulation").child("Tmatrix").attribute("shared").value(), "yes"));
+  // iterative solves of a scan start from the previous wavelengths
+  result.extrapolate_guess =
+      !std::strcmp(inputFile.child("simulation").child("guess").attribute("extrapolate").value(), "yes");
+  // Clebsch Gordan tables of the SH sources held once per node
+  result.shared_tables =
+      !std::strcmp(inputFile.child("simulation").child("coefficients").attribute("shared").value(), "yes");
+  // no CLG tables, the W numbers of the SH sources computed where they are used
+  result.onthefly_tables =
+      !std::strcmp(inputFile.child("simulation").child("coefficients").attribute("onthefly").value(), "yes");
+  // CLG tables are read from and added to this library, if any
+  result.CLG_library = inputFile.child("simulation").child("coefficients").attribute("library").value();
+  // the solver is chosen from the cost of each, within the memory of a process
+  auto const solver = inputFile.child("simulation").child("solver");
+  std::string const plan = solver.attribute("plan").as_string("manual");
+  if(plan != "manual" and plan != "auto")
+    throw std::runtime_error("The solver plan should be manual or auto");
+  result.solver_plan = plan == "auto";
+  result.solver_memory = solver.attribute("memory").as_uint(result.solver_memory);
+  if(result.solver_memory == 0)
+    throw std::runtime_error("The memory of the solver plan should be positive");
+  // the roofline the regions are placed on, when built with hardware counters
+  auto const roofline = inputFile.child("simulation").child("roofline");
+  result.peakGflops = roofline.attribute("gflops").as_double(0);
+  result.peakBandwidth = roofline.attribute("bandwidth").as_double(0);
+  // GCRO-DR keeps this many Krylov vectors from one solve to the next
+  result.geometry->krylovRecycling(
+      inputFile.child("simulation").child("krylov").attribute("recycle").as_uint(0));
+  // and GMRES runs this many cycles of this many vectors, down to this relative residual
+  auto const krylov = inputFile.child("simulation").child("krylov");
+  result.geometry->krylovSolver(krylov.attribute("tolerance").as_double(1e-7),
+                                krylov.attribute("restart").as_uint(250),
+                                krylov.attribute("cycles").as_uint(3));
+  if(not(result.geometry->get_krylovtolerance() > 0) or result.geometry->get_krylovrestart() == 0 or
+     result.geometry->get_krylovcycles() == 0)
+    throw std::runtime_error("The Krylov tolerance, restart and cycles should be positive");
+  // nearly touching scatterers are preconditioned together, or the subdomains of a partition
+  auto const preconditioner = inputFile.child("simulation").child("preconditioner");
+  std::string const type = preconditioner.attribute("type").as_string("nearfield");
+  if(type != "nearfield" and type != "schwarz")
+    throw std::runtime_error("The type of the preconditioner should be nearfield or schwarz");
+  result.geometry->nearFieldPreconditioner(preconditioner.attribute("gap").as_double(0),
+                                           preconditioner.attribute("size").as_uint(8));
+  result.geometry->schwarzPreconditioner(type == "schwarz",
+                                         preconditioner.attribute("subdomains").as_uint(0),
+                                         preconditioner.attribute("overlap").as_double(0));
+  if(result.geometry->get_schwarzoverlap() < 0)
+    throw std::runtime_error("The overlap of the subdomains should not be negative");
   result.nMax = result.geometry->nMax();
   result.nMaxS = result.geometry->nMaxS();
   ElectroMagnetic bground =  result.geometry->bground;
   // Read Excitation
   result.excitation = read_excitation(inputFile, result.nMax, bground);
+  // orientation averages from the invariants of the T-matrix of the cluster
+  auto const orientations = inputFile.child("source").child("orientations");
+  result.analyticAverage = !std::strcmp(orientations.attribute("method").value(), "analytic");
+  result.averageOrder = orientations.attribute("order").as_uint(0);
   // Update the geometry in case we had dynamic models
   result.geometry->update(result.excitation);
 
   // Read Excitation
   read_output(inputFile, result);
+  // only the scattered fields of the motifs are known
+  for(auto const &object : result.geometry->objects)
+    if(object.kind() == Scatterer::motif and (result.excitation->SH_cond or result.outputType == 0))
+      throw std::runtime_error("Motifs are solved for the far fields at the fundamental harmonic only");
+  // the SH sources are integrated over the meshes as they are in the input
+  if(result.excitation->SH_cond)
+    for(auto const &object : result.geometry->objects)
+      if(object.orientation[0] != 0 or object.orientation[1] != 0 or object.orientation[2] != 0)
+        throw std::runtime_error("Turned particles are solved for the fundamental harmonic only");
+  if(static_cast<t_int>(result.convergenceFrom) > result.nMax)
+    throw std::runtime_error("The convergence study starts at most at the harmonics of the simulation");
 
   result.parallel_params = read_parallel(inputFile.child("parallel"));
 #ifdef OPTIMET_BELOS
   result.belos_params = read_parameter_list(inputFile);
+#endif
+  // scattering matrix applied through the fast multipole method
   std::tie(result.do_fmm, result.fmm_subdiagonals) = read_fmm_input(inputFile.child("FMM"));
+  result.geometry->fastMultipole(result.do_fmm, inputFile.child("FMM").attribute("leaf").as_uint(8),
+                                 inputFile.child("FMM").attribute("digits").as_double(6));
+  // the subdomains precondition an iterative solve, matrix-free unless another is chosen
+  if(result.geometry->get_schwarzcond() and
+     not(result.geometry->get_ACAcond() or result.geometry->get_FMMcond() or
+         result.geometry->get_matrixfreecond()))
+    result.geometry->matrixFree(true, result.geometry->get_cachecond());
+  // the objects are the unit cell of an infinite array, coupled to all the images of each other
+  if(auto const periodic_node = inputFile.child("geometry").child("periodic")) {
+    std::vector<Cartesian<double>> lattice;
+    for(auto node = periodic_node.child("vector"); node; node = node.next_sibling("vector"))
+      lattice.emplace_back(node.attribute("x").as_double() * consFrnmTom,
+                           node.attribute("y").as_double() * consFrnmTom,
+                           node.attribute("z").as_double() * consFrnmTom);
+    if(lattice.size() != 2 and lattice.size() != 3)
+      throw std::runtime_error("A periodic array has two or three lattice vectors");
+    if(result.geometry->get_ACAcond() or result.geometry->get_FMMcond() or
+       result.geometry->get_matrixfreecond())
+      throw std::runtime_error("Periodic arrays are solved with the assembled scattering matrix");
+    // the phase between the images follows the incident wave
+    if(not result.excitation->incidences.empty() or result.analyticAverage)
+      throw std::runtime_error("Periodic arrays are solved for a single incidence");
+    if(result.convergenceFrom > 0)
+      throw std::runtime_error("Periodic arrays are solved with all the harmonics of the simulation");
+    result.geometry->periodicLattice(lattice);
+  }
+  if(result.geometry->get_symmetrycond() and
+     (not result.geometry->get_periodic().empty() or result.geometry->get_ACAcond() or
+      result.geometry->get_FMMcond() or result.geometry->get_matrixfreecond()))
+    throw std::runtime_error("The symmetry is used by the dense solves of finite arrangements only");
+
+  return result;
+}
+
+//! Adds the dims of the meshed objects below the node
+void mesh_names(pugi::xml_node const &node, std::set<std::string> &names) {
+  for(auto const &child : node.children()) {
+    if(child.attribute("type").value() == std::string("arbitrary.shape"))
+      names.insert(child.attribute("dims").value());
+    mesh_names(child, names);
+  }
+}
+
+//! \brief The root reads the meshes of the input and sends them to the other processes
+//! \details The meshes are returned so that they stay shared while the input is read.
+std::vector<std::shared_ptr<MeshFile const>>
+share_meshes(pugi::xml_document const &inputFile, mpi::Communicator const &comm) {
+  std::vector<std::shared_ptr<MeshFile const>> result;
+#ifdef OPTIMET_MPI
+  if(comm.size() <= 1)
+    return result;
+  std::set<std::string> names;
+  mesh_names(inputFile, names);
+  for(auto const &dims : names) {
+    std::shared_ptr<MeshFile const> mesh;
+    std::string error;
+    if(comm.is_root()) {
+      try {
+        mesh = MeshFile::load(dims);
+      } catch(std::exception const &e) {
+        error = e.what();
+      }
+    }
+    error = comm.broadcast(error);
+    if(not error.empty())
+      throw std::runtime_error(error);
+    std::vector<double> coord;
+    std::vector<int> topol;
+    if(comm.is_root()) {
+      coord.assign(mesh->coord(), mesh->coord() + 3 * mesh->vertices());
+      topol.assign(mesh->topol(), mesh->topol() + 3 * mesh->triangles());
+    }
+    coord = comm.broadcast(coord);
+    topol = comm.broadcast(topol);
+    if(not comm.is_root()) {
+      mesh = std::make_shared<MeshFile const>(std::move(coord), std::move(topol));
+      MeshFile::share(dims, mesh);
+    }
+    result.push_back(mesh);
+  }
+#else
+  (void)inputFile;
+  (void)comm;
 #endif
+  return result;
+}
 
+//! Adds the files of the tabulated materials below the node
+void material_names(pugi::xml_node const &node, std::set<std::string> &names) {
+  for(auto const &child : node.children()) {
+    if(child.name() == std::string("epsilon") and
+       child.attribute("type").value() == std::string("Tabulated"))
+      names.insert(child.attribute("file").value());
+    material_names(child, names);
+  }
+}
+
+//! \brief The root reads the tabulated materials of the input and sends them to the other processes
+//! \details The materials are returned so that they stay shared while the input is read.
+std::vector<std::shared_ptr<MaterialTable const>>
+share_materials(pugi::xml_document const &inputFile, mpi::Communicator const &comm) {
+  std::vector<std::shared_ptr<MaterialTable const>> result;
+#ifdef OPTIMET_MPI
+  if(comm.size() <= 1)
+    return result;
+  std::set<std::string> names;
+  material_names(inputFile, names);
+  for(auto const &file : names) {
+    std::shared_ptr<MaterialTable const> table;
+    std::string error;
+    if(comm.is_root()) {
+      try {
+        table = MaterialTable::load(file);
+      } catch(std::exception const &e) {
+        error = e.what();
+      }
+    }
+    error = comm.broadcast(error);
+    if(not error.empty())
+      throw std::runtime_error(error);
+    std::vector<double> grid;
+    std::vector<t_complex> samples;
+    if(comm.is_root()) {
+      grid = {table->first(), table->step()};
+      samples = table->samples();
+    }
+    grid = comm.broadcast(grid);
+    samples = comm.broadcast(samples);
+    if(not comm.is_root()) {
+      table = std::make_shared<MaterialTable const>(grid[0], grid[1], std::move(samples));
+      MaterialTable::share(file, table);
+    }
+    result.push_back(table);
+  }
+#else
+  (void)inputFile;
+  (void)comm;
+#endif
+  return result;
+}
+
+//! \brief The root reads the particle tables of the input and sends them to the other processes
+//! \details The tables are returned so that they stay shared while the input is read.
+std::vector<std::shared_ptr<ParticleTable const>>
+share_tables(pugi::xml_document const &inputFile, mpi::Communicator const &comm) {
+  std::vector<std::shared_ptr<ParticleTable const>> result;
+#ifdef OPTIMET_MPI
+  if(comm.size() <= 1)
+    return result;
+  std::set<std::string> names;
+  for(auto const &node : inputFile.child("geometry").children("structure"))
+    if(node.attribute("type").value() == std::string("table"))
+      names.insert(node.attribute("file").value());
+  for(auto const &file : names) {
+    std::shared_ptr<ParticleTable const> table;
+    std::string error;
+    if(comm.is_root()) {
+      try {
+        table = ParticleTable::load(file);
+      } catch(std::exception const &e) {
+        error = e.what();
+      }
+    }
+    error = comm.broadcast(error);
+    if(not error.empty())
+      throw std::runtime_error(error);
+    std::vector<t_real> positions, radii, orientations;
+    std::vector<int> types;
+    if(comm.is_root()) {
+      positions = table->positions();
+      types = table->types();
+      radii = table->radii();
+      orientations = table->orientations();
+    }
+    positions = comm.broadcast(positions);
+    types = comm.broadcast(types);
+    radii = comm.broadcast(radii);
+    orientations = comm.broadcast(orientations);
+    if(not comm.is_root()) {
+      table = std::make_shared<ParticleTable const>(std::move(positions), std::move(types),
+                                                    std::move(radii), std::move(orientations));
+      ParticleTable::share(file, table);
+    }
+    result.push_back(table);
+  }
+#else
+  (void)inputFile;
+  (void)comm;
+#endif
   return result;
 }
 }
 
-Run simulation_input(std::string const &fileName_) {
+Run simulation_input(std::string const &fileName_, mpi::Communicator const &comm) {
+  // only the root touches the file system, the others get the input and the meshes from it
+  std::string text;
+  if(comm.rank() == comm.root_id()) {
+    std::ifstream file(fileName_, std::ios::binary);
+    text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+#ifdef OPTIMET_MPI
+  if(comm.size() > 1)
+    text = comm.broadcast(text);
+#endif
   pugi::xml_document inputFile;
-  auto const fileResult = inputFile.load_file(fileName_.c_str());
-  if(!fileResult) {
+  auto const fileResult = inputFile.load_buffer(text.data(), text.size());
+  if(text.empty() or !fileResult) {
     std::ostringstream msg;
     msg << "Error reading or parsing input file " << fileName_ << "!";
     throw std::runtime_error(msg.str());
   }
+  auto const meshes = share_meshes(inputFile, comm);
+  auto const materials = share_materials(inputFile, comm);
+  auto const tables = share_tables(inputFile, comm);
   return simulation_input(inputFile);
 }
 
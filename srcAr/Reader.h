@@ -18,6 +18,7 @@
 #define READER_H_
 
 #include "Run.h"
+#include "mpi/Communicator.h"
 #include "pugi/pugixml.hpp"
 #include <string>
 
@@ -26,8 +27,11 @@
 #endif
 
 namespace optimet {
-//! Reads simulation configuration from input
-Run simulation_input(std::string const &filename);
+//! \brief Reads simulation configuration from input
+//! \details Only the root of the communicator reads the input and the meshes of the library, then
+//! sends them to the other processes.
+Run simulation_input(std::string const &filename,
+                     mpi::Communicator const &comm = mpi::Communicator());
 //! Reads simulation configuration from string buffer
 Run simulation_input(std::istream &buffer);
 }
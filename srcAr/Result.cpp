@@ -15,19 +15,234 @@
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
 
-#include "Algebra.h"
 #include "AuxCoefficients.h"
 #include "Coupling.h"
 #include "Result.h"
 #include "Tools.h"
 #include "constants.h"
+#include "mpi/Communicator.h"
 
+#include <algorithm>
+#include <cmath>
 #include <complex>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
 
 namespace optimet {
+namespace {
+//! \brief Order of the expansion of a cluster of the given diameter
+//! \details Semi-empirical rule of the Helmholtz FMM, never below the order of the scatterers.
+t_uint cluster_order(t_complex waveK, t_real diameter, t_real digits, t_uint nMax) {
+  auto const kd = std::abs(waveK) * diameter;
+  auto const order = kd + 1.8 * std::pow(digits, 2e0 / 3e0) * std::cbrt(std::max(kd, 1e0));
+  return std::max<t_uint>(nMax, static_cast<t_uint>(std::ceil(order)));
+}
+
+//! \brief Translates an outgoing expansion of order from to the order of the coupling
+//! \details The coefficients of the M functions come first, then those of the N functions.
+Vector<t_complex> translate(RotationCoupling const &AB, t_complex const *input, t_uint from) {
+  t_uint const N = Tools::iteratorMax(from);
+  t_uint const M = Tools::iteratorMax(AB.nMax);
+  Matrix<t_complex> padded = Matrix<t_complex>::Zero(2 * M, 1);
+  for(t_uint p = 0; p < N; p++) {
+    padded(p, 0) = input[p];
+    padded(M + p, 0) = input[N + p];
+  }
+  return AB.apply(padded, true).col(0);
+}
+
+//! \brief Squared norm (T x)^H (T x) of an outgoing expansion x translated to the origin
+//! \details T = [A^T B^T; B^T A^T] is the regular coupling from the scatterer to the origin.
+t_real translated_norm(Coupling const &coupling, Eigen::Ref<Vector<t_complex> const> const &x) {
+  auto const pMax = coupling.diagonal.rows();
+  Vector<t_complex> y(2 * pMax);
+  y.head(pMax).noalias() = coupling.diagonal.transpose() * x.head(pMax);
+  y.head(pMax).noalias() += coupling.offdiagonal.transpose() * x.tail(pMax);
+  y.tail(pMax).noalias() = coupling.offdiagonal.transpose() * x.head(pMax);
+  y.tail(pMax).noalias() += coupling.diagonal.transpose() * x.tail(pMax);
+  return y.squaredNorm();
+}
+
+//! \brief The fields of a batch of points, as sums of the VSWFs of an AuxCoefficientsBatch
+//! \details The real and imaginary parts of each component are contiguous over the points, as
+//! in the batch, so that the sums run over the points in the innermost loops. The sums are in
+//! the precision of the batch.
+template <class REAL> class FieldBatch {
+public:
+  typedef BasicAuxCoefficientsBatch<REAL> Batch;
+
+  //! Sets the fields of the given number of points to zero
+  void reset(t_uint points) {
+    points_ = points;
+    values_.assign(6 * points, 0e0);
+  }
+
+  //! \brief Adds factor * sum_p (F_p a_p + G_p b_p), for the harmonics first to pMax - 1
+  //! \details With a stride, the coefficients of harmonic p and point i are a[p * stride + i],
+  //! otherwise a[p] for all the points. Null coefficients are zero.
+  void add(Batch const &batch, typename Batch::Function F, t_complex const *a,
+           typename Batch::Function G, t_complex const *b, t_complex factor, t_uint pMax,
+           t_uint stride = 0, t_uint first = 0) {
+    ArenaVector<REAL> ar(points_), ai(points_), br(points_), bi(points_);
+    for(t_uint p = first; p < pMax; p++) {
+      for(t_uint i = 0; i < points_; i++) {
+        auto const k = stride > 0 ? p * stride + i : p;
+        auto const fa = a ? factor * a[k] : t_complex(0);
+        auto const fb = b ? factor * b[k] : t_complex(0);
+        ar[i] = fa.real();
+        ai[i] = fa.imag();
+        br[i] = fb.real();
+        bi[i] = fb.imag();
+      }
+      for(t_uint c = 0; c < 3; c++) {
+        REAL const *const Fr = batch.real(F, c, p);
+        REAL const *const Fi = batch.imag(F, c, p);
+        REAL const *const Gr = batch.real(G, c, p);
+        REAL const *const Gi = batch.imag(G, c, p);
+        REAL *const re = values_.data() + 2 * c * points_;
+        REAL *const im = re + points_;
+        for(t_uint i = 0; i < points_; i++) {
+          re[i] += Fr[i] * ar[i] - Fi[i] * ai[i] + Gr[i] * br[i] - Gi[i] * bi[i];
+          im[i] += Fr[i] * ai[i] + Fi[i] * ar[i] + Gr[i] * bi[i] + Gi[i] * br[i];
+        }
+      }
+    }
+  }
+
+  //! The field at point i
+  SphericalP<t_complex> operator()(t_uint i) const {
+    return SphericalP<t_complex>(t_complex(values_[i], values_[points_ + i]),
+                                 t_complex(values_[2 * points_ + i], values_[3 * points_ + i]),
+                                 t_complex(values_[4 * points_ + i], values_[5 * points_ + i]));
+  }
+
+private:
+  t_uint points_ = 0;
+  //! Real then imaginary parts of each component, by point
+  std::vector<REAL> values_;
+};
+
+//! The indices of the points by increasing distance to center
+std::vector<t_uint> by_distance(std::vector<Cartesian<double>> const &X,
+                                Cartesian<double> const &center) {
+  std::vector<t_real> r(X.size());
+  for(t_uint i = 0; i < X.size(); i++)
+    r[i] = Tools::findDistance(X[i], center);
+  std::vector<t_uint> result(X.size());
+  for(t_uint i = 0; i < X.size(); i++)
+    result[i] = i;
+  std::stable_sort(result.begin(), result.end(),
+                   [&r](t_uint a, t_uint b) { return r[a] < r[b]; });
+  return result;
+}
+
+//! \brief The smallest order N of an outgoing expansion whose terms above N sum to at most the
+//! tolerance times all of them, at distance r
+//! \details The term of order n is bounded by the norm of its coefficients times |h_n(kr)|, and
+//! by n / kr more for the N functions. The full order stands if the functions fail.
+t_uint effective_order(std::vector<t_real> const &norms, t_complex waveK, t_real r,
+                       t_real tolerance) {
+  t_uint const order = norms.size() - 1;
+  std::vector<t_complex> h(order + 1);
+  try {
+    bessel<Hankel1>(waveK * r, order, h.data(), nullptr);
+  } catch(std::runtime_error const &) {
+    return order;
+  }
+  t_real const kr = std::abs(waveK * r);
+  std::vector<t_real> terms(order + 1, 0e0);
+  t_real total = 0;
+  for(t_uint n = 1; n <= order; n++) {
+    terms[n] = norms[n] * std::abs(h[n]) * std::max(1e0, n / kr);
+    total += terms[n];
+  }
+  if(not std::isfinite(total) or not(total > 0))
+    return order;
+  t_real tail = 0;
+  for(t_uint n = order; n > 1; n--) {
+    tail += terms[n];
+    if(tail > tolerance * total)
+      return n;
+  }
+  return 1;
+}
+
+//! \brief Bisects the points lo to hi, inclusive, while the effective orders at its ends differ
+//! \details The ranges are appended as (one past the last point, order), merging those of the
+//! same order.
+template <class Order>
+void bisect_orders(t_uint lo, t_uint hi, t_uint nlo, t_uint nhi, Order const &at,
+                   std::vector<std::pair<t_uint, t_uint>> &ranges) {
+  auto const push = [&ranges](t_uint end, t_uint n) {
+    if(not ranges.empty() and ranges.back().second == n)
+      ranges.back().first = std::max(ranges.back().first, end);
+    else if(ranges.empty() or end > ranges.back().first)
+      ranges.emplace_back(end, n);
+  };
+  if(nlo == nhi) {
+    push(hi + 1, nlo);
+    return;
+  }
+  if(hi - lo <= 1) {
+    push(lo + 1, nlo);
+    push(hi + 1, nhi);
+    return;
+  }
+  t_uint const mid = lo + (hi - lo) / 2;
+  t_uint const nmid = at(mid);
+  bisect_orders(lo, mid, nlo, nmid, at, ranges);
+  bisect_orders(mid, hi, nmid, nhi, at, ranges);
+}
+
+//! \brief The ranges of points of an outgoing expansion c of the given order, as (one past the
+//! last point, effective order)
+//! \details The points are those of the angular functions, by increasing distance to the center,
+//! so that the effective orders decrease from range to range. A range spans points whose ends
+//! share an order, which the nearest point bounds. All the points keep the full order if the
+//! tolerance is zero or the points are not sorted.
+std::vector<std::pair<t_uint, t_uint>> pruned_ranges(AuxAngular const &angular, t_complex waveK,
+                                                     t_complex const *c, t_uint order,
+                                                     t_real tolerance) {
+  std::vector<std::pair<t_uint, t_uint>> ranges;
+  t_uint const points = angular.points();
+  if(points == 0)
+    return ranges;
+  bool sorted = true;
+  for(t_uint j = 1; j < points and sorted; j++)
+    sorted = angular.distance(j) >= angular.distance(j - 1);
+  if(not(tolerance > 0) or not sorted) {
+    ranges.emplace_back(points, order);
+    return ranges;
+  }
+  // the norms of the coefficients of each order, M then N
+  t_uint const p = Tools::iteratorMax(order);
+  std::vector<t_real> norms(order + 1, 0e0);
+  for(t_uint n = 1; n <= order; n++) {
+    for(t_uint k = n * n - 1; k < n * (n + 2); k++)
+      norms[n] += std::norm(c[k]) + std::norm(c[p + k]);
+    norms[n] = std::sqrt(norms[n]);
+  }
+  auto const at = [&](t_uint j) {
+    return effective_order(norms, waveK, angular.distance(j), tolerance);
+  };
+  bisect_orders(0, points - 1, at(0), at(points - 1), at, ranges);
+  return ranges;
+}
+} // namespace
+
+std::string FieldPart::name() const {
+  std::string result = dominant ? "dominant" :
+                       n > 0    ? "n" + std::to_string(n) + "m" + std::to_string(m) :
+                                  "";
+  if(component != both)
+    result += std::string(result.empty() ? "" : "_") + (component == TE ? "TE" : "TM");
+  return result.empty() ? "total" : result;
+}
+
 Result::Result(std::shared_ptr<Geometry> geometry_, std::shared_ptr<Excitation> excitation_)
     :result_FF(nullptr) {
      
@@ -47,6 +262,7 @@ void Result::init(std::shared_ptr<Geometry> geometry_, std::shared_ptr<Excitatio
   result_SH = NULL;
   nMax = geometry_->nMax();
   nMaxS = geometry_->nMaxS();
+  couplings = std::make_shared<OriginCouplings>();
 
   CLGcoeff.resize(9); 
   scatter_coef.resize(2 * Tools::iteratorMax(nMax) * geometry->objects.size());
@@ -71,486 +287,606 @@ void Result::init(std::shared_ptr<Geometry> geometry_, std::shared_ptr<Excitatio
 }
                    
 
-void Result::getEHFields(Spherical<double> R_, SphericalP<std::complex<double>> &EField_FF,
-                         SphericalP<std::complex<double>> &HField_FF, SphericalP<std::complex<double>> &EField_SH,
-                         SphericalP<std::complex<double>> &HField_SH, bool projection_, std::complex<double> *coeffXmn, std::complex<double> *coeffXpl) const {
-                                                 
-  SphericalP<std::complex<double>> Efield_FF = SphericalP<std::complex<double>>(
-      std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-  SphericalP<std::complex<double>> Einc_FF = SphericalP<std::complex<double>>(
-      std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-  SphericalP<std::complex<double>> Hfield_FF = SphericalP<std::complex<double>>(
-      std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-  SphericalP<std::complex<double>> Hinc_FF = SphericalP<std::complex<double>>(
-      std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-                                                       
-   
-      
-  SphericalP<std::complex<double>> Efield_SH = SphericalP<std::complex<double>>(
-      std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-  SphericalP<std::complex<double>> Egamma_SH = SphericalP<std::complex<double>>( // particular solution of diff equations
-      std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
-  SphericalP<std::complex<double>> Hfield_SH = SphericalP<std::complex<double>>(
-      std::complex<double>(0.0, 0.0), std::complex<double>(0.0, 0.0),
-      std::complex<double>(0.0, 0.0));
- 
-  int NO = geometry->objects.size(); // number of particles
-  
-   std::complex<double> amnSH, bmnSH, cmnSH, dmnSH;
-  
-  auto const omega = excitation->omega();
-  
-  const std::complex<double> waveK_0 = (omega) * std::sqrt(consEpsilon0 * consMu0);
-  
-  Spherical<double> Rrel;
+void Result::clusterExpansion(t_uint order) {
+  auto const &objects = geometry->objects;
+  t_uint const pMax = Tools::iteratorMax(nMax);
+  t_uint const pMaxS = Tools::iteratorMax(nMaxS);
 
-  std::complex<double> iZ = (consCmi / sqrt(geometry->bground.mu / geometry->bground.epsilon));
-  
-  int pMax = Tools::iteratorMax(nMax);
-  int pMaxS = Tools::iteratorMax(nMaxS);
-  
-  CompoundIterator p;
+  // centroid of the scatterers, and the sphere about it that holds them all
+  Cartesian<double> center(0, 0, 0);
+  for(auto const &object : objects) {
+    auto const R = Tools::toCartesian(object.vR);
+    center.init(center.x + R.x, center.y + R.y, center.z + R.z);
+  }
+  auto const n = static_cast<double>(std::max<std::size_t>(objects.size(), 1));
+  center.init(center.x / n, center.y / n, center.z / n);
+  clusterCenter = Tools::toSpherical(center);
+  clusterRadius = 0;
+  for(auto const &object : objects)
+    clusterRadius =
+        std::max(clusterRadius, Tools::toPoint(object.vR, clusterCenter).rrr + object.radius);
+
+  auto const digits = geometry->get_FMMdigits();
+  clusterOrder = order > 0 ? order : cluster_order(waveK, 2 * clusterRadius, digits, nMax);
+  clusterOrderS = order > 0 ? 2 * order :
+                              cluster_order(2.0 * waveK, 2 * clusterRadius, digits, nMaxS);
+
+  cluster_coef = Vector<t_complex>::Zero(2 * Tools::iteratorMax(clusterOrder));
+  for(size_t j = 0; j < objects.size(); j++) {
+    RotationCoupling const AB(Tools::toPoint(clusterCenter, objects[j].vR), waveK, clusterOrder,
+                              false);
+    cluster_coef += translate(AB, scatter_coef.data() + j * 2 * pMax, nMax);
+  }
 
-  // Check for inner point and set to 0
-  int intInd = geometry->checkInner(R_);
-  
-  
-  if(intInd < 0) // Outside a particle
-  {
-    // FF
-    
-      // Incoming field
-      optimet::AuxCoefficients aCoefInc(R_, waveK, 1, nMax); //regular VSWFs
-      
-      for(p = 0; p < p.max(nMax); p++) {
-      
-        Einc_FF = Einc_FF + (aCoefInc.M(static_cast<long>(p)) * excitation->dataIncAp[p] +
-                       aCoefInc.N(static_cast<long>(p)) * excitation->dataIncBp[p]); 
-        Hinc_FF = Hinc_FF +
-               (aCoefInc.N(static_cast<long>(p)) * excitation->dataIncAp[p] +
-                aCoefInc.M(static_cast<long>(p)) * excitation->dataIncBp[p]) *
-                   iZ;           
+  cluster_coef_SH = Vector<t_complex>::Zero(2 * Tools::iteratorMax(clusterOrderS));
+  if(excitation->SH_cond)
+    for(size_t j = 0; j < objects.size(); j++)
+      if(objects[j].kind() == Scatterer::arbitrary_shape) {
+        RotationCoupling const AB(Tools::toPoint(clusterCenter, objects[j].vR), 2.0 * waveK,
+                                  clusterOrderS, false);
+        cluster_coef_SH += translate(AB, scatter_coef_SH.data() + j * 2 * pMaxS, nMaxS);
       }
-    
-
-    // Scattered field
-     
-    for(size_t j = 0; j < geometry->objects.size(); j++) {
-      
-
-      Rrel = Tools::toPoint(R_, geometry->objects[j].vR);
+}
 
- 
-      optimet::AuxCoefficients aCoefFF(Rrel, waveK, 0, nMax); //radiative VSWFs
+void Result::getFarField(FarField const &directions,
+                         std::vector<SphericalP<std::complex<double>>> &EPattern_FF,
+                         std::vector<SphericalP<std::complex<double>>> &HPattern_FF,
+                         std::vector<SphericalP<std::complex<double>>> &EPattern_SH,
+                         std::vector<SphericalP<std::complex<double>>> &HPattern_SH) const {
+  std::complex<double> iZ = (consCmi / sqrt(geometry->bground.mu / geometry->bground.epsilon));
+  t_uint const pMax = Tools::iteratorMax(nMax);
+  t_uint const pMaxS = Tools::iteratorMax(nMaxS);
+  SphericalP<std::complex<double>> const zero(0.0, 0.0, 0.0);
+  EPattern_FF.assign(directions.directions(), zero);
+  HPattern_FF.assign(directions.directions(), zero);
+  EPattern_SH.assign(directions.directions(), zero);
+  HPattern_SH.assign(directions.directions(), zero);
 
-       
-      for(p = 0; p < p.max(nMax); p++) {
-     
-        
-        Efield_FF = Efield_FF + aCoefFF.M(static_cast<long>(p)) * scatter_coef[j * 2 * pMax + p.compound] +
-                 aCoefFF.N(static_cast<long>(p)) * scatter_coef[pMax + j * 2 * pMax + p.compound];
-                 
-        Hfield_FF = Hfield_FF +
-                 (aCoefFF.N(static_cast<long>(p)) * scatter_coef[j * 2 * pMax + p.compound] +
-                  aCoefFF.M(static_cast<long>(p)) * scatter_coef[pMax + j * 2 * pMax + p.compound]) *
-                     (iZ);
-      }
-            
-    }
-    
-  
-      // SH
-  if(excitation->SH_cond){  
   for(size_t j = 0; j < geometry->objects.size(); j++) {
-
-
-      Rrel = Tools::toPoint(R_, geometry->objects[j].vR);
-      
-      optimet::AuxCoefficients aCoefSH(Rrel, std::complex<double>(2.0, 0.0) * waveK, 0, nMaxS); //radiative VSWF
-
-      for(p = 0; p < p.max(nMaxS); p++) {
-
-      if (geometry->objects[j].scatterer_type == "arbitrary.shape"){ 
-      bmnSH =  (1.0/waveK_0) * scatter_coef_SH[j * 2 * pMaxS + p.compound];
-      
-      amnSH =  (1.0/waveK_0) * scatter_coef_SH[j * 2 * pMaxS + pMaxS + p.compound];
-      }
-
-        Efield_SH = Efield_SH + (aCoefSH.M(static_cast<long>(p)) * (bmnSH) +
-                                 aCoefSH.N(static_cast<long>(p)) * (amnSH)) * waveK_0; 
-        
-        Hfield_SH = Hfield_SH +
-                 (aCoefSH.N(static_cast<long>(p)) * (bmnSH) +
-                  aCoefSH.M(static_cast<long>(p)) * (amnSH)) * (iZ * waveK_0);
-                      
-      }
-      
+    auto const &vR = geometry->objects[j].vR;
+    auto const a = scatter_coef.data() + j * 2 * pMax;
+    directions.add(waveK, vR, a, a + pMax, nMax, 1.0, EPattern_FF);
+    directions.add(waveK, vR, a + pMax, a, nMax, iZ, HPattern_FF);
+
+    if(excitation->SH_cond && geometry->objects[j].kind() == Scatterer::arbitrary_shape) {
+      auto const b = scatter_coef_SH.data() + j * 2 * pMaxS;
+      directions.add(2.0 * waveK, vR, b, b + pMaxS, nMaxS, 1.0, EPattern_SH);
+      directions.add(2.0 * waveK, vR, b + pMaxS, b, nMaxS, iZ, HPattern_SH);
     }
-    
-   }
-
-  } // if
- 
- 
-  else // Inside a particle
- 
-    {
-     // FF  
-    Rrel = Tools::toPoint(R_, geometry->objects[intInd].vR);
-    
-    optimet::AuxCoefficients aCoefFF(Rrel, waveK_0 * sqrt(geometry->objects[intInd].elmag.epsilon_r *
-                                                      geometry->objects[intInd].elmag.mu_r), 1, nMax); //regular VSWFs
-                                                      
-                                   
-    std::complex<double> iZ_object = (consCmi / sqrt(geometry->objects[intInd].elmag.mu /
-                                                     geometry->objects[intInd].elmag.epsilon));
-                                                                                                     
-  
-    for(p = 0; p < p.max(nMax); p++) {
-      Efield_FF =
-          Efield_FF +
-          (aCoefFF.M(static_cast<long>(p)) * internal_coef[intInd * 2 * pMax + p.compound] +
-           aCoefFF.N(static_cast<long>(p)) * internal_coef[pMax + intInd * 2 * pMax + p.compound]);
-           
-                
-      Hfield_FF =
-          Hfield_FF +
-          (aCoefFF.N(static_cast<long>(p)) * internal_coef[intInd * 2 * pMax + p.compound] +
-           aCoefFF.M(static_cast<long>(p)) * internal_coef[pMax + intInd * 2 * pMax + p.compound]) *
-              iZ_object; 
-                               
-    }
-    
-    
-    // SH
-  if(excitation->SH_cond){  
-  optimet::AuxCoefficients aCoefSH(Rrel, std::complex<double> (2.0 , 0.0) * waveK_0 * 
-sqrt(geometry->objects[intInd].elmag.epsilon_r_SH * geometry->objects[intInd].elmag.mu_r_SH), 1, nMaxS); // regular VSWFs
-                                   
-                                   
-    std::complex<double> iZ_object_SH = (consCmi / sqrt(geometry->objects[intInd].elmag.mu_SH /
-                                                     geometry->objects[intInd].elmag.epsilon_SH));
-                                                                                                                                                       
-
-    for(p = 0; p < p.max(nMaxS); p++) {
-
-   if (geometry->objects[intInd].scatterer_type == "arbitrary.shape"){
-    cmnSH =  (1.0/waveK_0) * internal_coef_SH[intInd * 2 * pMaxS + p.compound];
-    
-    dmnSH =  (1.0/waveK_0) * internal_coef_SH[pMaxS + intInd * 2 * pMaxS + p.compound];
-    }
-    
-     Efield_SH =
-          Efield_SH +
-          (aCoefSH.M(static_cast<long>(p)) * (cmnSH) +
-           aCoefSH.N(static_cast<long>(p)) * (dmnSH)) * (waveK_0);
-           
-      Egamma_SH = Egamma_SH +
-             (aCoefSH.Xm(static_cast<long>(p)) * coeffXmn[p] +
-            aCoefSH.Xp(static_cast<long>(p)) * coeffXpl[p]);
-        
-      Hfield_SH =
-          Hfield_SH +
-          (aCoefSH.N(static_cast<long>(p)) * (cmnSH) +
-           aCoefSH.M(static_cast<long>(p)) * (dmnSH)) * iZ_object_SH * waveK_0;
-             
-   } 
- }    
-}
-
-  if(projection_) {
-    SphericalP<std::complex<double>> SphEField;
-    SphericalP<std::complex<double>> SphHField;
-    Rrel = Tools::toPoint(R_, geometry->objects[0].vR);
-
-    SphEField = Tools::fromProjection(Rrel, Einc_FF + Efield_FF);
-    SphHField = Tools::fromProjection(Rrel, Hinc_FF + Hfield_FF);
-    
-    EField_FF = SphEField;
-    HField_FF = SphHField;
-      
-    
-  } else {
-    EField_FF = Einc_FF + Efield_FF;
-    HField_FF = Hinc_FF + Hfield_FF;
-   
-    EField_SH = Efield_SH + Egamma_SH;
-    HField_SH = Hfield_SH;
- 
- 
   }
-  
 }
 
 #ifdef OPTIMET_MPI
 double Result::getExtinctionCrossSection(int gran1, int gran2) {
-  CompoundIterator p;
   int pMax = Tools::iteratorMax(nMax);
 
   double Cext(0.);
-  std::complex<double> *Q_local = new std::complex<double>[2 * pMax];
+  Vector<t_complex> Q_local(2 * pMax);
 
+  // the source vector of the solver holds the incident coefficients about each object
+  bool const sources = incident_coef.size() == scatter_coef.size();
   for(int j = gran1; j < gran2; j++) {
-
-    excitation->getIncLocal(geometry->objects[j].vR, Q_local, nMax);
-    for(p = 0; p < pMax; p++) {
-      Cext += std::real(std::conj(Q_local[p]) * scatter_coef[j * 2 * pMax + p.compound] +
-                        std::conj(Q_local[p.compound + pMax]) *
-                            scatter_coef[pMax + j * 2 * pMax + p.compound]);
-    }
+    if(sources)
+      Q_local = incident_coef.segment(j * 2 * pMax, 2 * pMax);
+    else
+      excitation->getIncLocal(geometry->objects[j].vR, Q_local.data(), nMax, couplings.get());
+    Cext += std::real(Q_local.dot(scatter_coef.segment(j * 2 * pMax, 2 * pMax)));
   }
-  
-  
 
-  delete[] Q_local;
   return (-1. / (std::real(waveK) * std::real(waveK))) * Cext;
 }
 
-
 double Result::getScatteringCrossSection(int gran1, int gran2) {
- 
-  CompoundIterator p, q;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
+  int pMax = Tools::iteratorMax(nMax);
 
   double temp1(0.0);
-  
-  std::complex<double> **T_AB = new std::complex<double> *[2 * (p.max(nMax))];
-  
-  std::complex<double> *SCcoefpom = new std::complex<double>[2 * pMax];
-  
-  for(p = 0; p < (int)(2 * p.max(nMax)); p++) {
-    T_AB[p] = new std::complex<double>[2 * p.max(nMax)];
-  }
-
-  auto const omega = excitation->omega();
-  
-  int NO = geometry->objects.size();
-  
   for(int j = gran1; j < gran2; j++) {
-
-   Spherical<double> point_ = geometry->objects[j].vR;
-   
-   Spherical<double> Rrel = point_ - Spherical<double>(0.0, 0.0, 0.0);
-  
-   optimet::Coupling const coupling(Rrel,  waveK, nMax, false); 
-   
-    for(p = 0; p < pMax; p++)   {
-    for(q = 0; q < qMax; q++) {
-    
-      T_AB[p][q] = coupling.diagonal(q, p);
-      T_AB[p + pMax][q + qMax] = coupling.diagonal(q, p);
-      T_AB[p + pMax][q] = coupling.offdiagonal(q, p);
-      T_AB[p][q + qMax] = coupling.offdiagonal(q, p);
-      
-    }
-  }
-  
-  for(p = 0; p < 2 * pMax; p++) {
-  
-  SCcoefpom[ p ] = scatter_coef[j * 2 * pMax + p.compound] ;
-  
+    Spherical<double> Rrel = geometry->objects[j].vR - Spherical<double>(0.0, 0.0, 0.0);
+    temp1 += translated_norm((*couplings)(Rrel, waveK, nMax),
+                             scatter_coef.segment(j * 2 * pMax, 2 * pMax));
   }
-  
-   for(p = 0; p < 2 * pMax; p++) {
-   
-    for(q = 0; q < 2 * qMax; q++) {
-
-
-      temp1 += std::real( (T_AB[p][q]) * std::conj(SCcoefpom[q.compound]) * 
-      
-        std::conj(T_AB[p][q]) * SCcoefpom[q.compound] );
-      
 
-    }
-  }  
+  return (1. / (std::real(waveK) * std::real(waveK))) * temp1;
 }
 
-   delete[] SCcoefpom;
+double Result::getScatteringCrossSection_SH(int gran1, int gran2) {
+  int pMax = Tools::iteratorMax(nMaxS);
 
-  for(p = 0; p < 2 * pMax; p++) {
-    delete[] T_AB[p];
+  double temp1(0.0);
+  for(int j = gran1; j < gran2; j++) {
+    // only the arbitrary shapes have SH sources
+    if(geometry->objects[j].kind() != Scatterer::arbitrary_shape)
+      continue;
+    Spherical<double> Rrel = geometry->objects[j].vR - Spherical<double>(0.0, 0.0, 0.0);
+    // waveK is doubled
+    temp1 += translated_norm((*couplings)(Rrel, 2.0 * waveK, nMaxS),
+                             scatter_coef_SH.segment(j * 2 * pMax, 2 * pMax));
   }
 
-  delete[] T_AB;
-  
-  return  (1. / (std::real(waveK) * std::real(waveK)))* temp1 ;
+  double const ArbCf = std::real(waveK) * std::real(waveK);
+  return (1.0 / (4.0 * ArbCf)) * temp1; // frequency doubled because of SH
 }
 
+double Result::getFarFieldCrossSection(FarField const &sphere, std::vector<double> const &weights,
+                                       int gran1, int gran2, bool SH) {
+  t_uint const order = SH ? nMaxS : nMax;
+  t_uint const pMax = Tools::iteratorMax(order);
+  std::complex<double> const k = SH ? 2.0 * waveK : waveK;
+  auto const &coef = SH ? scatter_coef_SH : scatter_coef;
+
+  std::vector<SphericalP<std::complex<double>>> pattern(
+      sphere.directions(), SphericalP<std::complex<double>>(0.0, 0.0, 0.0));
+  for(int j = gran1; j < gran2; j++)
+    if(not SH || geometry->objects[j].kind() == Scatterer::arbitrary_shape) {
+      auto const a = coef.data() + j * 2 * pMax;
+      sphere.add(k, geometry->objects[j].vR, a, a + pMax, order, 1.0, pattern);
+    }
 
-double Result::getScatteringCrossSection_SH(int gran1, int gran2) {
+  // sum of the patterns of all the scatterers, on the root
+  std::vector<t_complex> values;
+  for(auto const &value : pattern)
+    values.insert(values.end(), {value.rrr, value.the, value.phi});
+  int rank;
+  MPI_Comm_rank(*mpi::Communicator(), &rank);
+  if(rank != 0) {
+    MPI_Reduce(values.data(), nullptr, values.size(), MPI_DOUBLE_COMPLEX, MPI_SUM, 0,
+               *mpi::Communicator());
+    return 0;
+  }
+  MPI_Reduce(MPI_IN_PLACE, values.data(), values.size(), MPI_DOUBLE_COMPLEX, MPI_SUM, 0,
+             *mpi::Communicator());
+
+  double temp1(0.0);
+  for(t_uint i = 0; i < sphere.directions(); i++)
+    temp1 += weights[i] * (std::norm(values[3 * i]) + std::norm(values[3 * i + 1]) +
+                           std::norm(values[3 * i + 2]));
+  return (1. / (std::real(k) * std::real(k))) * temp1;
+}
+#endif
  
-  CompoundIterator p, q;
-  int pMax = p.max(nMaxS);
-  int qMax = q.max(nMaxS);
+void Result::getFields(std::vector<double> const &Rr, std::vector<double> const &Rthe,
+                       std::vector<double> const &Rphi, bool projection_,
+                       std::vector<double *> CLGcoeff,
+                       std::vector<SphericalP<std::complex<double>>> &EField_FF,
+                       std::vector<SphericalP<std::complex<double>>> &HField_FF,
+                       std::vector<SphericalP<std::complex<double>>> &EField_SH,
+                       std::vector<SphericalP<std::complex<double>>> &HField_SH,
+                       std::vector<std::vector<SphericalP<std::complex<double>>>> *partFields) {
+  std::vector<Spherical<double>> R(Rr.size());
+  for(t_uint i = 0; i < Rr.size(); i++)
+    R[i] = Spherical<double>(Rr[i], Rthe[i], Rphi[i]);
+  getFields(locate(R), projection_, CLGcoeff, EField_FF, HField_FF, EField_SH, HField_SH,
+            partFields);
+}
 
-  double temp1(0.0), ArbCf;
-  
-  std::complex<double> **T_AB = new std::complex<double> *[2 * (p.max(nMaxS))];
-  
-  std::complex<double> *SCcoefpom_SH = new std::complex<double>[2 * pMax];
-  
-  for(p = 0; p < (int)(2 * p.max(nMaxS)); p++) {
-    T_AB[p] = new std::complex<double>[2 * p.max(nMaxS)];
+void Result::radialTables(Cartesian<double> const &low, Cartesian<double> const &high,
+                          t_real tolerance) {
+  radial_.clear();
+  if(not(tolerance > 0))
+    return;
+  // the nearest and farthest distances of the box to a center
+  auto const range = [&](Cartesian<double> const &c) {
+    t_real near = 0, far = 0;
+    for(auto const &axis : {std::make_tuple(c.x, low.x, high.x),
+                            std::make_tuple(c.y, low.y, high.y),
+                            std::make_tuple(c.z, low.z, high.z)}) {
+      t_real const x = std::get<0>(axis), lo = std::get<1>(axis), hi = std::get<2>(axis);
+      t_real const gap = std::max({lo - x, x - hi, 0.0});
+      t_real const edge = std::max(std::abs(x - lo), std::abs(x - hi));
+      near += gap * gap;
+      far += edge * edge;
+    }
+    return std::make_pair(std::sqrt(near), std::sqrt(far));
+  };
+  // the interval and order of each table, merged over its uses
+  std::map<std::tuple<int, t_real, t_real>, std::tuple<t_real, t_real, t_uint>> uses;
+  auto const use = [&](BESSEL_TYPE type, t_complex k, t_real rmin, t_real rmax, t_uint order) {
+    auto const key = std::make_tuple(static_cast<int>(type), k.real(), k.imag());
+    auto const found = uses.find(key);
+    if(found == uses.end())
+      uses.emplace(key, std::make_tuple(rmin, rmax, order));
+    else
+      found->second = std::make_tuple(std::min(rmin, std::get<0>(found->second)),
+                                      std::max(rmax, std::get<1>(found->second)),
+                                      std::max(order, std::get<2>(found->second)));
+  };
+
+  auto const &objects = geometry->objects;
+  bool const SH = excitation->SH_cond;
+  // the incident field about the origin
+  auto const origin = range(Cartesian<double>(0, 0, 0));
+  use(Bessel, waveK, origin.first, origin.second, nMax);
+  // the scattered fields about each object and the center of the cluster, the Hankel functions
+  // starting away from the centers, and the internal fields within each object
+  t_complex const waveK_0 = excitation->omega() * std::sqrt(consEpsilon0 * consMu0);
+  std::vector<Cartesian<double>> centers;
+  std::vector<t_real> floors;
+  for(auto const &object : objects) {
+    centers.push_back(Tools::toCartesian(object.vR));
+    floors.push_back(1e-2 * object.radius);
+    use(Bessel, waveK_0 * sqrt(object.elmag.epsilon_r * object.elmag.mu_r), 0, object.radius,
+        nMax);
+    if(SH)
+      use(Bessel,
+          std::complex<double>(2.0, 0.0) * waveK_0 *
+              sqrt(object.elmag.epsilon_r_SH * object.elmag.mu_r_SH),
+          0, object.radius, nMaxS);
+  }
+  if(clusterOrder > 0) {
+    centers.push_back(Tools::toCartesian(clusterCenter));
+    floors.push_back(clusterRadius);
+  }
+  for(std::size_t j = 0; j < centers.size(); j++) {
+    auto const about = range(centers[j]);
+    t_real const rmin = std::max(about.first, floors[j]);
+    if(not(about.second > rmin))
+      continue;
+    use(Hankel1, waveK, rmin, about.second, std::max(nMax, clusterOrder));
+    if(SH)
+      use(Hankel1, std::complex<double>(2.0, 0.0) * waveK, rmin, about.second,
+          std::max(nMaxS, clusterOrderS));
   }
 
-  double mu_b_r = std::real(geometry->bground.mu_r);
-
-  double eps_b_r = std::real(geometry->bground.epsilon_r);
+  for(auto const &entry : uses) {
+    auto const &key = entry.first;
+    t_real const rmin = std::get<0>(entry.second), rmax = std::get<1>(entry.second);
+    if(not(rmax > rmin))
+      continue;
+    radial_[key] = std::make_shared<RadialTable const>(
+        static_cast<BESSEL_TYPE>(std::get<0>(key)), t_complex(std::get<1>(key), std::get<2>(key)),
+        rmin, rmax, std::get<2>(entry.second), tolerance);
+  }
+}
 
-  auto const omega = excitation->omega();
-  
-  for(int j = gran1; j < gran2; j++) {
+RadialTable const *Result::radial(BESSEL_TYPE type, t_complex waveK_, t_uint order) const {
+  auto const found =
+      radial_.find(std::make_tuple(static_cast<int>(type), waveK_.real(), waveK_.imag()));
+  if(found == radial_.end() or found->second->max_order() < static_cast<long int>(order))
+    return nullptr;
+  return found->second.get();
+}
 
-   Spherical<double> point_ = geometry->objects[j].vR;
-   
-   Spherical<double> Rrel = point_ - Spherical<double>(0.0, 0.0, 0.0);
-  
-   optimet::Coupling const coupling(Rrel,  2.0 * waveK, nMaxS, false);  // waveK is doubled
-   
-    for(p = 0; p < pMax; p++)   {
-    for(q = 0; q < qMax; q++) {
-    
-      T_AB[p][q] = coupling.diagonal(q, p);
-      T_AB[p + pMax][q + qMax] = coupling.diagonal(q, p);
-      T_AB[p + pMax][q] = coupling.offdiagonal(q, p);
-      T_AB[p][q + qMax] = coupling.offdiagonal(q, p);
-      
+void Result::fieldParts(std::vector<FieldPart> const &parts_) {
+  parts = parts_;
+  t_uint const pMax = Tools::iteratorMax(nMax);
+  auto const nobj = geometry->objects.size();
+  for(auto &part : parts) {
+    if(not part.dominant)
+      continue;
+    // the harmonic of the largest sum over the scatterers of the squares of its coefficients
+    t_uint best = 0;
+    t_real largest = -1;
+    for(t_uint p = 0; p < pMax; p++) {
+      t_real sum = 0;
+      for(t_uint j = 0; j < nobj; j++) {
+        if(part.component != FieldPart::TM)
+          sum += std::norm(scatter_coef(j * 2 * pMax + p));
+        if(part.component != FieldPart::TE)
+          sum += std::norm(scatter_coef(j * 2 * pMax + pMax + p));
+      }
+      if(sum > largest) {
+        largest = sum;
+        best = p;
+      }
     }
+    part.n = static_cast<t_int>(std::sqrt(best + 1e0));
+    part.m = static_cast<t_int>(best) + 1 - part.n * (part.n + 1);
   }
-  
-  for(p = 0; p < 2*pMax; p++) {
+}
 
-  if (geometry->objects[0].scatterer_type == "arbitrary.shape"){
-  SCcoefpom_SH[ p ] = scatter_coef_SH[j * 2 * pMax + p.compound];
-  
-  ArbCf = std::real(waveK) * std::real(waveK);
+Result::Located Result::locate(std::vector<Spherical<double>> const &R) const {
+  t_uint const nAngular = std::max(nMax, nMaxS);
+  auto const &objects = geometry->objects;
+  Located result;
+  result.R = R;
+  // the angular functions come from the cartesian offsets of the points, which spares the inverse
+  // trigonometric functions of their spherical coordinates about each object
+  result.X.resize(R.size());
+  for(t_uint i = 0; i < R.size(); i++)
+    result.X[i] = Tools::toCartesian(R[i]);
+  result.inner.resize(objects.size());
+  result.distance.resize(objects.size());
+  result.scattered.resize(objects.size());
+  result.internal.resize(objects.size());
+  // -1 outside all of them
+  auto const located = geometry->checkInner(R);
+  for(t_uint i = 0; i < R.size(); i++) {
+    if(located[i] < 0)
+      result.outer.push_back(i);
+    else
+      result.inner[located[i]].push_back(i);
   }
- }
-  
-   for(p = 0; p < 2 * pMax; p++) {
-   
-    for(q = 0; q < 2 * qMax; q++) {
 
+  std::vector<Cartesian<double>> Xout(result.outer.size());
+  for(t_uint i = 0; i < result.outer.size(); i++)
+    Xout[i] = result.X[result.outer[i]];
+  result.incident = std::make_shared<AuxAngular const>(Xout, Cartesian<double>(0, 0, 0), nMax);
+  result.nearest.resize(objects.size());
+  for(t_uint j = 0; j < objects.size(); j++) {
+    auto const center = Tools::toCartesian(objects[j].vR);
+    result.nearest[j] = by_distance(Xout, center);
+    std::vector<Cartesian<double>> Xnear(Xout.size());
+    for(t_uint i = 0; i < Xout.size(); i++)
+      Xnear[i] = Xout[result.nearest[j][i]];
+    result.scattered[j] = std::make_shared<AuxAngular const>(Xnear, center, nAngular);
+    auto const &indices = result.inner[j];
+    if(indices.empty())
+      continue;
+    std::vector<Cartesian<double>> Xin(indices.size());
+    for(t_uint i = 0; i < indices.size(); i++) {
+      Xin[i] = result.X[indices[i]];
+      result.distance[j].push_back(Tools::findDistance(Xin[i], center));
+    }
+    result.internal[j] = std::make_shared<AuxAngular const>(Xin, center, nAngular);
+  }
+  return result;
+}
 
-      temp1 += std::real( (T_AB[p][q]) * std::conj(SCcoefpom_SH[q.compound]) * 
-      
-        std::conj(T_AB[p][q]) * SCcoefpom_SH[q.compound] );
-      
+void Result::getFields(Located const &located, bool projection_, std::vector<double *> CLGcoeff,
+                       std::vector<SphericalP<std::complex<double>>> &EField_FF,
+                       std::vector<SphericalP<std::complex<double>>> &HField_FF,
+                       std::vector<SphericalP<std::complex<double>>> &EField_SH,
+                       std::vector<SphericalP<std::complex<double>>> &HField_SH,
+                       std::vector<std::vector<SphericalP<std::complex<double>>>> *partFields) {
+  if(single)
+    fields<float>(located, projection_, CLGcoeff, EField_FF, HField_FF, EField_SH, HField_SH,
+                  partFields);
+  else
+    fields<t_real>(located, projection_, CLGcoeff, EField_FF, HField_FF, EField_SH, HField_SH,
+                   partFields);
+}
 
+template <class REAL>
+void Result::fields(Located const &located, bool projection_, std::vector<double *> CLGcoeff,
+                    std::vector<SphericalP<std::complex<double>>> &EField_FF,
+                    std::vector<SphericalP<std::complex<double>>> &HField_FF,
+                    std::vector<SphericalP<std::complex<double>>> &EField_SH,
+                    std::vector<SphericalP<std::complex<double>>> &HField_SH,
+                    std::vector<std::vector<SphericalP<std::complex<double>>>> *partFields) {
+  typedef BasicAuxCoefficientsBatch<REAL> Batch;
+  auto const &R = located.R;
+  auto const &outer = located.outer;
+  auto const &inner = located.inner;
+  auto const points = R.size();
+  auto const omega = excitation->omega();
+  const std::complex<double> waveK_0 = (omega) * std::sqrt(consEpsilon0 * consMu0);
+  std::complex<double> iZ = (consCmi / sqrt(geometry->bground.mu / geometry->bground.epsilon));
+  t_uint const pMax = Tools::iteratorMax(nMax);
+  t_uint const pMaxS = Tools::iteratorMax(nMaxS);
+  t_uint const nAngular = std::max(nMax, nMaxS);
+  std::complex<double> const zero(0.0, 0.0);
+
+  FieldBatch<REAL> Einc_FF, Hinc_FF, Efield_FF, Hfield_FF, Efield_SH, Hfield_SH;
+  EField_FF.assign(points, SphericalP<std::complex<double>>(zero, zero, zero));
+  HField_FF.assign(points, SphericalP<std::complex<double>>(zero, zero, zero));
+  EField_SH.assign(points, SphericalP<std::complex<double>>(zero, zero, zero));
+  HField_SH.assign(points, SphericalP<std::complex<double>>(zero, zero, zero));
+
+  // E then H of each part, each one more accumulation of the VSWFs of the FF fields
+  t_uint const nparts = partFields ? parts.size() : 0;
+  if(partFields)
+    partFields->assign(2 * nparts, std::vector<SphericalP<std::complex<double>>>(
+                                       points, SphericalP<std::complex<double>>(zero, zero, zero)));
+  std::vector<FieldBatch<REAL>> Epart(nparts), Hpart(nparts);
+  // Adds the FF fields of the parts of expansion c of the given order, with their factors
+  auto const add_parts = [&](Batch const &batch, t_complex const *c, t_uint order,
+                             t_complex iZ_, t_uint size) {
+    t_uint const p = Tools::iteratorMax(order);
+    for(t_uint k = 0; k < nparts; k++) {
+      auto const &part = parts[k];
+      t_uint const first = part.n > 0 ? part.n * (part.n + 1) + part.m - 1 : 0;
+      t_uint const last = part.n > 0 ? std::min(first + 1, p) : p;
+      auto const a = part.component != FieldPart::TM ? c : nullptr;
+      auto const b = part.component != FieldPart::TE ? c + p : nullptr;
+      Epart[k].reset(size);
+      Hpart[k].reset(size);
+      Epart[k].add(batch, Batch::M_, a, Batch::N_, b, 1.0, last, 0, first);
+      Hpart[k].add(batch, Batch::N_, a, Batch::M_, b, iZ_, last, 0, first);
+    }
+  };
+
+  if(not outer.empty()) {
+    // Incoming field
+    Batch const aCoefInc(*located.incident, 0, outer.size(), waveK, 1, nMax,
+                         radial(Bessel, waveK, nMax)); // regular VSWFs
+    Einc_FF.reset(outer.size());
+    Hinc_FF.reset(outer.size());
+    Einc_FF.add(aCoefInc, Batch::M_, excitation->dataIncAp.data(),
+                Batch::N_, excitation->dataIncBp.data(), 1.0, pMax);
+    Hinc_FF.add(aCoefInc, Batch::N_, excitation->dataIncAp.data(),
+                Batch::M_, excitation->dataIncBp.data(), iZ, pMax);
+
+    for(t_uint i = 0; i < outer.size(); i++) {
+      EField_FF[outer[i]] = Einc_FF(i);
+      HField_FF[outer[i]] = Hinc_FF(i);
     }
-  }  
-}
 
-   delete[] SCcoefpom_SH;
+    // The angular functions of the points subset of outer about center, the subset sorted by
+    // increasing distance to it
+    auto const about = [&](std::vector<t_uint> &subset, Spherical<double> const &center,
+                           t_uint order) {
+      std::vector<Cartesian<double>> Xsub(subset.size());
+      for(t_uint i = 0; i < subset.size(); i++)
+        Xsub[i] = located.X[outer[subset[i]]];
+      auto const c = Tools::toCartesian(center);
+      auto const sorted = by_distance(Xsub, c);
+      std::vector<t_uint> const unsorted = subset;
+      for(t_uint i = 0; i < subset.size(); i++) {
+        subset[i] = unsorted[sorted[i]];
+        Xsub[i] = located.X[outer[subset[i]]];
+      }
+      return std::make_shared<AuxAngular const>(Xsub, c, order);
+    };
+    // Adds the fields of outgoing expansions to the points subset of outer, with their angular
+    // functions. FF and SH share the angular functions. The expansions are pruned to the
+    // effective order of each range of points, unless the parts need all the orders.
+    t_real const tolerance = nparts > 0 ? 0 : pruning;
+    auto const scattered = [&](std::vector<t_uint> const &subset, AuxAngular const &angular,
+                               t_uint order, t_complex const *a, t_uint orderS,
+                               t_complex const *b) {
+      t_uint const p = Tools::iteratorMax(order);
+      t_uint const pS = Tools::iteratorMax(orderS);
+
+      t_uint first = 0;
+      for(auto const &range : pruned_ranges(angular, waveK, a, order, tolerance)) {
+        t_uint const last = range.first, n = range.second, size = last - first;
+        Batch const aCoefFF(angular, first, last, waveK, 0, n,
+                            radial(Hankel1, waveK, n)); // radiative VSWFs
+        Efield_FF.reset(size);
+        Hfield_FF.reset(size);
+        Efield_FF.add(aCoefFF, Batch::M_, a, Batch::N_, a + p, 1.0, Tools::iteratorMax(n));
+        Hfield_FF.add(aCoefFF, Batch::N_, a, Batch::M_, a + p, iZ, Tools::iteratorMax(n));
+        add_parts(aCoefFF, a, order, iZ, size);
+        for(t_uint i = first; i < last; i++) {
+          auto const k = outer[subset[i]];
+          EField_FF[k] = EField_FF[k] + Efield_FF(i - first);
+          HField_FF[k] = HField_FF[k] + Hfield_FF(i - first);
+          for(t_uint part = 0; part < nparts; part++) {
+            (*partFields)[2 * part][k] = (*partFields)[2 * part][k] + Epart[part](i - first);
+            (*partFields)[2 * part + 1][k] =
+                (*partFields)[2 * part + 1][k] + Hpart[part](i - first);
+          }
+        }
+        first = last;
+      }
 
-  for(p = 0; p < 2 * pMax; p++) {
-    delete[] T_AB[p];
+      if(not b)
+        return;
+      t_complex const waveKS = std::complex<double>(2.0, 0.0) * waveK;
+      first = 0;
+      for(auto const &range : pruned_ranges(angular, waveKS, b, orderS, tolerance)) {
+        t_uint const last = range.first, n = range.second, size = last - first;
+        Batch const aCoefSH(angular, first, last, waveKS, 0, n,
+                            radial(Hankel1, waveKS, n)); // radiative VSWF
+        Efield_SH.reset(size);
+        Hfield_SH.reset(size);
+        Efield_SH.add(aCoefSH, Batch::M_, b, Batch::N_, b + pS, 1.0, Tools::iteratorMax(n));
+        Hfield_SH.add(aCoefSH, Batch::N_, b, Batch::M_, b + pS, iZ, Tools::iteratorMax(n));
+        for(t_uint i = first; i < last; i++) {
+          auto const k = outer[subset[i]];
+          EField_SH[k] = EField_SH[k] + Efield_SH(i - first);
+          HField_SH[k] = HField_SH[k] + Hfield_SH(i - first);
+        }
+        first = last;
+      }
+    };
+
+    // Outside the sphere circumscribing the cluster, its single expansion replaces the sum over
+    // the scatterers
+    std::vector<t_uint> near, distant;
+    auto const cluster = Tools::toCartesian(clusterCenter);
+    for(t_uint i = 0; i < outer.size(); i++)
+      if(clusterOrder > 0 && Tools::findDistance(located.X[outer[i]], cluster) > clusterRadius)
+        distant.push_back(i);
+      else
+        near.push_back(i);
+
+    // the angular functions of the located points, unless some of them are distant
+    if(not near.empty())
+      for(size_t j = 0; j < geometry->objects.size(); j++) {
+        t_complex const *const a = scatter_coef.data() + j * 2 * pMax;
+        t_complex const *const b =
+            excitation->SH_cond && geometry->objects[j].kind() == Scatterer::arbitrary_shape ?
+                scatter_coef_SH.data() + j * 2 * pMaxS :
+                nullptr;
+        if(distant.empty())
+          scattered(located.nearest[j], *located.scattered[j], nMax, a, nMaxS, b);
+        else {
+          auto const angular = about(near, geometry->objects[j].vR, nAngular);
+          scattered(near, *angular, nMax, a, nMaxS, b);
+        }
+      }
+    if(not distant.empty()) {
+      auto const angular = about(distant, clusterCenter, std::max(clusterOrder, clusterOrderS));
+      scattered(distant, *angular, clusterOrder, cluster_coef.data(), clusterOrderS,
+                excitation->SH_cond ? cluster_coef_SH.data() : nullptr);
+    }
   }
 
-  delete[] T_AB;
-  
-  return  (1.0 / (4.0 * ArbCf))* temp1 ; // frequency doubled because of SH
-}
-#endif
- 
-  #ifdef OPTIMET_MPI
-  int Result::setFields(std::vector<double> &Rr, std::vector<double> 
-                           &Rthe, std::vector<double> &Rphi, bool projection_, std::vector<double *> CLGcoeff) {
-  
-  Spherical<double> Rloc, Rrel;
-  
-  int sizeField;
-  
-  CompoundIterator p;
+  for(size_t j = 0; j < geometry->objects.size(); j++) {
+    auto const &indices = inner[j];
+    if(indices.empty())
+      continue;
+    auto const &object = geometry->objects[j];
+    auto const &distance = located.distance[j];
+    auto const &angular = *located.internal[j];
 
-  int pMaxS = p.max(nMaxS);
- 
-  std::complex<double> coeffXpl[pMaxS], coeffXmn[pMaxS];
-    
-  // Calculate the fields Fundamental Frequency and SH Frequency
-
-    SphericalP<std::complex<double>> EField_FF;
-    SphericalP<std::complex<double>> HField_FF;
-    SphericalP<std::complex<double>> EField_SH;
-    SphericalP<std::complex<double>> HField_SH;
-    
-    std::vector<std::complex<double>> EField_FF_x;
-    std::vector<std::complex<double>> EField_FF_y;
-    std::vector<std::complex<double>> EField_FF_z;
-    std::vector<std::complex<double>> HField_FF_x;
-    std::vector<std::complex<double>> HField_FF_y;
-    std::vector<std::complex<double>> HField_FF_z;
-    
-    std::vector<std::complex<double>> EField_SH_x;
-    std::vector<std::complex<double>> EField_SH_y;
-    std::vector<std::complex<double>> EField_SH_z;
-    std::vector<std::complex<double>> HField_SH_x;
-    std::vector<std::complex<double>> HField_SH_y;
-    std::vector<std::complex<double>> HField_SH_z;
-   
-    
-    for (int ii=0; ii<Rr.size(); ii++){
-
-    Rloc.rrr = Rr[ii];
-    Rloc.the = Rthe[ii];
-    Rloc.phi = Rphi[ii];
-
-    int intInd = geometry->checkInner(Rloc);
-    
-    if(intInd >= 0){
-    
-    Rrel = Tools::toPoint(Rloc, geometry->objects[intInd].vR);
-    geometry->COEFFpartSH(intInd, excitation, internal_coef, Rrel.rrr, nMaxS, coeffXmn, coeffXpl, CLGcoeff);
-    
+    // FF
+    t_complex const waveK_object = waveK_0 * sqrt(object.elmag.epsilon_r * object.elmag.mu_r);
+    Batch const aCoefFF(angular, 0, indices.size(), waveK_object, 1, nMax,
+                        radial(Bessel, waveK_object, nMax)); // regular VSWFs
+    std::complex<double> iZ_object =
+        (consCmi / sqrt(object.elmag.mu / object.elmag.epsilon));
+    auto const c = internal_coef.data() + j * 2 * pMax;
+    Efield_FF.reset(indices.size());
+    Hfield_FF.reset(indices.size());
+    Efield_FF.add(aCoefFF, Batch::M_, c, Batch::N_, c + pMax, 1.0, pMax);
+    Hfield_FF.add(aCoefFF, Batch::N_, c, Batch::M_, c + pMax, iZ_object, pMax);
+    add_parts(aCoefFF, c, nMax, iZ_object, indices.size());
+
+    // SH
+    Efield_SH.reset(indices.size());
+    Hfield_SH.reset(indices.size());
+    if(excitation->SH_cond) {
+      t_complex const waveK_object_SH = std::complex<double>(2.0, 0.0) * waveK_0 *
+                                        sqrt(object.elmag.epsilon_r_SH * object.elmag.mu_r_SH);
+      Batch const aCoefSH(angular, 0, indices.size(), waveK_object_SH, 1, nMaxS,
+                          radial(Bessel, waveK_object_SH, nMaxS)); // regular VSWFs
+      std::complex<double> iZ_object_SH =
+          (consCmi / sqrt(object.elmag.mu_SH / object.elmag.epsilon_SH));
+
+      if(object.kind() == Scatterer::arbitrary_shape) {
+        auto const d = internal_coef_SH.data() + j * 2 * pMaxS;
+        Efield_SH.add(aCoefSH, Batch::M_, d, Batch::N_, d + pMaxS, 1.0, pMaxS);
+        Hfield_SH.add(aCoefSH, Batch::N_, d, Batch::M_, d + pMaxS, iZ_object_SH, pMaxS);
+      }
+
+      // Particular solution, computed once per distance to the center
+      std::map<double, std::vector<std::complex<double>>> particular;
+      ArenaVector<std::complex<double>> coeffXmn(pMaxS * indices.size()),
+          coeffXpl(pMaxS * indices.size());
+      for(t_uint i = 0; i < indices.size(); i++) {
+        auto found = particular.find(distance[i]);
+        if(found == particular.end()) {
+          std::vector<std::complex<double>> coefficients(2 * pMaxS);
+          geometry->COEFFpartSH(j, excitation, internal_coef, distance[i], nMaxS,
+                                coefficients.data(), coefficients.data() + pMaxS, CLGcoeff);
+          found = particular.emplace(distance[i], std::move(coefficients)).first;
+        }
+        for(t_uint p = 0; p < pMaxS; p++) {
+          coeffXmn[p * indices.size() + i] = found->second[p];
+          coeffXpl[p * indices.size() + i] = found->second[pMaxS + p];
+        }
+      }
+      Efield_SH.add(aCoefSH, Batch::Xm_, coeffXmn.data(), Batch::Xp_, coeffXpl.data(), 1.0,
+                    pMaxS, indices.size());
+    }
+
+    for(t_uint i = 0; i < indices.size(); i++) {
+      EField_FF[indices[i]] = Efield_FF(i);
+      HField_FF[indices[i]] = Hfield_FF(i);
+      EField_SH[indices[i]] = Efield_SH(i);
+      HField_SH[indices[i]] = Hfield_SH(i);
+      for(t_uint part = 0; part < nparts; part++) {
+        (*partFields)[2 * part][indices[i]] = Epart[part](i);
+        (*partFields)[2 * part + 1][indices[i]] = Hpart[part](i);
+      }
     }
-   
-    getEHFields(Rloc, EField_FF, HField_FF, EField_SH, HField_SH, projection_, coeffXmn, coeffXpl);
-    
-    EField_FF_x.push_back (EField_FF.rrr);
-    EField_FF_y.push_back (EField_FF.the);
-    EField_FF_z.push_back (EField_FF.phi);
-    HField_FF_x.push_back (HField_FF.rrr);
-    HField_FF_y.push_back (HField_FF.the);
-    HField_FF_z.push_back (HField_FF.phi);
-
-    EField_SH_x.push_back (EField_SH.rrr);
-    EField_SH_y.push_back (EField_SH.the);
-    EField_SH_z.push_back (EField_SH.phi);
-    HField_SH_x.push_back (HField_SH.rrr);
-    HField_SH_y.push_back (HField_SH.the);
-    HField_SH_z.push_back (HField_SH.phi);
-
-   
-}//for
-
-
-   sizeField = EField_FF_x.size();
-   
-   MPI_Send(&EField_FF_x[0], EField_FF_x.size(), MPI_DOUBLE_COMPLEX, 0, 1, MPI_COMM_WORLD);
-   MPI_Send(&EField_FF_y[0], EField_FF_y.size(), MPI_DOUBLE_COMPLEX, 0, 2, MPI_COMM_WORLD);
-   MPI_Send(&EField_FF_z[0], EField_FF_z.size(), MPI_DOUBLE_COMPLEX, 0, 3, MPI_COMM_WORLD);   
-   MPI_Send(&HField_FF_x[0], HField_FF_x.size(), MPI_DOUBLE_COMPLEX, 0, 4, MPI_COMM_WORLD);
-   MPI_Send(&HField_FF_y[0], HField_FF_y.size(), MPI_DOUBLE_COMPLEX, 0, 5, MPI_COMM_WORLD);
-   MPI_Send(&HField_FF_z[0], HField_FF_z.size(), MPI_DOUBLE_COMPLEX, 0, 6, MPI_COMM_WORLD);
-
-   MPI_Send(&EField_SH_x[0], EField_SH_x.size(), MPI_DOUBLE_COMPLEX, 0, 7, MPI_COMM_WORLD);
-   MPI_Send(&EField_SH_y[0], EField_SH_y.size(), MPI_DOUBLE_COMPLEX, 0, 8, MPI_COMM_WORLD);
-   MPI_Send(&EField_SH_z[0], EField_SH_z.size(), MPI_DOUBLE_COMPLEX, 0, 9, MPI_COMM_WORLD);
-   MPI_Send(&HField_SH_x[0], HField_SH_x.size(), MPI_DOUBLE_COMPLEX, 0, 10, MPI_COMM_WORLD);
-   MPI_Send(&HField_SH_y[0], HField_SH_y.size(), MPI_DOUBLE_COMPLEX, 0, 11, MPI_COMM_WORLD);
-   MPI_Send(&HField_SH_z[0], HField_SH_z.size(), MPI_DOUBLE_COMPLEX, 0, 12, MPI_COMM_WORLD);
-   
-   MPI_Send(&sizeField, 1, MPI_INT, 0, 13, MPI_COMM_WORLD);
-
-  return 0;
+  }
 
+  if(projection_) {
+    auto const center = Tools::toCartesian(geometry->objects[0].vR);
+    for(t_uint i = 0; i < points; i++) {
+      auto const &X = located.X[i];
+      Cartesian<double> const Rrel(X.x - center.x, X.y - center.y, X.z - center.z);
+      EField_FF[i] = Tools::fromProjection(Rrel, EField_FF[i]);
+      HField_FF[i] = Tools::fromProjection(Rrel, HField_FF[i]);
+      for(t_uint k = 0; k < 2 * nparts; k++)
+        (*partFields)[k][i] = Tools::fromProjection(Rrel, (*partFields)[k][i]);
+      EField_SH[i] = SphericalP<std::complex<double>>(zero, zero, zero);
+      HField_SH[i] = SphericalP<std::complex<double>>(zero, zero, zero);
+    }
+  }
 }
-#endif   
+
 }
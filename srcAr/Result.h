@@ -17,12 +17,20 @@
 #ifndef RESULT_H_
 #define RESULT_H_
 
+#include "AuxCoefficients.h"
 #include "CompoundIterator.h"
+#include "Coupling.h"
 #include "Excitation.h"
+#include "FarField.h"
 #include "Geometry.h"
 #include "OutputGrid.h"
+#include "RadialTable.h"
 #include "Spherical.h"
 #include "SphericalP.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
 #include <vector>
 #ifdef OPTIMET_MPI
 #include <mpi.h>
@@ -30,6 +38,25 @@
 #include <complex>
 
 namespace optimet {
+/**
+ * A part of the FF fields written next to the total fields, from the same
+ * evaluation of the VSWFs: a harmonic, the dominant one or all of them, with
+ * both components or only the TE or TM one. Only the scattered and internal
+ * fields are split, the incident field belonging to no part.
+ */
+struct FieldPart {
+  //! Which of the M and N functions of the expansions the E field of the part keeps
+  enum Component { both, TE, TM };
+  //! Whether the harmonic is the one of the largest scattering coefficients, see Result::fieldParts
+  bool dominant = false;
+  //! The harmonic (n, m) of the part, all of them if n is zero
+  t_int n = 0, m = 0;
+  //! TE keeps the M functions of the E field, TM the N functions
+  Component component = both;
+  //! Suffix of the datasets of the part, e.g. TE, n1m-1 or dominant_TM
+  std::string name() const;
+};
+
 /**
  * The Result class is used to provide post simulation
  * output functions including field profiles, absorption
@@ -47,12 +74,56 @@ private:
   //! Maximum nMax
   optimet::t_uint nMax;
   optimet::t_uint nMaxS;
+  //! Orders of the expansions of the cluster, none if zero
+  optimet::t_uint clusterOrder = 0, clusterOrderS = 0;
+  Spherical<double> clusterCenter; /**< The center of the expansions of the cluster. */
+  double clusterRadius = 0;        /**< The radius of the sphere circumscribing the cluster. */
+  Vector<t_complex> cluster_coef;    /**< The scattering coefficients of the cluster. */
+  Vector<t_complex> cluster_coef_SH; /**< The scattering coefficients of the cluster, SH. */
+  std::vector<FieldPart> parts;      /**< The parts of the FF fields of getFields(). */
+  //! Relative accuracy the outgoing expansions of getFields() are pruned to, none if zero
+  t_real pruning = 0;
+  //! Whether getFields() sums the VSWFs in single precision
+  bool single = false;
+  //! Interpolations of the radial functions of getFields(), by type and wave number
+  std::map<std::tuple<int, t_real, t_real>, std::shared_ptr<RadialTable const>> radial_;
+
+  //! The interpolation of the functions of type and wave number waveK_ up to order, null if none
+  RadialTable const *radial(BESSEL_TYPE type, t_complex waveK_, t_uint order) const;
 public:
+  /**
+   * Points of getFields() sorted by the object they are in, with the angular
+   * functions of their positions relative to the origin and to the objects.
+   * None of it depends on the wavelength, so that the points can be located
+   * once for a whole scan.
+   */
+  struct Located {
+    std::vector<Spherical<double>> R; /**< The points. */
+    std::vector<Cartesian<double>> X; /**< The points, in cartesian coordinates. */
+    std::vector<t_uint> outer;        /**< The points outside all the objects. */
+    std::vector<std::vector<t_uint>> inner; /**< The points inside each object. */
+    //! Distances of the points inside each object to its center
+    std::vector<std::vector<double>> distance;
+    //! The outer points by increasing distance to each object, as indices of outer
+    std::vector<std::vector<t_uint>> nearest;
+    //! Angular functions of the outer points about the origin, and about each object in the
+    //! order of nearest
+    std::shared_ptr<AuxAngular const> incident;
+    std::vector<std::shared_ptr<AuxAngular const>> scattered;
+    //! Angular functions of the inner points of each object, none if empty
+    std::vector<std::shared_ptr<AuxAngular const>> internal;
+  };
+
   Vector<t_complex> scatter_coef;   /**< The scattering coefficients. */
   Vector<t_complex> internal_coef;  /**< The internal coefficients. */
   Vector<t_complex> scatter_coef_SH;   /**< The scattering coefficients. second harmonic */
   Vector<t_complex> internal_coef_SH;  /**< The internal coefficients. second harmonic */
   std::vector<double *> CLGcoeff; // Coefficients needed for SH source calculations
+  //! Couplings from the origin, shared with the solver so that those of its sources are reused
+  std::shared_ptr<optimet::OriginCouplings> couplings;
+  //! \brief The incident coefficients about each object, the source vector of the solver
+  //! \details Computed again by the cross sections if empty.
+  Vector<t_complex> incident_coef;
   /**
    * Initialization constructor for the Result class.
    * Fundamental Frequency version.
@@ -105,16 +176,113 @@ public:
 
 
   /**
-   * Returns the E and H fields at a given point.
-   * @param R_ the coordinates of the point.
-   * @param EField_ SphericalP vector that will store the E field.
-   * @param HField_ SphericalP vector that will store the H field.
+   * Returns the E and H fields at a set of points.
+   * The points are grouped by the particle they are in, if any, and the
+   * spherical functions of each group are evaluated as one batch. With the
+   * spherical projection, only the fundamental frequency is computed.
+   * @param Rr the radial coordinates of the points.
+   * @param Rthe the polar coordinates of the points.
+   * @param Rphi the azimuthal coordinates of the points.
    * @param projection_ defines spherical (1) or cartesian (0) projection.
+   * @param CLGcoeff the Clebsch-Gordan tables of the SH sources.
+   * @param EField_FF the E fields at the fundamental frequency, one per point.
+   * @param HField_FF the H fields at the fundamental frequency, one per point.
+   * @param EField_SH the E fields at the SH frequency, one per point.
+   * @param HField_SH the H fields at the SH frequency, one per point.
+   * @param partFields the E then H fields of each part of fieldParts(), one per point.
+   */
+  void getFields(std::vector<double> const &Rr, std::vector<double> const &Rthe,
+                 std::vector<double> const &Rphi, bool projection_, std::vector<double *> CLGcoeff,
+                 std::vector<SphericalP<std::complex<double>>> &EField_FF,
+                 std::vector<SphericalP<std::complex<double>>> &HField_FF,
+                 std::vector<SphericalP<std::complex<double>>> &EField_SH,
+                 std::vector<SphericalP<std::complex<double>>> &HField_SH,
+                 std::vector<std::vector<SphericalP<std::complex<double>>>> *partFields = nullptr);
+  /**
+   * Sorts points by the object they are in for getFields().
+   * @param R the points.
+   * @return the points with their angular functions, up to nMax and nMaxS.
+   */
+  Located locate(std::vector<Spherical<double>> const &R) const;
+  //! The fields at points located by locate(), as getFields() of their coordinates
+  void getFields(Located const &points, bool projection_, std::vector<double *> CLGcoeff,
+                 std::vector<SphericalP<std::complex<double>>> &EField_FF,
+                 std::vector<SphericalP<std::complex<double>>> &HField_FF,
+                 std::vector<SphericalP<std::complex<double>>> &EField_SH,
+                 std::vector<SphericalP<std::complex<double>>> &HField_SH,
+                 std::vector<std::vector<SphericalP<std::complex<double>>>> *partFields = nullptr);
+
+  /**
+   * Sets the parts of the FF fields getFields() returns next to the totals.
+   * The dominant parts take the harmonic of the largest scattering
+   * coefficients of all the scatterers, of their component, which must be
+   * known. Parts are not available with an expansion of the cluster.
+   * @param parts_ the parts, in the order of their fields.
+   */
+  void fieldParts(std::vector<FieldPart> const &parts_);
+  //! The parts of the FF fields, their dominant harmonics found
+  std::vector<FieldPart> const &fieldParts() const { return parts; }
+
+  /**
+   * Translates the scattering coefficients of all the scatterers into a single
+   * outgoing expansion about the center of the cluster, at each frequency.
+   * getFields() then computes the scattered fields of the points outside the
+   * sphere circumscribing the cluster from these expansions alone.
+   * The scattering coefficients must be known.
+   * @param order the maximum value of the n iterator of the FF expansion, the
+   * SH one being twice as large. If zero, the orders follow the rule of the
+   * FMM with the digits of the geometry.
+   */
+  void clusterExpansion(t_uint order = 0);
+
+  /**
+   * Tabulates the radial functions of the points of getFields() within a box,
+   * which are then interpolated rather than computed. There is one table for
+   * each wave number and type of function, over the distances of the box to
+   * the centers of the expansions. The points outside the tables keep the
+   * functions themselves. Must be called again after clusterExpansion().
+   * @param low the smallest x, y and z of the points.
+   * @param high the largest x, y and z of the points.
+   * @param tolerance the relative accuracy of the interpolation, no tables if zero.
+   */
+  void radialTables(Cartesian<double> const &low, Cartesian<double> const &high,
+                    t_real tolerance);
+
+  /**
+   * Prunes the outgoing expansions of getFields() at each point outside the
+   * objects to the orders whose terms sum above a tolerance, the higher orders
+   * falling off away from the centers. The parts of the fields keep all the
+   * orders.
+   * @param tolerance the relative accuracy of the fields, all the orders if zero.
+   */
+  void pruneFields(t_real tolerance) { pruning = tolerance; }
+
+  /**
+   * Computes the VSWFs of getFields() and sums them in single precision,
+   * which halves their memory traffic. The Bessel functions and the angular
+   * functions are still computed in double precision, and rounded, as are the
+   * coefficients, so that the fields are accurate to about 1e-6 relative to
+   * the largest terms of their expansions.
+   * @param value whether to use single precision.
+   */
+  void singleFields(bool value) { single = value; }
+
+  /**
+   * Returns the radiation patterns of the scattered E and H fields.
+   * The fields behave as exp(i k r) / (k r) times the patterns far from the
+   * scatterers, with the wave number k of each frequency.
+   * @param directions the directions of the patterns, up to nMax and nMaxS.
+   * @param EPattern_FF the E pattern at the fundamental frequency, one per direction.
+   * @param HPattern_FF the H pattern at the fundamental frequency, one per direction.
+   * @param EPattern_SH the E pattern at the SH frequency, one per direction.
+   * @param HPattern_SH the H pattern at the SH frequency, one per direction.
    */
-  void getEHFields(Spherical<double> R_, SphericalP<std::complex<double>> &EField_FF,
-       SphericalP<std::complex<double>> &HField_FF, SphericalP<std::complex<double>> &EField_SH,
-       SphericalP<std::complex<double>> &HField_SH, bool projection_, std::complex<double> *coeffXmn, std::complex<double> *coeffXpl) const;
-                   
+  void getFarField(FarField const &directions,
+                   std::vector<SphericalP<std::complex<double>>> &EPattern_FF,
+                   std::vector<SphericalP<std::complex<double>>> &HPattern_FF,
+                   std::vector<SphericalP<std::complex<double>>> &EPattern_SH,
+                   std::vector<SphericalP<std::complex<double>>> &HPattern_SH) const;
+
   #ifdef OPTIMET_MPI
   //Returns the Extinction Cross Section for Fundamental Frequency.
   double getExtinctionCrossSection(int gran1, int gran2);
@@ -124,21 +292,32 @@ public:
 
   // Returns the Scattering Cross Section for SH Frequency.
   double getScatteringCrossSection_SH(int gran1, int gran2);  
- #endif
 
   /**
-   * Populate a grid with E and H fields.
-   * @param oEGrid_FF the OutputGrid object for the E fields, fundamental freq.
-   * @param oHGrid_FF the OutputGrid object for the H fields, fundamental freq.
-   * @param oEGrid_SH the OutputGrid object for the E fields, SH freq.
-   * @param oHGrid_SH the OutputGrid object for the H fields, SH freq.
-   * @param projection_ defines spherical (1) or cartesian (0) projection.
-   * @return 0 if succesful, 1 otherwise.
+   * Returns the scattering cross section integrated from the radiation pattern
+   * over a quadrature of the directions. The interference between the
+   * scatterers is included and no coupling is computed. Each process adds the
+   * patterns of its scatterers, the total is returned on the root process and
+   * zero on the others, so that the values add up as the other cross sections.
+   * @param sphere the directions of the quadrature.
+   * @param weights the weights of the quadrature, one per direction.
+   * @param gran1 the first scatterer of this process.
+   * @param gran2 one past the last scatterer of this process.
+   * @param SH whether the cross section is at the SH frequency.
    */
-#ifdef OPTIMET_MPI
- int setFields(std::vector<double> &Rr, std::vector<double> &Rthe, 
-std::vector<double> &Rphi, bool projection_, std::vector<double *> CLGcoeff);
-#endif
+  double getFarFieldCrossSection(FarField const &sphere, std::vector<double> const &weights,
+                                 int gran1, int gran2, bool SH);
+ #endif
+
+private:
+  //! getFields() with the VSWFs and their sums of type REAL
+  template <class REAL>
+  void fields(Located const &points, bool projection_, std::vector<double *> CLGcoeff,
+              std::vector<SphericalP<std::complex<double>>> &EField_FF,
+              std::vector<SphericalP<std::complex<double>>> &HField_FF,
+              std::vector<SphericalP<std::complex<double>>> &EField_SH,
+              std::vector<SphericalP<std::complex<double>>> &HField_SH,
+              std::vector<std::vector<SphericalP<std::complex<double>>>> *partFields);
 };
 }
 #endif /* RESULT_H_ */
@@ -17,15 +17,18 @@
 #ifndef OPTIMET_RUN_H_
 #define OPTIMET_RUN_H_
 
-#include "CompoundIterator.h"
+#include "Aliases.h"
 #include "Excitation.h"
 #include "Geometry.h"
+#include "OutputGrid.h"
+#include "Result.h"
 #include "Types.h"
 #include "mpi/Communicator.h"
 #include "scalapack/Context.h"
 #include "scalapack/Parameters.h"
 #include <array>
 #include <memory>
+#include <vector>
 
 #ifdef OPTIMET_BELOS
 #include <Teuchos_ParameterList.hpp>
@@ -58,18 +61,86 @@ public:
   t_int nMaxS; // second harmonic number of spherical harmonics
 
   //! This bit will be moved to the case or where it is appropiate
-  t_int projection;
+  t_int projection = 0;
   std::array<t_real, 9> params;
+  //! Points of a field output: a regular grid of params, or a plane, a line or a list of points
+  t_int gridType = O3DCartesianRegular;
+  //! x, y and z of each point of a plane, a line or a list, params holding the shape of their datasets
+  std::shared_ptr<std::vector<t_real> const> gridPoints;
+  //! Levels of an octree refining the cells of the grid near the surfaces, none if zero
+  t_int octreeLevels = 0;
+  //! Further levels where the cells reach two surfaces, in the gaps between the particles
+  t_int octreeGaps = 0;
   //! Output type required: 0 -> Field, 1 -> Cross Sections, 2 -> Scattering Coefficients
   t_int outputType;
-  //! Output only one mode (harmonic) in the field profile
-  bool singleMode;
-  //! Index of single mode to output in the field profile
-  CompoundIterator singleModeIndex;
-  //! Get dominant mode automatically
-  bool dominantAuto;
-  //! Get only one or both components: 0 -> Both, 1 - > TE, 2 - > TM
-  t_int singleComponent;
+  //! Coefficients of an earlier solve the fields are evaluated from, solved if empty
+  std::string coefficientsFile;
+  //! Parts of the scattered and internal fields written next to the fields, one mode or component
+  std::vector<FieldPart> fieldParts;
+  //! Layout of the HDF5 datasets of the field profile
+  GridStorage fieldStorage;
+  //! Number of points of the field profile handed out at once to a process
+  t_int fieldBlock = 64;
+  //! Relative accuracy of the interpolated radial functions of the field profile, none if zero
+  t_real fieldRadial = 0;
+  //! Mirror planes of the field profile, any of x, y and z, auto to find them, none if empty
+  std::string fieldMirror;
+  //! Relative tolerance the outgoing expansions of the field profile are pruned to, none if zero
+  t_real fieldPrune = 0;
+  //! Whether the VSWFs of the field profile are summed in single precision
+  bool fieldSingle = false;
+  //! Whether the processes reduce the field profile to its statistics, in _Statistics.dat
+  bool fieldStatistics = false;
+  //! Number of points of highest FF enhancement in the statistics
+  t_uint fieldHotspots = 0;
+  //! Bins of the histogram of the FF enhancement, logarithmic from fieldLow to fieldHigh, none if zero
+  t_uint fieldBins = 0;
+  t_real fieldLow = 1e-2, fieldHigh = 1e4;
+  //! Whether the field profile is gathered and written to HDF5, or only reduced to its statistics
+  bool fieldWrite = true;
+  //! Whether the fields far from the scatterers come from a single expansion of the cluster
+  bool clusterExpansion = false;
+  //! Order of the expansion of the cluster, chosen from its size if zero
+  t_uint clusterOrder = 0;
+  //! Whether the scattering cross sections of a scan are integrated from the radiation patterns
+  bool farFieldCrossSection = false;
+  //! Number of polar and azimuthal angles of the radiation patterns of a scan, none if zero
+  t_uint patternTheta = 0, patternPhi = 0;
+  //! Whether the iterations and timings of the iterative solves of a scan are written out
+  bool solverStatistics = false;
+  //! Number of groups of processes sharing out the wavelengths of a scan
+  t_uint scanGroups = 1;
+  //! Wavelengths of a scan written as field maps, each at its closest step
+  std::vector<t_real> fieldWavelengths;
+  //! Whether the steps of a scan at the maxima of the FF scattering cross section are field maps
+  bool fieldMaxima = false;
+  //! Grid of the field maps of a scan, as params for a field output
+  std::array<t_real, 9> fieldGrid;
+  //! Points whose fields are written at every step of a scan, x y z of each in m
+  std::vector<t_real> probes;
+  //! Text file of the positions of the objects in nm, x y z of each for each configuration
+  std::string ensemble;
+  //! Number of groups of processes sharing out the configurations of an ensemble
+  t_uint ensembleGroups = 1;
+  //! Whether a scan averages over the orientations with the T-matrix of the cluster
+  bool analyticAverage = false;
+  //! Order of the T-matrix of the cluster, chosen from its size if zero
+  t_uint averageOrder = 0;
+  //! \brief Lowest order of a convergence study of the scan, none if zero
+  //! \details The orders from it up to nMax, by convergenceStep, are solved at each wavelength.
+  t_uint convergenceFrom = 0;
+  t_uint convergenceStep = 1;
+  //! Number of wavelengths of a scan solved between two checkpoints, none if zero
+  t_uint checkpointEvery = 0;
+  //! Output jobs of a scan queued or written at most in the background, written in place if zero
+  t_uint writerDepth = 0;
+  //! Times the step of a scan can be halved where the cross sections bend, uniform steps if zero
+  t_uint adaptiveLevels = 0;
+  //! Largest distance of the cross sections to their interpolation, relative to their magnitude
+  t_real adaptiveTolerance = 1e-2;
+  //! \brief Largest residual of the solves of a scan within the span of its full solves
+  //! \details All the solves are full if zero.
+  t_real reducedTolerance = 0;
   scalapack::Context context;
   mpi::Communicator communicator;
 
@@ -77,6 +148,20 @@ public:
   bool do_fmm;
   //! Number of subdiagonals when setting up fmm local vs non-local mpi distribution
   t_int fmm_subdiagonals;
+  //! Whether the initial guesses along a wavelength scan are extrapolated from the last two steps
+  bool extrapolate_guess = false;
+  //! Whether the CLG tables are held once per node, in shared memory, rather than by each process
+  bool shared_tables = false;
+  //! Whether the W numbers of the SH sources are computed where they are used, without any CLG tables
+  bool onthefly_tables = false;
+  //! HDF5 file caching the CLG tables between runs, none if empty
+  std::string CLG_library;
+  //! Whether the solver is chosen from its predicted cost, unless the case asks for one
+  bool solver_plan = false;
+  //! Memory of a process the chosen solver may take, in MB
+  t_uint solver_memory = 2048;
+  //! Peak GFLOP/s and GB/s of a process, the roofline of the hardware counters if positive
+  t_real peakGflops = 0, peakBandwidth = 0;
 
   /**
    * Params:
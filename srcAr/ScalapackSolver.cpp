@@ -15,59 +15,312 @@
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
 #include "ScalapackSolver.h"
+#include "AxialSymmetry.h"
+#include "CouplingOperator.h"
+#include "CyclicSymmetry.h"
+#include "FMM.h"
+#include "HMatrix.h"
+#include "LatticeOperator.h"
+#include "NearFieldPreconditioner.h"
+#include "SchwarzPreconditioner.h"
+#include "SolverStatistics.h"
+#include "mpi/Collectives.h"
 #include "scalapack/BroadcastToOutOfContext.h"
 #include "scalapack/LinearSystemSolver.h"
+#include <algorithm>
 #include <chrono>
+#include <iostream>
+#include <limits>
 #include <Eigen/Dense>
 using namespace std::chrono;
 namespace optimet {
 namespace solver {
-
-std::tuple<scalapack::Matrix<t_complex>, scalapack::Matrix<t_complex>>
-Scalapack::parallel_input() const {
-  auto const nMax = geometry->nMax();
-  auto const N = 2 * nMax * (nMax + 2) * geometry->objects.size();
-  scalapack::Matrix<t_complex> Aparallel(context(), {N, N}, block_size());
-  if(Aparallel.size() > 0)
-    Aparallel.local() = S;
-  scalapack::Matrix<t_complex> bparallel(context(), {N, 1}, block_size());
-  if(bparallel.local().size() > 0)
-    bparallel.local() = Q;
-  return std::make_tuple(Aparallel, bparallel);
+namespace {
+//! Applies the operator to each column
+template <class OPERATOR>
+Matrix<t_complex> apply_columns(OPERATOR const &A, Matrix<t_complex> const &X) {
+  Matrix<t_complex> result(X.rows(), X.cols());
+  for(t_int k = 0; k < X.cols(); ++k)
+    result.col(k) = A * Vector<t_complex>(X.col(k));
+  return result;
 }
 
-std::tuple<scalapack::Matrix<t_complex>, scalapack::Matrix<t_complex>>
-Scalapack::parallel_input_SH(Vector<t_complex> &K, int Dims) const {
-
-   t_uint N = Dims;
+//! \brief Solves a dense system out-of-core on the root, from the factors computed on first use
+//! \details The matrix is assembled by panels of the columns of whole scatterers, as many as fit
+//! within the memory given for two panels. The solution is broadcast to all the processes.
+Matrix<t_complex> out_of_core_solve(std::string const &path, t_uint memory, t_uint n, t_uint nobj,
+                                    NearFieldPreconditioner::PairBlock const &block,
+                                    Matrix<t_complex> const &B,
+                                    mpi::Communicator const &communicator,
+                                    std::shared_ptr<OutOfCoreLU> &lu) {
+  Matrix<t_complex> X(B.rows(), B.cols());
+  std::exception_ptr error = nullptr;
+  if(communicator.is_root()) {
+    try {
+      if(not lu) {
+        t_uint const N = n * nobj;
+        t_real const panel = static_cast<t_real>(N) * n * sizeof(t_complex);
+        t_uint const objects = std::max<t_real>(1, std::floor(memory * 1048576e0 / (2 * panel)));
+        lu = std::make_shared<OutOfCoreLU>(path, N, objects * n, [&](t_uint first, t_uint cols) {
+          Matrix<t_complex> result(N, cols);
+          for(t_uint jj = first / n; jj < (first + cols) / n; ++jj)
+            for(t_uint ii = 0; ii < nobj; ++ii)
+              result.block(ii * n, jj * n - first, n, n) = block(ii, jj);
+          return result;
+        });
+      }
+      X = lu->solve(B);
+    } catch(...) {
+      error = std::current_exception();
+    }
+  }
+  // the other processes must not wait for a solution that will not come
+  if(mpi::broadcast<int>(error ? 1 : 0, communicator, communicator.root_id()) != 0) {
+    if(error)
+      std::rethrow_exception(error);
+    throw std::runtime_error("The out-of-core solve failed on the root");
+  }
+  return mpi::broadcast(X, communicator, communicator.root_id());
+}
 
-  scalapack::Matrix<t_complex> Aparallel(context(), {N, N}, block_size());
-  if(Aparallel.size() > 0)
-    Aparallel.local() = V;
-  scalapack::Matrix<t_complex> bparallel(context(), {N, 1}, block_size());
-  if(bparallel.local().size() > 0)
-    bparallel.local() = K;
-  return std::make_tuple(Aparallel, bparallel);
+//! \brief Solves a dense system from the factors of its matrix, computed on first use
+//! \details With mixed precision, the matrix is factorized in single precision and the solution
+//! refined in double. Should the refinement fail, the matrix is factorized in double once and for
+//! all. Should LU meet a singular pivot, or with qr, the system is solved with QR instead.
+template <class MATRIX>
+std::tuple<scalapack::Matrix<t_complex>, int>
+dense_solve(MATRIX const &matrix, scalapack::Matrix<t_complex> const &b, bool mixed_precision,
+            bool qr, std::shared_ptr<scalapack::MixedLUFactors> &mixed,
+            std::shared_ptr<scalapack::LUFactors<t_complex>> &lu) {
+  if(qr)
+    return scalapack::qr_linear_system(matrix(), b);
+  if(mixed_precision and not lu) {
+    if(not mixed)
+      mixed = std::make_shared<scalapack::MixedLUFactors>(
+          scalapack::mixed_lu_factorization(matrix()));
+    auto result = scalapack::mixed_lu_solve(*mixed, b);
+    if(std::get<1>(result) == 0)
+      return result;
+    lu = std::make_shared<scalapack::LUFactors<t_complex>>(scalapack::lu_factorization(mixed->A));
+    mixed.reset();
+  }
+  else if(not lu)
+    lu = std::make_shared<scalapack::LUFactors<t_complex>>(scalapack::lu_factorization(matrix()));
+  auto result = scalapack::lu_solve(*lu, b);
+  if(std::get<1>(result) > 0)
+    return scalapack::qr_linear_system(matrix(), b);
+  return result;
 }
 
+//! The T and RgQ matrices held side by side in the memory shared by the node, copied to local
+TRgQmatrices const &shared_TRgQ(mpi::SharedArray const &shared, t_uint nMax, t_uint nobj,
+                                TRgQmatrices &local) {
+  t_uint const N = 2 * nMax * (nMax + 2);
+  auto const data = reinterpret_cast<t_complex const *>(shared.data());
+  local.T = Eigen::Map<Matrix<t_complex> const>(data, N, nobj * N);
+  local.RgQ = Eigen::Map<Matrix<t_complex> const>(data + N * nobj * N, N, nobj * N);
+  return local;
+}
+}
 
 void Scalapack::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_SH,
                       Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const {
-    
- if(context().is_valid()) {
-    //FF
-     auto const nobj = geometry->objects.size();
-    Matrix<t_complex> TmatrixFF, RgQmatrixFF, SCATmatFF;
-    int nMax = geometry->nMax();
-    int pMax = nMax * (nMax + 2);
-    TmatrixFF = S.block(0 ,0 , 2*pMax, nobj*2*pMax);
-    RgQmatrixFF = S.block(0 , nobj*2*pMax , 2*pMax, nobj*2*pMax);
-
-    SCATmatFF = ScatteringMatrixFF(TmatrixFF, *geometry, incWave);
-    
-    X_sca_ = SCATmatFF.colPivHouseholderQr().solve(Q);   
-    PreconditionedMatrix::unprecondition(X_sca_, X_int_, TmatrixFF, RgQmatrixFF);
+  Matrix<t_complex> sca, inter, sca_SH, inter_SH;
+  solve(Q, sca, inter, sca_SH, inter_SH, CGcoeff);
+  X_sca_ = sca.col(0);
+  X_int_ = inter.col(0);
+  if(incWave->SH_cond) {
+    X_sca_SH = sca_SH.col(0);
+    X_int_SH = inter_SH.col(0);
+  }
+}
+
+void Scalapack::solve_incidences(Matrix<t_complex> &X_sca_, Matrix<t_complex> &X_int_,
+                                 Matrix<t_complex> &X_sca_SH, Matrix<t_complex> &X_int_SH,
+                                 std::vector<double *> CGcoeff) {
+  // the scattering matrices do not depend on the incidence, only the source vectors do
+  Matrix<t_complex> const Qs = source_vectors(*geometry, incWave, communicator(), origin_.get());
+  solve(Qs, X_sca_, X_int_, X_sca_SH, X_int_SH, CGcoeff);
+}
+
+void Scalapack::solve(Matrix<t_complex> const &Qs, Matrix<t_complex> &X_sca_, Matrix<t_complex> &X_int_,
+                      Matrix<t_complex> &X_sca_SH, Matrix<t_complex> &X_int_SH,
+                      std::vector<double *> CGcoeff) const {
+  // kept for the extinction, which needs the incident coefficients about each object
+  sources_ = Qs;
+
+  // parameters for ACA-gmres solver
+  double const tol = geometry->get_krylovtolerance();
+  int const maxit = geometry->get_krylovrestart();
+  int const no_rest = geometry->get_krylovcycles();
+  // the recycled subspaces are kept across solves and wavelengths
+  recycleFF_.k = recycleSH_.k = geometry->get_recycle();
+  //FF
+  auto const nobj = geometry->objects.size();
+  auto const nInc = Qs.cols();
+  TRgQmatrices localFF;
+  auto const &matricesFF = TRgQ_FF(localFF);
+  Matrix<t_complex> const &TmatrixFF = matricesFF.T, &RgQmatrixFF = matricesFF.RgQ;
+  int nMax = geometry->nMax();
+  int pMax = nMax * (nMax + 2);
+  X_sca_.resize(nobj*2*pMax, nInc);
+  X_int_.resize(nobj*2*pMax, nInc);
+
+  // converts each column back to the scattered and internal coefficients
+  auto const unprecondition = [&](Matrix<t_complex> const &solution) {
+    for(Eigen::Index i = 0; i < nInc; ++i) {
+      Vector<t_complex> sca = solution.col(i), inter;
+      PreconditionedMatrix::unprecondition(sca, inter, TmatrixFF, RgQmatrixFF);
+      X_sca_.col(i) = sca;
+      X_int_.col(i) = inter;
+    }
+  };
 
+  // the dense solves split over the rotations about z the objects are invariant under, if any,
+  // factorized by the first solve after an update
+  auto const symmetric = [&]() {
+    if(symmetryFF_ or not geometry->get_symmetrycond())
+      return static_cast<bool>(symmetryFF_);
+    auto const order = geometry->get_symmetryorder() > 0 ? geometry->get_symmetryorder() :
+                                                           CyclicSymmetry::detect(*geometry);
+    if(order < 2)
+      return false;
+    symmetryFF_ = std::make_shared<CyclicSymmetry>(*geometry, order);
+    symmetryFF_->factorise(
+        nMax,
+        [&](t_uint ii, t_uint jj) { return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj); },
+        communicator());
+    if(communicator().rank() == 0)
+      std::cout << "The FF scattering matrix is split over " << order << " rotations about z"
+                << std::endl;
+    return true;
+  };
+
+  // the iterative solvers are preconditioned with the couplings of the nearly touching scatterers,
+  // or with those within the subdomains of a partition
+  bool const iterative =
+      geometry->get_ACAcond() or geometry->get_FMMcond() or geometry->get_matrixfreecond();
+  auto const nearFF = preconditioner(
+      *geometry, 2 * pMax,
+      [&](t_uint ii, t_uint jj) { return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj); },
+      iterative, communicator());
+
+  if(geometry->get_ACAcond()) {
+    // the far pairs are compressed from single rows and columns of their blocks
+    HMatrix const SCATmatFF(
+        *geometry, 2 * pMax,
+        [&](t_uint ii, t_uint jj) { return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj); },
+        [&](t_uint ii, t_uint jj, t_uint index, bool column) {
+          return ScatteringSliceFF(TmatrixFF, *geometry, incWave, ii, jj, index, column);
+        },
+        1.0, geometry->get_ACAtolerance(), 4, geometry->get_ACArecompress(),
+        geometry->get_ACAsingle());
+    auto const sizeMAT = SCATmatFF.memory();
+    SolverStatistics::operator_memory(sizeMAT, SCATmatFF.rows());
+    if(communicator().rank() == 0)
+      std::cout<<"The size of the FF scattering matrix in MB is"<< sizeMAT<<std::endl;
+
+    Matrix<t_complex> solution(Qs.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatFF, *nearFF, Qs.col(i), tol, maxit, no_rest,
+                                     recycleFF_, preconditioned_guess(i, TmatrixFF));
+    unprecondition(solution);
+  }
+  else if(geometry->get_FMMcond()) {
+    FMMOperator const SCATmatFF(TmatrixFF, *geometry, incWave->waveK, nMax, false,
+                                geometry->get_FMMleaf(), geometry->get_FMMdigits());
+    auto const sizeMAT = SCATmatFF.memory();
+    SolverStatistics::operator_memory(sizeMAT, SCATmatFF.rows());
+    if(communicator().rank() == 0)
+      std::cout<<"The size of the FF fast multipole operator in MB is"<< sizeMAT<<std::endl;
+
+    Matrix<t_complex> solution(Qs.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatFF, *nearFF, Qs.col(i), tol, maxit, no_rest,
+                                     recycleFF_, preconditioned_guess(i, TmatrixFF));
+    unprecondition(solution);
+  }
+  else if(geometry->get_matrixfreecond() and geometry->get_latticecond()) {
+    LatticeOperator const SCATmatFF(TmatrixFF, *geometry, incWave->waveK, nMax, false);
+    auto const sizeMAT = SCATmatFF.memory();
+    SolverStatistics::operator_memory(sizeMAT, SCATmatFF.rows());
+    if(communicator().rank() == 0)
+      std::cout<<"The size of the FF lattice operator in MB is"<< sizeMAT<<std::endl;
+
+    Matrix<t_complex> solution(Qs.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatFF, *nearFF, Qs.col(i), tol, maxit, no_rest,
+                                     recycleFF_, preconditioned_guess(i, TmatrixFF));
+    unprecondition(solution);
+  }
+  else if(geometry->get_matrixfreecond()) {
+    CouplingOperator const SCATmatFF(TmatrixFF, *geometry, incWave->waveK, nMax, false,
+                                     geometry->get_cachecond(), &couplings_,
+                                     keep_couplings(false));
+    Matrix<t_complex> solution(Qs.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatFF, *nearFF, Qs.col(i), tol, maxit, no_rest,
+                                     recycleFF_, preconditioned_guess(i, TmatrixFF));
+    unprecondition(solution);
+  }
+  else if(AxialSymmetry::detect(*geometry, nMax)) {
+    // the orders m with sources only, each from the coefficients of that order
+    if(not axialFF_)
+      axialFF_ = std::make_shared<AxialSymmetry>(nobj, nMax, communicator());
+    unprecondition(axialFF_->solve(Qs, [&](t_uint ii, t_uint jj) {
+      return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj);
+    }));
+  }
+  else if(symmetric())
+    unprecondition(symmetryFF_->solve(Qs));
+  else if(not scratch_.empty()) {
+    unprecondition(out_of_core_solve(
+        scratch_ + "/optimet_FF_" + std::to_string(mpi::Communicator().rank()) + ".lu",
+        scratch_memory_, 2 * pMax, nobj,
+        [&](t_uint ii, t_uint jj) { return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj); },
+        Qs, communicator(), outFF_));
+  }
+  else if(context().is_valid()) {
+    // assembled and solved block-cyclically, no process holds the whole matrix
+    // all the incidences, and all the solves until the next update, share a single factorization
+    t_uint const N = nobj*2*pMax;
+    if(luFF_ and not factorized_.empty()) {
+      // the particles moved since the factorization, their block rows and columns corrected
+      auto const lu_solve = [&](Matrix<t_complex> const &B) {
+        auto const result = scalapack::lu_solve(
+            *luFF_, distributed_matrix(B, N, B.cols(), context(), block_size()));
+        if(std::get<1>(result) != 0)
+          throw std::runtime_error("Error encountered while solving the linear system");
+        return gather_all_source_matrix(std::get<0>(result));
+      };
+      if(not lowrankFF_) {
+        Geometry before(*geometry);
+        for(t_uint j = 0; j < nobj; ++j)
+          before.objects[j].vR =
+              Spherical<t_real>(factorized_[3 * j], factorized_[3 * j + 1], factorized_[3 * j + 2]);
+        lowrankFF_ = std::make_shared<LowRankUpdate>(
+            LowRankUpdate::moved(factorized_, positions_), nobj, 2 * pMax,
+            [&](t_uint ii, t_uint jj) {
+              return ScatteringBlockFF(TmatrixFF, before, incWave, ii, jj);
+            },
+            [&](t_uint ii, t_uint jj) {
+              return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj);
+            },
+            lu_solve);
+      }
+      unprecondition(lowrankFF_->solve(Qs, lu_solve));
+    } else {
+      auto const gls_result = dense_solve(
+          [&]() {
+            return ScatteringMatrixFF(TmatrixFF, *geometry, incWave, context(), block_size());
+          },
+          distributed_matrix(Qs, N, nInc, context(), block_size()), mixed_precision_,
+          qr_factorization_, mixedFF_, luFF_);
+      if(std::get<1>(gls_result) != 0)
+        throw std::runtime_error("Error encountered while solving the linear system");
+
+      unprecondition(gather_all_source_matrix(std::get<0>(gls_result)));
+    }
   }
 
   if(context().size() != communicator().size()) {
@@ -77,26 +330,117 @@ void Scalapack::solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vect
 
   //SH
   if(incWave->SH_cond){
-  auto const nobj = geometry->objects.size();
-  Vector<t_complex> KmNOD, K1;
-  Matrix<t_complex> TmatrixSH, RgQmatrixSH, SCATmatSH;
+  update_SH();
+  Matrix<t_complex> KmNOD, K1;
+  TRgQmatrices localSH;
+  auto const &matricesSH = TRgQ_SH(localSH);
+  Matrix<t_complex> const &TmatrixSH = matricesSH.T, &RgQmatrixSH = matricesSH.RgQ;
   int nMaxS = geometry->nMaxS();
   int pMax = nMaxS * (nMaxS + 2);
-  TmatrixSH = V.block(0 ,0 , 2*pMax, nobj*2*pMax);
-  RgQmatrixSH = V.block(0 , nobj*2*pMax , 2*pMax, nobj*2*pMax);
-   
-  KmNOD = distributed_source_vector_SH_Mnode(*geometry, incWave, X_int_, X_sca_, TmatrixSH);
- 
-  MPI_Barrier(MPI_COMM_WORLD);
-  K1 =  distributed_vector_SH_AR1(*geometry, incWave, X_int_, X_sca_);
-  MPI_Barrier(MPI_COMM_WORLD);
-      
-  if(context().is_valid()) {
+
+  // the sources of each incidence come from its own fundamental frequency solution
+  for(Eigen::Index i = 0; i < nInc; ++i) {
+  Vector<t_complex> inter = X_int_.col(i);
+  Vector<t_complex> KmNOD_i, K1_i;
+  std::tie(KmNOD_i, K1_i) = distributed_source_vectors_SH(*geometry, incWave, inter, TmatrixSH,
+                                                           communicator());
+  if(i == 0) {
+    KmNOD.resize(KmNOD_i.size(), nInc);
+    K1.resize(K1_i.size(), nInc);
+  }
+  KmNOD.col(i) = KmNOD_i;
+  K1.col(i) = K1_i;
+  }
+  X_sca_SH.resize(nobj*2*pMax, nInc);
+  X_int_SH.resize(nobj*2*pMax, nInc);
+
+  auto const unprecondition_SH = [&](Matrix<t_complex> const &solution) {
+    for(Eigen::Index i = 0; i < nInc; ++i) {
+      Vector<t_complex> sca = solution.col(i), inter, K1_i = K1.col(i);
+      PreconditionedMatrix::unprecondition_SH(sca, inter, K1_i, RgQmatrixSH);
+      X_sca_SH.col(i) = sca;
+      X_int_SH.col(i) = inter;
+    }
+  };
+
+  auto const nearSH = preconditioner(
+      *geometry, 2 * pMax,
+      [&](t_uint ii, t_uint jj) { return ScatteringBlockSH(TmatrixSH, *geometry, incWave, ii, jj); },
+      iterative, communicator());
+
+  if(geometry->get_ACAcond()) {
+    HMatrix const SCATmatSH(
+        *geometry, 2 * pMax,
+        [&](t_uint ii, t_uint jj) { return ScatteringBlockSH(TmatrixSH, *geometry, incWave, ii, jj); },
+        [&](t_uint ii, t_uint jj, t_uint index, bool column) {
+          return ScatteringSliceSH(TmatrixSH, *geometry, incWave, ii, jj, index, column);
+        },
+        1.0, geometry->get_ACAtolerance(), 4, geometry->get_ACArecompress(),
+        geometry->get_ACAsingle());
+    SolverStatistics::operator_memory(SCATmatSH.memory(), SCATmatSH.rows());
+    Matrix<t_complex> solution(KmNOD.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatSH, *nearSH, KmNOD.col(i), tol, maxit, no_rest,
+                                     recycleSH_, preconditioned_guess_SH(i, KmNOD.rows()));
+    unprecondition_SH(solution);
+  }
+  else if(geometry->get_FMMcond()) {
+    FMMOperator const SCATmatSH(TmatrixSH, *geometry, 2.0 * incWave->waveK, nMaxS, true,
+                                geometry->get_FMMleaf(), geometry->get_FMMdigits());
+    Matrix<t_complex> solution(KmNOD.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatSH, *nearSH, KmNOD.col(i), tol, maxit, no_rest,
+                                     recycleSH_, preconditioned_guess_SH(i, KmNOD.rows()));
+    unprecondition_SH(solution);
+  }
+  else if(geometry->get_matrixfreecond() and geometry->get_latticecond()) {
+    LatticeOperator const SCATmatSH(TmatrixSH, *geometry, 2.0 * incWave->waveK, nMaxS, true);
+    auto const sizeMAT = SCATmatSH.memory();
+    SolverStatistics::operator_memory(sizeMAT, SCATmatSH.rows());
+    if(communicator().rank() == 0)
+      std::cout<<"The size of the SH lattice operator in MB is"<< sizeMAT<<std::endl;
+
+    Matrix<t_complex> solution(KmNOD.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatSH, *nearSH, KmNOD.col(i), tol, maxit, no_rest,
+                                     recycleSH_, preconditioned_guess_SH(i, KmNOD.rows()));
+    unprecondition_SH(solution);
+  }
+  else if(geometry->get_matrixfreecond()) {
+    CouplingOperator const SCATmatSH(TmatrixSH, *geometry, 2.0 * incWave->waveK, nMaxS, true,
+                                     geometry->get_cachecond(), &couplings_,
+                                     keep_couplings(true));
+    Matrix<t_complex> solution(KmNOD.rows(), nInc);
+    for(Eigen::Index i = 0; i < nInc; ++i)
+      solution.col(i) = Gcrodr_Zcomp(SCATmatSH, *nearSH, KmNOD.col(i), tol, maxit, no_rest,
+                                     recycleSH_, preconditioned_guess_SH(i, KmNOD.rows()));
+    unprecondition_SH(solution);
+  }
+  else if(AxialSymmetry::detect(*geometry, nMaxS)) {
+    if(not axialSH_)
+      axialSH_ = std::make_shared<AxialSymmetry>(nobj, nMaxS, communicator());
+    unprecondition_SH(axialSH_->solve(KmNOD, [&](t_uint ii, t_uint jj) {
+      return ScatteringBlockSH(TmatrixSH, *geometry, incWave, ii, jj);
+    }));
+  }
+  else if(not scratch_.empty()) {
+    unprecondition_SH(out_of_core_solve(
+        scratch_ + "/optimet_SH_" + std::to_string(mpi::Communicator().rank()) + ".lu",
+        scratch_memory_, 2 * pMax, nobj,
+        [&](t_uint ii, t_uint jj) { return ScatteringBlockSH(TmatrixSH, *geometry, incWave, ii, jj); },
+        KmNOD, communicator(), outSH_));
+  }
+  else if(context().is_valid()) {
     
-    SCATmatSH = ScatteringMatrixSH(TmatrixSH, *geometry, incWave);
-    X_sca_SH = SCATmatSH.colPivHouseholderQr().solve(KmNOD);
+    t_uint const N = nobj*2*pMax;
+    auto const gls_result_SH = dense_solve(
+        [&]() { return ScatteringMatrixSH(TmatrixSH, *geometry, incWave, context(), block_size()); },
+        distributed_matrix(KmNOD, N, nInc, context(), block_size()), mixed_precision_,
+        qr_factorization_, mixedSH_, luSH_);
+    if(std::get<1>(gls_result_SH) != 0)
+      throw std::runtime_error("Error encountered while solving the linear system");
 
-    PreconditionedMatrix::unprecondition_SH(X_sca_SH, X_int_SH, K1, RgQmatrixSH);
+    unprecondition_SH(gather_all_source_matrix(std::get<0>(gls_result_SH)));
 
   }
 
@@ -109,20 +453,211 @@ if(context().size() != communicator().size()) {
  
 }
 
+t_real Scalapack::solve_reduced(Matrix<t_complex> const &basis, Matrix<t_complex> &X_sca_,
+                                Matrix<t_complex> &X_int_) const {
+  auto const nobj = geometry->objects.size();
+  int const nMax = geometry->nMax();
+  int const pMax = nMax * (nMax + 2);
+  t_uint const N = 2 * pMax;
+  if(basis.cols() == 0 or basis.rows() != static_cast<Eigen::Index>(nobj * N))
+    return std::numeric_limits<t_real>::infinity();
+  TRgQmatrices localFF;
+  auto const &matricesFF = TRgQ_FF(localFF);
+  Matrix<t_complex> const &TmatrixFF = matricesFF.T, &RgQmatrixFF = matricesFF.RgQ;
+
+  // the basis in the preconditioned unknowns, orthonormal and without the directions it repeats
+  Matrix<t_complex> Z(basis.rows(), basis.cols());
+  for(t_uint ii = 0; ii < nobj; ++ii)
+    Z.middleRows(ii * N, N) =
+        matricesFF.Tblock(ii).partialPivLu().solve(basis.middleRows(ii * N, N));
+  Eigen::ColPivHouseholderQR<Matrix<t_complex>> qr(Z);
+  qr.setThreshold(1e-10);
+  Z = qr.householderQ() * Matrix<t_complex>::Identity(Z.rows(), qr.rank());
+
+  Matrix<t_complex> AZ;
+  // the compressed blocks and the couplings are applied to all the columns at once
+  if(geometry->get_ACAcond())
+    AZ = HMatrix(*geometry, N,
+                 [&](t_uint ii, t_uint jj) {
+                   return ScatteringBlockFF(TmatrixFF, *geometry, incWave, ii, jj);
+                 },
+                 [&](t_uint ii, t_uint jj, t_uint index, bool column) {
+                   return ScatteringSliceFF(TmatrixFF, *geometry, incWave, ii, jj, index, column);
+                 },
+                 1.0, geometry->get_ACAtolerance(), 4, geometry->get_ACArecompress(),
+                 geometry->get_ACAsingle()) *
+         Z;
+  else if(geometry->get_FMMcond())
+    AZ = apply_columns(FMMOperator(TmatrixFF, *geometry, incWave->waveK, nMax, false,
+                                   geometry->get_FMMleaf(), geometry->get_FMMdigits()),
+                       Z);
+  else if(geometry->get_matrixfreecond() and geometry->get_latticecond())
+    AZ = apply_columns(LatticeOperator(TmatrixFF, *geometry, incWave->waveK, nMax, false), Z);
+  else
+    AZ = CouplingOperator(TmatrixFF, *geometry, incWave->waveK, nMax, false,
+                          geometry->get_cachecond(), &couplings_, keep_couplings(false)) *
+         Z;
+
+  auto const nInc = incWave->nIncidences();
+  Matrix<t_complex> const Qs = source_vectors(*geometry, incWave, communicator(), origin_.get());
+  sources_ = Qs;
+
+  // least squares, the products being known on all the processes
+  Matrix<t_complex> const y = AZ.colPivHouseholderQr().solve(Qs);
+  t_real residual = 0;
+  for(t_uint i = 0; i < nInc; ++i)
+    residual = std::max(residual, (AZ * y.col(i) - Qs.col(i)).norm() / Qs.col(i).norm());
+
+  Matrix<t_complex> const solution = Z * y;
+  X_sca_.resize(nobj * N, nInc);
+  X_int_.resize(nobj * N, nInc);
+  for(t_uint i = 0; i < nInc; ++i) {
+    Vector<t_complex> sca = solution.col(i), inter;
+    PreconditionedMatrix::unprecondition(sca, inter, TmatrixFF, RgQmatrixFF);
+    X_sca_.col(i) = sca;
+    X_int_.col(i) = inter;
+  }
+  return residual;
+}
+
+namespace {
+//! Keys of the T-matrices of the particles, in the order of the objects
+std::vector<std::string> tmatrix_keys(Geometry const &geometry, t_real omega, bool SH) {
+  std::vector<std::string> keys;
+  for(auto const &object : geometry.objects)
+    keys.push_back(object.TmatrixKey(geometry.bground, omega, SH));
+  return keys;
+}
+
+//! Drops the T-matrices of the particles that are no longer in the geometry
+void prune(TmatrixCache &cache, std::vector<std::string> const &keys) {
+  for(auto i = cache.begin(); i != cache.end();)
+    if(std::find(keys.begin(), keys.end(), i->first) == keys.end())
+      i = cache.erase(i);
+    else
+      ++i;
+}
+}
+
+bool Scalapack::keep_couplings(bool SH) const {
+  // the wave numbers match only in a background that does not disperse, and the orders of the
+  // couplings only without truncated particles nor sparsified couplings
+  if(not incWave->SH_cond or not geometry->get_cachecond() or geometry->bground.modelType != 0 or
+     geometry->nMax() != geometry->nMaxS() or geometry->truncated() or
+     geometry->get_couplingtolerance() > 0)
+    return false;
+  auto const lambda = incWave->lambda();
+  return geometry->scanned(SH ? 0.5 * lambda : 2 * lambda);
+}
+
 void Scalapack::update() {
+  // only the excitation changes from one incidence to the next: the T-matrices depend on the
+  // particles and the wavelength, the factorizations also on the positions
+  Q = source_vector(*geometry, incWave, communicator(), origin_.get());
 
-  Q = source_vector(*geometry, incWave);
-  MPI_Barrier(MPI_COMM_WORLD);
-  
-  S = getTRgQmatrix_FF_parr(*geometry, incWave);
-  MPI_Barrier(MPI_COMM_WORLD);
+  std::vector<t_real> positions;
+  for(auto const &object : geometry->objects) {
+    positions.push_back(object.vR.rrr);
+    positions.push_back(object.vR.the);
+    positions.push_back(object.vR.phi);
+  }
+  if(positions != positions_) {
+    // with few particles moved since the LU factors of the dense FF solves, the factors are kept
+    // and corrected by the next solve
+    auto const base = factorized_.empty() ? positions_ : factorized_;
+    bool const correct =
+        luFF_ and lowrank_ > 0 and base.size() == positions.size() and
+        LowRankUpdate::moved(base, positions).size() <= lowrank_ * geometry->objects.size();
+    if(not correct) {
+      luFF_.reset();
+      factorized_.clear();
+    } else
+      factorized_ = base == positions ? std::vector<t_real>() : base;
+    lowrankFF_.reset();
+    symmetryFF_.reset();
+    axialFF_.reset();
+    luSH_.reset();
+    axialSH_.reset();
+    outFF_.reset();
+    outSH_.reset();
+    mixedFF_.reset();
+    mixedSH_.reset();
+    couplings_.clear();
+    positions_ = positions;
+  }
+
+  auto const keysFF = tmatrix_keys(*geometry, incWave->omega(), false);
+  std::vector<int> ordersFF;
+  for(auto const &object : geometry->objects)
+    ordersFF.push_back(object.truncation());
+  if(keysFF != keysFF_ or ordersFF != ordersFF_ or (S.empty() and not sharedFF_)) {
+    luFF_.reset();
+    factorized_.clear();
+    lowrankFF_.reset();
+    symmetryFF_.reset();
+    axialFF_.reset();
+    mixedFF_.reset();
+    outFF_.reset();
+    S.clear();
+    sharedFF_.reset();
+    auto const keysSH = incWave->SH_cond ? tmatrix_keys(*geometry, incWave->omega(), true) :
+                                           std::vector<std::string>();
+    if(geometry->get_TmatrixShared())
+      sharedFF_ = getTRgQmatrix_FF_shared(*geometry, incWave, &cacheFF_, communicator(),
+                                          communicator().split_shared());
+    else if(incWave->SH_cond and (keysSH != keysSH_ or V.empty())) {
+      // the SH particles are computed alongside the FF ones, rather than by the first SH solve
+      luSH_.reset();
+      axialSH_.reset();
+    axialSH_.reset();
+      mixedSH_.reset();
+      outSH_.reset();
+      std::tie(S, V) = getTRgQmatrices(*geometry, incWave, &cacheFF_, &cacheSH_, communicator());
+      prune(cacheSH_, keysSH);
+      keysSH_ = keysSH;
+    } else
+      S = getTRgQmatrices(*geometry, incWave, false, &cacheFF_, communicator());
+    prune(cacheFF_, keysFF);
+    keysFF_ = keysFF;
+    ordersFF_ = ordersFF;
+  }
+
+  // the SH matrices are built by the first solve needing them
+  if(not incWave->SH_cond) {
+    keysSH_.clear();
+    cacheSH_.clear();
+  }
+}
 
- if(incWave->SH_cond){
-  V = getTRgQmatrix_SH_parr(*geometry, incWave);
-  MPI_Barrier(MPI_COMM_WORLD);
- }
+void Scalapack::update_SH() const {
+  auto const keysSH = tmatrix_keys(*geometry, incWave->omega(), true);
+  if(keysSH == keysSH_ and (not V.empty() or sharedSH_))
+    return;
+  luSH_.reset();
+  axialSH_.reset();
+  mixedSH_.reset();
+  outSH_.reset();
+  V.clear();
+  sharedSH_.reset();
+  if(geometry->get_TmatrixShared())
+    sharedSH_ = getTRgQmatrix_SH_shared(*geometry, incWave, &cacheSH_, communicator(),
+                                        communicator().split_shared());
+  else
+    V = getTRgQmatrices(*geometry, incWave, true, &cacheSH_, communicator());
+  prune(cacheSH_, keysSH);
+  keysSH_ = keysSH;
+}
 
+TRgQmatrices const &Scalapack::TRgQ_FF(TRgQmatrices &local) const {
+  if(not sharedFF_)
+    return S;
+  return shared_TRgQ(*sharedFF_, geometry->nMax(), geometry->objects.size(), local);
+}
 
+TRgQmatrices const &Scalapack::TRgQ_SH(TRgQmatrices &local) const {
+  if(not sharedSH_)
+    return V;
+  return shared_TRgQ(*sharedSH_, geometry->nMaxS(), geometry->objects.size(), local);
 }
 }
 }
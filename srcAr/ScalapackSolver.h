@@ -20,10 +20,20 @@
 #include "Types.h"
 
 #ifdef OPTIMET_SCALAPACK
+#include "AxialSymmetry.h"
+#include "CouplingOperator.h"
+#include "CyclicSymmetry.h"
+#include "HMatrix.h"
+#include "LowRankUpdate.h"
+#include "OutOfCoreLU.h"
 #include "PreconditionedMatrix.h"
 #include "PreconditionedMatrixSolver.h"
 #include "Solver.h"
 #include "scalapack/Context.h"
+#include "scalapack/LinearSystemSolver.h"
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace optimet {
 namespace solver {
@@ -34,16 +44,30 @@ public:
   Scalapack(std::shared_ptr<Geometry> geometry, std::shared_ptr<Excitation const> incWave,
             mpi::Communicator const &comm = mpi::Communicator(),
             scalapack::Context const &context = scalapack::Context::Squarest(),
-            scalapack::Sizes const &block_size = scalapack::Sizes{64, 64})
-      :PreconditionedMatrix(geometry, incWave, comm), context_(context), block_size_(block_size) {
+            scalapack::Sizes const &block_size = scalapack::Sizes{64, 64},
+            bool mixed_precision = false, bool qr_factorization = false,
+            std::string const &scratch = "", t_uint scratch_memory = 1024, t_real lowrank = 0)
+      :PreconditionedMatrix(geometry, incWave, comm), context_(context), block_size_(block_size),
+       mixed_precision_(mixed_precision), qr_factorization_(qr_factorization), scratch_(scratch),
+       scratch_memory_(scratch_memory), lowrank_(lowrank) {
     update();
   }
   Scalapack(Run const &run)
       : Scalapack(run.geometry, run.excitation, run.communicator, run.context,
-                  {run.parallel_params.block_size, run.parallel_params.block_size}) {}
+                  {run.parallel_params.block_size, run.parallel_params.block_size},
+                  run.parallel_params.mixed_precision, run.parallel_params.qr_factorization,
+                  run.parallel_params.scratch, run.parallel_params.scratch_memory,
+                  run.parallel_params.lowrank) {}
 
   void solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_SH, 
              Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const override;
+  //! All the incidences are solved at once, with a single factorization or operator
+  void solve_incidences(Matrix<t_complex> &X_sca_, Matrix<t_complex> &X_int_,
+                        Matrix<t_complex> &X_sca_SH, Matrix<t_complex> &X_int_SH,
+                        std::vector<double *> CGcoeff) override;
+  //! Projected with the operator of the iterative solves, or the matrix-free one otherwise
+  t_real solve_reduced(Matrix<t_complex> const &basis, Matrix<t_complex> &X_sca_,
+                       Matrix<t_complex> &X_int_) const override;
   void update() override;
 
   //! Scalapack context used during computation
@@ -56,10 +80,71 @@ protected:
   scalapack::Context context_;
   //! Block-sizes for scalapack
   scalapack::Sizes block_size_;
+  //! \brief LU factors of the FF and SH scattering matrices
+  //! \details Computed by the first dense solve after an update, reused by the next ones.
+  mutable std::shared_ptr<scalapack::LUFactors<t_complex>> luFF_, luSH_;
+  //! \brief Factors of the orders m of the FF and SH scattering matrices of particles on the z axis
+  //! \details Computed by the first dense solves needing them after an update, reused by the next ones.
+  mutable std::shared_ptr<AxialSymmetry> axialFF_, axialSH_;
+  //! \brief Factors of the FF scattering matrix split over the rotations of a cyclic symmetry
+  //! \details Computed by the first dense solve after an update, reused by the next ones.
+  mutable std::shared_ptr<CyclicSymmetry> symmetryFF_;
+  //! Whether the dense solves are factorized in single precision and refined in double
+  bool mixed_precision_;
+  //! Whether the dense solves use QR rather than LU, which they fall back to on a singular pivot
+  bool qr_factorization_;
+  //! \brief Single precision LU factors of the FF and SH scattering matrices
+  //! \details Used instead of the double ones with mixed precision, until a refinement fails.
+  mutable std::shared_ptr<scalapack::MixedLUFactors> mixedFF_, mixedSH_;
+  //! Directory of the out-of-core factors, the dense systems being solved in memory if empty
+  std::string scratch_;
+  //! Memory in MB of the two panels of an out-of-core factorization
+  t_uint scratch_memory_;
+  //! \brief Out-of-core factors of the FF and SH scattering matrices, on the root only
+  //! \details Computed by the first dense solve after an update, reused by the next ones.
+  mutable std::shared_ptr<OutOfCoreLU> outFF_, outSH_;
+  //! Krylov subspaces recycled by the iterative FF and SH solves, from one solve to the next
+  mutable KrylovRecycler recycleFF_, recycleSH_;
+  //! \brief T-matrices of the particles, kept across updates
+  //! \details Only the particles whose key changes, e.g. with the wavelength or the material, are
+  //! recomputed. The keys of the particles in S and V tell whether either needs rebuilding at all.
+  TmatrixCache cacheFF_;
+  mutable TmatrixCache cacheSH_;
+  std::vector<std::string> keysFF_;
+  mutable std::vector<std::string> keysSH_;
+  //! Orders the FF T-matrices in S are truncated to, rebuilt from the cache when they change
+  std::vector<int> ordersFF_;
+  //! \brief FF and SH T and RgQ matrices held once per node, with Tmatrix shared="yes"
+  //! \details S and V are then left empty.
+  std::shared_ptr<mpi::SharedArray const> sharedFF_;
+  mutable std::shared_ptr<mpi::SharedArray const> sharedSH_;
+  //! Positions of the particles when the factorizations were obtained
+  std::vector<t_real> positions_;
+  //! \brief Largest fraction of the particles moved since the LU factors of the dense FF solves
+  //! for which the factors are corrected rather than computed again, never if zero
+  t_real lowrank_;
+  //! Positions of the particles the LU factors of the dense FF solves are those of, if not positions_
+  std::vector<t_real> factorized_;
+  //! \brief Correction of the FF LU factors for the particles moved since
+  //! \details Computed by the first dense solve after an update, reused by the next ones.
+  mutable std::shared_ptr<LowRankUpdate> lowrankFF_;
+  //! \brief Couplings of the matrix-free operators, kept for a later wavelength of the scan
+  //! \details The SH operator at a wavelength couples at the wave number of the FF one at half of it.
+  mutable CouplingCache couplings_;
 
-  //! Creates scalapack matrix wrappers
-  std::tuple<scalapack::Matrix<t_complex>, scalapack::Matrix<t_complex>> parallel_input() const;
-  std::tuple<scalapack::Matrix<t_complex>, scalapack::Matrix<t_complex>> parallel_input_SH(Vector<t_complex> &K, int Dims) const;
+  //! Whether the couplings of the FF or SH operator at this wavelength are met again in the scan
+  bool keep_couplings(bool SH) const;
+
+  //! Builds V for the current wavelength and particles, unless it is up to date
+  void update_SH() const;
+  //! \brief The FF T and RgQ matrices, S itself or copied to local from the memory shared by the node
+  TRgQmatrices const &TRgQ_FF(TRgQmatrices &local) const;
+  //! The SH T and RgQ matrices, V itself or copied to local from the memory shared by the node
+  TRgQmatrices const &TRgQ_SH(TRgQmatrices &local) const;
+  //! Solves for the source vectors in the columns of Qs
+  void solve(Matrix<t_complex> const &Qs, Matrix<t_complex> &X_sca_, Matrix<t_complex> &X_int_,
+             Matrix<t_complex> &X_sca_SH, Matrix<t_complex> &X_int_SH,
+             std::vector<double *> CGcoeff) const;
 };
 }
 }
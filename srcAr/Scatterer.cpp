@@ -19,8 +19,12 @@
 #include "HarmonicsIterator.h"
 #include "Scatterer.h"
 #include "Tools.h"
-#include "Trian.h"
 #include <Eigen/LU> 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
 
 Scatterer::Scatterer(Spherical<double> vR_, ElectroMagnetic elmag_, double radius_, int nMax_, int nMaxS_)
     : vR(vR_), elmag(elmag_), radius(radius_), nMax(nMax_), nMaxS(nMaxS_) {}
@@ -31,646 +35,442 @@ Scatterer::~Scatterer() {}
 
 void Scatterer::Mesh(std::vector<double> co, std::vector<int> top)	 
 {
-coord = co;
-topol = top;
+  Mesh(std::make_shared<optimet::MeshFile const>(std::move(co), std::move(top)));
+}
+
+void Scatterer::Mesh(std::shared_ptr<optimet::MeshFile const> mesh_, int degree, int rotations,
+                     bool mirror) {
+  mesh = optimet::SurfaceMesh::get(mesh_, degree, rotations, mirror);
+}
+
+void Scatterer::Revolution(std::shared_ptr<optimet::MeshFile const> mesh_, int contour,
+                           int meridians) {
+  mesh = optimet::SurfaceMesh::revolution(mesh_, contour, meridians);
+}
+
+std::shared_ptr<optimet::AuxAngular const> Scatterer::getPointAngular(int nMax_) const {
+  return mesh->angular(nMax_);
+}
+
+bool Scatterer::sameTmatrix(Scatterer const &other) const {
+  if(scatterer_type != other.scatterer_type or nMax != other.nMax or nMaxS != other.nMaxS)
+    return false;
+  // the copies of a motif share its particles
+  if(particles != other.particles)
+    return false;
+  // for meshed objects the radius is only that of the circumscribed sphere
+  if(scatterer_type == "sphere" and radius != other.radius)
+    return false;
+  if(elmag.epsilon != other.elmag.epsilon or elmag.mu != other.elmag.mu or
+     elmag.epsilon_r != other.elmag.epsilon_r or elmag.mu_r != other.elmag.mu_r or
+     elmag.epsilon_SH != other.elmag.epsilon_SH or elmag.mu_SH != other.elmag.mu_SH or
+     elmag.epsilon_r_SH != other.elmag.epsilon_r_SH or elmag.mu_r_SH != other.elmag.mu_r_SH)
+    return false;
+  if(mesh == other.mesh)
+    return true;
+  if(not mesh or not other.mesh or mesh->degree() != other.mesh->degree() or
+     mesh->contour() != other.mesh->contour() or mesh->meridians() != other.mesh->meridians() or
+     mesh->rotations() != other.mesh->rotations() or mesh->mirror() != other.mesh->mirror())
+    return false;
+  auto const &a = mesh->file(), &b = other.mesh->file();
+  if(a.vertices() != b.vertices() or a.triangles() != b.triangles())
+    return false;
+  return std::equal(a.coord(), a.coord() + 3 * a.vertices(), b.coord()) and
+         std::equal(a.topol(), a.topol() + 3 * a.triangles(), b.topol());
+}
 
+namespace {
+// FNV-1a, running over the bytes of the arguments
+template <class T> void hash_bytes(std::uint64_t &hash, T const *data, std::size_t n) {
+  unsigned char const *bytes = reinterpret_cast<unsigned char const *>(data);
+  for(std::size_t i = 0; i < n * sizeof(T); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+}
+}
+
+std::string Scatterer::TmatrixKey(ElectroMagnetic const &bground, double omega_, bool SH) const {
+  std::uint64_t hash = 14695981039346656037ull;
+  hash_bytes(hash, scatterer_type.data(), scatterer_type.size());
+  if(mesh) {
+    hash_bytes(hash, mesh->file().coord(), 3 * mesh->file().vertices());
+    hash_bytes(hash, mesh->file().topol(), 3 * mesh->file().triangles());
+    // the default quadrature leaves the keys of the earlier caches as they were
+    optimet::t_uint const degree = mesh->degree();
+    if(degree != 3)
+      hash_bytes(hash, &degree, 1);
+    optimet::t_uint const revolution[] = {mesh->contour(), mesh->meridians()};
+    if(mesh->contour() > 0)
+      hash_bytes(hash, revolution, 2);
+    optimet::t_uint const symmetry[] = {mesh->rotations(), mesh->mirror()};
+    if(mesh->contour() == 0 and mesh->wedge() > 0)
+      hash_bytes(hash, symmetry, 2);
+  }
+  // for meshed objects the radius is only that of the circumscribed sphere
+  if(scatterer_type == "sphere")
+    hash_bytes(hash, &radius, 1);
+  // a motif by the keys and positions of its particles
+  if(particles)
+    for(auto const &particle : *particles) {
+      auto const key = particle.TmatrixKey(bground, omega_, SH);
+      hash_bytes(hash, key.data(), key.size());
+      double const position[] = {particle.vR.rrr, particle.vR.the, particle.vR.phi};
+      hash_bytes(hash, position, 3);
+    }
+  int const n = SH ? nMaxS : nMax;
+  hash_bytes(hash, &n, 1);
+  hash_bytes(hash, &omega_, 1);
+  std::complex<double> const material[] = {
+      SH ? elmag.epsilon_SH : elmag.epsilon, SH ? elmag.mu_SH : elmag.mu,
+      SH ? elmag.epsilon_r_SH : elmag.epsilon_r, SH ? elmag.mu_r_SH : elmag.mu_r,
+      SH ? bground.epsilon_SH : bground.epsilon, SH ? bground.mu_SH : bground.mu};
+  hash_bytes(hash, material, 6);
+
+  char key[64];
+  std::snprintf(key, sizeof(key), "%s_%016llx_n%d", SH ? "SH" : "FF",
+                static_cast<unsigned long long>(hash), n);
+  return key;
+}
+
+void Scatterer::getTRgQSphere(optimet::Matrix<optimet::t_complex> &Tmatrix,
+                              optimet::Matrix<optimet::t_complex> &RgQmatrix,
+                              optimet::t_real omega_, ElectroMagnetic const &bground,
+                              bool SH) const {
+  optimet::Matrix<optimet::t_complex> T, RgQ;
+  getTRgQSpheres({omega_}, {elmag}, bground, SH, T, RgQ);
+  Tmatrix = T.col(0).asDiagonal();
+  RgQmatrix = RgQ.col(0).asDiagonal();
+}
+
+void Scatterer::getTRgQSpheres(std::vector<optimet::t_real> const &omegas,
+                               std::vector<ElectroMagnetic> const &materials,
+                               ElectroMagnetic const &bground, bool SH,
+                               optimet::Matrix<optimet::t_complex> &Tdiagonals,
+                               optimet::Matrix<optimet::t_complex> &RgQdiagonals) const {
+  using namespace optimet;
+
+  int const n_max = SH ? nMaxS : nMax;
+  std::size_t const count = omegas.size();
+  // the arguments k_b r of the Bessel and Hankel functions, then k_s r of the Bessel ones
+  std::vector<t_complex> rho(count), mu_sob(count), k_b(count), z(2 * count);
+  for(std::size_t w = 0; w < count; ++w) {
+    auto const frequency = SH ? 2 * omegas[w] : omegas[w];
+    auto const epsilon = SH ? materials[w].epsilon_SH : materials[w].epsilon;
+    auto const mu = SH ? materials[w].mu_SH : materials[w].mu;
+    auto const k_s = frequency * std::sqrt(epsilon * mu);
+    k_b[w] = frequency * std::sqrt(bground.epsilon * bground.mu);
+    rho[w] = k_s / k_b[w];
+    mu_sob[w] = mu / bground.mu;
+    z[w] = k_b[w] * radius;
+    z[count + w] = rho[w] * z[w];
+  }
+  std::vector<t_complex> J((n_max + 1) * 2 * count), dJ(J.size());
+  std::vector<t_complex> H((n_max + 1) * count), dH(H.size());
+  auto failures = bessel_batch<Bessel>(z.data(), 2 * count, n_max, J.data(), dJ.data());
+  if(failures.empty())
+    failures = bessel_batch<Hankel1>(z.data(), count, n_max, H.data(), dH.data());
+  if(not failures.empty())
+    throw std::runtime_error(failures.front().message + " in the Mie coefficients of a sphere");
+
+  int const pMax = n_max * (n_max + 2);
+  Tdiagonals.resize(2 * pMax, count);
+  RgQdiagonals.resize(2 * pMax, count);
+  for(std::size_t w = 0; w < count; ++w) {
+    auto const r_0 = z[w];
+    for(int n = 1, current = 0; n <= n_max; current += 2 * n + 1, ++n) {
+      auto const jn = J[n * 2 * count + w], djn = dJ[n * 2 * count + w];
+      auto const jrho = J[n * 2 * count + count + w], djrho = dJ[n * 2 * count + count + w];
+      auto const hn = H[n * count + w], dhn = dH[n * count + w];
+      // Riccati-Bessel functions and their derivatives
+      auto const psi = r_0 * jn;
+      auto const dpsi = r_0 * djn + jn;
+      auto const ksi = r_0 * hn;
+      auto const dksi = r_0 * dhn + hn;
+      auto const psirho = r_0 * rho[w] * jrho;
+      auto const dpsirho = r_0 * rho[w] * djrho + jrho;
+
+      // TE part, b_n coefficients, and TM part, a_n coefficients
+      auto const TE = (psi / ksi) * (mu_sob[w] * dpsi / psi - rho[w] * dpsirho / psirho) /
+                      (rho[w] * dpsirho / psirho - mu_sob[w] * dksi / ksi);
+      auto const TM = (psi / ksi) * (mu_sob[w] * dpsirho / psirho - rho[w] * dpsi / psi) /
+                      (rho[w] * dksi / ksi - mu_sob[w] * dpsirho / psirho);
+      // T Q = RgQ for SH rather than -RgQ
+      Tdiagonals.col(w).segment(current, 2 * n + 1).fill(SH ? -TE : TE);
+      Tdiagonals.col(w).segment(pMax + current, 2 * n + 1).fill(SH ? -TM : TM);
+
+      // ratios of the scattered to the internal coefficients, with the (-1)^m of the surface
+      // integrals, the SH ones lacking their factor i k_b
+      auto const scale =
+          (SH ? 1.0 / (consCi * k_b[w]) : t_complex(1)) / (consCi * mu_sob[w] * rho[w]);
+      auto const RgTE = scale * (rho[w] * dpsirho * psi - mu_sob[w] * psirho * dpsi);
+      auto const RgTM = scale * (mu_sob[w] * psi * dpsirho - rho[w] * psirho * dpsi);
+      for(int m = -n; m <= n; ++m) {
+        RgQdiagonals(current + n + m, w) = m % 2 == 0 ? RgTE : -RgTE;
+        RgQdiagonals(pMax + current + n + m, w) = m % 2 == 0 ? RgTM : -RgTM;
+      }
+    }
+  }
 }
 
 #ifdef OPTIMET_MPI
 void Scatterer::getQLocal(optimet::Vector<optimet::t_complex>& Qmatrix,
- optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const {
+ optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const {
   using namespace optimet;
 
-  auto const N = HarmonicsIterator::max_flat(nMax) - 1;
- 
   // calculate the Qmatrix for arbitrary shaped scatterer (evaluation of surface integrals)
-  
-          CompoundIterator mu1;
-          CompoundIterator mup;
-          CompoundIterator nu1;
-          
-          Cartesian<double> intpoinCar; // integration points in Cartesian system
-          Spherical<double> intpoinSph; // integration points in spherical system
-          
-          const std::complex<double> k_0 = (omega_) * std::sqrt(consEpsilon0 * consMu0);
-          
-          int muMax =mu1.max(nMax);
-          int nuMax =nu1.max(nMax);
-          int brojac(0);
-          int size = nuMax*(gran2 - gran1);
-          
-          std::complex<double>* resCR = new std::complex<double>[3];
-          std::complex<double> resDOT;
-
-          Vector<t_complex> Qmatrix_a(size), Qmatrix_b(size), Qmatrix_c(size), Qmatrix_d(size);
-         Vector<t_complex> Qmatrix_1(2*size), Qmatrix_2(2*size);
-          
-          auto const k_s = omega_ * std::sqrt(elmag.epsilon * elmag.mu);
-          auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu);
-  
-        unsigned int Nt = (topol.size()) / 3;  //number of triangles
-
-        std::vector<std::vector<double>> Points = Tools::getPoints4();
-
-	std::vector<double> Weights = Tools::getWeights4();
-       
-	for (mu1 = gran1; mu1 < gran2 ; mu1++){
-	
-	int nn = mu1.first;
-	int mm =  mu1.second;
-	mup = nn * (nn + 1) + mm - 1;
-		
-	for (nu1 = 0; nu1 < nuMax ; nu1++){
-	
-	std::complex<double> I11(0.0,0.0), I12(0.0,0.0), I21(0.0,0.0), I22(0.0,0.0);
-        std::complex<double> I31(0.0,0.0), I32(0.0,0.0), I41(0.0,0.0), I42(0.0,0.0);
-	
-	// surface integration
-	 for (int ele1 = 0; ele1 < Nt; ++ele1){
-
-        const int* n1 = this->getNOvertex(ele1);
-	
-		const double* p1 = this->getCoord(n1[0]);
-                
-		const double* p2 = this->getCoord(n1[1]);
-	
-		const double* p3 = this->getCoord(n1[2]);
-                
-                Trian trian(p1, p2, p3); 
-                
-		double det = trian.getDeter();
-		std::vector<double> nvec = trian.getnorm();
-	
-	for (int ni = 0; ni != Weights.size(); ++ni) {
-	
-	double N1 = Points[ni][0];
-	double N2 = Points[ni][1];
-        double N0 = 1.0 - N1 - N2;
-
-	double wi = Weights[ni];
-         
-	intpoinCar.x = (p1[0])*N1 + (p2[0])*N2 + (p3[0])*N0;
-	intpoinCar.y = (p1[1])*N1 + (p2[1])*N2 + (p3[1])*N0;
-	intpoinCar.z = (p1[2])*N1 + (p2[2])*N2 + (p3[2])*N0;
-	
-	intpoinSph = Tools::toSpherical(intpoinCar); 
-	
-
-        optimet::AuxCoefficients aCoefext3(intpoinSph, k_b, 0, nMax); //radiative VSWF (3)
-        optimet::AuxCoefficients aCoefint1(intpoinSph, k_0 * sqrt(elmag.epsilon_r * elmag.mu_r), 1, nMax); //regular VSWF (1)
-
-        //*****************************************
-        Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-		
-        resDOT = Tools::dot (&nvec[0], resCR);
-
-        I11 = I11 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I12 = I12 + wi * det *(consCi * k_b*k_s)*resDOT;
-	
-
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I21 = I21 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I22 = I22 + wi * det *(consCi * k_b*k_s)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I31 = I31 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I32 = I32 + wi * det *(consCi * k_b*k_s)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I41 = I41 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I42 = I42 + wi * det *(consCi * k_b*k_s)*resDOT;
-	//*****************************************
-	
-	
-	}// Gauss Legendre integration of spherical harmonics over a triangle 
-        }// iteration over all triangles, complete surface integration	
-
-        Qmatrix_a (brojac) = (I11 + I12);
-        Qmatrix_b (brojac) = (I21 + I22);
-        Qmatrix_c (brojac) = (I31 + I32);
-        Qmatrix_d (brojac) = (I41 + I42);
-
-        brojac++;         
-	}
-
-	}// iteration over all spherical harmonics
-  
-      Qmatrix_1.head(size) = Qmatrix_a;
-      Qmatrix_1.tail(size) = Qmatrix_b;
-
-      Qmatrix_2.head(size) = Qmatrix_c;
-      Qmatrix_2.tail(size) = Qmatrix_d;
-
-      Qmatrix.head(2*size) = Qmatrix_1;
-      Qmatrix.tail(2*size) = Qmatrix_2;
-   
+  const std::complex<double> k_0 = (omega_) * std::sqrt(consEpsilon0 * consMu0);
+  auto const k_s = omega_ * std::sqrt(elmag.epsilon * elmag.mu);
+  auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu);
+
+  // radiative VSWF (3) outside, regular VSWF (1) inside
+  surfaceIntegrals({{k_b, false, k_0 * sqrt(elmag.epsilon_r * elmag.mu_r), consCi * k_b * k_b,
+                     consCi * k_b * k_s}},
+                   nMax, gran1, gran2, tri1, tri2, {&Qmatrix});
 }
 
+void Scatterer::getRgQLocal(optimet::Vector<optimet::t_complex>& RgQmatrix, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const {
+  using namespace optimet;
+
+  // calculate the Rg(Q) matrix for arbitrary shaped scatterer, needed for conversion of scattered to internal coefficients
+  const std::complex<double> k_0 = (omega_) * std::sqrt(consEpsilon0 * consMu0);
+  auto const k_s = omega_ * std::sqrt(elmag.epsilon * elmag.mu);
+  auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu);
+
+  // regular VSWF (1) outside and inside
+  surfaceIntegrals({{k_b, true, k_0 * sqrt(elmag.epsilon_r * elmag.mu_r), consCi * k_b * k_b,
+                     consCi * k_b * k_s}},
+                   nMax, gran1, gran2, tri1, tri2, {&RgQmatrix});
+}
 
-void Scatterer::getRgQLocal(optimet::Vector<optimet::t_complex>& RgQmatrix, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const {
+void Scatterer::getQLocalSH(optimet::Vector<optimet::t_complex>& QmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const {
   using namespace optimet;
-  
-  auto const N = HarmonicsIterator::max_flat(nMax) - 1;
-
-// calculate the Rg(Q) matrix for arbitrary shaped scatterer, needed for conversion of scattered to internal coefficients
-          CompoundIterator mu1;
-          CompoundIterator mup;
-          CompoundIterator nu1;
-          
-          Cartesian<double> intpoinCar; // integration points in Cartesian system
-          Spherical<double> intpoinSph; // integration points in spherical system
-         const std::complex<double> k_0 = (omega_) * std::sqrt(consEpsilon0 * consMu0);
-          
-          int muMax =mu1.max(nMax);
-          int nuMax =nu1.max(nMax);
-          int brojac(0);
-          int size = nuMax *(gran2 - gran1);
-          
-          std::complex<double>* resCR = new std::complex<double>[3];
-          std::complex<double> resDOT;
-
-          Vector<t_complex> RgQmatrix_a(size), RgQmatrix_b(size), RgQmatrix_c(size), RgQmatrix_d(size);
-         Vector<t_complex> RgQmatrix_1(2*size), RgQmatrix_2(2*size);
-          
-          auto const k_s = omega_ * std::sqrt(elmag.epsilon * elmag.mu);  
-          auto const k_b = omega_ * std::sqrt(bground.epsilon * bground.mu); 
-  
-        unsigned int Nt = (topol.size()) / 3;  //number of triangles
-
-       std::vector<std::vector<double>> Points = Tools::getPoints4();
-
-	std::vector<double> Weights = Tools::getWeights4();
-
-	for (mu1 = gran1; mu1 < gran2 ; mu1++){
-	
-	int nn = mu1.first;
-	int mm =  mu1.second;
-	mup = nn * (nn + 1) + mm - 1;
-		
-	for (nu1 = 0; nu1 < nuMax ; nu1++){
-	
-	std::complex<double> RgI11(0.0,0.0), RgI12(0.0,0.0), RgI21(0.0,0.0), RgI22(0.0,0.0);
-        std::complex<double> RgI31(0.0,0.0), RgI32(0.0,0.0), RgI41(0.0,0.0), RgI42(0.0,0.0);
-	
-	// surface integration
-	 for (int ele1 = 0; ele1 < Nt; ++ele1){
-
-         const int* n1 = this->getNOvertex(ele1);
-	
-		const double* p1 = this->getCoord(n1[0]);
-
-		const double* p2 = this->getCoord(n1[1]);
-	
-		const double* p3 = this->getCoord(n1[2]);
-                
-                Trian trian(p1, p2, p3); 
-                
-		double det = trian.getDeter();
-		std::vector<double> nvec = trian.getnorm();
-		
-	for (int ni = 0; ni != Weights.size(); ++ni) {
-	
-	double N1 = Points[ni][0];
-	double N2 = Points[ni][1];
-        double N0 = 1.0 - N1 - N2;
-
-	double wi = Weights[ni];
-         
-	intpoinCar.x = (p1[0])*N1 + (p2[0])*N2 + (p3[0])*N0;
-	intpoinCar.y = (p1[1])*N1 + (p2[1])*N2 + (p3[1])*N0;
-	intpoinCar.z = (p1[2])*N1 + (p2[2])*N2 + (p3[2])*N0;
-	
-	intpoinSph = Tools::toSpherical(intpoinCar); 
-	
-
-        optimet::AuxCoefficients aCoefext1(intpoinSph, k_b, 1, nMax); //regular VSWF (1)
-        optimet::AuxCoefficients aCoefint1(intpoinSph, k_0 * sqrt(elmag.epsilon_r * elmag.mu_r), 1, nMax); //regular VSWF (1)
-	
-
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI11 = RgI11 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI12 = RgI12 + wi * det *(consCi * k_b*k_s)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI21 = RgI21 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI22 = RgI22 + wi * det *(consCi * k_b*k_s)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI31 = RgI31 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI32 = RgI32 + wi * det *(consCi * k_b*k_s)*resDOT;
-	
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI41 = RgI41 + wi * det *(consCi * k_b*k_b)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI42 = RgI42 + wi * det *(consCi * k_b*k_s)*resDOT;
-	
-	
-	}// Gauss Legendre integration of spherical harmonics over a triangle 
-        }// iteration over all triangles, complete surface integration
-
-        RgQmatrix_a (brojac) = (RgI11 + RgI12);
-        RgQmatrix_b (brojac) = (RgI21 + RgI22);
-        RgQmatrix_c (brojac) = (RgI31 + RgI32);
-        RgQmatrix_d (brojac) = (RgI41 + RgI42);
-
-        brojac++;        
-	}	
-	}// iteration over all spherical harmonics
-
-      RgQmatrix_1.head(size) = RgQmatrix_a;
-      RgQmatrix_1.tail(size) = RgQmatrix_b;
-
-      RgQmatrix_2.head(size) = RgQmatrix_c;
-      RgQmatrix_2.tail(size) = RgQmatrix_d;
-
-      RgQmatrix.head(2*size) = RgQmatrix_1;
-      RgQmatrix.tail(2*size) = RgQmatrix_2;
- 
-  }
-                   
 
-void Scatterer::getQLocalSH(optimet::Vector<optimet::t_complex>& QmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const {
+  // SH frequency coefficients
+  const std::complex<double> k_0_SH = (2 * omega_) * std::sqrt(consEpsilon0 * consMu0);
+  auto const k_s_SH = 2 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH);
+  auto const k_b_SH = 2 * omega_ * std::sqrt(bground.epsilon * bground.mu);
+
+  // radiative VSWF (3) outside, regular VSWF (1) inside
+  surfaceIntegrals({{k_b_SH, false, k_0_SH * sqrt(elmag.epsilon_r_SH * elmag.mu_r_SH), k_b_SH,
+                     k_s_SH}},
+                   nMaxS, gran1, gran2, tri1, tri2, {&QmatrixSH});
+}
+
+void Scatterer::getRgQLocalSH(optimet::Vector<optimet::t_complex>& RgQmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const {
   using namespace optimet;
-  
-  auto const N = HarmonicsIterator::max_flat(nMaxS) - 1;
-  
-  // SH frequency coefficients 
+
+  // SH frequency coefficients
+  const std::complex<double> k_0_SH = 2 * (omega_) * std::sqrt(consEpsilon0 * consMu0);
   auto const k_s_SH = 2 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH);
   auto const k_b_SH = 2 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-  
-          CompoundIterator mu1;
-          CompoundIterator mup;
-          CompoundIterator nu1;
-          
-          Cartesian<double> intpoinCar; // integration points in Cartesian system
-          Spherical<double> intpoinSph; // integration points in spherical system 
-          const std::complex<double> k_0_SH = (2 * omega_) * std::sqrt(consEpsilon0 * consMu0);
-           
-          int muMax =mu1.max(nMaxS);
-          int nuMax =nu1.max(nMaxS);
-          int brojac(0);
-          int size = nuMax *(gran2 - gran1);
-          
-          std::complex<double>* resCR = new std::complex<double>[3];
-          std::complex<double> resDOT;
-
-         Vector<t_complex> QmatrixSH_a(size), QmatrixSH_b(size), QmatrixSH_c(size), QmatrixSH_d(size);
-         Vector<t_complex> QmatrixSH_1(2*size), QmatrixSH_2(2*size);
-
-        unsigned int Nt = (topol.size()) / 3;  //number of triangles
-
-        std::vector<std::vector<double>> Points = Tools::getPoints4();
-
-	std::vector<double> Weights = Tools::getWeights4();
-       
-	for (mu1 = gran1; mu1 < gran2 ; mu1++){
-         
-	int nn = mu1.first;
-	int mm =  mu1.second;
-	mup = nn * (nn + 1) + mm - 1;
-        		
- 	for (nu1 = 0; nu1 < nuMax ; nu1++){
-	
-	std::complex<double> I11(0.0,0.0), I12(0.0,0.0), I21(0.0,0.0), I22(0.0,0.0);
-        std::complex<double> I31(0.0,0.0), I32(0.0,0.0), I41(0.0,0.0), I42(0.0,0.0);
-	
-	// surface integration
-	for (int ele1 = 0; ele1 < Nt; ++ele1){
-        
-        const int* n1 = this->getNOvertex(ele1);
-	
-		const double* p1 = this->getCoord(n1[0]);
-                
-		const double* p2 = this->getCoord(n1[1]);
-	
-		const double* p3 = this->getCoord(n1[2]);
-                
-                Trian trian(p1, p2, p3); 
-                
-		double det = trian.getDeter();
-		std::vector<double> nvec = trian.getnorm();
-		
-	for (int ni = 0; ni != Weights.size(); ++ni) {
-	
-	double N1 = Points[ni][0];
-	double N2 = Points[ni][1];
-        double N0 = 1.0 - N1 - N2;
-
-	double wi = Weights[ni];
-         
-	intpoinCar.x = (p1[0])*N1 + (p2[0])*N2 + (p3[0])*N0;
-	intpoinCar.y = (p1[1])*N1 + (p2[1])*N2 + (p3[1])*N0;
-	intpoinCar.z = (p1[2])*N1 + (p2[2])*N2 + (p3[2])*N0;
-	
-	intpoinSph = Tools::toSpherical(intpoinCar); 
-	
-
-        optimet::AuxCoefficients aCoefext3(intpoinSph, k_b_SH, 0, nMaxS); //radiative VSWF (3)
-	optimet::AuxCoefficients aCoefint1(intpoinSph, k_0_SH * sqrt(elmag.epsilon_r_SH * elmag.mu_r_SH), 1, nMaxS); //regular VSWF (1)
-        
-        //*****************************************
-        Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I11 = I11 + wi * det *(k_b_SH)*resDOT;
-	///***********
-        Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I12 = I12 + wi * det *(k_s_SH)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I21 = I21 + wi * det *(k_b_SH)*resDOT;
-	///***********
-        Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I22 = I22 + wi * det *(k_s_SH)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I31 = I31 + wi * det *(k_b_SH)*resDOT;
-	///***********
-        Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I32 = I32 + wi * det *(k_s_SH)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext3.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I41 = I41 + wi * det *(k_b_SH)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext3.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	I42 = I42 + wi * det *(k_s_SH)*resDOT;
-	//*****************************************
-	
-	
-	}// Gauss Legendre integration of spherical harmonics over a triangle 
-        }// iteration over all triangles, complete surface integration	
-
-        QmatrixSH_a (brojac) = (I11 + I12);
-        QmatrixSH_b (brojac) = (I21 + I22);
-        QmatrixSH_c (brojac) = (I31 + I32);
-        QmatrixSH_d (brojac) = (I41 + I42);
- 
-        brojac++;
-
-	}
-	
-	}// iteration over all spherical harmonics
-
-      QmatrixSH_1.head(size) = QmatrixSH_a;
-      QmatrixSH_1.tail(size) = QmatrixSH_b;
-
-      QmatrixSH_2.head(size) = QmatrixSH_c;
-      QmatrixSH_2.tail(size) = QmatrixSH_d;
-
-      QmatrixSH.head(2*size) = QmatrixSH_1;
-      QmatrixSH.tail(2*size) = QmatrixSH_2;
-  
-  }
 
+  // regular VSWF (1) outside and inside
+  surfaceIntegrals({{k_b_SH, true, k_0_SH * sqrt(elmag.epsilon_r_SH * elmag.mu_r_SH), k_b_SH,
+                     k_s_SH}},
+                   nMaxS, gran1, gran2, tri1, tri2, {&RgQmatrixSH});
+}
 
-void Scatterer::getRgQLocalSH(optimet::Vector<optimet::t_complex>& RgQmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const {
+void Scatterer::getQRgQLocal(std::vector<optimet::t_real> const &omegas,
+                             std::vector<ElectroMagnetic> const &materials,
+                             ElectroMagnetic const &bground, bool SH, int gran1, int gran2,
+                             int tri1, int tri2,
+                             std::vector<optimet::Vector<optimet::t_complex>> &Qmatrices,
+                             std::vector<optimet::Vector<optimet::t_complex>> &RgQmatrices) const {
   using namespace optimet;
-  
-  auto const N = HarmonicsIterator::max_flat(nMaxS) - 1;
 
-  // calculate the Rg(Q) matrix for arbitrary shaped scatterer, needed for conversion of scattered to internal coefficients
-  
-          CompoundIterator mu1;
-          CompoundIterator mup;
-          CompoundIterator nu1;
-          
-          Cartesian<double> intpoinCar; // integration points in Cartesian system
-          Spherical<double> intpoinSph; // integration points in spherical system
-          const std::complex<double> k_0_SH = 2 * (omega_) * std::sqrt(consEpsilon0 * consMu0);
-          
-          int muMax =mu1.max(nMaxS);
-          int nuMax =nu1.max(nMaxS);
-          int brojac(0);
-          int size = nuMax *(gran2 - gran1);
-   
-          std::complex<double>* resCR = new std::complex<double>[3];
-          std::complex<double> resDOT;
-
-         Vector<t_complex> RgQmatrixSH_a(size), RgQmatrixSH_b(size), RgQmatrixSH_c(size), RgQmatrixSH_d(size);
-         Vector<t_complex> RgQmatrixSH_1(2*size), RgQmatrixSH_2(2*size);
-          
-         auto const k_s_SH = 2 * omega_ * std::sqrt(elmag.epsilon_SH * elmag.mu_SH); 
-         auto const k_b_SH = 2 * omega_ * std::sqrt(bground.epsilon * bground.mu);
-  
-        unsigned int Nt = (topol.size()) / 3;  //number of triangles
-        
-        std::vector<std::vector<double>> Points = Tools::getPoints4();
-
-	std::vector<double> Weights = Tools::getWeights4();
-
-	for (mu1 = gran1; mu1 < gran2 ; mu1++){
-	
-	int nn = mu1.first;
-	int mm =  mu1.second;
-	mup = nn * (nn + 1) + mm - 1;
-		
-	for (nu1 = 0; nu1 < nuMax ; nu1++){
-	
-	std::complex<double> RgI11(0.0,0.0), RgI12(0.0,0.0), RgI21(0.0,0.0), RgI22(0.0,0.0);
-        std::complex<double> RgI31(0.0,0.0), RgI32(0.0,0.0), RgI41(0.0,0.0), RgI42(0.0,0.0);
-	
-	// surface integration
-	for (int ele1 = 0; ele1 < Nt; ++ele1){
-
-        const int* n1 = this->getNOvertex(ele1);
-	
-		const double* p1 = this->getCoord(n1[0]);
-
-		const double* p2 = this->getCoord(n1[1]);
-	
-		const double* p3 = this->getCoord(n1[2]);
-                
-                Trian trian(p1, p2, p3); 
-                
-		double det = trian.getDeter();
-		std::vector<double> nvec = trian.getnorm();
-		
-	for (int ni = 0; ni != Weights.size(); ++ni) {
-	
-	double N1 = Points[ni][0];
-	double N2 = Points[ni][1];
-        double N0 = 1.0 - N1 - N2;
-
-	double wi = Weights[ni];
-         
-	intpoinCar.x = (p1[0])*N1 + (p2[0])*N2 + (p3[0])*N0;
-	intpoinCar.y = (p1[1])*N1 + (p2[1])*N2 + (p3[1])*N0;
-	intpoinCar.z = (p1[2])*N1 + (p2[2])*N2 + (p3[2])*N0;
-	
-	intpoinSph = Tools::toSpherical(intpoinCar); 
-	
-
-        optimet::AuxCoefficients aCoefext1(intpoinSph, k_b_SH, 1, nMaxS); //regular VSWF (1)
-        optimet::AuxCoefficients aCoefint1(intpoinSph, k_0_SH * sqrt(elmag.epsilon_r_SH * elmag.mu_r_SH), 1, nMaxS); //regular VSWF (1)
-
-       //*****************************************
-       Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI11 = RgI11 + wi * det *(k_b_SH)*resDOT;
-       ///***********
-       Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI12 = RgI12 + wi * det *(k_s_SH)*resDOT;
-        //*****************************************
-        Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI21 = RgI21 + wi * det *(k_b_SH)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI22 = RgI22 + wi * det *(k_s_SH)*resDOT;
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI31 = RgI31 + wi * det *(k_b_SH)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI32 = RgI32 + wi * det *(k_s_SH)*resDOT;
-	
-	
-	//*****************************************
-	Tools::cross(resCR, aCoefint1.N(static_cast<long>(nu1)), aCoefext1.M(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI41 = RgI41 + wi * det *(k_b_SH)*resDOT;
-	///***********
-	Tools::cross(resCR, aCoefint1.M(static_cast<long>(nu1)), aCoefext1.N(static_cast<long>(mup)));
-	
-	resDOT = Tools::dot (&nvec[0], resCR);
-	
-	RgI42 = RgI42 + wi * det *(k_s_SH)*resDOT;
-	
-	
-	}// Gauss Legendre integration of spherical harmonics over a triangle 
-        }// iteration over all triangles, complete surface integration	
-
-        RgQmatrixSH_a (brojac) = (RgI11 + RgI12);
-	RgQmatrixSH_b (brojac) = (RgI21 + RgI22);
-	RgQmatrixSH_c (brojac) = (RgI31 + RgI32);
-	RgQmatrixSH_d (brojac) = (RgI41 + RgI42);
-        
-        brojac++; 
-	}
-
-	}// iteration over all spherical harmonics
-
-      RgQmatrixSH_1.head(size) = RgQmatrixSH_a;
-      RgQmatrixSH_1.tail(size) = RgQmatrixSH_b;
-
-      RgQmatrixSH_2.head(size) = RgQmatrixSH_c;
-      RgQmatrixSH_2.tail(size) = RgQmatrixSH_d;
-
-      RgQmatrixSH.head(2*size) = RgQmatrixSH_1;
-      RgQmatrixSH.tail(2*size) = RgQmatrixSH_2;
-
-     }
- #endif                         
-    
+  int const nMax_ = SH ? nMaxS : nMax;
+  auto const size = 4 * CompoundIterator::max(nMax_) * (gran2 - gran1);
+  Qmatrices.assign(omegas.size(), Vector<t_complex>(size));
+  RgQmatrices.assign(omegas.size(), Vector<t_complex>(size));
+  // Q then RgQ at each frequency, with the same inner functions, as in getQLocal and getRgQLocal
+  std::vector<SurfacePass> passes;
+  std::vector<Vector<t_complex> *> results;
+  for(std::size_t w = 0; w < omegas.size(); ++w) {
+    auto const &material = materials[w];
+    t_real const omega = SH ? 2 * omegas[w] : omegas[w];
+    std::complex<double> const k_0 = omega * std::sqrt(consEpsilon0 * consMu0);
+    auto const k_b = omega * std::sqrt(bground.epsilon * bground.mu);
+    auto const k_s = SH ? omega * std::sqrt(material.epsilon_SH * material.mu_SH) :
+                          omega * std::sqrt(material.epsilon * material.mu);
+    auto const k_int = SH ? k_0 * sqrt(material.epsilon_r_SH * material.mu_r_SH) :
+                            k_0 * sqrt(material.epsilon_r * material.mu_r);
+    auto const factor_b = SH ? k_b : consCi * k_b * k_b;
+    auto const factor_s = SH ? k_s : consCi * k_b * k_s;
+    for(bool const regular : {false, true})
+      passes.push_back({k_b, regular, k_int, factor_b, factor_s});
+    results.push_back(&Qmatrices[w]);
+    results.push_back(&RgQmatrices[w]);
+  }
+  surfaceIntegrals(passes, nMax_, gran1, gran2, tri1, tri2, results);
+}
+
+void Scatterer::surfaceIntegrals(
+    std::vector<SurfacePass> const &passes, int nMax_, int gran1, int gran2, int tri1, int tri2,
+    std::vector<optimet::Vector<optimet::t_complex> *> const &Qmatrices) const {
+  using namespace optimet;
+
+  int nuMax = CompoundIterator::max(nMax_);
+  int nrows = gran2 - gran1;
+  int size = nuMax * nrows;
+  int const npasses = passes.size();
+
+  int Nt = getNOtriangles();
+  int Nq = getNOpoints() / std::max(Nt, 1); // quadrature points per triangle
+  // on a symmetric mesh, the integrals over all the images of a triangle of the wedge are those
+  // over the triangle times its number of images, for the pairs of inner and outer functions
+  // whose products are invariant, and vanish for the others
+  bool const symmetric = getNOwedge() > 0;
+
+  // n.(X1 x Y3) = (n x X1).Y3, so every block of the surface integral is a product
+  // of a (3 points x nu) table of w*det*(n x X1) with a (3 points x mu) table of Y3.
+  // Triangles are packed in chunks so that the tables stay small, and each chunk is integrated
+  // for all the passes while its triangles are at hand.
+  int const chunk = 64;
+  int const chunk_rows = 3 * chunk * Nq;
+  int const nchunks = (tri2 - tri1 + chunk - 1) / chunk;
+  // [ n.(M1 x N3)  n.(M1 x M3) ]
+  // [ n.(N1 x N3)  n.(N1 x M3) ]
+  std::vector<Matrix<t_complex>> integrals(npasses,
+                                           Matrix<t_complex>::Zero(2 * nuMax, 2 * nrows));
+  std::exception_ptr error = nullptr;
+  // the angular parts are shared by the inner and outer VSWFs and kept between wavelengths
+  auto const angular = getPointAngular(nMax_);
+  // outer functions of the columns are taken at (n, -m)
+  auto const indices = harmonic_indices(nMax_);
+  std::vector<t_uint> outer_index(nrows);
+  for(int col = 0; col < nrows; ++col)
+    outer_index[col] = flatten_indices(indices[gran1 + col].first, -indices[gran1 + col].second);
+
+  // with OpenMP the chunks are shared among the threads of this rank,
+  // each thread keeping its own partial sums
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel
+#endif
+  {
+    Matrix<t_complex> inner(chunk_rows, 2 * nuMax); // [n x M1 | n x N1]
+    Matrix<t_complex> outer(chunk_rows, 2 * nrows); // [N3 | M3]
+    std::vector<Matrix<t_complex>> partial(npasses,
+                                           Matrix<t_complex>::Zero(2 * nuMax, 2 * nrows));
+    std::vector<t_real> wdet(Nq);
+
+    // surface integration
+#ifdef OPTIMET_OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for(int ichunk = 0; ichunk < nchunks; ++ichunk) {
+      try {
+        int const first = tri1 + ichunk * chunk;
+        int const last = std::min<int>(first + chunk, tri2);
+        int row = 0;
+
+        for(int p = 0; p < npasses; ++p) {
+          auto const &pass = passes[p];
+          // the inner functions of the previous pass serve again at the same wave number
+          bool const same_inner = p > 0 and passes[p - 1].k_int == pass.k_int;
+          row = 0;
+          for(int ele1 = first; ele1 < last; ++ele1, row += 3 * Nq) {
+
+            const double *nvec = getNormal(ele1);
+
+            // the VSWFs at the quadrature points of this triangle are evaluated in one batch
+            // and shared by all (mu, nu) pairs
+            AuxCoefficientsBatch const aCoefext(*angular, ele1 * Nq, (ele1 + 1) * Nq, pass.k_ext,
+                                                pass.regular_ext, nMax_);
+            if(not same_inner) {
+              AuxCoefficientsBatch const aCoefint(*angular, ele1 * Nq, (ele1 + 1) * Nq,
+                                                  pass.k_int, 1, nMax_);
+              for(int q = 0; q < Nq; ++q)
+                wdet[q] = (symmetric ? mesh->images[ele1] : 1) * getPointWdet(ele1 * Nq + q);
+
+              // rows c * Nq + q of the triangle hold component c at point q, so that the tables
+              // are filled from the batches point after point
+              for(int f = 0; f < 2; ++f) {
+                auto const function = f == 0 ? AuxCoefficientsBatch::M_ : AuxCoefficientsBatch::N_;
+                for(int nu1 = 0; nu1 < nuMax; ++nu1)
+                  for(int c = 0; c < 3; ++c) {
+                    // (n x X)_c = n_c1 X_c2 - n_c2 X_c1
+                    int const c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+                    t_real const *const r1 = aCoefint.real(function, c1, nu1);
+                    t_real const *const i1 = aCoefint.imag(function, c1, nu1);
+                    t_real const *const r2 = aCoefint.real(function, c2, nu1);
+                    t_real const *const i2 = aCoefint.imag(function, c2, nu1);
+                    t_complex *const column = &inner(row + c * Nq, f * nuMax + nu1);
+                    for(int q = 0; q < Nq; ++q)
+                      column[q] = wdet[q] * t_complex(nvec[c1] * r2[q] - nvec[c2] * r1[q],
+                                                      nvec[c1] * i2[q] - nvec[c2] * i1[q]);
+                  }
+              }
+            }
+
+            for(int f = 0; f < 2; ++f) {
+              auto const function = f == 0 ? AuxCoefficientsBatch::N_ : AuxCoefficientsBatch::M_;
+              for(int col = 0; col < nrows; ++col)
+                for(int c = 0; c < 3; ++c) {
+                  t_real const *const re = aCoefext.real(function, c, outer_index[col]);
+                  t_real const *const im = aCoefext.imag(function, c, outer_index[col]);
+                  t_complex *const column = &outer(row + c * Nq, f * nrows + col);
+                  for(int q = 0; q < Nq; ++q)
+                    column[q] = t_complex(re[q], im[q]);
+                }
+            } // Gauss Legendre integration of spherical harmonics over a triangle
+          }
+
+          partial[p].noalias() += inner.topRows(row).transpose() * outer.topRows(row);
+        }
+      } catch(...) {
+        // exceptions must not escape the parallel region
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_surface_integrals)
+#endif
+        error = std::current_exception();
+      }
+    } // iteration over all triangles, complete surface integration
+
+#ifdef OPTIMET_OPENMP
+#pragma omp critical(optimet_surface_integrals)
+#endif
+    for(int p = 0; p < npasses; ++p)
+      integrals[p] += partial[p];
+  }
+  if(error)
+    std::rethrow_exception(error);
+  if(symmetric) {
+    // the rotations by 2 pi / N keep the products of the functions of m and m' if N divides m - m',
+    // the mirror multiplies them by (-1)^(n + m + n' + m'), and by -1 more between M and N
+    int const rotations = mesh->rotations();
+    for(int col = 0; col < nrows; ++col)
+      for(int nu1 = 0; nu1 < nuMax; nu1++) {
+        auto const &mu = indices[gran1 + col], &nu = indices[nu1];
+        bool const rotated = (nu.second - mu.second) % rotations != 0;
+        bool const odd = (nu.first + nu.second + mu.first + mu.second) % 2 != 0;
+        // rows M then N of the inner functions, columns N then M of the outer ones
+        for(int i = 0; i < 2; ++i)
+          for(int j = 0; j < 2; ++j)
+            if(rotated or (mesh->mirror() and odd == (i == j)))
+              for(auto &integral : integrals)
+                integral(i * nuMax + nu1, j * nrows + col) = 0;
+      }
+  }
+
+  for(int p = 0; p < npasses; ++p) {
+    auto const IMN = integrals[p].block(0, 0, nuMax, nrows);
+    auto const IMM = integrals[p].block(0, nrows, nuMax, nrows);
+    auto const INN = integrals[p].block(nuMax, 0, nuMax, nrows);
+    auto const INM = integrals[p].block(nuMax, nrows, nuMax, nrows);
+    auto const factor_b = passes[p].factor_b, factor_s = passes[p].factor_s;
+    auto &Qmatrix = *Qmatrices[p];
+
+    // rows are stored with flat index nu + nuMax * (mu - gran1), i.e. column-major blocks
+    Matrix<t_complex> block(nuMax, nrows);
+    block = factor_b * IMN + factor_s * INM;
+    Qmatrix.segment(0, size) = Eigen::Map<Vector<t_complex>>(block.data(), size);
+    block = factor_b * INN + factor_s * IMM;
+    Qmatrix.segment(size, size) = Eigen::Map<Vector<t_complex>>(block.data(), size);
+    block = factor_b * IMM + factor_s * INN;
+    Qmatrix.segment(2 * size, size) = Eigen::Map<Vector<t_complex>>(block.data(), size);
+    block = factor_b * INM + factor_s * IMN;
+    Qmatrix.segment(3 * size, size) = Eigen::Map<Vector<t_complex>>(block.data(), size);
+  }
+}
+#endif
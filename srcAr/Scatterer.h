@@ -21,10 +21,17 @@
 #include "Spherical.h"
 #include "Types.h"
 #include "CompoundIterator.h"
+#include "SurfaceMesh.h"
+#include <array>
+#include <memory>
+#include <string>
 #include <vector>
 #include <tuple>
 #include <cstring>
 
+namespace optimet {
+class AuxAngular;
+}
 
 /**
  * The Scatterer class is the highest level element of a geometry.
@@ -35,25 +42,75 @@
 class Scatterer {
 private:
 
-        std::vector<double> coord;
-        std::vector<int> topol;
+        // vertices, triangles and their tables, shared with the other scatterers of the same mesh
+        std::shared_ptr<optimet::SurfaceMesh const> mesh;
        
 public:
         void Mesh(std::vector<double> co, std::vector<int> top);
+        //! Uses a mesh of the library, shared with the other scatterers using it
+        //! \details The quadrature on each triangle is exact up to the given degree, 1 to 8. A mesh
+        //! invariant under the rotations by 2 pi / rotations about z, and under z -> -z with the
+        //! mirror, has its T-matrix integrated over an irreducible wedge.
+        void Mesh(std::shared_ptr<optimet::MeshFile const> mesh_, int degree = 3, int rotations = 1,
+                  bool mirror = false);
+        //! \brief Uses a mesh of the library as a body of revolution around the z axis
+        //! \details The surface integrals run along its generating curve, on contour points, and
+        //! around the axis, on evenly spaced meridians. Its T-matrix never couples different m.
+        void Revolution(std::shared_ptr<optimet::MeshFile const> mesh_, int contour, int meridians);
 	
 	const double* getCoord(int vertex_number)const{
-	return &(coord[vertex_number * 3]);
+	return mesh->file().coord() + vertex_number * 3;
 	}
 	
 	 const int* getNOvertex(int trian_number) const {
 	
-	return &(topol[trian_number*3]);
+	return mesh->file().topol() + trian_number * 3;
         }
 
   const int getTopolsize() const {
 	
-	return topol.size();
+	return mesh ? 3 * mesh->file().triangles() : 0;
         }
+
+  //! The kinds of scatterers, each with T-matrices and sources of its own
+  enum Kind { sphere, arbitrary_shape, motif };
+  //! \brief The kind of the scatterer, for the callers of the kernels to branch on once
+  //! \details The arbitrary shapes are the scatterers with a mesh, as read for "arbitrary.shape",
+  //! the motifs those standing for a group of particles.
+  Kind kind() const { return particles ? motif : mesh ? arbitrary_shape : sphere; }
+
+  int getNOvertices() const { return mesh ? mesh->file().vertices() : 0; }
+  int getNOtriangles() const { return mesh ? mesh->triangles() : 0; }
+  int getNOpoints() const { return mesh ? mesh->points() : 0; }
+  //! Number of triangles of the irreducible wedge of a symmetric mesh, zero otherwise
+  int getNOwedge() const { return mesh ? mesh->wedge() : 0; }
+  //! Number of rotations about z the mesh is invariant under
+  int getNOrotations() const { return mesh ? mesh->rotations() : 1; }
+  //! Whether the mesh is invariant under z -> -z
+  bool getMirror() const { return mesh and mesh->mirror(); }
+  //! Number of points along the generating curve of a body of revolution, zero otherwise
+  int getContour() const { return mesh ? mesh->contour() : 0; }
+
+  const double* getNormal(int trian_number) const { return &(mesh->normal[trian_number * 3]); }
+  const double* getCentroid(int trian_number) const { return &(mesh->centroid[trian_number * 3]); }
+  double getDeter(int trian_number) const { return mesh->deter[trian_number]; }
+
+  Cartesian<double> getPointCar(int point) const {
+    return Cartesian<double>(mesh->x[point], mesh->y[point], mesh->z[point]);
+  }
+  Spherical<double> getPointSph(int point) const {
+    return Spherical<double>(mesh->r[point], mesh->the[point], mesh->phi[point]);
+  }
+
+  double getPointWdet(int point) const { return mesh->wdet[point]; }
+
+  /**
+   * The angular parts of the VSWFs at the quadrature points. They only depend
+   * on the mesh, so they are computed on the first call and serve all the
+   * scatterers of the mesh, wave numbers and wavelengths.
+   * @param nMax_ the maximum value of the n iterator needed.
+   */
+  std::shared_ptr<optimet::AuxAngular const> getPointAngular(int nMax_) const;
   /**
    * Default Scatterer constructor.
    * Does NOT initialize the object.
@@ -93,18 +150,133 @@ public:
   double radius;         /**< The radius of a sphere encompassing the scatterer.*/
   int nMax;              /**< Maximum value of the n iterator. */
   int nMaxS;              /**< Maximum value of the n iterator SH */  
+  /** Harmonics of the fundamental T-matrix of the particle, at most nMax, all of them if zero.
+   * The couplings to a smaller particle stop at the larger order of the two. */
+  int order = 0;
+  //! Harmonics picked from the size parameter at the current wavelength, none if zero
+  int wavelength_order = 0;
+  //! The order the fundamental T-matrix of the particle is truncated to
+  int truncation() const {
+    int result = nMax;
+    for(int const given : {order, wavelength_order})
+      if(given > 0 and given < result)
+        result = given;
+    return result;
+  }
   std::string scatterer_type; // type of scatterer, sphere or arbitrary shaped
+  /** z-y-z Euler angles of the particle in radians: its mesh is turned by Rz(alpha) Ry(beta)
+   * Rz(gamma) in the laboratory frame. Its T-matrix is computed and cached in its own frame. */
+  std::array<double, 3> orientation{{0, 0, 0}};
+  /** \brief The particles of a motif, positioned about its centre, shared by its copies
+   * \details Its T-matrix is that of the cluster of the particles, at the harmonics of the
+   * scatterer, and none of its fields but the scattered ones are known. Empty for a particle. */
+  std::shared_ptr<std::vector<Scatterer> const> particles;
+
+  /**
+   * Checks whether two scatterers have the same T-matrices: same type, mesh,
+   * material and number of harmonics. Positions do not enter the comparison.
+   * @param other the scatterer to compare with.
+   * @return true if the T-matrices of this scatterer can be reused for other.
+   */
+  bool sameTmatrix(Scatterer const &other) const;
+
+  /**
+   * Key of the T-matrix of this scatterer in a T-matrix library. Hashes the
+   * type, mesh, material and number of harmonics, together with the
+   * frequency and the background.
+   * @param bground the properties of the background.
+   * @param omega_ the angular frequency of the fundamental.
+   * @param SH true for the second harmonic T-matrix.
+   * @return a key such that equal keys mean equal T-matrices.
+   */
+  std::string TmatrixKey(ElectroMagnetic const &bground, double omega_, bool SH) const;
+
+  /**
+   * T and RgQ matrices of a sphere from the Mie coefficients, both diagonal.
+   * RgQ is the one the surface integrals would give: solving with it turns
+   * the scattered coefficients into the internal ones.
+   * @param Tmatrix the T-matrix, FF or SH.
+   * @param RgQmatrix the RgQ matrix, FF or SH.
+   * @param omega_ the angular frequency of the fundamental.
+   * @param bground the properties of the background.
+   * @param SH true for the second harmonic matrices.
+   */
+  void getTRgQSphere(optimet::Matrix<optimet::t_complex> &Tmatrix,
+                     optimet::Matrix<optimet::t_complex> &RgQmatrix, optimet::t_real omega_,
+                     ElectroMagnetic const &bground, bool SH) const;
+
+  /**
+   * Diagonals of the T and RgQ matrices of a sphere at many frequencies, as
+   * getTRgQSphere, the Bessel and Hankel functions of all of them in one batch.
+   * @param omegas the angular frequencies of the fundamental.
+   * @param materials the properties of the sphere at each frequency.
+   * @param bground the properties of the background.
+   * @param SH true for the second harmonic matrices.
+   * @param Tdiagonals the diagonal of the T-matrix at each frequency, by column.
+   * @param RgQdiagonals the diagonal of the RgQ matrix at each frequency, by column.
+   */
+  void getTRgQSpheres(std::vector<optimet::t_real> const &omegas,
+                      std::vector<ElectroMagnetic> const &materials,
+                      ElectroMagnetic const &bground, bool SH,
+                      optimet::Matrix<optimet::t_complex> &Tdiagonals,
+                      optimet::Matrix<optimet::t_complex> &RgQdiagonals) const;
   #ifdef OPTIMET_MPI
+  // the local rows gran1 to gran2 of the matrices, with the integrals over triangles tri1 to tri2
   // FF Q matrix
-  void getQLocal(optimet::Vector<optimet::t_complex>& Qmatrix, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const;
+  void getQLocal(optimet::Vector<optimet::t_complex>& Qmatrix, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const;
 
   // FF RgQmatrix
-  void getRgQLocal(optimet::Vector<optimet::t_complex>& RgQmatrix, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const;  
+  void getRgQLocal(optimet::Vector<optimet::t_complex>& RgQmatrix, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const;  
   // SH Qmatrix for arbitrary shaped objects
-  void getQLocalSH(optimet::Vector<optimet::t_complex>& QmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const;
+  void getQLocalSH(optimet::Vector<optimet::t_complex>& QmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const;
   
   // SH RgQmatrix for arbitrary shaped objects
-  void getRgQLocalSH(optimet::Vector<optimet::t_complex>& RgQmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2) const;
+  void getRgQLocalSH(optimet::Vector<optimet::t_complex>& RgQmatrixSH, optimet::t_real omega_, ElectroMagnetic const &bground, int gran1, int gran2, int tri1, int tri2) const;
+
+  /**
+   * Local rows of the Q and RgQ matrices at several frequencies, in a single
+   * pass over the mesh: the triangles, their normals and the angular parts
+   * are visited once for all of them, and the inner VSWFs of each frequency
+   * are shared by its Q and RgQ matrices.
+   * @param omegas the angular frequencies of the fundamental.
+   * @param materials the properties of the scatterer at each frequency.
+   * @param bground the properties of the background.
+   * @param SH true for the second harmonic matrices.
+   * @param gran1, gran2 the range of rows mu.
+   * @param tri1, tri2 the range of triangles integrated over, partial sums if not all of them.
+   * @param Qmatrices the local rows of the Q matrix at each frequency.
+   * @param RgQmatrices the local rows of the RgQ matrix at each frequency.
+   */
+  void getQRgQLocal(std::vector<optimet::t_real> const &omegas,
+                    std::vector<ElectroMagnetic> const &materials, ElectroMagnetic const &bground,
+                    bool SH, int gran1, int gran2, int tri1, int tri2,
+                    std::vector<optimet::Vector<optimet::t_complex>> &Qmatrices,
+                    std::vector<optimet::Vector<optimet::t_complex>> &RgQmatrices) const;
+
+private:
+  //! The wave numbers and prefactors of one of the matrices given by surfaceIntegrals
+  struct SurfacePass {
+    optimet::t_complex k_ext;    /**< the wave number of the outer VSWFs */
+    bool regular_ext;            /**< regular outer VSWFs (RgQ), else radiative ones (Q) */
+    optimet::t_complex k_int;    /**< the wave number of the inner (regular) VSWFs */
+    optimet::t_complex factor_b; /**< the prefactor of the background terms */
+    optimet::t_complex factor_s; /**< the prefactor of the scatterer terms */
+  };
+
+  /**
+   * Surface integrals shared by the FF/SH Q and RgQ matrices, for several of
+   * them in one pass over the triangles. Consecutive passes with the same
+   * inner wave number share the table of their inner VSWFs.
+   * @param passes the wave numbers and prefactors of each matrix.
+   * @param nMax_ the maximum value of the n iterator.
+   * @param gran1, gran2 the range of rows mu.
+   * @param tri1, tri2 the range of triangles integrated over, partial sums if not all of them.
+   * @param Qmatrices the local rows [a | b | c | d] of each matrix, 4 * nuMax * (gran2 - gran1)
+   * values each, allocated by the caller.
+   */
+  void surfaceIntegrals(std::vector<SurfacePass> const &passes, int nMax_, int gran1, int gran2,
+                        int tri1, int tri2,
+                        std::vector<optimet::Vector<optimet::t_complex> *> const &Qmatrices) const;
 #endif  
 };
 
@@ -0,0 +1,190 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#include "SchwarzPreconditioner.h"
+#include "Profile.h"
+#include "Tools.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <numeric>
+
+namespace optimet {
+
+namespace {
+//! Coordinate x, y or z of a point
+t_real coordinate(Cartesian<t_real> const &R, t_uint axis) {
+  return axis == 0 ? R.x : axis == 1 ? R.y : R.z;
+}
+
+//! \brief Cuts the objects from first to last into parts subdomains of nearly equal sizes
+//! \details Each cut is across the longest side of the bounding box of the centres.
+void bisect(std::vector<Cartesian<t_real>> const &centres, std::vector<t_uint>::iterator first,
+            std::vector<t_uint>::iterator last, t_uint parts,
+            std::vector<std::vector<t_uint>> &subdomains) {
+  if(parts < 2 or last - first < 2) {
+    subdomains.emplace_back(first, last);
+    return;
+  }
+  t_uint axis = 0;
+  t_real longest = -1;
+  for(t_uint k = 0; k < 3; ++k) {
+    auto const range = std::minmax_element(first, last, [&](t_uint a, t_uint b) {
+      return coordinate(centres[a], k) < coordinate(centres[b], k);
+    });
+    auto const side = coordinate(centres[*range.second], k) - coordinate(centres[*range.first], k);
+    if(side > longest) {
+      longest = side;
+      axis = k;
+    }
+  }
+  auto const middle = first + (last - first) * (parts / 2) / parts;
+  std::nth_element(first, middle, last, [&](t_uint a, t_uint b) {
+    return coordinate(centres[a], axis) < coordinate(centres[b], axis);
+  });
+  bisect(centres, first, middle, parts / 2, subdomains);
+  bisect(centres, middle, last, parts - parts / 2, subdomains);
+}
+} // namespace
+
+SchwarzPreconditioner::SchwarzPreconditioner(Geometry const &geometry, t_uint n,
+                                             PairBlock const &block, t_uint subdomains,
+                                             t_real overlap,
+                                             mpi::Communicator const &communicator)
+    : NearFieldPreconditioner(n, geometry.objects.size()), communicator_(communicator) {
+  std::vector<Cartesian<t_real>> centres;
+  t_real largest = 0;
+  for(auto const &object : geometry.objects) {
+    centres.push_back(Tools::toCartesian(object.vR));
+    largest = std::max(largest, object.radius);
+  }
+  subdomains_ = std::max<t_uint>(
+      1, std::min<t_uint>(nobj_, subdomains > 0 ? subdomains : communicator.size()));
+  std::vector<t_uint> objects(nobj_);
+  std::iota(objects.begin(), objects.end(), 0);
+  std::vector<std::vector<t_uint>> parts;
+  bisect(centres, objects.begin(), objects.end(), subdomains_, parts);
+
+  // the objects binned into cells as large as the farthest reach of the overlap
+  t_real const reach = (2 + overlap) * largest;
+  auto const cell = [&](t_uint i) {
+    return std::array<long, 3>{{static_cast<long>(std::floor(centres[i].x / reach)),
+                                static_cast<long>(std::floor(centres[i].y / reach)),
+                                static_cast<long>(std::floor(centres[i].z / reach))}};
+  };
+  std::map<std::array<long, 3>, std::vector<t_uint>> cells;
+  if(overlap > 0)
+    for(t_uint i = 0; i < nobj_; ++i)
+      cells[cell(i)].push_back(i);
+  std::vector<int> owner(nobj_);
+  for(t_uint d = 0; d < parts.size(); ++d)
+    for(auto const i : parts[d])
+      owner[i] = d;
+
+  for(t_uint d = communicator.rank(); d < parts.size(); d += communicator.size()) {
+    clusters_.emplace_back();
+    auto &current = clusters_.back();
+    current.objects = parts[d];
+    std::sort(current.objects.begin(), current.objects.end());
+    cores_.push_back(current.objects.size());
+    // the scatterers of the other subdomains near enough to one of this one
+    std::vector<t_uint> grown;
+    for(auto const i : parts[d]) {
+      if(not(overlap > 0))
+        break;
+      auto const centre = cell(i);
+      for(long a = -1; a <= 1; ++a)
+        for(long b = -1; b <= 1; ++b)
+          for(long c = -1; c <= 1; ++c) {
+            auto const found = cells.find({{centre[0] + a, centre[1] + b, centre[2] + c}});
+            if(found == cells.end())
+              continue;
+            for(auto const j : found->second) {
+              if(owner[j] == static_cast<int>(d))
+                continue;
+              auto const ri = geometry.objects[i].radius, rj = geometry.objects[j].radius;
+              auto Rij = centres[i] - centres[j];
+              if(std::sqrt(Rij * Rij) - ri - rj <= overlap * std::min(ri, rj))
+                grown.push_back(j);
+            }
+          }
+    }
+    std::sort(grown.begin(), grown.end());
+    grown.erase(std::unique(grown.begin(), grown.end()), grown.end());
+    current.objects.insert(current.objects.end(), grown.begin(), grown.end());
+
+    auto const m = current.objects.size();
+    current.S.resize(m * n_, m * n_);
+    for(t_uint j = 0; j < m; ++j)
+      for(t_uint i = 0; i < m; ++i)
+        current.S.block(i * n_, j * n_, n_, n_) = block(current.objects[i], current.objects[j]);
+    current.lu.compute(current.S);
+  }
+  // the blocks with their factors
+  t_real bytes = 0;
+  for(auto const &current : clusters_)
+    bytes += 2.0 * current.S.size() * sizeof(t_complex);
+  Profile::count("Schwarz subdomains", clusters_.size());
+  Profile::memory("Schwarz subdomains", bytes);
+}
+
+Matrix<t_complex> SchwarzPreconditioner::solve(Matrix<t_complex> const &X) const {
+  return restricted(X, true);
+}
+
+Matrix<t_complex> SchwarzPreconditioner::operator*(Matrix<t_complex> const &X) const {
+  return restricted(X, false);
+}
+
+Matrix<t_complex> SchwarzPreconditioner::restricted(Matrix<t_complex> const &X,
+                                                    bool inverse) const {
+  Matrix<t_complex> result = Matrix<t_complex>::Zero(X.rows(), X.cols());
+  for(t_uint c = 0; c < clusters_.size(); ++c) {
+    auto const &current = clusters_[c];
+    Matrix<t_complex> input(current.S.rows(), X.cols());
+    for(t_uint i = 0; i < current.objects.size(); ++i)
+      input.middleRows(i * n_, n_) = X.middleRows(current.objects[i] * n_, n_);
+    Matrix<t_complex> const output =
+        inverse ? Matrix<t_complex>(current.lu.solve(input)) : Matrix<t_complex>(current.S * input);
+    // the overlap only helps the scatterers of the subdomain itself
+    for(t_uint i = 0; i < cores_[c]; ++i)
+      result.middleRows(current.objects[i] * n_, n_) = output.middleRows(i * n_, n_);
+  }
+#ifdef OPTIMET_MPI
+  MPI_Allreduce(MPI_IN_PLACE, result.data(), result.size(), MPI_DOUBLE_COMPLEX, MPI_SUM,
+                *communicator_);
+#endif
+  return result;
+}
+
+std::shared_ptr<NearFieldPreconditioner const>
+preconditioner(Geometry const &geometry, t_uint n, NearFieldPreconditioner::PairBlock const &block,
+               bool iterative, mpi::Communicator const &communicator) {
+  if(iterative and geometry.get_schwarzcond()) {
+    auto const result = std::make_shared<SchwarzPreconditioner>(
+        geometry, n, block, geometry.get_schwarzsubdomains(), geometry.get_schwarzoverlap(),
+        communicator);
+    if(communicator.rank() == 0)
+      std::cout << "The iterative solves are preconditioned over " << result->subdomains()
+                << " subdomains" << std::endl;
+    return result;
+  }
+  return std::make_shared<NearFieldPreconditioner>(
+      geometry, n, block, iterative ? geometry.get_nearfieldgap() : 0,
+      geometry.get_nearfieldsize());
+}
+}
@@ -0,0 +1,80 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_SCHWARZ_PRECONDITIONER_H
+#define OPTIMET_SCHWARZ_PRECONDITIONER_H
+
+#include "Geometry.h"
+#include "NearFieldPreconditioner.h"
+#include "Types.h"
+#include "mpi/Communicator.h"
+#include <memory>
+#include <vector>
+
+namespace optimet {
+
+/**
+ * The SchwarzPreconditioner class implements a restricted additive Schwarz
+ * preconditioner of the scattering matrix. The scatterers are cut into compact
+ * subdomains by recursive coordinate bisection, each subdomain grown by the
+ * scatterers within an overlap of its own. Each process factorises the diagonal
+ * blocks of its subdomains only, and the inverse of the preconditioner sums, over
+ * the processes, the solutions of the subdomains restricted to their own
+ * scatterers. The iterative solvers then run on the whole system with the
+ * couplings between subdomains left to the Krylov space.
+ */
+class SchwarzPreconditioner : public NearFieldPreconditioner {
+public:
+  /**
+   * Initialization constructor for the SchwarzPreconditioner class.
+   * @param geometry the geometry of the simulation.
+   * @param n the size of the block of one scatterer, 2 * nMax * (nMax + 2).
+   * @param block function returning the block coupling two scatterers.
+   * @param subdomains the number of subdomains, one per process if zero.
+   * @param overlap a scatterer joins a subdomain if the gap between its circumscribed sphere and
+   * that of a scatterer of the subdomain is at most overlap times the smaller radius.
+   * @param communicator the processes sharing the subdomains.
+   */
+  SchwarzPreconditioner(Geometry const &geometry, t_uint n, PairBlock const &block,
+                        t_uint subdomains, t_real overlap,
+                        mpi::Communicator const &communicator = mpi::Communicator());
+
+  Matrix<t_complex> solve(Matrix<t_complex> const &X) const override;
+  Matrix<t_complex> operator*(Matrix<t_complex> const &X) const override;
+  bool empty() const override { return false; }
+
+  //! Number of subdomains, over all the processes
+  t_uint subdomains() const { return subdomains_; }
+
+private:
+  //! Applies the factorisations or the blocks of the subdomains of this process, then sums
+  Matrix<t_complex> restricted(Matrix<t_complex> const &X, bool inverse) const;
+
+  //! The number of subdomains
+  t_uint subdomains_;
+  //! For each subdomain of this process, the number of its own scatterers, first in its cluster
+  std::vector<t_uint> cores_;
+  //! The processes sharing the subdomains
+  mpi::Communicator communicator_;
+};
+
+//! \brief The preconditioner of an iterative solve
+//! \details Schwarz over the subdomains given to the geometry, else the near-field clusters, the
+//! identity if not iterative.
+std::shared_ptr<NearFieldPreconditioner const>
+preconditioner(Geometry const &geometry, t_uint n, NearFieldPreconditioner::PairBlock const &block,
+               bool iterative, mpi::Communicator const &communicator);
+}
+#endif
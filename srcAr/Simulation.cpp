@@ -16,17 +16,41 @@
 
 #include "Simulation.h"
 #include "Aliases.h"
+#include "ClusterTmatrix.h"
 #include "CompoundIterator.h"
+#include "Engine.h"
+#include "FarField.h"
+#include "MirrorSymmetry.h"
 #include "Output.h"
+#include "PreconditionedMatrix.h"
+#include "Profile.h"
 #include "Reader.h"
 #include "Result.h"
 #include "Run.h"
 #include "Solver.h"
+#include "SolverStatistics.h"
+#include "Threads.h"
+#include "Tools.h"
+#include "Writer.h"
+#include "mpi/Collectives.h"
+#include "mpi/Counter.h"
+#include "scalapack/Tuning.h"
+#include <algorithm>
 #include <string>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <tuple>
 
 using namespace std::chrono;
 
@@ -34,11 +58,65 @@ namespace optimet {
 int Simulation::run() {
   
   // Read the case file
-  auto run = simulation_input(caseFile + ".xml");
+  auto run = simulation_input(caseFile + ".xml", communicator());
+  peak_gflops_ = run.peakGflops;
+  peak_bandwidth_ = run.peakBandwidth;
+  bind_threads(run.parallel_params.threads, run.parallel_params.bind, run.parallel_params.places);
+  plan_solver(run);
+  if(dry_run()) {
+    memory_estimate(run);
+    return 0;
+  }
   
 #ifdef OPTIMET_MPI
   run.parallel_params.grid = scalapack::squarest_largest_grid(communicator().size());
   run.communicator = communicator();
+#ifdef OPTIMET_SCALAPACK
+  // the groups of a scan or an ensemble build their own grids
+  bool const groups = run.outputType == 11 and (run.scanGroups > 1 or run.ensembleGroups > 1);
+  if(run.parallel_params.tune and not groups) {
+    auto const pMax = std::max(run.nMax * (run.nMax + 2),
+                               run.excitation->SH_cond ? run.nMaxS * (run.nMaxS + 2) : 0);
+    auto const N = 2 * pMax * run.geometry->objects.size();
+    auto const tuning = scalapack::tune(N, communicator(), run.parallel_params.tuning_profile,
+                                        run.parallel_params.mapping);
+    run.parallel_params.block_size = tuning.block_size;
+    run.parallel_params.grid = tuning.grid;
+    run.context = scalapack::Context(tuning.grid);
+    if(communicator().is_root())
+      std::cout << "Block size " << tuning.block_size << " on a " << tuning.grid.rows << "x"
+                << tuning.grid.cols << " grid, " << tuning.seconds
+                << " s for the calibration factorization" << std::endl;
+  }
+  if(run.parallel_params.mapping != "ranks" and not groups)
+    run.context = scalapack::Context::NodeLocal(run.parallel_params.grid, communicator(),
+                                                run.parallel_params.mapping == "rows");
+#endif
+  // the orientation averages need the T-matrix of the cluster rather than a solver
+  if(run.outputType == 11 and run.analyticAverage) {
+    average_wavelengths(run);
+    return 0;
+  }
+  // the configurations of an ensemble, solved by groups of processes
+  if(run.outputType == 11 and not run.ensemble.empty()) {
+    ensemble(run);
+    return 0;
+  }
+  // the lower orders of the scan from the T-matrices of the highest one
+  if(run.outputType == 11 and run.convergenceFrom > 0) {
+    convergence(run);
+    return 0;
+  }
+  // the fields of the coefficients of an earlier run need no solver
+  if(run.outputType == 0 and not run.coefficientsFile.empty()) {
+    field_simulation(run, nullptr);
+    return 0;
+  }
+  // each group of processes builds its own solver
+  if(run.outputType == 11 and run.scanGroups > 1 and communicator().size() > 1) {
+    scan_groups(run);
+    return 0;
+  }
 #endif
 
   // Initialize the solver
@@ -46,6 +124,7 @@ int Simulation::run() {
   
   switch(run.outputType) {
   case 0:
+  case 2:
     #ifdef OPTIMET_MPI
     field_simulation(run, solver);
     #endif
@@ -63,6 +142,118 @@ int Simulation::run() {
 }
 
 #ifdef OPTIMET_MPI
+namespace {
+//! Leaves of an octree over the cells of a grid, level by level from the coarsest
+struct Octree {
+  //! x, y and z of the centre of each leaf, in m
+  std::vector<t_real> centres;
+  //! Edges along x, y and z of each leaf, in m
+  std::vector<t_real> edges;
+  //! Level of each leaf, zero for the cells of the grid
+  std::vector<t_real> levels;
+  //! First leaf of each level, then the number of leaves
+  std::vector<t_real> offsets;
+};
+
+//! \brief Splits the cells of a grid in eight where they reach the surface of an object
+//! \details Each step of params makes one cell along its axis. A cell is split while its level
+//! is below levels if it reaches a surface, or its corners fall in different objects for the
+//! meshes inside their bounding spheres, and below levels + gaps if it lies in a gap.
+Octree octree(Geometry &geometry, std::array<t_real, 9> const &params, int levels, int gaps) {
+  Octree result;
+  t_real edge[3], low[3];
+  int steps[3];
+  for(int a = 0; a < 3; ++a) {
+    steps[a] = std::max(1, static_cast<int>(params[3 * a + 2]));
+    low[a] = params[3 * a];
+    edge[a] = (params[3 * a + 1] - params[3 * a]) / steps[a];
+  }
+  // lower corners of the cells of a level, x varying the fastest
+  std::vector<t_real> cells, finer;
+  for(int k = 0; k < steps[2]; ++k)
+    for(int j = 0; j < steps[1]; ++j)
+      for(int i = 0; i < steps[0]; ++i)
+        cells.insert(cells.end(), {low[0] + i * edge[0], low[1] + j * edge[1], low[2] + k * edge[2]});
+
+  for(int level = 0; not cells.empty(); ++level) {
+    result.offsets.push_back(result.levels.size());
+    t_real const reach =
+        0.5 * std::sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+    finer.clear();
+    for(std::size_t c = 0; c < cells.size(); c += 3) {
+      Cartesian<t_real> const centre(cells[c] + 0.5 * edge[0], cells[c + 1] + 0.5 * edge[1],
+                                     cells[c + 2] + 0.5 * edge[2]);
+      bool split = level < levels and geometry.nearSurfaces(centre, reach) > 0;
+      for(int corner = 1; corner < 8 and level < levels and not split; ++corner) {
+        auto const at = [&](int n) {
+          return geometry.checkInner(Tools::toSpherical(Cartesian<t_real>(
+              cells[c] + (n & 1) * edge[0], cells[c + 1] + (n >> 1 & 1) * edge[1],
+              cells[c + 2] + (n >> 2 & 1) * edge[2])));
+        };
+        split = at(corner) != at(0);
+      }
+      // within reach of two surfaces for the cell gaps levels up, so that the gaps narrower than
+      // it are split down to the finest cells
+      if(not split and level < levels + gaps)
+        split = geometry.nearSurfaces(centre, std::ldexp(reach, gaps)) > 1;
+      if(split) {
+        for(int n = 0; n < 8; ++n)
+          finer.insert(finer.end(), {cells[c] + (n & 1) * 0.5 * edge[0],
+                                     cells[c + 1] + (n >> 1 & 1) * 0.5 * edge[1],
+                                     cells[c + 2] + (n >> 2 & 1) * 0.5 * edge[2]});
+        continue;
+      }
+      result.centres.insert(result.centres.end(), {centre.x, centre.y, centre.z});
+      result.edges.insert(result.edges.end(), {edge[0], edge[1], edge[2]});
+      result.levels.push_back(level);
+    }
+    for(auto &e : edge)
+      e *= 0.5;
+    cells.swap(finer);
+  }
+  result.offsets.push_back(result.levels.size());
+  return result;
+}
+
+//! \brief E and H of the FF, then E and H of the SH, at consecutive points of a grid
+//! \details Followed by E and H of each part of the FF fields, Run::fieldParts.
+typedef std::vector<std::vector<SphericalP<std::complex<double>>>> FieldValues;
+
+//! \brief Writes the fields of the points from first on to the FF and SH files, then closes them
+//! \details The grid as in Simulation::field_map. The parts go to the groups Field_E_<name> and
+//! Field_H_<name> of the FF file.
+void write_field_grids(Output &oFile_FF, Output &oFile_SH, int type,
+                       std::array<t_real, 9> const &params, GridStorage const &storage,
+                       std::shared_ptr<std::vector<t_real> const> const &coordinates, int first,
+                       std::vector<FieldPart> const &parts, FieldValues const &values) {
+  OutputGrid oEGrid_FF2(type, params, oFile_FF.getHandle("Field_E"), storage, coordinates);
+  OutputGrid oHGrid_FF2(type, params, oFile_FF.getHandle("Field_H"), storage, coordinates);
+
+  OutputGrid oEGrid_SH2(type, params, oFile_SH.getHandle("Field_E"), storage, coordinates);
+  OutputGrid oHGrid_SH2(type, params, oFile_SH.getHandle("Field_H"), storage, coordinates);
+
+  oEGrid_FF2.writeRange(first, values[0]);
+  oHGrid_FF2.writeRange(first, values[1]);
+  oEGrid_SH2.writeRange(first, values[2]);
+  oHGrid_SH2.writeRange(first, values[3]);
+
+  for(std::size_t k = 0; k < parts.size(); ++k)
+    for(int field = 0; field < 2; ++field) {
+      std::string const group = (field == 0 ? "Field_E_" : "Field_H_") + parts[k].name();
+      OutputGrid part(type, params, oFile_FF.getHandle(group), storage, coordinates);
+      part.writeRange(first, values[4 + 2 * k + field]);
+      part.close();
+    }
+
+  oEGrid_FF2.close();
+  oHGrid_FF2.close();
+  oFile_FF.close();
+  oEGrid_SH2.close();
+  oHGrid_SH2.close();
+  oFile_SH.close();
+}
+} // namespace
+
 void Simulation::field_simulation(Run &run, std::shared_ptr<solver::AbstractSolver> solver) {
   // Determine the simulation type and proceed accordingly
   
@@ -72,7 +263,7 @@ void Simulation::field_simulation(Run &run, std::shared_ptr<solver::AbstractSolv
   int nMaxS = run.geometry->nMaxS();
   int flatMax = nMax * (nMax + 2);
   int flatMaxS = nMaxS * (nMaxS + 2);
-  int sizeCF = flatMaxS * flatMax * flatMax;
+  int sizeCF = run.geometry->couplings(nMax, nMaxS).size();
   
   int gran1CG, gran2CG;
   int rank_pc = communicator().rank();
@@ -90,254 +281,1017 @@ void Simulation::field_simulation(Run &run, std::shared_ptr<solver::AbstractSolv
 
 
 
-  std::vector<double> C_10m1_par(sizeCF_par), C_11m1_par(sizeCF_par), C_00m1_par(sizeCF_par), C_01m1_par(sizeCF_par);
-  std::vector<double> W_m1m1_par(sizeCF_par), W_11_par(sizeCF_par), W_00_par(sizeCF_par), W_10_par(sizeCF_par), W_01_par(sizeCF_par);
+  // the slice of this process, none when the W numbers are computed where they are used
+  int const sizeCF_slice = run.onthefly_tables ? 0 : sizeCF_par;
+  std::vector<double> C_10m1_par(sizeCF_slice), C_11m1_par(sizeCF_slice), C_00m1_par(sizeCF_slice), C_01m1_par(sizeCF_slice);
+  std::vector<double> W_m1m1_par(sizeCF_slice), W_11_par(sizeCF_slice), W_00_par(sizeCF_slice), W_10_par(sizeCF_slice), W_01_par(sizeCF_slice);
 
-  std::vector<double> C_10m1(sizeCF), C_11m1(sizeCF), C_00m1(sizeCF), C_01m1(sizeCF);
-  std::vector<double> W_m1m1(sizeCF), W_11(sizeCF), W_00(sizeCF), W_10(sizeCF), W_01(sizeCF);
+  // the complete tables, on each process or once per node in shared memory
+  int const sizeCF_full = run.shared_tables or run.onthefly_tables ? 0 : sizeCF;
+  std::vector<double> C_10m1(sizeCF_full), C_11m1(sizeCF_full), C_00m1(sizeCF_full), C_01m1(sizeCF_full);
+  std::vector<double> W_m1m1(sizeCF_full), W_11(sizeCF_full), W_00(sizeCF_full), W_10(sizeCF_full), W_01(sizeCF_full);
 
-  std::vector<double *> CLGcoeff_par = {&C_10m1_par[0], &C_11m1_par[0], &C_00m1_par[0], &C_01m1_par[0],
-                                       &W_m1m1_par[0], &W_11_par[0], &W_00_par[0], &W_10_par[0], &W_01_par[0]};
+  std::vector<double *> CLGcoeff_par = {C_10m1_par.data(), C_11m1_par.data(), C_00m1_par.data(), C_01m1_par.data(),
+                                       W_m1m1_par.data(), W_11_par.data(), W_00_par.data(), W_10_par.data(), W_01_par.data()};
 
-  std::vector<double *> CLGcoeff = {&C_10m1[0], &C_11m1[0], &C_00m1[0], &C_01m1[0],
-                                       &W_m1m1[0], &W_11[0], &W_00[0], &W_10[0], &W_01[0]};
+  std::vector<double *> CLGcoeff = {C_10m1.data(), C_11m1.data(), C_00m1.data(), C_01m1.data(),
+                                       W_m1m1.data(), W_11.data(), W_00.data(), W_10.data(), W_01.data()};
 
-  run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
+  if(run.onthefly_tables)
+    CLGcoeff.assign(9, nullptr);
+  else if(run.shared_tables)
+    CLGcoeff = shared_tables(sizeCF);
 
-  All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
+  if(not run.onthefly_tables) {
+    Profile::Region const timer("CLG coefficients");
+    if(not load_tables(run, CLGcoeff, sizeCF)) {
+      run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
 
-  solver->solve(result.scatter_coef, result.internal_coef, result.scatter_coef_SH, result.internal_coef_SH, CLGcoeff);
-
-  std::vector<double> Rr, Rthe, Rphi;
+      if(run.shared_tables)
+        All2all_shared(CLGcoeff, CLGcoeff_par, gran1CG, sizeCF_par);
+      else
+        All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
+      save_tables(run, CLGcoeff, sizeCF);
+    }
+  }
+  Profile::memory("CLG tables", 9.0 * sizeof(double) * (sizeCF_full + sizeCF_slice));
+
+  if(solver) {
+    Profile::Region const timer("solve");
+    solver->solve(result.scatter_coef, result.internal_coef, result.scatter_coef_SH,
+                  result.internal_coef_SH, CLGcoeff);
+  } else
+    load_coefficients(run, result);
+  // the coefficients alone, for later field runs
+  if(run.outputType == 2) {
+    save_coefficients(run, result);
+    return;
+  }
+  if(run.octreeLevels == 0) {
+    field_map(run, result, CLGcoeff, run.gridType, run.params, run.gridPoints, caseFile);
+    return;
+  }
 
-  int size, sizeField;
+  // the leaves of the octree as a list of points, then their cells next to the fields
+  auto const tree = octree(*run.geometry, run.params, run.octreeLevels, run.octreeGaps);
+  auto const leaves = tree.levels.size();
+  Profile::count("octree leaves", leaves);
+  field_map(run, result, CLGcoeff, O3DPointList,
+            {{0, 0, static_cast<t_real>(leaves), 0, 0, 1, 0, 0, 1}},
+            std::make_shared<std::vector<t_real> const>(tree.centres), caseFile);
+  if(communicator().rank() != communicator().root_id() or not run.fieldWrite)
+    return;
+  for(std::string const harmonic : {"_FF", "_SH"}) {
+    if(harmonic == "_SH" and not run.excitation->SH_cond)
+      continue;
+    Output file;
+    if(file.open(caseFile + harmonic + ".h5") < 0)
+      throw std::runtime_error("Could not open " + caseFile + harmonic + ".h5");
+    file.writeReal("Octree/centres", tree.centres.data(), tree.centres.size());
+    file.writeReal("Octree/edges", tree.edges.data(), tree.edges.size());
+    file.writeReal("Octree/levels", tree.levels.data(), tree.levels.size());
+    file.writeReal("Octree/offsets", tree.offsets.data(), tree.offsets.size());
+    file.close();
+  }
+}
 
-  if(communicator().rank() == communicator().root_id()) {
+void Simulation::field_map(Run const &run, Result &result, std::vector<double *> const &CLGcoeff,
+                           int type, std::array<t_real, 9> const &params,
+                           std::shared_ptr<std::vector<t_real> const> const &coordinates,
+                           std::string const &name, Writer *writer) {
+  if(run.clusterExpansion)
+    result.clusterExpansion(run.clusterOrder);
+  // the harmonics of the dominant parts are those of the largest coefficients
+  result.fieldParts(run.fieldParts);
+  auto const parts = result.fieldParts();
+  // E and H at the fundamental and SH frequencies, then E and H of each part
+  int const values = 12 + 6 * parts.size();
+
+  // Each process computes the coordinates of its own points
+  OutputGrid const grid(type, params, coordinates);
+  int const gridPoints = grid.gridPoints;
+  // the radial functions of the points are interpolated over the box of the grid
+  if(run.fieldRadial > 0) {
+    Profile::Region const timer("radial tables");
+    Cartesian<double> low, high;
+    grid.bounds(low, high);
+    result.radialTables(low, high, run.fieldRadial);
+  }
+  result.pruneFields(run.fieldPrune);
+  result.singleFields(run.fieldSingle);
+
+  // With mirror planes shared by the geometry, the excitation and the grid, only the points on
+  // the upper side of each plane are computed, the others being their images. The parts of the
+  // fields and the spherical projection are not symmetric.
+  MirrorSymmetry mirror;
+  if(not run.fieldMirror.empty() and parts.empty() and not run.projection) {
+    mirror = MirrorSymmetry(*run.geometry, *run.excitation, run.fieldMirror);
+    mirror.restrict(grid);
+  }
+  int const n[3] = {static_cast<int>(params[2]), static_cast<int>(params[5]),
+                    static_cast<int>(params[8])};
+  auto const cursor = [&](int g) {
+    return std::array<int, 3>{{g % n[0], (g / n[0]) % n[1], g / (n[0] * n[1])}};
+  };
+  std::vector<int> irreducible;
+  if(not mirror.empty())
+    for(int g = 0; g < gridPoints; ++g) {
+      auto const i = cursor(g);
+      bool upper = true;
+      for(int c = 0; c < 3; ++c)
+        upper = upper and (not mirror.plane(c) or 2 * i[c] >= n[c] - 1);
+      if(upper)
+        irreducible.push_back(g);
+    }
+  int const computed = mirror.empty() ? gridPoints : static_cast<int>(irreducible.size());
+
+  // Every process, the root included, takes blocks of points until none is left. The points
+  // inside the particles cost more than the others, so the blocks are handed out on demand.
+  int const block = std::max(1, run.fieldBlock);
+  mpi::Counter const next(0, communicator());
+  // Within a block, the threads of the process share slabs of points. The locator of the
+  // particles is built before the threads use it.
+  int const slab = 16;
+  run.geometry->checkInner(std::vector<Spherical<double>>());
+  std::vector<std::pair<int, int>> pieces;
+  std::vector<t_complex> fields;
+  std::vector<std::vector<t_complex>> slabs;
+  for(int start = next.fetch_add(block); start < computed; start = next.fetch_add(block)) {
+    int const end = std::min(start + block, computed);
+    Profile::Region const timer("fields");
+    Profile::count("field points", end - start);
+    int const nslabs = (end - start + slab - 1) / slab;
+    slabs.resize(nslabs);
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for schedule(dynamic) if(nslabs > 1)
+#endif
+    for(int s = 0; s < nslabs; ++s) {
+      std::vector<double> Rr, Rthe, Rphi;
+      std::vector<SphericalP<std::complex<double>>> EField_FF, HField_FF, EField_SH, HField_SH;
+      FieldValues partFields;
+      int const first = start + s * slab, last = std::min(first + slab, end);
+      if(mirror.empty())
+        grid.getPoints(first, last, Rr, Rthe, Rphi);
+      else
+        for(int k = first; k < last; ++k) {
+          auto const R = grid.getPoint(irreducible[k]);
+          Rr.push_back(R.rrr);
+          Rthe.push_back(R.the);
+          Rphi.push_back(R.phi);
+        }
+      result.getFields(Rr, Rthe, Rphi, run.projection, CLGcoeff, EField_FF, HField_FF, EField_SH,
+                       HField_SH, &partFields);
+      slabs[s].clear();
+      for(int ii = 0; ii < last - first; ii++) {
+        for(auto const &field : {EField_FF[ii], HField_FF[ii], EField_SH[ii], HField_SH[ii]})
+          slabs[s].insert(slabs[s].end(), {field.rrr, field.the, field.phi});
+        for(auto const &part : partFields)
+          slabs[s].insert(slabs[s].end(), {part[ii].rrr, part[ii].the, part[ii].phi});
+      }
+    }
+    pieces.emplace_back(start, end);
+    for(auto const &values : slabs)
+      fields.insert(fields.end(), values.begin(), values.end());
+  }
 
-     OutputGrid oEGrid_FF(O3DCartesianRegular, run.params);
-    OutputGrid oHGrid_FF(O3DCartesianRegular, run.params);
+  // The computed points and their images, in increasing order of the grid, as runs of
+  // consecutive points
+  if(not mirror.empty()) {
+    Profile::Region const timer("field images");
+    std::vector<std::pair<int, std::size_t>> images;
+    std::vector<t_complex> reflected;
+    std::size_t value = 0;
+    for(auto const &piece : pieces)
+      for(int k = piece.first; k < piece.second; ++k, value += values) {
+        auto const i = cursor(irreducible[k]);
+        for(t_uint mask = 0; mask < 8; ++mask) {
+          // each plane the point is not on gives one more image
+          auto j = i;
+          bool image = true;
+          for(int c = 0; c < 3; ++c)
+            if(mask & (1u << c)) {
+              image = image and mirror.plane(c) and 2 * i[c] != n[c] - 1;
+              j[c] = n[c] - 1 - i[c];
+            }
+          if(not image)
+            continue;
+          images.emplace_back(j[0] + n[0] * (j[1] + n[1] * j[2]), reflected.size());
+          reflected.insert(reflected.end(), fields.begin() + value,
+                           fields.begin() + value + values);
+          mirror.reflect(mask, &reflected[images.back().second]);
+        }
+      }
+    std::sort(images.begin(), images.end());
+    pieces.clear();
+    fields.clear();
+    for(auto const &image : images) {
+      if(pieces.empty() or pieces.back().second != image.first)
+        pieces.emplace_back(image.first, image.first);
+      pieces.back().second += 1;
+      fields.insert(fields.end(), reflected.begin() + image.second,
+                    reflected.begin() + image.second + values);
+    }
+  }
+  if(run.fieldStatistics)
+    field_statistics(run, grid, pieces, fields, values, name);
+  if(not run.fieldWrite)
+    return;
+
+  // Each process writes a range of consecutive points with parallel HDF5, otherwise the root
+  // writes them all
+  std::vector<int> owners(communicator().size() + 1, gridPoints);
+#ifdef H5_HAVE_PARALLEL
+  int const size = communicator().size();
+  for(int rank = 0; rank < size; rank++)
+    owners[rank] = rank * (gridPoints / size) + std::min(rank, gridPoints % size);
+#else
+  owners[0] = 0;
+#endif
+  auto const owned = [&]() {
+    Profile::Region const timer("field gather");
+    return field_ranges(pieces, fields, owners, values);
+  }();
+  Profile::memory("field values", (fields.size() + owned.size()) * sizeof(t_complex));
+
+  int const first = owners[communicator().rank()];
+  int const points = owners[communicator().rank() + 1] - first;
+  // E and H of the FF, then of the SH and of the parts, shared with the job writing them
+  auto const fieldValues = std::make_shared<FieldValues>(
+      values / 3, std::vector<SphericalP<std::complex<double>>>(points));
+  for(int ii = 0; ii < points; ii++) {
+    auto const field = owned.begin() + values * ii;
+    for(int k = 0; k < values / 3; ++k)
+      (*fieldValues)[k][ii] =
+          SphericalP<std::complex<double>>(field[3 * k], field[3 * k + 1], field[3 * k + 2]);
+  }
 
-    OutputGrid oEGrid_SH(O3DCartesianRegular, run.params);
-    OutputGrid oHGrid_SH(O3DCartesianRegular, run.params);
-   
-  Spherical<double> Rloc;
-  
-  int gran = oEGrid_FF.gridPoints / (communicator().size()-1);
+  auto const storage = run.fieldStorage;
+#ifdef H5_HAVE_PARALLEL
+  // collective, hence in place
+  Profile::Region const timer("HDF5 write");
+  std::lock_guard<std::mutex> const lock(Output::mutex());
+  Output oFile_FF, oFile_SH;
+  oFile_FF.init(name + "_FF.h5", *communicator());
+  oFile_SH.init(name + "_SH.h5", *communicator());
+  write_field_grids(oFile_FF, oFile_SH, type, params, storage, coordinates, first, parts,
+                      *fieldValues);
+  if(communicator().rank() == communicator().root_id() && !run.excitation->SH_cond)
+    remove((name + "_SH.h5").c_str());
+#else
+  if(communicator().rank() != communicator().root_id())
+    return;
+  bool const SH = run.excitation->SH_cond;
+  auto const job = [=]() {
+    std::lock_guard<std::mutex> const lock(Output::mutex());
+    Output oFile_FF, oFile_SH;
+    oFile_FF.init(name + "_FF.h5");
+    oFile_SH.init(name + "_SH.h5");
+    write_field_grids(oFile_FF, oFile_SH, type, params, storage, coordinates, first, parts,
+                      *fieldValues);
+    if(!SH)
+      remove((name + "_SH.h5").c_str());
+  };
+  Profile::Region const timer("HDF5 write");
+  if(writer)
+    writer->push(job);
+  else
+    job();
+#endif
+}
 
-  int brojac(1), numproc(1);  
-   
-  while(brojac<=oEGrid_FF.gridPoints) {
-    Rloc = oEGrid_FF.getPoint();
-    oHGrid_FF.getPoint();
-    oEGrid_SH.getPoint();
-    oHGrid_SH.getPoint();
-   
-    Rr.push_back(Rloc.rrr);
-    Rthe.push_back(Rloc.the);
-    Rphi.push_back(Rloc.phi);
-    
-    if ((brojac == numproc * gran)&&(numproc < (communicator().size()-1))){
-       size = Rr.size();    
-       MPI_Send(&Rr[0], Rr.size(), MPI_DOUBLE, numproc, 1, MPI_COMM_WORLD);
-       MPI_Send(&Rthe[0], Rthe.size(), MPI_DOUBLE, numproc, 2, MPI_COMM_WORLD);
-       MPI_Send(&Rphi[0], Rphi.size(), MPI_DOUBLE, numproc, 3, MPI_COMM_WORLD);           
-       MPI_Send(&size, 1, MPI_INT, numproc, 4, MPI_COMM_WORLD);
-     numproc++;
-
-     Rr.clear();
-     Rthe.clear();
-     Rphi.clear();
-
-     }
-
-    else if(brojac == oEGrid_FF.gridPoints){
-       size = Rr.size();
-       MPI_Send(&Rr[0], Rr.size(), MPI_DOUBLE, numproc, 1, MPI_COMM_WORLD);
-       MPI_Send(&Rthe[0], Rthe.size(), MPI_DOUBLE, numproc, 2, MPI_COMM_WORLD);
-       MPI_Send(&Rphi[0], Rphi.size(), MPI_DOUBLE, numproc, 3, MPI_COMM_WORLD);
-       MPI_Send(&size, 1, MPI_INT, numproc, 4, MPI_COMM_WORLD);
-    }
-
- brojac++;
-
-    oEGrid_FF.gotoNext();
-    oHGrid_FF.gotoNext();
-    oEGrid_SH.gotoNext();
-    oHGrid_SH.gotoNext();
-} //while     
- 
-   } // root_id 0 proccess
-
-if(communicator().rank() != communicator().root_id()) {
-     MPI_Recv(&size, 1, MPI_INT, 0, 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-     Rr.resize(size);
-     Rthe.resize(size);
-     Rphi.resize(size);
-   MPI_Recv(&Rr[0], Rr.size(), MPI_DOUBLE, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&Rthe[0], Rthe.size(), MPI_DOUBLE, 0, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&Rphi[0], Rphi.size(), MPI_DOUBLE, 0, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  
-result.setFields(Rr, Rthe, Rphi, run.projection, CLGcoeff);
+void Simulation::field_statistics(Run const &run, OutputGrid const &grid,
+                                  std::vector<std::pair<int, int>> const &pieces,
+                                  std::vector<t_complex> const &fields, int values,
+                                  std::string const &name) const {
+  auto const &E0 = run.excitation->Einc;
+  t_real const incident = std::norm(E0.rrr) + std::norm(E0.the) + std::norm(E0.phi);
+  auto const intensity = [&](std::size_t i) {
+    return (std::norm(fields[i]) + std::norm(fields[i + 1]) + std::norm(fields[i + 2])) / incident;
+  };
+  // points, points outside the objects, then the sums of the FF and SH intensities outside
+  std::vector<t_real> sums(4, 0), histogram(run.fieldBins, 0);
+  // largest FF and SH intensities and their points, for MPI_MAXLOC
+  struct {
+    double value;
+    int index;
+  } maxima[2] = {{-1, -1}, {-1, -1}};
+  std::vector<std::pair<t_real, int>> hot;
+  auto const keep = [&]() {
+    if(hot.size() <= run.fieldHotspots)
+      return;
+    std::nth_element(hot.begin(), hot.begin() + run.fieldHotspots, hot.end(),
+                     std::greater<std::pair<t_real, int>>());
+    hot.resize(run.fieldHotspots);
+  };
+  t_real const decades = std::log(run.fieldHigh / run.fieldLow);
+
+  std::size_t value = 0;
+  std::vector<Spherical<double>> R;
+  for(auto const &piece : pieces) {
+    int const start = piece.first, end = piece.second;
+    R.clear();
+    for(int i = start; i < end; ++i)
+      R.push_back(grid.getPoint(i));
+    auto const inside = run.geometry->checkInner(R);
+    for(int i = start; i < end; ++i, value += values) {
+      sums[0] += 1;
+      if(inside[i - start] >= 0)
+        continue;
+      t_real const FF = intensity(value), SH = intensity(value + 6);
+      sums[1] += 1;
+      sums[2] += FF;
+      sums[3] += SH;
+      for(auto const &candidate : {std::make_pair(FF, 0), std::make_pair(SH, 1)})
+        if(candidate.first > maxima[candidate.second].value)
+          maxima[candidate.second] = {candidate.first, i};
+      if(run.fieldBins > 0) {
+        t_real const u = FF > run.fieldLow ? run.fieldBins * std::log(FF / run.fieldLow) / decades : 0;
+        histogram[std::min<t_real>(u, run.fieldBins - 1)] += 1;
+      }
+      if(run.fieldHotspots > 0) {
+        hot.emplace_back(FF, i);
+        if(hot.size() >= 2 * run.fieldHotspots)
+          keep();
+      }
+    }
+  }
+  keep();
+
+  bool const root = communicator().rank() == communicator().root_id();
+  auto const reduce = [&](std::vector<t_real> &values) {
+    if(values.empty())
+      return;
+    if(root)
+      MPI_Reduce(MPI_IN_PLACE, values.data(), values.size(), MPI_DOUBLE, MPI_SUM, 0,
+                 *communicator());
+    else
+      MPI_Reduce(values.data(), nullptr, values.size(), MPI_DOUBLE, MPI_SUM, 0, *communicator());
+  };
+  reduce(sums);
+  reduce(histogram);
+  if(root)
+    MPI_Reduce(MPI_IN_PLACE, maxima, 2, MPI_DOUBLE_INT, MPI_MAXLOC, 0, *communicator());
+  else
+    MPI_Reduce(maxima, nullptr, 2, MPI_DOUBLE_INT, MPI_MAXLOC, 0, *communicator());
+  // the hot spots of every process, the highest of them kept at the root
+  Vector<t_real> local(2 * hot.size());
+  for(std::size_t i = 0; i < hot.size(); ++i)
+    local.segment(2 * i, 2) << hot[i].first, hot[i].second;
+  auto const all = communicator().all_gather(local);
+  if(not root)
+    return;
+  hot.clear();
+  for(Vector<t_real>::Index i = 0; i < all.size(); i += 2)
+    hot.emplace_back(all(i), static_cast<int>(all(i + 1)));
+  keep();
+  std::sort(hot.begin(), hot.end(), std::greater<std::pair<t_real, int>>());
+
+  // the points in nm
+  auto const at = [&](int i) {
+    auto const xyz = Tools::toCartesian(grid.getPoint(i));
+    std::ostringstream point;
+    point << xyz.x * 1e9 << "\t" << xyz.y * 1e9 << "\t" << xyz.z * 1e9;
+    return point.str();
+  };
+  std::ofstream out(name + "_Statistics.dat");
+  out << std::setprecision(10);
+  out << "# intensities relative to the incident field, over the points outside the objects\n";
+  out << "points\t" << sums[0] << "\noutside\t" << sums[1] << "\n";
+  if(sums[1] == 0)
+    return;
+  out << "maximum\t" << maxima[0].value << "\t" << at(maxima[0].index) << "\n";
+  out << "mean\t" << sums[2] / sums[1] << "\n";
+  if(run.excitation->SH_cond) {
+    out << "SH maximum\t" << maxima[1].value << "\t" << at(maxima[1].index) << "\n";
+    out << "SH mean\t" << sums[3] / sums[1] << "\n";
+    out << "conversion\t" << sums[3] / sums[2] << "\n";
+  }
+  if(not hot.empty())
+    out << "# hot spots: FF intensity, x, y and z in nm\n";
+  for(auto const &spot : hot)
+    out << spot.first << "\t" << at(spot.second) << "\n";
+  if(run.fieldBins > 0)
+    out << "# histogram of the FF intensity: lower edge of the bin, points\n";
+  for(t_uint k = 0; k < run.fieldBins; ++k)
+    out << run.fieldLow * std::exp(k * decades / run.fieldBins) << "\t" << histogram[k] << "\n";
 }
 
-if(communicator().rank() == communicator().root_id()) {
+std::vector<t_complex> Simulation::field_ranges(std::vector<std::pair<int, int>> const &computed,
+                                                std::vector<t_complex> const &fields,
+                                                std::vector<int> const &owners,
+                                                int values) const {
+  int const size = communicator().size();
+
+  // Cut the pieces at the ranges of the owners, as (start, length) pieces to send to each one
+  std::vector<std::vector<int>> pieces(size);
+  std::vector<int> sendCounts(size, 0);
+  for(auto const &piece : computed) {
+    int const start = piece.first, end = piece.second;
+    for(int rank = 0; rank < size; rank++) {
+      int const first = std::max(start, owners[rank]);
+      int const last = std::min(end, owners[rank + 1]);
+      if(first < last) {
+        pieces[rank].insert(pieces[rank].end(), {first, last - first});
+        sendCounts[rank] += values * (last - first);
+      }
+    }
+  }
+
+  // Exchange the pieces, then their values
+  std::vector<int> headerCounts(size), headerSizes(size), headerSend, headerDispls(size),
+      headerRecvDispls(size);
+  for(int rank = 0; rank < size; rank++) {
+    headerCounts[rank] = pieces[rank].size();
+    headerDispls[rank] = headerSend.size();
+    headerSend.insert(headerSend.end(), pieces[rank].begin(), pieces[rank].end());
+  }
+  MPI_Alltoall(headerCounts.data(), 1, MPI_INT, headerSizes.data(), 1, MPI_INT, *communicator());
+  for(int rank = 0; rank < size; rank++)
+    headerRecvDispls[rank] = rank > 0 ? headerRecvDispls[rank - 1] + headerSizes[rank - 1] : 0;
+  std::vector<int> headerRecv(headerRecvDispls.back() + headerSizes.back());
+  MPI_Alltoallv(headerSend.data(), headerCounts.data(), headerDispls.data(), MPI_INT,
+                headerRecv.data(), headerSizes.data(), headerRecvDispls.data(), MPI_INT,
+                *communicator());
+
+  // The pieces are in increasing order, so those sent to each owner are contiguous
+  std::vector<int> sendDispls(size), recvCounts(size, 0), recvDispls(size);
+  for(int rank = 0; rank < size; rank++) {
+    sendDispls[rank] = rank > 0 ? sendDispls[rank - 1] + sendCounts[rank - 1] : 0;
+    for(int i = 0; i < headerSizes[rank]; i += 2)
+      recvCounts[rank] += values * headerRecv[headerRecvDispls[rank] + i + 1];
+    recvDispls[rank] = rank > 0 ? recvDispls[rank - 1] + recvCounts[rank - 1] : 0;
+  }
+  std::vector<t_complex> received(recvDispls.back() + recvCounts.back());
+  MPI_Alltoallv(fields.data(), sendCounts.data(), sendDispls.data(), MPI_DOUBLE_COMPLEX,
+                received.data(), recvCounts.data(), recvDispls.data(), MPI_DOUBLE_COMPLEX,
+                *communicator());
+
+  // Place the pieces in the range of this process
+  int const first = owners[communicator().rank()];
+  std::vector<t_complex> result(values * (owners[communicator().rank() + 1] - first));
+  auto value = received.begin();
+  for(std::size_t i = 0; i < headerRecv.size(); i += 2) {
+    std::copy(value, value + values * headerRecv[i + 1],
+              result.begin() + values * (headerRecv[i] - first));
+    value += values * headerRecv[i + 1];
+  }
+  return result;
+}
 
-    Output oFile_FF(caseFile + "_FF.h5");
-    Output oFile_SH(caseFile + "_SH.h5");
+void Simulation::All2all (std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par, int sizeVec){
 
-    OutputGrid oEGrid_FF2(O3DCartesianRegular, run.params, oFile_FF.getHandle("Field_E"));
-    OutputGrid oHGrid_FF2(O3DCartesianRegular, run.params, oFile_FF.getHandle("Field_H"));
+    int size = communicator().size();
+    Vector<int> sizesProc(size), dispr(size);
 
-    OutputGrid oEGrid_SH2(O3DCartesianRegular, run.params, oFile_SH.getHandle("Field_E"));
-    OutputGrid oHGrid_SH2(O3DCartesianRegular, run.params, oFile_SH.getHandle("Field_H"));
+    MPI_Allgather(&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, *communicator());
+ 
+  
+   for (int kk = 0; kk < size; kk++)
+   dispr(kk) = (kk > 0) ? (dispr(kk-1) + sizesProc(kk-1)) : 0;
+ 
+  
+    for (int i = 0; i < 9; i++)
+    MPI_Allgatherv(CLGcoeff_par[i], sizeVec, MPI_DOUBLE, CLGcoeff[i],
+                                       &sizesProc(0), &dispr(0), MPI_DOUBLE, *communicator());
 
-    int NOpoints =  oEGrid_FF2.gridPoints;
 
-    std::vector<SphericalP<std::complex<double>>> EField_FFvec (NOpoints);
-    std::vector<SphericalP<std::complex<double>>> HField_FFvec (NOpoints);
-    std::vector<SphericalP<std::complex<double>>> EField_SHvec (NOpoints);
-    std::vector<SphericalP<std::complex<double>>> HField_SHvec (NOpoints);
+}
 
+std::vector<double *> Simulation::shared_tables(int sizeCF) {
+  auto const node = communicator().split_shared();
+  CLGshared_.clear();
+  std::vector<double *> CLGcoeff;
+  for(int i = 0; i < 9; i++) {
+    CLGshared_.emplace_back(sizeCF, node);
+    CLGcoeff.push_back(CLGshared_.back().data());
+  }
+  return CLGcoeff;
+}
 
-    SphericalP<std::complex<double>> EField_FF;
-    SphericalP<std::complex<double>> HField_FF;
-    SphericalP<std::complex<double>> EField_SH;
-    SphericalP<std::complex<double>> HField_SH;
+void Simulation::All2all_shared(std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par,
+                                int gran1, int sizeVec) {
+  auto const &node = CLGshared_.front().node();
+  auto const sizeCF = CLGshared_.front().size();
+  // the roots of the nodes exchange the tables between nodes
+  auto const roots = communicator().split(node.is_root() ? 0 : 1);
+
+  // each coefficient is computed by one process only and is zero elsewhere, so the sum over the
+  // nodes fills the tables exactly
+  if(node.is_root())
+    for(int i = 0; i < 9; i++)
+      std::fill(CLGcoeff[i], CLGcoeff[i] + sizeCF, 0e0);
+  CLGshared_.front().synchronize();
+  for(int i = 0; i < 9; i++)
+    std::copy(CLGcoeff_par[i], CLGcoeff_par[i] + sizeVec, CLGcoeff[i] + gran1);
+  CLGshared_.front().synchronize();
+  if(node.is_root() and roots.size() > 1)
+    for(int i = 0; i < 9; i++)
+      MPI_Allreduce(MPI_IN_PLACE, CLGcoeff[i], sizeCF, MPI_DOUBLE, MPI_SUM, *roots);
+  CLGshared_.front().synchronize();
+}
 
+namespace {
+//! Names of the CLG tables in the library
+char const *const CLGnames[9] = {"C_10m1", "C_11m1", "C_00m1", "C_01m1", "W_m1m1",
+                                 "W_11",   "W_00",   "W_10",   "W_01"};
+//! Group of the CLG tables of nMax and nMaxS in the library
+std::string CLGkey(Run const &run) {
+  return "CLG/nMax" + std::to_string(run.geometry->nMax()) + "_nMaxS" +
+         std::to_string(run.geometry->nMaxS());
+}
 
-    std::vector<std::complex<double>> EField_FF_x;
-    std::vector<std::complex<double>> EField_FF_y;
-    std::vector<std::complex<double>> EField_FF_z;
-    std::vector<std::complex<double>> HField_FF_x;
-    std::vector<std::complex<double>> HField_FF_y;
-    std::vector<std::complex<double>> HField_FF_z;
+//! \brief The steps halving the intervals of an adaptive scan where the cross sections bend
+//! \details The records hold the step, the wavelength, then the cross sections. A step whose cross
+//! sections are further than tolerance times their largest magnitude from the line through its
+//! neighbours has the intervals on either side halved. The steps are on the finest grid, and the
+//! intervals halve to whole steps.
+std::vector<int> refinement(std::map<int, std::vector<double>> const &records, double tolerance) {
+  if(records.size() < 3)
+    return {};
+  auto const width = records.begin()->second.size();
+  std::vector<double> scale(width, 0);
+  for(auto const &record : records)
+    for(std::size_t q = 2; q < width; ++q)
+      scale[q] = std::max(scale[q], std::abs(record.second[q]));
+  std::set<int> result;
+  for(auto b = std::next(records.begin()); std::next(b) != records.end(); ++b) {
+    auto const a = std::prev(b), c = std::next(b);
+    double const t = static_cast<double>(b->first - a->first) / (c->first - a->first);
+    bool bends = false;
+    for(std::size_t q = 2; q < width and not bends; ++q)
+      bends = std::abs(b->second[q] - (1 - t) * a->second[q] - t * c->second[q]) >
+              tolerance * scale[q];
+    if(not bends)
+      continue;
+    if(b->first - a->first > 1)
+      result.insert((a->first + b->first) / 2);
+    if(c->first - b->first > 1)
+      result.insert((b->first + c->first) / 2);
+  }
+  return {result.begin(), result.end()};
+}
 
-    std::vector<std::complex<double>> EField_SH_x;
-    std::vector<std::complex<double>> EField_SH_y;
-    std::vector<std::complex<double>> EField_SH_z;
-    std::vector<std::complex<double>> HField_SH_x;
-    std::vector<std::complex<double>> HField_SH_y;
-    std::vector<std::complex<double>> HField_SH_z;
+//! \brief Spectra of a scan, appended to extensible datasets of an HDF5 file
+//! \details The rows of each dataset are buffered, and written a few steps at a time.
+class Spectra {
+public:
+  //! Creates the file, with the base groups of an Output
+  void open(std::string const &name) {
+    file_.init(name);
+    open_ = true;
+  }
+  //! Adds a row to the dataset path, all the rows of a dataset having the same size
+  void append(std::string const &path, std::vector<double> const &row) {
+    if(not open_)
+      return;
+    auto &pending = pending_[path];
+    pending.first = row.size();
+    pending.second.insert(pending.second.end(), row.begin(), row.end());
+    if(pending.second.size() >= rows_ * row.size())
+      write(path, pending);
+  }
+  void close() {
+    if(not open_)
+      return;
+    for(auto &pending : pending_)
+      write(pending.first, pending.second);
+    file_.close();
+    open_ = false;
+  }
+  ~Spectra() { close(); }
+
+private:
+  //! Rows buffered in each dataset before they are written
+  static constexpr std::size_t rows_ = 32;
+  Output file_;
+  bool open_ = false;
+  //! Size of the rows and buffered rows of each dataset
+  std::map<std::string, std::pair<std::size_t, std::vector<double>>> pending_;
+
+  void write(std::string const &path, std::pair<std::size_t, std::vector<double>> &pending) {
+    if(pending.second.empty())
+      return;
+    file_.appendReal(path, pending.second.data(), pending.second.size() / pending.first,
+                     pending.first);
+    pending.second.clear();
+  }
+};
 
-    int kk = 0;
+//! Checkpoint of a scan, one per group if the scan is shared between groups
+std::string checkpoint_file(std::string const &caseFile, bool grouped, t_uint group) {
+  return caseFile + "_Checkpoint" + (grouped ? std::to_string(group) : "") + ".h5";
+}
 
-   for(int rank = 1; rank < communicator().size(); rank++){
-    
-   MPI_Recv(&sizeField, 1, MPI_INT, rank, 13, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-   EField_FF_x.resize(sizeField);
-   EField_FF_y.resize(sizeField);
-   EField_FF_z.resize(sizeField);
-   HField_FF_x.resize(sizeField);
-   HField_FF_y.resize(sizeField);
-   HField_FF_z.resize(sizeField);
-
-   EField_SH_x.resize(sizeField);
-   EField_SH_y.resize(sizeField);
-   EField_SH_z.resize(sizeField);
-   HField_SH_x.resize(sizeField);
-   HField_SH_y.resize(sizeField);
-   HField_SH_z.resize(sizeField);
-
-   MPI_Recv(&EField_FF_x[0], EField_FF_x.size(), MPI_DOUBLE_COMPLEX, rank, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&EField_FF_y[0], EField_FF_y.size(), MPI_DOUBLE_COMPLEX, rank, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&EField_FF_z[0], EField_FF_z.size(), MPI_DOUBLE_COMPLEX, rank, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&HField_FF_x[0], HField_FF_x.size(), MPI_DOUBLE_COMPLEX, rank, 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&HField_FF_y[0], HField_FF_y.size(), MPI_DOUBLE_COMPLEX, rank, 5, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&HField_FF_z[0], HField_FF_z.size(), MPI_DOUBLE_COMPLEX, rank, 6, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-   MPI_Recv(&EField_SH_x[0], EField_SH_x.size(), MPI_DOUBLE_COMPLEX, rank, 7, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&EField_SH_y[0], EField_SH_y.size(), MPI_DOUBLE_COMPLEX, rank, 8, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&EField_SH_z[0], EField_SH_z.size(), MPI_DOUBLE_COMPLEX, rank, 9, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&HField_SH_x[0], HField_SH_x.size(), MPI_DOUBLE_COMPLEX, rank, 10, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&HField_SH_y[0], HField_SH_y.size(), MPI_DOUBLE_COMPLEX, rank, 11, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-   MPI_Recv(&HField_SH_z[0], HField_SH_z.size(), MPI_DOUBLE_COMPLEX, rank, 12, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    
-   for (int ii = 0; ii < EField_FF_x.size(); ii++){
-
-   EField_FF.rrr = EField_FF_x[ii];   
-   EField_FF.the = EField_FF_y[ii];
-   EField_FF.phi = EField_FF_z[ii];
-   HField_FF.rrr = HField_FF_x[ii];
-   HField_FF.the = HField_FF_y[ii];
-   HField_FF.phi = HField_FF_z[ii];
-
-   EField_SH.rrr = EField_SH_x[ii];
-   EField_SH.the = EField_SH_y[ii];
-   EField_SH.phi = EField_SH_z[ii];
-   HField_SH.rrr = HField_SH_x[ii];
-   HField_SH.the = HField_SH_y[ii];
-   HField_SH.phi = HField_SH_z[ii];
-
-    EField_FFvec[kk] = EField_FF;
-    HField_FFvec[kk] = HField_FF;
-    EField_SHvec[kk] = EField_SH;
-    HField_SHvec[kk] = HField_SH;
- 
-   kk++; 
-       
-   }
+//! The existing checkpoints of a scan, whatever the number of groups that wrote them
+std::vector<std::string> checkpoint_files(std::string const &caseFile) {
+  std::vector<std::string> result;
+  if(std::ifstream(checkpoint_file(caseFile, false, 0).c_str()).good())
+    result.push_back(checkpoint_file(caseFile, false, 0));
+  for(t_uint group = 0; std::ifstream(checkpoint_file(caseFile, true, group).c_str()).good();
+      ++group)
+    result.push_back(checkpoint_file(caseFile, true, group));
+  return result;
+}
+}
 
-   }
+bool Simulation::load_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF) {
+  if(run.CLG_library.empty())
+    return false;
+  int found = 0;
+  if(communicator().rank() == 0) {
+    std::ifstream existing(run.CLG_library.c_str());
+    if(existing.good()) {
+      Output file;
+      if(file.open(run.CLG_library) >= 0) {
+        found = 1;
+        for(int i = 0; i < 9 and found; i++)
+          found = file.readReal(CLGkey(run) + "/" + CLGnames[i], CLGcoeff[i], sizeCF);
+        file.close();
+      }
+    }
+  }
+  MPI_Bcast(&found, 1, MPI_INT, 0, *communicator());
+  if(not found)
+    return false;
+
+  // in shared memory only the roots of the nodes receive the tables
+  bool const shared = not CLGshared_.empty();
+  auto const root = shared ? CLGshared_.front().node().is_root() : true;
+  auto const readers = communicator().split(root ? 0 : 1);
+  if(root)
+    for(int i = 0; i < 9; i++)
+      MPI_Bcast(CLGcoeff[i], sizeCF, MPI_DOUBLE, 0, *readers);
+  if(shared)
+    CLGshared_.front().synchronize();
+  return true;
+}
 
-    kk = 0;
+void Simulation::save_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF) {
+  if(run.CLG_library.empty() or communicator().rank() != 0)
+    return;
+  Output file;
+  if(file.open(run.CLG_library) < 0) {
+    std::cerr << "Could not open CLG library " << run.CLG_library << std::endl;
+    return;
+  }
+  for(int i = 0; i < 9; i++)
+    file.writeReal(CLGkey(run) + "/" + CLGnames[i], CLGcoeff[i], sizeCF);
+  file.close();
+}
 
-    while(!((oEGrid_FF2.gridDone)&&(oEGrid_SH2.gridDone))) {
-    oEGrid_FF2.getPoint();
-    oHGrid_FF2.getPoint();
-    oEGrid_SH2.getPoint();
-    oHGrid_SH2.getPoint(); 
+namespace {
+//! Centres of the objects, x y z of each in m
+std::vector<t_real> object_positions(Geometry const &geometry) {
+  std::vector<t_real> result;
+  for(auto const &object : geometry.objects) {
+    auto const xyz = Tools::toCartesian(object.vR);
+    result.insert(result.end(), {xyz.x, xyz.y, xyz.z});
+  }
+  return result;
+}
 
-    oHGrid_FF2.pushDataNext(HField_FFvec[kk]);
-    oEGrid_FF2.pushDataNext(EField_FFvec[kk]);
-    oHGrid_SH2.pushDataNext(HField_SHvec[kk]);
-    oEGrid_SH2.pushDataNext(EField_SHvec[kk]);
-   
-    kk++;
+//! The incidence of an excitation, as the wavelength, the angles of the wavevector and the
+//! real and imaginary parts of the theta and phi components of the incident field
+std::vector<t_real> incidence(Excitation const &excitation) {
+  return {excitation.lambda(),          excitation.vKInc.the,         excitation.vKInc.phi,
+          excitation.Einc.the.real(), excitation.Einc.the.imag(), excitation.Einc.phi.real(),
+          excitation.Einc.phi.imag()};
+}
+} // namespace
+
+void Simulation::save_coefficients(Run const &run, Result const &result) const {
+  if(communicator().rank() != 0)
+    return;
+  auto const name = caseFile + "_Coefficients.h5";
+  std::remove(name.c_str());
+  Output file;
+  if(file.open(name) < 0)
+    throw std::runtime_error("Could not open " + name);
+  auto const positions = object_positions(*run.geometry);
+  auto const wave = incidence(*run.excitation);
+  t_real const harmonics[] = {static_cast<t_real>(run.geometry->nMax()),
+                              static_cast<t_real>(run.geometry->nMaxS())};
+  file.writeReal("positions", positions.data(), positions.size());
+  file.writeReal("incidence", wave.data(), wave.size());
+  file.writeReal("harmonics", harmonics, 2);
+  file.writeComplex("scatter_coef", result.scatter_coef.data(), 1, result.scatter_coef.size());
+  file.writeComplex("internal_coef", result.internal_coef.data(), 1, result.internal_coef.size());
+  if(run.excitation->SH_cond) {
+    file.writeComplex("scatter_coef_SH", result.scatter_coef_SH.data(), 1,
+                      result.scatter_coef_SH.size());
+    file.writeComplex("internal_coef_SH", result.internal_coef_SH.data(), 1,
+                      result.internal_coef_SH.size());
   }
+  file.close();
+}
 
-    oEGrid_FF2.close();
-    oHGrid_FF2.close();
-    oFile_FF.close();
-    oEGrid_SH2.close();
-    oHGrid_SH2.close();
-    oFile_SH.close();
-    if(!run.excitation->SH_cond){
-    std::string SH = caseFile + "_SH.h5";
-    const char *cstr = SH.c_str();
-    remove(cstr);
+void Simulation::load_coefficients(Run const &run, Result &result) const {
+  auto const positions = object_positions(*run.geometry);
+  auto const wave = incidence(*run.excitation);
+  t_real const harmonics[] = {static_cast<t_real>(run.geometry->nMax()),
+                              static_cast<t_real>(run.geometry->nMaxS())};
+  auto const size = run.geometry->scatterer_size();
+  auto const sizeSH = 2 * run.geometry->objects.size() * harmonics[1] * (harmonics[1] + 2);
+  result.scatter_coef.resize(size);
+  result.internal_coef.resize(size);
+  result.scatter_coef_SH = Vector<t_complex>::Zero(sizeSH);
+  result.internal_coef_SH = Vector<t_complex>::Zero(sizeSH);
+
+  // the root reads the file, the other processes get the coefficients from it
+  int found = 0;
+  if(communicator().rank() == 0) {
+    std::vector<t_real> written(positions.size() + wave.size() + 2);
+    Output file;
+    if(std::ifstream(run.coefficientsFile.c_str()).good() and
+       file.open(run.coefficientsFile) >= 0) {
+      found = file.readReal("positions", written.data(), positions.size()) and
+              file.readReal("incidence", written.data() + positions.size(), wave.size()) and
+              file.readReal("harmonics", written.data() + positions.size() + wave.size(), 2) and
+              file.readComplex("scatter_coef", result.scatter_coef.data(), 1, size) and
+              file.readComplex("internal_coef", result.internal_coef.data(), 1, size) and
+              (not run.excitation->SH_cond or
+               (file.readComplex("scatter_coef_SH", result.scatter_coef_SH.data(), 1, sizeSH) and
+                file.readComplex("internal_coef_SH", result.internal_coef_SH.data(), 1, sizeSH)));
+      file.close();
     }
+    // the same objects, harmonics and incidence up to round-off
+    std::vector<t_real> expected(positions);
+    expected.insert(expected.end(), wave.begin(), wave.end());
+    expected.insert(expected.end(), harmonics, harmonics + 2);
+    auto const scale = std::abs(*std::max_element(
+        expected.begin(), expected.end(),
+        [](t_real a, t_real b) { return std::abs(a) < std::abs(b); }));
+    for(std::size_t i = 0; found and i < expected.size(); ++i)
+      if(std::abs(written[i] - expected[i]) >
+         1e-10 * (i < positions.size() ? scale : std::max(std::abs(expected[i]), 1.0)))
+        found = -1;
   }
+  found = communicator().broadcast(found, 0);
+  if(found == 0)
+    throw std::runtime_error("Could not read the coefficients from " + run.coefficientsFile);
+  if(found < 0)
+    throw std::runtime_error("The coefficients of " + run.coefficientsFile +
+                             " were solved for other objects, harmonics or incidence");
+  for(auto coef : {&result.scatter_coef, &result.internal_coef, &result.scatter_coef_SH,
+                   &result.internal_coef_SH})
+    MPI_Bcast(coef->data(), coef->size(), MPI_DOUBLE_COMPLEX, 0, *communicator());
 }
 
-void Simulation::All2all (std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par, int sizeVec){
-
-    int size = communicator().size();
-    Vector<int> sizesProc(size), dispr(size);
+t_uint Simulation::split_groups(Run &run, t_uint groups) const {
+  auto const world = communicator();
+  groups = std::min(groups, world.size());
+  // contiguous ranks, the first groups holding one more process
+  std::vector<t_uint> first(groups + 1, 0);
+  for(t_uint g = 0; g < groups; ++g)
+    first[g + 1] = first[g] + world.size() / groups + (g < world.size() % groups ? 1 : 0);
+  t_uint const group =
+      std::upper_bound(first.begin(), first.end(), world.rank()) - first.begin() - 1;
+
+  auto const local = world.split(group);
+#ifdef OPTIMET_SCALAPACK
+  // creating a context is collective over all the processes, as in scalapack::Context::split
+  scalapack::Context const system;
+  for(t_uint g = 0; g < groups; ++g) {
+    auto const grid = scalapack::squarest_largest_grid(first[g + 1] - first[g]);
+    Matrix<t_uint> map(grid.rows, grid.cols);
+    for(t_uint r = 0; r < grid.rows; ++r)
+      for(t_uint c = 0; c < grid.cols; ++c)
+        map(r, c) = first[g] + r * grid.cols + c;
+    auto const context = system.subcontext(map);
+    if(g == group) {
+      run.context = context;
+      run.parallel_params.grid = grid;
+    }
+  }
+#endif
+  run.communicator = local;
+  return group;
+}
 
-    MPI_Allgather(&sizeVec, 1, MPI_INT, &sizesProc(0), 1, MPI_INT, MPI_COMM_WORLD);
- 
-  
-   for (int kk = 0; kk < size; kk++)
-   dispr(kk) = (kk > 0) ? (dispr(kk-1) + sizesProc(kk-1)) : 0;
- 
-  
-    for (int i = 0; i < 9; i++)
-    MPI_Allgatherv(CLGcoeff_par[i], sizeVec, MPI_DOUBLE, CLGcoeff[i],
-                                       &sizesProc(0), &dispr(0), MPI_DOUBLE, MPI_COMM_WORLD);
+void Simulation::scan_groups(Run &run) {
+  auto const world = communicator();
+  mpi::Counter const next(0, world);
+  auto const group = split_groups(run, run.scanGroups);
+
+  // the modules creating their own communicator now get the group's
+  communicator(run.communicator);
+  mpi::Communicator::world(run.communicator);
+  try {
+    scan_wavelengths(run, optimet::solver::factory(run), &next, group);
+  } catch(...) {
+    communicator(world);
+    mpi::Communicator::world();
+    throw;
+  }
+  communicator(world);
+  mpi::Communicator::world();
+}
 
+void Simulation::ensemble(Run &run) {
+  auto const world = communicator();
+  auto &objects = run.geometry->objects;
+  t_uint const nobj = objects.size();
+
+  // the centres of the objects in each configuration, read by the root
+  Vector<t_real> positions;
+  if(world.is_root()) {
+    std::ifstream file(run.ensemble);
+    std::vector<t_real> values;
+    for(t_real value; file >> value;)
+      values.push_back(value);
+    if(file.bad() or not file.eof())
+      values.clear();
+    positions = Eigen::Map<Vector<t_real> const>(values.data(), values.size());
+  }
+  positions = world.broadcast(positions);
+  if(positions.size() == 0 or positions.size() % (3 * nobj) != 0)
+    throw std::runtime_error("The ensemble file " + run.ensemble +
+                             " should hold the x y z of each object, in nm, for each configuration");
+  t_uint const configurations = positions.size() / (3 * nobj);
+
+  // the wavelengths of the scan, the tabulated materials looked up at all of them once
+  t_uint const steps = std::max<t_uint>(1, run.params[2]);
+  auto const lams = steps > 1 ? (run.params[1] - run.params[0]) / (steps - 1) : 0;
+  std::vector<t_real> lambdas(steps);
+  for(t_uint i = 0; i < steps; ++i)
+    lambdas[i] = run.params[0] + i * lams;
+  run.geometry->preload(lambdas);
+
+  // The pairs of a wavelength and a configuration are handed out in the order of the
+  // wavelengths, so that a group meets all its configurations at a wavelength before the next
+  // one: the T-matrices it keeps are those of the current wavelength.
+  mpi::Counter const next(0, world);
+  if(run.ensembleGroups > 1 and world.size() > 1)
+    split_groups(run, run.ensembleGroups);
+  auto const local = run.communicator;
+  auto const nInc = run.excitation->nIncidences();
+  t_uint const width = 2 + 3 * nInc;
+  std::vector<t_real> records;
+  auto const original = objects;
+  communicator(local);
+  mpi::Communicator::world(local);
+  try {
+    // one solver and set of CLG tables per group, kept over all its configurations
+    Engine engine(local);
+    for(;;) {
+      t_uint item = local.is_root() ? next.fetch_add(1) : 0;
+      item = local.broadcast(item);
+      if(item >= steps * configurations)
+        break;
+      auto const step = item / configurations, configuration = item % configurations;
+      for(t_uint j = 0; j < nobj; ++j) {
+        auto const xyz = positions.segment(3 * (configuration * nobj + j), 3) * consFrnmTom;
+        objects[j].vR = Tools::toSpherical(Cartesian<t_real>(xyz(0), xyz(1), xyz(2)));
+      }
+      if(not run.geometry->is_valid())
+        throw std::runtime_error("The objects of configuration " + std::to_string(configuration) +
+                                 " of the ensemble overlap");
+      auto const response = engine.solve(run, lambdas[step]);
+      if(local.is_root()) {
+        records.push_back(configuration);
+        records.push_back(step);
+        for(auto const cs : {&response.absorption, &response.scattering, &response.scattering_SH})
+          records.insert(records.end(), cs->data(), cs->data() + nInc);
+      }
+    }
+  } catch(...) {
+    objects = original;
+    communicator(world);
+    mpi::Communicator::world();
+    throw;
+  }
+  objects = original;
+  communicator(world);
+  mpi::Communicator::world();
+  run.communicator = world;
+
+  // the cross sections of all the groups, gathered by the root
+  int const count = records.size();
+  std::vector<int> counts(world.size()), displs(world.size() + 1, 0);
+  MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, world.root_id(), *world);
+  for(t_uint r = 0; r < world.size(); ++r)
+    displs[r + 1] = displs[r] + counts[r];
+  std::vector<t_real> gathered(world.is_root() ? displs.back() : 0);
+  MPI_Gatherv(records.data(), count, MPI_DOUBLE, gathered.data(), counts.data(), displs.data(),
+              MPI_DOUBLE, world.root_id(), *world);
+  if(not world.is_root())
+    return;
+
+  // in the order of the configurations then of the wavelengths, with the mean over the ensemble
+  std::map<std::pair<t_uint, t_uint>, t_real const *> sorted;
+  for(std::size_t k = 0; k < gathered.size(); k += width)
+    sorted[{static_cast<t_uint>(gathered[k]), static_cast<t_uint>(gathered[k + 1])}] =
+        &gathered[k + 2];
+  Matrix<t_real> mean = Matrix<t_real>::Zero(3 * nInc, steps);
+  std::ofstream out(caseFile + "_Ensemble.dat"), outMean(caseFile + "_EnsembleMean.dat");
+  out << std::setprecision(10);
+  outMean << std::setprecision(10);
+  auto const write = [&](std::ofstream &file, t_real wavelength, t_real const *cs) {
+    file << wavelength;
+    for(t_uint k = 0; k < 3 * nInc; ++k)
+      if(k < 2 * nInc or run.excitation->SH_cond)
+        file << "\t" << cs[k];
+    file << std::endl;
+  };
+  for(auto const &record : sorted) {
+    out << record.first.first << "\t";
+    write(out, lambdas[record.first.second], record.second);
+    mean.col(record.first.second) += Eigen::Map<Vector<t_real> const>(record.second, 3 * nInc);
+  }
+  mean /= configurations;
+  for(t_uint i = 0; i < steps; ++i)
+    write(outMean, lambdas[i], mean.col(i).data());
+}
 
+void Simulation::average_wavelengths(Run &run) {
+  t_uint const steps = std::max<t_uint>(1, run.params[2]);
+  auto const lams = steps > 1 ? (run.params[1] - run.params[0]) / (steps - 1) : 0;
+  std::vector<t_real> lambdas(steps);
+  for(t_uint i = 0; i < steps; ++i)
+    lambdas[i] = run.params[0] + i * lams;
+  run.geometry->preload(lambdas);
+
+  std::ofstream out;
+  if(communicator().is_root()) {
+    out.open(caseFile + "_AverageCS.dat");
+    out << std::setprecision(10);
+  }
+  for(auto const lambda : lambdas) {
+    run.excitation->updateWavelength(lambda);
+    run.geometry->update(run.excitation);
+    // the T-matrices of the distinct particles at this wavelength
+    TmatrixCache cache;
+    auto const TRgQ = getTRgQmatrix_FF_parr(*run.geometry, run.excitation, &cache, communicator());
+    auto const order = run.averageOrder > 0 ? run.averageOrder :
+                                              cluster_order(*run.geometry, run.excitation->waveK);
+    auto const average = orientation_average(
+        cluster_tmatrix(*run.geometry, run.excitation, TRgQ.leftCols(TRgQ.cols() / 2), order,
+                        communicator()),
+        run.excitation);
+    if(communicator().is_root())
+      out << lambda << "\t" << average.extinction << "\t" << average.scattering << "\t"
+          << average.absorption << std::endl;
+  }
 }
 
+void Simulation::convergence(Run &run) {
+  t_uint const steps = std::max<t_uint>(1, run.params[2]);
+  auto const lams = steps > 1 ? (run.params[1] - run.params[0]) / (steps - 1) : 0;
+  std::vector<t_real> lambdas(steps);
+  for(t_uint i = 0; i < steps; ++i)
+    lambdas[i] = run.params[0] + i * lams;
+  run.geometry->preload(lambdas);
+
+  // the orders of the study, always ending with those of the simulation
+  std::vector<t_uint> orders;
+  for(t_uint n = run.convergenceFrom; n < static_cast<t_uint>(run.nMax); n += run.convergenceStep)
+    orders.push_back(n);
+  orders.push_back(run.nMax);
+
+  std::ofstream out;
+  if(communicator().is_root()) {
+    out.open(caseFile + "_Convergence.dat");
+    out << std::setprecision(10);
+  }
+  // The orders of a wavelength follow each other, so that the solver truncates the T-matrices
+  // it keeps for the wavelength rather than computing them again. The objects with their own
+  // harmonics are truncated to the smaller of theirs and those of the study.
+  auto &objects = run.geometry->objects;
+  auto const original = objects;
+  auto const nInc = run.excitation->nIncidences();
+  try {
+    Engine engine(communicator());
+    for(auto const lambda : lambdas)
+      for(auto const order : orders) {
+        for(std::size_t j = 0; j < objects.size(); ++j)
+          objects[j].order = original[j].order > 0 ?
+                                 std::min<int>(original[j].order, order) :
+                                 static_cast<int>(order);
+        auto const response = engine.solve(run, lambda);
+        if(not communicator().is_root())
+          continue;
+        out << lambda << "\t" << order;
+        for(t_uint inc = 0; inc < nInc; ++inc)
+          out << "\t" << response.extinction(inc) << "\t" << response.scattering(inc) << "\t"
+              << response.absorption(inc);
+        out << std::endl;
+      }
+  } catch(...) {
+    objects = original;
+    throw;
+  }
+  objects = original;
+}
 
-void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolver> solver) {
+void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolver> solver,
+                                  mpi::Counter const *next, t_uint group) {
   std::ofstream outASec_FF, outSSec_FF, outSSec_SH, outASec_SH;
  
   int nMax = run.geometry->nMax();
   int nMaxS = run.geometry->nMaxS();
   int flatMax = nMax * (nMax + 2);
   int flatMaxS = nMaxS * (nMaxS + 2);
-  int sizeCF = flatMaxS * flatMax * flatMax;
+  int sizeCF = run.geometry->couplings(nMax, nMaxS).size();
   int gran1, gran2, gran1CG, gran2CG;
   int rank = communicator().rank();
   int size = communicator().size();
@@ -355,24 +1309,46 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
    int sizeCF_par = gran2CG - gran1CG;
    
   
-  std::vector<double> C_10m1_par(sizeCF_par), C_11m1_par(sizeCF_par), C_00m1_par(sizeCF_par), C_01m1_par(sizeCF_par);
-  std::vector<double> W_m1m1_par(sizeCF_par), W_11_par(sizeCF_par), W_00_par(sizeCF_par), W_10_par(sizeCF_par), W_01_par(sizeCF_par);
-
-  std::vector<double> C_10m1(sizeCF), C_11m1(sizeCF), C_00m1(sizeCF), C_01m1(sizeCF);
-  std::vector<double> W_m1m1(sizeCF), W_11(sizeCF), W_00(sizeCF), W_10(sizeCF), W_01(sizeCF);
+  // the slice of this process, none when the W numbers are computed where they are used
+  int const sizeCF_slice = run.onthefly_tables ? 0 : sizeCF_par;
+  std::vector<double> C_10m1_par(sizeCF_slice), C_11m1_par(sizeCF_slice), C_00m1_par(sizeCF_slice), C_01m1_par(sizeCF_slice);
+  std::vector<double> W_m1m1_par(sizeCF_slice), W_11_par(sizeCF_slice), W_00_par(sizeCF_slice), W_10_par(sizeCF_slice), W_01_par(sizeCF_slice);
+
+  // the complete tables, on each process or once per node in shared memory
+  int const sizeCF_full = run.shared_tables or run.onthefly_tables ? 0 : sizeCF;
+  std::vector<double> C_10m1(sizeCF_full), C_11m1(sizeCF_full), C_00m1(sizeCF_full), C_01m1(sizeCF_full);
+  std::vector<double> W_m1m1(sizeCF_full), W_11(sizeCF_full), W_00(sizeCF_full), W_10(sizeCF_full), W_01(sizeCF_full);
   
-  std::vector<double *> CLGcoeff_par = {&C_10m1_par[0], &C_11m1_par[0], &C_00m1_par[0], &C_01m1_par[0],
-                                       &W_m1m1_par[0], &W_11_par[0], &W_00_par[0], &W_10_par[0], &W_01_par[0]};
-
-  std::vector<double *> CLGcoeff = {&C_10m1[0], &C_11m1[0], &C_00m1[0], &C_01m1[0],
-                                       &W_m1m1[0], &W_11[0], &W_00[0], &W_10[0], &W_01[0]}; 
-
-  run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
+  std::vector<double *> CLGcoeff_par = {C_10m1_par.data(), C_11m1_par.data(), C_00m1_par.data(), C_01m1_par.data(),
+                                       W_m1m1_par.data(), W_11_par.data(), W_00_par.data(), W_10_par.data(), W_01_par.data()};
+
+  std::vector<double *> CLGcoeff = {C_10m1.data(), C_11m1.data(), C_00m1.data(), C_01m1.data(),
+                                       W_m1m1.data(), W_11.data(), W_00.data(), W_10.data(), W_01.data()}; 
+
+  if(run.onthefly_tables)
+    CLGcoeff.assign(9, nullptr);
+  else if(run.shared_tables)
+    CLGcoeff = shared_tables(sizeCF);
+
+  if(not run.onthefly_tables) {
+    Profile::Region const timer("CLG coefficients");
+    if(not load_tables(run, CLGcoeff, sizeCF)) {
+      run.geometry->Coefficients(nMax, nMaxS, CLGcoeff_par, gran1CG, gran2CG);
+
+      if(run.shared_tables)
+        All2all_shared(CLGcoeff, CLGcoeff_par, gran1CG, sizeCF_par);
+      else
+        All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
+      // the groups would all write the same tables
+      if(group == 0)
+        save_tables(run, CLGcoeff, sizeCF);
+    }
+  }
+  Profile::memory("CLG tables", 9.0 * sizeof(double) * (sizeCF_full + sizeCF_slice));
 
-      
-  All2all(CLGcoeff, CLGcoeff_par, sizeCF_par);
- 
-  if(communicator().rank() == communicator().root_id()) {
+  // the cross sections are written by the root of all the groups
+  bool const writes = next ? next->communicator().is_root() : communicator().is_root();
+  if(writes) {
   
  
     outASec_FF.open(caseFile + "_AbsorptionCS_FF.dat");
@@ -383,31 +1359,353 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
     }
     
   }
+  // one column per incidence, then the orientation average
+  auto const write = [&](std::ofstream &out, double wavelength, Vector<double> const &cs) {
+    out << wavelength;
+    double average(0.0);
+    for(Eigen::Index inc = 0; inc < cs.size(); ++inc) {
+      out << "\t" << cs(inc);
+      average += run.excitation->weight(inc) * cs(inc);
+    }
+    if(cs.size() > 1)
+      out << "\t" << average;
+    out << "\n";
+  };
+  auto const write_cross_sections = [&](double wavelength, Vector<double> const &extinction,
+                                        Vector<double> const &scattering,
+                                        Vector<double> const &scattering_SH) {
+    write(outASec_FF, wavelength, extinction - scattering);
+    write(outSSec_FF, wavelength, scattering);
+    if(run.excitation->SH_cond)
+      write(outSSec_SH, wavelength, scattering_SH);
+  };
+
+  // Radiation patterns on a grid of directions, from the poles and with theta slowest. The
+  // angular functions are computed once for all the wavelengths.
+  std::vector<double> pattern_the, pattern_phi;
+  for(t_uint i = 0; i < run.patternTheta; i++)
+    for(t_uint j = 0; j < run.patternPhi; j++) {
+      pattern_the.push_back(run.patternTheta > 1 ? consPi * i / (run.patternTheta - 1) : consPi / 2);
+      pattern_phi.push_back(2 * consPi * j / run.patternPhi);
+    }
+  FarField const directions(pattern_the, pattern_phi, std::max(nMax, nMaxS));
+  Output oPattern;
+
+  // Quadrature of the scattering cross sections, exact for the patterns at the shortest wavelength
+  std::vector<double> sphere_the, sphere_phi, sphere_weights;
+  if(run.farFieldCrossSection) {
+    double extent = 0;
+    for(auto const &object : run.geometry->objects)
+      extent = std::max(extent, object.vR.rrr);
+    auto const &bground = run.geometry->bground;
+    auto const kMax = 2 * consPi / std::min(run.params[0], run.params[1]) *
+                      std::abs(std::sqrt(bground.epsilon_r * bground.mu_r));
+    int const order = std::ceil(std::max(nMax + kMax * extent, nMaxS + 2 * kMax * extent)) + 2;
+    auto const points = Tools::getLinePts(order + 1);
+    auto const weights = Tools::getLineWghts(order + 1);
+    for(int i = 0; i <= order; i++)
+      for(int j = 0; j <= 2 * order; j++) {
+        sphere_the.push_back(std::acos(points[i]));
+        sphere_phi.push_back(2 * consPi * j / (2 * order + 1));
+        sphere_weights.push_back(weights[i] * 2 * consPi / (2 * order + 1));
+      }
+  }
+  FarField const sphere(sphere_the, sphere_phi, std::max(nMax, nMaxS));
+  if(run.patternTheta > 0 && communicator().rank() == communicator().root_id()) {
+    // a resumed scan adds to the patterns of the steps already done
+    auto const name = caseFile + "_Pattern" + (next ? std::to_string(group) : "") + ".h5";
+    if(resume())
+      oPattern.open(name);
+    else
+      oPattern.init(name);
+    oPattern.writeReal("theta", pattern_the.data(), pattern_the.size());
+    oPattern.writeReal("phi", pattern_phi.data(), pattern_phi.size());
+  }
+  // one line of JSON per iterative solve, a resumed scan adding to the lines already written
+  std::ofstream oSolver;
+  if(run.solverStatistics && communicator().rank() == communicator().root_id())
+    oSolver.open(caseFile + "_Solver" + (next ? std::to_string(group) : "") + ".jsonl",
+                 resume() ? std::ios::app : std::ios::trunc);
+  // The probes are located once for all the steps, their fields written by the root of each
+  // group, a resumed scan adding to the lines already written
+  Result::Located probes;
+  std::ofstream oProbes;
+  if(not run.probes.empty() && communicator().rank() == communicator().root_id()) {
+    std::vector<Spherical<double>> R;
+    // offset as the points of the grids, so that none is at an origin
+    for(std::size_t i = 0; i < run.probes.size(); i += 3)
+      R.push_back(Tools::toSpherical(Cartesian<double>(
+          run.probes[i] + 1e-12, run.probes[i + 1] + 1e-12, run.probes[i + 2] + 1e-12)));
+    probes = Result(run.geometry, run.excitation).locate(R);
+    oProbes.open(caseFile + "_Probes" + (next ? std::to_string(group) : "") + ".dat",
+                 resume() ? std::ios::app : std::ios::trunc);
+  }
 
   // Now scan over the wavelengths given in params
   double lami = run.params[0];
   double lamf = run.params[1];
-  int steps = run.params[2];
+  // an adaptive scan picks its steps on a grid finer than the given one
+  int const coarse = 1 << run.adaptiveLevels;
+  int steps = (static_cast<int>(run.params[2]) - 1) * coarse + 1;
 
   double lam;
   double lams;
 
-  double scaCS_SH(0.0), scaCS_FF(0.0), extCS_FF(0.0);
   int NO = run.geometry->objects.size();
   int TMax = NO * flatMaxS;
   
   lams = (lamf - lami) / (steps - 1); 
-  
-   for(int i = 0; i < steps; i++) {
-    
+
+  // the tabulated materials at all the steps at once, which are then looked up
+  {
+    std::vector<double> lambdas(steps);
+    for(int i = 0; i < steps; i++)
+      lambdas[i] = lami + i * lams;
+    run.geometry->preload(lambdas);
+  }
+
+  // solutions at the last two wavelengths, from which the iterative solvers start
+  Matrix<t_complex> last, before_last, last_SH, before_last_SH;
+  // the solutions of the full solves, spanning those of the reduced ones
+  Matrix<t_complex> basis;
+  int last_step = -1, before_last_step = -1;
+
+  // step, wavelength, then extinction, scattering and SH cross sections of each incidence
+  auto const nInc = run.excitation->nIncidences();
+  int const width = 2 + 3 * nInc;
+  std::vector<double> records;
+  // step, then the extinction, scattering and SH cross sections of each object, by incidence
+  int const objects_width = 1 + 3 * NO * nInc;
+  std::vector<double> object_records;
+  // The spectra in the CS_Ext, CS_Sca and CS_Abs groups, of each object if known, for each
+  // incidence. Without the couplings, only the extinction of the objects is known.
+  Spectra spectra;
+  if(writes)
+    spectra.open(caseFile + "_Spectra.h5");
+  // The output of the roots, written in the background while the next steps are solved. The jobs
+  // hold on to the files above by reference, and are all done before these are closed.
+  Writer writer(communicator().rank() == communicator().root_id() ? run.writerDepth : 0);
+  auto const write_record = [&](double const *step_record, double const *step_objects) {
+    // a copy of the rows, then of those of the objects if known
+    auto const rows = std::make_shared<std::vector<double>>(step_record, step_record + width);
+    if(step_objects)
+      rows->insert(rows->end(), step_objects, step_objects + objects_width);
+    writer.push([&, rows]() {
+      std::lock_guard<std::mutex> const lock(Output::mutex());
+      double const *record = rows->data();
+      double const *objects = rows->size() > static_cast<std::size_t>(width) ? record + width : nullptr;
+      Eigen::Map<Vector<double> const> cs(record + 2, 3 * nInc);
+      write_cross_sections(record[1], cs.head(nInc), cs.segment(nInc, nInc), cs.tail(nInc));
+      auto const row = [](Vector<double> const &values) {
+        return std::vector<double>(values.data(), values.data() + values.size());
+      };
+      spectra.append("wavelength", {record[1]});
+      spectra.append("CS_Ext/FF", row(cs.head(nInc)));
+      spectra.append("CS_Sca/FF", row(cs.segment(nInc, nInc)));
+      spectra.append("CS_Abs/FF", row(cs.head(nInc) - cs.segment(nInc, nInc)));
+      if(run.excitation->SH_cond)
+        spectra.append("CS_Sca/SH", row(cs.tail(nInc)));
+      // the steps of an earlier run without them are not a number
+      Vector<double> const unknown =
+          Vector<double>::Constant(objects_width - 1, std::numeric_limits<double>::quiet_NaN());
+      Eigen::Map<Vector<double> const> cs_objects(objects ? objects + 1 : unknown.data(),
+                                                  objects_width - 1);
+      auto const extinction = cs_objects.head(NO * nInc), scattering = cs_objects.segment(NO * nInc, NO * nInc);
+      spectra.append("CS_Ext/FF_objects", row(extinction));
+      if(run.farFieldCrossSection)
+        return;
+      spectra.append("CS_Sca/FF_objects", row(scattering));
+      spectra.append("CS_Abs/FF_objects", row(extinction - scattering));
+      if(run.excitation->SH_cond)
+        spectra.append("CS_Sca/SH_objects", row(cs_objects.tail(NO * nInc)));
+    });
+  };
+
+  // Field maps from the solutions of the steps closest to the given wavelengths, of each incidence
+  std::set<int> mapped;
+  for(auto const wavelength : run.fieldWavelengths)
+    mapped.insert(steps > 1 ? std::max(0, std::min(steps - 1, static_cast<int>(std::lround(
+                                                                    (wavelength - lami) / lams))))
+                            : 0);
+  auto const write_fields = [&](int step, Matrix<t_complex> const &scatter_coef,
+                                Matrix<t_complex> const &internal_coef,
+                                Matrix<t_complex> const &scatter_coef_SH,
+                                Matrix<t_complex> const &internal_coef_SH) {
+    Profile::Region const timer("scan fields");
+    for(t_uint inc = 0; inc < nInc; ++inc) {
+      Result result(run.geometry, nInc == 1 ? run.excitation : run.excitation->incidence(inc));
+      result.scatter_coef = scatter_coef.col(inc);
+      result.internal_coef = internal_coef.col(inc);
+      if(run.excitation->SH_cond) {
+        result.scatter_coef_SH = scatter_coef_SH.col(inc);
+        result.internal_coef_SH = internal_coef_SH.col(inc);
+      }
+      field_map(run, result, CLGcoeff, O3DCartesianRegular, run.fieldGrid, nullptr,
+                caseFile + "_Step" + std::to_string(step) +
+                    (nInc > 1 ? "_Incidence" + std::to_string(inc) : ""),
+                &writer);
+    }
+  };
+  // the FF scattering cross sections of the last two steps, and the solution of the last one,
+  // for the field maps at the maxima
+  int peak_step = -1, rise_step = -1;
+  double peak_sigma = 0, rise_sigma = 0;
+  Matrix<t_complex> peak_coef, peak_internal, peak_coef_SH, peak_internal_SH;
+
+  // The steps done by an earlier run, found by the root of all the groups. The checkpoints are
+  // otherwise started afresh.
+  auto const &all = next ? next->communicator() : communicator();
+  std::map<int, std::vector<double>> finished, finished_objects;
+  std::map<int, std::string> finished_file;
+  double const scan[4] = {lami, lamf, static_cast<double>(steps), static_cast<double>(nInc)};
+  if(writes and resume()) {
+    for(auto const &name : checkpoint_files(caseFile)) {
+      Output file;
+      double written[4];
+      if(file.open(name) < 0 or not file.readReal("scan", written, 4) or
+         not std::equal(written, written + 4, scan)) {
+        std::cerr << "Ignoring checkpoint " << name << ", written for another scan" << std::endl;
+        continue;
+      }
+      std::vector<double> record(width), objects(objects_width);
+      for(int i = 0; i < steps; i++)
+        if(file.readReal("step" + std::to_string(i) + "/record", record.data(), width)) {
+          finished[i] = record;
+          finished_file[i] = name;
+          if(file.readReal("step" + std::to_string(i) + "/objects", objects.data(),
+                           objects_width))
+            finished_objects[i] = objects;
+        }
+      file.close();
+    }
+    std::cout << "Resuming the scan, " << finished.size() << " of " << steps
+              << " wavelengths done" << std::endl;
+  }
+  else if(writes and run.checkpointEvery > 0)
+    for(auto const &name : checkpoint_files(caseFile))
+      std::remove(name.c_str());
+  // no checkpoint is written before they are all read
+  Vector<t_int> done(finished.size());
+  t_int n = 0;
+  for(auto const &step : finished)
+    done(n++) = step.first;
+  done = all.broadcast(done);
+  std::set<int> const skipped(done.data(), done.data() + done.size());
+
+  // The steps solved together: all of them, or those of a level of an adaptive scan. The cross
+  // sections are written as soon as they are solved, unless the steps come out of order.
+  std::vector<int> level;
+  for(int i = 0; i < steps; i += coarse)
+    level.push_back(i);
+  bool const streamed = not next and run.adaptiveLevels == 0;
+  // The positions in the level are fetched by the root of the group, one at a time. Each group
+  // fetches one past the end of the level.
+  int const groups = next ? all.all_reduce(static_cast<int>(communicator().is_root()), MPI_SUM) : 1;
+  int base = 0;
+  auto const next_position = [&](int position) {
+    if(not next)
+      return position + 1;
+    int const fetched = communicator().is_root() ? next->fetch_add(1) - base : 0;
+    return communicator().broadcast(fetched);
+  };
+
+  // reads the solution of a step done by an earlier run, without groups
+  auto const restore = [&](int step, Matrix<t_complex> &coef, Matrix<t_complex> &coef_SH) {
+    if(communicator().is_root()) {
+      auto const path = "step" + std::to_string(step);
+      double sizes[3] = {0, 0, 0};
+      std::lock_guard<std::mutex> const lock(Output::mutex());
+      Output file;
+      file.open(finished_file[step]);
+      file.readReal(path + "/sizes", sizes, 3);
+      coef.resize(static_cast<t_int>(sizes[0]), static_cast<t_int>(sizes[2]));
+      coef_SH.resize(static_cast<t_int>(sizes[1]), static_cast<t_int>(sizes[2]));
+      if(not file.readComplex(path + "/scatter_coef", coef.data(), coef.cols(), coef.rows()) or
+         not file.readComplex(path + "/scatter_coef_SH", coef_SH.data(), coef_SH.cols(),
+                              coef_SH.rows())) {
+        coef.resize(0, 0);
+        coef_SH.resize(0, 0);
+      }
+      file.close();
+    }
+    coef = communicator().broadcast(coef);
+    coef_SH = communicator().broadcast(coef_SH);
+  };
+
+  // The steps solved here and not yet in the checkpoint, with their scattering coefficients. The
+  // file is only open while they are written.
+  std::vector<std::tuple<int, std::vector<double>, std::vector<double>, Matrix<t_complex>,
+                         Matrix<t_complex>>>
+      pending;
+  auto const flush = [&]() {
+    if(pending.empty())
+      return;
+    auto const name = checkpoint_file(caseFile, next != nullptr, group);
+    auto const steps = std::make_shared<decltype(pending)>();
+    steps->swap(pending);
+    writer.push([&, name, steps]() {
+      std::lock_guard<std::mutex> const lock(Output::mutex());
+      Output file;
+      if(file.open(name) < 0) {
+        std::cerr << "Could not open checkpoint " << name << std::endl;
+        return;
+      }
+      file.writeReal("scan", scan, 4);
+      for(auto const &step : *steps) {
+        auto const path = "step" + std::to_string(std::get<0>(step));
+        auto const &coef = std::get<3>(step);
+        auto const &coef_SH = std::get<4>(step);
+        double const sizes[3] = {static_cast<double>(coef.rows()),
+                                 static_cast<double>(coef_SH.rows()),
+                                 static_cast<double>(coef.cols())};
+        file.writeReal(path + "/sizes", sizes, 3);
+        file.writeComplex(path + "/scatter_coef", coef.data(), coef.cols(), coef.rows());
+        file.writeComplex(path + "/scatter_coef_SH", coef_SH.data(), coef_SH.cols(),
+                          coef_SH.rows());
+        file.writeReal(path + "/objects", std::get<2>(step).data(), objects_width);
+        // last, so that a step is only done once all its data is written
+        file.writeReal(path + "/record", std::get<1>(step).data(), width);
+      }
+      file.close();
+    });
+  };
+
+  while(not level.empty()) {
+   for(int position = next_position(-1); position < static_cast<int>(level.size());
+       position = next_position(position)) {
+    int const i = level[position];
     lam = lami + i * lams;
 
+    if(skipped.count(i)) {
+      if(streamed and writes)
+        write_record(finished[i].data(),
+                     finished_objects.count(i) ? finished_objects[i].data() : nullptr);
+      continue;
+    }
+    // the guesses from the solutions of the earlier run
+    if(streamed and last_step != i - 1 and skipped.count(i - 1)) {
+      if(skipped.count(i - 2))
+        restore(i - 2, before_last, before_last_SH);
+      restore(i - 1, last, last_SH);
+      before_last_step = skipped.count(i - 2) ? i - 2 : -1;
+      last_step = i - 1;
+    }
+
     run.excitation->updateWavelength(lam);
     run.geometry->update(run.excitation);
 
-    solver->update(run); // building of the sistem matrices   
+    SolverStatistics::clear();
+    {
+      Profile::Region const timer("solver update");
+      solver->update(run); // building of the sistem matrices
+    }
 
-    Vector<double> scaCS_SH_vec(size), scaCS_FF_vec(size), extCS_FF_vec(size);
+    // evenly spaced steps, so that the linear extrapolation is 2 x_{i-1} - x_{i-2}
+    if(run.extrapolate_guess and before_last_step >= 0 and
+       i - last_step == last_step - before_last_step)
+      solver->initial_guess(2.0 * last - before_last, 2.0 * last_SH - before_last_SH);
+    else
+      solver->initial_guess(last, last_SH);
 
     if(communicator().rank() == communicator().root_id()) {
 
@@ -415,12 +1713,43 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
 
     }
 
-  Result result(run.geometry, run.excitation);
-   
-  solver->solve(result.scatter_coef, result.internal_coef, result.scatter_coef_SH, result.internal_coef_SH, CLGcoeff);
-
-      if (size <= NO) {  // if the number of processes is less or eq numb of part
-
+  // all the incidences share the scattering matrix
+  Matrix<t_complex> scatter_coef, internal_coef, scatter_coef_SH, internal_coef_SH;
+  // within the span of the full solutions, unless its residual is too large
+  auto const solve_start = steady_clock::now();
+  bool const reduced =
+      run.reducedTolerance > 0 and not run.excitation->SH_cond and basis.cols() > 0 and
+      solver->solve_reduced(basis, scatter_coef, internal_coef) <= run.reducedTolerance;
+  if(reduced) {
+    if(communicator().is_root())
+      std::cout << "Reduced solve, within " << basis.cols() << " solutions" << std::endl;
+  }
+  else if(nInc == 1) {
+    Result result(run.geometry, run.excitation);
+    solver->solve(result.scatter_coef, result.internal_coef, result.scatter_coef_SH, result.internal_coef_SH, CLGcoeff);
+    scatter_coef = result.scatter_coef;
+    internal_coef = result.internal_coef;
+    scatter_coef_SH = result.scatter_coef_SH;
+    internal_coef_SH = result.internal_coef_SH;
+  }
+  else
+    solver->solve_incidences(scatter_coef, internal_coef, scatter_coef_SH, internal_coef_SH, CLGcoeff);
+  Profile::time("solve", duration<t_real>(steady_clock::now() - solve_start).count());
+  if(run.reducedTolerance > 0 and not reduced) {
+    basis.conservativeResize(scatter_coef.rows(), basis.cols() + scatter_coef.cols());
+    basis.rightCols(scatter_coef.cols()) = scatter_coef;
+  }
+  if(oSolver.is_open())
+    SolverStatistics::write_json(oSolver, i, lam);
+  before_last.swap(last);
+  before_last_SH.swap(last_SH);
+  last = scatter_coef;
+  last_SH = scatter_coef_SH;
+  before_last_step = last_step;
+  last_step = i;
+
+  // the scatterers whose cross sections this process adds up
+  if (size <= NO) {  // if the number of processes is less or eq numb of part
     if (rank < (NO % size)) {
     gran1 = rank * (NO/size + 1);
     gran2 = gran1 + NO/size + 1;
@@ -428,77 +1757,223 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
     gran1 = rank * (NO/size) + (NO % size);
     gran2 = gran1 + (NO/size);
     }
+  }
+  else {  // if the number of processes is more than numb of part
+    gran1 = rank < NO ? rank : NO;
+    gran2 = rank < NO ? rank + 1 : NO;
+  }
 
+  auto const cross_sections_start = steady_clock::now();
+  Vector<double> scaCS_SH_vec = Vector<double>::Zero(nInc), scaCS_FF_vec(nInc), extCS_FF_vec(nInc);
+  // those of each object, by incidence, of the objects of this process
+  Vector<double> scaCS_SH_objects = Vector<double>::Zero(NO * nInc),
+                 scaCS_FF_objects = Vector<double>::Zero(NO * nInc),
+                 extCS_FF_objects = Vector<double>::Zero(NO * nInc);
+  for(t_uint inc = 0; inc < nInc; ++inc) {
+    Result result(run.geometry, nInc == 1 ? run.excitation : run.excitation->incidence(inc));
+    result.couplings = solver->origin_couplings();
+    result.scatter_coef = scatter_coef.col(inc);
+    result.internal_coef = internal_coef.col(inc);
+    if(solver->sources().cols() == static_cast<t_int>(nInc))
+      result.incident_coef = solver->sources().col(inc);
     if(run.excitation->SH_cond){
-     scaCS_SH = result.getScatteringCrossSection_SH(gran1, gran2);
-     }
-     scaCS_FF = result.getScatteringCrossSection(gran1, gran2);
-     extCS_FF = result.getExtinctionCrossSection(gran1, gran2);
-
-    if(run.excitation->SH_cond){    
-    MPI_Gather(&scaCS_SH, 1, MPI_DOUBLE, &scaCS_SH_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    }     
-    MPI_Gather(&scaCS_FF, 1, MPI_DOUBLE, &scaCS_FF_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Gather(&extCS_FF, 1, MPI_DOUBLE, &extCS_FF_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
- 
-      if(communicator().rank() == communicator().root_id()) {    
-              
-      outASec_FF << lam << "\t" << extCS_FF_vec.sum() - scaCS_FF_vec.sum() << std::endl;
-      outSSec_FF << lam << "\t" << scaCS_FF_vec.sum() << std::endl;
-
-      if(run.excitation->SH_cond){
-      outSSec_SH << lam << "\t" << scaCS_SH_vec.sum() << std::endl;
-      //std::cout<<scaCS_FF_vec.sum()<<std::endl;
-      //std::cout<<scaCS_SH_vec.sum()<<std::endl;
-     }
+    result.scatter_coef_SH = scatter_coef_SH.col(inc);
+    result.internal_coef_SH = internal_coef_SH.col(inc);
+    }
+    // the objects one at a time, whose sums are the cross sections from the couplings
+    for(int j = gran1; j < gran2; ++j) {
+      extCS_FF_objects(j * nInc + inc) = result.getExtinctionCrossSection(j, j + 1);
+      if(run.farFieldCrossSection)
+        continue;
+      scaCS_FF_objects(j * nInc + inc) = result.getScatteringCrossSection(j, j + 1);
+      if(run.excitation->SH_cond)
+        scaCS_SH_objects(j * nInc + inc) = result.getScatteringCrossSection_SH(j, j + 1);
+    }
+    auto const total = [&](Vector<double> const &objects) {
+      double sum = 0;
+      for(int j = gran1; j < gran2; ++j)
+        sum += objects(j * nInc + inc);
+      return sum;
+    };
+    if(run.excitation->SH_cond)
+      scaCS_SH_vec(inc) =
+          run.farFieldCrossSection ?
+              result.getFarFieldCrossSection(sphere, sphere_weights, gran1, gran2, true) :
+              total(scaCS_SH_objects);
+    scaCS_FF_vec(inc) =
+        run.farFieldCrossSection ?
+            result.getFarFieldCrossSection(sphere, sphere_weights, gran1, gran2, false) :
+            total(scaCS_FF_objects);
+    extCS_FF_vec(inc) = total(extCS_FF_objects);
+
+    if(run.patternTheta > 0 && communicator().rank() == communicator().root_id()) {
+      std::vector<SphericalP<std::complex<double>>> patterns[4];
+      result.getFarField(directions, patterns[0], patterns[1], patterns[2], patterns[3]);
+      std::string const path = "step" + std::to_string(i) + "/incidence" + std::to_string(inc);
+      char const *names[4] = {"/E_FF", "/H_FF", "/E_SH", "/H_SH"};
+      for(int k = 0; k < (run.excitation->SH_cond ? 4 : 2); k++) {
+        // the x, y and z components of each direction
+        std::vector<t_complex> values;
+        for(auto const &value : patterns[k])
+          values.insert(values.end(), {value.rrr, value.the, value.phi});
+        auto const dataset = path + names[k];
+        writer.push([&oPattern, dataset, values]() {
+          std::lock_guard<std::mutex> const lock(Output::mutex());
+          oPattern.writeComplex(dataset, values.data(), values.size() / 3, 3);
+        });
+      }
+    }
   }
-    
-  }// if
-
 
- else if (size > NO)  {  // if the number of processes is more than numb of part
-
-     if (rank<NO){     
-     
-     gran1 = rank;
-
-     gran2 = rank + 1;
-
-     if(run.excitation->SH_cond)
-     scaCS_SH = result.getScatteringCrossSection_SH(gran1, gran2);
-     
-     scaCS_FF = result.getScatteringCrossSection(gran1, gran2);
-     extCS_FF = result.getExtinctionCrossSection(gran1, gran2);
-
-   }//if
-    
+  // sums over the processes, one entry per incidence or per object and incidence
+  auto const reduce = [&](Vector<double> &cs) {
+    if(communicator().rank() == communicator().root_id())
+      MPI_Reduce(MPI_IN_PLACE, cs.data(), cs.size(), MPI_DOUBLE, MPI_SUM, 0, *communicator());
+    else
+      MPI_Reduce(cs.data(), nullptr, cs.size(), MPI_DOUBLE, MPI_SUM, 0, *communicator());
+  };
+  if(run.excitation->SH_cond)
+    reduce(scaCS_SH_vec);
+  reduce(scaCS_FF_vec);
+  reduce(extCS_FF_vec);
+  reduce(extCS_FF_objects);
+  if(not run.farFieldCrossSection) {
+    reduce(scaCS_FF_objects);
     if(run.excitation->SH_cond)
-    MPI_Gather(&scaCS_SH, 1, MPI_DOUBLE, &scaCS_SH_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    
-    MPI_Gather(&scaCS_FF, 1, MPI_DOUBLE, &scaCS_FF_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Gather(&extCS_FF, 1, MPI_DOUBLE, &extCS_FF_vec(0), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
-
-      if(communicator().rank() == communicator().root_id()) {
+      reduce(scaCS_SH_objects);
+  }
+  Profile::time("cross sections",
+                duration<t_real>(steady_clock::now() - cross_sections_start).count());
+
+  // |E| at the probes for each incidence, FF then SH
+  if(oProbes.is_open()) {
+    Profile::Region const timer("probes");
+    std::ostringstream line;
+    line << std::setprecision(10) << lam;
+    for(t_uint inc = 0; inc < nInc; ++inc) {
+      Result result(run.geometry, nInc == 1 ? run.excitation : run.excitation->incidence(inc));
+      result.scatter_coef = scatter_coef.col(inc);
+      result.internal_coef = internal_coef.col(inc);
+      if(run.excitation->SH_cond) {
+        result.scatter_coef_SH = scatter_coef_SH.col(inc);
+        result.internal_coef_SH = internal_coef_SH.col(inc);
+      }
+      std::vector<SphericalP<std::complex<double>>> EField_FF, HField_FF, EField_SH, HField_SH;
+      result.getFields(probes, run.projection, CLGcoeff, EField_FF, HField_FF, EField_SH,
+                       HField_SH);
+      auto const magnitude = [](SphericalP<std::complex<double>> const &field) {
+        return std::sqrt(std::norm(field.rrr) + std::norm(field.the) + std::norm(field.phi));
+      };
+      for(std::size_t k = 0; k < EField_FF.size(); ++k) {
+        line << "\t" << magnitude(EField_FF[k]);
+        if(run.excitation->SH_cond)
+          line << "\t" << magnitude(EField_SH[k]);
+      }
+    }
+    line << "\n";
+    auto const text = line.str();
+    writer.push([&oProbes, text]() { oProbes << text; });
+  }
 
-      outASec_FF << lam << "\t" << extCS_FF_vec.sum() - scaCS_FF_vec.sum() << std::endl;
-      outSSec_FF << lam << "\t" << scaCS_FF_vec.sum()<< std::endl;
+  if(mapped.count(i))
+    write_fields(i, scatter_coef, internal_coef, scatter_coef_SH, internal_coef_SH);
+  if(run.fieldMaxima) {
+    // the last step is a maximum if both its neighbours scatter less, averaged over the incidences
+    double sigma = scaCS_FF_vec(0);
+    if(nInc > 1) {
+      sigma = 0;
+      for(t_uint inc = 0; inc < nInc; ++inc)
+        sigma += run.excitation->weight(inc) * scaCS_FF_vec(inc);
+    }
+    sigma = communicator().broadcast(sigma);
+    if(peak_step == i - 1 and rise_step == i - 2 and peak_sigma > rise_sigma and
+       peak_sigma > sigma and not mapped.count(peak_step)) {
+      if(communicator().is_root())
+        std::cout << "Field maps at the maximum at Lambda = " << lami + peak_step * lams
+                  << std::endl;
+      run.excitation->updateWavelength(lami + peak_step * lams);
+      run.geometry->update(run.excitation);
+      write_fields(peak_step, peak_coef, peak_internal, peak_coef_SH, peak_internal_SH);
+      run.excitation->updateWavelength(lam);
+      run.geometry->update(run.excitation);
+    }
+    rise_step = peak_step;
+    rise_sigma = peak_sigma;
+    peak_step = i;
+    peak_sigma = sigma;
+    peak_coef = scatter_coef;
+    peak_internal = internal_coef;
+    peak_coef_SH = scatter_coef_SH;
+    peak_internal_SH = internal_coef_SH;
+  }
 
-      if(run.excitation->SH_cond)
-      outSSec_SH << lam << "\t" << scaCS_SH_vec.sum() << std::endl;
-      //std::cout<<scaCS_FF_vec.sum()<<std::endl;
-      //std::cout<<scaCS_SH_vec.sum()<<std::endl;
-    
-      }
+  if(communicator().is_root()) {
+    std::vector<double> record = {static_cast<double>(i), lam};
+    for(auto const cs : {&extCS_FF_vec, &scaCS_FF_vec, &scaCS_SH_vec})
+      record.insert(record.end(), cs->data(), cs->data() + nInc);
+    std::vector<double> objects = {static_cast<double>(i)};
+    for(auto const cs : {&extCS_FF_objects, &scaCS_FF_objects, &scaCS_SH_objects})
+      objects.insert(objects.end(), cs->data(), cs->data() + cs->size());
+    if(streamed)
+      write_record(record.data(), objects.data());
+    else {
+      records.insert(records.end(), record.begin(), record.end());
+      object_records.insert(object_records.end(), objects.begin(), objects.end());
+    }
+    if(run.checkpointEvery > 0) {
+      pending.emplace_back(i, record, objects, scatter_coef, scatter_coef_SH);
+      if(pending.size() >= run.checkpointEvery)
+        flush();
+    }
+  }
 
-      
-}// else if
+   }// for
+   base += level.size() + groups;
+
+   // the cross sections of the level, with those of the earlier run
+   auto const gather = [&](std::vector<double> &rows, std::size_t size,
+                           std::map<int, std::vector<double>> &by_step) {
+     int const count = rows.size();
+     std::vector<int> counts(all.size()), displs(all.size() + 1, 0);
+     MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, all.root_id(), *all);
+     for(t_uint r = 0; r < all.size(); ++r)
+       displs[r + 1] = displs[r] + counts[r];
+     std::vector<double> gathered(writes ? displs.back() : 0);
+     MPI_Gatherv(rows.data(), count, MPI_DOUBLE, gathered.data(), counts.data(), displs.data(),
+                 MPI_DOUBLE, all.root_id(), *all);
+     for(std::size_t k = 0; k < gathered.size(); k += size)
+       by_step[gathered[k]].assign(gathered.begin() + k, gathered.begin() + k + size);
+     rows.clear();
+   };
+   if(not streamed) {
+     gather(records, width, finished);
+     gather(object_records, objects_width, finished_objects);
+   }
 
-}// for
+   // the steps where the cross sections bend, decided by the root of all the groups
+   Vector<t_int> refined;
+   if(writes and run.adaptiveLevels > 0) {
+     auto const steps = refinement(finished, run.adaptiveTolerance);
+     refined = Eigen::Map<Vector<t_int> const>(steps.data(), steps.size());
+     if(not steps.empty())
+       std::cout << "Refining the scan at " << steps.size() << " wavelengths" << std::endl;
+   }
+   refined = all.broadcast(refined);
+   level.assign(refined.data(), refined.data() + refined.size());
+  }
+  if(communicator().is_root())
+    flush();
 
+  // in the order of the wavelengths
+  if(not streamed)
+    for(auto const &step : finished)
+      write_record(step.second.data(), finished_objects.count(step.first) ?
+                                           finished_objects[step.first].data() :
+                                           nullptr);
+  writer.flush();
+  spectra.close();
 
-  if(communicator().rank() == communicator().root_id()) {
+  if(writes) {
 
     outASec_FF.close();
     outSSec_FF.close();
@@ -507,11 +1982,250 @@ void Simulation::scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolv
     outASec_SH.close();
    }
   }
+  if(run.patternTheta > 0 && communicator().rank() == communicator().root_id()) {
+    // the steps in the file, including those of an earlier run
+    std::vector<double> pattern_lambda, pattern_steps;
+    for(int i = 0; i < steps; i++)
+      if(oPattern.exists("step" + std::to_string(i))) {
+        pattern_lambda.push_back(lami + i * lams);
+        pattern_steps.push_back(i);
+      }
+    oPattern.writeReal("wavelength", pattern_lambda.data(), pattern_lambda.size());
+    // the steps solved by this group
+    if(next)
+      oPattern.writeReal("step", pattern_steps.data(), pattern_steps.size());
+    oPattern.close();
+  }
 }
 #endif
 
 int Simulation::done() {
-  // Placeholder method. Not needed at the moment.
-  return 0;
+  if(dry_run())
+    return 0;
+  // the time and memory of each region on all the processes
+#ifdef OPTIMET_MPI
+  auto const summary = Profile::summary(communicator());
+  if(not communicator().is_root())
+    return 0;
+#else
+  auto const summary = Profile::summary();
+#endif
+  if(summary.empty())
+    return 0;
+  std::cout << "\nTimings and memory over the processes" << std::endl;
+  Profile::write_table(std::cout, summary);
+  std::ostringstream roofline;
+  Profile::write_roofline(roofline, summary, peak_gflops_, peak_bandwidth_);
+  if(not roofline.str().empty())
+    std::cout << "\nRoofline of the counted regions, per process" << std::endl << roofline.str();
+  std::ofstream json(caseFile + "_Timings.json");
+  Profile::write_json(json, summary);
+  return json ? 0 : 1;
+}
+
+void Simulation::memory_estimate(Run &run) const {
+  auto &geometry = *run.geometry;
+  t_real const processes = communicator().size();
+  t_real const nobj = geometry.objects.size();
+  t_real const nMax = geometry.nMax(), nMaxS = geometry.nMaxS();
+  t_real const pMax = nMax * (nMax + 2), pMaxS = nMaxS * (nMaxS + 2);
+  bool const SH = run.excitation->SH_cond;
+  t_real const complex = sizeof(t_complex);
+
+  // the largest arrays of the process holding the most, in bytes
+  std::vector<std::pair<std::string, t_real>> sizes;
+  t_real const sizeCF = geometry.couplings(geometry.nMax(), geometry.nMaxS()).size();
+  sizes.emplace_back("CLG tables", run.onthefly_tables ? 0.0 :
+                     9 * sizeof(double) * (sizeCF + std::ceil(sizeCF / processes)));
+  // T and RgQ of each object, side by side in the solver, and of each distinct particle in its
+  // cache
+  std::set<std::string> keys, keysSH;
+  for(auto const &object : geometry.objects) {
+    keys.insert(object.TmatrixKey(geometry.bground, run.excitation->omega(), false));
+    if(SH)
+      keysSH.insert(object.TmatrixKey(geometry.bground, run.excitation->omega(), true));
+  }
+  sizes.emplace_back("T-matrices", complex * 2 * (2 * pMax) * (2 * pMax) * (nobj + keys.size()));
+  if(SH)
+    sizes.emplace_back("SH T-matrices",
+                       complex * 2 * (2 * pMaxS) * (2 * pMaxS) * (nobj + keysSH.size()));
+  bool meshes = false;
+  for(auto const &object : geometry.objects)
+    meshes = meshes or object.kind() == Scatterer::arbitrary_shape;
+  // the rows of Q and RgQ, then both gathered
+  auto const pLarge = SH ? std::max(pMax, pMaxS) : pMax;
+  if(meshes)
+    sizes.emplace_back("T-matrix integrals", complex * 4 * (2 * pLarge) * (2 * pLarge));
+  // distributed with its factorisation, the iterative solvers holding less
+  auto const rows = 2 * pMax * nobj, rowsS = 2 * pMaxS * nobj;
+  sizes.emplace_back("scattering matrix", complex * 2 * rows * rows / processes);
+  if(SH)
+    sizes.emplace_back("SH scattering matrix", complex * 2 * rowsS * rowsS / processes);
+  if(run.outputType == 0) {
+    // 12 values per point and 6 per part, computed, then owned and unpacked by their writer
+    t_real const points = run.params[2] * run.params[5] * run.params[8];
+#ifdef H5_HAVE_PARALLEL
+    t_real const owned = std::ceil(points / processes);
+#else
+    t_real const owned = points;
+#endif
+    t_real const values = 12 + 6 * run.fieldParts.size();
+    sizes.emplace_back("field values",
+                       complex * values * (std::ceil(points / processes) + 2 * owned));
+  }
+
+  if(communicator().rank() != communicator().root_id())
+    return;
+  std::size_t width = 5;
+  for(auto const &size : sizes)
+    width = std::max(width, size.first.size());
+  t_real total = 0;
+  std::cout << "Predicted memory of a process in MB\n";
+  for(auto const &size : sizes) {
+    std::cout << std::left << std::setw(width) << size.first << std::right << std::setw(14)
+              << std::fixed << std::setprecision(1) << size.second / (1024 * 1024) << "\n";
+    total += size.second;
+  }
+  std::cout << std::left << std::setw(width) << "total" << std::right << std::setw(14)
+            << total / (1024 * 1024) << std::endl;
+}
+
+void Simulation::plan_solver(Run &run) const {
+  if(not run.solver_plan)
+    return;
+  auto &geometry = *run.geometry;
+  t_real const processes = communicator().size();
+  t_real const nobj = geometry.objects.size();
+  t_real const complex = sizeof(t_complex);
+  // a rough model: each process sustains a GFlop/s, each iterative solve takes 100 products
+  t_real const rate = 1e9, products = 100, leaf = geometry.get_FMMleaf();
+  std::vector<t_real> harmonics{t_real(geometry.nMax())};
+  if(run.excitation->SH_cond)
+    harmonics.push_back(geometry.nMaxS());
+
+  // the smallest gap between the circumscribed spheres, relative to the smaller radius, found
+  // by the root alone
+  t_real gap = std::numeric_limits<t_real>::max();
+  if(communicator().rank() == communicator().root_id() and nobj <= 20000)
+    for(t_uint ii = 0; ii < geometry.objects.size(); ++ii) {
+      auto Ri = Tools::toCartesian(geometry.objects[ii].vR);
+      auto const ri = geometry.objects[ii].radius;
+      for(t_uint jj = ii + 1; jj < geometry.objects.size(); ++jj) {
+        auto const rj = geometry.objects[jj].radius;
+        auto Rij = Ri - Tools::toCartesian(geometry.objects[jj].vR);
+        gap = std::min(gap, (std::sqrt(Rij * Rij) - ri - rj) / std::min(ri, rj));
+      }
+    }
+#ifdef OPTIMET_MPI
+  gap = communicator().broadcast(gap);
+#endif
+  bool const touching = gap < 0.1;
+  // the Krylov basis of the GCRO-DR solves of the Belos build, which recycle a subspace from one
+  // solve to the next
+#ifdef OPTIMET_BELOS
+  bool const belos = true;
+  t_real const krylov = run.belos_params->get<int>("Num Blocks", 250);
+#else
+  bool const belos = false;
+  t_real const krylov = 0;
+#endif
+  t_real const recycled = std::min<t_real>(geometry.get_recycle(), products / 2);
+
+  // memory of a process in bytes and time in seconds, summed over the FF and SH systems
+  struct Cost {
+    std::string name;
+    bool possible;
+    t_real memory, time;
+  };
+  std::vector<Cost> costs{{"dense", true, 0, 0},
+                          {"ACA", not touching and nobj > 1, 0, 0},
+                          {"matrix-free", nobj > 1, 0, 0},
+                          {"matrix-free without cache", nobj > 1, 0, 0},
+                          {"FMM", nobj >= 64, 0, 0},
+                          {"Belos GCRO-DR", belos and nobj > 1, 0, 0}};
+  for(auto const nMax : harmonics) {
+    // a block of T-matrix, a factorised coupling, and the blocks of the compressed rows of a scatterer
+    t_real const block = 2 * nMax * (nMax + 2), coupling = 4 * nMax * nMax * nMax;
+    t_real const N = block * nobj, compressed = block * (8 + 4 * std::log2(std::max(nobj, 2.0)));
+    t_real const Tmatrices = complex * block * block * nobj;
+    costs[0].memory += complex * 2 * N * N / processes;
+    costs[0].time += (8 * nobj * nobj * block * block * block + 8. / 3. * N * N * N) / processes;
+    costs[1].memory +=
+        Tmatrices + (geometry.get_ACAsingle() ? complex / 2 : complex) * N * compressed / processes;
+    costs[1].time += 8 * N * compressed * (coupling / block + products) / processes;
+    costs[2].memory += Tmatrices + complex * coupling * nobj * nobj / processes;
+    costs[2].time += 8 * products * nobj * (nobj * coupling + block * block) / processes;
+    costs[3].memory += Tmatrices;
+    costs[3].time += 8 * products * nobj * (5 * nobj * coupling + block * block) / processes;
+    costs[4].memory += Tmatrices + complex * 27 * leaf * coupling * nobj / processes;
+    costs[4].time += 8 * products * nobj *
+                     (27 * leaf * coupling + 2 * block * block * std::log2(std::max(nobj, 2.0))) /
+                     processes;
+    // the cached couplings of the matrix-free solver, and the Krylov and recycled bases
+    costs[5].memory += Tmatrices + complex * coupling * nobj * nobj / processes +
+                       complex * N * (krylov + 2 * geometry.get_recycle()) / processes;
+    costs[5].time += 8 * (products - recycled) * nobj * (nobj * coupling + block * block) /
+                     processes;
+  }
+  for(auto &cost : costs)
+    cost.time /= rate;
+
+  // a solver asked for by the case is kept, as is the dense solver of a periodic lattice
+  std::string chosen;
+  bool given = geometry.get_ACAcond() or geometry.get_FMMcond() or
+               geometry.get_matrixfreecond() or not run.parallel_params.scratch.empty() or
+               not geometry.get_periodic().empty();
+#ifdef OPTIMET_BELOS
+  given = given or run.belos_params->get<std::string>("Solver") != "scalapack";
+#endif
+  if(given)
+    chosen = "given by the case";
+  else {
+    t_real const budget = t_real(run.solver_memory) * 1024 * 1024;
+    auto best = costs.end();
+    for(auto cost = costs.begin(); cost != costs.end(); ++cost)
+      if(cost->possible and cost->memory <= budget and
+         (best == costs.end() or cost->time < best->time))
+        best = cost;
+    // nothing fits: the smallest
+    if(best == costs.end())
+      for(auto cost = costs.begin(); cost != costs.end(); ++cost)
+        if(cost->possible and (best == costs.end() or cost->memory < best->memory))
+          best = cost;
+    chosen = best->name;
+    auto const index = best - costs.begin();
+    if(index == 1)
+      geometry.ACAcompression(true, geometry.get_ACAtolerance(), geometry.get_ACArecompress(),
+                              geometry.get_ACAsingle());
+    else if(index == 2 or index == 3)
+      geometry.matrixFree(true, index == 2);
+    else if(index == 4) {
+      run.do_fmm = true;
+      geometry.fastMultipole(true, geometry.get_FMMleaf(), geometry.get_FMMdigits());
+    }
+#ifdef OPTIMET_BELOS
+    else if(index == 5) {
+      geometry.matrixFree(false, true);
+      run.belos_params->set("Solver", "GCRODR");
+    }
+#endif
+    // nearly touching scatterers slow the iterative solvers down unless preconditioned together
+    if(index > 0 and touching and not(geometry.get_nearfieldgap() > 0))
+      geometry.nearFieldPreconditioner(0.5, geometry.get_nearfieldsize());
+  }
+
+  if(communicator().rank() != communicator().root_id())
+    return;
+  std::cout << "Predicted cost of the solvers, per process\n";
+  for(auto const &cost : costs) {
+    std::cout << std::left << std::setw(26) << cost.name << std::right;
+    if(cost.possible)
+      std::cout << std::setw(14) << std::fixed << std::setprecision(1)
+                << cost.memory / (1024 * 1024) << " MB" << std::setw(14) << std::scientific
+                << std::setprecision(2) << cost.time << " s\n";
+    else
+      std::cout << std::setw(17) << "unsuited" << "\n";
+  }
+  std::cout << "Solver: " << chosen << std::defaultfloat << std::endl;
 }
 }
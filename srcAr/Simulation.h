@@ -18,15 +18,24 @@
 #define SIMULATION_H_
 
 #include "mpi/Communicator.h"
+#include "mpi/SharedArray.h"
+#include "Types.h"
+#include <array>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace optimet {
+class OutputGrid;
+class Result;
 class Run;
+class Writer;
 namespace solver {
 class AbstractSolver;
 }
+namespace mpi {
+class Counter;
+}
 /**
  * The Simulation class implements a full simulation.
  * A Simulation object will create a set of Cases and Requests based
@@ -54,8 +63,9 @@ public:
   int run();
 
   /**
-   * Finishes a simulation.
-   * Placeholder method. Not needed at the moment.
+   * Finishes a simulation, printing the time spent in each region of the
+   * computation and writing it to caseFile_Timings.json.
+   * Collective over the processes of the simulation.
    * @return 0 if succesful, 1 otherwise.
    */
   int done();
@@ -66,16 +76,110 @@ public:
     return *this;
   }
 
+  //! Whether a scan skips the wavelengths found in its checkpoints
+  bool resume() const { return resume_; }
+  Simulation &resume(bool r) {
+    resume_ = r;
+    return *this;
+  }
+  //! Whether run() only predicts the memory of the simulation, without running it
+  bool dry_run() const { return dry_run_; }
+  Simulation &dry_run(bool d) {
+    dry_run_ = d;
+    return *this;
+  }
+
 protected:
+  //! \brief Prints the memory the largest arrays of the simulation will take on a process
+  //! \details The sizes follow from the input alone: nothing is computed.
+  void memory_estimate(Run &run) const;
+  //! \brief Chooses the solver of the scattering matrix from the predicted cost of each
+  //! \details Dense, ACA, matrix-free or FMM, the fastest of those fitting run.solver_memory. A
+  //! case asking for a solver or a periodic lattice keeps it. The choice is printed by the root.
+  void plan_solver(Run &run) const;
   #ifdef OPTIMET_MPI
-  void scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolver> solver);
+  //! \brief Solves at each wavelength of the scan, writing the cross sections
+  //! \details With a counter, the steps are fetched from it one at a time, the processes of this
+  //! simulation being one group among several sharing the scan. The cross sections are then
+  //! gathered by the root of the counter's communicator once all the steps are done. The group
+  //! number tells the radiation patterns of each group apart.
+  void scan_wavelengths(Run &run, std::shared_ptr<solver::AbstractSolver> solver,
+                        mpi::Counter const *next = nullptr, t_uint group = 0);
+  //! \brief Scans the wavelengths with the processes split into run.scanGroups groups
+  //! \details Each group has its own communicator, BLACS context and solver, and solves the
+  //! wavelengths it is handed out whole.
+  void scan_groups(Run &run);
+  //! \brief Splits the processes into groups of contiguous ranks, returning the group of this one
+  //! \details The communicator and BLACS context of the run become those of the group.
+  t_uint split_groups(Run &run, t_uint groups) const;
+  //! \brief Solves each configuration of run.ensemble at each wavelength of the scan
+  //! \details The processes are split into run.ensembleGroups groups, each with one solver kept
+  //! over the configurations it is handed out. The root writes the cross sections of each
+  //! configuration to caseFile_Ensemble.dat and their means to caseFile_EnsembleMean.dat.
+  void ensemble(Run &run);
+  //! \brief Writes the cross sections averaged over the orientations at each wavelength
+  //! \details From the trace and norm of the T-matrix of the cluster, to caseFile_AverageCS.dat.
+  void average_wavelengths(Run &run);
+  //! \brief Writes the cross sections of each order of a convergence study at each wavelength
+  //! \details The T-matrices of the highest order are computed once per wavelength and truncated
+  //! to the lower ones, to caseFile_Convergence.dat.
+  void convergence(Run &run);
   void field_simulation(Run &run, std::shared_ptr<solver::AbstractSolver> solver);
+  //! \brief Writes the fields of the coefficients of the result on a grid to name_FF.h5 and name_SH.h5
+  //! \details Collective over the communicator, the grid as in Run::gridType, Run::params and
+  //! Run::gridPoints for a field output. Without parallel HDF5 the root writes the files, in the
+  //! background if given a writer.
+  void field_map(Run const &run, Result &result, std::vector<double *> const &CLGcoeff, int type,
+                 std::array<t_real, 9> const &params,
+                 std::shared_ptr<std::vector<t_real> const> const &coordinates,
+                 std::string const &name, Writer *writer = nullptr);
+  //! \brief Sends the fields of the pieces computed by each process to the process owning them
+  //! \details Process r owns the points owners[r] to owners[r + 1] - 1. The pieces are the
+  //! increasing ranges of points [first, end) of this process, and the fields hold the given
+  //! values per point, 12 and 6 per part of the fields, in the order of the pieces.
+  //! Returns the fields of the points owned here.
+  std::vector<t_complex> field_ranges(std::vector<std::pair<int, int>> const &pieces,
+                                      std::vector<t_complex> const &fields,
+                                      std::vector<int> const &owners, int values = 12) const;
+  //! \brief Writes the statistics of the fields of a map to name_Statistics.dat
+  //! \details Collective over the communicator, from the pieces computed by each process as for
+  //! field_ranges, the points outside the objects reduced without gathering the fields.
+  void field_statistics(Run const &run, OutputGrid const &grid,
+                        std::vector<std::pair<int, int>> const &pieces,
+                        std::vector<t_complex> const &fields, int values,
+                        std::string const &name) const;
   void All2all(std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par, int sizeVec);
+  //! \brief Allocates the CLG tables once per node, in MPI-3 shared memory windows
+  //! \details The windows are kept until the next call.
+  std::vector<double *> shared_tables(int sizeCF);
+  //! Gathers the slices of the CLG tables into the shared windows of each node
+  void All2all_shared(std::vector<double *> CLGcoeff, std::vector<double *> CLGcoeff_par, int gran1,
+                      int sizeVec);
+  //! Reads the CLG tables from the library of the run, false if it does not hold them
+  bool load_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF);
+  //! Adds the CLG tables to the library of the run, if any
+  void save_tables(Run const &run, std::vector<double *> CLGcoeff, int sizeCF);
+  //! \brief Writes the coefficients of a solve to caseFile_Coefficients.h5
+  //! \details With the wavelength, the incidence, the harmonics and the positions of the objects.
+  void save_coefficients(Run const &run, Result const &result) const;
+  //! \brief Reads the coefficients of run.coefficientsFile into the result
+  //! \details Fails if they were solved for another wavelength, incidence or geometry.
+  void load_coefficients(Run const &run, Result &result) const;
   #endif
 private:
   std::string caseFile; /**< Name of the case without extensions. */
   //! \details Fake if not compiled with MPI
   mpi::Communicator communicator_;
+  //! Whether a scan skips the wavelengths found in its checkpoints
+  bool resume_ = false;
+  //! Whether run() only predicts the memory of the simulation
+  bool dry_run_ = false;
+  //! Peak GFLOP/s and GB/s of a process, for the roofline printed by done()
+  t_real peak_gflops_ = 0, peak_bandwidth_ = 0;
+  #ifdef OPTIMET_MPI
+  //! The CLG tables shared by the processes of a node, if any
+  std::vector<mpi::SharedArray> CLGshared_;
+  #endif
 };
 }
 #endif /* SIMULATION_H_ */
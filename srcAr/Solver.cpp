@@ -26,6 +26,37 @@
 namespace optimet {
 namespace solver {
 
+void AbstractSolver::solve_incidences(Matrix<t_complex> &X_sca_, Matrix<t_complex> &X_int_,
+                                      Matrix<t_complex> &X_sca_SH, Matrix<t_complex> &X_int_SH,
+                                      std::vector<double *> CGcoeff) {
+  auto const excitation = incWave;
+  auto const nInc = excitation->nIncidences();
+  Vector<t_complex> sca, inter, sca_SH, inter_SH;
+  Matrix<t_complex> sources;
+  for(t_uint i = 0; i < nInc; ++i) {
+    // the solver is already up to date with the first incidence
+    if(i > 0)
+      update(geometry, excitation->incidence(i));
+    solve(sca, inter, sca_SH, inter_SH, CGcoeff);
+    if(i == 0) {
+      X_sca_.resize(sca.size(), nInc);
+      X_int_.resize(inter.size(), nInc);
+      X_sca_SH.resize(sca_SH.size(), nInc);
+      X_int_SH.resize(inter_SH.size(), nInc);
+      sources.resize(sources_.cols() == 1 ? sources_.rows() : 0, nInc);
+    }
+    X_sca_.col(i) = sca;
+    X_int_.col(i) = inter;
+    X_sca_SH.col(i) = sca_SH;
+    X_int_SH.col(i) = inter_SH;
+    if(sources_.cols() == 1 and sources_.rows() == sources.rows())
+      sources.col(i) = sources_.col(0);
+  }
+  if(nInc > 1)
+    update(geometry, excitation);
+  sources_ = sources;
+}
+
 
 std::shared_ptr<AbstractSolver> factory(Run const &run) {
 
@@ -66,7 +97,7 @@ Vector<t_complex> convertInternal(Vector<t_complex> const &scattered, Matrix<t_c
     
     Qmatsingle = RgQ.block(0, ii*N, N, N);
 
-    result.segment(ii*N, N) = Qmatsingle.inverse() * scattered.segment(ii*N, N);
+    result.segment(ii*N, N) = Qmatsingle.partialPivLu().solve(scattered.segment(ii*N, N));
 }   
   return result;
 }
@@ -116,7 +147,7 @@ Vector<t_complex> convertInternal_SH(Vector<t_complex> const &scattered, Vector<
 
     Qmatsingle = RgQ.block(0, ii*N, N, N);
    
-    result.segment(ii*N, N) = Qmatsingle.inverse()*((-consCi/k_b_SH)*scattered.segment(ii*N, N) + K_1.segment(ii*N, N));
+    result.segment(ii*N, N) = Qmatsingle.partialPivLu().solve((-consCi/k_b_SH)*scattered.segment(ii*N, N) + K_1.segment(ii*N, N));
   
  } 
    
@@ -30,6 +30,7 @@
 #include "scalapack/Parameters.h"
 #include <complex>
 #include <exception>
+#include <limits>
 #include <memory>
 
 #ifdef OPTIMET_BELOS
@@ -86,6 +87,16 @@ public:
    */
   virtual void solve(Vector<t_complex> &X_sca_, Vector<t_complex> &X_int_, Vector<t_complex> &X_sca_SH, 
                     Vector<t_complex> &X_int_SH, std::vector<double *> CGcoeff) const = 0;
+  /**
+   * Solves for all the incidences of the excitation, one column per incidence.
+   * By default, the solver is updated for each incidence in turn, and finally
+   * for the excitation itself.
+   * @param X_sca_ the return matrix for the scattered coefficients.
+   * @param X_int_ the return matrix for the internal coefficients.
+   */
+  virtual void solve_incidences(Matrix<t_complex> &X_sca_, Matrix<t_complex> &X_int_,
+                                Matrix<t_complex> &X_sca_SH, Matrix<t_complex> &X_int_SH,
+                                std::vector<double *> CGcoeff);
   /**
    * Update method for the Solver class.
    * @param geometry_ the geometry of the simulation.
@@ -96,6 +107,8 @@ public:
   update(std::shared_ptr<Geometry> geometry_, std::shared_ptr<Excitation const> incWave_) {
     geometry = geometry_;
     incWave = incWave_;
+    origin_->clear();
+    sources_.resize(0, 0);
     update();
   }
   void update(Run const &run) { return update(run.geometry, run.excitation); }
@@ -103,6 +116,35 @@ public:
   //! \details Because that's how the original implementation rocked.
   virtual void update() = 0;
 
+  /**
+   * Initial guesses of the iterative solvers for the next solves.
+   * Typically the solution at a neighbouring wavelength. The direct solvers ignore them.
+   * @param X_sca_ the scattered coefficients, one column per incidence, empty to start from zero.
+   * @param X_sca_SH the scattered SH coefficients, likewise.
+   */
+  void initial_guess(Matrix<t_complex> const &X_sca_, Matrix<t_complex> const &X_sca_SH) {
+    guess_ = X_sca_;
+    guess_SH_ = X_sca_SH;
+  }
+
+  /**
+   * Solves the fundamental frequency within the span of given scattered coefficients, typically
+   * the solutions at other wavelengths of a scan. The system is applied once to each of them and
+   * their combination with the least residual is kept, for all the incidences.
+   * @param basis the scattered coefficients, one per column.
+   * @param X_sca_ the return matrix for the scattered coefficients.
+   * @param X_int_ the return matrix for the internal coefficients.
+   * @return the largest residual relative to the source vector of its incidence, infinite if
+   * this solver cannot project its system.
+   */
+  virtual t_real solve_reduced(Matrix<t_complex> const &basis, Matrix<t_complex> &X_sca_,
+                               Matrix<t_complex> &X_int_) const {
+    (void)basis;
+    (void)X_sca_;
+    (void)X_int_;
+    return std::numeric_limits<t_real>::infinity();
+  }
+
   //! Converts back to the scattered result from the indirect calculation
   Vector<t_complex> convertIndirect(Vector<t_complex> const &scattered, Matrix<t_complex> const &Tmat) const {
     return optimet::convertIndirect(scattered, Tmat, incWave->omega(), geometry->bground,
@@ -136,12 +178,24 @@ public:
   }
 
   mpi::Communicator const &communicator() const { return communicator_; }
+  //! \brief Couplings from the origin computed by the last update and solve
+  //! \details The cross sections look them up rather than computing them again.
+  std::shared_ptr<OriginCouplings> origin_couplings() const { return origin_; }
+  //! \brief FF source vectors of the last solve, one column per incidence, empty if not kept
+  //! \details The incident coefficients about each object, which the extinction reuses.
+  Matrix<t_complex> const &sources() const { return sources_; }
 
 protected:
   std::shared_ptr<Geometry> geometry;        /**< Pointer to the geometry. */
   std::shared_ptr<Excitation const> incWave; /**< Pointer to the incoming excitation. */
   mpi::Communicator communicator_;
   t_uint nMax;
+  Matrix<t_complex> guess_;                     /**< Initial guess of the scattered coefficients. */
+  Matrix<t_complex> guess_SH_;                  /**< Initial guess of the scattered SH coefficients. */
+  //! Couplings from the origin of the source vectors, kept until the next update
+  std::shared_ptr<OriginCouplings> origin_ = std::make_shared<OriginCouplings>();
+  //! FF source vectors of the last solve
+  mutable Matrix<t_complex> sources_;
 };
 
 //! A factory function for solvers
@@ -0,0 +1,64 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "SolverStatistics.h"
+#include <limits>
+
+namespace optimet {
+namespace {
+std::vector<KrylovRecord> &all_records() {
+  static std::vector<KrylovRecord> records;
+  return records;
+}
+t_real &compression() {
+  static t_real compression = 0;
+  return compression;
+}
+}
+
+void SolverStatistics::record(KrylovRecord record) {
+  record.compression = compression();
+  all_records().push_back(std::move(record));
+}
+
+void SolverStatistics::operator_memory(t_real memory, t_uint rows) {
+  compression() = rows > 0 ? memory / (static_cast<t_real>(rows) * rows * (16.0 / 1e6)) : 0;
+}
+
+std::vector<KrylovRecord> const &SolverStatistics::records() { return all_records(); }
+
+void SolverStatistics::clear() {
+  all_records().clear();
+  compression() = 0;
+}
+
+void SolverStatistics::write_json(std::ostream &stream, t_int step, t_real wavelength) {
+  auto const precision = stream.precision(std::numeric_limits<t_real>::max_digits10);
+  for(auto const &record : all_records()) {
+    stream << "{\"step\": " << step << ", \"wavelength\": " << wavelength << ", \"method\": \""
+           << record.method << "\", \"rows\": " << record.rows
+           << ", \"iterations\": " << record.iterations
+           << ", \"compression\": " << record.compression << ", \"time\": {\"product\": "
+           << record.product << ", \"orthogonalization\": " << record.orthogonalization
+           << ", \"communication\": " << record.communication << "}, \"residuals\": [";
+    for(std::size_t i = 0; i < record.residuals.size(); ++i)
+      stream << (i > 0 ? ", " : "") << record.residuals[i];
+    stream << "]}\n";
+  }
+  stream.precision(precision);
+  stream.flush();
+}
+}
@@ -0,0 +1,61 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_SOLVER_STATISTICS_H
+#define OPTIMET_SOLVER_STATISTICS_H
+
+#include "Types.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace optimet {
+
+//! Convergence and timings of one iterative solve
+struct KrylovRecord {
+  std::string method;             /**< The Krylov method. */
+  t_uint rows;                    /**< The size of the system. */
+  t_uint iterations;              /**< The products with the operator. */
+  std::vector<t_real> residuals;  /**< The relative residual after each iteration. */
+  t_real product;                 /**< Seconds spent in the products with the operator. */
+  t_real orthogonalization;       /**< Seconds spent orthogonalizing the Krylov vectors. */
+  t_real communication;           /**< Seconds spent exchanging vectors outside the products. */
+  t_real compression;             /**< Memory of the operator over that of the dense matrix. */
+};
+
+/**
+ * The SolverStatistics class gathers the records of the iterative solves of
+ * a process, e.g. those of one wavelength of a scan, until they are written
+ * and cleared. The operators set the compression of the solves that follow
+ * them, zero meaning that it is not known.
+ */
+class SolverStatistics {
+public:
+  //! Adds the record of a solve, with the last compression set
+  static void record(KrylovRecord record);
+  //! Sets the compression of the next solves from the memory of their operator, in MB
+  static void operator_memory(t_real memory, t_uint rows);
+  //! The records since the last clear
+  static std::vector<KrylovRecord> const &records();
+  //! Forgets the records and the compression
+  static void clear();
+
+  //! \brief Writes each record as a line of JSON
+  //! \details The step and wavelength of the records are written with each of them.
+  static void write_json(std::ostream &stream, t_int step, t_real wavelength);
+};
+}
+#endif
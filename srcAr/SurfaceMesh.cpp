@@ -0,0 +1,314 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "SurfaceMesh.h"
+
+#include "AuxCoefficients.h"
+#include "Tools.h"
+#include "Trian.h"
+#include "constants.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+namespace optimet {
+
+namespace {
+//! \brief The triangles of an irreducible wedge first, then the others
+//! \details The wedge holds the triangles whose centroids lie in 0 <= phi < 2 pi / rotations, and
+//! z >= 0 with the mirror. Those on the axis or in the plane z = 0 have fewer distinct images.
+std::vector<t_uint> symmetric_order(MeshFile const &file, t_uint rotations, bool mirror,
+                                    std::vector<t_real> &images) {
+  t_uint const Nt = file.triangles();
+  std::vector<t_real> centroids(3 * Nt);
+  t_real size = 0;
+  for(t_uint ele1 = 0; ele1 < Nt; ++ele1)
+    for(int j = 0; j < 3; ++j) {
+      for(int v = 0; v < 3; ++v)
+        centroids[3 * ele1 + j] += file.coord()[3 * file.topol()[3 * ele1 + v] + j] / 3;
+      size = std::max(size, std::abs(centroids[3 * ele1 + j]));
+    }
+  t_real const tolerance = 1e-6 * size;
+  t_real const sector = 2 * consPi / rotations;
+
+  // centroids sorted by z, to find the images
+  std::vector<std::pair<t_real, t_uint>> byz(Nt);
+  for(t_uint ele1 = 0; ele1 < Nt; ++ele1)
+    byz[ele1] = std::make_pair(centroids[3 * ele1 + 2], ele1);
+  std::sort(byz.begin(), byz.end());
+  auto const found = [&](t_real x, t_real y, t_real z) {
+    for(auto i = std::lower_bound(byz.begin(), byz.end(), std::make_pair(z - tolerance, t_uint(0)));
+        i != byz.end() and i->first <= z + tolerance; ++i)
+      if(std::abs(centroids[3 * i->second] - x) <= tolerance and
+         std::abs(centroids[3 * i->second + 1] - y) <= tolerance)
+        return true;
+    return false;
+  };
+
+  std::vector<t_uint> wedge, others;
+  t_real covered = 0;
+  for(t_uint ele1 = 0; ele1 < Nt; ++ele1) {
+    t_real const x = centroids[3 * ele1], y = centroids[3 * ele1 + 1], z = centroids[3 * ele1 + 2];
+    bool const axis = std::sqrt(x * x + y * y) <= tolerance;
+    bool const plane = std::abs(z) <= tolerance;
+    t_real phi = std::atan2(y, x);
+    if(phi < -1e-9)
+      phi += 2 * consPi;
+    if(not(axis or phi < sector - 1e-9) or (mirror and not plane and z < 0)) {
+      others.push_back(ele1);
+      continue;
+    }
+    for(t_uint k = 0; k < rotations; ++k) {
+      t_real const c = std::cos(k * sector), s = std::sin(k * sector);
+      t_real const xk = c * x - s * y, yk = s * x + c * y;
+      if(not found(xk, yk, z) or (mirror and not found(xk, yk, -z)))
+        throw std::runtime_error("The mesh does not have the symmetries of the particle");
+    }
+    wedge.push_back(ele1);
+    images.push_back((axis ? 1 : rotations) * (mirror and not plane ? 2 : 1));
+    covered += images.back();
+  }
+  if(covered != Nt)
+    throw std::runtime_error("The mesh does not have the symmetries of the particle");
+  wedge.insert(wedge.end(), others.begin(), others.end());
+  return wedge;
+}
+}
+
+SurfaceMesh::SurfaceMesh(std::shared_ptr<MeshFile const> file, t_uint degree)
+    : SurfaceMesh(std::move(file), degree, 1, false) {}
+
+SurfaceMesh::SurfaceMesh(std::shared_ptr<MeshFile const> file, t_uint degree, t_uint rotations,
+                         bool mirror)
+    : file_(std::move(file)), degree_(degree), contour_(0), meridians_(0), rotations_(rotations),
+      mirror_(mirror) {
+  if(rotations_ < 1)
+    throw std::runtime_error("A symmetric mesh needs at least one rotation");
+  // the triangles of the wedge first
+  std::vector<t_uint> order(file_->triangles());
+  for(t_uint ele1 = 0; ele1 < order.size(); ++ele1)
+    order[ele1] = ele1;
+  if(rotations_ > 1 or mirror_)
+    order = symmetric_order(*file_, rotations_, mirror_, images);
+
+  // tabulate the triangle geometry and the quadrature points once per mesh
+  std::vector<std::vector<double>> Points = Tools::getTrianglePoints(degree_);
+  std::vector<double> Weights = Tools::getTriangleWeights(degree_);
+
+  t_uint const Nt = file_->triangles(); // number of triangles
+  t_uint const Np = Nt * Weights.size();
+
+  normal.resize(3 * Nt);
+  centroid.resize(3 * Nt);
+  deter.resize(Nt);
+  x.resize(Np);
+  y.resize(Np);
+  z.resize(Np);
+  r.resize(Np);
+  the.resize(Np);
+  phi.resize(Np);
+  wdet.resize(Np);
+
+  t_uint point = 0;
+  for(t_uint ele1 = 0; ele1 < Nt; ++ele1) {
+
+    const int *n1 = file_->topol() + 3 * order[ele1];
+
+    const double *p1 = file_->coord() + 3 * n1[0];
+    const double *p2 = file_->coord() + 3 * n1[1];
+    const double *p3 = file_->coord() + 3 * n1[2];
+
+    Trian trian(p1, p2, p3);
+
+    double det = trian.getDeter();
+    deter[ele1] = det;
+    for(int j = 0; j != 3; ++j) {
+      normal[3 * ele1 + j] = trian.getnorm()[j];
+      centroid[3 * ele1 + j] = trian.getcp()[j];
+    }
+
+    for(t_uint ni = 0; ni != Weights.size(); ++ni, ++point) {
+
+      double N1 = Points[ni][0];
+      double N2 = Points[ni][1];
+      double N0 = 1.0 - N1 - N2;
+
+      Cartesian<double> intpoinCar((p1[0]) * N1 + (p2[0]) * N2 + (p3[0]) * N0,
+                                   (p1[1]) * N1 + (p2[1]) * N2 + (p3[1]) * N0,
+                                   (p1[2]) * N1 + (p2[2]) * N2 + (p3[2]) * N0);
+      Spherical<double> intpoinSph = Tools::toSpherical(intpoinCar);
+
+      x[point] = intpoinCar.x;
+      y[point] = intpoinCar.y;
+      z[point] = intpoinCar.z;
+      r[point] = intpoinSph.rrr;
+      the[point] = intpoinSph.the;
+      phi[point] = intpoinSph.phi;
+      wdet[point] = Weights[ni] * det;
+    }
+  }
+}
+
+namespace {
+//! Distance from the center to the mesh along a unit direction, and the outward normal there
+t_real cast_ray(MeshFile const &file, t_real const *direction, t_real *normal) {
+  t_real distance = 0;
+  for(t_uint ele1 = 0; ele1 < file.triangles(); ++ele1) {
+    const int *n1 = file.topol() + 3 * ele1;
+    const double *a = file.coord() + 3 * n1[0];
+    const double *b = file.coord() + 3 * n1[1];
+    const double *c = file.coord() + 3 * n1[2];
+    // Moller-Trumbore, the ray starting at the center
+    t_real e1[3], e2[3], p[3], q[3], t[3];
+    for(int i = 0; i < 3; ++i) {
+      e1[i] = b[i] - a[i];
+      e2[i] = c[i] - a[i];
+      t[i] = -a[i];
+    }
+    Tools::cross(p, direction, e2);
+    t_real const det = Tools::dot(e1, p);
+    if(std::abs(det) < 1e-300)
+      continue;
+    t_real const u = Tools::dot(t, p) / det;
+    Tools::cross(q, t, e1);
+    t_real const v = Tools::dot(direction, q) / det;
+    if(u < -1e-12 or v < -1e-12 or u + v > 1 + 1e-12)
+      continue;
+    t_real const hit = Tools::dot(e2, q) / det;
+    if(hit <= distance)
+      continue;
+    distance = hit;
+    Tools::cross(normal, e1, e2);
+    t_real const length = std::sqrt(Tools::dot(normal, normal));
+    t_real const sign = Tools::dot(normal, direction) < 0 ? -1 : 1;
+    for(int i = 0; i < 3; ++i)
+      normal[i] *= sign / length;
+  }
+  if(not(distance > 0))
+    throw std::runtime_error("A body of revolution must be star-shaped from its center");
+  return distance;
+}
+}
+
+SurfaceMesh::SurfaceMesh(std::shared_ptr<MeshFile const> file, t_uint contour, t_uint meridians)
+    : file_(std::move(file)), degree_(0), contour_(contour), meridians_(meridians),
+      rotations_(meridians), mirror_(false) {
+  if(contour_ < 1 or meridians_ < 1)
+    throw std::runtime_error("A body of revolution needs points along its curve and meridians");
+  auto const us = Tools::getLinePts(contour_);
+  auto const ws = Tools::getLineWghts(contour_);
+  t_real const dphi = 2 * consPi / meridians_;
+
+  // the generating curve in the plane phi = 0, with the (r, theta) components of the normal
+  std::vector<t_real> radii(contour_), nr(contour_), nt(contour_);
+  for(t_uint i = 0; i < contour_; ++i) {
+    t_real const ct = us[i], st = std::sqrt(1 - ct * ct);
+    t_real const direction[] = {st, 0, ct};
+    t_real normal[3];
+    radii[i] = cast_ray(*file_, direction, normal);
+    nr[i] = normal[0] * st + normal[2] * ct;
+    nt[i] = normal[0] * ct - normal[2] * st;
+    // the curve must be the same along the other meridians
+    for(t_uint quarter = 1; quarter < 4; ++quarter) {
+      t_real const phi = quarter * consPi / 2;
+      t_real const other[] = {st * std::cos(phi), st * std::sin(phi), ct};
+      if(std::abs(cast_ray(*file_, other, normal) - radii[i]) > 0.05 * radii[i])
+        throw std::runtime_error("The mesh is not a body of revolution around the z axis");
+    }
+    // the azimuthal component is that of the facets alone
+    t_real const length = std::sqrt(nr[i] * nr[i] + nt[i] * nt[i]);
+    nr[i] /= length;
+    nt[i] /= length;
+  }
+
+  t_uint const Np = contour_ * meridians_;
+  normal.resize(3 * Np);
+  centroid.resize(3 * Np);
+  deter.resize(Np);
+  x.resize(Np);
+  y.resize(Np);
+  z.resize(Np);
+  r.resize(Np);
+  the.resize(Np);
+  phi.resize(Np);
+  wdet.resize(Np);
+  for(t_uint j = 0, point = 0; j < meridians_; ++j)
+    for(t_uint i = 0; i < contour_; ++i, ++point) {
+      t_real const ct = us[i], st = std::sqrt(1 - ct * ct);
+      t_real const cp = std::cos(j * dphi), sp = std::sin(j * dphi);
+      x[point] = centroid[3 * point] = radii[i] * st * cp;
+      y[point] = centroid[3 * point + 1] = radii[i] * st * sp;
+      z[point] = centroid[3 * point + 2] = radii[i] * ct;
+      r[point] = radii[i];
+      the[point] = std::acos(ct);
+      phi[point] = Tools::toSpherical(Cartesian<double>(x[point], y[point], z[point])).phi;
+      normal[3 * point] = (nr[i] * st + nt[i] * ct) * cp;
+      normal[3 * point + 1] = (nr[i] * st + nt[i] * ct) * sp;
+      normal[3 * point + 2] = nr[i] * ct - nt[i] * st;
+      // n.r dS = r^2 dcos(theta) dphi on a star-shaped surface
+      wdet[point] = ws[i] * dphi * radii[i] * radii[i] / nr[i];
+      // as twice the area of a triangle
+      deter[point] = 2 * wdet[point];
+    }
+  // the wedge is the first meridian
+  images.assign(contour_, meridians_);
+}
+
+std::shared_ptr<SurfaceMesh const>
+SurfaceMesh::get(std::shared_ptr<MeshFile const> const &file, t_uint degree, t_uint rotations,
+                 bool mirror) {
+  // the tables hold on to their file, whose address cannot be reused while they live
+  static std::map<std::tuple<MeshFile const *, t_uint, t_uint, bool>,
+                  std::weak_ptr<SurfaceMesh const>>
+      meshes;
+  auto const key = std::make_tuple(file.get(), degree, rotations, mirror);
+  auto result = meshes[key].lock();
+  if(not result) {
+    result = std::make_shared<SurfaceMesh const>(file, degree, rotations, mirror);
+    meshes[key] = result;
+  }
+  return result;
+}
+
+std::shared_ptr<SurfaceMesh const>
+SurfaceMesh::revolution(std::shared_ptr<MeshFile const> const &file, t_uint contour,
+                        t_uint meridians) {
+  static std::map<std::tuple<MeshFile const *, t_uint, t_uint>, std::weak_ptr<SurfaceMesh const>>
+      meshes;
+  auto const key = std::make_tuple(file.get(), contour, meridians);
+  auto result = meshes[key].lock();
+  if(not result) {
+    result = std::make_shared<SurfaceMesh const>(file, contour, meridians);
+    meshes[key] = result;
+  }
+  return result;
+}
+
+std::shared_ptr<AuxAngular const> SurfaceMesh::angular(t_uint nMax) const {
+  if(!angular_ or angular_->nMax() < nMax) {
+    // from the cartesian coordinates, without the trigonometric functions of the angles
+    std::vector<Cartesian<double>> points(this->points());
+    for(t_uint point = 0; point < this->points(); ++point)
+      points[point] = Cartesian<double>(x[point], y[point], z[point]);
+    angular_ = std::make_shared<AuxAngular const>(points, Cartesian<double>(0, 0, 0), nMax);
+  }
+  return angular_;
+}
+}
@@ -0,0 +1,142 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SURFACE_MESH_H_
+#define SURFACE_MESH_H_
+
+#include "MeshFile.h"
+#include "Types.h"
+
+#include <memory>
+#include <vector>
+
+namespace optimet {
+class AuxAngular;
+
+/**
+ * The SurfaceMesh class tabulates the triangles of a mesh and the quadrature
+ * points of the surface integrals over them. It never changes once built, and
+ * the scatterers with the same mesh share a single instance, so that copying
+ * a scatterer costs a few pointers whatever the size of its mesh.
+ */
+class SurfaceMesh {
+public:
+  /**
+   * Initializing constructor for the SurfaceMesh class.
+   * @param file the vertices and triangles of the mesh.
+   * @param degree the degree up to which the quadrature on each triangle is exact.
+   */
+  explicit SurfaceMesh(std::shared_ptr<MeshFile const> file, t_uint degree = 3);
+
+  /**
+   * Initializing constructor for a mesh invariant under rotations about the z
+   * axis and possibly under the mirror in the plane z = 0. The triangles of an
+   * irreducible wedge come first in the tables.
+   * @param file the vertices and triangles of the mesh.
+   * @param degree the degree up to which the quadrature on each triangle is exact.
+   * @param rotations the mesh is invariant under the rotations by 2 pi / rotations.
+   * @param mirror whether the mesh is invariant under z -> -z.
+   */
+  SurfaceMesh(std::shared_ptr<MeshFile const> file, t_uint degree, t_uint rotations, bool mirror);
+
+  /**
+   * Initializing constructor for a body of revolution around the z axis. Its
+   * generating curve is read from the mesh along the meridian phi = 0, which
+   * is then turned around the axis.
+   * @param file the vertices and triangles of the mesh, star-shaped from its center.
+   * @param contour the number of Gauss-Legendre points in cos(theta) along the curve.
+   * @param meridians the number of evenly spaced meridians.
+   */
+  SurfaceMesh(std::shared_ptr<MeshFile const> file, t_uint contour, t_uint meridians);
+
+  /**
+   * Returns the tables of a mesh.
+   * @param file the vertices and triangles of the mesh.
+   * @param degree the degree up to which the quadrature on each triangle is exact.
+   * @param rotations the number of rotations about z the mesh is invariant under.
+   * @param mirror whether the mesh is invariant under z -> -z.
+   * @return the instance shared with the other users of the mesh and quadrature.
+   */
+  static std::shared_ptr<SurfaceMesh const> get(std::shared_ptr<MeshFile const> const &file,
+                                                t_uint degree = 3, t_uint rotations = 1,
+                                                bool mirror = false);
+
+  /**
+   * Returns the tables of a body of revolution.
+   * @param file the vertices and triangles of the mesh.
+   * @param contour the number of points along the generating curve.
+   * @param meridians the number of meridians.
+   * @return the instance shared with the other users of the mesh and quadrature.
+   */
+  static std::shared_ptr<SurfaceMesh const>
+  revolution(std::shared_ptr<MeshFile const> const &file, t_uint contour, t_uint meridians);
+
+  //! Vertices and triangles of the mesh
+  MeshFile const &file() const { return *file_; }
+  //! Degree up to which the quadrature on each triangle is exact
+  t_uint degree() const { return degree_; }
+  //! \brief Number of points along the generating curve of a body of revolution, zero otherwise
+  //! \details The points of meridian j follow those of meridian j - 1, the first one at phi = 0,
+  //! each point being a patch of its own in the triangle table.
+  t_uint contour() const { return contour_; }
+  //! Number of meridians of a body of revolution
+  t_uint meridians() const { return meridians_; }
+  //! \brief Number of leading triangles forming an irreducible wedge of a symmetric mesh, or zero
+  //! \details Their images under the rotations and the mirror cover the mesh. The wedge of a body
+  //! of revolution is its first meridian.
+  t_uint wedge() const { return images.size(); }
+  //! Number of rotations about the z axis the mesh is invariant under, one if none
+  t_uint rotations() const { return rotations_; }
+  //! Whether the mesh is invariant under z -> -z
+  bool mirror() const { return mirror_; }
+
+  //! Number of triangles
+  t_uint triangles() const { return deter.size(); }
+  //! Number of quadrature points
+  t_uint points() const { return wdet.size(); }
+
+  /**
+   * The angular parts of the VSWFs at the quadrature points. They only depend
+   * on the mesh, so they are computed on the first call and serve all the
+   * scatterers, wave numbers and wavelengths.
+   * @param nMax the maximum value of the n iterator needed.
+   */
+  std::shared_ptr<AuxAngular const> angular(t_uint nMax) const;
+
+  // triangle table
+  std::vector<t_real> normal;   // unit normals, 3 per triangle
+  std::vector<t_real> centroid; // centroids, 3 per triangle
+  std::vector<t_real> deter;    // |p13 x p21|, one per triangle
+
+  // quadrature points of all triangles, points() / triangles() per triangle
+  std::vector<t_real> x, y, z;       // Cartesian coordinates
+  std::vector<t_real> r, the, phi;   // spherical coordinates
+  std::vector<t_real> wdet;          // quadrature weight times determinant
+
+  // number of distinct images of each triangle of the wedge under the symmetries
+  std::vector<t_real> images;
+
+private:
+  std::shared_ptr<MeshFile const> file_;
+  t_uint degree_;
+  t_uint contour_, meridians_;
+  t_uint rotations_;
+  bool mirror_;
+  // built on first use
+  mutable std::shared_ptr<AuxAngular const> angular_;
+};
+}
+#endif
@@ -16,6 +16,7 @@
 
 #include "Symbol.h"
 
+#include <algorithm>
 #include <cmath>
 #include "constants.h"
 #include "Bessel.h"
@@ -29,6 +30,83 @@ double Wigner3j(int j1, int j2, int j3, int m1, int m2, int m3) {
   return gsl_sf_coupling_3j(2 * j1, 2 * j2, 2 * j3, 2 * m1, 2 * m2, 2 * m3); 
 }
 
+std::vector<double> Wigner3jRange(int j1, int j2, int m1, int m2) {
+  int const m3 = -m1 - m2;
+  int const jmin = std::max(std::abs(j1 - j2), std::abs(m3));
+  int const jmax = j1 + j2;
+  if(std::abs(m1) > j1 or std::abs(m2) > j2 or jmin > jmax)
+    return std::vector<double>();
+
+  // j A(j + 1) f(j + 1) + B(j) f(j) + (j + 1) A(j) f(j - 1) = 0, with A(jmin) = A(jmax + 1) = 0
+  auto const A = [&](int j) {
+    return std::sqrt((j * j - (j1 - j2) * (j1 - j2)) *
+                     ((j1 + j2 + 1.0) * (j1 + j2 + 1.0) - j * j) * (j * j - m3 * m3 + 0.0));
+  };
+  auto const B = [&](int j) {
+    return -(2.0 * j + 1.0) *
+           ((j1 * (j1 + 1.0) - j2 * (j2 + 1.0)) * m3 - j * (j + 1.0) * (m2 - m1));
+  };
+
+  std::vector<double> f(jmax - jmin + 1, 0e0);
+  auto const at = [&](int j) -> double & { return f[j - jmin]; };
+  if(m1 == 0 and m2 == 0) {
+    // B vanishes and the recursion steps by two, every other symbol being zero by parity
+    at(jmin) = 1e0;
+    for(int j = jmin + 1; j < jmax; j += 2)
+      at(j + 1) = -(j + 1.0) * A(j) * at(j - 1) / (j * A(j + 1));
+  } else {
+    // forward from jmin while the symbols grow, which is stable up to the classical region
+    int jmid = jmin;
+    at(jmin) = 1e0;
+    if(jmin < jmax) {
+      // at jmin = 0, j1 = j2 and m3 = 0, the ratio of the first two symbols is known
+      at(jmin + 1) = jmin == 0 ? m1 / std::sqrt(j1 * (j1 + 1.0)) : -B(jmin) / (jmin * A(jmin + 1));
+      jmid = jmin + 1;
+      while(jmid < jmax and std::abs(at(jmid)) >= std::abs(at(jmid - 1))) {
+        at(jmid + 1) = -(B(jmid) * at(jmid) + (jmid + 1.0) * A(jmid) * at(jmid - 1)) /
+                       (jmid * A(jmid + 1));
+        jmid++;
+      }
+    }
+    // backward from jmax down to jmid - 1, then matched to the forward sweep on the overlap
+    if(jmid < jmax) {
+      std::vector<double> g(jmax - jmid + 2, 0e0);
+      auto const back = [&](int j) -> double & { return g[j - jmid + 1]; };
+      back(jmax) = 1e0;
+      back(jmax - 1) = -B(jmax) / ((jmax + 1.0) * A(jmax));
+      for(int j = jmax - 1; j > jmid - 1; j--)
+        back(j - 1) = -(B(j) * back(j) + j * A(j + 1) * back(j + 1)) / ((j + 1.0) * A(j));
+      double const scale = (at(jmid) * back(jmid) + at(jmid - 1) * back(jmid - 1)) /
+                           (back(jmid) * back(jmid) + back(jmid - 1) * back(jmid - 1));
+      for(int j = jmid + 1; j <= jmax; j++)
+        at(j) = scale * back(j);
+    }
+  }
+
+  // sum over j of (2j + 1) f(j)^2 is one, and the sign of f(jmax) is (-1)^(j1 - j2 - m3)
+  double norm = 0e0;
+  for(int j = jmin; j <= jmax; j++)
+    norm += (2.0 * j + 1.0) * at(j) * at(j);
+  norm = 1e0 / std::sqrt(norm);
+  if((at(jmax) < 0) != (std::abs(j1 - j2 - m3) % 2 == 1))
+    norm = -norm;
+  for(auto &value : f)
+    value *= norm;
+  return f;
+}
+
+double Wigner3jTable::operator()(int j1, int j2, int j3, int m1, int m2, int m3) {
+  if(m1 + m2 + m3 != 0 or j3 > j1 + j2 or j3 < std::max(std::abs(j1 - j2), std::abs(m3)))
+    return 0e0;
+  std::array<int, 4> const key = {{j1, j2, m1, m2}};
+  auto range = ranges_.find(key);
+  if(range == ranges_.end())
+    range = ranges_.emplace(key, Wigner3jRange(j1, j2, m1, m2)).first;
+  if(range->second.empty())
+    return 0e0;
+  return range->second[j3 - std::max(std::abs(j1 - j2), std::abs(m3))];
+}
+
 namespace {
 
 double Wigner6j(int j1, int j2, int j3, int j4, int j5, int j6) {
@@ -41,87 +119,69 @@ double Wigner9j(int j11, int j12, int j13, int j21, int j22, int j23, int j31,
                             2 * j23, 2 * j31, 2 * j32, 2 * j33);
 }
 
-double CleGor(int j, int m, int j1, int m1, int j2, int m2) {
+double CleGor(Wigner3jTable &wigner, int j, int m, int j1, int m1, int j2, int m2) {
 
   return std::pow(-1.0, m + j1 - j2) * std::sqrt(2.0 * j + 1.0) *  
-         Wigner3j(j1, j2, j, m1, m2, -m);
+         wigner(j1, j2, j, m1, m2, -m);
 }
 
 
-// A numbers
-std::complex<double> A_0(int n, double R, const std::complex<double> &waveK_i,
-                         const std::complex<double> &cmn, int nMax) {
-                                                 
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(R * waveK_i, nMax);  
+// Regular spherical Bessel functions at r waveK, computed once and shared by
+// the kernels of all the (p, q) pairs of a contraction
+struct BesselTable {
+  BesselTable(double r, const std::complex<double> &waveK, int nMax, bool dd = false)
+      : r(r), waveK(waveK), data(nMax + 1), ddata(nMax + 1), dddata(dd ? nMax + 1 : 0) {
+    bessel<Bessel, false>(r * waveK, nMax, data.data(), ddata.data(),
+                          dd ? dddata.data() : nullptr);
+  }
+  double r;
+  std::complex<double> waveK;
+  std::vector<std::complex<double>> data, ddata, dddata;
+};
 
-  return data[n] * cmn;
+// A numbers
+std::complex<double> A_0(int n, const BesselTable &b, const std::complex<double> &cmn) {
+  return b.data[n] * cmn;
 }
 
-std::complex<double> A_1(int n, double R, const std::complex<double> &waveK_i,
-                         const std::complex<double> &dmn, int nMax) {
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(R * waveK_i, nMax); 
-
-  return std::complex<double>(0.0, 1.0) * (1.0 / waveK_i) *
-         (waveK_i * ddata[n] + data[n] / R) * dmn;   
+std::complex<double> A_1(int n, const BesselTable &b, const std::complex<double> &dmn) {
+  return std::complex<double>(0.0, 1.0) * (1.0 / b.waveK) *
+         (b.waveK * b.ddata[n] + b.data[n] / b.r) * dmn;
 }
 
-std::complex<double> A_m1(int n, double R, const std::complex<double> &waveK_i,
-                          const std::complex<double> &dmn, int nMax) {
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(R * waveK_i, nMax);
-
-
+std::complex<double> A_m1(int n, const BesselTable &b, const std::complex<double> &dmn) {
   return std::complex<double>(0.0, 1.0) * std::sqrt(n * (n + 1.0)) *
-         (1.0 / waveK_i / R) * data[n] * dmn;  
+         (1.0 / b.waveK / b.r) * b.data[n] * dmn;
 }
 
-std::complex<double> F_00(int n1, int n2, double r, const std::complex<double> &waveK_i,
-                          int nMax) {
- 
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(r * waveK_i, nMax);
-
-
-  return  data[n1] * ddata[n2];
+std::complex<double> F_00(int n1, int n2, const BesselTable &b) {
+  return b.data[n1] * b.ddata[n2];
 }
 
-std::complex<double> F_11(int n1, int n2, double r, const std::complex<double> &waveK_i,
-                          int nMax) {
- 
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(r * waveK_i, nMax);
+std::complex<double> F_11(int n1, int n2, const BesselTable &b) {
+  auto const &data = b.data;
+  auto const &ddata = b.ddata;
+  auto const &waveK_i = b.waveK;
+  auto const r = b.r;
 
   return (waveK_i * ddata[n2] + data[n2]/r) * (waveK_i * ddata[n1] + data[n1]/r);
 }
 
-std::complex<double> F_m1m1(int n1, int n2, double r, const std::complex<double> &waveK_i,
-                          int nMax) {
- 
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(r * waveK_i, nMax);
-
-
-  return  (1.0 / (std::pow(r , 2.0))) * (data[n1] * data[n2]);
+std::complex<double> F_m1m1(int n1, int n2, const BesselTable &b) {
+  return  (1.0 / (std::pow(b.r , 2.0))) * (b.data[n1] * b.data[n2]);
 }
 
-std::complex<double> F_d00(int n1, int n2, double r, const std::complex<double> &waveK_i,
-                          int nMax) {
- 
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(r * waveK_i, nMax);
-
-
-  return  data[n1] * ddata[n2] * waveK_i + waveK_i * ddata[n1] * data[n2];
+std::complex<double> F_d00(int n1, int n2, const BesselTable &b) {
+  return  b.data[n1] * b.ddata[n2] * b.waveK + b.waveK * b.ddata[n1] * b.data[n2];
 }
 
-std::complex<double> F_d11(int n1, int n2, double r, const std::complex<double> &waveK_i,
-                          int nMax) {
- 
-  std::vector<std::complex<double>> data, ddata, dddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(r * waveK_i, nMax);
-  dddata = bessel3der<Bessel, false>(r * waveK_i, nMax);
+// Needs the table computed with dd set
+std::complex<double> F_d11(int n1, int n2, const BesselTable &b) {
+  auto const &data = b.data;
+  auto const &ddata = b.ddata;
+  auto const &dddata = b.dddata;
+  auto const &waveK_i = b.waveK;
+  auto const r = b.r;
 
   return  (std::pow(waveK_i , 2.0) * dddata[n1] - (1.0 / std::pow(r , 2.0)) * data[n1] + (1.0 / r) * waveK_i * ddata[n1]) *
           (waveK_i * ddata[n2] + data[n2]/r) + (std::pow(waveK_i , 2.0) * dddata[n2] - (1.0 / std::pow(r , 2.0)) * data[n2] 
@@ -129,589 +189,336 @@ std::complex<double> F_d11(int n1, int n2, double r, const std::complex<double>
           (waveK_i * ddata[n1] + data[n1]/r);
 }
 
-std::complex<double> F_dm1m1(int n1, int n2, double r, const std::complex<double> &waveK_i,
-                          int nMax) {
- 
-  std::vector<std::complex<double>> data, ddata;
-  std::tie(data, ddata) = bessel<Bessel, false>(r * waveK_i, nMax);
-
+std::complex<double> F_dm1m1(int n1, int n2, const BesselTable &b) {
+  auto const &data = b.data;
+  auto const &ddata = b.ddata;
+  auto const &waveK_i = b.waveK;
+  auto const r = b.r;
 
   return  (1.0 / (std::pow(r , 2.0))) * (waveK_i * ddata[n1] * data[n2] + data[n1] * waveK_i * ddata[n2]) - (2.0 / 
 (std::pow(r , 3.0))) * (data[n1] * data[n2]);
 }
 
-double W(int L1, int J1, int M1, int L2, int J2, int M2, int L, int M) {
+double W(Wigner3jTable &wigner, int L1, int J1, int M1, int L2, int J2, int M2, int L, int M) {
 
   return std::pow(-1.0, J2 + L1 + L) *
          std::sqrt((2.0 * J1 + 1.0) * (2.0 * J2 + 1.0) * (2.0 * L1 + 1.0) *
                    (2.0 * L2 + 1.0) / (4.0 * consPi * (2.0 * L + 1.0))) *
-         Wigner6j(L1, L2, L, J2, J1, 1.0) * CleGor(L, 0, L1, 0, L2, 0) *
-         CleGor(L, M, J1, M1, J2, M2);  
+         Wigner6j(L1, L2, L, J2, J1, 1.0) * CleGor(wigner, L, 0, L1, 0, L2, 0) *
+         CleGor(wigner, L, M, J1, M1, J2, M2);  
 }
 
 } // namespace
 
                           
-// function for coefficients with Xm1 spherical function, particular solution of diff equations, SH
-std::complex<double> CXm1(CompoundIterator &kk, double *W_m1m1, double *W_00, double *W_11, int nMax,
-                            optimet::Vector<optimet::t_complex> &internalCoef_FF_,
-                            double r,
-                            int objectIndex_, double omega,
-                            const Scatterer &object) {
-                            
-   int n = kk.first;
-   int m = kk.second;                         
+// function for the coefficients with the Xm1 and Xp1 spherical functions, particular solution of diff equations, SH
+void CXm1p1(double *W_m1m1, double *W_00, double *W_11, const CouplingPattern &pattern, int nMax,
+            int nMaxS, optimet::Vector<optimet::t_complex> &internalCoef_FF_, double r,
+            int objectIndex_, double omega, const Scatterer &object,
+            std::complex<double> *coefXmn, std::complex<double> *coefXpl) {
 
   // Basic relations
-  const double R = object.radius;
   const std::complex<double> eps_0 = consEpsilon0;
-  const std::complex<double> mu_0 = consMu0;
   const std::complex<double> mu_j = object.elmag.mu;
   const std::complex<double> eps_j = object.elmag.epsilon;
-  
-  
-  // SH Basic relations
 
+  // SH Basic relations
   const std::complex<double> gamma = object.elmag.gamma;
   const std::complex<double> eps_j2 = object.elmag.epsilon_SH;
-  const std::complex<double> mu_j2 = object.elmag.mu_SH;
-  
+
   // Auxiliary variables
-  const std::complex<double> waveK_01 = (omega) * std::sqrt(eps_0 * mu_0); 
   const std::complex<double> waveK_j1 = (omega) * std::sqrt(eps_j * mu_j);
+  const std::complex<double> factor = (-eps_0 / eps_j2) * gamma;
+  const std::complex<double> invK2 = 1.0 / (waveK_j1 * waveK_j1);
+
+  int const pMax = max_flat_index(nMax);
+  int const qMax = max_flat_index(nMax);
+  auto const indices = harmonic_indices(std::max(nMax, nMaxS));
+
+  // radial factors of both coefficients, by (n1, n2), the 1 / k^2 and the
+  // sqrt(n1 n2 (n1 + 1) (n2 + 1)) of the d d terms included
+  const BesselTable bessels(r, waveK_j1, nMax, true);
+  int const nn = nMax + 1;
+  std::vector<std::complex<double>> Fm_00(nn * nn), Fm_11(nn * nn), Fm_m1m1(nn * nn);
+  std::vector<std::complex<double>> Fp_00(nn * nn), Fp_11(nn * nn), Fp_m1m1(nn * nn);
+  for(int n1 = 1; n1 <= nMax; n1++)
+    for(int n2 = 1; n2 <= nMax; n2++) {
+      auto const l = n1 * nn + n2;
+      auto const s12 = std::sqrt(n1 * n2 * (n1 + 1.0) * (n2 + 1.0));
+      Fm_00[l] = F_d00(n1, n2, bessels);
+      Fm_11[l] = invK2 * F_d11(n1, n2, bessels);
+      Fm_m1m1[l] = invK2 * s12 * F_dm1m1(n1, n2, bessels);
+      Fp_00[l] = F_00(n1, n2, bessels);
+      Fp_11[l] = invK2 * F_11(n1, n2, bessels);
+      Fp_m1m1[l] = invK2 * s12 * F_m1m1(n1, n2, bessels);
+    }
 
+  // products of the internal coefficients, by compound index qMax p + q
+  std::vector<std::complex<double>> cc(pMax * qMax), dd(pMax * qMax);
+  for(int p = 0; p < pMax; p++)
+    for(int q = 0; q < qMax; q++) {
+      cc[p * qMax + q] = internalCoef_FF_(objectIndex_ * 2 * pMax + p) *
+                         internalCoef_FF_(objectIndex_ * 2 * qMax + q);
+      dd[p * qMax + q] = internalCoef_FF_(pMax + objectIndex_ * 2 * pMax + p) *
+                         internalCoef_FF_(qMax + objectIndex_ * 2 * qMax + q);
+    }
 
-  double W00, W11, Wm1m1;
-  
-  CompoundIterator p, q;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  
-  int size1 = pMax * qMax;
- 
- std::complex<double> cmn_1, dmn_1, cmn_2, dmn_2; 
- 
-  
- std::complex<double> COEFFXm1(0.0, 0.0);
- 
- int brojac (0);
- 
- 
- for(p = 0; p <  pMax; p++) {  
- 
- cmn_1 = internalCoef_FF_(objectIndex_ * 2 * pMax + p.compound);
- 
-  dmn_1 = internalCoef_FF_(pMax + objectIndex_ * 2 * pMax + p.compound);
-  
-  for(q = 0; q <  qMax; q++) {    
-  
-  cmn_2 = internalCoef_FF_(objectIndex_ * 2 * qMax + q.compound);
- 
-   dmn_2 = internalCoef_FF_(qMax + objectIndex_ * 2 * qMax + q.compound);
-   
-   Wm1m1 = W_m1m1[kk*size1 +brojac];
-                    
-   W00 = W_00[kk*size1 +brojac];                 
-   
-   W11 =  W_11[kk*size1 +brojac];
-                 
-   
-   COEFFXm1 += (-eps_0 / eps_j2) * gamma * ( cmn_1 * cmn_2 * W00 * F_d00(p.first, q.first, r, waveK_j1, nMax)
-
-      + dmn_1 * dmn_2 * (1.0 / (std::pow(waveK_j1, 2.0))) * (W11 * F_d11(p.first, q.first, r, waveK_j1, nMax)
-       
-       + Wm1m1 * std::sqrt(p.first * q.first * (p.first + 1) * (q.first + 1)) *  F_dm1m1(p.first, q.first, r, waveK_j1, nMax)));
-                          
-                        
-    brojac ++;          
-   }
- 
-  }
-        
-  return COEFFXm1 ;    
-}
-
-
-// function for coefficients with Xp1 spherical function, particular solution of diff equations, SH
-std::complex<double> CXp1(CompoundIterator &kk, double *W_m1m1, double *W_00, double *W_11, int nMax,
-                            optimet::Vector<optimet::t_complex> &internalCoef_FF_,
-                            double r,
-                            int objectIndex_, double omega,
-                            const Scatterer &object) {
-                            
-  int n = kk.first;
-  int m = kk.second;                          
-
-  // Basic relations
-  const double R = object.radius;
-  const std::complex<double> eps_0 = consEpsilon0;
-  const std::complex<double> mu_0 = consMu0;
-  const std::complex<double> mu_j = object.elmag.mu;
-  const std::complex<double> eps_j = object.elmag.epsilon;
-  
-  
-  // SH Basic relations
-
-  const std::complex<double> gamma = object.elmag.gamma;
-  const std::complex<double> eps_j2 = object.elmag.epsilon_SH;
-  const std::complex<double> mu_j2 = object.elmag.mu_SH;
-  
-  // Auxiliary variables
-  const std::complex<double> waveK_01 = (omega) * std::sqrt(eps_0 * mu_0); 
-  const std::complex<double> waveK_j1 = (omega) * std::sqrt(eps_j * mu_j);
+  // without the tables, the W numbers of each k are computed for its couplings alone, and dropped
+  bool const onthefly = W_m1m1 == nullptr or W_00 == nullptr or W_11 == nullptr;
+  std::vector<double> row_m1m1, row_00, row_11;
+
+  for(int k = 0; k < max_flat_index(nMaxS); k++) {
+    std::complex<double> COEFFXm1(0.0, 0.0), COEFFXp1(0.0, 0.0);
+    int const first = pattern.start[k], last = pattern.start[k + 1];
+    double const *w_m1m1 = W_m1m1 + first, *w_00 = W_00 + first, *w_11 = W_11 + first;
+    if(onthefly) {
+      row_m1m1.resize(last - first);
+      row_00.resize(last - first);
+      row_11.resize(last - first);
+      W_m1m1coeff(row_m1m1.data(), pattern, first, last);
+      W_00coeff(row_00.data(), pattern, first, last);
+      W_11coeff(row_11.data(), pattern, first, last);
+      w_m1m1 = row_m1m1.data();
+      w_00 = row_00.data();
+      w_11 = row_11.data();
+    }
 
-  double  W00, W11, Wm1m1;
-  
-  CompoundIterator p, q;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  
-  int size1 = pMax * qMax;
- 
- std::complex<double> cmn_1, dmn_1, cmn_2, dmn_2; 
- 
+    for(int i = first; i < last; i++) {
+      auto const pq = pattern.pq[i];
+      auto const l = indices[pq / qMax].first * nn + indices[pq % qMax].first;
+      auto const cW00 = cc[pq] * w_00[i - first];
+      auto const dW11 = dd[pq] * w_11[i - first];
+      auto const dWm1m1 = dd[pq] * w_m1m1[i - first];
 
- std::complex<double> COEFFXp1(0.0, 0.0);
- 
- int brojac (0);
- 
- for(p = 0; p <  pMax; p++) {  
- 
- cmn_1 = internalCoef_FF_(objectIndex_ * 2 * pMax + p.compound);
- 
-  dmn_1 = internalCoef_FF_(pMax + objectIndex_ * 2 * pMax + p.compound);
-  
-  for(q = 0; q <  qMax; q++) {    
-  
-  cmn_2 = internalCoef_FF_(objectIndex_ * 2 * qMax + q.compound);
- 
-   dmn_2 = internalCoef_FF_(qMax + objectIndex_ * 2 * qMax + q.compound);
-   
-   Wm1m1 = W_m1m1[kk*size1 +brojac];
-                    
-   W00 = W_00[kk*size1 +brojac];                 
-   
-   W11 = W_11[kk*size1 +brojac];
-                 
-   
-                          
-   
-   COEFFXp1 += (-eps_0 / eps_j2) * gamma * ( cmn_1 * cmn_2 * W00 * std::sqrt(n * (n + 1)) * (1.0 / r) * F_00(p.first, q.first, r, waveK_j1, nMax) + 
-              dmn_1  * dmn_2 * (1.0 / (std::pow(waveK_j1, 2.0))) * (W11 * std::sqrt(n * (n + 1)) * (1.0 / r) * 
+      COEFFXm1 += cW00 * Fm_00[l] + dW11 * Fm_11[l] + dWm1m1 * Fm_m1m1[l];
+      COEFFXp1 += cW00 * Fp_00[l] + dW11 * Fp_11[l] + dWm1m1 * Fp_m1m1[l];
+    }
 
-               F_11(p.first, q.first, r, waveK_j1, nMax) + Wm1m1 * std::sqrt(p.first * q.first * (p.first + 1) * (q.first + 1)) * 
-              
-               std::sqrt(n * (n + 1)) * (1.0 / r) * F_m1m1(p.first, q.first, r, waveK_j1, nMax)));      
-               
-               brojac++;                  
-              
-   }
- 
+    coefXmn[k] = factor * COEFFXm1;
+    coefXpl[k] = factor * std::sqrt(indices[k].first * (indices[k].first + 1.0)) * (1.0 / r) *
+                 COEFFXp1;
   }
-  
-   
-  return COEFFXp1 ;    
-
 }
 
- // C numbers
-#ifdef OPTIMET_MPI
-void C_10m1coeff (double *C_10m1, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
- int J, M, J1, M1, J2, M2, brojac(0);
-  
-for (int tt = gran1; tt < gran2; tt++) {
- 
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-
-J =k.first;
-M = k.second;
-
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second; 
+CouplingPattern::CouplingPattern(int nMax, int nMaxS) : nMax(nMax), nMaxS(nMaxS) {
+  int const qMax = max_flat_index(nMax);
+
+  start.reserve(max_flat_index(nMaxS) + 1);
+  for(int J = 1; J <= nMaxS; J++)
+    for(int M = J; M >= -J; M--) {
+      start.push_back(pq.size());
+      for(int J1 = 1; J1 <= nMax; J1++)
+        for(int M1 = J1; M1 >= -J1; M1--) {
+          // M2 = M - M1, and J2 runs over the triangle of J and J1
+          int const M2 = M - M1;
+          int const J2min = std::max(std::max(std::abs(J - J1), std::abs(M2)), 1);
+          int const J2max = std::min(J + J1, nMax);
+          for(int J2 = J2min; J2 <= J2max; J2++)
+            pq.push_back(qMax * flatten_indices(J1, M1) + flatten_indices(J2, M2));
+        }
+    }
+  start.push_back(pq.size());
+}
 
+int CouplingPattern::k(int i) const {
+  return std::upper_bound(start.begin(), start.end(), i) - start.begin() - 1;
+}
 
+ // C numbers
+void C_10m1coeff (double *C_10m1, const CouplingPattern &pattern, int gran1, int gran2){
 
-C_10m1[brojac] =std::sqrt(3.0 / 2.0 / consPi) * (2.0 * J1 + 1.0) *
-         CleGor(J, M, J1, M1, J2, M2) *
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    C_10m1[tt - gran1] = std::sqrt(3.0 / 2.0 / consPi) * (2.0 * J1 + 1.0) *
+         CleGor(wigner, J, M, J1, M1, J2, M2) *
          (std::sqrt(J2 * (2.0 * J2 - 1.0)) *  
               Wigner9j(J1, J1, 1, J2, J2 - 1, 1, J, J + 1, 1) *
-              CleGor(J + 1, 0, J1, 0, J2 - 1, 0) *
+              CleGor(wigner, J + 1, 0, J1, 0, J2 - 1, 0) *
               std::sqrt(J / (2.0 * J + 1.0)) -
           std::sqrt((J2 + 1.0) * (2.0 * J2 + 3.0)) *
               Wigner9j(J1, J1, 1, J2, J2 + 1, 1, J, J + 1, 1) *
-              CleGor(J + 1, 0, J1, 0, J2 + 1, 0) *
+              CleGor(wigner, J + 1, 0, J1, 0, J2 + 1, 0) *
               std::sqrt(J / (2.0 * J + 1.0)) +
           std::sqrt(J2 * (2.0 * J2 - 1.0)) *
               Wigner9j(J1, J1, 1, J2, J2 - 1, 1, J, J - 1, 1) *
-              CleGor(J - 1, 0, J1, 0, J2 - 1, 0) *
+              CleGor(wigner, J - 1, 0, J1, 0, J2 - 1, 0) *
               std::sqrt((J + 1.0) / (2.0 * J + 1.0)) -
           std::sqrt((J2 + 1) * (2.0 * J2 + 3.0)) *      
               Wigner9j(J1, J1, 1, J2, J2 + 1, 1, J, J - 1, 1) *
-              CleGor(J - 1, 0, J1, 0, J2 + 1, 0) *
+              CleGor(wigner, J - 1, 0, J1, 0, J2 + 1, 0) *
               std::sqrt((J + 1) / (2.0 * J + 1.0)));
-              
-     brojac++;           
-    }
+  });
 
 }
 
 
-void C_11m1coeff (double *C_11m1, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-  
-for (int tt = gran1; tt < gran2; tt++) {
+void C_11m1coeff (double *C_11m1, const CouplingPattern &pattern, int gran1, int gran2){
 
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-J =k.first;
-M = k.second;
-
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second;
-
-  C_11m1[brojac] = std::sqrt(3.0 / 2.0 / consPi) * CleGor(J, M, J1, M1, J2, M2) *
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    C_11m1[tt - gran1] = std::sqrt(3.0 / 2.0 / consPi) * CleGor(wigner, J, M, J1, M1, J2, M2) *
          (std::sqrt((J1 + 1.0) * J2 * (2.0 * J1 - 1.0) * (2.0 * J2 - 1.0)) *
               Wigner9j(J1, J1 - 1, 1, J2, J2 - 1, 1, J, J + 1, 1) *
-              CleGor(J + 1, 0, J1 - 1, 0, J2 - 1, 0) *
+              CleGor(wigner, J + 1, 0, J1 - 1, 0, J2 - 1, 0) *
               std::sqrt(J / (2.0 * J + 1.0)) -
           std::sqrt((J1 + 1.0) * (J2 + 1) * (2.0 * J1 - 1.0) *
                     (2.0 * J2 + 3.0)) *
               Wigner9j(J1, J1 - 1, 1, J2, J2 + 1, 1, J, J + 1, 1) *
-              CleGor(J + 1, 0, J1 - 1, 0, J2 + 1, 0) *
+              CleGor(wigner, J + 1, 0, J1 - 1, 0, J2 + 1, 0) *
               std::sqrt(J / (2.0 * J + 1.0)) +
           sqrt(J1 * J2 * (2.0 * J1 + 3.0) * (2.0 * J2 - 1.0)) *
               Wigner9j(J1, J1 + 1, 1, J2, J2 - 1, 1, J, J + 1, 1) *
-              CleGor(J + 1, 0, J1 + 1, 0, J2 - 1, 0) *
+              CleGor(wigner, J + 1, 0, J1 + 1, 0, J2 - 1, 0) *
               std::sqrt(J / (2.0 * J + 1.0)) -
           std::sqrt(J1 * (J2 + 1) * (2.0 * J1 + 3.0) * (2.0 * J2 + 3.0)) *
               Wigner9j(J1, J1 + 1, 1, J2, J2 + 1, 1, J, J + 1, 1) *         // seems alright
-              CleGor(J + 1, 0, J1 + 1, 0, J2 + 1, 0) *
+              CleGor(wigner, J + 1, 0, J1 + 1, 0, J2 + 1, 0) *
               std::sqrt(J / (2.0 * J + 1.0)) +
           std::sqrt((J1 + 1.0) * J2 * (2.0 * J1 - 1.0) * (2.0 * J2 - 1.0)) *
               Wigner9j(J1, J1 - 1, 1, J2, J2 - 1, 1, J, J - 1, 1) *
-              CleGor(J - 1, 0, J1 - 1, 0, J2 - 1, 0) *
+              CleGor(wigner, J - 1, 0, J1 - 1, 0, J2 - 1, 0) *
               std::sqrt((J + 1) / (2.0 * J + 1.0)) -
           std::sqrt((J1 + 1.0) * (J2 + 1) * (2.0 * J1 - 1.0) *
                     (2.0 * J2 + 3.0)) *
               Wigner9j(J1, J1 - 1, 1, J2, J2 + 1, 1, J, J - 1, 1) *
-              CleGor(J - 1, 0, J1 - 1, 0, J2 + 1, 0) *
+              CleGor(wigner, J - 1, 0, J1 - 1, 0, J2 + 1, 0) *
               std::sqrt((J + 1) / (2.0 * J + 1.0)) +
           std::sqrt(J1 * J2 * (2.0 * J1 + 3.0) * (2.0 * J2 - 1.0)) *
               Wigner9j(J1, J1 + 1, 1, J2, J2 - 1, 1, J, J - 1, 1) *
-              CleGor(J - 1, 0, J1 + 1, 0, J2 - 1, 0) *
+              CleGor(wigner, J - 1, 0, J1 + 1, 0, J2 - 1, 0) *
               std::sqrt((J + 1) / (2.0 * J + 1.0)) -
           std::sqrt(J1 * (J2 + 1) * (2.0 * J1 + 3.0) * (2.0 * J2 + 3.0)) *
               Wigner9j(J1, J1 + 1, 1, J2, J2 + 1, 1, J, J - 1, 1) *
-              CleGor(J - 1, 0, J1 + 1, 0, J2 + 1, 0) *
+              CleGor(wigner, J - 1, 0, J1 + 1, 0, J2 + 1, 0) *
               std::sqrt((J + 1) / (2.0 * J + 1.0)));
-              
- brojac++;
-}
+  });
 }
 
-void C_00m1coeff(double *C_00m1, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-  
-for (int tt = gran1; tt < gran2; tt++) {
-
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-J =k.first;
-M = k.second;
+void C_00m1coeff(double *C_00m1, const CouplingPattern &pattern, int gran1, int gran2){
 
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second;
-
-  C_00m1[brojac] = std::sqrt(3.0 / 2.0 / consPi) * (2.0 * J1 + 1.0) *
-         CleGor(J, M, J1, M1, J2, M2) *
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    C_00m1[tt - gran1] = std::sqrt(3.0 / 2.0 / consPi) * (2.0 * J1 + 1.0) *
+         CleGor(wigner, J, M, J1, M1, J2, M2) *
          (std::sqrt(J2 * (2.0 * J2 - 1.0)) * 
               Wigner9j(J1, J1, 1, J2, J2 - 1, 1, J, J, 1) *
-              CleGor(J, 0, J1, 0, J2 - 1, 0) -
+              CleGor(wigner, J, 0, J1, 0, J2 - 1, 0) -
           std::sqrt((J2 + 1.0) * (2.0 * J2 + 3.0)) *
               Wigner9j(J1, J1, 1, J2, J2 + 1, 1, J, J, 1) *
-              CleGor(J, 0, J1, 0, J2 + 1, 0));
-              
-              brojac++;
+              CleGor(wigner, J, 0, J1, 0, J2 + 1, 0));
+  });
 }
-}
-
-void C_01m1coeff(double *C_01m1, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-  
-for (int tt = gran1; tt < gran2; tt++) {
-
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-J =k.first;
-M = k.second;
 
-J1 =p.first;
-M1 = p.second;
+void C_01m1coeff(double *C_01m1, const CouplingPattern &pattern, int gran1, int gran2){
 
-J2 =q.first;
-M2 = q.second;
-
-  C_01m1[brojac] = std::sqrt(3.0 / 2.0 / consPi) * CleGor(J, M, J1, M1, J2, M2) *
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    C_01m1[tt - gran1] = std::sqrt(3.0 / 2.0 / consPi) * CleGor(wigner, J, M, J1, M1, J2, M2) *
          (std::sqrt((J1 + 1.0) * J2 * (2.0 * J1 - 1.0) * (2.0 * J2 - 1.0)) *
               Wigner9j(J1, J1 - 1, 1, J2, J2 - 1, 1, J, J, 1) *
-              CleGor(J, 0, J1 - 1, 0, J2 - 1, 0) -
+              CleGor(wigner, J, 0, J1 - 1, 0, J2 - 1, 0) -
           std::sqrt((J1 + 1.0) * (J2 + 1.0) * (2.0 * J1 - 1.0) *
                     (2.0 * J2 + 3.0)) *
               Wigner9j(J1, J1 - 1, 1, J2, J2 + 1, 1, J, J, 1) *
-              CleGor(J, 0, J1 - 1, 0, J2 + 1, 0) +
+              CleGor(wigner, J, 0, J1 - 1, 0, J2 + 1, 0) +
           std::sqrt(J1 * J2 * (2.0 * J1 + 3.0) * (2.0 * J2 - 1.0)) *
               Wigner9j(J1, J1 + 1, 1, J2, J2 - 1, 1, J, J, 1) *
-              CleGor(J, 0, J1 + 1, 0, J2 - 1, 0) -
+              CleGor(wigner, J, 0, J1 + 1, 0, J2 - 1, 0) -
           std::sqrt(J1 * (J2 + 1) * (2.0 * J1 + 3.0) * (2.0 * J2 + 3.0)) * 
               Wigner9j(J1, J1 + 1.0, 1.0, J2, J2 + 1.0, 1.0, J, J, 1.0) *
-              CleGor(J, 0, J1 + 1.0, 0, J2 + 1.0, 0));
-              
-             brojac++;
-}
+              CleGor(wigner, J, 0, J1 + 1.0, 0, J2 + 1.0, 0));
+  });
 }
 
 // W numbers
 
-void W_m1m1coeff (double *W_m1m1, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-  
-for (int tt = gran1; tt < gran2; tt++) {
+void W_m1m1coeff (double *W_m1m1, const CouplingPattern &pattern, int gran1, int gran2){
 
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-J =k.first;
-M = k.second;
-
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second;
-
-W_m1m1[brojac] = std::sqrt(J1 / (2.0 * J1 + 1.0)) *
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    W_m1m1[tt - gran1] = std::sqrt(J1 / (2.0 * J1 + 1.0)) *
                   std::sqrt(J2 / (2.0 * J2 + 1.0)) * 
-                  W(J1 - 1, J1, M1, J2 - 1, J2,
+                  W(wigner, J1 - 1, J1, M1, J2 - 1, J2,
                     M2, J, M) +
               std::sqrt((J1 + 1) / (2.0 * J1 + 1.0)) *
                   std::sqrt((J2 + 1) / (2.0 * J2 + 1.0)) *
-                  W(J1 + 1, J1, M1, J2 + 1, J2,  
+                  W(wigner, J1 + 1, J1, M1, J2 + 1, J2,  
                     M2, J, M) -
               std::sqrt(J1 / (2.0 * J1 + 1.0)) *
                   std::sqrt((J2 + 1) / (2.0 * J2 + 1.0)) *
-                  W(J1 - 1, J1, M1, J2 + 1, J2,
+                  W(wigner, J1 - 1, J1, M1, J2 + 1, J2,
                     M2, J, M) -
               std::sqrt((J1 + 1) / (2.0 * J1 + 1.0)) *
                   std::sqrt(J2 / (2.0 * J2 + 1.0)) *
-                  W(J1 + 1, J1, M1, J2 - 1, J2,
+                  W(wigner, J1 + 1, J1, M1, J2 - 1, J2,
                     M2, J, M);
  
-           brojac++;
-              
-       }
+  });
               
   }
      
      
-void W_11coeff (double *W_11, int nMax, int nMaxS, int gran1, int gran2){
+void W_11coeff (double *W_11, const CouplingPattern &pattern, int gran1, int gran2){
 
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-  
-for (int tt = gran1; tt < gran2; tt++) {
-
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-J =k.first;
-M = k.second;
-
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second;
-
-  W_11[brojac] =  std::sqrt((J1 + 1.0) / (2.0 * J1 + 1.0)) *
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    W_11[tt - gran1] = std::sqrt((J1 + 1.0) / (2.0 * J1 + 1.0)) *
                std::sqrt((J2 + 1.0) / (2.0 * J2 + 1.0)) *
-               W(J1 - 1, J1, M1, J2 - 1, J2, M2,
+               W(wigner, J1 - 1, J1, M1, J2 - 1, J2, M2,
                  J, M) +
            std::sqrt(J1 / (2.0 * J1 + 1.0)) *
                std::sqrt(J2 / (2.0 * J2 + 1.0)) *
-               W(J1 + 1.0, J1, M1, J2 + 1.0, J2, M2,
+               W(wigner, J1 + 1.0, J1, M1, J2 + 1.0, J2, M2,
                  J, M) +                                                             
            std::sqrt((J1 + 1.0) / (2.0 * J1 + 1.0)) *
                std::sqrt(J2 / (2.0 * J2 + 1.0)) *
-               W(J1 - 1.0, J1, M1, J2 + 1.0, J2, M2,
+               W(wigner, J1 - 1.0, J1, M1, J2 + 1.0, J2, M2,
                  J, M) +
            std::sqrt(J1 / (2.0 * J1 + 1.0)) *
                std::sqrt((J2 + 1.0) / (2.0 * J2 + 1.0)) *
-               W(J1 + 1.0, J1, M1, J2 - 1.0, J2, M2,
+               W(wigner, J1 + 1.0, J1, M1, J2 - 1.0, J2, M2,
                  J, M);
 
-         brojac++;  
-                 
-        }
+  });
   }
   
-void W_00coeff (double *W_00, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-
-for (int tt = gran1; tt < gran2; tt++) {
+void W_00coeff (double *W_00, const CouplingPattern &pattern, int gran1, int gran2){
 
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    W_00[tt - gran1] = W(wigner, J1, J1, M1, J2, J2, M2, J, M);
 
-J =k.first;
-M = k.second;
-
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second;
-
-W_00[brojac] = W(J1, J1, M1, J2, J2, M2, J, M);
-
-brojac++;
-
-}
+  });
 }
 
-void W_10coeff (double *W_10, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-
-for (int tt = gran1; tt < gran2; tt++) {
-
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-J =k.first;
-M = k.second;
+void W_10coeff (double *W_10, const CouplingPattern &pattern, int gran1, int gran2){
 
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second;
-
- W_10[brojac] = std::sqrt((J1 + 1.0) / (2.0 * J1 + 1.0)) *
-                    W(J1 - 1.0, J1, M1, J2, J2,
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    W_10[tt - gran1] = std::sqrt((J1 + 1.0) / (2.0 * J1 + 1.0)) *
+                    W(wigner, J1 - 1.0, J1, M1, J2, J2,
                       M2, J, M) +
                 std::sqrt(J1 / (2.0 * J1 + 1.0)) *
-                    W(J1 + 1.0, J1, M1, J2, J2,
+                    W(wigner, J1 + 1.0, J1, M1, J2, J2,
                       M2, J, M);
 
-    brojac++;
-
-   }
+  });
   }          
 
 
-void W_01coeff (double *W_01, int nMax, int nMaxS, int gran1, int gran2){
-
-CompoundIterator p, q, k;
-  int pMax = p.max(nMax);
-  int qMax = q.max(nMax);
-  int kMax = k.max(nMaxS);
-  
-  int J, M, J1, M1, J2, M2, brojac(0);
-  
-for (int tt = gran1; tt < gran2; tt++) {
-
- q = tt % qMax;
- p = (tt / qMax) % pMax;
- k = tt / (pMax * qMax);
-
-J =k.first;
-M = k.second;
-
-J1 =p.first;
-M1 = p.second;
-
-J2 =q.first;
-M2 = q.second;
+void W_01coeff (double *W_01, const CouplingPattern &pattern, int gran1, int gran2){
 
-   W_01[brojac] = std::sqrt((J2 + 1.0) / (2.0 * J2 + 1.0)) *
-                    W(J1, J1, M1, J2 - 1.0, J2,
+  Wigner3jTable wigner;
+  pattern.for_each(gran1, gran2, [&](int tt, int J, int M, int J1, int M1, int J2, int M2) {
+    W_01[tt - gran1] = std::sqrt((J2 + 1.0) / (2.0 * J2 + 1.0)) *
+                    W(wigner, J1, J1, M1, J2 - 1.0, J2,
                       M2, J, M) +
                   std::sqrt(J2 / (2.0 * J2 + 1.0)) *
-                    W(J1, J1, M1, J2 + 1.0, J2,
+                    W(wigner, J1, J1, M1, J2 + 1.0, J2,
                       M2, J, M);
   
-         brojac++;
-                      
-     }
+  });
    }                   
-#endif
          
 } // namespace symbol
 } // namespace optimet
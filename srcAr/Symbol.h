@@ -26,34 +26,91 @@
 #include "Scatterer.h"
 #include "ElectroMagnetic.h"
 #include "CompoundIterator.h"
+#include <algorithm>
+#include <array>
+#include <map>
+#include <vector>
 
 namespace optimet {
 namespace symbol {
  
+/**
+ * The CouplingPattern class lists the couplings (k, p, q) of the SH source
+ * coefficients allowed by the selection rules of the Clebsch-Gordan
+ * coefficients, M = M1 + M2 and |J1 - J2| <= J <= J1 + J2. The tables of
+ * C and W numbers only hold the values of these couplings, in the same order.
+ */
+struct CouplingPattern {
+  CouplingPattern(int nMax = 0, int nMaxS = 0);
+  //! The k of the i-th coupling
+  int k(int i) const;
+  //! Number of couplings
+  int size() const { return pq.size(); }
+  //! \brief Calls f(i, J, M, J1, M1, J2, M2) for the couplings first <= i < last, in order
+  //! \details The harmonic indices of k, p and q come from tables, and k from walking the
+  //! pattern, rather than from a search and CompoundIterator for each coupling.
+  template <class F> void for_each(int first, int last, F &&f) const;
+
+  int nMax, nMaxS;
+  //! The couplings of k are start[k] to start[k + 1] - 1
+  std::vector<int> start;
+  //! The compound index qMax p + q of each coupling
+  std::vector<int> pq;
+};
+
+template <class F> void CouplingPattern::for_each(int first, int last, F &&f) const {
+  if(first >= last)
+    return;
+  auto const indices = harmonic_indices(std::max(nMax, nMaxS));
+  int const qMax = max_flat_index(nMax);
+  for(int i = first, kk = k(first); i < last; ++i) {
+    while(i >= start[kk + 1])
+      ++kk;
+    auto const &J = indices[kk], &J1 = indices[pq[i] / qMax], &J2 = indices[pq[i] % qMax];
+    f(i, J.first, J.second, J1.first, J1.second, J2.first, J2.second);
+  }
+}
+
 double Wigner3j(int j1, int j2, int j3, int m1, int m2, int m3);
+
+//! \brief The 3j symbols (j1 j2 j3; m1 m2 -m1-m2) of j3 = max(|j1 - j2|, |m1 + m2|) to j1 + j2
+//! \details Computed in one sweep by the three-term recursion in j3 of Schulten and Gordon,
+//! J. Math. Phys. 16, 1961 (1975), run inwards from both ends of the range.
+std::vector<double> Wigner3jRange(int j1, int j2, int m1, int m2);
+
+/**
+ * The Wigner3jTable class evaluates 3j symbols through Wigner3jRange. The
+ * symbols of every j3 allowed by (j1, j2, m1, m2) are computed on the first
+ * call and kept for the later ones, so that a loop over the couplings costs
+ * one recursion per (j1, j2, m1, m2) rather than one factorial sum per symbol.
+ */
+class Wigner3jTable {
+public:
+  //! The 3j symbol (j1 j2 j3; m1 m2 m3), zero if it is not allowed
+  double operator()(int j1, int j2, int j3, int m1, int m2, int m3);
+
+private:
+  //! The symbols of the j3 range of each (j1, j2, m1, m2)
+  std::map<std::array<int, 4>, std::vector<double>> ranges_;
+};
                            
-std::complex<double> CXm1(CompoundIterator &kk, double *W_m1m1, double *W_00, double *W_11, int nMax,
-                            optimet::Vector<optimet::t_complex> &internalCoef_FF_,
-                            double r,
-                            int objectIndex_, double omega,
-                            const Scatterer &object);
-                            
-std::complex<double> CXp1(CompoundIterator &kk, double *W_m1m1, double *W_00, double *W_11, int nMax,
-                            optimet::Vector<optimet::t_complex> &internalCoef_FF_,
-                            double r,
-                            int objectIndex_, double omega,
-                            const Scatterer &object);                            
-#ifdef OPTIMET_MPI                                                       
-void C_10m1coeff (double *C_10m1, int nMax, int nMaxS, int gran1, int gran2); 
-void C_11m1coeff (double *C_11m1, int nMax, int nMaxS, int gran1, int gran2);  
-void C_00m1coeff (double *C_00m1, int nMax, int nMaxS, int gran1, int gran2);  
-void C_01m1coeff (double *C_01m1, int nMax, int nMaxS, int gran1, int gran2);  
-void W_m1m1coeff  (double *W_m1m1, int nMax, int nMaxS, int gran1, int gran2);    
-void W_11coeff  (double *W_11, int nMax, int nMaxS, int gran1, int gran2); 
-void W_00coeff  (double *W_00, int nMax, int nMaxS, int gran1, int gran2);
-void W_10coeff  (double *W_10, int nMax, int nMaxS, int gran1, int gran2);  
-void W_01coeff  (double *W_01, int nMax, int nMaxS, int gran1, int gran2);
-#endif  
+//! \brief Coefficients of the Xm1 and Xp1 spherical functions of all the SH sources at r
+//! \details One sweep over the couplings of the pattern gives both coefficients of each k,
+//! coefXmn and coefXpl having nMaxS (nMaxS + 2) values. The W numbers are read from the
+//! tables, indexed as the couplings, or computed row by row when any of them is null.
+void CXm1p1(double *W_m1m1, double *W_00, double *W_11, const CouplingPattern &pattern, int nMax,
+            int nMaxS, optimet::Vector<optimet::t_complex> &internalCoef_FF_, double r,
+            int objectIndex_, double omega, const Scatterer &object,
+            std::complex<double> *coefXmn, std::complex<double> *coefXpl);                            
+void C_10m1coeff (double *C_10m1, const CouplingPattern &pattern, int gran1, int gran2); 
+void C_11m1coeff (double *C_11m1, const CouplingPattern &pattern, int gran1, int gran2);  
+void C_00m1coeff (double *C_00m1, const CouplingPattern &pattern, int gran1, int gran2);  
+void C_01m1coeff (double *C_01m1, const CouplingPattern &pattern, int gran1, int gran2);  
+void W_m1m1coeff  (double *W_m1m1, const CouplingPattern &pattern, int gran1, int gran2);    
+void W_11coeff  (double *W_11, const CouplingPattern &pattern, int gran1, int gran2); 
+void W_00coeff  (double *W_00, const CouplingPattern &pattern, int gran1, int gran2);
+void W_10coeff  (double *W_10, const CouplingPattern &pattern, int gran1, int gran2);  
+void W_01coeff  (double *W_01, const CouplingPattern &pattern, int gran1, int gran2);
 } // namespace symbol
 } // namespace optimet
 
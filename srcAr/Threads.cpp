@@ -0,0 +1,115 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#include "Threads.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#ifdef OPTIMET_OPENMP
+#include <omp.h>
+#endif
+#if defined(OPTIMET_OPENMP) and defined(__linux__)
+#include <sched.h>
+#endif
+#ifdef OPTIMET_MPI
+#include "mpi/Communicator.h"
+#endif
+
+namespace optimet {
+namespace {
+#if defined(OPTIMET_OPENMP) and defined(__linux__)
+//! A value of the topology of the cpu, or the cpu itself if the kernel does not tell
+int topology(int cpu, std::string const &name) {
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" + name);
+  int result = cpu;
+  file >> result;
+  return file ? result : cpu;
+}
+
+//! The cpus of each place, from those the process may run on
+std::vector<std::vector<int>> find_places(std::string const &places) {
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if(sched_getaffinity(0, sizeof(mask), &mask) != 0)
+    return {};
+  // socket, core and cpu of each cpu, grouped into places by the first one or two
+  std::vector<std::tuple<int, int, int>> cpus;
+  for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    if(CPU_ISSET(cpu, &mask))
+      cpus.emplace_back(topology(cpu, "physical_package_id"), topology(cpu, "core_id"), cpu);
+  std::sort(cpus.begin(), cpus.end());
+  std::vector<std::vector<int>> result;
+  for(std::size_t i = 0; i < cpus.size(); ++i) {
+    bool const same =
+        i > 0 and
+        ((places == "sockets" and std::get<0>(cpus[i]) == std::get<0>(cpus[i - 1])) or
+         (places == "cores" and std::get<0>(cpus[i]) == std::get<0>(cpus[i - 1]) and
+          std::get<1>(cpus[i]) == std::get<1>(cpus[i - 1])));
+    if(not same)
+      result.emplace_back();
+    result.back().push_back(std::get<2>(cpus[i]));
+  }
+  return result;
+}
+#endif
+} // namespace
+
+void bind_threads(t_uint threads, std::string const &bind, std::string const &places) {
+  if(bind != "none" and bind != "close" and bind != "spread")
+    throw std::runtime_error("The binding of the threads must be none, close or spread");
+  if(places != "threads" and places != "cores" and places != "sockets")
+    throw std::runtime_error("The places of the threads must be threads, cores or sockets");
+#ifdef OPTIMET_OPENMP
+  if(threads > 0)
+    omp_set_num_threads(threads);
+#ifdef __linux__
+  if(bind == "none")
+    return;
+  auto all = find_places(places);
+  if(all.empty())
+    return;
+#ifdef OPTIMET_MPI
+  // processes left unbound by the launcher share the places of the node
+  auto const node = mpi::Communicator().split_shared();
+  int const first = all.front().front();
+  int lowest = first, highest = first;
+  MPI_Allreduce(&first, &lowest, 1, MPI_INT, MPI_MIN, *node);
+  MPI_Allreduce(&first, &highest, 1, MPI_INT, MPI_MAX, *node);
+  if(lowest == highest and node.size() > 1 and all.size() >= node.size()) {
+    auto const begin = all.begin() + node.rank() * all.size() / node.size();
+    auto const end = all.begin() + (node.rank() + 1) * all.size() / node.size();
+    all = std::vector<std::vector<int>>(begin, end);
+  }
+#endif
+#pragma omp parallel
+  {
+    std::size_t const t = omp_get_thread_num(), T = omp_get_num_threads(), P = all.size();
+    // consecutive threads on consecutive places, or as far apart as the places allow, the
+    // threads sharing the places in turn when there are more of them
+    auto const &place = all[bind == "close" and T <= P ? t : t * P / T];
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for(auto const cpu : place)
+      CPU_SET(cpu, &mask);
+    sched_setaffinity(0, sizeof(mask), &mask);
+  }
+#endif
+#else
+  (void)threads;
+#endif
+}
+} // namespace optimet
@@ -0,0 +1,47 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_THREADS_H
+#define OPTIMET_THREADS_H
+
+#include "Types.h"
+#include <cstddef>
+#include <string>
+
+namespace optimet {
+
+//! \brief Sets the number of threads of each process and binds them to the places of its cpus
+//! \details The places are the hardware threads, cores or sockets the process may run on, in the
+//! order of the sockets and cores. The threads are bound to consecutive places with "close",
+//! spread evenly over them with "spread", and left to the OpenMP runtime with "none". When the
+//! processes of a node all see the same cpus, as when the MPI launcher binds none, each takes its
+//! share of the places. Zero threads keeps the default of the runtime. Without OpenMP, or outside
+//! of Linux, only the check of the arguments remains.
+void bind_threads(t_uint threads, std::string const &bind, std::string const &places);
+
+//! \brief Zeroes count blocks of block values at data, in parallel
+//! \details The threads touch the blocks in the static partition of a parallel loop over count,
+//! so that the pages of each block are on the socket of the thread working on it in such a loop
+//! later on. The memory should be freshly allocated, and not yet written to.
+template <class T> void first_touch(T *data, std::size_t count, std::size_t block) {
+#ifdef OPTIMET_OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(t_int k = 0; k < static_cast<t_int>(count); ++k)
+    for(std::size_t i = 0; i < block; ++i)
+      data[k * block + i] = T(0);
+}
+} // namespace optimet
+#endif
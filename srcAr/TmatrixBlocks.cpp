@@ -0,0 +1,71 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#include "TmatrixBlocks.h"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+namespace optimet {
+
+namespace {
+//! FNV-1a hash of the entries of a block
+std::uint64_t hash(Matrix<t_complex> const &block) {
+  auto const bytes = reinterpret_cast<unsigned char const *>(block.data());
+  std::uint64_t result = 14695981039346656037ull;
+  for(std::size_t i = 0; i < block.size() * sizeof(t_complex); ++i)
+    result = (result ^ bytes[i]) * 1099511628211ull;
+  return result;
+}
+} // namespace
+
+bool diagonal_tmatrix(Matrix<t_complex> const &T, t_uint first, t_uint n) {
+  for(t_uint j = 0; j < n; ++j)
+    for(t_uint i = 0; i < n; ++i)
+      if(i != j and T(i, first + j) != t_complex(0))
+        return false;
+  return true;
+}
+
+TmatrixBlocks::TmatrixBlocks(Matrix<t_complex> const &T, t_uint n) {
+  t_uint const nobj = n == 0 ? 0 : T.cols() / n;
+  // the blocks found so far by a hash of their entries, identical particles having equal copies
+  std::unordered_map<std::uint64_t, std::vector<t_uint>> found;
+  for(t_uint i = 0; i < nobj; ++i) {
+    diagonal_.push_back(diagonal_tmatrix(T, i * n, n));
+    Matrix<t_complex> block = T.block(0, i * n, n, n);
+    if(diagonal_.back())
+      block = Matrix<t_complex>(block.diagonal());
+    auto &candidates = found[hash(block)];
+    auto const same = std::find_if(candidates.begin(), candidates.end(), [&](t_uint kind) {
+      return blocks_[kind].cols() == block.cols() and blocks_[kind] == block;
+    });
+    if(same != candidates.end()) {
+      kinds_.push_back(*same);
+      continue;
+    }
+    kinds_.push_back(blocks_.size());
+    candidates.push_back(blocks_.size());
+    blocks_.emplace_back(std::move(block));
+  }
+}
+
+t_real TmatrixBlocks::memory() const {
+  t_real result = 0;
+  for(auto const &block : blocks_)
+    result += block.size() * (16.0 / 1e6);
+  return result;
+}
+}
@@ -0,0 +1,68 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_TMATRIX_BLOCKS_H
+#define OPTIMET_TMATRIX_BLOCKS_H
+
+#include "Types.h"
+#include <vector>
+
+namespace optimet {
+
+//! \brief Whether the T-matrix of a scatterer has no entry off its diagonal, as those of the spheres
+//! \details The block of the scatterer is the n columns from first of the T-matrices side by side.
+//! The search stops at the first entry off the diagonal, usually within the first column.
+bool diagonal_tmatrix(Matrix<t_complex> const &T, t_uint first, t_uint n);
+
+/**
+ * The TmatrixBlocks class holds the T-matrices of the scatterers, those
+ * which are diagonal, as the Mie coefficients of the spheres, as vectors.
+ * Applying such a T-matrix to a vector then costs O(pMax) rather than
+ * O(pMax^2), and to a coupling block O(pMax^2) rather than O(pMax^3).
+ * Scatterers with the same T-matrix, as identical spheres, share one block.
+ */
+class TmatrixBlocks {
+public:
+  /**
+   * Initialization constructor for the TmatrixBlocks class.
+   * @param T the T-matrices of the scatterers side by side, n by nobj n.
+   * @param n the size of the T-matrix of one scatterer.
+   */
+  TmatrixBlocks(Matrix<t_complex> const &T, t_uint n);
+
+  //! Whether the T-matrix of scatterer i is diagonal
+  bool diagonal(t_uint i) const { return diagonal_[i]; }
+  //! T_i X
+  template <class DERIVED>
+  Matrix<t_complex> left(t_uint i, Eigen::MatrixBase<DERIVED> const &X) const {
+    if(diagonal_[i])
+      return blocks_[kinds_[i]].col(0).asDiagonal() * X;
+    return blocks_[kinds_[i]] * X;
+  }
+  //! Number of distinct T-matrices
+  t_uint kinds() const { return blocks_.size(); }
+  //! Memory held in MB
+  t_real memory() const;
+
+private:
+  //! Whether the T-matrix of each scatterer is diagonal
+  std::vector<bool> diagonal_;
+  //! The block of each scatterer
+  std::vector<t_uint> kinds_;
+  //! The distinct T-matrices, a single column for the diagonal ones
+  std::vector<Matrix<t_complex>> blocks_;
+};
+}
+#endif
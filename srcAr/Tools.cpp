@@ -15,9 +15,11 @@
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
 #include "Tools.h"
+#include "constants.h"
 #include <cmath>
 #include <assert.h>
 #include <iostream>
+#include <stdexcept>
 
 Tools::Tools() {
   //
@@ -44,19 +46,19 @@ Cartesian<double> Tools::toCartesian(Spherical<double> point) {
 }
 
 // dot product (double)
-double Tools::dot(double *uvec,  double *vvec)
+double Tools::dot(const double* uvec,  const double* vvec)
    {
 	   return uvec[0] * vvec[0] + uvec[1] * vvec[1] + uvec[2] * vvec[2];
    }
    
  // dot product (complex)
- std::complex<double> Tools::dot(double* uvec,  std::complex<double>* vvec)
+ std::complex<double> Tools::dot(const double* uvec,  std::complex<double>* vvec)
    {
 	   return uvec[0] * vvec[0] + uvec[1] * vvec[1] + uvec[2] * vvec[2];
    }
 
   // dot product (double, SphericalP)
-  std::complex<double> Tools::dot(double* uvec,  SphericalP<std::complex<double>> vvec)
+  std::complex<double> Tools::dot(const double* uvec,  SphericalP<std::complex<double>> vvec)
    {
 	   return uvec[0] * vvec.rrr + uvec[1] * vvec.the + uvec[2] * vvec.phi;
    }
@@ -68,8 +70,8 @@ double Tools::dot(double *uvec,  double *vvec)
    }
   
   // cross product of two vectors (double)
-  void Tools::cross(double* res, double* u,
-	 double* v)
+  void Tools::cross(double* res, const double* u,
+	 const double* v)
 {
 
 	res[0] = u[1] * v[2] - u[2] *  v[1];
@@ -86,7 +88,7 @@ double Tools::dot(double *uvec,  double *vvec)
 
 }
 
-void Tools::cross(std::complex<double>* res, double* u, SphericalP<std::complex<double>> v){
+void Tools::cross(std::complex<double>* res, const double* u, SphericalP<std::complex<double>> v){
         
         res[0] = u[1] * v.phi - u[2] *  v.the;
 	res[1] = u[2] * v.rrr - u[0] *  v.phi;
@@ -95,7 +97,7 @@ void Tools::cross(std::complex<double>* res, double* u, SphericalP<std::complex<
 }
 
 // -nxnxE
-void Tools::crossTanTr(std::complex<double>* res, std::complex<double>* resCR, double* u, SphericalP<std::complex<double>> v){
+void Tools::crossTanTr(std::complex<double>* res, std::complex<double>* resCR, const double* u, SphericalP<std::complex<double>> v){
         
         resCR[0] = u[1] * v.phi - u[2] *  v.the;
 	resCR[1] = u[2] * v.rrr - u[0] *  v.phi;
@@ -108,7 +110,7 @@ void Tools::crossTanTr(std::complex<double>* res, std::complex<double>* resCR, d
 }
 
 // nxnxE
-void Tools::crossTan(std::complex<double>* res, std::complex<double>* resCR, double* u, std::complex<double>* v){
+void Tools::crossTan(std::complex<double>* res, std::complex<double>* resCR, const double* u, std::complex<double>* v){
         
         resCR[0] = u[1] * v[2] - u[2] *  v[1];
 	resCR[1] = u[2] * v[0] - u[0] *  v[2];
@@ -192,6 +194,87 @@ double Tools::norm2(double* vec)
 
 }
 
+namespace {
+// symmetric rule on a triangle of area 1/2, the weights summing to one over the orbits
+struct TriangleRule {
+  std::vector<std::vector<double>> points;
+  std::vector<double> weights;
+
+  void centroid(double w) { add(1.0 / 3.0, 1.0 / 3.0, w); }
+  // the three points (a, a, 1 - 2a)
+  void orbit3(double a, double w) {
+    double const b = 1.0 - 2.0 * a;
+    add(a, a, w);
+    add(a, b, w);
+    add(b, a, w);
+  }
+  // the six permutations of (a, b, 1 - a - b)
+  void orbit6(double a, double b, double w) {
+    double const c = 1.0 - a - b;
+    add(a, b, w);
+    add(b, a, w);
+    add(a, c, w);
+    add(c, a, w);
+    add(b, c, w);
+    add(c, b, w);
+  }
+  void add(double N1, double N2, double w) {
+    points.push_back({N1, N2});
+    weights.push_back(0.5 * w);
+  }
+};
+
+// Dunavant's rules, all points inside and all weights positive
+TriangleRule triangle_rule(int degree) {
+  TriangleRule rule;
+  switch(degree) {
+  case 1:
+    rule.centroid(1.0);
+    break;
+  case 2:
+    rule.orbit3(1.0 / 6.0, 1.0 / 3.0);
+    break;
+  case 3:
+    rule.points = Tools::getPoints4();
+    rule.weights = Tools::getWeights4();
+    break;
+  case 4:
+    rule.orbit3(0.445948490915965, 0.223381589678011);
+    rule.orbit3(0.091576213509771, 0.109951743655322);
+    break;
+  case 5:
+    rule.centroid(0.225);
+    rule.orbit3(0.470142064105115, 0.132394152788506);
+    rule.orbit3(0.101286507323456, 0.125939180544827);
+    break;
+  case 6:
+    rule.orbit3(0.249286745170910, 0.116786275726379);
+    rule.orbit3(0.063089014491502, 0.050844906370207);
+    rule.orbit6(0.053145049844817, 0.310352451033784, 0.082851075618374);
+    break;
+  case 7:
+  case 8:
+    rule.centroid(0.144315607677787);
+    rule.orbit3(0.459292588292723, 0.095091634267285);
+    rule.orbit3(0.170569307751760, 0.103217370534718);
+    rule.orbit3(0.050547228317031, 0.032458497623198);
+    rule.orbit6(0.008394777409958, 0.263112829634638, 0.027230314174435);
+    break;
+  default:
+    throw std::runtime_error("The triangle quadrature is exact up to degree 8 at most");
+  }
+  return rule;
+}
+}
+
+std::vector<std::vector<double>> Tools::getTrianglePoints(int degree) {
+  return triangle_rule(degree).points;
+}
+
+std::vector<double> Tools::getTriangleWeights(int degree) {
+  return triangle_rule(degree).weights;
+}
+
 // Gauss Legendre points on a line
 std::vector<double> Tools::getLineWghts4() {
 	std::vector<double> w(4);
@@ -245,6 +328,45 @@ std::vector<double> Tools::getLinePts6() {
 
 }
 
+namespace {
+// Gauss-Legendre points and weights on [-1, 1], by Newton iterations on the Legendre polynomial
+void gauss_legendre(int n, std::vector<double> &points, std::vector<double> &weights) {
+  points.resize(n);
+  weights.resize(n);
+  for(int i = 0; i < n; ++i) {
+    double x = std::cos(consPi * (i + 0.75) / (n + 0.5));
+    double derivative = 1.0;
+    for(int iteration = 0; iteration < 100; ++iteration) {
+      double p0 = 1.0, p1 = x;
+      for(int l = 2; l <= n; ++l) {
+        double const p2 = ((2 * l - 1) * x * p1 - (l - 1) * p0) / l;
+        p0 = p1;
+        p1 = p2;
+      }
+      derivative = n * (x * p1 - p0) / (x * x - 1.0);
+      double const dx = p1 / derivative;
+      x -= dx;
+      if(std::abs(dx) < 1e-15)
+        break;
+    }
+    points[i] = x;
+    weights[i] = 2.0 / ((1.0 - x * x) * derivative * derivative);
+  }
+}
+}
+
+std::vector<double> Tools::getLinePts(int n) {
+  std::vector<double> P, w;
+  gauss_legendre(n, P, w);
+  return P;
+}
+
+std::vector<double> Tools::getLineWghts(int n) {
+  std::vector<double> P, w;
+  gauss_legendre(n, P, w);
+  return w;
+}
+
 
 
 Spherical<double> Tools::toSpherical(Cartesian<double> point) {
@@ -300,6 +422,20 @@ Tools::fromProjection(Spherical<double> point,
       std::cos(point.phi) * vector.the - sin(point.phi) * vector.rrr);
 }
 
+SphericalP<std::complex<double>>
+Tools::fromProjection(Cartesian<double> point,
+                      SphericalP<std::complex<double>> vector) {
+  // theta = phi = 0 at the origin and on the axis, as in toSpherical
+  double const rho = std::sqrt(point.x * point.x + point.y * point.y);
+  double const r = std::sqrt(rho * rho + point.z * point.z);
+  double const st = r > 0.0 ? rho / r : 0.0, ct = r > 0.0 ? point.z / r : 1.0;
+  double const sp = rho > 0.0 ? point.y / rho : 0.0, cp = rho > 0.0 ? point.x / rho : 1.0;
+  return SphericalP<std::complex<double>>(
+      st * cp * vector.rrr + st * sp * vector.the + ct * vector.phi,
+      ct * cp * vector.rrr + ct * sp * vector.the - st * vector.phi,
+      cp * vector.the - sp * vector.rrr);
+}
+
 Spherical<double> Tools::toPoint(Spherical<double> R, Spherical<double> P) {
   Cartesian<double> R_cart = toCartesian(R);
   Cartesian<double> P_cart = toCartesian(P);
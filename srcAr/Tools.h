@@ -77,6 +77,17 @@ public:
   fromProjection(Spherical<double> point,
                  SphericalP<std::complex<double>> vector);
 
+  /**
+   * Projects a cartesian point onto a SphericalP vector (spherical projection),
+   * with the sines and cosines of its angles taken from its coordinates.
+   * @param point the point to be projected.
+   * @param vector the vector to be used as basis for projection.
+   * @return the projected vector in SphericalP.
+   */
+  static SphericalP<std::complex<double>>
+  fromProjection(Cartesian<double> point,
+                 SphericalP<std::complex<double>> vector);
+
   /**
    * Converts a point from spherical to SphericalP coordinates.
    * @param point - the coordinates of the point in
@@ -115,31 +126,31 @@ public:
   static long iteratorMax(long n);
 
   // scalar product between two vectors (double)
-   static double dot(double *uvec,  double *vvec);
+   static double dot(const double* uvec,  const double* vvec);
   
   // dot product (complex)
-   static std::complex<double> dot(double* uvec,  std::complex<double>* vvec);
+   static std::complex<double> dot(const double* uvec,  std::complex<double>* vvec);
 
    // dot product SphericalP
-   static std::complex<double> dot(double* uvec,  SphericalP<std::complex<double>> vvec);
+   static std::complex<double> dot(const double* uvec,  SphericalP<std::complex<double>> vvec);
 
     // dot product (cmplex double, SphericalP)
     static std::complex<double> dot(std::complex<double>* uvec,  SphericalP<std::complex<double>> vvec);
 
    // cross product of two vectors (double) 
-    static void cross(double* res, double* u, double* v);
+    static void cross(double* res, const double* u, const double* v);
 
   // cross product of two vectors (SphericalP) 
   static void cross(std::complex<double>* res, SphericalP<std::complex<double>> u, SphericalP<std::complex<double>> v);
 
   // cross product of two vectors (double and SphericalP) 
-   static void cross(std::complex<double>* res, double* u, SphericalP<std::complex<double>> v);
+   static void cross(std::complex<double>* res, const double* u, SphericalP<std::complex<double>> v);
 
    // tangential component of a vector (-nxnxE)
-   static void crossTanTr(std::complex<double>* res, std::complex<double>* resCR, double* u, SphericalP<std::complex<double>> v);
+   static void crossTanTr(std::complex<double>* res, std::complex<double>* resCR, const double* u, SphericalP<std::complex<double>> v);
 
    // minus tangential component of a vector (nxnx)
-   static void crossTan(std::complex<double>* res, std::complex<double>* resCR, double* u, std::complex<double>* v);
+   static void crossTan(std::complex<double>* res, std::complex<double>* resCR, const double* u, std::complex<double>* v);
 
   // different norms
         static double norm2(double* vec);
@@ -155,6 +166,12 @@ public:
    
    static std::vector<double> getWeights7();
 
+   //! \brief Points of the symmetric rule on a triangle exact up to the given degree, 1 to 8
+   //! \details Degree 3 is the 4-point rule of getPoints4(), the others have positive weights.
+   static std::vector<std::vector<double>> getTrianglePoints(int degree);
+   //! Weights of the rule of getTrianglePoints(), summing to the area 1/2 of the reference triangle
+   static std::vector<double> getTriangleWeights(int degree);
+
    // Gauss-Legendre integration points on a line       
     static std::vector<double> getLineWghts4();
              
@@ -163,6 +180,11 @@ public:
     static std::vector<double> getLineWghts6();
                          
     static std::vector<double> getLinePts6();
+
+   // Gauss-Legendre integration points and weights on a line, for any number of points
+    static std::vector<double> getLinePts(int n);
+
+    static std::vector<double> getLineWghts(int n);
  
   /**
    * Translate from one coordinate system to another.
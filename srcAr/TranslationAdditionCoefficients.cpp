@@ -17,11 +17,11 @@
 #include "TranslationAdditionCoefficients.h"
 #include "Bessel.h"
 #include "constants.h"
+#include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <complex>
-
-#include <boost/math/special_functions/legendre.hpp>
-#include <boost/math/special_functions/spherical_harmonic.hpp>
+#include <stdexcept>
 
 namespace optimet {
 namespace {
@@ -61,10 +61,49 @@ inline t_real b_minus(t_int n, t_int m) {
 }
 } // anonymous namespace
 
+void legendre(t_real cosine, t_real sine, t_int m, t_int lMax, t_real *result) {
+  assert(m >= 0);
+  if(m > lMax)
+    return;
+  t_real current = 1e0 / std::sqrt(4 * constant::pi);
+  for(t_int i = 1; i <= m; ++i)
+    current *= -std::sqrt((2 * i + 1) / (2e0 * i)) * sine;
+  // P_l+1 = a_l+1 (cos P_l - P_l-1 / a_l), a_l = sqrt((4 l^2 - 1) / (l^2 - m^2))
+  auto const a = [m](t_int l) {
+    return std::sqrt((4e0 * l * l - 1) / (static_cast<t_real>(l) * l - m * m));
+  };
+  t_real previous = 0;
+  for(t_int l = m; l <= lMax; ++l) {
+    result[l - m] = current;
+    auto const next = a(l + 1) * (cosine * current - (l > m ? previous / a(l) : 0e0));
+    previous = current;
+    current = next;
+  }
+}
+
+void spherical_harmonics(Spherical<t_real> const &R, t_int lMax, std::vector<t_complex> &result) {
+  result.resize((lMax + 1) * (lMax + 1));
+  thread_local std::vector<t_real> column;
+  column.resize(lMax + 1);
+  auto const c = std::cos(R.the), s = std::sin(R.the);
+  for(t_int m = 0; m <= lMax; ++m) {
+    legendre(c, s, m, lMax, column.data());
+    auto const phase = std::exp(t_complex(0, m * R.phi));
+    for(t_int l = m; l <= lMax; ++l) {
+      result[l * (l + 1) + m] = column[l - m] * phase;
+      if(m > 0)
+        result[l * (l + 1) - m] = (m % 2 == 0 ? 1e0 : -1e0) * column[l - m] * std::conj(phase);
+    }
+  }
+}
+
 t_complex Ynm(Spherical<t_real> const &R, t_int n, t_int m) {
   if(not is_valid(n, m))
     return 0;
-  return boost::math::spherical_harmonic(n, m, R.the, R.phi);
+  std::vector<t_real> column(n - std::abs(m) + 1);
+  legendre(std::cos(R.the), std::sin(R.the), std::abs(m), n, column.data());
+  auto const result = column.back() * std::exp(t_complex(0, std::abs(m) * R.phi));
+  return m >= 0 ? result : (m % 2 == 0 ? 1e0 : -1e0) * std::conj(result);
 }
 
 namespace details {
@@ -78,19 +117,55 @@ t_complex CachedRecurrence::operator()(t_int n, t_int m, t_int l, t_int k) {
   // separately using the symmetry
   // relationship.
   assert(m >= 0);
+  if(axial and k != m)
+    return 0e0;
 
-  // Check cache first
-  t_indices const indices{{n, m, l, k}};
-  auto const i_found = cache.find(indices);
-  if(i_found != cache.end())
-    return i_found->second;
+  if(n > nmax or l > 2 * nmax - n) {
+    if(not seeds.empty())
+      throw std::out_of_range("Translation addition coefficients beyond the given lattice sums");
+    tabulate(std::max(std::max(n, l), nmax + 1));
+  }
+  return table[index(n, m, l, k)];
+}
 
-  auto const result = recurrence(n, m, l, k);
-  cache[indices] = result;
-  return result;
+t_complex CachedRecurrence::value(t_int n, t_int m, t_int l, t_int k) const {
+  if(not is_valid(n, m, l, k) or (axial and k != m))
+    return 0e0;
+  assert(n <= nmax and l <= 2 * nmax - n);
+  return table[index(n, m, l, k)];
 }
 
-t_complex CachedRecurrence::recurrence(t_int n, t_int m, t_int l, t_int k) {
+void CachedRecurrence::tabulate(t_int nMax) {
+  nmax = nMax;
+  table.assign(static_cast<std::size_t>(nmax + 1) * (nmax + 1) * (2 * nmax + 1) *
+                   (axial ? 1 : 4 * nmax + 1),
+               0e0);
+  if(not seeds.empty())
+    assert(seeds.size() >= static_cast<std::size_t>((2 * nmax + 1) * (2 * nmax + 1)));
+  else {
+    radial.resize(2 * nmax + 1);
+    if(regular)
+      optimet::bessel<Bessel>(direction.rrr * waveK, 2 * nmax, radial.data(), nullptr);
+    else
+      optimet::bessel<Hankel1>(direction.rrr * waveK, 2 * nmax, radial.data(), nullptr);
+    spherical_harmonics(direction, 2 * nmax, harmonics);
+  }
+
+  // each n only depends on n - 1 and n - 2, for l up to one more
+  for(t_int n(0); n <= nmax; ++n)
+    for(t_int m(0); m <= n; ++m)
+      for(t_int l(0); l <= 2 * nmax - n; ++l) {
+        if(axial) {
+          if(m <= l)
+            table[index(n, m, l, m)] = recurrence(n, m, l, m);
+          continue;
+        }
+        for(t_int k(-l); k <= l; ++k)
+          table[index(n, m, l, k)] = recurrence(n, m, l, k);
+      }
+}
+
+t_complex CachedRecurrence::recurrence(t_int n, t_int m, t_int l, t_int k) const {
   if(n == 0 and m == 0)
     return initial(l, k);
   else if(n == m)
@@ -99,27 +174,27 @@ t_complex CachedRecurrence::recurrence(t_int n, t_int m, t_int l, t_int k) {
     return offdiagonal_recurrence(n, m, l, k);
 }
 
-t_complex CachedRecurrence::initial(t_int l, t_int k) {
+t_complex CachedRecurrence::initial(t_int l, t_int k) const {
   assert(l >= 0);
-  auto const wave = direction.rrr * waveK;
-  auto const bessel = regular ? optimet::bessel<Bessel> : optimet::bessel<Hankel1>;
-  auto const hb = std::get<0>(bessel(wave, l)).back();
+  if(not seeds.empty())
+    return seeds[l * (l + 1) + k];
+  auto const hb = radial[l];
   if(l == 0 and k == 0)
     return hb;
   auto const factor = std::sqrt(4e0 * constant::pi) * ((l + k) % 2 == 0 ? 1 : -1);
-  return factor * Ynm(direction, l, -k) * hb;
+  return factor * harmonics[l * (l + 1) - k] * hb;
 }
 
-t_complex CachedRecurrence::diagonal_recurrence(t_int n, t_int l, t_int k) {
-  return (operator()(n - 1, n - 1, l - 1, k - 1) * b_plus(l - 1, k - 1) +
-          operator()(n - 1, n - 1, l + 1, k - 1) * b_minus(l + 1, k - 1)) /
+t_complex CachedRecurrence::diagonal_recurrence(t_int n, t_int l, t_int k) const {
+  return (value(n - 1, n - 1, l - 1, k - 1) * b_plus(l - 1, k - 1) +
+          value(n - 1, n - 1, l + 1, k - 1) * b_minus(l + 1, k - 1)) /
          b_plus(n - 1, n - 1);
 }
 
-t_complex CachedRecurrence::offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k) {
-  return (-operator()(n - 2, m, l, k) * a_minus(n - 1, m) +
-          operator()(n - 1, m, l - 1, k) * a_plus(l - 1, k) +
-          operator()(n - 1, m, l + 1, k) * a_minus(l + 1, k)) /
+t_complex CachedRecurrence::offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k) const {
+  return (-value(n - 2, m, l, k) * a_minus(n - 1, m) +
+          value(n - 1, m, l - 1, k) * a_plus(l - 1, k) +
+          value(n - 1, m, l + 1, k) * a_minus(l + 1, k)) /
          a_plus(n - 1, m);
 }
 
@@ -130,8 +205,119 @@ t_complex TranslationAdditionCoefficients::operator()(t_int n, t_int m, t_int l,
     return positive(n, m, l, k);
 
   auto const sign = negative.is_regular() ? k + m : n + m + l + k;
-  auto const result = std::conj(negative(n, -m, l, -k));
+  auto const result = std::conj((shared ? positive : negative)(n, -m, l, -k));
   return sign % 2 == 0 ? result : -result;
 }
 
+std::vector<t_complex> TranslationAdditionCoefficients::seeds(std::vector<t_complex> const &sums,
+                                                              bool regular, t_int nMax,
+                                                              bool negative) {
+  // sqrt(4 pi) (-1)^(l + k) h_l Y_l,-k, and for negative m the conjugate coefficients for -k
+  // which the symmetry relationship conjugates back
+  std::vector<t_complex> result((2 * nMax + 1) * (2 * nMax + 1));
+  for(t_int l(0); l <= 2 * nMax; ++l)
+    for(t_int k(-l); k <= l; ++k) {
+      auto const sign = negative ? (regular ? k : l + k) : 0;
+      auto const kk = negative ? -k : k;
+      auto const value = std::sqrt(4e0 * constant::pi) * ((l + kk) % 2 == 0 ? 1 : -1) *
+                         sums[l * (l + 1) - kk];
+      result[l * (l + 1) + k] = negative ? std::conj(value) * t_real(sign % 2 == 0 ? 1 : -1) : value;
+    }
+  return result;
+}
+
+namespace details {
+CoaxialWeights::CoaxialWeights(t_int nMax)
+    : nmax_(nMax), offsets((nMax + 1) * (nMax + 1) * (nMax + 1), 0) {
+  // weights of the radial functions of orders 0 to 2 nmax, for n - 2, n - 1 and n
+  t_int const L = 2 * nmax_ + 1;
+  auto const position = [nMax, L](t_int n, t_int m, t_int l) -> std::size_t {
+    return ((static_cast<std::size_t>(n % 3) * (nMax + 1) + m) * L + l) * L;
+  };
+  std::vector<t_real> rolling(3 * (nmax_ + 1) * L * L, 0e0);
+  auto const weight = [&](t_int n, t_int m, t_int l) -> t_real const * {
+    return is_valid(n, m, l, m) and l <= 2 * nmax_ - n ? &rolling[position(n, m, l)] : nullptr;
+  };
+  for(t_int n(0); n <= nmax_; ++n)
+    for(t_int m(0); m <= n; ++m)
+      for(t_int l(0); l < L; ++l) {
+        auto *const result = &rolling[position(n, m, l)];
+        std::fill(result, result + L, 0e0);
+        if(l > 2 * nmax_ - n or l < m)
+          continue;
+        auto const add = [result, L](t_real const *w, t_real factor) {
+          if(w != nullptr and factor != 0)
+            for(t_int p(0); p < L; ++p)
+              result[p] += factor * w[p];
+        };
+        if(n == 0)
+          // sqrt(4 pi) (-1)^l Y_l0(0, 0)
+          result[l] = (l % 2 == 0 ? 1 : -1) * std::sqrt(2e0 * l + 1e0);
+        else if(n == m) {
+          add(weight(n - 1, n - 1, l - 1), b_plus(l - 1, m - 1) / b_plus(n - 1, n - 1));
+          add(weight(n - 1, n - 1, l + 1), b_minus(l + 1, m - 1) / b_plus(n - 1, n - 1));
+        } else {
+          add(weight(n - 2, m, l), -a_minus(n - 1, m) / a_plus(n - 1, m));
+          add(weight(n - 1, m, l - 1), a_plus(l - 1, m) / a_plus(n - 1, m));
+          add(weight(n - 1, m, l + 1), a_minus(l + 1, m) / a_plus(n - 1, m));
+        }
+        // only orders |n - l| <= p <= n + l contribute, round-off errors elsewhere would dominate
+        // the small regular coefficients
+        std::fill(result, result + std::abs(n - l), 0e0);
+        std::fill(result + std::min(n + l + 1, L), result + L, 0e0);
+        if(l <= nmax_) {
+          offsets[(n * (nmax_ + 1) + m) * (nmax_ + 1) + l] = weights.size();
+          weights.insert(weights.end(), result + std::abs(n - l), result + n + l + 1);
+        }
+      }
+}
+
+std::shared_ptr<CoaxialWeights const> CoaxialWeights::get(t_int nMax) {
+  static std::vector<std::shared_ptr<CoaxialWeights const>> tables;
+  std::shared_ptr<CoaxialWeights const> result;
+#pragma omp critical(optimet_coaxial_weights)
+  {
+    if(tables.size() <= static_cast<std::size_t>(nMax))
+      tables.resize(nMax + 1);
+    if(not tables[nMax])
+      tables[nMax] = std::make_shared<CoaxialWeights const>(nMax);
+    result = tables[nMax];
+  }
+  return result;
+}
+} // namespace details
+
+CoaxialTranslationAdditionCoefficients::CoaxialTranslationAdditionCoefficients(t_real distance,
+                                                                               t_complex waveK,
+                                                                               bool regular,
+                                                                               t_int nMax)
+    : nmax(nMax), table((nMax + 1) * (nMax + 1) * (nMax + 1), 0e0) {
+  std::vector<t_complex> radial(2 * nmax + 1);
+  if(regular)
+    optimet::bessel<Bessel>(distance * waveK, 2 * nmax, radial.data(), nullptr);
+  else
+    optimet::bessel<Hankel1>(distance * waveK, 2 * nmax, radial.data(), nullptr);
+
+  // the geometric weights are shared, only the radial functions change with the pair and k
+  auto const weights = details::CoaxialWeights::get(nmax);
+  for(t_int n(0); n <= nmax; ++n)
+    for(t_int m(0); m <= n; ++m)
+      for(t_int l(m); l <= nmax; ++l) {
+        auto const *const w = (*weights)(n, m, l);
+        t_complex value = 0;
+        for(t_int p(std::abs(n - l)); p <= n + l; ++p)
+          value += w[p - std::abs(n - l)] * radial[p];
+        table[(n * (nmax + 1) + m) * (nmax + 1) + l] = value;
+      }
+}
+
+t_complex CoaxialTranslationAdditionCoefficients::operator()(t_int n, t_int m, t_int l,
+                                                             t_int k) const {
+  if(not is_valid(n, m, l, k) or k != m)
+    return 0e0;
+  assert(n <= nmax and l <= nmax);
+  // coefficients for -m are those for m along z
+  return table[(n * (nmax + 1) + std::abs(m)) * (nmax + 1) + l];
+}
+
 } // end of optimet namespace
@@ -15,29 +15,56 @@
 // along with Optimet. If not, see <http://www.gnu.org/licenses/>.
 
 #ifndef TRANSLATION_ADDITION_COEFFICIENTS_H
+#define TRANSLATION_ADDITION_COEFFICIENTS_H
 
 #include "Types.h"
 #include <array>
-#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "Spherical.h"
+#include "constants.h"
 
 namespace optimet {
 //! Equation 1 of Appendix A in Stout (2002)
 t_complex Ynm(Spherical<t_real> const &R, t_int n, t_int m);
+//! \brief Y_lk(R) for l <= lMax and |k| <= l, at l (l + 1) + k, as Ynm
+//! \details One sweep of the Legendre recurrence for all the orders, rather than one per order.
+void spherical_harmonics(Spherical<t_real> const &R, t_int lMax, std::vector<t_complex> &result);
+//! \brief Normalized associated Legendre functions of a given m >= 0, for m <= l <= lMax
+//! \details sqrt((2l + 1) / 4 pi (l - m)! / (l + m)!) P_lm(cos θ), with the Condon-Shortley
+//! phase, at l - m. They come from the sectoral one by the three-term recurrence in l, which is
+//! stable at any angle, without the factorials which overflow for large orders.
+void legendre(t_real cosine, t_real sine, t_int m, t_int lMax, t_real *result);
 
 namespace details {
 
 //! \brief Computes translation addition coefficients for m > 0
 //! \details Equations come from Stout (2002), appendix C. Negative m coefficients should be
-//! obtained using the symmetry relationship. This class caches previously computed coefficients.
+//! obtained using the symmetry relationship. The coefficients are tabulated for n <= nMax, in the
+//! order of the recurrence. The table grows if larger indices are requested. When R lies on the z
+//! axis, only the k = m coefficients are non-zero, and only those are tabulated.
 class CachedRecurrence {
 public:
   //! Indices tuple
   typedef std::array<t_int, 4> t_indices;
 
-  CachedRecurrence(Spherical<t_real> R, t_complex waveK, bool regular = true)
-      : direction(R), waveK(waveK), regular(regular) {}
+  CachedRecurrence(Spherical<t_real> R, t_complex waveK, bool regular = true, t_int nMax = 0)
+      : direction(R), waveK(waveK), regular(regular),
+        axial(R.the == 0e0 or R.the == constant::pi), nmax(-1) {
+    if(nMax > 0)
+      tabulate(nMax);
+  }
+  //! \brief Recurrence from given coefficients of n = 0, at l (l + 1) + k for l <= 2 nMax
+  //! \details The recurrence is linear, with coefficients which do not depend on R. Given the
+  //! sums of the initial coefficients over the images of a lattice, it gives the sums of all of
+  //! them.
+  CachedRecurrence(std::vector<t_complex> seeds, bool regular, t_int nMax)
+      : direction(0, 0, 0), waveK(0), regular(regular), axial(false), nmax(-1),
+        seeds(std::move(seeds)) {
+    tabulate(nMax);
+  }
 
   //! \brief Returns translation addition coefficients
   //! \details n and m correspond to the same variables in Stout (2004), l and k correspond to ν and
@@ -53,14 +80,34 @@ protected:
   t_complex const waveK;
   //! Whether this is for regular or irregular coeffs
   bool const regular;
-  //! Caches known coefficients
-  std::map<t_indices, t_complex> cache;
+  //! Whether the direction is along z
+  bool const axial;
+  //! Largest n in the table, l goes up to 2 nmax - n
+  t_int nmax;
+  //! Coefficients for 0 <= m <= n <= nmax
+  std::vector<t_complex> table;
+  //! Bessel or Hankel functions of order 0 to 2 nmax
+  std::vector<t_complex> radial;
+  //! Spherical harmonics of the direction of order 0 to 2 nmax, at l (l + 1) + k
+  std::vector<t_complex> harmonics;
+  //! Coefficients of n = 0, if given rather than computed from R
+  std::vector<t_complex> seeds;
+
+  //! Position of (n, m, l, k) in the table
+  std::size_t index(t_int n, t_int m, t_int l, t_int k) const {
+    auto const nml = (static_cast<std::size_t>(n) * (nmax + 1) + m) * (2 * nmax + 1) + l;
+    return axial ? nml : nml * (4 * nmax + 1) + k + 2 * nmax;
+  }
+  //! Tabulated coefficient, zero outside the domain of validity
+  t_complex value(t_int n, t_int m, t_int l, t_int k) const;
+  //! Fills the table up to n = nMax, without recursion
+  void tabulate(t_int nMax);
 
   //! Switches between recurrence relationships
-  t_complex recurrence(t_int n, t_int m, t_int l, t_int k);
-  t_complex initial(t_int l, t_int k);
-  t_complex diagonal_recurrence(t_int n, t_int l, t_int k);
-  t_complex offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k);
+  t_complex recurrence(t_int n, t_int m, t_int l, t_int k) const;
+  t_complex initial(t_int l, t_int k) const;
+  t_complex diagonal_recurrence(t_int n, t_int l, t_int k) const;
+  t_complex offdiagonal_recurrence(t_int n, t_int m, t_int l, t_int k) const;
 };
 
 } // end of details namespace
@@ -69,19 +116,86 @@ protected:
 //! \details The coefficients are obtained for given wave. It is not possible to change it once set.
 class TranslationAdditionCoefficients {
 public:
-  TranslationAdditionCoefficients(Spherical<t_real> R, t_complex waveK, bool regular = true)
-      : positive(R, waveK, regular),
-        negative(R, regular ? std::conj(waveK) : -std::conj(waveK), regular) {}
+  //! \param nMax: largest n and l expected, so that the coefficients are tabulated only once
+  //! For a real wavenumber, the regular coefficients of negative m come from the same recurrence
+  //! as those of positive m, which is run only once.
+  TranslationAdditionCoefficients(Spherical<t_real> R, t_complex waveK, bool regular = true,
+                                  t_int nMax = 0)
+      : shared(regular and waveK.imag() == 0), positive(R, waveK, regular, nMax),
+        negative(R, regular ? std::conj(waveK) : -std::conj(waveK), regular, shared ? 0 : nMax) {}
+  //! \brief Coefficients summed over the images of a lattice
+  //! \details sums are those of the Bessel or Hankel functions times Y_lk over the images, at
+  //! l (l + 1) + k for l <= 2 nMax, as from LatticeSums. The table cannot grow beyond nMax.
+  TranslationAdditionCoefficients(std::vector<t_complex> const &sums, bool regular, t_int nMax)
+      : shared(false), positive(seeds(sums, regular, nMax, false), regular, nMax),
+        negative(seeds(sums, regular, nMax, true), regular, nMax) {}
 
   //! \brief Computes the coefficients as per Stout (2002)
   //! \details n, m, l, k correspond to n, m, ν, μ in Stout (2002), respectively.
   t_complex operator()(t_int n, t_int m, t_int l, t_int k);
 
 protected:
+  //! Whether the recurrence for negative m is that for positive m
+  bool const shared;
   //! Recurrence for positive m
   details::CachedRecurrence positive;
   //! Recurrence for negative m
   details::CachedRecurrence negative;
+
+  //! Coefficients of n = 0 from the sums, conjugated as per the symmetry relationship if negative
+  static std::vector<t_complex>
+  seeds(std::vector<t_complex> const &sums, bool regular, t_int nMax, bool negative);
+};
+
+namespace details {
+//! \brief Weights of the Bessel or Hankel functions in the coefficients along z
+//! \details The recurrence of Stout (2002) applied to the weights of each radial function rather
+//! than to the coefficients. The weights depend neither on the distance nor on the wavenumber: a
+//! single table serves all the pairs of particles at all the wavelengths.
+class CoaxialWeights {
+public:
+  //! \param nMax: largest n and l of the table
+  explicit CoaxialWeights(t_int nMax);
+
+  //! \brief The table for the given nMax, computed the first time it is asked for
+  static std::shared_ptr<CoaxialWeights const> get(t_int nMax);
+
+  //! Largest n and l in the table
+  t_int nmax() const { return nmax_; }
+  //! \brief Weights of the orders |n - l| to n + l for 0 <= m <= n and m <= l
+  t_real const *operator()(t_int n, t_int m, t_int l) const {
+    return &weights[offsets[(n * (nmax_ + 1) + m) * (nmax_ + 1) + l]];
+  }
+
+protected:
+  t_int nmax_;
+  //! Nonzero weights of each n, m, l, one after the other
+  std::vector<t_real> weights;
+  //! Start of the weights of n, m, l
+  std::vector<std::size_t> offsets;
+};
+} // namespace details
+
+//! \brief Translation-addition coefficients for a translation along z
+//! \details Only the k = m coefficients are non-zero. They are summed from accurate radial
+//! functions with the geometric weights of CoaxialWeights. Unlike a recurrence over the
+//! coefficients themselves, this remains accurate for large orders at short distances. The sums
+//! cost O(nMax^4), the weights being shared.
+class CoaxialTranslationAdditionCoefficients {
+public:
+  //! \param nMax: largest n and l of the table
+  CoaxialTranslationAdditionCoefficients(t_real distance, t_complex waveK, bool regular,
+                                         t_int nMax);
+
+  //! \brief Coefficients as per Stout (2002), for n, l <= nMax
+  //! \details n, m, l, k correspond to n, m, ν, μ in Stout (2002), respectively.
+  t_complex operator()(t_int n, t_int m, t_int l, t_int k) const;
+
+protected:
+  //! Largest n and l in the table
+  t_int nmax;
+  //! Coefficients for 0 <= m <= n <= nmax and l <= nmax
+  std::vector<t_complex> table;
 };
 }
 
@@ -15,27 +15,27 @@
 #ifndef OPTIMET_TRIAN_H
 #define OPTIMET_TRIAN_H
 
-#include <vector>
+#include <array>
 
 class Trian{
 private:
 
-	std::vector<double> coord1; 
-	std::vector<double> coord2; 
-	std::vector<double> coord3; 
-	std::vector<double> nvec;
-        std::vector<double> cp;
-	std::vector<double> dl;
-	std::vector<double*> lvec;
+	std::array<double, 3> coord1; 
+	std::array<double, 3> coord2; 
+	std::array<double, 3> coord3; 
+	std::array<double, 3> nvec;
+        std::array<double, 3> cp;
+	std::array<double, 3> dl;
+	std::array<std::array<double, 3>, 3> lvec;
 	double deter;
 	void calculate_parameters();    
 	
 public:
 	Trian(const double* c1, const double* c2, const double* c3);
-	const std::vector<double>& getnorm() const { return nvec; }
-        const std::vector<double>& getcp() const { return cp; }
-	const std::vector<double>& getdl() const { return dl; }
-	const std::vector<double*> getlvec() const { return lvec; }
+	const std::array<double, 3>& getnorm() const { return nvec; }
+        const std::array<double, 3>& getcp() const { return cp; }
+	const std::array<double, 3>& getdl() const { return dl; }
+	const std::array<std::array<double, 3>, 3>& getlvec() const { return lvec; }
 	double getDeter() const { return deter; }
 
 };
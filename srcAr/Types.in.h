@@ -23,6 +23,12 @@
 
 #cmakedefine OPTIMET_BELOS
 #cmakedefine OPTIMET_MPI
+#cmakedefine OPTIMET_OPENMP
+#cmakedefine OPTIMET_CALIPER
+#cmakedefine OPTIMET_SCOREP
+#cmakedefine OPTIMET_NVTX
+#cmakedefine OPTIMET_ITT
+#cmakedefine OPTIMET_PAPI
 #ifdef OPTIMET_MPI
 #cmakedefine OPTIMET_SCALAPACK
 #endif
@@ -0,0 +1,97 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#include "Writer.h"
+#include "Profile.h"
+#include <utility>
+
+namespace optimet {
+Writer::Writer(t_uint depth) : depth_(depth) {
+  if(depth_ > 0)
+    thread_ = std::thread(&Writer::loop, this);
+}
+
+Writer::~Writer() {
+  if(not thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> const lock(mutex_);
+    stop_ = true;
+  }
+  changed_.notify_all();
+  thread_.join();
+}
+
+void Writer::push(std::function<void()> job) {
+  if(depth_ == 0) {
+    job();
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  rethrow();
+  if(jobs_.size() + busy_ >= depth_) {
+    Profile::Region const timer("output wait");
+    changed_.wait(lock, [this]() { return jobs_.size() + busy_ < depth_ or error_; });
+    rethrow();
+  }
+  jobs_.push_back(std::move(job));
+  lock.unlock();
+  changed_.notify_all();
+}
+
+void Writer::flush() {
+  if(depth_ == 0)
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if(not jobs_.empty() or busy_) {
+    Profile::Region const timer("output wait");
+    changed_.wait(lock, [this]() { return jobs_.empty() and not busy_; });
+  }
+  rethrow();
+}
+
+void Writer::rethrow() {
+  if(not error_)
+    return;
+  auto const error = error_;
+  error_ = nullptr;
+  std::rethrow_exception(error);
+}
+
+void Writer::loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(true) {
+    changed_.wait(lock, [this]() { return stop_ or not jobs_.empty(); });
+    if(jobs_.empty())
+      return;
+    auto job = std::move(jobs_.front());
+    jobs_.pop_front();
+    busy_ = true;
+    lock.unlock();
+    // a failed job does not stop the ones after it, its error waits for the next push or flush
+    std::exception_ptr error;
+    try {
+      job();
+    } catch(...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if(error and not error_)
+      error_ = error;
+    busy_ = false;
+    changed_.notify_all();
+  }
+}
+} // namespace optimet
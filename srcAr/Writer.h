@@ -0,0 +1,70 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPTIMET_WRITER_H
+#define OPTIMET_WRITER_H
+
+#include "Types.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace optimet {
+/**
+ * Writes the output of a process on a thread of its own.
+ * The jobs are run in the order they are pushed, while the process goes on with its work. At most
+ * depth of them are queued or running: with two, the output of a step is written while the next
+ * one is computed, and the output of the one after waits for the first to be on disk. A job owns
+ * the data it writes. Jobs calling HDF5 hold Output::mutex(), as does any other thread calling it
+ * meanwhile. A depth of zero runs the jobs where they are pushed.
+ */
+class Writer {
+public:
+  explicit Writer(t_uint depth = 0);
+  Writer(Writer const &) = delete;
+  Writer &operator=(Writer const &) = delete;
+  //! Waits for the jobs left, dropping their errors
+  ~Writer();
+
+  //! \brief Queues a job, waiting while depth jobs are queued or running
+  //! \details Throws the error of an earlier job, if any, or of the job itself at depth zero.
+  void push(std::function<void()> job);
+  //! Waits for all the jobs, then throws the error of the first failed one, if any
+  void flush();
+  //! Jobs queued or running at most
+  t_uint depth() const { return depth_; }
+
+private:
+  //! Runs the jobs until stopped and none is left
+  void loop();
+  //! Throws the error of a job and forgets it, the lock being held
+  void rethrow();
+
+  t_uint depth_;
+  std::deque<std::function<void()>> jobs_;
+  //! Whether a job is running
+  bool busy_ = false;
+  //! Whether the thread should stop once the jobs are done
+  bool stop_ = false;
+  std::exception_ptr error_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::thread thread_;
+};
+} // namespace optimet
+#endif
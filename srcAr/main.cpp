@@ -19,6 +19,7 @@
 // Restricted to testing for the moment.
 //
 
+#include "MeshFile.h"
 #include "Simulation.h"
 #include "mpi/Session.h"
 #include <iostream>
@@ -26,9 +27,20 @@
 int main(int argc, const char *argv[]) {
 
   optimet::mpi::init(argc, argv);
-  if(argc <= 1) {
+  // converts the text files of a mesh of the library to its binary form
+  if(argc == 3 and std::string(argv[1]) == "--mesh") {
+    optimet::MeshFile::convert(argv[2]);
+    optimet::mpi::finalize();
+    return 0;
+  }
+  // a scan killed part way can be started again from its checkpoints
+  bool const resume = argc > 2 and std::string(argv[2]) == "--resume";
+  // the memory a simulation needs, without running it
+  bool const dry_run = argc > 2 and std::string(argv[2]) == "--dry-run";
+  if(argc <= 1 or (argc > 2 and not(resume or dry_run))) {
     
-    std::cerr << "Usage: " << argv[0] << " <path/to/xml/file>" << std::endl;
+    std::cerr << "Usage: " << argv[0] << " <path/to/xml/file> [--resume | --dry-run]" << std::endl;
+    std::cerr << "       " << argv[0] << " --mesh <dims>" << std::endl;
     return 1;
   }
 
@@ -40,6 +52,7 @@ int main(int argc, const char *argv[]) {
 
  
   optimet::Simulation simulation(caseFile);
+  simulation.resume(resume).dry_run(dry_run);
   simulation.run();
   simulation.done();
 
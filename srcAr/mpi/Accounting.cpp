@@ -0,0 +1,252 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+// Accounting of the MPI calls through the profiling interface: each collective adds its time and
+// the bytes this process sends and receives to the Profile registry, under the innermost region it
+// is called from, e.g. "T-matrix gather: MPI_Allgatherv". Non-blocking calls count their bytes when
+// posted, the time waiting for them going to MPI_Wait or MPI_Waitall.
+#include "Types.h"
+#if defined(OPTIMET_MPI) and not defined(OPTIMET_SCOREP)
+#include "Profile.h"
+#include <chrono>
+#include <mpi.h>
+#include <thread>
+
+namespace optimet {
+namespace {
+//! The thread running the static initialisers, the only one whose calls are counted
+std::thread::id const main_thread = std::this_thread::get_id();
+
+//! Bytes of count items of a type
+t_real bytes(int count, MPI_Datatype type) {
+  int size = 0;
+  if(count > 0)
+    PMPI_Type_size(type, &size);
+  return static_cast<t_real>(count) * size;
+}
+
+//! Bytes of the items of a type sent to, or received from, each process
+t_real bytes(int const *counts, int processes, MPI_Datatype type) {
+  t_real result = 0;
+  for(int i = 0; i < processes; ++i)
+    result += bytes(counts[i], type);
+  return result;
+}
+
+int size(MPI_Comm comm) {
+  int result;
+  PMPI_Comm_size(comm, &result);
+  return result;
+}
+
+int rank(MPI_Comm comm) {
+  int result;
+  PMPI_Comm_rank(comm, &result);
+  return result;
+}
+
+//! Number of neighbours of this process in a graph communicator
+int neighbours(MPI_Comm comm) {
+  int topology, result = 0;
+  PMPI_Topo_test(comm, &topology);
+  if(topology == MPI_GRAPH)
+    PMPI_Graph_neighbors_count(comm, rank(comm), &result);
+  else if(topology == MPI_DIST_GRAPH) {
+    int sources, weighted;
+    PMPI_Dist_graph_neighbors_count(comm, &sources, &result, &weighted);
+  }
+  return result;
+}
+
+//! Times a call, then adds it to the registry with its bytes
+class Call {
+public:
+  Call(char const *name, t_real bytes)
+      : name_(name), bytes_(bytes), start_(std::chrono::steady_clock::now()) {}
+  ~Call() {
+    if(std::this_thread::get_id() != main_thread)
+      return;
+    auto const region = Profile::current();
+    auto const name = region.empty() ? name_ : region + ": " + name_;
+    Profile::time(name, std::chrono::duration<t_real>(std::chrono::steady_clock::now() - start_)
+                            .count());
+    if(bytes_ > 0)
+      Profile::count(name + " bytes", bytes_);
+  }
+
+private:
+  std::string const name_;
+  t_real const bytes_;
+  std::chrono::steady_clock::time_point const start_;
+};
+} // namespace
+} // namespace optimet
+
+using optimet::Call;
+using optimet::bytes;
+using optimet::neighbours;
+using optimet::rank;
+using optimet::size;
+
+extern "C" {
+int MPI_Barrier(MPI_Comm comm) {
+  Call const call("MPI_Barrier", 0);
+  return PMPI_Barrier(comm);
+}
+
+int MPI_Bcast(void *buffer, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+  Call const call("MPI_Bcast", bytes(count, type));
+  return PMPI_Bcast(buffer, count, type, root, comm);
+}
+
+int MPI_Ibcast(void *buffer, int count, MPI_Datatype type, int root, MPI_Comm comm,
+               MPI_Request *request) {
+  Call const call("MPI_Ibcast", bytes(count, type));
+  return PMPI_Ibcast(buffer, count, type, root, comm, request);
+}
+
+int MPI_Reduce(void const *send, void *receive, int count, MPI_Datatype type, MPI_Op op, int root,
+               MPI_Comm comm) {
+  Call const call("MPI_Reduce", bytes(count, type) * (rank(comm) == root ? 2 : 1));
+  return PMPI_Reduce(send, receive, count, type, op, root, comm);
+}
+
+int MPI_Ireduce(void const *send, void *receive, int count, MPI_Datatype type, MPI_Op op,
+                int root, MPI_Comm comm, MPI_Request *request) {
+  Call const call("MPI_Ireduce", bytes(count, type) * (rank(comm) == root ? 2 : 1));
+  return PMPI_Ireduce(send, receive, count, type, op, root, comm, request);
+}
+
+int MPI_Allreduce(void const *send, void *receive, int count, MPI_Datatype type, MPI_Op op,
+                  MPI_Comm comm) {
+  Call const call("MPI_Allreduce", 2 * bytes(count, type));
+  return PMPI_Allreduce(send, receive, count, type, op, comm);
+}
+
+int MPI_Reduce_scatter(void const *send, void *receive, int const *counts, MPI_Datatype type,
+                       MPI_Op op, MPI_Comm comm) {
+  Call const call("MPI_Reduce_scatter",
+                  bytes(counts, size(comm), type) + bytes(counts[rank(comm)], type));
+  return PMPI_Reduce_scatter(send, receive, counts, type, op, comm);
+}
+
+int MPI_Gather(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+               int recvcount, MPI_Datatype recvtype, int root, MPI_Comm comm) {
+  Call const call("MPI_Gather",
+                  bytes(sendcount, sendtype) +
+                      (rank(comm) == root ? size(comm) * bytes(recvcount, recvtype) : 0));
+  return PMPI_Gather(send, sendcount, sendtype, receive, recvcount, recvtype, root, comm);
+}
+
+int MPI_Gatherv(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+                int const *recvcounts, int const *displs, MPI_Datatype recvtype, int root,
+                MPI_Comm comm) {
+  Call const call("MPI_Gatherv",
+                  bytes(sendcount, sendtype) +
+                      (rank(comm) == root ? bytes(recvcounts, size(comm), recvtype) : 0));
+  return PMPI_Gatherv(send, sendcount, sendtype, receive, recvcounts, displs, recvtype, root,
+                      comm);
+}
+
+int MPI_Igatherv(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+                 int const *recvcounts, int const *displs, MPI_Datatype recvtype, int root,
+                 MPI_Comm comm, MPI_Request *request) {
+  Call const call("MPI_Igatherv",
+                  bytes(sendcount, sendtype) +
+                      (rank(comm) == root ? bytes(recvcounts, size(comm), recvtype) : 0));
+  return PMPI_Igatherv(send, sendcount, sendtype, receive, recvcounts, displs, recvtype, root,
+                       comm, request);
+}
+
+int MPI_Allgather(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+                  int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+  Call const call("MPI_Allgather",
+                  bytes(sendcount, sendtype) + size(comm) * bytes(recvcount, recvtype));
+  return PMPI_Allgather(send, sendcount, sendtype, receive, recvcount, recvtype, comm);
+}
+
+int MPI_Allgatherv(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+                   int const *recvcounts, int const *displs, MPI_Datatype recvtype,
+                   MPI_Comm comm) {
+  Call const call("MPI_Allgatherv",
+                  bytes(sendcount, sendtype) + bytes(recvcounts, size(comm), recvtype));
+  return PMPI_Allgatherv(send, sendcount, sendtype, receive, recvcounts, displs, recvtype, comm);
+}
+
+int MPI_Iallgatherv(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+                    int const *recvcounts, int const *displs, MPI_Datatype recvtype,
+                    MPI_Comm comm, MPI_Request *request) {
+  Call const call("MPI_Iallgatherv",
+                  bytes(sendcount, sendtype) + bytes(recvcounts, size(comm), recvtype));
+  return PMPI_Iallgatherv(send, sendcount, sendtype, receive, recvcounts, displs, recvtype, comm,
+                          request);
+}
+
+int MPI_Alltoall(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+                 int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+  Call const call("MPI_Alltoall",
+                  size(comm) * (bytes(sendcount, sendtype) + bytes(recvcount, recvtype)));
+  return PMPI_Alltoall(send, sendcount, sendtype, receive, recvcount, recvtype, comm);
+}
+
+int MPI_Alltoallv(void const *send, int const *sendcounts, int const *sdispls,
+                  MPI_Datatype sendtype, void *receive, int const *recvcounts, int const *rdispls,
+                  MPI_Datatype recvtype, MPI_Comm comm) {
+  Call const call("MPI_Alltoallv", bytes(sendcounts, size(comm), sendtype) +
+                                       bytes(recvcounts, size(comm), recvtype));
+  return PMPI_Alltoallv(send, sendcounts, sdispls, sendtype, receive, recvcounts, rdispls,
+                        recvtype, comm);
+}
+
+int MPI_Neighbor_allgather(void const *send, int sendcount, MPI_Datatype sendtype, void *receive,
+                           int recvcount, MPI_Datatype recvtype, MPI_Comm comm) {
+  Call const call("MPI_Neighbor_allgather",
+                  neighbours(comm) * (bytes(sendcount, sendtype) + bytes(recvcount, recvtype)));
+  return PMPI_Neighbor_allgather(send, sendcount, sendtype, receive, recvcount, recvtype, comm);
+}
+
+int MPI_Ineighbor_allgatherv(void const *send, int sendcount, MPI_Datatype sendtype,
+                             void *receive, int const *recvcounts, int const *displs,
+                             MPI_Datatype recvtype, MPI_Comm comm, MPI_Request *request) {
+  auto const n = neighbours(comm);
+  Call const call("MPI_Ineighbor_allgatherv",
+                  n * bytes(sendcount, sendtype) + bytes(recvcounts, n, recvtype));
+  return PMPI_Ineighbor_allgatherv(send, sendcount, sendtype, receive, recvcounts, displs,
+                                   recvtype, comm, request);
+}
+
+int MPI_Ineighbor_alltoallv(void const *send, int const *sendcounts, int const *sdispls,
+                            MPI_Datatype sendtype, void *receive, int const *recvcounts,
+                            int const *rdispls, MPI_Datatype recvtype, MPI_Comm comm,
+                            MPI_Request *request) {
+  auto const n = neighbours(comm);
+  Call const call("MPI_Ineighbor_alltoallv",
+                  bytes(sendcounts, n, sendtype) + bytes(recvcounts, n, recvtype));
+  return PMPI_Ineighbor_alltoallv(send, sendcounts, sdispls, sendtype, receive, recvcounts,
+                                  rdispls, recvtype, comm, request);
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status) {
+  Call const call("MPI_Wait", 0);
+  return PMPI_Wait(request, status);
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[]) {
+  Call const call("MPI_Waitall", 0);
+  return PMPI_Waitall(count, requests, statuses);
+}
+}
+#endif
@@ -23,6 +23,7 @@
 #include "mpi/Communicator.h"
 #include <mpi.h>
 #include <numeric>
+#include <string>
 #include <type_traits>
 #include <vector>
 
@@ -81,6 +82,24 @@ Vector<T> broadcast(Vector<T> const &mat, Communicator const &comm, t_uint root)
   }
 }
 
+template <class T>
+typename std::enable_if<is_registered_type<T>::value, std::vector<T>>::type
+broadcast(std::vector<T> const &vec, Communicator const &comm, t_uint root) {
+  assert(root < comm.size());
+  auto const size = broadcast(vec.size(), comm, root);
+  std::vector<T> result(comm.rank() == root ? vec : std::vector<T>(size));
+  MPI_Bcast(result.data(), size, Type<T>::value, root, *comm);
+  return result;
+}
+
+inline std::string broadcast(std::string const &str, Communicator const &comm, t_uint root) {
+  assert(root < comm.size());
+  auto const size = broadcast(str.size(), comm, root);
+  std::string result(comm.rank() == root ? str : std::string(size, '\0'));
+  MPI_Bcast(&result[0], size, MPI_CHAR, root, *comm);
+  return result;
+}
+
 template <class MATRIX>
 typename std::enable_if<std::is_same<Matrix<typename MATRIX::Scalar>, MATRIX>::value, MATRIX>::type
 broadcast(Communicator const &comm, t_uint root) {
@@ -21,6 +21,7 @@
 #ifdef OPTIMET_MPI
 #include "RegisteredTypes.h"
 #include <mpi.h>
+#include <string>
 #include <type_traits>
 #include <vector>
 
@@ -55,6 +56,12 @@ all_gather(Eigen::PlainObjectBase<T> const &input, Communicator const &comm);
 template <class T> Matrix<T> broadcast(Matrix<T> const &, Communicator const &, t_uint);
 //! Broadcasts an eigen vector
 template <class T> Vector<T> broadcast(Vector<T> const &, Communicator const &, t_uint);
+//! Broadcasts a string
+std::string broadcast(std::string const &, Communicator const &, t_uint);
+//! Broadcasts a vector of registered types
+template <class T>
+typename std::enable_if<is_registered_type<T>::value, std::vector<T>>::type
+broadcast(std::vector<T> const &, Communicator const &, t_uint);
 //! Broadcasts an eigen matrix
 template <class MATRIX>
 typename std::enable_if<std::is_same<Matrix<typename MATRIX::Scalar>, MATRIX>::value, MATRIX>::type
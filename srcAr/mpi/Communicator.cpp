@@ -32,6 +32,21 @@ Communicator::Communicator(MPI_Comm const& comm) : impl(nullptr) {
   reset(&comm);
 }
 
+Communicator::Communicator() : impl(world_impl()) {
+  if(not impl) {
+    MPI_Comm const comm = MPI_COMM_WORLD;
+    reset(&comm);
+  }
+}
+
+std::shared_ptr<Communicator::Impl const> &Communicator::world_impl() {
+  static std::shared_ptr<Impl const> result;
+  return result;
+}
+
+void Communicator::world(Communicator const &comm) { world_impl() = comm.impl; }
+void Communicator::world() { world_impl().reset(); }
+
 void Communicator::reset(MPI_Comm const * const comm) {
   if(comm == nullptr) {
     impl.reset();
@@ -56,6 +71,13 @@ Communicator Communicator::split(t_int color, t_uint rank) const {
   return comm;
 }
 
+Communicator Communicator::split_shared() const {
+  MPI_Comm comm;
+  MPI_Comm_split_type(**this, MPI_COMM_TYPE_SHARED, static_cast<t_int>(rank()), MPI_INFO_NULL,
+                      &comm);
+  return comm;
+}
+
 Communicator Communicator::duplicate() const {
   MPI_Comm comm;
   MPI_Comm_dup(**this, &comm);
@@ -46,8 +46,9 @@ class Communicator {
   };
 
 public:
-  //! World communicator
-  Communicator() : Communicator(MPI_COMM_WORLD){};
+  //! \brief World communicator
+  //! \details MPI_COMM_WORLD, unless another one was set with world().
+  Communicator();
 
   virtual ~Communicator(){};
 
@@ -66,6 +67,9 @@ public:
   Communicator split(t_int color) const { return split(color, rank()); }
   //! Split current communicator
   Communicator split(t_int color, t_uint rank) const;
+  //! \brief Splits into the processes that can share memory, one communicator per node
+  //! \details Ranks are kept in the same order.
+  Communicator split_shared() const;
 
   //! True if object is root
   bool is_root() const { return rank() == root_id(); }
@@ -118,12 +122,21 @@ public:
   //! True if the communicator is valid
   bool is_valid() const { return static_cast<bool>(impl); }
 
+  //! \brief Sets the communicator of the default-constructed objects
+  //! \details Lets a group of processes run a simulation as if alone, e.g. some of the
+  //! wavelengths of a scan.
+  static void world(Communicator const &comm);
+  //! Default-constructed objects are MPI_COMM_WORLD again
+  static void world();
+
 private:
   //! Holds data associated with the context
   std::shared_ptr<Impl const> impl;
 
   //! Deletes an mpi communicator
   static void delete_comm(Impl *impl);
+  //! The communicator set with world(), if any
+  static std::shared_ptr<Impl const> &world_impl();
 
 protected:
   //! \brief Constructs a communicator
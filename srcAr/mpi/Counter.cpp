@@ -0,0 +1,64 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "mpi/Counter.h"
+#include "mpi/Collectives.h"
+#include "mpi/Session.h"
+#include <exception>
+#include <mpi.h>
+
+namespace optimet {
+namespace mpi {
+
+Counter::Counter(t_int start, Communicator const &comm) : impl(nullptr), comm_(comm) {
+  if(not initialized())
+    throw std::runtime_error("Mpi was not initialized");
+
+  // only the root holds the counter
+  MPI_Aint const bytes = comm.is_root() ? sizeof(int) : 0;
+  int *value = nullptr;
+  MPI_Win window;
+  if(MPI_Win_allocate(bytes, sizeof(int), MPI_INFO_NULL, *comm, &value, &window) != MPI_SUCCESS)
+    throw std::runtime_error("Could not allocate the counter window");
+
+  // passive target epoch for the whole life of the window
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+  if(comm.is_root())
+    *value = start;
+  MPI_Win_sync(window);
+  comm.barrier();
+
+  impl = std::shared_ptr<Impl>(new Impl{window, value}, &delete_window);
+}
+
+t_int Counter::fetch_add(t_int increment) const {
+  int const add = increment;
+  int result;
+  MPI_Fetch_and_op(&add, &result, MPI_INT, comm_.root_id(), 0, MPI_SUM, impl->window);
+  MPI_Win_flush(comm_.root_id(), impl->window);
+  return result;
+}
+
+void Counter::delete_window(Impl *const impl) {
+  if(initialized() and not finalized()) {
+    MPI_Win_unlock_all(impl->window);
+    MPI_Win_free(&impl->window);
+  }
+  delete impl;
+}
+
+} /* optimet::mpi */
+} /* optimet */
@@ -0,0 +1,67 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_MPI_COUNTER_H
+#define OPTIMET_MPI_COUNTER_H
+
+#include "Types.h"
+
+#ifdef OPTIMET_MPI
+
+#include "mpi/Communicator.h"
+#include <memory>
+#include <mpi.h>
+
+namespace optimet {
+namespace mpi {
+
+//! \brief An integer held by the root of a communicator and incremented atomically by any process
+//! \details Hands out work on demand: each increment returns a value that no other process got,
+//! without the root taking part. Copies of this object are shallow, the window is freed with the
+//! last one.
+class Counter {
+  //! Holds the window
+  struct Impl {
+    //! The window exposing the counter
+    MPI_Win window;
+    //! The memory of the counter, on the root
+    int *value;
+  };
+
+public:
+  //! Creates the counter with the given value, collective over the communicator
+  Counter(t_int start, Communicator const &comm);
+
+  //! Adds increment to the counter and returns its previous value
+  t_int fetch_add(t_int increment) const;
+
+  //! The processes sharing the counter
+  Communicator const &communicator() const { return comm_; }
+
+private:
+  //! Holds data associated with the window
+  std::shared_ptr<Impl> impl;
+  //! The processes sharing the counter
+  Communicator comm_;
+
+  //! Frees the window
+  static void delete_window(Impl *impl);
+};
+
+} /* optimet::mpi */
+} /* optimet */
+#endif /* ifdef OPTIMET_MPI */
+#endif /* ifndef OPTIMET_MPI_COUNTER_H */
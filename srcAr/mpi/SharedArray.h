@@ -0,0 +1,76 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_MPI_SHARED_ARRAY_H
+#define OPTIMET_MPI_SHARED_ARRAY_H
+
+#include "Types.h"
+
+#ifdef OPTIMET_MPI
+
+#include "mpi/Communicator.h"
+#include <memory>
+#include <mpi.h>
+
+namespace optimet {
+namespace mpi {
+
+//! \brief An array of doubles held once per node, in an MPI-3 shared memory window
+//! \details The root of the node communicator allocates the memory and the other processes
+//! of the node point into it, so that they all read and write the same copy. Copies of this
+//! object are shallow, the window is freed with the last one.
+class SharedArray {
+  //! Holds the window
+  struct Impl {
+    //! The shared memory window
+    MPI_Win window;
+    //! The memory of the root of the node
+    double *data;
+    //! The number of elements
+    t_uint size;
+  };
+
+public:
+  //! \brief Allocates the array, collective over the node communicator
+  //! \details The node communicator should only hold processes sharing memory, as given by
+  //! Communicator::split_shared.
+  SharedArray(t_uint size, Communicator const &node);
+
+  //! The shared memory
+  double *data() const { return impl->data; }
+  //! The number of elements
+  t_uint size() const { return impl->size; }
+  //! The processes sharing the array
+  Communicator const &node() const { return node_; }
+
+  //! \brief Makes the writes of each process visible to the others of the node
+  //! \details Collective over the node communicator.
+  void synchronize() const;
+
+private:
+  //! Holds data associated with the window
+  std::shared_ptr<Impl> impl;
+  //! The processes sharing the memory
+  Communicator node_;
+
+  //! Frees the window
+  static void delete_window(Impl *impl);
+};
+
+} /* optimet::mpi */
+} /* optimet */
+#endif /* ifdef OPTIMET_MPI */
+#endif /* ifndef OPTIMET_MPI_SHARED_ARRAY_H */
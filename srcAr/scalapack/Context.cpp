@@ -17,8 +17,11 @@
 #include "scalapack/Blacs.h"
 #include "scalapack/Context.h"
 #include "scalapack/InitExit.h"
+#include <algorithm>
 #include <exception>
 #include <iostream>
+#include <numeric>
+#include <vector>
 
 namespace optimet {
 namespace scalapack {
@@ -89,6 +92,25 @@ Context::Context(Context const &system, Matrix<t_uint> const &gridmap) : impl(nu
     increment_ref();
 }
 
+Context Context::NodeLocal(Sizes const &grid, mpi::Communicator const &world, bool rows) {
+  if(grid.rows * grid.cols > world.size())
+    throw std::runtime_error("The grid is larger than the processes");
+  // the processes sorted by the first rank of their node, in the order of ranks within a node
+  t_uint const leader = world.split_shared().broadcast(world.rank());
+  auto const leaders = world.all_gather(leader);
+  std::vector<t_uint> order(world.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&leaders](t_uint a, t_uint b) { return leaders[a] < leaders[b]; });
+  Matrix<t_uint> gridmap(grid.rows, grid.cols);
+  for(t_uint k = 0; k < grid.rows * grid.cols; ++k)
+    if(rows)
+      gridmap(k / grid.cols, k % grid.cols) = order[k];
+    else
+      gridmap(k % grid.rows, k / grid.rows) = order[k];
+  return Context(Context(), gridmap);
+}
+
 Matrix<t_uint> Context::rank_map() const {
   int context = **this;
   Matrix<t_uint> result(rows(), cols());
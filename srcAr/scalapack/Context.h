@@ -21,6 +21,7 @@
 #include "scalapack/Collectives.h"
 #include "scalapack/InitExit.h"
 #include "scalapack/Parameters.h"
+#include "mpi/Communicator.h"
 #include <memory>
 #include <iostream>
 
@@ -123,6 +124,12 @@ rows()) : 0; }
   //! \brief Creates the largest squarest context
   //! \see optimet::scalapack::squarest_largest_grid()
   static Context Squarest() { return Context(squarest_largest_grid(global_size())); }
+  //! \brief Creates a context whose rows, or columns, stay within the nodes
+  //! \details The processes are ordered by node, then laid out on the grid row by row, or column by
+  //! column, so that each row or column holds processes of a single node whenever the processes
+  //! per node are a multiple of its length. Collective over world, whose ranks should be the BLACS
+  //! process numbers.
+  static Context NodeLocal(Sizes const &grid, mpi::Communicator const &world, bool rows = true);
 
   //! Broadcast to other processes
   template <class T> T broadcast(T const &value, t_uint row, t_uint col) const {
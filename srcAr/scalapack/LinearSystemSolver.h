@@ -29,6 +29,7 @@
 #endif
 
 #include <tuple>
+#include <vector>
 
 namespace optimet {
 namespace scalapack {
@@ -42,6 +43,45 @@ template <class SCALAR>
 std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
 general_linear_system(Matrix<SCALAR> const &A, Matrix<SCALAR> const &b);
 
+//! LU factors of a matrix, reusable for any number of right-hand sides
+template <class SCALAR> struct LUFactors {
+  //! Factors L and U, as overwritten by pXgetrf
+  typename Matrix<SCALAR>::ConcreteMatrix LU;
+  //! Pivots of the rows
+  std::vector<int> pivots;
+  //! Info flag of pXgetrf
+  int info;
+};
+//! Factorizes a square matrix
+template <class SCALAR> LUFactors<SCALAR> lu_factorization(Matrix<SCALAR> const &A);
+//! Solves a system of linear equations from the LU factors of its matrix
+template <class SCALAR>
+std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
+lu_solve(LUFactors<SCALAR> const &factors, Matrix<SCALAR> const &b);
+
+//! \brief Solves a system of linear equations with a QR factorization
+//! \details About twice the cost of LU, but stable for rank-deficient or ill-conditioned matrices.
+template <class SCALAR>
+std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
+qr_linear_system(Matrix<SCALAR> const &A, Matrix<SCALAR> const &b);
+
+//! LU factors in single precision of a matrix kept in double precision, for iterative refinement
+struct MixedLUFactors {
+  //! The matrix itself, for the residuals
+  Matrix<std::complex<double>> A;
+  //! Its factors in single precision
+  LUFactors<std::complex<float>> LU;
+};
+//! Factorizes a square matrix in single precision
+MixedLUFactors mixed_lu_factorization(Matrix<std::complex<double>> const &A);
+//! \brief Solves a system of linear equations from the single precision factors of its matrix
+//! \details The solution is refined with the residuals in double precision, x += A^-1 (b - A x),
+//! until the residual is below tolerance relative to b. The info flag is 1 if it does not get
+//! there within the given iterations, e.g. for a matrix too ill-conditioned in single precision.
+std::tuple<Matrix<std::complex<double>>, int>
+mixed_lu_solve(MixedLUFactors const &factors, Matrix<std::complex<double>> const &b,
+               t_real tolerance = 1e-10, t_uint iterations = 10);
+
 #ifdef OPTIMET_BELOS
 //! Solve a system of linear equations using Belos
 template <class SCALARA, class SCALARB>
@@ -22,6 +22,9 @@
 #include "scalapack/LinearSystemSolver.h"
 #include "scalapack/Matrix.h"
 
+#include <algorithm>
+#include <cmath>
+#include <tuple>
 #include <vector>
 
 #ifdef OPTIMET_BELOS
@@ -64,6 +67,28 @@ OPTIMET_MACRO(c, C, std::complex<float>);
 OPTIMET_MACRO(z, Z, std::complex<double>);
 #undef OPTIMET_MACRO
 
+#define OPTIMET_MACRO(letter, LETTER, TYPE)                                                        \
+  inline void getrf(int *m, int *n, TYPE *a, int *ia, int *ja, int *desca, int *ipiv, int *info) { \
+    OPTIMET_FC_GLOBAL(p##letter##getrf, P##LETTER##GETRF)(m, n, a, ia, ja, desca, ipiv, info);     \
+  }                                                                                                \
+  inline void getrs(char const *trans, int *n, int *nrhs, TYPE const *a, int *ia, int *ja,         \
+                    int *desca, int const *ipiv, TYPE *b, int *ib, int *jb, int *descb,            \
+                    int *info) {                                                                   \
+    OPTIMET_FC_GLOBAL(p##letter##getrs, P##LETTER##GETRS)                                          \
+    (trans, n, nrhs, a, ia, ja, desca, ipiv, b, ib, jb, descb, info);                              \
+  }                                                                                                \
+  inline void gels(char const *trans, int *m, int *n, int *nrhs, TYPE *a, int *ia, int *ja,        \
+                   int *desca, TYPE *b, int *ib, int *jb, int *descb, TYPE *work, int *lwork,      \
+                   int *info) {                                                                    \
+    OPTIMET_FC_GLOBAL(p##letter##gels, P##LETTER##GELS)                                            \
+    (trans, m, n, nrhs, a, ia, ja, desca, b, ib, jb, descb, work, lwork, info);                    \
+  }
+OPTIMET_MACRO(s, S, float);
+OPTIMET_MACRO(d, D, double);
+OPTIMET_MACRO(c, C, std::complex<float>);
+OPTIMET_MACRO(z, Z, std::complex<double>);
+#undef OPTIMET_MACRO
+
 template <class SCALARA, class SCALARB>
 void sane_input(Matrix<SCALARA> const &A, Matrix<SCALARB> const &b) {
   if(A.rows() != A.cols())
@@ -90,6 +115,121 @@ template <class SCALAR> int general_linear_system_inplace(Matrix<SCALAR> &A, Mat
   return info;
 }
 
+template <class SCALAR> LUFactors<SCALAR> lu_factorization(Matrix<SCALAR> const &A) {
+  typedef typename Matrix<SCALAR>::ConcreteMatrix ConcreteMatrix;
+  if(A.rows() != A.cols())
+    throw std::runtime_error("Matrix should be square");
+  LUFactors<SCALAR> result{ConcreteMatrix(A.local(), A.context(), A.sizes(), A.blocks()),
+                           std::vector<int>(), 0};
+  if(not A.context().is_valid())
+    return result;
+  if(A.blocks().rows != A.blocks().cols)
+    throw std::runtime_error("Blocs must be square");
+  int m = A.rows(), n = A.cols(), one = 1;
+  result.pivots.resize(A.local().rows() + A.blocks().rows);
+  getrf(&m, &n, result.LU.local().data(), &one, &one, const_cast<int *>(result.LU.blacs().data()),
+        result.pivots.data(), &result.info);
+  return result;
+}
+
+template <class SCALAR>
+std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
+lu_solve(LUFactors<SCALAR> const &factors, Matrix<SCALAR> const &b) {
+  typedef typename Matrix<SCALAR>::ConcreteMatrix ConcreteMatrix;
+  auto const &A = factors.LU;
+  if(not(A.context().is_valid() and b.context().is_valid()))
+    return std::tuple<ConcreteMatrix, int>{ConcreteMatrix(b.context(), b.sizes(), b.blocks()), 0};
+  sane_input(A, b);
+  if(factors.info != 0)
+    return std::tuple<ConcreteMatrix, int>{ConcreteMatrix(b.context(), b.sizes(), b.blocks()),
+                                           factors.info};
+  ConcreteMatrix result(b.local(), b.context(), b.sizes(), b.blocks());
+  int n = A.rows(), nrhs = b.cols(), one = 1, info;
+  char const trans = 'N';
+  getrs(&trans, &n, &nrhs, A.local().data(), &one, &one, const_cast<int *>(A.blacs().data()),
+        factors.pivots.data(), result.local().data(), &one, &one,
+        const_cast<int *>(result.blacs().data()), &info);
+  return std::tuple<ConcreteMatrix, int>{std::move(result), std::move(info)};
+}
+
+template <class SCALAR>
+std::tuple<typename Matrix<SCALAR>::ConcreteMatrix, int>
+qr_linear_system(Matrix<SCALAR> const &A, Matrix<SCALAR> const &b) {
+  typedef typename Matrix<SCALAR>::ConcreteMatrix ConcreteMatrix;
+  if(not(A.context().is_valid() and b.context().is_valid()))
+    return std::tuple<ConcreteMatrix, int>{ConcreteMatrix(b.context(), b.sizes(), b.blocks()), 0};
+  sane_input(A, b);
+  ConcreteMatrix result(b.local(), b.context(), b.sizes(), b.blocks());
+  ConcreteMatrix Acopy(A.local(), A.context(), A.sizes(), A.blocks());
+  int m = A.rows(), n = A.cols(), nrhs = b.cols(), one = 1, lwork = -1, info;
+  char const trans = 'N';
+  // queries the size of the workspace first
+  std::vector<SCALAR> work(1);
+  gels(&trans, &m, &n, &nrhs, Acopy.local().data(), &one, &one,
+       const_cast<int *>(Acopy.blacs().data()), result.local().data(), &one, &one,
+       const_cast<int *>(result.blacs().data()), work.data(), &lwork, &info);
+  lwork = static_cast<int>(std::real(work[0]));
+  work.resize(std::max(lwork, 1));
+  gels(&trans, &m, &n, &nrhs, Acopy.local().data(), &one, &one,
+       const_cast<int *>(Acopy.blacs().data()), result.local().data(), &one, &one,
+       const_cast<int *>(result.blacs().data()), work.data(), &lwork, &info);
+  return std::tuple<ConcreteMatrix, int>{std::move(result), std::move(info)};
+}
+
+namespace {
+//! Norm of a distributed matrix, known on all the processes of its context
+inline t_real frobenius_norm(Matrix<std::complex<double>> const &A) {
+  double result = A.local().squaredNorm();
+  int context = *A.context(), one = 1, all = -1;
+  OPTIMET_FC_GLOBAL(dgsum2d, DGSUM2D)(&context, "A", " ", &one, &one, &result, &one, &all, &all);
+  return std::sqrt(result);
+}
+}
+
+inline MixedLUFactors mixed_lu_factorization(Matrix<std::complex<double>> const &A) {
+  Matrix<std::complex<float>> const single(A.local().cast<std::complex<float>>(), A.context(),
+                                           A.sizes(), A.blocks(), A.index());
+  return MixedLUFactors{A, lu_factorization(single)};
+}
+
+inline std::tuple<Matrix<std::complex<double>>, int>
+mixed_lu_solve(MixedLUFactors const &factors, Matrix<std::complex<double>> const &b,
+               t_real tolerance, t_uint iterations) {
+  typedef Matrix<std::complex<double>> ConcreteMatrix;
+  auto const &A = factors.A;
+  if(not(A.context().is_valid() and b.context().is_valid()))
+    return std::tuple<ConcreteMatrix, int>{ConcreteMatrix(b.context(), b.sizes(), b.blocks()), 0};
+  // solves in single precision, the solution being in double
+  auto const single_solve = [&factors](ConcreteMatrix const &rhs) {
+    Matrix<std::complex<float>> const single(rhs.local().cast<std::complex<float>>(),
+                                             rhs.context(), rhs.sizes(), rhs.blocks(),
+                                             rhs.index());
+    auto const solution = lu_solve(factors.LU, single);
+    ConcreteMatrix result(std::get<0>(solution).local().cast<std::complex<double>>(),
+                          rhs.context(), rhs.sizes(), rhs.blocks(), rhs.index());
+    return std::make_tuple(std::move(result), std::get<1>(solution));
+  };
+
+  ConcreteMatrix x(b.context(), b.sizes(), b.blocks());
+  int info;
+  std::tie(x, info) = single_solve(b);
+  if(info != 0)
+    return std::tuple<ConcreteMatrix, int>{std::move(x), info};
+  auto const norm = frobenius_norm(b);
+  for(t_uint i = 0; i < iterations; ++i) {
+    ConcreteMatrix residual = b;
+    pdgemm(-1e0, A, x, 1e0, residual);
+    if(frobenius_norm(residual) <= tolerance * norm)
+      return std::tuple<ConcreteMatrix, int>{std::move(x), 0};
+    ConcreteMatrix correction(b.context(), b.sizes(), b.blocks());
+    std::tie(correction, info) = single_solve(residual);
+    if(info != 0)
+      return std::tuple<ConcreteMatrix, int>{std::move(x), info};
+    x.local() += correction.local();
+  }
+  return std::tuple<ConcreteMatrix, int>{std::move(x), 1};
+}
+
 #ifdef OPTIMET_BELOS
 template <class SCALARA, class SCALARB>
 std::tuple<typename Matrix<SCALARA>::ConcreteMatrix, int>
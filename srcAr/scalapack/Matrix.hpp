@@ -102,6 +102,19 @@ Matrix<SCALAR>::local_indices(std::tuple<t_uint, t_uint> const &i) const {
       OPTIMET_FC_GLOBAL(indxg2p, INDXG2P)(&i_col, &nb_col, &dummy, &f_col, &np_col));
 }
 
+template <class SCALAR>
+std::tuple<t_uint, t_uint>
+Matrix<SCALAR>::global_indices(std::tuple<t_uint, t_uint, t_uint, t_uint> const &i) const {
+  // same as indxl2g, with zero-based indices
+  auto const global = [](t_uint local, t_uint block, t_uint proc, t_uint first, t_uint nprocs) {
+    return (local / block) * block * nprocs + ((nprocs + proc - first) % nprocs) * block +
+           local % block;
+  };
+  return std::tuple<t_uint, t_uint>(
+      global(std::get<0>(i), blocks().rows, std::get<2>(i), first_row(), context().rows()),
+      global(std::get<1>(i), blocks().cols, std::get<3>(i), first_col(), context().cols()));
+}
+
 template <class SCALAR> void Matrix<SCALAR>::operator=(Matrix<SCALAR> const &other) {
   if(rows() != other.rows() or cols() != other.cols())
     throw std::runtime_error("Matrices have different sizes.");
@@ -18,6 +18,7 @@
 #define OPTIMET_PARALLEL_PARAMETERS_H
 
 #include "Types.h"
+#include <string>
 
 namespace optimet {
 namespace scalapack {
@@ -34,9 +35,35 @@ struct Index {
 struct Parameters {
   t_uint block_size;
   Sizes grid;
+  //! Whether dense systems are factorized in single precision and refined in double
+  bool mixed_precision;
+  //! Whether dense systems are solved with QR rather than LU
+  bool qr_factorization;
+  //! \brief Directory of the factors of the dense systems, solved out-of-core if not empty
+  //! \details The root assembles and factorizes each matrix by panels of columns, keeping two
+  //! panels of at most scratch_memory MB in memory.
+  std::string scratch;
+  t_uint scratch_memory = 1024;
+  //! \brief Largest fraction of the particles moved since an LU factorization for which it is
+  //! corrected with a low-rank update rather than computed again, never if zero
+  t_real lowrank = 0;
+  //! \brief Whether the block size and grid are chosen by timing calibration factorizations
+  //! \details The choices are kept in tuning_profile, if not empty, for the later runs.
+  bool tune = false;
+  std::string tuning_profile;
+  //! Whether the processes of the grid are laid out by rank, or with its rows or columns on one node
+  std::string mapping = "ranks";
+  //! Threads of each process, the default of the OpenMP runtime if zero
+  t_uint threads = 0;
+  //! Binding of the threads to their places, none, close or spread
+  std::string bind = "none";
+  //! Places of the threads, the hardware threads, cores or sockets
+  std::string places = "cores";
 
-  Parameters(t_uint block_size = 64, Sizes grid = {0, 0})
-      : block_size(block_size), grid(grid) {}
+  Parameters(t_uint block_size = 64, Sizes grid = {0, 0}, bool mixed_precision = false,
+             bool qr_factorization = false)
+      : block_size(block_size), grid(grid), mixed_precision(mixed_precision),
+        qr_factorization(qr_factorization) {}
 };
 
 #ifdef OPTIMET_SCALAPACK
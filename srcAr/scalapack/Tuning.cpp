@@ -0,0 +1,131 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#include "scalapack/Tuning.h"
+#include "pugi/pugixml.hpp"
+#include "scalapack/LinearSystemSolver.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+namespace optimet {
+namespace scalapack {
+namespace {
+//! Time of the LU factorization of a well conditioned matrix of size n, on the slowest process
+t_real factorization_time(t_uint n, t_uint block_size, Sizes const &grid,
+                          mpi::Communicator const &comm, std::string const &mapping) {
+  Context const context = mapping == "ranks" ? Context(grid) :
+                                               Context::NodeLocal(grid, comm, mapping == "rows");
+  Matrix<t_complex> A(context, {n, n}, {block_size, block_size});
+  if(context.is_valid()) {
+    A.local().setRandom();
+    for(t_uint j = 0; j < static_cast<t_uint>(A.local().cols()); ++j)
+      for(t_uint i = 0; i < static_cast<t_uint>(A.local().rows()); ++i) {
+        auto const global = A.global_indices(i, j);
+        if(std::get<0>(global) == std::get<1>(global))
+          A.local()(i, j) += static_cast<t_real>(n);
+      }
+  }
+  comm.barrier();
+  auto const start = std::chrono::steady_clock::now();
+  auto const factors = lu_factorization(A);
+  comm.barrier();
+  std::chrono::duration<t_real> const elapsed = std::chrono::steady_clock::now() - start;
+  if(factors.info != 0)
+    throw std::runtime_error("A calibration factorization failed");
+  return comm.all_reduce(elapsed.count(), MPI_MAX);
+}
+} // namespace
+
+Tuning tune(t_uint N, mpi::Communicator const &comm, std::string const &profile,
+            std::string const &mapping) {
+  t_uint const n = std::max<t_uint>(1, std::min<t_uint>(N, 1024));
+  // the processes sharing a node with the root
+  t_uint const node = comm.broadcast(comm.split_shared().size());
+
+  // a choice made before for the same machine class
+  pugi::xml_document document;
+  Tuning result{0, {0, 0}, 0};
+  if(comm.is_root() and not profile.empty() and document.load_file(profile.c_str()))
+    for(auto entry = document.child("tuning").child("grid"); entry;
+        entry = entry.next_sibling("grid"))
+      if(entry.attribute("processes").as_uint() == comm.size() and
+         entry.attribute("node").as_uint() == node and entry.attribute("size").as_uint() == n and
+         entry.attribute("mapping").as_string("ranks") == mapping) {
+        result = {entry.attribute("block_size").as_uint(),
+                  {entry.attribute("rows").as_uint(), entry.attribute("cols").as_uint()},
+                  entry.attribute("seconds").as_double()};
+        break;
+      }
+  result.block_size = comm.broadcast(result.block_size);
+  result.grid.rows = comm.broadcast(result.grid.rows);
+  result.grid.cols = comm.broadcast(result.grid.cols);
+  result.seconds = comm.broadcast(result.seconds);
+  if(result.block_size > 0 and result.grid.rows * result.grid.cols > 0 and
+     result.grid.rows * result.grid.cols <= comm.size())
+    return result;
+
+  // the grids of all the processes, both ways round, and the squarest largest one
+  std::vector<Sizes> grids;
+  for(t_uint rows = 1; rows <= comm.size(); ++rows)
+    if(comm.size() % rows == 0)
+      grids.push_back({rows, comm.size() / rows});
+  auto const squarest = squarest_largest_grid(comm.size());
+  if(squarest.rows * squarest.cols != comm.size())
+    grids.push_back(squarest);
+  // at least one block per process along each side of the matrix
+  std::vector<t_uint> blocks;
+  for(t_uint const block_size : {16u, 32u, 64u, 128u, 256u})
+    if(block_size <= n)
+      blocks.push_back(block_size);
+  if(blocks.empty())
+    blocks.push_back(n);
+
+  // a first factorization is not timed, for the libraries to set up
+  factorization_time(n, blocks.front(), squarest, comm, mapping);
+  result.seconds = std::numeric_limits<t_real>::max();
+  for(auto const &grid : grids)
+    for(auto const block_size : blocks) {
+      if(block_size != blocks.front() and block_size * std::max(grid.rows, grid.cols) > n)
+        continue;
+      auto const seconds = factorization_time(n, block_size, grid, comm, mapping);
+      if(seconds < result.seconds)
+        result = {block_size, grid, seconds};
+    }
+
+  if(comm.is_root() and not profile.empty()) {
+    auto tuning = document.child("tuning");
+    if(not tuning)
+      tuning = document.append_child("tuning");
+    auto entry = tuning.append_child("grid");
+    entry.append_attribute("processes") = static_cast<unsigned int>(comm.size());
+    entry.append_attribute("node") = static_cast<unsigned int>(node);
+    entry.append_attribute("size") = static_cast<unsigned int>(n);
+    entry.append_attribute("mapping") = mapping.c_str();
+    entry.append_attribute("block_size") = static_cast<unsigned int>(result.block_size);
+    entry.append_attribute("rows") = static_cast<unsigned int>(result.grid.rows);
+    entry.append_attribute("cols") = static_cast<unsigned int>(result.grid.cols);
+    entry.append_attribute("seconds") = result.seconds;
+    if(not document.save_file(profile.c_str()))
+      std::cerr << "Could not write the tuning profile " << profile << std::endl;
+  }
+  return result;
+}
+} // scalapack
+} // optimet
@@ -0,0 +1,48 @@
+// (C) University College London 2017
+// This file is part of Optimet, licensed under the terms of the GNU Public License
+//
+// Optimet is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Optimet is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Optimet. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPTIMET_SCALAPACK_TUNING_H
+#define OPTIMET_SCALAPACK_TUNING_H
+
+#include "Types.h"
+#include "mpi/Communicator.h"
+#include "scalapack/Parameters.h"
+#include <string>
+
+namespace optimet {
+namespace scalapack {
+#ifdef OPTIMET_SCALAPACK
+//! Block size and process grid of the dense factorizations, with the time they took
+struct Tuning {
+  t_uint block_size;
+  Sizes grid;
+  //! Time of the calibration factorization, in seconds
+  t_real seconds;
+};
+
+//! \brief Block size and process grid factorizing matrices of size N fastest
+//! \details Short LU factorizations of a matrix of at most 1024 rows are timed for the block sizes
+//! and the grids of all the processes, the squarest largest grid included. A profile, if given,
+//! holds the choices made before on this machine class, for as many processes, processes per node
+//! and calibration size; a new choice is added to it by the root. The grids are laid out as given
+//! by mapping, as in Parameters. Collective over comm, which should hold all the processes of the
+//! BLACS system.
+Tuning tune(t_uint N, mpi::Communicator const &comm, std::string const &profile = "",
+            std::string const &mapping = "ranks");
+#endif
+} // scalapack
+} // optimet
+#endif